@@ -7,8 +7,8 @@ BROWSER         ?= chromium
 
 SUPPORT_MODULES := libpcre
 COMMON_MODULES  := xkbcommon
-GFX_MODULES     := pangocairo pango cairo
-XCB_MODULES     := cairo-xcb xcb-keysyms xcb-icccm xcb-ewmh xcb-util
+GFX_MODULES     := pangocairo pango cairo fontconfig
+XCB_MODULES     := cairo-xcb xcb-keysyms xcb-icccm xcb-ewmh xcb-util xcb-shm
 
 ALL_MODULES     := $(SUPPORT_MODULES) $(COMMON_MODULES) $(GFX_MODULES) $(XCB_MODULES)
 
@@ -87,7 +87,7 @@ else
   $(error Unrecognised VERBOSE: $(VERBOSE))
 endif
 
-.PHONY: all info install clean
+.PHONY: all info install clean bench
 
 all:
 
@@ -99,6 +99,9 @@ info:
 
 install: all
 
+# Run the benchmarks, see EXE type BENCH.
+bench:
+
 clean:
 	rm -rf obj priv dist
 
@@ -163,14 +166,14 @@ endif
 endef
 
 # Create an executable.
-# $(1) type (DIST|PRIV|TEST)
+# $(1) type (DIST|PRIV|TEST|BENCH)
 # $(2) path
 # $(3) sources
 # $(4) CXXFLAGS
 # $(5) static library (non-transitive) dependencies (directories)
 # $(6) LDFLAGS
 define EXE
-ifeq (,$$(findstring $(1),DIST PRIV TEST))
+ifeq (,$$(findstring $(1),DIST PRIV TEST BENCH))
   $$(error Bad EXE type $1)
 endif
 
@@ -244,6 +247,17 @@ else
 all: $$($(2)_EXE)
 endif
 
+ifeq (BENCH,$(1))
+bench: $(2)_BENCH
+
+.PHONY: $(2)_BENCH
+
+$(2)_BENCH: $$($(2)_EXE)
+ifneq ($(MODE),analysis)
+	$(V)$$($(2)_EXE)
+endif
+endif
+
 ifeq (DIST,$(1))
 install: $(2)_INSTALL
 
@@ -258,7 +272,7 @@ endef
 # SUPPORT
 #
 
-$(eval $(call LIB,terminol/support,conv.cxx debug.cxx pattern.cxx sys.cxx test.cxx time.cxx,$(SUPPORT_CFLAGS),))
+$(eval $(call LIB,terminol/support,arena.cxx bench.cxx conv.cxx debug.cxx fenwick_tree.cxx file_stream.cxx frame_trace.cxx lz.cxx pattern.cxx spill_file.cxx startup_trace.cxx sys.cxx test.cxx time.cxx,$(SUPPORT_CFLAGS),))
 
 $(eval $(call EXE,TEST,terminol/support/test-support,test_support.cxx,$(SUPPORT_CFLAGS),terminol/support,$(SUPPORT_LDFLAGS)))
 
@@ -278,16 +292,80 @@ $(eval $(call EXE,TEST,terminol/support/test-queue,test_queue.cxx,$(SUPPORT_CFLA
 
 $(eval $(call EXE,TEST,terminol/support/test-destroyer,test_destroyer.cxx,$(SUPPORT_CFLAGS),terminol/support,$(SUPPORT_LDFLAGS)))
 
+$(eval $(call EXE,TEST,terminol/support/test-flat-map,test_flat_map.cxx,$(SUPPORT_CFLAGS),terminol/support,$(SUPPORT_LDFLAGS)))
+
+$(eval $(call EXE,TEST,terminol/support/test-small-vector,test_small_vector.cxx,$(SUPPORT_CFLAGS),terminol/support,$(SUPPORT_LDFLAGS)))
+
+$(eval $(call EXE,TEST,terminol/support/test-arena,test_arena.cxx,$(SUPPORT_CFLAGS),terminol/support,$(SUPPORT_LDFLAGS)))
+
+$(eval $(call EXE,TEST,terminol/support/test-lz,test_lz.cxx,$(SUPPORT_CFLAGS),terminol/support,$(SUPPORT_LDFLAGS)))
+
+$(eval $(call EXE,TEST,terminol/support/test-fenwick-tree,test_fenwick_tree.cxx,$(SUPPORT_CFLAGS),terminol/support,$(SUPPORT_LDFLAGS)))
+
+$(eval $(call EXE,TEST,terminol/support/test-worker,test_worker.cxx,$(SUPPORT_CFLAGS),terminol/support,$(SUPPORT_LDFLAGS)))
+
+$(eval $(call EXE,TEST,terminol/support/test-selector,test_selector.cxx,$(SUPPORT_CFLAGS),terminol/support,$(SUPPORT_LDFLAGS)))
+
+$(eval $(call EXE,TEST,terminol/support/test-timer-heap,test_timer_heap.cxx,$(SUPPORT_CFLAGS),terminol/support,$(SUPPORT_LDFLAGS)))
+
+$(eval $(call EXE,TEST,terminol/support/test-startup-trace,test_startup_trace.cxx,$(SUPPORT_CFLAGS),terminol/support,$(SUPPORT_LDFLAGS)))
+
+$(eval $(call EXE,TEST,terminol/support/test-frame-trace,test_frame_trace.cxx,$(SUPPORT_CFLAGS),terminol/support,$(SUPPORT_LDFLAGS)))
+
+$(eval $(call EXE,BENCH,terminol/support/bench-rle,bench_rle.cxx,$(SUPPORT_CFLAGS),terminol/support,$(SUPPORT_LDFLAGS)))
+
+$(eval $(call EXE,BENCH,terminol/support/bench-cache,bench_cache.cxx,$(SUPPORT_CFLAGS),terminol/support,$(SUPPORT_LDFLAGS)))
+
+$(eval $(call EXE,BENCH,terminol/support/bench-queue,bench_queue.cxx,$(SUPPORT_CFLAGS),terminol/support,$(SUPPORT_LDFLAGS)))
+
 #
 # COMMON
 #
 
-$(eval $(call LIB,terminol/common,ascii.cxx bindings.cxx bit_sets.cxx buffer.cxx config.cxx data_types.cxx escape.cxx simple_deduper.cxx enums.cxx key_map.cxx parser.cxx terminal.cxx tty.cxx utf8.cxx vt_state_machine.cxx,$(COMMON_CFLAGS),terminol/support))
+$(eval $(call LIB,terminol/common,active_grid.cxx ascii.cxx bindings.cxx bit_sets.cxx buffer.cxx config.cxx control.cxx data_types.cxx draw_list.cxx escape.cxx compressed_deduper.cxx frame_scheduler.cxx deduper_factory.cxx history_budget.cxx history_export.cxx history_restore.cxx para_codec.cxx search_index.cxx search_job.cxx selection_text.cxx shell_pool.cxx simple_deduper.cxx tiered_deduper.cxx enums.cxx key_map.cxx parser.cxx terminal.cxx tty.cxx utf8.cxx vt_state_machine.cxx,$(COMMON_CFLAGS),terminol/support))
 
 $(eval $(call EXE,TEST,terminol/common/test-utf8,test_utf8.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
 
+$(eval $(call EXE,TEST,terminol/common/test-ascii,test_ascii.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
+
 $(eval $(call EXE,TEST,terminol/common/test-data-types,test_data_types.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
 
+$(eval $(call EXE,TEST,terminol/common/test-para-codec,test_para_codec.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
+
+$(eval $(call EXE,TEST,terminol/common/test-simple-deduper,test_simple_deduper.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
+
+$(eval $(call EXE,TEST,terminol/common/test-tiered-deduper,test_tiered_deduper.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
+
+$(eval $(call EXE,TEST,terminol/common/test-compressed-deduper,test_compressed_deduper.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
+
+$(eval $(call EXE,TEST,terminol/common/test-draw-list,test_draw_list.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
+
+$(eval $(call EXE,TEST,terminol/common/test-frame-scheduler,test_frame_scheduler.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
+
+$(eval $(call EXE,TEST,terminol/common/test-search-index,test_search_index.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
+
+$(eval $(call EXE,TEST,terminol/common/test-search-job,test_search_job.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
+
+$(eval $(call EXE,TEST,terminol/common/test-selection-text,test_selection_text.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
+
+$(eval $(call EXE,TEST,terminol/common/test-history-export,test_history_export.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
+
+$(eval $(call EXE,TEST,terminol/common/test-history-restore,test_history_restore.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
+
+$(eval $(call EXE,TEST,terminol/common/test-history-budget,test_history_budget.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
+
+$(eval $(call EXE,TEST,terminol/common/test-control,test_control.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
+
+$(eval $(call EXE,TEST,terminol/common/test-shell-pool,test_shell_pool.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
+
+$(eval $(call EXE,TEST,terminol/common/test-vt-state-machine,test_vt_state_machine.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
+
+$(eval $(call EXE,BENCH,terminol/common/bench-utf8,bench_utf8.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
+
+$(eval $(call EXE,BENCH,terminol/common/bench-vt-state-machine,bench_vt_state_machine.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
+
+$(eval $(call EXE,BENCH,terminol/common/bench-simple-deduper,bench_simple_deduper.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
+
 $(eval $(call EXE,PRIV,terminol/common/abuse,abuse.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
 
 $(eval $(call EXE,PRIV,terminol/common/wedge,wedge.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
@@ -306,11 +384,15 @@ $(eval $(call EXE,PRIV,terminol/common/play,play.cxx,$(COMMON_CFLAGS),terminol/c
 
 $(eval $(call EXE,PRIV,terminol/common/spinner,spinner.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
 
+$(eval $(call EXE,PRIV,terminol/common/bench,bench.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
+
+$(eval $(call EXE,PRIV,terminol/common/workload,workload.cxx,$(COMMON_CFLAGS),terminol/common,$(COMMON_LDFLAGS)))
+
 #
 # XCB
 #
 
-$(eval $(call LIB,terminol/xcb,basics.cxx common.cxx color_set.cxx dispatcher.cxx font_manager.cxx font_set.cxx screen.cxx widget.cxx,$(XCB_CFLAGS),terminol/common))
+$(eval $(call LIB,terminol/xcb,basics.cxx common.cxx color_set.cxx dispatcher.cxx font_manager.cxx font_set.cxx glyph_atlas.cxx screen.cxx shm_image.cxx widget.cxx,$(XCB_CFLAGS),terminol/common))
 
 $(eval $(call EXE,DIST,terminol/xcb/terminol,terminol.cxx,$(XCB_CFLAGS),terminol/xcb,$(XCB_LDFLAGS) -lutil))
 
@@ -0,0 +1,111 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/active_grid.hxx"
+
+ActiveGrid::ActiveGrid(int16_t rows, int16_t cols) :
+    _cols(cols),
+    _block(),
+    _rows(),
+    _order(),
+    _spare()
+{
+    ASSERT(rows > 0 && cols > 0, "");
+    relayout(rows, cols);
+    resize(rows);
+}
+
+auto ActiveGrid::push_front(const Cell * first, const Cell * last, bool cont) -> Line & {
+    ASSERT(last - first <= _cols, "");
+
+    _order.push_front(takeSpare());
+    auto & line = front();
+    auto   end  = std::copy(first, last, line.cells.begin());
+    std::fill(end, line.cells.end(), Cell::blank());
+    line.cont = cont;
+    line.wrap = last - first;
+    return line;
+}
+
+void ActiveGrid::resize(size_t rows) {
+    while (size() > rows) { pop_back(); }
+    while (size() < rows) { push_back(); }
+}
+
+void ActiveGrid::rotateDown(size_t begin, size_t end, size_t n, StyleId style) {
+    ASSERT(begin <= end && end <= size() && n <= end - begin, "");
+
+    auto first = _order.begin() + begin;
+    auto last  = _order.begin() + end;
+    std::rotate(first, last - n, last);
+
+    for (auto i = begin; i != begin + n; ++i) { (*this)[i].clear(style); }
+}
+
+void ActiveGrid::rotateUp(size_t begin, size_t end, size_t n, StyleId style) {
+    ASSERT(begin <= end && end <= size() && n <= end - begin, "");
+
+    auto first = _order.begin() + begin;
+    auto last  = _order.begin() + end;
+    std::rotate(first, first + n, last);
+
+    for (auto i = end - n; i != end; ++i) { (*this)[i].clear(style); }
+}
+
+void ActiveGrid::setCols(int16_t cols) {
+    ASSERT(cols > 0, "cols not positive.");
+    if (cols != _cols) { relayout(_rows.size(), cols); }
+}
+
+void ActiveGrid::shrink_to_fit() {
+    if (!_spare.empty()) { relayout(size(), _cols); }
+}
+
+uint32_t ActiveGrid::takeSpare() {
+    if (_spare.empty()) {
+        // Double, so that growing a line at a time stays amortised O(1).
+        relayout(std::max<size_t>(2 * _rows.size(), 1), _cols);
+    }
+
+    auto row = _spare.back();
+    _spare.pop_back();
+    return row;
+}
+
+void ActiveGrid::relayout(size_t rows, int16_t cols) {
+    ASSERT(rows >= size(), "");
+
+    std::vector<Cell> block(rows * cols, Cell::blank());
+    std::vector<Line> lines(rows);
+
+    for (size_t r = 0; r != rows; ++r) {
+        lines[r].cells = Cells(&block[r * cols], cols);
+    }
+
+    // The lines keep their order, in the first rows of the block.
+    for (size_t i = 0; i != size(); ++i) {
+        auto & from = (*this)[i];
+        auto & to   = lines[i];
+        auto   keep = std::min<size_t>(from.cells.size(), cols);
+
+        std::copy(from.cells.begin(), from.cells.begin() + keep, to.cells.begin());
+
+        if (cols == _cols) {
+            to.cont = from.cont;
+            to.wrap = from.wrap;
+        }
+        else {
+            to.cont = false;
+            to.wrap = std::min(from.wrap, cols);
+        }
+
+        _order[i] = i;
+    }
+
+    _spare.clear();
+    for (auto r = rows; r != size(); --r) { _spare.push_back(r - 1); }
+
+    _block.swap(block);
+    _rows.swap(lines);
+    _cols = cols;
+}
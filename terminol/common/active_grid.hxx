@@ -0,0 +1,159 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef COMMON__ACTIVE_GRID__HXX
+#define COMMON__ACTIVE_GRID__HXX
+
+#include "terminol/common/data_types.hxx"
+#include "terminol/support/debug.hxx"
+#include "terminol/support/pattern.hxx"
+
+#include <vector>
+#include <deque>
+#include <iterator>
+#include <algorithm>
+
+// ActiveGrid holds the lines of a buffer's active region, each line's cells
+// being a row of one contiguous block. The order of the lines is a ring of
+// row indices into the block, so adding a line at one end as another leaves
+// the other, or scrolling a region, moves indices rather than cells and
+// allocates nothing. Rows that fall out of use are kept for the next line.
+class ActiveGrid : protected Uncopyable {
+public:
+    // A row of cells in the block. Its cells are overwritten, never resized.
+    class Cells {
+        Cell    * _begin;
+        int16_t   _size;
+
+    public:
+        Cells() : _begin(nullptr), _size(0) {}
+        Cells(Cell * begin, int16_t size) : _begin(begin), _size(size) {}
+
+        Cell       * begin()       { return _begin; }
+        Cell       * end()         { return _begin + _size; }
+        const Cell * begin() const { return _begin; }
+        const Cell * end()   const { return _begin + _size; }
+
+        size_t size()  const { return _size; }
+        bool   empty() const { return _size == 0; }
+
+        Cell       & operator [] (size_t i)       { return _begin[i]; }
+        const Cell & operator [] (size_t i) const { return _begin[i]; }
+    };
+
+    struct Line {
+        Cells   cells;
+        bool    cont;       // does this line continue on the next line?
+        int16_t wrap;       // wrappable index, <= cells.size()
+
+        Line() : cells(), cont(false), wrap(0) {}
+
+        void clear(StyleId style) {
+            cont = false;
+            wrap = 0;
+            std::fill(cells.begin(), cells.end(), Cell::blank(style));
+        }
+
+        bool isBlank() const {
+            for (auto & c : cells) {
+                if (c != Cell::blank()) { return false; }
+            }
+            return true;
+        }
+    };
+
+    template <typename Grid, typename Value>
+    class Iterator : public std::iterator<std::bidirectional_iterator_tag, Value> {
+        Grid   * _grid;
+        size_t   _row;
+
+    public:
+        Iterator(Grid * grid, size_t row) : _grid(grid), _row(row) {}
+
+        Value & operator *  () const { return (*_grid)[_row]; }
+        Value * operator -> () const { return &(*_grid)[_row]; }
+
+        Iterator & operator ++ () { ++_row; return *this; }
+        Iterator & operator -- () { --_row; return *this; }
+
+        Iterator operator + (ptrdiff_t n) const { return Iterator(_grid, _row + n); }
+        Iterator operator - (ptrdiff_t n) const { return Iterator(_grid, _row - n); }
+
+        ptrdiff_t operator - (const Iterator & rhs) const { return _row - rhs._row; }
+
+        bool operator == (const Iterator & rhs) const { return _row == rhs._row; }
+        bool operator != (const Iterator & rhs) const { return _row != rhs._row; }
+    };
+
+    typedef Iterator<ActiveGrid, Line>             iterator;
+    typedef Iterator<const ActiveGrid, const Line> const_iterator;
+
+private:
+    int16_t               _cols;
+    std::vector<Cell>     _block;       // _cols cells for each of _rows.
+    std::vector<Line>     _rows;        // Each over its stretch of _block.
+    std::deque<uint32_t>  _order;       // Index into _rows of each line, first to last.
+    std::vector<uint32_t> _spare;       // Indices into _rows of no line.
+
+public:
+    ActiveGrid(int16_t rows, int16_t cols);
+
+    size_t size()  const { return _order.size(); }
+    bool   empty() const { return _order.empty(); }
+
+    Line       & operator [] (size_t i)       { return _rows[_order[i]]; }
+    const Line & operator [] (size_t i) const { return _rows[_order[i]]; }
+
+    Line       & front()       { return _rows[_order.front()]; }
+    const Line & front() const { return _rows[_order.front()]; }
+    Line       & back()        { return _rows[_order.back()]; }
+    const Line & back()  const { return _rows[_order.back()]; }
+
+    iterator       begin()       { return iterator(this, 0); }
+    iterator       end()         { return iterator(this, size()); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end()   const { return const_iterator(this, size()); }
+
+    void pop_front() { _spare.push_back(_order.front()); _order.pop_front(); }
+    void pop_back()  { _spare.push_back(_order.back());  _order.pop_back(); }
+
+    // Add a blank line. May invalidate references to lines.
+    Line & push_back(StyleId style = StyleTable::DEFAULT) {
+        _order.push_back(takeSpare());
+        auto & line = back();
+        line.clear(style);
+        return line;
+    }
+
+    // Add a line of the cells in [first, last), padded with blanks. May
+    // invalidate references to lines.
+    Line & push_front(const Cell * first, const Cell * last, bool cont);
+
+    // Add or remove blank lines at the back.
+    void resize(size_t rows);
+
+    // Move the lines in [begin, end) 'n' places towards 'end', those moved
+    // off the end becoming blank lines at 'begin'. Or the reverse.
+    void rotateDown(size_t begin, size_t end, size_t n, StyleId style);
+    void rotateUp(size_t begin, size_t end, size_t n, StyleId style);
+
+    // Clip or pad every line to 'cols'. Clears 'cont' of every line.
+    void setCols(int16_t cols);
+
+    // Release the rows of no line.
+    void shrink_to_fit();
+
+    size_t bytes() const {
+        return _block.capacity() * sizeof(Cell) +
+            _rows.capacity() * sizeof(Line) +
+            (_order.size() + _spare.capacity()) * sizeof(uint32_t);
+    }
+
+protected:
+    uint32_t takeSpare();
+
+    // Lay out 'rows' rows of 'cols' in a new block, keeping the lines.
+    void relayout(size_t rows, int16_t cols);
+};
+
+#endif // COMMON__ACTIVE_GRID__HXX
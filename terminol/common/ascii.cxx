@@ -2,3 +2,51 @@
 // Copyright © 2013 David Bryant
 
 #include "terminol/common/ascii.hxx"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#  include <immintrin.h>
+#endif
+
+size_t printableRun(const uint8_t * data, size_t size) {
+    size_t i = 0;
+
+    // Compared as signed bytes, '\x80'..'\xFF' are negative and so fall below
+    // SPACE along with the controls. A clear bit in the mask marks the first
+    // byte that ends the run.
+
+#if defined(__AVX2__)
+    auto low32  = _mm256_set1_epi8(SPACE - 1);
+    auto high32 = _mm256_set1_epi8(DEL);
+
+    for (; i + 32 <= size; i += 32) {
+        auto v    = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+        auto ok   = _mm256_and_si256(_mm256_cmpgt_epi8(v, low32),
+                                     _mm256_cmpgt_epi8(high32, v));
+        auto mask = static_cast<uint32_t>(_mm256_movemask_epi8(ok));
+        if (mask != 0xFFFFFFFFu) {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+#endif
+
+#if defined(__SSE2__)
+    auto low16  = _mm_set1_epi8(SPACE - 1);
+    auto high16 = _mm_set1_epi8(DEL);
+
+    for (; i + 16 <= size; i += 16) {
+        auto v    = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+        auto ok   = _mm_and_si128(_mm_cmpgt_epi8(v, low16),
+                                  _mm_cmpgt_epi8(high16, v));
+        auto mask = static_cast<uint32_t>(_mm_movemask_epi8(ok));
+        if (mask != 0xFFFFu) {
+            return i + __builtin_ctz(~mask);
+        }
+    }
+#endif
+
+    for (; i != size; ++i) {
+        if (!isPrintable(data[i])) { break; }
+    }
+
+    return i;
+}
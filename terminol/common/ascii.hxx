@@ -8,6 +8,7 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <cstddef>
 
 const uint8_t NUL   = '\x00';  // '\0'
 const uint8_t SOH   = '\x01';
@@ -50,6 +51,15 @@ const uint8_t SPACE = '\x20';
 
 const uint8_t DEL   = '\x7F';
 
+// Is the byte a printable ASCII character ('\x20'..'\x7E')?
+inline bool isPrintable(uint8_t c) {
+    return c >= SPACE && c < DEL;
+}
+
+// Length of the run of printable ASCII characters at the start of data.
+// Vectorised with SSE2/AVX2 where the compiler targets them.
+size_t printableRun(const uint8_t * data, size_t size);
+
 // Streaming helper.
 struct Char {
     explicit Char(uint8_t c_) : c(c_) {}
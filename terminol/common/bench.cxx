@@ -0,0 +1,274 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+// Record the output of a command through a pty, or replay a recording
+// through Terminal, Buffer and VtStateMachine with a null renderer and
+// report throughput. Replays are deterministic, so the figures can be
+// compared before and after a change to the parser or buffer.
+
+#include "terminol/common/terminal.hxx"
+#include "terminol/common/deduper_factory.hxx"
+#include "terminol/support/sync_destroyer.hxx"
+#include "terminol/support/cmdline.hxx"
+
+#include <fstream>
+#include <memory>
+#include <iomanip>
+#include <iterator>
+
+#include <unistd.h>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+class Recorder : public Tty::I_Observer {
+    std::ofstream & _ofs;
+    size_t          _bytes;
+    bool            _reaped;
+
+public:
+    explicit Recorder(std::ofstream & ofs) : _ofs(ofs), _bytes(0), _reaped(false) {}
+    virtual ~Recorder() {}
+
+    size_t bytes()  const { return _bytes; }
+    bool   reaped() const { return _reaped; }
+
+    // Tty::I_Observer implementation:
+
+    void ttyData(const uint8_t * data, size_t size) override {
+        _ofs.write(reinterpret_cast<const char *>(data), size);
+        _bytes += size;
+    }
+
+    void ttySync() override {}
+
+    void ttyReaped(int UNUSED(status)) override {
+        _reaped = true;
+    }
+};
+
+// Counts what the parser sees, independently of Terminal.
+class Counter : public VtStateMachine::I_Observer {
+public:
+    size_t chars;
+    size_t controls;
+    size_t escapes;
+
+    Counter() : chars(0), controls(0), escapes(0) {}
+    virtual ~Counter() {}
+
+    // VtStateMachine::I_Observer implementation:
+
+    void machineNormal(utf8::Seq UNUSED(seq), utf8::Length UNUSED(length)) override { ++chars; }
+    void machineControl(uint8_t UNUSED(control)) override { ++controls; }
+    void machineSimpleEsc(const SimpleEsc & UNUSED(esc)) override { ++escapes; }
+    void machineCsiEsc(const CsiEsc & UNUSED(esc)) override { ++escapes; }
+    void machineDcsEsc(const DcsEsc & UNUSED(esc)) override { ++escapes; }
+    void machineOscEsc(const OscEsc & UNUSED(esc)) override { ++escapes; }
+};
+
+// Accepts everything Terminal draws and counts it.
+class NullObserver : public Terminal::I_Observer {
+    std::string _displayName;
+
+public:
+    size_t frames;
+    size_t scrolls;
+    size_t bgs;
+    size_t fgs;
+    size_t cursors;
+
+    NullObserver() :
+        _displayName(), frames(0), scrolls(0), bgs(0), fgs(0), cursors(0) {}
+    virtual ~NullObserver() {}
+
+    // Terminal::I_Observer implementation:
+
+    const std::string & terminalGetDisplayName() const override { return _displayName; }
+    void terminalCopy(const std::shared_ptr<const SelectionText> & UNUSED(text),
+                      Terminal::Selection                          UNUSED(selection)) override {}
+    void terminalPaste(Terminal::Selection UNUSED(selection)) override {}
+    void terminalResizeLocalFont(int UNUSED(delta)) override {}
+    void terminalResizeGlobalFont(int UNUSED(delta)) override {}
+    void terminalResetTitleAndIcon() override {}
+    void terminalSetWindowTitle(const std::string & UNUSED(str),
+                                bool UNUSED(transient)) override {}
+    void terminalSetIconName(const std::string & UNUSED(str)) override {}
+    void terminalBell() override {}
+    void terminalResizeBuffer(int16_t UNUSED(rows), int16_t UNUSED(cols)) override {}
+    bool terminalFixDamageBegin() override { ++frames; return true; }
+    bool terminalScroll(int16_t UNUSED(begin), int16_t UNUSED(end),
+                        int16_t UNUSED(rows)) override { ++scrolls; return true; }
+    void terminalDrawBg(UColor UNUSED(color),
+                        const std::vector<CellRect> & UNUSED(rects)) override { ++bgs; }
+    void terminalDrawFg(int16_t UNUSED(row), const std::vector<FgRun> & runs,
+                        const uint8_t * UNUSED(str),
+                        size_t UNUSED(size)) override { fgs += runs.size(); }
+    void terminalDrawCursor(Pos UNUSED(pos), UColor UNUSED(fg), UColor UNUSED(bg),
+                            AttrSet UNUSED(attrs), const uint8_t * UNUSED(str),
+                            size_t UNUSED(size), bool UNUSED(wrapNext),
+                            bool UNUSED(focused)) override { ++cursors; }
+    bool terminalBlitRow(int16_t UNUSED(row),
+                         const Buffer::RowKey & UNUSED(key)) override { return false; }
+    void terminalCaptureRow(int16_t UNUSED(row),
+                            const Buffer::RowKey & UNUSED(key)) override {}
+    void terminalDrawScrollbar(size_t UNUSED(totalRows), size_t UNUSED(historyOffset),
+                               int16_t UNUSED(visibleRows)) override {}
+    void terminalFixDamageEnd(const RegionSet & UNUSED(damage),
+                              bool UNUSED(scrollbar)) override {}
+    void terminalReaped(int UNUSED(status)) override {}
+};
+
+void record(const Config          & config,
+            const std::string     & path,
+            int16_t                 rows,
+            int16_t                 cols,
+            const Tty::Command    & command) {
+    std::ofstream ofs(path.c_str(), std::ios::binary);
+    ENFORCE(ofs.good(), "Failed to open: " << path);
+
+    Selector selector;
+    Recorder recorder(ofs);
+
+    try {
+        Tty tty(recorder, selector, config, rows, cols, "0", command, "");
+
+        while (tty.isOpen()) { selector.animate(); }
+        while (!recorder.reaped()) {
+            tty.tryReap();
+            if (!recorder.reaped()) { ::usleep(10000); }
+        }
+    }
+    catch (const Tty::Error & error) {
+        FATAL(error.message);
+    }
+
+    std::cout << "Recorded " << recorder.bytes() << " bytes to " << path << std::endl;
+}
+
+void replay(const Config      & config,
+            const std::string & path,
+            int16_t             rows,
+            int16_t             cols,
+            size_t              chunk,
+            int                 repeat) {
+    std::ifstream ifs(path.c_str(), std::ios::binary);
+    ENFORCE(ifs.good(), "Failed to open: " << path);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(ifs)),
+                              std::istreambuf_iterator<char>());
+    ENFORCE(!data.empty(), "Empty recording: " << path);
+
+    // Untimed pass to count what the stream contains.
+    Counter        counter;
+    {
+        VtStateMachine machine(counter, config);
+        utf8::Machine  decoder;
+        for (auto byte : data) {
+            if (decoder.consume(byte) == utf8::Machine::State::ACCEPT) {
+                machine.consume(decoder.seq(), decoder.length());
+            }
+        }
+    }
+
+    // The shell only swallows anything Terminal writes back, e.g. replies
+    // to device attribute queries.
+    Selector                   selector;
+    SyncDestroyer              destroyer;
+    std::unique_ptr<I_Deduper> deduper(createDeduper(config, destroyer));
+    NullObserver               observer;
+    Clock::duration            elapsed(0);
+
+    try {
+        Terminal terminal(observer, config, selector, *deduper, destroyer, rows, cols,
+                          "0", Tty::Command{ "/bin/sh", "-c", "exec cat > /dev/null" }, "");
+
+        for (int i = 0; i != repeat; ++i) {
+            auto start = Clock::now();
+            for (size_t offset = 0; offset < data.size(); offset += chunk) {
+                terminal.replay(&data[offset], std::min(chunk, data.size() - offset));
+            }
+            elapsed += Clock::now() - start;
+        }
+
+        terminal.killReap();
+    }
+    catch (const Tty::Error & error) {
+        FATAL(error.message);
+    }
+
+    auto seconds = std::chrono::duration_cast<std::chrono::duration<double>>(elapsed).count();
+    auto bytes   = double(data.size()) * repeat;
+    auto frames  = std::max<size_t>(observer.frames, 1);
+    auto draws   = observer.scrolls + observer.bgs + observer.fgs + observer.cursors;
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "bytes:       " << size_t(bytes) << " in " << seconds << " s" << std::endl
+              << "throughput:  " << bytes / (1 << 20) / seconds << " MB/s" << std::endl
+              << "escapes:     " << counter.escapes * repeat << ", "
+              << counter.escapes * repeat / seconds << " /s" << std::endl
+              << "controls:    " << counter.controls * repeat << std::endl
+              << "cells:       " << counter.chars * repeat << std::endl
+              << "frames:      " << observer.frames << std::endl
+              << "draws/frame: " << double(draws) / frames
+              << " (scroll " << double(observer.scrolls) / frames
+              << ", bg " << double(observer.bgs) / frames
+              << ", fg " << double(observer.fgs) / frames
+              << ", cursor " << double(observer.cursors) / frames << ")" << std::endl;
+}
+
+std::string makeHelp(const std::string & progName) {
+    std::ostringstream ost;
+    ost << "Usage: " << progName << " [OPTION]... record FILE -- COMMAND..." << std::endl
+        << "       " << progName << " [OPTION]... replay FILE" << std::endl
+        << std::endl
+        << "Options:" << std::endl
+        << "  --help" << std::endl
+        << "  --rows=ROWS       (default 24)" << std::endl
+        << "  --cols=COLS       (default 80)" << std::endl
+        << "  --chunk=BYTES     replay, bytes per frame (default 65536)" << std::endl
+        << "  --repeat=COUNT    replay, passes over the recording (default 1)" << std::endl
+        ;
+    return ost.str();
+}
+
+} // namespace {anonymous}
+
+int main(int argc, char * argv[]) {
+    Config config;
+    int    rows   = 24;
+    int    cols   = 80;
+    int    chunk  = 64 << 10;
+    int    repeat = 1;
+
+    CmdLine cmdLine(makeHelp(argv[0]), "bench");
+    cmdLine.add(new IntHandler(rows),   '\0', "rows");
+    cmdLine.add(new IntHandler(cols),   '\0', "cols");
+    cmdLine.add(new IntHandler(chunk),  '\0', "chunk");
+    cmdLine.add(new IntHandler(repeat), '\0', "repeat");
+
+    try {
+        auto arguments = cmdLine.parse(argc, const_cast<const char **>(argv));
+
+        if (rows <= 0 || cols <= 0 || chunk <= 0 || repeat <= 0) {
+            FATAL("Options must be positive.");
+        }
+
+        if (arguments.size() >= 3 && arguments[0] == "record") {
+            Tty::Command command(arguments.begin() + 2, arguments.end());
+            record(config, arguments[1], rows, cols, command);
+        }
+        else if (arguments.size() == 2 && arguments[0] == "replay") {
+            replay(config, arguments[1], rows, cols, chunk, repeat);
+        }
+        else {
+            std::cerr << makeHelp(argv[0]);
+            return 1;
+        }
+    }
+    catch (const CmdLine::Error & error) {
+        FATAL(error.message);
+    }
+
+    return 0;
+}
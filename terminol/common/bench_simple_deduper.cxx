@@ -0,0 +1,69 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/simple_deduper.hxx"
+#include "terminol/support/sync_destroyer.hxx"
+#include "terminol/support/bench.hxx"
+
+namespace {
+
+// Paragraphs of plain and styled text, some of them repeated, as in a
+// scrollback of build output.
+std::vector<std::vector<Cell>> makeCorpus() {
+    std::vector<std::vector<Cell>> paras;
+
+    for (int i = 0; i != 256; ++i) {
+        std::vector<Cell> cells;
+        auto              length = 20 + (i * 37) % 200;
+        Style             style;
+
+        for (int j = 0; j != length; ++j) {
+            if (i % 3 == 0 && j % 10 == 0) {
+                style.fg = UColor::indexed((i + j) % 16);
+            }
+            cells.push_back(Cell::ascii('a' + (i % 4 == 0 ? j : i + j) % 26, style));
+        }
+
+        paras.push_back(cells);
+    }
+
+    return paras;
+}
+
+} // namespace {anonymous}
+
+int main() {
+    Bench         bench("simple-deduper");
+    SyncDestroyer destroyer;
+    SimpleDeduper deduper(destroyer);
+
+    auto   paras = makeCorpus();
+    size_t cells = 0;
+    for (auto & para : paras) { cells += para.size(); }
+    auto   bytes = cells * sizeof(Cell) / paras.size();
+
+    std::vector<I_Deduper::Tag> tags;
+    for (auto & para : paras) { tags.push_back(deduper.store(para)); }
+
+    size_t next = 0;
+
+    // Each store is matched by a remove, so the table holds steady.
+    bench.run("store-remove", bytes, [&] {
+        auto tag = deduper.store(paras[next++ % paras.size()]);
+        deduper.remove(tag);
+    });
+
+    std::vector<Cell> output;
+    bool              cont;
+    int16_t           wrap;
+
+    bench.run("lookup-segment-80", 80 * sizeof(Cell), [&] {
+        output.clear();
+        deduper.lookupSegment(tags[next++ % tags.size()], 0, 80, output, cont, wrap);
+        Bench::keep(output);
+    });
+
+    for (auto tag : tags) { deduper.remove(tag); }
+
+    return 0;
+}
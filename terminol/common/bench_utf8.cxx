@@ -0,0 +1,58 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/utf8.hxx"
+#include "terminol/support/bench.hxx"
+
+#include <string>
+
+namespace {
+
+std::string repeat(const std::string & str, size_t size) {
+    std::string result;
+    while (result.size() < size) { result += str; }
+    return result;
+}
+
+void runMachine(Bench & bench, const std::string & name, const std::string & corpus) {
+    auto data = reinterpret_cast<const uint8_t *>(corpus.data());
+
+    bench.run(name, corpus.size(), [&] {
+        utf8::Machine machine;
+        size_t        accepted = 0;
+        for (size_t i = 0; i != corpus.size(); ++i) {
+            if (machine.consume(data[i]) == utf8::Machine::State::ACCEPT) { ++accepted; }
+        }
+        Bench::keep(accepted);
+    });
+}
+
+void runDecodeRun(Bench & bench, const std::string & name, const std::string & corpus) {
+    auto                   data = reinterpret_cast<const uint8_t *>(corpus.data());
+    std::vector<utf8::Seq> seqs;
+
+    bench.run(name, corpus.size(), [&] {
+        seqs.clear();
+        Bench::keep(utf8::decodeRun(data, corpus.size(), seqs));
+    });
+}
+
+} // namespace {anonymous}
+
+int main() {
+    Bench bench("utf8");
+
+    const size_t SIZE  = 64 << 10;
+    auto         ascii = repeat("The quick brown fox jumps over the lazy dog. ", SIZE);
+    auto         mixed = repeat("na\xC3\xAFve caf\xC3\xA9 \xE2\x94\x82 \xE2\x86\x92 ", SIZE);
+    auto         cjk   = repeat("\xE4\xB8\xAD\xE6\x96\x87\xE6\xB5\x8B\xE8\xAF\x95", SIZE);
+
+    runMachine(bench, "machine-ascii", ascii);
+    runMachine(bench, "machine-mixed", mixed);
+    runMachine(bench, "machine-cjk",   cjk);
+
+    runDecodeRun(bench, "decode-run-mixed", mixed);
+    runDecodeRun(bench, "decode-run-cjk",   cjk);
+
+    return 0;
+}
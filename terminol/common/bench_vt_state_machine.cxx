@@ -0,0 +1,97 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/vt_state_machine.hxx"
+#include "terminol/support/bench.hxx"
+
+#include <sstream>
+
+namespace {
+
+class NullObserver : public VtStateMachine::I_Observer {
+public:
+    size_t events;
+
+    NullObserver() : events(0) {}
+    virtual ~NullObserver() {}
+
+    // VtStateMachine::I_Observer implementation:
+
+    void machineNormal(utf8::Seq UNUSED(seq), utf8::Length UNUSED(length)) override { ++events; }
+    void machineControl(uint8_t UNUSED(control)) override { ++events; }
+    void machineSimpleEsc(const SimpleEsc & UNUSED(esc)) override { ++events; }
+    void machineCsiEsc(const CsiEsc & UNUSED(esc)) override { ++events; }
+    void machineDcsEsc(const DcsEsc & UNUSED(esc)) override { ++events; }
+    void machineOscEsc(const OscEsc & UNUSED(esc)) override { ++events; }
+};
+
+// The corpus is pre-decoded, so only the state machine is timed.
+struct Corpus {
+    std::vector<utf8::Seq>    seqs;
+    std::vector<utf8::Length> lengths;
+    size_t                    bytes;
+
+    explicit Corpus(const std::string & str) : seqs(), lengths(), bytes(str.size()) {
+        utf8::Machine machine;
+        for (auto c : str) {
+            if (machine.consume(c) == utf8::Machine::State::ACCEPT) {
+                seqs.push_back(machine.seq());
+                lengths.push_back(machine.length());
+            }
+        }
+    }
+};
+
+std::string makeText() {
+    std::ostringstream ost;
+    for (int i = 0; i != 1000; ++i) {
+        ost << "line " << i << ": the quick brown fox jumps over the lazy dog\r\n";
+    }
+    return ost.str();
+}
+
+std::string makeSgr() {
+    std::ostringstream ost;
+    for (int i = 0; i != 1000; ++i) {
+        ost << "\x1B[38;2;" << i % 256 << ';' << i * 7 % 256 << ';' << i * 13 % 256 << 'm' << 'x'
+            << "\x1B[1;4;3" << i % 8 << "m" << "word" << "\x1B[0m";
+        if (i % 16 == 15) { ost << "\r\n"; }
+    }
+    return ost.str();
+}
+
+std::string makeCursor() {
+    std::ostringstream ost;
+    for (int i = 0; i != 1000; ++i) {
+        ost << CsiEsc::CUP(i % 24 + 1, i % 80 + 1) << "ab" << "\x1B[K"
+            << "\x1B" "7" "\x1B[?25l" "\x1B" "8" "\x1B]0;title " << i << '\x07';
+    }
+    return ost.str();
+}
+
+void runCorpus(Bench & bench, const std::string & name, const std::string & str) {
+    Config         config;
+    NullObserver   observer;
+    VtStateMachine machine(observer, config);
+    Corpus         corpus(str);
+
+    bench.run(name, corpus.bytes, [&] {
+        for (size_t i = 0; i != corpus.seqs.size(); ++i) {
+            machine.consume(corpus.seqs[i], corpus.lengths[i]);
+        }
+    });
+
+    Bench::keep(observer.events);
+}
+
+} // namespace {anonymous}
+
+int main() {
+    Bench bench("vt-state-machine");
+
+    runCorpus(bench, "text",   makeText());
+    runCorpus(bench, "sgr",    makeSgr());
+    runCorpus(bench, "cursor", makeCursor());
+
+    return 0;
+}
@@ -52,6 +52,14 @@ std::ostream & operator << (std::ostream & ost, Action action) {
             return ost << "CLEAR_HISTORY";
         case Action::SEARCH:
             return ost << "SEARCH";
+        case Action::SEARCH_NEXT:
+            return ost << "SEARCH_NEXT";
+        case Action::SEARCH_PREV:
+            return ost << "SEARCH_PREV";
+        case Action::EXPORT_HISTORY:
+            return ost << "EXPORT_HISTORY";
+        case Action::EXPORT_HISTORY_SGR:
+            return ost << "EXPORT_HISTORY_SGR";
         case Action::DEBUG_GLOBAL_TAGS:
             return ost << "DEBUG_GLOBAL_TAGS";
         case Action::DEBUG_LOCAL_TAGS:
@@ -68,6 +76,8 @@ std::ostream & operator << (std::ostream & ost, Action action) {
             return ost << "DEBUG_STATS";
         case Action::DEBUG_STATS2:
             return ost << "DEBUG_STATS2";
+        case Action::DEBUG_FRAMES:
+            return ost << "DEBUG_FRAMES";
     }
 
     FATAL("Invalid action: " << static_cast<int>(action));
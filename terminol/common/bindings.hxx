@@ -58,6 +58,10 @@ enum class Action {
     SCROLL_BOTTOM,
     CLEAR_HISTORY,
     SEARCH,
+    SEARCH_NEXT,
+    SEARCH_PREV,
+    EXPORT_HISTORY,
+    EXPORT_HISTORY_SGR,
     DEBUG_GLOBAL_TAGS,
     DEBUG_LOCAL_TAGS,
     DEBUG_HISTORY,
@@ -65,7 +69,8 @@ enum class Action {
     DEBUG_MODES,
     DEBUG_SELECTION,
     DEBUG_STATS,
-    DEBUG_STATS2
+    DEBUG_STATS2,
+    DEBUG_FRAMES
 };
 
 std::ostream & operator << (std::ostream & ost, Action action);
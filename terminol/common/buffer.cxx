@@ -3,6 +3,122 @@
 
 #include "terminol/common/buffer.hxx"
 #include "terminol/common/escape.hxx"
+#include "terminol/common/history_restore.hxx"
+#include "terminol/common/para_codec.hxx"
+#include "terminol/support/hash.hxx"
+
+#include <unordered_map>
+#include <cstdlib>
+
+namespace {
+
+const size_t   REFLOW_MIN_ROWS   = 256;      // Indexed immediately, beyond what is needed.
+const size_t   REFLOW_CHUNK_ROWS = 16384;    // Indexed by each continueReflow().
+const size_t   SEARCH_THREADS    = 4;        // At most, to search the history.
+const size_t   TRIM_BATCH        = 64;       // Excess paragraphs allowed, then released together.
+
+//
+// History snapshot layout:
+//
+//   char[8]  magic
+//   uint32_t version
+//   uint32_t number of paragraphs (N)
+//   N * (uint32_t number, paragraph if first occurrence of number)
+//
+// where a paragraph is:
+//
+//   uint32_t size, uint64_t hash (hash64() of the following size bytes),
+//   uint32_t length (cells), uint32_t number of styles (S), S * Style,
+//   encoded bytes
+//
+// where the encoded bytes number the styles 0 to S - 1 in place of their ids.
+//
+// Numbers are assigned in order of first occurrence, so duplicate
+// paragraphs are written once and the snapshot can be streamed in one pass.
+// Snapshots are read back by HistoryRestore.
+//
+
+// Releases the references of dropped paragraphs, in one removeMany().
+class TagGarbage : public I_Destroyer::Garbage {
+    I_Deduper                 & _deduper;
+    std::vector<I_Deduper::Tag> _tags;
+
+public:
+    TagGarbage(I_Deduper & deduper, std::vector<I_Deduper::Tag> && tags) :
+        _deduper(deduper), _tags(std::move(tags)) {}
+
+    ~TagGarbage() override { _deduper.removeMany(_tags); }
+};
+
+template <typename T> void writeValue(OutStream & ostream, const T & value) {
+    ostream.writeAll(&value, sizeof value, 1);
+}
+
+// Style ids only hold for the life of the process, so a snapshot of a
+// paragraph carries its styles and numbers them itself.
+void writeParagraph(OutStream & ostream, const std::vector<Cell> & cells) {
+    std::unordered_map<StyleId, StyleId> numbers;
+    std::vector<Style>                   styles;
+    std::vector<Cell>                    numbered;
+
+    numbered.reserve(cells.size());
+
+    for (auto & cell : cells) {
+        auto result = numbers.insert(std::make_pair(cell.styleId,
+                                                    static_cast<StyleId>(styles.size())));
+        if (result.second) { styles.push_back(cell.style()); }
+        numbered.push_back(Cell::utf8(cell.seq, result.first->second));
+    }
+
+    std::vector<uint8_t> encoded;
+    para::encode(numbered, encoded);
+
+    auto                 stylesSize = styles.size() * sizeof(Style);
+    std::vector<uint8_t> bytes(2 * sizeof(uint32_t) + stylesSize);
+    para::put<uint32_t>(bytes, 0, cells.size());
+    para::put<uint32_t>(bytes, sizeof(uint32_t), styles.size());
+    std::memcpy(&bytes[2 * sizeof(uint32_t)], styles.data(), stylesSize);
+    bytes.insert(bytes.end(), encoded.begin(), encoded.end());
+
+    writeValue<uint32_t>(ostream, bytes.size());
+    writeValue<uint64_t>(ostream, hash64(bytes.data(), bytes.size()));
+    ostream.writeAll(bytes.data(), 1, bytes.size());
+}
+
+// Special characters (i.e. line drawing) are drawn neither bold nor italic.
+StyleId withoutEmphasis(StyleId id) {
+    auto & style = lookupStyle(id);
+
+    if (style.attrs.get(Attr::BOLD) || style.attrs.get(Attr::ITALIC)) {
+        auto plain = style;
+        plain.attrs.unset(Attr::BOLD);
+        plain.attrs.unset(Attr::ITALIC);
+        return internStyle(plain);
+    }
+    else {
+        return id;
+    }
+}
+
+// Distinct colours have distinct keys.
+uint32_t colorKey(UColor color) {
+    switch (color.type) {
+        case UColor::Type::STOCK:
+            return static_cast<uint32_t>(color.name);
+        case UColor::Type::INDEXED:
+            return (1 << 24) | color.index;
+        case UColor::Type::DIRECT:
+            return (2 << 24) | (color.values.r << 16) | (color.values.g << 8) | color.values.b;
+    }
+
+    FATAL("Unreachable");
+}
+
+// Stands for the cursor in _presented. It is never equal to a real cell, so
+// the cell under the cursor is always redrawn once the cursor moves off it.
+const Cell PRESENTED_CURSOR = Cell::utf8(utf8::Seq(0xFF, 0xFF, 0xFF, 0xFF));
+
+} // namespace {anonymous}
 
 Buffer::ParaIter::ParaIter(const Buffer & buffer, APos pos) :
     _buffer(buffer),
@@ -43,7 +159,7 @@ void Buffer::ParaIter::moveBackward() {
         --_pos.row;
         _pos.col = _buffer.getCols() - 1;
 
-        if (_pos.row == -static_cast<int32_t>(_buffer._history.size() + 1)) {
+        if (_pos.row == -static_cast<int32_t>(_buffer.getHistoricalRows() + 1)) {
             _valid = false;
         }
         else {
@@ -96,20 +212,18 @@ void Buffer::BufferIter::moveBackward() {
 }
 
 bool Buffer::BufferIter::isStartOfPara() {
-    auto prevRow = _row - 1;
-
-    if (static_cast<uint32_t>(-prevRow - 1) == _buffer.getHistoricalRows()) {
-        return true;
-    }
-
-    if (prevRow < 0) {
+    if (_row < 0) {
         // Historical.
-        auto & hline = _buffer._history[_buffer._history.size() + prevRow];
-        return hline.seqnum == 0;
+        return _buffer.getHLine(_row).seqnum == 0;
+    }
+    else if (_row == 0) {
+        // The pending paragraph, if any, continues into the active rows.
+        auto & tags = _buffer._tags;
+        return tags.empty() || tags.back() != I_Deduper::invalidTag();
     }
     else {
         // Active.
-        auto & aline = _buffer._active[prevRow];
+        auto & aline = _buffer._active[_row - 1];
         return !aline.cont;
     }
 }
@@ -120,19 +234,28 @@ Buffer::Buffer(const Config       & config,
                int16_t              rows,
                int16_t              cols,
                uint32_t             historyLimit,
-               const CharSubArray & charSubs) :
+               const CharSubArray & charSubs,
+               HistoryBudget      * budget) :
     _config(config),
     _deduper(deduper),
     _destroyer(destroyer),
     _tags(),
-    _lostTags(0),
+    _searchIndex(),
+    _lengths(),
     _pending(),
     _history(),
-    _active(rows, ALine(cols)),
+    _unflowedTags(0),
+    _active(rows, cols),
+    _bumped(),
     _damage(rows),
+    _scroll(),
+    _presented(rows),
     _tabs(cols),
     _scrollOffset(0),
     _historyLimit(historyLimit),
+    _budget(historyLimit == 0 ? nullptr : budget),
+    _countBytes(_budget || (historyLimit != 0 && config.scrollBackBytes != 0)),
+    _historyBytes(0),
     _cols(cols),
     _barDamage(true),
     _selectMark(),
@@ -140,10 +263,15 @@ Buffer::Buffer(const Config       & config,
     _cursor(),
     _savedCursor(),
     _charSubs(charSubs),
-    _search(nullptr)
+    _search(nullptr),
+    _lineCache(),
+    _lineCacheHits(0),
+    _lineCacheMisses(0)
 {
     resetMargins();
     resetTabs();
+
+    if (_budget) { _budget->add(this); }
 }
 
 Buffer::~Buffer() {
@@ -151,27 +279,11 @@ Buffer::~Buffer() {
         delete _search;
     }
 
-    class Garbage : public AsyncDestroyer::Garbage {
-    private:
-        I_Deduper                & _deduper;
-        std::deque<I_Deduper::Tag> _tags;
-    public:
-        Garbage(I_Deduper                   & deduper,
-                std::deque<I_Deduper::Tag> && tags) :
-            _deduper(deduper), _tags(tags) {}
-
-        ~Garbage() override {
-            for (auto tag : _tags) {
-                // Deregister all of our valid tags. Note, really only the last tags can
-                // be invalid.
-                if (tag != I_Deduper::invalidTag()) {
-                    _deduper.remove(tag);
-                }
-            }
-        }
-    };
+    if (_budget) { _budget->remove(this); }
 
-    _destroyer.add(new Garbage(_deduper, std::move(_tags)));
+    // Note, really only the last tags can be invalid, and removeMany()
+    // skips them.
+    _destroyer.add(new TagGarbage(_deduper, std::vector<I_Deduper::Tag>(_tags.begin(), _tags.end())));
 }
 
 //
@@ -293,7 +405,7 @@ void Buffer::clearSelection() {
     damageSelection();
 
     // Retain the selection marker, if it is within the history.
-    if (static_cast<int32_t>(_history.size()) + _selectMark.row < 0) {
+    if (static_cast<int32_t>(getHistoricalRows()) + _selectMark.row < 0) {
         _selectMark = APos();
     }
 
@@ -301,28 +413,62 @@ void Buffer::clearSelection() {
 }
 
 bool Buffer::getSelectedText(std::string & text) const {
+    SelectionText selection(_deduper);
+
+    if (getSelectedText(selection)) {
+        selection.read(text);
+        return true;
+    }
+    else {
+        return false;
+    }
+}
+
+bool Buffer::getSelectedText(SelectionText & text) const {
     APos begin, end;
 
     // Declare this outside of the loop to avoid reallocation.
     std::vector<Cell> cells(getCols(), Cell::blank());
 
     if (normaliseSelection(begin, end)) {
+        auto cols = getCols();
+
         for (auto i = begin; i.row <= end.row; ++i.row, i.col = 0) {
+            int16_t limit = i.row < end.row ? cols : end.col;
+
+            if (i.row < 0) {
+                auto hline = getHLine(i.row);
+                auto tag   = _tags[hline.index];
+
+                if (LIKELY(tag != I_Deduper::invalidTag())) {
+                    // Refer to the stored paragraph rather than decoding it.
+                    uint32_t offset = hline.seqnum * cols;
+                    int16_t  wrap   = std::min<uint32_t>(cols, _lengths[hline.index] - offset);
+
+                    if (i.col < std::min(limit, wrap)) {
+                        text.appendPara(tag, offset + i.col, offset + std::min(limit, wrap));
+                    }
+
+                    if (i.col < limit && wrap < limit) {
+                        text.appendNewline();
+                    }
+
+                    continue;
+                }
+            }
+
             bool    cont;
             int16_t wrap;
             getLine(i.row, cells, cont, wrap);
 
-            for (; i.col < getCols() && (i.row < end.row || i.col != end.col); ++i.col) {
+            for (; i.col < cols && (i.row < end.row || i.col != end.col); ++i.col) {
                 if (i.col >= wrap) {
-                    text.push_back('\n');
+                    text.appendNewline();
                     break;
                 }
 
-                auto & cell = cells[i.col];
-                auto   seq  = cell.seq;
-                std::copy(&seq.bytes[0],
-                          &seq.bytes[utf8::leadLength(seq.lead())],
-                          back_inserter(text));
+                auto seq = cells[i.col].seq;
+                text.appendText(seq.bytes, utf8::leadLength(seq.lead()));
             }
         }
 
@@ -333,20 +479,61 @@ bool Buffer::getSelectedText(std::string & text) const {
     }
 }
 
+void Buffer::getMemoryStats(MemoryStats & stats) const {
+    stats.tags    += _tags.size() * sizeof(I_Deduper::Tag) +
+                     _lengths.size() * sizeof(uint32_t) +
+                     _searchIndex.bytes();
+    stats.history += _history.bytes();
+
+    stats.active  += _active.bytes();
+
+    stats.pending += _pending.capacity() * sizeof(Cell);
+    // Decoded lines are as wide as the buffer, give or take a resize.
+    stats.cache   += _lineCache.size() * (sizeof(CLine) + _cols * sizeof(Cell));
+
+    stats.cacheHits   += _lineCacheHits;
+    stats.cacheMisses += _lineCacheMisses;
+}
+
+void Buffer::markStyles(std::vector<bool> & used) const {
+    auto mark = [&](const Cell & cell) { used[cell.styleId] = true; };
+
+    for (auto & line : _active) {
+        std::for_each(line.cells.begin(), line.cells.end(), mark);
+    }
+
+    std::for_each(_pending.begin(), _pending.end(), mark);
+
+    for (auto & cells : _presented) {
+        std::for_each(cells.begin(), cells.end(), mark);
+    }
+
+    for (auto & pair : _lineCache) {
+        std::for_each(pair.second.cells.begin(), pair.second.cells.end(), mark);
+    }
+
+    used[_cursor.style]             = true;
+    used[_savedCursor.cursor.style] = true;
+}
+
 void Buffer::clearHistory() {
-    if (_history.empty()) {
+    if (_tags.empty()) {
         return;
     }
 
-    for (auto tag : _tags) {
-        if (LIKELY(tag != I_Deduper::invalidTag())) {
-            _deduper.remove(tag);
-        }
-    }
+    if (_search) { stopSearch(); }
+
+    _destroyer.add(new TagGarbage(_deduper, std::vector<I_Deduper::Tag>(_tags.begin(), _tags.end())));
+
+    chargeBytes(-static_cast<ssize_t>(_historyBytes));
 
     _tags.clear();
+    _searchIndex.clear();
+    _lengths.clear();
     _history.clear();
+    _unflowedTags = 0;
     _pending.clear();
+    _lineCache.clear();
 
     clearSelection();
 
@@ -357,11 +544,108 @@ void Buffer::clearHistory() {
         _scrollOffset = 0;
         damageViewport(true);
     }
+
+    if (_search) { startSearch(); }
+}
+
+void Buffer::saveHistory(OutStream & ostream) const throw (StreamError) {
+    std::unordered_map<I_Deduper::Tag, uint32_t> numbers;
+    uint32_t                                     count = 0;
+    std::vector<Cell>                            cells;
+
+    ostream.writeAll(HistoryRestore::SNAPSHOT_MAGIC, 1, sizeof HistoryRestore::SNAPSHOT_MAGIC);
+    writeValue<uint32_t>(ostream, HistoryRestore::SNAPSHOT_VERSION);
+    writeValue<uint32_t>(ostream, _tags.size());
+
+    for (auto tag : _tags) {
+        if (tag == I_Deduper::invalidTag()) {
+            // The pending paragraph. Its continuation isn't history so it
+            // will be restored as a complete paragraph.
+            writeValue<uint32_t>(ostream, count++);
+            writeParagraph(ostream, _pending);
+            continue;
+        }
+
+        auto iter = numbers.find(tag);
+
+        if (iter != numbers.end()) {
+            writeValue<uint32_t>(ostream, iter->second);
+        }
+        else {
+            numbers.insert(std::make_pair(tag, count));
+            writeValue<uint32_t>(ostream, count++);
+
+            cells.clear();
+            _deduper.lookup(tag, cells);
+            writeParagraph(ostream, cells);
+        }
+    }
+}
+
+void Buffer::getHistory(std::vector<I_Deduper::Tag>    & tags,
+                        std::vector<std::vector<Cell>> & tail) const {
+    std::vector<Cell> cells;
+
+    tags.reserve(_tags.size());
+
+    for (auto tag : _tags) {
+        if (LIKELY(tag != I_Deduper::invalidTag())) {
+            tags.push_back(tag);
+        }
+        else {
+            // The pending paragraph is continued by the first active line.
+            cells = _pending;
+        }
+    }
+
+    for (auto & aline : _active) {
+        cells.insert(cells.end(), aline.cells.begin(), aline.cells.begin() + aline.wrap);
+
+        if (!aline.cont) {
+            tail.push_back(std::move(cells));
+            cells.clear();
+        }
+    }
+
+    if (!cells.empty()) {
+        tail.push_back(std::move(cells));
+    }
+
+    while (!tail.empty() && tail.back().empty()) {
+        tail.pop_back();
+    }
+}
+
+void Buffer::insertHistory(std::vector<I_Deduper::Tag> & tags,
+                           std::vector<uint32_t>       & lengths,
+                           SearchIndex                 & index) {
+    ASSERT(tags.size() == lengths.size(), "");
+
+    if (tags.empty()) { return; }
+
+    if (_search) { stopSearch(); }
+
+    _tags.insert(_tags.begin(), tags.begin(), tags.end());
+    _lengths.insert(_lengths.begin(), lengths.begin(), lengths.end());
+    _searchIndex.merge(index);
+    for (auto tag : tags) { chargeHistory(tag, true); }
+    rebuildHistory(getRows());
+    enforceHistoryLimit();
+    damageViewport(true);
+
+    tags.clear();
+    lengths.clear();
+
+    if (_search) { startSearch(); }
 }
 
 bool Buffer::scrollUpHistory(uint16_t rows) {
     auto oldScrollOffset = _scrollOffset;
 
+    if (_scrollOffset + rows > getHistoricalRows()) {
+        reflowHistory(_scrollOffset + rows - getHistoricalRows());
+    }
+
     if (_scrollOffset + rows > getHistoricalRows()) {
         _scrollOffset = getHistoricalRows();
     }
@@ -370,7 +654,10 @@ bool Buffer::scrollUpHistory(uint16_t rows) {
     }
 
     if (_scrollOffset != oldScrollOffset) {
-        damageViewport(true);
+        // The viewport content moves down.
+        auto delta = std::min<uint32_t>(_scrollOffset - oldScrollOffset, getRows());
+        damageScroll(0, getRows(), -static_cast<int16_t>(delta));
+        _barDamage = true;
         return true;
     }
     else {
@@ -389,7 +676,10 @@ bool Buffer::scrollDownHistory(uint16_t rows) {
     }
 
     if (_scrollOffset != oldScrollOffset) {
-        damageViewport(true);
+        // The viewport content moves up.
+        auto delta = std::min<uint32_t>(oldScrollOffset - _scrollOffset, getRows());
+        damageScroll(0, getRows(), static_cast<int16_t>(delta));
+        _barDamage = true;
         return true;
     }
     else {
@@ -398,6 +688,8 @@ bool Buffer::scrollDownHistory(uint16_t rows) {
 }
 
 bool Buffer::scrollTopHistory() {
+    finishReflow();
+
     if (_scrollOffset != getHistoricalRows()) {
         _scrollOffset = getHistoricalRows();
         damageViewport(true);
@@ -420,6 +712,9 @@ bool Buffer::scrollBottomHistory() {
 }
 
 void Buffer::migrateFrom(Buffer & other, bool clear_) {
+    // The other buffer was being presented.
+    invalidatePresented();
+
     other.clearSelection();
     _cursor          = other._cursor;
     _cursor.wrapNext = false;
@@ -439,28 +734,7 @@ void Buffer::write(utf8::Seq seq, bool autoWrap, bool insert) {
     cs->translate(seq);
 
     if (autoWrap && _cursor.wrapNext) {
-        _cursor.wrapNext = false;
-        auto & line = _active[_cursor.pos.row];
-
-        // Don't set 'cont' to true if this line will remain the last line,
-        // otherwise we violate our invariant.
-        if (_cursor.pos.row == _marginEnd - 1 || _cursor.pos.row < getRows() - 1) {
-            line.cont = true; // continues on next line
-        }
-
-        ASSERT(_cursor.pos.col == _cols - 1,
-               "col=" << _cursor.pos.col << ", _cols-1=" << _cols - 1);
-        ASSERT(line.wrap == _cols,
-               "wrap=" << line.wrap << ", _cols=" << _cols);
-
-        if (_cursor.pos.row == _marginEnd - 1) {
-            addLine();      // invalidates line reference
-            moveCursor2(true, 0, false, 0);
-        }
-        else {
-            // If we are on the last line then the column will just be reset.
-            moveCursor2(true, 1, false, 0);
-        }
+        wrapCursor();
     }
     else if (insert) {
         insertCells(1);
@@ -469,8 +743,7 @@ void Buffer::write(utf8::Seq seq, bool autoWrap, bool insert) {
     auto style = _cursor.style;
 
     if (cs->isSpecial()) {
-        style.attrs.unset(Attr::BOLD);
-        style.attrs.unset(Attr::ITALIC);
+        style = withoutEmphasis(style);
     }
 
     auto & line = _active[_cursor.pos.row];
@@ -498,6 +771,78 @@ void Buffer::write(utf8::Seq seq, bool autoWrap, bool insert) {
     damageCell();       // For the sake of the cursor.
 }
 
+void Buffer::writeRun(const uint8_t * data, size_t size, bool autoWrap, bool insert) {
+    damageCell();
+
+    auto cs    = getCharSub(_cursor.charSet);
+    auto style = _cursor.style;
+
+    if (cs->isSpecial()) {
+        style = withoutEmphasis(style);
+    }
+
+    while (size != 0) {
+        auto wrap = autoWrap && _cursor.wrapNext;
+        auto col  = wrap ? 0 : _cursor.pos.col;
+
+        // Without auto-wrap the cursor sticks at the last column, so each
+        // remaining character takes a turn there. Like write(), the first
+        // character after a wrap is not inserted.
+        auto n = static_cast<int16_t>(std::min<size_t>(size, getCols() - col));
+
+        if (wrap) {
+            wrapCursor();
+            if (insert) { n = 1; }
+        }
+        else if (insert) {
+            insertCells(n);
+        }
+
+        APos selBegin, selEnd;
+        auto selected = normaliseSelection(selBegin, selEnd);
+        auto & line = _active[_cursor.pos.row];
+
+        for (int16_t i = 0; i != n; ++i) {
+            utf8::Seq seq(data[i]);
+            ASSERT(utf8::leadLength(seq.lead()) == utf8::Length::L1, "");
+            cs->translate(seq);
+            auto cell = Cell::utf8(seq, style);
+
+            if (line.cells[col + i] != cell) {
+                if (selected) {
+                    APos begin(Pos(_cursor.pos.row, col + i), 0);
+                    APos end(Pos(_cursor.pos.row, col + i + 1), 0);
+
+                    if (selBegin < end && begin < selEnd) {
+                        clearSelection();
+                        selected = false;
+                    }
+                }
+
+                line.cells[col + i] = cell;
+            }
+        }
+
+        line.wrap = std::max<int16_t>(line.wrap, col + n);
+        ASSERT(line.wrap <= getCols(), "");
+
+        damageColumns(col, col + n);
+
+        if (col + n == getCols()) {
+            _cursor.pos.col  = getCols() - 1;
+            _cursor.wrapNext = true;
+        }
+        else {
+            _cursor.pos.col += n;
+        }
+
+        data += n;
+        size -= n;
+    }
+
+    damageCell();       // For the sake of the cursor.
+}
+
 void Buffer::backspace(bool autoWrap) {
     if (_cursor.wrapNext && !_config.traditionalWrapping) {
         _cursor.wrapNext = false;
@@ -634,19 +979,10 @@ void Buffer::resizeClip(int16_t rows, int16_t cols) {
     ASSERT(_cursor.pos.col >= 0 && _cursor.pos.col < getCols(), "");
 
     clearSelection();
+    if (_search) { stopSearch(); }
 
-    if (cols != getCols()) {
-        for (auto & line : _active) {
-            line.resize(cols);
-        }
-    }
-
-    if (rows > getRows()) {
-        _active.resize(rows, ALine(cols));
-    }
-    else if (rows < getRows()) {
-        _active.erase(_active.begin() + rows, _active.end());
-    }
+    _active.setCols(cols);
+    _active.resize(rows);
 
     _cols = cols;
 
@@ -668,6 +1004,8 @@ void Buffer::resizeClip(int16_t rows, int16_t cols) {
 
     _damage.resize(rows);
     damageViewport(false);
+
+    if (_search) { startSearch(); }
 }
 
 void Buffer::resizeReflow(int16_t rows, int16_t cols) {
@@ -676,6 +1014,7 @@ void Buffer::resizeReflow(int16_t rows, int16_t cols) {
     ASSERT(_cursor.pos.col >= 0 && _cursor.pos.col < getCols(), "");
 
     clearSelection();
+    if (_search) { stopSearch(); }
 
     ASSERT(!_active.back().cont, "");
 
@@ -723,18 +1062,19 @@ void Buffer::resizeReflow(int16_t rows, int16_t cols) {
         ASSERT(_pending.empty(), "");
 
         _cols = cols;       // Must set before calling rebuildHistory().
-        rebuildHistory();
+        _active.setCols(cols);
+        _lineCache.clear();
+        rebuildHistory(2 * rows);   // Rows to pull back into active, plus the viewport.
 
         doneCursor = false;
 
         // Pull rows out of history first.
-        while (getRows() < rows && !_history.empty()) {
+        while (getRows() < rows && getHistoricalRows() != 0) {
             if (doneCursor) {
                 ++_cursor.pos.row;
             }
             else if (_tags.size() - 1 == cursorTagIndex) {
-                auto & hline = _history.back();
-                uint32_t offset = hline.seqnum * cols;
+                uint32_t offset = (_history.back() - 1) * cols;
                 if (cursorOffset == offset + cols) {
                     _cursor.pos.row  = 0;
                     _cursor.pos.col  = cursorOffset - offset;
@@ -763,9 +1103,7 @@ void Buffer::resizeReflow(int16_t rows, int16_t cols) {
         }
 
         // Add blank lines to get the rest.
-        if (getRows() < rows) {
-            _active.resize(rows, ALine(cols));
-        }
+        _active.resize(rows);
 
         ASSERT(_active.size() == static_cast<size_t>(rows), "");
         ASSERT(_active.front().cells.size() == static_cast<size_t>(cols), "");
@@ -773,15 +1111,13 @@ void Buffer::resizeReflow(int16_t rows, int16_t cols) {
     else {
         if (getRows() < rows) {
             // Pull rows out of history first.
-            while (getRows() < rows && !_history.empty()) {
+            while (getRows() < rows && getHistoricalRows() != 0) {
                 ++_cursor.pos.row;
                 unbump();
             }
 
             // Add blank lines to get the rest.
-            if (getRows() < rows) {
-                _active.resize(rows, ALine(cols));
-            }
+            _active.resize(rows);
         }
         else if (getRows() > rows) {
             // Push excess rows into history.
@@ -798,7 +1134,7 @@ void Buffer::resizeReflow(int16_t rows, int16_t cols) {
 
     _active.shrink_to_fit();
 
-    _scrollOffset = std::min<uint32_t>(_scrollOffset, _history.size());
+    _scrollOffset = std::min<uint32_t>(_scrollOffset, getHistoricalRows());
 
     resetMargins();
 
@@ -813,6 +1149,8 @@ void Buffer::resizeReflow(int16_t rows, int16_t cols) {
 
     _damage.resize(rows);
     damageViewport(true);
+
+    if (_search) { startSearch(); }
 }
 
 void Buffer::tabForward(uint16_t count) {
@@ -1075,6 +1413,11 @@ void Buffer::damageViewport(bool scrollbar) {
         d.damageSet(0, getCols());
     }
 
+    _scroll = Scroll();     // Pointless now.
+
+    // The whole viewport is redrawn, perhaps onto a fresh surface.
+    invalidatePresented();
+
     if (scrollbar) {
         _barDamage = true;
     }
@@ -1093,42 +1436,46 @@ void Buffer::testPattern() {
     damageActive();
 }
 
-void Buffer::accumulateDamage(Region & damage) const {
-    bool first = true;
+void Buffer::accumulateDamage(RegionSet & damage) const {
     int16_t rowNum = 0;
 
     for (auto & d : _damage) {
-        auto cB = d.begin;
-        auto cE = d.end;
-
-        if (UNLIKELY(cB != cE)) {
-            if (UNLIKELY(first)) {
-                damage.begin.row = rowNum;
-                damage.end.row   = rowNum + 1;
-                damage.begin.col = cB;
-                damage.end.col   = cE;
-                first    = false;
-            }
-            else {
-                damage.end.row   = rowNum + 1;
-                damage.begin.col = std::min(damage.begin.col, cB);
-                damage.end.col   = std::max(damage.end.col, cE);
-            }
+        if (UNLIKELY(d.begin != d.end)) {
+            damage.add(Region(Pos(rowNum, d.begin), Pos(rowNum + 1, d.end)));
         }
 
         ++rowNum;
     }
+
+    // Scrolled rows change whether they are copied or redrawn.
+    if (_scroll.rows != 0) {
+        damage.add(Region(Pos(_scroll.begin, 0), Pos(_scroll.end, getCols())));
+    }
 }
 
 void Buffer::dispatch(bool reverse, I_Renderer & renderer) {
+        dispatchScroll(renderer);
+        diffDamage();
+
+        std::vector<std::pair<int16_t, RowKey>> captures;
+        dispatchRows(reverse, renderer, captures);
         dispatchBg(reverse, renderer);
         dispatchFg(reverse, renderer);
 
+        for (auto & capture : captures) {
+            renderer.bufferCaptureRow(capture.first, capture.second);
+        }
+
         if (_search) {
             dispatchSearch(reverse, renderer);
         }
         else {
             dispatchCursor(reverse, renderer);
+
+            auto r0 = _scrollOffset + static_cast<uint32_t>(_cursor.pos.row);
+            if (r0 < static_cast<uint32_t>(getRows()) && !_presented[r0].empty()) {
+                _presented[r0][_cursor.pos.col] = PRESENTED_CURSOR;
+            }
         }
 
         resetDamage();
@@ -1138,6 +1485,7 @@ void Buffer::resetDamage() {
     for (auto & d : _damage) {
         d.reset();
     }
+    _scroll    = Scroll();
     _barDamage = false;
 }
 
@@ -1153,73 +1501,121 @@ const CharSub * Buffer::getCharSub(CharSet charSet) const {
     return _charSubs.get(charSet);
 }
 
-void Buffer::beginSearch(const std::string & pattern) {
+void Buffer::beginSearch(const std::string & pattern) throw (Regex::Error) {
     ASSERT(!_search, "Already searching.");
-    _search = new Search(*this, pattern);
-    _damage.back().damageAdd(0, getCols());
+    _search = new Search(pattern);
+    startSearch();
+}
+
+const std::string & Buffer::getSearchPattern() const {
+    ASSERT(_search, "Not searching.");
+    return _search->pattern;
+}
 
-    auto & bufferIter = _search->iter;
-    auto & allOffsets = _search->allOffsets;
+void Buffer::setSearchPattern(const std::string & pattern) throw (Regex::Error) {
+    ASSERT(_search, "Not searching.");
+    std::unique_ptr<Regex> regex(new Regex(pattern));
 
-    Regex regex(pattern);
+    stopSearch();
+    _search->pattern = pattern;
+    _search->regex   = std::move(regex);
+    startSearch();
+}
 
-    while (bufferIter.valid()) {
-        auto paraIter = bufferIter.getParaIter();
+bool Buffer::pollSearch() {
+    if (!isSearchPending()) {
+        return false;
+    }
 
-        std::vector<uint8_t> para;
+    auto & search = *_search;
 
-        while (paraIter.valid()) {
-            auto & cell = paraIter.getCell();
-            auto   seq  = cell.seq;
+    std::vector<SearchJob::Hit>                                 found;
+    std::vector<std::pair<I_Deduper::Tag, SearchJob::Ranges>>   matched;
 
-            std::copy(&seq.bytes[0],
-                      &seq.bytes[utf8::leadLength(seq.lead())],
-                      back_inserter(para));
+    auto finished = search.job->collect(found, matched);
 
-            paraIter.moveForward();
+    for (auto & pair : matched) {
+        // Several workers may have matched the same paragraph.
+        if (search.indices.find(pair.first) == search.indices.end()) {
+            search.indices.insert(pair.first, static_cast<uint32_t>(search.matches.size()));
+            search.matches.push_back(std::move(pair.second));
         }
+    }
 
-        para.push_back('\0');
+    if (finished) {
+        search.job.reset();
+        _damage.back().damageAdd(0, getCols());     // The status line.
+    }
 
-        std::cout << &para.front() << std::endl;
+    if (found.empty()) {
+        return finished;
+    }
 
-        // PCRE_NOTEMPTY, PCRE_NO_UTF8_CHECK
-        allOffsets = regex.matchAllOffsets(reinterpret_cast<const char *>(&para.front()),
-                                           para.size());
+    auto byRow = [](const Search::Hit & lhs, const Search::Hit & rhs) {
+        return lhs.row < rhs.row;
+    };
 
-        if (!allOffsets.empty()) {
-            break;
-        }
+    auto & hits       = search.hits;
+    auto   current    = hits.empty() ? Search::Hit() : hits[search.current];
+    auto   size       = hits.size();
+    auto   historical = static_cast<int32_t>(getHistoricalRows());
 
-        bufferIter.moveBackward();
+    for (auto & hit : found) {
+        if (hit.index < search.dropped) { continue; }      // Since trimmed.
+        auto index = hit.index - search.dropped;
+        auto row   = static_cast<int32_t>(_history.prefix(index)) - historical;
+        hits.push_back(Search::Hit{ row, _history.get(index),
+                                    search.indices.find(hit.tag)->second });
     }
-}
 
-const std::string & Buffer::getSearchPattern() const {
-    ASSERT(_search, "Not searching.");
-    return _search->pattern;
-}
+    if (hits.size() == size) {
+        return finished;
+    }
 
-void Buffer::setSearchPattern(const std::string & pattern) {
-    ASSERT(_search, "Not searching.");
-    _search->pattern = pattern;
-    // TODO
+    std::sort(hits.begin() + size, hits.end(), byRow);
+    std::inplace_merge(hits.begin(), hits.begin() + size, hits.end(), byRow);
+
+    if (search.moved) {
+        // Stay on the same hit.
+        search.current = std::lower_bound(hits.begin(), hits.end(), current, byRow) -
+                         hits.begin();
+        damageViewport(false);
+    }
+    else {
+        search.current = hits.size() - 1;
+        showSearchHit();
+    }
+
+    return true;
 }
 
 void Buffer::nextSearch() {
     ASSERT(_search, "Not searching.");
-    NYI("");
+    auto & search = *_search;
+
+    if (!search.hits.empty() && search.current != 0) {
+        --search.current;
+        search.moved = true;
+        showSearchHit();
+    }
 }
 
 void Buffer::prevSearch() {
     ASSERT(_search, "Not searching.");
-    NYI("");
+    auto & search = *_search;
+
+    if (search.current + 1 < search.hits.size()) {
+        ++search.current;
+        search.moved = true;
+        showSearchHit();
+    }
 }
 
 void Buffer::endSearch() {
     ASSERT(_search, "Not searching.");
     delete _search;
     _search = nullptr;
+    damageViewport(false);
 }
 
 void Buffer::dumpTags(std::ostream & ost) const {
@@ -1264,12 +1660,14 @@ void Buffer::dumpHistory(std::ostream & ost) const {
     size_t            i = 0;
     std::vector<Cell> cells;
 
-    for (auto & l : _history) {
+    for (int32_t row = -static_cast<int32_t>(getHistoricalRows()); row != 0; ++row) {
+        auto l = getHLine(row);
+
         ost << std::setw(4) << i << " "
-            << std::setw(4) << l.index - _lostTags << " "
+            << std::setw(4) << l.index << " "
             << std::setw(2) << l.seqnum << " \'";
 
-        auto     tag    = _tags[l.index - _lostTags];
+        auto     tag    = _tags[l.index];
         uint32_t offset = l.seqnum * getCols();
         bool     cont;
         int16_t  wrap;
@@ -1340,8 +1738,8 @@ void Buffer::dumpSelection(std::ostream & ost) const {
 
 void Buffer::getLine(int32_t row, std::vector<Cell> & cells, bool & cont, int16_t & wrap) const {
     if (row < 0) {
-        auto & hline = _history[_history.size() + row];
-        auto   tag   = _tags[hline.index - _lostTags];
+        auto hline = getHLine(row);
+        auto tag   = _tags[hline.index];
 
         uint32_t offset = hline.seqnum * getCols();
 
@@ -1352,7 +1750,27 @@ void Buffer::getLine(int32_t row, std::vector<Cell> & cells, bool & cont, int16_
             cont = (offset + wrap != _pending.size());
         }
         else {
-            _deduper.lookupSegment(tag, offset, getCols(), cells, cont, wrap);
+            LineKey key(tag, hline.seqnum, getCols());
+            auto    iter = _lineCache.find(key);
+
+            if (iter != _lineCache.end()) {
+                auto & cline = iter->second;
+                std::copy(cline.cells.begin(), cline.cells.end(), cells.begin());
+                cont = cline.cont;
+                wrap = cline.wrap;
+                ++_lineCacheHits;
+            }
+            else {
+                _deduper.lookupSegment(tag, offset, getCols(), cells, cont, wrap);
+                ++_lineCacheMisses;
+
+                if (_config.lineCacheSize != 0) {
+                    if (_lineCache.size() == _config.lineCacheSize) {
+                        _lineCache.erase(_lineCache.begin());   // Evict the oldest.
+                    }
+                    _lineCache.insert(key, CLine(cells, cont, wrap));
+                }
+            }
         }
     }
     else {
@@ -1364,12 +1782,51 @@ void Buffer::getLine(int32_t row, std::vector<Cell> & cells, bool & cont, int16_
     }
 }
 
-void Buffer::dispatchBg(bool reverse, I_Renderer & renderer) const {
-    APos selBegin, selEnd;
-    auto selValid = normaliseSelection(selBegin, selEnd);
+void Buffer::uncacheLine(I_Deduper::Tag tag, uint32_t seqnum) {
+    auto iter = _lineCache.find(LineKey(tag, seqnum, getCols()));
+    if (iter != _lineCache.end()) {
+        _lineCache.erase(iter);
+    }
+}
 
-    // Declare this outside of the loop to avoid reallocation.
-    std::vector<Cell> cells(getCols(), Cell::blank());
+void Buffer::dispatchScroll(I_Renderer & renderer) {
+    if (_scroll.rows != 0) {
+        if (renderer.bufferScroll(_scroll.begin, _scroll.end, _scroll.rows)) {
+            // The presented rows move with the pixels.
+            auto begin = _presented.begin() + _scroll.begin;
+            auto end   = _presented.begin() + _scroll.end;
+
+            if (_scroll.rows > 0) {
+                std::move(begin + _scroll.rows, end, begin);
+                for (auto iter = end - _scroll.rows; iter != end; ++iter) { iter->clear(); }
+            }
+            else {
+                std::move_backward(begin, end + _scroll.rows, end);
+                for (auto iter = begin; iter != begin - _scroll.rows; ++iter) { iter->clear(); }
+            }
+        }
+        else {
+            for (auto i = _scroll.begin; i != _scroll.end; ++i) {
+                _damage[i].damageSet(0, getCols());
+            }
+        }
+    }
+
+    _scroll = Scroll();
+}
+
+// Shrink the damage of each row to the cells that differ from what was last
+// presented, so programs that repaint unchanged content cost nothing.
+void Buffer::diffDamage() {
+    APos selBegin, selEnd;
+
+    if (_search || normaliseSelection(selBegin, selEnd)) {
+        // Selected and searched cells aren't drawn as stored, so stop tracking.
+        invalidatePresented();
+        return;
+    }
+
+    std::vector<Cell> cells(getCols(), Cell::blank());
 
     for (int16_t row = 0; row != getRows(); ++row) {
         auto & damage = _damage[row];
@@ -1379,6 +1836,127 @@ void Buffer::dispatchBg(bool reverse, I_Renderer & renderer) const {
         int16_t wrap;
         getLine(static_cast<int32_t>(row - _scrollOffset), cells, cont, wrap);
 
+        auto & presented = _presented[row];
+
+        if (presented.empty()) {
+            // Only a complete row can become known.
+            if (damage.begin == 0 && damage.end == getCols()) {
+                presented = cells;
+            }
+            continue;
+        }
+
+        auto begin = damage.begin;
+        auto end   = damage.end;
+
+        while (begin != end && cells[begin]   == presented[begin])   { ++begin; }
+        while (end != begin && cells[end - 1] == presented[end - 1]) { --end; }
+
+        std::copy(cells.begin() + begin, cells.begin() + end, presented.begin() + begin);
+
+        if (begin == end) {
+            damage.reset();
+        }
+        else {
+            damage.damageSet(begin, end);
+        }
+    }
+}
+
+// Damaged historical rows are blitted if the renderer has them, otherwise
+// they are drawn as usual and, if drawn in full, offered for capture.
+void Buffer::dispatchRows(bool reverse, I_Renderer & renderer,
+                          std::vector<std::pair<int16_t, RowKey>> & captures) {
+    APos selBegin, selEnd;
+
+    if (_search || normaliseSelection(selBegin, selEnd)) {
+        // Selected and searched cells aren't drawn as stored.
+        return;
+    }
+
+    auto rows = static_cast<int16_t>(std::min<uint32_t>(_scrollOffset, getRows()));
+    std::vector<Cell> cells(getCols(), Cell::blank());
+
+    for (int16_t row = 0; row != rows; ++row) {
+        auto & damage = _damage[row];
+        if (damage.begin == damage.end) { continue; }
+
+        auto r     = static_cast<int32_t>(row - _scrollOffset);
+        auto hline = getHLine(r);
+        auto tag   = _tags[hline.index];
+
+        // The pending paragraph is still growing.
+        if (tag == I_Deduper::invalidTag()) { continue; }
+
+        bool    cont;
+        int16_t wrap;
+        getLine(r, cells, cont, wrap);
+
+        // The generation, lest an id come to stand for another style.
+        RowKey key(tag, hline.seqnum, getCols(), reverse,
+                   hash64(cells.data(), cells.size() * sizeof(Cell)) ^
+                   StyleTable::instance().generation());
+
+        if (renderer.bufferBlitRow(row, key)) {
+            damage.reset();
+        }
+        else if (damage.begin == 0 && damage.end == getCols()) {
+            captures.push_back(std::make_pair(row, key));
+        }
+    }
+}
+
+void Buffer::invalidatePresented() {
+    _presented.assign(getRows(), std::vector<Cell>());
+}
+
+void Buffer::dispatchBg(bool reverse, I_Renderer & renderer) const {
+    APos selBegin, selEnd;
+    auto selValid = normaliseSelection(selBegin, selEnd);
+
+    // Declare these outside of the loop to avoid reallocation.
+    std::vector<Cell> cells(getCols(), Cell::blank());
+    std::vector<bool> marks(getCols(), false);  // Search matches.
+
+    // Runs are grouped by colour, in order of first appearance, so each
+    // colour is filled once. Background never overlaps, so the order of
+    // the fills doesn't matter.
+    std::vector<UColor>                     colors;
+    std::vector<std::vector<CellRect>>      groups;
+    std::unordered_map<uint32_t, size_t>    indices;
+
+    auto addRun = [&](int16_t row, int16_t col, int16_t count, UColor color) {
+        auto iter = indices.find(colorKey(color));
+
+        if (iter == indices.end()) {
+            iter = indices.insert(std::make_pair(colorKey(color), groups.size())).first;
+            colors.push_back(color);
+            groups.emplace_back();
+        }
+
+        auto & rects = groups[iter->second];
+
+        // Extend the previous rectangle down if it spans the same columns.
+        if (!rects.empty()) {
+            auto & last = rects.back();
+            if (last.pos.col == col && last.cols == count && last.pos.row + last.rows == row) {
+                ++last.rows;
+                return;
+            }
+        }
+
+        rects.emplace_back(Pos(row, col), 1, count);
+    };
+
+    for (int16_t row = 0; row != getRows(); ++row) {
+        auto & damage = _damage[row];
+        if (damage.begin == damage.end) { continue; }
+
+        bool    cont;
+        int16_t wrap;
+        getLine(static_cast<int32_t>(row - _scrollOffset), cells, cont, wrap);
+        getSearchMarks(static_cast<int32_t>(row - _scrollOffset), marks);
+
         auto bg0  = UColor::stock(UColor::Name::TEXT_BG);
         auto col0 = damage.begin;  // Accumulation start column.
         auto col1 = col0;
@@ -1394,8 +1972,8 @@ void Buffer::dispatchBg(bool reverse, I_Renderer & renderer) const {
             auto   apos     = APos(row - _scrollOffset, col1);
             auto   selected = selValid && isCellSelected(apos, selBegin, selEnd, wrap);
             auto & cell     = cells[col1];
-            auto & attrs    = cell.style.attrs;
-            auto   swap     = XOR(reverse, attrs.get(Attr::INVERSE));
+            auto & style    = cell.style();
+            auto   swap     = XOR(XOR(reverse, style.attrs.get(Attr::INVERSE)), marks[col1]);
             auto   bg1      = bg0; // About to be overridden.
 
             if (UNLIKELY(selected)) {
@@ -1403,20 +1981,20 @@ void Buffer::dispatchBg(bool reverse, I_Renderer & renderer) const {
                     bg1 = UColor::stock(UColor::Name::SELECT_BG);
                 }
                 else if (_config.customSelectFgColor) {
-                    bg1 = swap ? cell.style.fg : cell.style.bg;
+                    bg1 = swap ? style.fg : style.bg;
                 }
                 else {
-                    bg1 = !swap ? cell.style.fg : cell.style.bg;
+                    bg1 = !swap ? style.fg : style.bg;
                 }
             }
             else {
-                bg1 = swap ? cell.style.fg : cell.style.bg;
+                bg1 = swap ? style.fg : style.bg;
             }
 
             if (UNLIKELY(bg0 != bg1)) {
                 if (col1 != col0) {
                     // flush run
-                    renderer.bufferDrawBg(Pos(row, col0), col1 - col0, bg0);
+                    addRun(row, col0, col1 - col0, bg0);
                 }
 
                 col0 = col1;
@@ -1426,9 +2004,13 @@ void Buffer::dispatchBg(bool reverse, I_Renderer & renderer) const {
 
         // There may be an unterminated run to flush.
         if (col1 != col0) {
-            renderer.bufferDrawBg(Pos(row, col0), col1 - col0, bg0);
+            addRun(row, col0, col1 - col0, bg0);
         }
     }
+
+    for (size_t i = 0; i != groups.size(); ++i) {
+        renderer.bufferDrawBg(colors[i], groups[i]);
+    }
 }
 
 void Buffer::dispatchFg(bool reverse, I_Renderer & renderer) const {
@@ -1437,7 +2019,9 @@ void Buffer::dispatchFg(bool reverse, I_Renderer & renderer) const {
 
     // Declare these outside of the loop to avoid reallocation.
     std::vector<Cell>    cells(getCols(), Cell::blank());
-    std::vector<uint8_t> run;               // Buffer for accumulating character runs.
+    std::vector<bool>    marks(getCols(), false);   // Search matches.
+    std::vector<uint8_t> str;               // The row segment's characters.
+    std::vector<FgRun>   runs;              // Its runs.
 
     for (int16_t row = 0; row != getRows(); ++row) {
         auto & damage = _damage[row];
@@ -1446,12 +2030,20 @@ void Buffer::dispatchFg(bool reverse, I_Renderer & renderer) const {
         bool    cont;
         int16_t wrap;
         getLine(static_cast<int32_t>(row - _scrollOffset), cells, cont, wrap);
+        getSearchMarks(static_cast<int32_t>(row - _scrollOffset), marks);
 
         auto fg0    = UColor::stock(UColor::Name::TEXT_FG);
         auto attrs0 = AttrSet();
+        auto solo0  = false;          // Must the run be drawn alone?
         auto col0   = damage.begin;   // Accumulation start column.
         auto col1   = col0;
 
+        // The previous cell. A cell with the same style id, selection and
+        // mark has the same colour and attributes, no need to look them up.
+        auto id0       = StyleTable::DEFAULT;
+        auto selected0 = false;
+        auto mark0     = false;
+
         for (; col1 != damage.end; ++col1) {
 #if 0
             // Once we get past the wrap point all cells will be blank,
@@ -1463,57 +2055,72 @@ void Buffer::dispatchFg(bool reverse, I_Renderer & renderer) const {
             auto   selected = selValid && isCellSelected(apos, selBegin, selEnd, wrap);
             auto & cell     = cells[col1];
             auto   length   = utf8::leadLength(cell.seq.lead());
-            auto & attrs1   = cell.style.attrs;
-            auto   swap     = XOR(reverse, attrs1.get(Attr::INVERSE));
-            auto   fg1      = fg0; // About to be overridden.
+            bool   mark     = marks[col1];
+            auto   attrs1   = attrs0;
+            auto   fg1      = fg0;
 
-            if (UNLIKELY(selected)) {
-                if (_config.customSelectFgColor) {
-                    fg1 = UColor::stock(UColor::Name::SELECT_FG);
-                }
-                else if (_config.customSelectBgColor) {
-                    fg1 = swap ? cell.style.bg : cell.style.fg;
+            if (col1 == damage.begin ||
+                cell.styleId != id0 || selected != selected0 || mark != mark0)
+            {
+                auto & style = cell.style();
+                auto   swap  = XOR(XOR(reverse, style.attrs.get(Attr::INVERSE)), mark);
+
+                attrs1 = style.attrs;
+
+                if (UNLIKELY(selected)) {
+                    if (_config.customSelectFgColor) {
+                        fg1 = UColor::stock(UColor::Name::SELECT_FG);
+                    }
+                    else if (_config.customSelectBgColor) {
+                        fg1 = swap ? style.bg : style.fg;
+                    }
+                    else {
+                        fg1 = !swap ? style.bg : style.fg;
+                    }
                 }
                 else {
-                    fg1 = !swap ? cell.style.bg : cell.style.fg;
+                    fg1 = swap ? style.bg : style.fg;
                 }
+
+                id0       = cell.styleId;
+                selected0 = selected;
+                mark0     = mark;
             }
-            else {
-                fg1 = swap ? cell.style.bg : cell.style.fg;
-            }
 
-            /* If the UTF-8 codepoint is more than one byte then terminate the run
-             * to prevent the alignment being upset when the resulting glyph is
-             * wider than the fixed width font.
-             * Can we do this a better way?
-             */
-            if (UNLIKELY(length != utf8::Length::L1 ||
-                         fg0    != fg1              ||
+            // Glyphs that might not fit the cell are drawn alone so they
+            // can't upset the alignment of the rest of the run.
+            auto solo1 = length != utf8::Length::L1 &&
+                         utf8::width(utf8::decode(cell.seq.bytes)) != utf8::Width::NARROW;
+
+            if (UNLIKELY(solo0  || solo1 ||
+                         fg0    != fg1   ||
                          attrs0 != attrs1)) {
                 if (col1 != col0) {
-                    // flush run
-                    auto size = run.size();
-                    run.push_back(NUL);
-                    renderer.bufferDrawFg(Pos(row, col0), col1 - col0,
-                                          fg0, attrs0, &run.front(), size);
-                    run.clear();
+                    // End the run.
+                    auto offset = runs.empty() ? 0 : runs.back().offset + runs.back().size;
+                    runs.emplace_back(col0, col1 - col0, fg0, attrs0, offset, str.size() - offset);
                 }
 
                 col0   = col1;
                 fg0    = fg1;
                 attrs0 = attrs1;
+                solo0  = solo1;
             }
 
-            std::copy(cell.seq.bytes, cell.seq.bytes + length, std::back_inserter(run));
+            std::copy(cell.seq.bytes, cell.seq.bytes + length, std::back_inserter(str));
         }
 
-        // There may be an unterminated run to flush.
+        // There may be an unterminated run to end.
         if (col1 != col0) {
-            // flush run
-            auto size = run.size();
-            run.push_back(NUL);
-            renderer.bufferDrawFg(Pos(row, col0), col1 - col0, fg0, attrs0, &run.front(), size);
-            run.clear();
+            auto offset = runs.empty() ? 0 : runs.back().offset + runs.back().size;
+            runs.emplace_back(col0, col1 - col0, fg0, attrs0, offset, str.size() - offset);
+        }
+
+        // The whole segment at once.
+        if (!runs.empty()) {
+            renderer.bufferDrawFg(row, runs, str.data(), str.size());
+            runs.clear();
+            str.clear();
         }
     }
 }
@@ -1531,10 +2138,10 @@ void Buffer::dispatchCursor(bool reverse, I_Renderer & renderer) const {
         auto   apos     = APos(r1 - _scrollOffset, c1);
         auto   selected = selValid && isCellSelected(apos, selBegin, selEnd, wrap);
         auto & cell     = aline.cells[c1];
-        auto & attrs    = cell.style.attrs;
+        auto & attrs    = cell.style().attrs;
         auto   swap     = XOR(reverse, attrs.get(Attr::INVERSE));
-        auto   fg       = cell.style.fg;
-        auto   bg       = cell.style.bg;
+        auto   fg       = cell.style().fg;
+        auto   bg       = cell.style().bg;
         if (XOR(selected, swap)) { std::swap(fg, bg); }
 
         if (_config.customCursorFillColor) {
@@ -1558,40 +2165,225 @@ void Buffer::dispatchCursor(bool reverse, I_Renderer & renderer) const {
 void Buffer::dispatchSearch(bool UNUSED(reverse), I_Renderer & renderer) const {
     auto row = getRows() - 1;
 
-    auto str = "?" + _search->pattern;
+    auto & search = *_search;
+    auto   str    = "?" + search.pattern + "  " +
+                    stringify(search.hits.empty() ? 0 : search.hits.size() - search.current) +
+                    "/" + stringify(search.hits.size()) + (search.job ? "+" : "");
 
-    renderer.bufferDrawBg(Pos(row, 0), getCols(), UColor::stock(UColor::Name::TEXT_FG));
-    renderer.bufferDrawFg(Pos(row, 0),
-                          str.size(),
-                          UColor::stock(UColor::Name::TEXT_BG),
-                          AttrSet(),
-                          reinterpret_cast<const uint8_t *>(str.data()),
-                          str.size());
+    str.resize(std::min(str.size(), static_cast<size_t>(getCols())));
+
+    renderer.bufferDrawBg(UColor::stock(UColor::Name::TEXT_FG),
+                          std::vector<CellRect>(1, CellRect(Pos(row, 0), 1, getCols())));
+    std::vector<FgRun> runs(1, FgRun(0, str.size(), UColor::stock(UColor::Name::TEXT_BG),
+                                     AttrSet(), 0, str.size()));
+    renderer.bufferDrawFg(row, runs, reinterpret_cast<const uint8_t *>(str.data()), str.size());
 }
 
-void Buffer::rebuildHistory() {
-    _history.clear();
+void Buffer::getSearchMarks(int32_t row, std::vector<bool> & marks) const {
+    std::fill(marks.begin(), marks.end(), false);
 
-    uint32_t index = 0;
+    if (!_search) { return; }
 
-    for (auto tag : _tags) {
-        auto length = (tag != I_Deduper::invalidTag() ?
-                       _deduper.lookupLength(tag) :
-                       _pending.size());
+    // Paragraphs don't overlap, so only the last hit starting at or before
+    // the row can contain it.
+    auto & hits = _search->hits;
+    auto   iter = std::upper_bound(hits.begin(), hits.end(), row,
+                                   [](int32_t r, const Search::Hit & hit) {
+                                       return r < hit.row;
+                                   });
 
-        uint16_t seqnum = 0;
-        size_t   offset = 0;
+    if (iter == hits.begin()) { return; }
+    --iter;
 
-        do {
-            _history.push_back(HLine(index + _lostTags, seqnum));
-            ++seqnum;
-            offset += _cols;
-        } while (offset < length);
+    auto seqnum = static_cast<uint32_t>(row - iter->row);
+    if (seqnum >= iter->rows) { return; }
 
-        ++index;
+    uint32_t begin = seqnum * getCols();
+    uint32_t end   = begin + getCols();
+
+    for (auto & range : _search->matches[iter->match]) {
+        for (auto i = std::max(range.first, begin); i < std::min(range.second, end); ++i) {
+            marks[i - begin] = true;
+        }
+    }
+}
+
+void Buffer::startSearch() {
+    finishReflow();         // Search all the history.
+
+    auto & search = *_search;
+
+    // Paragraphs that aren't (yet) deduplicated are searched directly: the
+    // active ones, and the pending one.
+    BufferIter           bufferIter(*this, getRows() - 1);
+    std::vector<Cell>    cells;
+    std::vector<uint8_t> text;
+    SearchJob::Ranges    ranges;
+
+    while (bufferIter.valid()) {
+        auto row = bufferIter.getRow();
+        if (row < 0 && _tags[getHLine(row).index] != I_Deduper::invalidTag()) { break; }
+
+        cells.clear();
+
+        for (auto paraIter = bufferIter.getParaIter(); paraIter.valid(); paraIter.moveForward()) {
+            cells.push_back(paraIter.getCell());
+        }
+
+        SearchJob::match(*search.regex, cells, text, ranges);
+
+        if (!ranges.empty()) {
+            auto rows = std::max<uint32_t>(1, (cells.size() + getCols() - 1) / getCols());
+            search.hits.push_back(Search::Hit{ row, rows,
+                                               static_cast<uint32_t>(search.matches.size()) });
+            search.matches.push_back(ranges);
+        }
+
+        bufferIter.moveBackward();
     }
 
-    _history.shrink_to_fit();
+    std::reverse(search.hits.begin(), search.hits.end());
+
+    if (!search.hits.empty()) {
+        search.current = search.hits.size() - 1;
+        showSearchHit();
+    }
+    else {
+        damageViewport(false);
+    }
+
+    // The rest of the history is searched in the background. Only the
+    // unique paragraphs that could match are considered.
+    SearchIndex::Query          query(search.pattern);
+    std::vector<I_Deduper::Tag> candidates;
+    _searchIndex.candidates(query, candidates);
+
+    if (!candidates.empty()) {
+        std::vector<I_Deduper::Tag> tags(_tags.begin(), _tags.end());
+        auto threads = std::min<size_t>(SEARCH_THREADS, std::thread::hardware_concurrency());
+        search.job.reset(new SearchJob(_deduper, *search.regex,
+                                       std::move(tags), std::move(candidates), threads));
+    }
+}
+
+// Called before the history changes, because the job refers to its tags
+// and the hits to its rows. The search is started again afterwards.
+void Buffer::stopSearch() {
+    auto & search = *_search;
+
+    search.job.reset();
+    search.matches.clear();
+    search.indices.clear();
+    search.hits.clear();
+    search.current = 0;
+    search.moved   = false;
+    search.dropped = 0;
+}
+
+// Scroll the current hit into view, if it isn't already.
+void Buffer::showSearchHit() {
+    auto & hit = _search->hits[_search->current];
+    auto   top = hit.row + static_cast<int32_t>(_scrollOffset);      // Viewport row.
+
+    // The last row shows the search status.
+    if (top < 0 || top >= getRows() - 1) {
+        auto offset = static_cast<int32_t>(getRows() / 2) - hit.row;
+        offset = std::max<int32_t>(offset, 0);
+        offset = std::min<int32_t>(offset, getHistoricalRows());
+
+        if (static_cast<uint32_t>(offset) != _scrollOffset) {
+            _scrollOffset = offset;
+            _barDamage    = true;
+        }
+    }
+
+    damageViewport(false);
+}
+
+// The oldest 'count' paragraphs have been trimmed from the history. The job
+// holds its own references to them, so it carries on, but its hits in them
+// are dropped as they are collected. Rows are counted from the active
+// region, so the other hits are unmoved.
+void Buffer::trimSearch(size_t count) {
+    auto & search = *_search;
+    auto & hits   = search.hits;
+    auto   top    = -static_cast<int32_t>(getHistoricalRows());
+
+    search.dropped += count;
+
+    auto end = std::find_if(hits.begin(), hits.end(),
+                            [top](const Search::Hit & hit) { return hit.row >= top; });
+    auto gone = static_cast<size_t>(end - hits.begin());
+
+    if (gone != 0) {
+        hits.erase(hits.begin(), end);
+        search.current = search.current >= gone ? search.current - gone : 0;
+        _damage.back().damageAdd(0, getCols());     // The status line.
+    }
+}
+
+// Only the newest history is indexed immediately: the scrolled-back rows,
+// plus 'rows', with some to spare. The rest is indexed incrementally by
+// continueReflow().
+void Buffer::rebuildHistory(size_t rows) {
+    _history.assign(_tags.size(), 0);
+    _unflowedTags = _tags.size();
+
+    reflowHistory(_scrollOffset + rows + REFLOW_MIN_ROWS);
+}
+
+bool Buffer::continueReflow() {
+    return reflowHistory(REFLOW_CHUNK_ROWS);
+}
+
+// Count the rows of unflowed paragraphs, newest first, until at least 'rows'
+// rows have been added to _history.
+bool Buffer::reflowHistory(size_t rows) {
+    if (_unflowedTags == 0) {
+        return false;
+    }
+
+    size_t added = 0;
+
+    while (_unflowedTags != 0 && added < rows) {
+        --_unflowedTags;
+
+        auto count = countRows(_unflowedTags);
+        _history.set(_unflowedTags, count);
+        added += count;
+    }
+
+    if (_unflowedTags == 0) {
+        _history.shrink_to_fit();
+    }
+
+    _barDamage = true;
+
+    return _unflowedTags != 0;
+}
+
+// How many rows does paragraph 'index' wrap to at the current width?
+uint32_t Buffer::countRows(size_t index) const {
+    auto tag    = _tags[index];
+    auto length = (tag != I_Deduper::invalidTag() ? _lengths[index] : _pending.size());
+
+    // An empty paragraph still occupies a row.
+    return length == 0 ? 1 : (length + _cols - 1) / _cols;
+}
+
+// Estimate the rows of the unflowed paragraphs from those already indexed.
+uint32_t Buffer::getUnflowedRows() const {
+    if (_unflowedTags == 0) {
+        return 0;
+    }
+
+    auto flowedTags = _tags.size() - _unflowedTags;
+
+    if (flowedTags == 0) {
+        return _unflowedTags;
+    }
+
+    return static_cast<uint64_t>(_unflowedTags) * getHistoricalRows() / flowedTags;
 }
 
 bool Buffer::isCellSelected(APos apos, APos begin, APos end, int16_t wrap) {
@@ -1658,10 +2450,9 @@ void Buffer::insertLinesAt(int16_t row, uint16_t n) {
         }
     }
 
-    _active.erase (_active.begin() + _marginEnd - n, _active.begin() + _marginEnd);
-    _active.insert(_active.begin() + row, n, ALine(getCols(), _cursor.style));
+    _active.rotateDown(row, _marginEnd, n, _cursor.style);
 
-    damageRows(row, _marginEnd);
+    damageScrollActive(row, _marginEnd, -static_cast<int16_t>(n));
 
     // We mustn't leave a line with 'cont' set when the continuation line
     // is gone. This can also cause _active.back().cont to be true, violating
@@ -1691,10 +2482,9 @@ void Buffer::eraseLinesAt(int16_t row, uint16_t n) {
         }
     }
 
-    _active.erase (_active.begin() + row, _active.begin() + row + n);
-    _active.insert(_active.begin() + _marginEnd - n, n, ALine(getCols(), _cursor.style));
+    _active.rotateUp(row, _marginEnd, n, _cursor.style);
 
-    damageRows(row, _marginEnd);
+    damageScrollActive(row, _marginEnd, n);
 
     ASSERT(!_active.back().cont, "");
 }
@@ -1738,6 +2528,65 @@ void Buffer::damageRows(int16_t begin, int16_t end) {
     }
 }
 
+// Record that the viewport rows [begin, end) have moved up by 'rows' (down
+// if negative), damaging the rows that are exposed.
+void Buffer::damageScroll(int16_t begin, int16_t end, int16_t rows) {
+    ASSERT(begin >= 0 && begin <= end && end <= getRows(), "");
+
+    if (rows == 0 || begin == end) {
+        return;
+    }
+
+    if (_scroll.rows != 0 && (_scroll.begin != begin || _scroll.end != end)) {
+        // Only one block of rows can be pending. Redraw the old one.
+        for (auto i = _scroll.begin; i != _scroll.end; ++i) {
+            _damage[i].damageSet(0, getCols());
+        }
+        _scroll = Scroll();
+    }
+
+    auto height = end - begin;
+
+    if (_search || std::abs(rows) >= height || std::abs(_scroll.rows + rows) >= height) {
+        // Nothing is left to copy (or the search bar would move).
+        for (auto i = begin; i != end; ++i) {
+            _damage[i].damageSet(0, getCols());
+        }
+        _scroll = Scroll();
+        return;
+    }
+
+    _scroll.begin = begin;
+    _scroll.end   = end;
+    _scroll.rows += rows;
+
+    if (rows > 0) {
+        std::copy(_damage.begin() + begin + rows, _damage.begin() + end,
+                  _damage.begin() + begin);
+        for (auto i = end - rows; i != end; ++i) {
+            _damage[i].damageSet(0, getCols());
+        }
+    }
+    else {
+        std::copy_backward(_damage.begin() + begin, _damage.begin() + end + rows,
+                           _damage.begin() + end);
+        for (auto i = begin; i != begin - rows; ++i) {
+            _damage[i].damageSet(0, getCols());
+        }
+    }
+}
+
+// As damageScroll(), but for active rows, which may be partially visible.
+void Buffer::damageScrollActive(int16_t begin, int16_t end, int16_t rows) {
+    auto bottom = static_cast<uint32_t>(getRows());
+    auto begin2 = std::min(_scrollOffset + static_cast<uint32_t>(begin), bottom);
+    auto end2   = std::min(_scrollOffset + static_cast<uint32_t>(end),   bottom);
+
+    // The cursor is drawn over the rows, so it moves with them.
+    damageCell();
+    damageScroll(begin2, end2, rows);
+}
+
 void Buffer::damageSelection() {
     APos begin, end;
 
@@ -1763,6 +2612,13 @@ void Buffer::addLine() {
         eraseLinesAt(_marginBegin, 1);
     }
     else {
+        // Unless scrolled back, the viewport moves up with the active rows.
+        auto follow = _scrollOffset == 0;
+
+        if (follow) {
+            damageCell();
+        }
+
         if (_historyLimit == 0) {
             _active.pop_front();
         }
@@ -1770,7 +2626,7 @@ void Buffer::addLine() {
             bump();
 
             if (!_config.scrollWithHistory) {
-                if (_scrollOffset != 0 && _scrollOffset != _history.size()) {
+                if (_scrollOffset != 0 && _scrollOffset != getHistoricalRows()) {
                     ++_scrollOffset;
                 }
             }
@@ -1778,26 +2634,59 @@ void Buffer::addLine() {
             enforceHistoryLimit();
         }
 
-        _active.emplace_back(getCols());
+        _active.push_back();
 
         APos begin, end;
         if (normaliseSelection(begin, end)) {
-            if (begin.row == -static_cast<int32_t>(_history.size())) {
+            if (begin.row == -static_cast<int32_t>(getHistoricalRows())) {
                 clearSelection();
             }
             else {
                 --_selectMark.row;
                 --_selectDelim.row;
             }
+
+            follow = false;     // Selection damage isn't tracked through the scroll.
         }
         else {
-            if (_selectMark.row > -static_cast<int32_t>(_history.size())) {
+            if (_selectMark.row > -static_cast<int32_t>(getHistoricalRows())) {
                 --_selectMark.row;
                 --_selectDelim.row;
             }
         }
 
-        damageViewport(true);
+        if (follow) {
+            damageScroll(0, getRows(), 1);
+            _barDamage = true;
+        }
+        else {
+            damageViewport(true);
+        }
+    }
+}
+
+void Buffer::wrapCursor() {
+    _cursor.wrapNext = false;
+    auto & line = _active[_cursor.pos.row];
+
+    // Don't set 'cont' to true if this line will remain the last line,
+    // otherwise we violate our invariant.
+    if (_cursor.pos.row == _marginEnd - 1 || _cursor.pos.row < getRows() - 1) {
+        line.cont = true; // continues on next line
+    }
+
+    ASSERT(_cursor.pos.col == _cols - 1,
+           "col=" << _cursor.pos.col << ", _cols-1=" << _cols - 1);
+    ASSERT(line.wrap == _cols,
+           "wrap=" << line.wrap << ", _cols=" << _cols);
+
+    if (_cursor.pos.row == _marginEnd - 1) {
+        addLine();      // invalidates line reference
+        moveCursor2(true, 0, false, 0);
+    }
+    else {
+        // If we are on the last line then the column will just be reset.
+        moveCursor2(true, 1, false, 0);
     }
 }
 
@@ -1816,63 +2705,65 @@ void Buffer::bump() {
     if (_pending.empty()) {
         // This line is not a continuation of a previous line.
         ASSERT(_tags.empty() || _tags.back() != I_Deduper::invalidTag(), "");
-        ASSERT(_history.empty() || _history.back().index - _lostTags == _tags.size() - 1, "");
 
         if (cont) {
             // This line is continued on the next line so it can't be stored
             // for dedupe yet.
-            _pending = std::move(cells);
-            ASSERT(cells.empty(), "Not stolen by move constructor?");
+            _pending.assign(cells.begin(), cells.end());
             _tags.push_back(I_Deduper::invalidTag());
+            _lengths.push_back(0);
         }
         else {
             // This line is completely standalone. Immediately dedupe it.
             ASSERT(static_cast<size_t>(wrap) <= cells.size(), "");
-            cells.erase(cells.begin() + wrap, cells.end());
-            auto tag = _deduper.store(cells);
+            _bumped.assign(cells.begin(), cells.begin() + wrap);
+            auto tag = _deduper.store(_bumped);
             ASSERT(tag != I_Deduper::invalidTag(), "");
+            chargeHistory(tag, true);
+            _searchIndex.add(tag, _bumped);
             _tags.push_back(tag);
+            _lengths.push_back(_bumped.size());
         }
 
-        _history.push_back(HLine(_tags.size() + _lostTags - 1, 0));
+        _history.push_back(1);
     }
     else {
         // This line is a continuation of the previous line.
         // Copy its contents into _pending.
         ASSERT(!_tags.empty(), "");
         ASSERT(_tags.back() == I_Deduper::invalidTag(), "");
-        ASSERT(!_history.empty(), "");
-        ASSERT(_history.back().index - _lostTags == _tags.size() - 1, "");
+        ASSERT(_history.size() == _tags.size() && _history.back() != 0, "");
         auto oldSize = _pending.size();
         ASSERT(oldSize % _cols == 0, "");
 
         _pending.resize(oldSize + wrap, Cell::blank());
         std::copy(cells.begin(), cells.begin() + wrap, _pending.begin() + oldSize);
-        _history.push_back(HLine(_tags.size() + _lostTags - 1, _history.back().seqnum + 1));
+        _history.set(_history.size() - 1, _history.back() + 1);
 
         if (!cont) {
             // This line is not itself continued.
             // Store _pending and the tag.
             auto tag = _deduper.store(_pending);
             ASSERT(tag != I_Deduper::invalidTag(), "");
+            chargeHistory(tag, true);
+            _searchIndex.add(tag, _pending);
+            _lengths.back() = _pending.size();
             _pending.clear();
             ASSERT(_tags.back() == I_Deduper::invalidTag(), "");
             _tags.back() = tag;
         }
     }
 
-    ASSERT(!_history.empty() && _history.back().index - _lostTags == _tags.size() - 1, "");
+    ASSERT(_history.size() == _tags.size() && _lengths.size() == _tags.size(), "");
 
-    _active.pop_front();        // This invalidates 'aline'.
+    _active.pop_front();        // This invalidates 'aline', but keeps its row.
 }
 
 void Buffer::unbump() {
     ASSERT(!_tags.empty(), "");
-    ASSERT(!_history.empty(), "");
-
-    auto & hline = _history.back();
-    ASSERT(hline.index - _lostTags == _tags.size() - 1, "");
+    ASSERT(_history.size() == _tags.size() && _history.back() != 0, "");
 
+    auto seqnum = _history.back() - 1;
     bool cont;
 
     if (_pending.empty()) {
@@ -1880,7 +2771,14 @@ void Buffer::unbump() {
         auto tag = _tags.back();
         ASSERT(tag != I_Deduper::invalidTag(), "");
         _deduper.lookup(tag, _pending);
+        _searchIndex.remove(tag);
+        chargeHistory(tag, false);
         _deduper.remove(tag);
+
+        // The tag is no longer ours, so forget its lines.
+        for (uint32_t s = 0; s == 0 || s * _cols < _pending.size(); ++s) {
+            uncacheLine(tag, s);
+        }
         _tags.back() = I_Deduper::invalidTag();
     }
     else {
@@ -1888,39 +2786,145 @@ void Buffer::unbump() {
         ASSERT(_tags.back() == I_Deduper::invalidTag(), "");
     }
 
-    size_t offset = hline.seqnum * _cols;
+    size_t offset = seqnum * _cols;
     ASSERT(offset <= _pending.size(), "");
-    std::vector<Cell> cells(_pending.begin() + offset, _pending.end());
+    _active.push_front(_pending.data() + offset, _pending.data() + _pending.size(), cont);
     _pending.erase(_pending.begin() + offset, _pending.end());
-
-    _active.emplace_front(cells, cont, cells.size(), _cols);
-    ASSERT(cells.empty(), "Not stolen by move constructor?");
     ASSERT(_active.front().wrap <= _cols, "");
 
-    _history.pop_back();
-
-    if (_history.empty() || _history.back().index - _lostTags != _tags.size() - 1) {
+    if (seqnum == 0) {
         _tags.pop_back();
+        _lengths.pop_back();
+        _history.pop_back();
         ASSERT(_pending.empty(), "");
     }
+    else {
+        _history.set(_history.size() - 1, seqnum);
+    }
+}
+
+void Buffer::chargeHistory(I_Deduper::Tag tag, bool add) {
+    if (!_countBytes) { return; }
+
+    auto bytes = static_cast<ssize_t>(_deduper.lookupBytes(tag));
+    chargeBytes(add ? bytes : -bytes);
+}
+
+void Buffer::chargeBytes(ssize_t delta) {
+    ASSERT(delta >= 0 || static_cast<size_t>(-delta) <= _historyBytes, "");
+    _historyBytes += delta;
+
+    if (_budget && delta != 0) { _budget->charge(this, delta); }
 }
 
 void Buffer::enforceHistoryLimit() {
-    while (_tags.size() > _historyLimit) {
-        while (!_history.empty() && _history.front().index == _lostTags) {
-            if (_scrollOffset == _history.size()) { --_scrollOffset; }
-            _history.pop_front();
+    // Let the excess build up to a batch, so a flood of output releases its
+    // paragraphs a batch at a time rather than one at a time. A small limit
+    // gets a proportionately small batch.
+    auto excess = _tags.size() > _historyLimit ? _tags.size() - _historyLimit : 0;
+
+    if (excess != 0 && excess >= std::min<size_t>(TRIM_BATCH, _historyLimit / 16 + 1)) {
+        trimHistory(excess);
+    }
+
+    // Bytes are only counted for valid tags, so those are all that go for
+    // the sake of the byte limit. Each one's size is looked up on the way
+    // anyway, so they go one at a time.
+    auto byteLimit = _config.scrollBackBytes;
+
+    while (_countBytes && byteLimit != 0 && _historyBytes > byteLimit &&
+           _tags.front() != I_Deduper::invalidTag())
+    {
+        evictOldest();
+    }
+
+    trimSelection();
+}
+
+void Buffer::trimHistory(size_t count) {
+    ASSERT(count <= _tags.size(), "");
+
+    auto rows = _history.prefix(count);
+
+    for (size_t i = 0; i != count; ++i) {
+        for (uint32_t seqnum = 0; seqnum != _history.get(i); ++seqnum) {
+            uncacheLine(_tags[i], seqnum);
         }
+    }
+
+    _scrollOffset = std::min(_scrollOffset, getHistoricalRows() - rows);
+
+    std::vector<I_Deduper::Tag> tags(_tags.begin(), _tags.begin() + count);
+    size_t                      bytes = 0;
 
-        _deduper.remove(_tags.front());
-        _tags.pop_front();
-        ++_lostTags;
+    for (auto tag : tags) {
+        if (tag != I_Deduper::invalidTag()) {
+            _searchIndex.remove(tag);
+            if (_countBytes) { bytes += _deduper.lookupBytes(tag); }
+        }
     }
 
+    chargeBytes(-static_cast<ssize_t>(bytes));
+
+    _history.pop_front(count);
+    _tags.erase(_tags.begin(), _tags.begin() + count);
+    _lengths.erase(_lengths.begin(), _lengths.begin() + count);
+
+    if (_search) { trimSearch(count); }
+
+    // Those never indexed.
+    _unflowedTags -= std::min<uint32_t>(_unflowedTags, count);
+
+    // The references stay until the destroyer gets to them.
+    _destroyer.add(new TagGarbage(_deduper, std::move(tags)));
+}
+
+void Buffer::evictOldest() {
+    auto rows = _history.front();   // Zero if unflowed.
+
+    for (uint32_t seqnum = 0; seqnum != rows; ++seqnum) {
+        uncacheLine(_tags.front(), seqnum);
+    }
+
+    _scrollOffset = std::min(_scrollOffset, getHistoricalRows() - rows);
+    _history.pop_front();
+
+    if (_tags.front() != I_Deduper::invalidTag()) {
+        _searchIndex.remove(_tags.front());
+        chargeHistory(_tags.front(), false);
+    }
+    _deduper.remove(_tags.front());
+    _tags.pop_front();
+    _lengths.pop_front();
+
+    if (_search) { trimSearch(1); }
+
+    if (_unflowedTags != 0) {
+        // It was never indexed.
+        --_unflowedTags;
+    }
+}
+
+void Buffer::trimSelection() {
     APos begin, end;
     if (normaliseSelection(begin, end)) {
-        if (static_cast<int32_t>(_history.size()) + begin.row < 0) {
+        if (static_cast<int32_t>(getHistoricalRows()) + begin.row < 0) {
             clearSelection();
         }
     }
 }
+
+bool Buffer::budgetEvict() {
+    if (_tags.empty() || _tags.front() == I_Deduper::invalidTag()) {
+        return false;
+    }
+
+    auto scrollOffset = _scrollOffset;
+    evictOldest();
+    trimSelection();
+
+    // The viewport was at the top of the history, which has gone.
+    if (_scrollOffset != scrollOffset) { damageViewport(true); }
+
+    return true;
+}
@@ -5,14 +5,24 @@
 #define COMMON__BUFFER__HXX
 
 #include "terminol/common/data_types.hxx"
+#include "terminol/common/active_grid.hxx"
 #include "terminol/common/config.hxx"
 #include "terminol/common/deduper_interface.hxx"
+#include "terminol/common/history_budget.hxx"
 #include "terminol/common/char_sub.hxx"
+#include "terminol/common/search_index.hxx"
+#include "terminol/common/search_job.hxx"
+#include "terminol/common/selection_text.hxx"
 #include "terminol/support/async_destroyer.hxx"
+#include "terminol/support/cache.hxx"
+#include "terminol/support/fenwick_tree.hxx"
+#include "terminol/support/flat_map.hxx"
 #include "terminol/support/regex.hxx"
+#include "terminol/support/stream.hxx"
 
 #include <deque>
 #include <vector>
+#include <memory>
 #include <iomanip>
 
 // Buffer is the in-memory representation of the on-screen terminal data.
@@ -39,18 +49,20 @@
 // data is stored as paragraphs, e.g. if some text is continued across three
 // lines then the concatenation of those three lines is stored in the
 // historical data.
-// An additional data structure, HLine, allows historical data to be indexed
-// (by row/column) by mapping the grid into segments of these paragraphs.
+// The historical data is indexed (by row/column) with a prefix-sum tree of
+// the number of rows each paragraph wraps to, so mapping a row to its
+// paragraph and segment (an HLine) is O(log n), and the index costs a few
+// words per paragraph rather than per row.
 //
-// During a reflowed-resize the HLines are invalidated but the paragraphs
-// are not. The HLines must be rebuilt by re-traversing the paragraphs.
+// During a reflowed-resize the row counts are invalidated but the paragraphs
+// are not. The counts are recomputed from the cached paragraph lengths.
 // Because the paragraphs are never invalidated (not even during resize)
 // they are stored in a deduplicator object to reduce memory usage for large
 // histories.
 //
 // The cost of representing the on-screen data in these two different ways
 // is the complexity of harmonising access to them.
-class Buffer {
+class Buffer : protected HistoryBudget::I_Client {
     // APos (Absolute-Position) is a position identifier that is able to
     // refer to historical AND active lines.
     struct APos {
@@ -80,53 +92,52 @@ class Buffer {
         return ost << pos.row << 'x' << pos.col;
     }
 
-    // HLine (or Historical-Line) represents a line of text in the historical region.
+    // HLine (or Historical-Line) locates a line of text in the historical region.
     // It can also be thought of as representing a segment of an unwrapped line.
     struct HLine {
-        uint32_t index;             // index into _tags (adjusted by _lostTags)
+        uint32_t index;             // index into _tags
         uint32_t seqnum;            // continuation number, 0 -> 1st line, 1 -> 2nd line, etc
 
         HLine(uint32_t index_, uint32_t seqnum_) : index(index_), seqnum(seqnum_) {}
     };
 
     // ALine (or Active-Line) represents a line of text in the active region.
-    // An ALine directly contains its cells
-    struct ALine {
-        std::vector<Cell> cells;    // active lines have a greater/equal capacity to their wrap/size
-        bool              cont;     // does this line continue on the next line?
-        int16_t           wrap;     // wrappable index, <= cells.size()
-
-        explicit ALine(int16_t cols, const Style & style = Style()) :
-            cells(cols, Cell::blank(style)), cont(false), wrap(0) {}
-
-        ALine(std::vector<Cell> & cells_, bool cont_, int16_t wrap_, int16_t cols) :
-            cells(std::move(cells_)), cont(cont_), wrap(wrap_)
-        {
-            ASSERT(wrap_ <= cols, "");
-            cells.resize(cols, Cell::blank());
-        }
+    // Its cells are a row of the active grid.
+    typedef ActiveGrid::Line ALine;
 
-        void resize(int16_t cols) {
-            ASSERT(cols > 0, "cols not positive.");
-            cont = false;
-            wrap = std::min(wrap, cols);
-            cells.resize(cols, Cell::blank());
-        }
+    // LineKey identifies a decoded historical line. Tags are unique to their
+    // content so lines may be shared between identical paragraphs.
+    struct LineKey {
+        I_Deduper::Tag tag;
+        uint32_t       seqnum;
+        int16_t        cols;
+
+        LineKey(I_Deduper::Tag tag_, uint32_t seqnum_, int16_t cols_) :
+            tag(tag_), seqnum(seqnum_), cols(cols_) {}
 
-        void clear(const Style & style) {
-            cont = false;
-            wrap = 0;
-            std::fill(cells.begin(), cells.end(), Cell::blank(style));
+        friend bool operator == (const LineKey & lhs, const LineKey & rhs) {
+            return lhs.tag == rhs.tag && lhs.seqnum == rhs.seqnum && lhs.cols == rhs.cols;
         }
 
-        bool isBlank() const {
-            for (auto & c : cells) {
-                if (c != Cell::blank()) { return false; }
+        struct Hash {
+            size_t operator () (const LineKey & key) const {
+                return key.tag ^ (key.seqnum * 0x9E3779B9u) ^ (static_cast<uint32_t>(key.cols) << 20);
             }
-            return true;
-        }
+        };
     };
 
+    // CLine (or Cached-Line) is a decoded historical line, as returned by getLine().
+    struct CLine {
+        std::vector<Cell> cells;
+        bool              cont;
+        int16_t           wrap;
+
+        CLine(const std::vector<Cell> & cells_, bool cont_, int16_t wrap_) :
+            cells(cells_), cont(cont_), wrap(wrap_) {}
+    };
+
+    typedef Cache<LineKey, CLine, LineKey::Hash> LineCache;
+
     // Damage for a visible line (active or historical, but in the viewport)
     struct Damage {
         int16_t begin;      // inclusive
@@ -165,14 +176,27 @@ class Buffer {
         }
     };
 
+    // Scroll records that the viewport rows [begin, end) have moved up by
+    // 'rows' (down if negative) since the last dispatch, so that the renderer
+    // can copy them instead of redrawing them. The damage of those rows moves
+    // with them.
+    struct Scroll {
+        int16_t begin;
+        int16_t end;
+        int16_t rows;       // 0 -> no scroll
+
+        Scroll() : begin(0), end(0), rows(0) {}
+    };
+
     // Cursor encompasses the state associated with a VT cursor.
     struct Cursor {
         Pos     pos;            // Current cursor position.
-        Style   style;          // Current cursor style.
+        StyleId style;          // Current cursor style, interned.
         bool    wrapNext;       // Flag indicating whether the next char wraps.
         CharSet charSet;        // Which CharSet is in use?
 
-        Cursor() : pos(), style(), wrapNext(false), charSet(CharSet::G0) {}
+        Cursor() :
+            pos(), style(StyleTable::DEFAULT), wrapNext(false), charSet(CharSet::G0) {}
     };
 
     struct SavedCursor {
@@ -229,6 +253,8 @@ class Buffer {
             return _valid;
         }
 
+        int32_t getRow() const { return _row; }
+
         void moveForward();
 
         void moveBackward();
@@ -242,13 +268,33 @@ class Buffer {
     //
 
     struct Search {
-        Search(const Buffer & buffer, const std::string & pattern_) :
-            iter(buffer, buffer.getRows() - 2),
-            pattern(pattern_) {}
-
-        BufferIter                              iter;
-        std::string                             pattern;
-        std::vector<std::vector<Regex::Substr>> allOffsets;
+        struct Hit {
+            int32_t  row;       // First row of the paragraph.
+            uint32_t rows;
+            uint32_t match;     // Index into matches.
+        };
+
+        explicit Search(const std::string & pattern_) :
+            pattern(pattern_),
+            regex(new Regex(pattern_)),
+            matches(),
+            indices(I_Deduper::invalidTag()),
+            hits(),
+            current(0),
+            moved(false),
+            dropped(0),
+            job() {}
+
+        std::string                    pattern;
+        std::unique_ptr<Regex>         regex;
+        std::vector<SearchJob::Ranges> matches;     // The matched cells of each hit paragraph.
+        FlatMap<I_Deduper::Tag, uint32_t, std::hash<I_Deduper::Tag>>
+                                       indices;     // Historical paragraphs' matches.
+        std::vector<Hit>               hits;        // Sorted by row.
+        size_t                         current;     // Into hits, unless empty.
+        bool                           moved;       // Navigated? Else current is the newest.
+        uint32_t                       dropped;     // Paragraphs trimmed since the job's snapshot.
+        std::unique_ptr<SearchJob>     job;         // Searching the history, until finished.
     };
 
     //
@@ -259,14 +305,22 @@ class Buffer {
     I_Deduper                  & _deduper;
     I_Destroyer                & _destroyer;
     std::deque<I_Deduper::Tag>   _tags;             // The paragraph history.
-    uint32_t                     _lostTags;         // Incremented for each _tags.pop_front().
+    SearchIndex                  _searchIndex;      // Summaries of the valid _tags.
+    std::deque<uint32_t>         _lengths;          // Cells of each tag, unused while pending.
     std::vector<Cell>            _pending;          // Paragraph pending to become historical.
-    std::deque<HLine>            _history;          // Historical paragraph segments. Indexable.
-    std::deque<ALine>            _active;           // Active paragraph segments. Indexable.
+    FenwickTree                  _history;          // Rows of each tag. Indexable by row.
+    uint32_t                     _unflowedTags;     // Leading _tags not yet counted in _history.
+    ActiveGrid                   _active;           // Active paragraph segments. Indexable.
+    std::vector<Cell>            _bumped;           // Scratch for bump().
     std::vector<Damage>          _damage;           // Viewport-relative damage.
+    Scroll                       _scroll;           // Viewport-relative pending scroll.
+    std::vector<std::vector<Cell>> _presented;      // Viewport rows as last dispatched, empty if unknown.
     std::vector<bool>            _tabs;             // Column-indexable, true if tab stop exists.
     uint32_t                     _scrollOffset;     // 0 -> scroll bottom
-    uint32_t                     _historyLimit;     // Maximum number of historical paragraphs to keep.
+    uint32_t                     _historyLimit;     // Historical paragraphs to keep, give or take a trim batch.
+    HistoryBudget              * _budget;           // Shared with other buffers, if any.
+    bool                         _countBytes;       // Is _historyBytes counted?
+    size_t                       _historyBytes;     // Deduper bytes of the valid _tags.
     int16_t                      _cols;             // Current width of buffer.
     int16_t                      _marginBegin;      // Index of first row in margin (inclusive).
     int16_t                      _marginEnd;        // Index of last row in  margin (exclusive).
@@ -277,19 +331,75 @@ class Buffer {
     SavedCursor                  _savedCursor;      // Saved cursor.
     CharSubArray                 _charSubs;
     Search                     * _search;
+    mutable LineCache            _lineCache;        // Recently decoded historical lines.
+    mutable uint32_t             _lineCacheHits;
+    mutable uint32_t             _lineCacheMisses;
 
 public:
+    // RowKey identifies what a historical row looks like when drawn, so a
+    // renderer may keep rendered rows. Historical paragraphs are immutable,
+    // the hash of the cells guards against a tag being reused.
+    struct RowKey {
+        I_Deduper::Tag tag;
+        uint32_t       seqnum;
+        int16_t        cols;
+        bool           reverse;
+        uint64_t       hash;
+
+        RowKey(I_Deduper::Tag tag_, uint32_t seqnum_, int16_t cols_, bool reverse_, uint64_t hash_) :
+            tag(tag_), seqnum(seqnum_), cols(cols_), reverse(reverse_), hash(hash_) {}
+
+        friend bool operator == (const RowKey & lhs, const RowKey & rhs) {
+            return
+                lhs.tag == rhs.tag && lhs.seqnum == rhs.seqnum && lhs.cols == rhs.cols &&
+                lhs.reverse == rhs.reverse && lhs.hash == rhs.hash;
+        }
+
+        struct Hash {
+            size_t operator () (const RowKey & key) const {
+                return static_cast<size_t>(key.hash);
+            }
+        };
+    };
+
+    // Approximate bytes held by a buffer, by structure. The paragraphs
+    // themselves are held by the deduper.
+    struct MemoryStats {
+        size_t tags    = 0;     // The history's tags, lengths and search index.
+        size_t history = 0;     // The history's row counts.
+        size_t active  = 0;     // The active lines.
+        size_t pending = 0;     // The paragraph pending to become historical.
+        size_t cache   = 0;     // Decoded historical lines.
+
+        // Not bytes: how effective the decoded-line cache has been.
+        size_t cacheHits   = 0;
+        size_t cacheMisses = 0;
+
+        size_t total() const { return tags + history + active + pending + cache; }
+
+        MemoryStats & operator += (const MemoryStats & rhs) {
+            tags    += rhs.tags;
+            history += rhs.history;
+            active  += rhs.active;
+            pending += rhs.pending;
+            cache   += rhs.cache;
+            cacheHits   += rhs.cacheHits;
+            cacheMisses += rhs.cacheMisses;
+            return *this;
+        }
+    };
+
     class I_Renderer {
     public:
-        virtual void bufferDrawBg(Pos     pos,
-                                  int16_t count,
-                                  UColor  color) = 0;
-        virtual void bufferDrawFg(Pos             pos,
-                                  int16_t         count,
-                                  UColor          color,
-                                  AttrSet         attrs,
-                                  const uint8_t * str,       // nul-terminated
-                                  size_t          size) = 0;
+        // Fill each rectangle with the colour, before any foreground over them.
+        virtual void bufferDrawBg(UColor                        color,
+                                  const std::vector<CellRect> & rects) = 0;
+        // Draw a damaged segment of the row, its runs in order. Glyphs that
+        // might not fit their cell have a run each.
+        virtual void bufferDrawFg(int16_t                    row,
+                                  const std::vector<FgRun> & runs,
+                                  const uint8_t            * str,
+                                  size_t                     size) = 0;
         virtual void bufferDrawCursor(Pos             pos,
                                       UColor          fg,
                                       UColor          bg,
@@ -297,6 +407,16 @@ public:
                                       const uint8_t * str,    // nul-terminated, count 1
                                       size_t          size,
                                       bool            wrapNext) = 0;
+        // Move the viewport rows [begin, end) up by 'rows' (down if negative).
+        // Return false if they must be redrawn instead.
+        virtual bool bufferScroll(int16_t begin,
+                                  int16_t end,
+                                  int16_t rows) = 0;
+        // Draw the viewport row as it was captured for the key. Return false
+        // if it wasn't, then it is drawn cell by cell.
+        virtual bool bufferBlitRow(int16_t row, const RowKey & key) = 0;
+        // The viewport row has just been drawn in full, for the key.
+        virtual void bufferCaptureRow(int16_t row, const RowKey & key) = 0;
 
     protected:
         ~I_Renderer() {}
@@ -309,32 +429,69 @@ public:
            int16_t              rows,
            int16_t              cols,
            uint32_t             historyLimit,
-           const CharSubArray & charSubs);
+           const CharSubArray & charSubs,
+           HistoryBudget      * budget = nullptr);
 
-    ~Buffer();
+    virtual ~Buffer();
 
     int16_t  getRows() const { return static_cast<int16_t>(_active.size()); }
     int16_t  getCols() const { return _cols; }
 
     // How many _wrapped_ lines are there in the scroll-back history?
-    uint32_t getHistoricalRows() const { return _history.size(); }
-    // How many historical and active lines are there?
-    uint32_t getTotalRows() const { return _history.size() + _active.size(); }
-    // How many rows is viewport offset from the start of history?
-    uint32_t getHistoryOffset() const { return _history.size() - _scrollOffset; }
+    uint32_t getHistoricalRows() const { return _history.total(); }
+    // How many historical and active lines are there? Estimated during a reflow.
+    uint32_t getTotalRows() const {
+        return getUnflowedRows() + getHistoricalRows() + _active.size();
+    }
+    // How many rows is viewport offset from the start of history? Estimated
+    // during a reflow.
+    uint32_t getHistoryOffset() const {
+        return getUnflowedRows() + getHistoricalRows() - _scrollOffset;
+    }
     // How many rows is the viewport offset from the beginning of active?
     uint32_t getScrollOffset() const { return _scrollOffset; }
     // Is the bar damaged (does it need redrawing)?
     bool     getBarDamage() const { return _barDamage; }
+    // How effective has the decoded-line cache been?
+    void     getLineCacheStats(uint32_t & hits, uint32_t & misses) const {
+        hits   = _lineCacheHits;
+        misses = _lineCacheMisses;
+    }
+    // Add this buffer's footprint to 'stats'. Proportional to the rows, not
+    // the history.
+    void     getMemoryStats(MemoryStats & stats) const;
+    // Set the flag in 'used' (see StyleTable::reclaim()) of every style id
+    // held by the cells of this buffer. The history is held by the deduper.
+    void     markStyles(std::vector<bool> & used) const;
 
     void markSelection(Pos pos);
     void delimitSelection(Pos pos, bool initial);
     void expandSelection(Pos pos, int level);
     void clearSelection();
     bool getSelectedText(std::string & text) const;
+    // Refers to historical paragraphs rather than copying their text.
+    bool getSelectedText(SelectionText & text) const;
 
     void clearHistory();
 
+    // Is a reflow still indexing older history?
+    bool isReflowing() const { return _unflowedTags != 0; }
+    // Index the next chunk of older history. Returns true if there is more.
+    bool continueReflow();
+
+    // Write the history paragraphs to a snapshot.
+    void saveHistory(OutStream & ostream) const throw (StreamError);
+    // The stored history paragraphs, oldest first, for HistoryExport, and
+    // the cells of the paragraphs that follow them: the pending paragraph
+    // and the active lines, less trailing blank lines.
+    void getHistory(std::vector<I_Deduper::Tag>    & tags,
+                    std::vector<std::vector<Cell>> & tail) const;
+    // Insert the paragraphs taken from a HistoryRestore before the existing
+    // history, taking over their references, which leaves the arguments empty.
+    void insertHistory(std::vector<I_Deduper::Tag> & tags,
+                       std::vector<uint32_t>       & lengths,
+                       SearchIndex                 & index);
+
     bool scrollUpHistory(uint16_t rows);
 
     bool scrollDownHistory(uint16_t rows);
@@ -349,6 +506,10 @@ public:
 
     void write(utf8::Seq seq, bool autoWrap, bool insert);
 
+    // Equivalent to write() for each of a run of single byte characters, but
+    // a row at a time.
+    void writeRun(const uint8_t * data, size_t size, bool autoWrap, bool insert);
+
     void backspace(bool autoWrap);
 
     void forwardIndex(bool resetCol = false);
@@ -400,15 +561,31 @@ public:
         resetStyle();
     }
 
-    void resetStyle() { _cursor.style = Style(); }
+    void resetStyle() { _cursor.style = StyleTable::DEFAULT; }
 
-    void setAttr(Attr attr) { _cursor.style.attrs.set(attr); }
+    void setAttr(Attr attr) {
+        auto style = lookupStyle(_cursor.style);
+        style.attrs.set(attr);
+        _cursor.style = internStyle(style);
+    }
 
-    void unsetAttr(Attr attr) { _cursor.style.attrs.unset(attr); }
+    void unsetAttr(Attr attr) {
+        auto style = lookupStyle(_cursor.style);
+        style.attrs.unset(attr);
+        _cursor.style = internStyle(style);
+    }
 
-    void setFg(const UColor & color) { _cursor.style.fg = color; }
+    void setFg(const UColor & color) {
+        auto style = lookupStyle(_cursor.style);
+        style.fg = color;
+        _cursor.style = internStyle(style);
+    }
 
-    void setBg(const UColor & color) { _cursor.style.bg = color; }
+    void setBg(const UColor & color) {
+        auto style = lookupStyle(_cursor.style);
+        style.bg = color;
+        _cursor.style = internStyle(style);
+    }
 
     void insertCells(uint16_t n);
 
@@ -444,7 +621,7 @@ public:
 
     void damageCell();
 
-    void accumulateDamage(Region & damage) const;
+    void accumulateDamage(RegionSet & damage) const;
 
     void dispatch(bool reverse, I_Renderer & renderer);
 
@@ -455,9 +632,16 @@ public:
     const CharSub * getCharSub(CharSet charSet) const;
 
     bool isSearching() const { return _search; }
-    void beginSearch(const std::string & pattern);
+    // Is the history still being searched? If so pollSearch() should be
+    // called periodically.
+    bool isSearchPending() const { return _search && _search->job; }
+    void beginSearch(const std::string & pattern) throw (Regex::Error);
     const std::string & getSearchPattern() const;
-    void setSearchPattern(const std::string & pattern);
+    void setSearchPattern(const std::string & pattern) throw (Regex::Error);
+    // Take the hits found since the last call. Returns true if there
+    // is damage.
+    bool pollSearch();
+    // Move to the next older hit, or the next newer hit.
     void nextSearch();
     void prevSearch();
     void endSearch();
@@ -468,16 +652,39 @@ public:
     void dumpSelection(std::ostream & ost) const;
 
 protected:
+    // Locate a historical row, -1 being the most recent.
+    HLine getHLine(int32_t row) const {
+        uint32_t seqnum;
+        auto     index = _history.find(getHistoricalRows() + row, seqnum);
+        return HLine(index, seqnum);
+    }
+
     void getLine(int32_t row, std::vector<Cell> & cells,
                  bool & cont, int16_t & wrap) const;
+    void uncacheLine(I_Deduper::Tag tag, uint32_t seqnum);
 
+    void dispatchScroll(I_Renderer & renderer);
+    void diffDamage();
+    void dispatchRows(bool reverse, I_Renderer & renderer,
+                      std::vector<std::pair<int16_t, RowKey>> & captures);
+    void invalidatePresented();
     void dispatchBg(bool reverse, I_Renderer & renderer) const;
     void dispatchFg(bool reverse, I_Renderer & renderer) const;
     void dispatchCursor(bool reverse, I_Renderer & renderer) const;
     void dispatchSearch(bool reverse, I_Renderer & renderer) const;
+    void getSearchMarks(int32_t row, std::vector<bool> & marks) const;
+
+    void startSearch();
+    void stopSearch();
+    void showSearchHit();
+    void trimSearch(size_t count);
     void resetDamage();
 
-    void rebuildHistory();
+    void rebuildHistory(size_t rows);
+    bool reflowHistory(size_t rows);
+    uint32_t countRows(size_t index) const;
+    void finishReflow() { reflowHistory(std::numeric_limits<size_t>::max()); }
+    uint32_t getUnflowedRows() const;
 
     static bool isCellSelected(APos apos, APos begin, APos end, int16_t wrap);
 
@@ -494,16 +701,39 @@ protected:
     void damageColumns(int16_t begin, int16_t end);
 
     void damageRows(int16_t begin, int16_t end);
+    void damageScroll(int16_t begin, int16_t end, int16_t rows);
+    void damageScrollActive(int16_t begin, int16_t end, int16_t rows);
 
     void damageSelection();
 
     void addLine();
 
+    void wrapCursor();
+
     void bump();
 
     void unbump();
 
+    // Count the bytes of 'tag' into (or out of) the history, if counting.
+    void chargeHistory(I_Deduper::Tag tag, bool add);
+
+    void chargeBytes(ssize_t delta);
+
     void enforceHistoryLimit();
+
+    // Drop the 'count' oldest paragraphs together, leaving the destroyer to
+    // release them from the deduper in one batch.
+    void trimHistory(size_t count);
+
+    // Drop the oldest paragraph, which mustn't be pending.
+    void evictOldest();
+
+    // Clear the selection if it reaches into dropped history.
+    void trimSelection();
+
+    // HistoryBudget::I_Client implementation:
+
+    bool budgetEvict() override;
 };
 
 #endif // COMMON__BUFFER__HXX
@@ -6,10 +6,21 @@
 
 #include "terminol/support/net.hxx"
 #include "terminol/common/config.hxx"
+#include "terminol/common/control.hxx"
 
+#include <string>
+#include <set>
+
+// Requests are sent as soon as the socket allows, without waiting for the
+// replies to earlier ones, see control.hxx.
 class Client : protected SocketClient::I_Observer {
-    SocketClient   _socket;
-    bool           _finished;
+    SocketClient                _socket;
+    control::Reader             _reader;
+    uint32_t                    _nextTag;
+    std::set<uint32_t>          _awaited;       // Tags of requests yet to be answered.
+    std::vector<control::Frame> _replies;       // In the order received.
+    bool                        _queued;        // Requests not yet sent?
+    bool                        _connected;
 
 public:
     struct Error {
@@ -18,35 +29,82 @@ public:
     };
 
     Client(I_Selector   & selector,
-           const Config & config,
-           bool           shutdown) try :
+           const Config & config) try :
         _socket(*this, selector, config.socketPath),
-        _finished(false)
-    {
-        uint8_t byte = shutdown ? 0xFF : 0;
-        _socket.send(&byte, 1);
-    }
+        _reader(),
+        _nextTag(0),
+        _awaited(),
+        _replies(),
+        _queued(false),
+        _connected(true)
+    {}
     catch (const SocketClient::Error & error) {
         throw Error(error.message);
     }
 
     virtual ~Client() {}
 
-    bool isFinished() const { return _finished; }
+    // Queue a request, returning the tag its reply will carry.
+    uint32_t request(ControlRequest type, const std::vector<uint8_t> & payload = {}) {
+        auto tag = _nextTag++;
+
+        std::vector<uint8_t> bytes;
+        control::putFrame(bytes, type, tag, payload.data(), payload.size());
+        _socket.send(bytes.data(), bytes.size());
+        _queued = true;
+
+        if (hasReply(type)) { _awaited.insert(tag); }
+
+        return tag;
+    }
+
+    uint32_t create(const control::Create & create) {
+        std::vector<uint8_t> payload;
+        control::encodeCreate(create, payload);
+        return request(ControlRequest::CREATE, payload);
+    }
+
+    // Everything sent and answered, or the server has gone.
+    bool isFinished() const {
+        return !_connected || (!_queued && _awaited.empty());
+    }
+
+    const std::vector<control::Frame> & getReplies() const { return _replies; }
 
 protected:
 
     // SocketClient::I_Observer implementation:
 
+    void clientReceived(const uint8_t * data, size_t size) override {
+        _reader.append(data, size);
+
+        try {
+            control::Frame reply;
+            while (_reader.next(reply)) {
+                if (_awaited.erase(reply.tag) == 0) {
+                    ERROR("Unexpected reply: " << reply.tag);
+                    continue;
+                }
+                _replies.push_back(std::move(reply));
+            }
+        }
+        catch (const control::Reader::Error & error) {
+            ERROR(error.message);
+            _connected = false;
+        }
+    }
+
     void clientDisconnected() override {
-        ERROR("Client disconnected");
-        _finished = true;
+        // The server disconnects once shut down.
+        if (!_awaited.empty()) {
+            ERROR("Client disconnected");
+        }
+        _connected = false;
     }
 
     void clientQueueEmpty() override {
-        _finished = true;
+        _queued = false;
     }
 };
 
-
 #endif // COMMON__CLIENT__HXX
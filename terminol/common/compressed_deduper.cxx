@@ -0,0 +1,318 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/compressed_deduper.hxx"
+#include "terminol/common/para_codec.hxx"
+#include "terminol/support/hash.hxx"
+#include "terminol/support/lz.hxx"
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+
+CompressedDeduper::CompressedDeduper(size_t blockSize) :
+    _entries(invalidTag()),
+    _blockSize(blockSize),
+    _open(),
+    _openTags(),
+    _openLiveBytes(0),
+    _blocks(),
+    _freeBlocks(),
+    _sealedRawBytes(0),
+    _sealedBytes(0),
+    _cachedBlock(OPEN_BLOCK),
+    _cache(),
+    _totalRefs(0),
+    _totalBytes(0),
+    _mutex() {}
+
+CompressedDeduper::~CompressedDeduper() {}
+
+auto CompressedDeduper::store(const std::vector<Cell> & cells) -> Tag {
+    std::vector<uint8_t> bytes;
+    para::encode(cells, bytes);
+    auto hash = hash64(bytes.data(), bytes.size());
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    auto tag = claimTag(hash, 1,
+                        [&](Tag t) {
+                            auto iter = _entries.find(t);
+
+                            if (iter == _entries.end()) {
+                                Entry entry(cells.size(), bytes.size(), OPEN_BLOCK, 0);
+                                append(t, entry, bytes.data());
+                                _entries.insert(t, std::move(entry));
+                                return true;
+                            }
+
+                            auto & entry = iter->second;
+
+                            if (bytes.size() == entry.size &&
+                                std::memcmp(bytes.data(), data(entry), bytes.size()) == 0)
+                            {
+                                ++entry.refs;
+
+                                if (entry.block != OPEN_BLOCK) {
+                                    // Move it out of the old block.
+                                    release(entry);
+                                    append(t, entry, bytes.data());
+                                }
+                                return true;
+                            }
+
+                            return false;
+                        },
+                        [&] { return static_cast<Tag>(_entries.size()) != invalidTag(); });
+
+    ++_totalRefs;
+    _totalBytes += bytes.size();
+
+    if (_open.size() >= _blockSize) {
+        seal();
+    }
+
+    return tag;
+}
+
+void CompressedDeduper::lookup(Tag tag, std::vector<Cell> & cells) const {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    auto iter = _entries.find(tag);
+    ASSERT(iter != _entries.end(), "");
+
+    auto & entry = iter->second;
+    para::decode(data(entry), entry.length, cells);
+}
+
+void CompressedDeduper::lookupSegment(Tag tag, uint32_t offset, int16_t max_size,
+                                      std::vector<Cell> & cells, bool & cont, int16_t & wrap) const {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    auto iter = _entries.find(tag);
+    ASSERT(iter != _entries.end(), "");
+
+    auto & entry = iter->second;
+    ASSERT(offset <= entry.length, "");
+    para::Decoder decoder(data(entry), offset);
+
+    cells.resize(max_size, Cell::blank());
+    wrap = std::min<uint32_t>(max_size, entry.length - offset);
+
+    decoder.read(cells.data(), wrap);
+    std::fill(cells.begin() + wrap, cells.end(), Cell::blank());
+    cont = (offset + wrap != entry.length);
+}
+
+size_t CompressedDeduper::lookupLength(Tag tag) const {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    auto iter = _entries.find(tag);
+    ASSERT(iter != _entries.end(), "");
+    return iter->second.length;
+}
+
+size_t CompressedDeduper::lookupBytes(Tag tag) const {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    auto iter = _entries.find(tag);
+    ASSERT(iter != _entries.end(), "");
+    return iter->second.size;
+}
+
+void CompressedDeduper::lookupText(Tag tag, const TextVisitor & visit) const {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    auto iter = _entries.find(tag);
+    ASSERT(iter != _entries.end(), "");
+
+    auto & entry  = iter->second;
+    auto   bytes  = data(entry);
+    auto   offset = para::textOffset(bytes);
+    visit(bytes + offset, entry.size - offset);
+}
+
+void CompressedDeduper::addRef(Tag tag) {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    ASSERT(tag != invalidTag(), "");
+    auto iter = _entries.find(tag);
+    ASSERT(iter != _entries.end(), "");
+    ++iter->second.refs;
+    ++_totalRefs;
+    _totalBytes += iter->second.size;
+}
+
+void CompressedDeduper::remove(Tag tag) {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    ASSERT(tag != invalidTag(), "");
+    removeEntry(tag);
+}
+
+void CompressedDeduper::removeMany(const std::vector<Tag> & tags) {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    for (auto tag : tags) {
+        if (tag != invalidTag()) { removeEntry(tag); }
+    }
+}
+
+void CompressedDeduper::markStyles(std::vector<bool> & used) const {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    // Block by block, so each is decompressed once.
+    std::vector<const Entry *> entries;
+    entries.reserve(_entries.size());
+    for (auto & pair : _entries) { entries.push_back(&pair.second); }
+
+    std::sort(entries.begin(), entries.end(),
+              [](const Entry * lhs, const Entry * rhs) { return lhs->block < rhs->block; });
+
+    for (auto entry : entries) {
+        para::markStyles(data(*entry), used);
+    }
+}
+
+void CompressedDeduper::removeEntry(Tag tag) {
+    auto iter = _entries.find(tag);
+    ASSERT(iter != _entries.end(), "");
+    auto & entry = iter->second;
+
+    _totalBytes -= entry.size;
+
+    if (--entry.refs == 0) {
+        release(entry);
+        _entries.erase(iter);
+    }
+
+    --_totalRefs;
+}
+
+void CompressedDeduper::getLineStats(uint32_t & uniqueLines, uint32_t & totalLines) const {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    uniqueLines = _entries.size();
+    totalLines  = _totalRefs;
+}
+
+void CompressedDeduper::getByteStats(size_t & uniqueBytes, size_t & totalBytes) const {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    // Unique bytes are those actually held, after deduplication and
+    // compression, so the ratio reflects both.
+    uniqueBytes = _open.size() + _sealedBytes;
+    totalBytes  = _totalBytes;
+}
+
+void CompressedDeduper::dump(std::ostream & ost) const {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    auto flags = ost.flags();
+
+    ost << "BEGIN BLOCKS" << std::endl
+        << "open:   " << _open.size() << " bytes, " << _openLiveBytes << " live" << std::endl
+        << "sealed: " << _blocks.size() - _freeBlocks.size() << " blocks, "
+        << _sealedRawBytes << " bytes compressed to " << _sealedBytes;
+
+    if (_sealedBytes != 0) {
+        ost << " (" << std::fixed << std::setprecision(2)
+            << static_cast<double>(_sealedRawBytes) / _sealedBytes << "x)";
+    }
+
+    ost << std::endl << "END BLOCKS" << std::endl << std::endl;
+
+    ost.flags(flags);
+}
+
+const uint8_t * CompressedDeduper::data(const Entry & entry) const {
+    if (entry.block == OPEN_BLOCK) {
+        return &_open[entry.offset];
+    }
+
+    if (_cachedBlock != entry.block) {
+        auto & block = _blocks[entry.block];
+        _cache.resize(block.rawSize);
+        ENFORCE(lz::decompress(block.data.data(), block.data.size(), _cache.data(), _cache.size()),
+                "Corrupt history block: " << entry.block);
+        _cachedBlock = entry.block;
+    }
+
+    return &_cache[entry.offset];
+}
+
+void CompressedDeduper::append(Tag tag, Entry & entry, const uint8_t * bytes) {
+    entry.block  = OPEN_BLOCK;
+    entry.offset = _open.size();
+
+    _open.insert(_open.end(), bytes, bytes + entry.size);
+    _openTags.push_back(tag);
+    _openLiveBytes += entry.size;
+}
+
+void CompressedDeduper::release(const Entry & entry) {
+    if (entry.block == OPEN_BLOCK) {
+        _openLiveBytes -= entry.size;
+
+        if (_openLiveBytes == 0) {
+            _open.clear();
+            _openTags.clear();
+        }
+    }
+    else {
+        auto & block = _blocks[entry.block];
+        block.liveBytes -= entry.size;
+
+        if (block.liveBytes == 0) {
+            _sealedRawBytes -= block.rawSize;
+            _sealedBytes    -= block.data.size();
+            std::vector<uint8_t>().swap(block.data);
+            _freeBlocks.push_back(entry.block);
+
+            if (_cachedBlock == entry.block) {
+                _cachedBlock = OPEN_BLOCK;
+            }
+        }
+    }
+}
+
+void CompressedDeduper::seal() {
+    ASSERT(_openLiveBytes != 0, "");
+
+    Block block;
+    lz::compress(_open.data(), _open.size(), block.data);
+    block.data.shrink_to_fit();
+    block.rawSize   = _open.size();
+    block.liveBytes = _openLiveBytes;
+
+    _sealedRawBytes += block.rawSize;
+    _sealedBytes    += block.data.size();
+
+    uint32_t index;
+
+    if (_freeBlocks.empty()) {
+        index = _blocks.size();
+        _blocks.push_back(std::move(block));
+    }
+    else {
+        index = _freeBlocks.back();
+        _freeBlocks.pop_back();
+        _blocks[index] = std::move(block);
+    }
+
+    for (auto tag : _openTags) {
+        auto iter = _entries.find(tag);
+        if (iter != _entries.end() && iter->second.block == OPEN_BLOCK) {
+            iter->second.block = index;
+        }
+    }
+
+    // The open bytes are the decompressed block, so keep them as the cache.
+    _cache.swap(_open);
+    _cachedBlock = index;
+
+    _open.clear();
+    _openTags.clear();
+    _openLiveBytes = 0;
+}
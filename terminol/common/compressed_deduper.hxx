@@ -0,0 +1,94 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef COMMON__COMPRESSED_DEDUPER__HXX
+#define COMMON__COMPRESSED_DEDUPER__HXX
+
+#include "terminol/common/deduper_interface.hxx"
+#include "terminol/support/flat_map.hxx"
+
+#include <vector>
+#include <mutex>
+
+// CompressedDeduper appends encoded paragraphs to an open block. Once the
+// open block reaches the block size it is LZ compressed and sealed.
+// Compressing whole blocks, rather than single paragraphs, captures the
+// redundancy between neighbouring lines of output, which is where most of it
+// is for logs.
+// Lookups of sealed paragraphs decompress the containing block into a single
+// block cache, so sequential history access costs one decompression per
+// block. Storing a duplicate of a sealed paragraph moves it to the open block
+// so that frequently repeated paragraphs don't pin old blocks.
+class CompressedDeduper : public I_Deduper {
+    struct Entry {
+        uint32_t refs;
+        uint32_t length;
+        uint32_t size;          // Encoded bytes.
+        uint32_t block;         // OPEN_BLOCK or index into _blocks.
+        uint32_t offset;        // Within the (uncompressed) block.
+
+        Entry() : refs(0), length(0), size(0), block(0), offset(0) {}
+        Entry(uint32_t length_, uint32_t size_, uint32_t block_, uint32_t offset_) :
+            refs(1), length(length_), size(size_), block(block_), offset(offset_) {}
+    };
+
+    struct Block {
+        std::vector<uint8_t> data;      // Compressed. Empty if free.
+        uint32_t             rawSize;
+        uint32_t             liveBytes; // Referenced (uncompressed) bytes.
+
+        Block() : data(), rawSize(0), liveBytes(0) {}
+    };
+
+    struct TagHash {
+        size_t operator () (Tag tag) const { return tag; }
+    };
+
+    static const uint32_t OPEN_BLOCK = static_cast<uint32_t>(-1);
+
+    FlatMap<Tag, Entry, TagHash> _entries;
+    const size_t                 _blockSize;
+    std::vector<uint8_t>         _open;             // Uncompressed.
+    std::vector<Tag>             _openTags;         // May be stale.
+    uint32_t                     _openLiveBytes;
+    std::vector<Block>           _blocks;
+    std::vector<uint32_t>        _freeBlocks;
+    size_t                       _sealedRawBytes;
+    size_t                       _sealedBytes;
+    mutable uint32_t             _cachedBlock;      // OPEN_BLOCK if none.
+    mutable std::vector<uint8_t> _cache;            // Decompressed _cachedBlock.
+    size_t                       _totalRefs;
+    size_t                       _totalBytes;       // Encoded bytes times references.
+    mutable std::mutex           _mutex;
+
+public:
+    explicit CompressedDeduper(size_t blockSize = 64 * 1024);
+    virtual ~CompressedDeduper();
+
+    // I_Deduper implementation:
+
+    Tag store(const std::vector<Cell> & cells) override;
+    void lookup(Tag tag, std::vector<Cell> & cells) const override;
+    void lookupSegment(Tag tag, uint32_t offset, int16_t maxSize,
+                       std::vector<Cell> & cells, bool & cont, int16_t & wrap) const override;
+    size_t lookupLength(Tag tag) const override;
+    size_t lookupBytes(Tag tag) const override;
+    void lookupText(Tag tag, const TextVisitor & visit) const override;
+    void addRef(Tag tag) override;
+    void remove(Tag tag) override;
+    void removeMany(const std::vector<Tag> & tags) override;
+    void markStyles(std::vector<bool> & used) const override;
+
+    void getLineStats(uint32_t & uniqueLines, uint32_t & totalLines) const override;
+    void getByteStats(size_t & uniqueBytes, size_t & totalBytes) const override;
+    void dump(std::ostream & ost) const override;
+
+protected:
+    const uint8_t * data(const Entry & entry) const;
+    void append(Tag tag, Entry & entry, const uint8_t * bytes);
+    void release(const Entry & entry);
+    void removeEntry(Tag tag);      // _mutex must be locked.
+    void seal();
+};
+
+#endif // COMMON__COMPRESSED_DEDUPER__HXX
@@ -6,8 +6,21 @@
 
 #include <limits>
 
+#include <pwd.h>
+#include <unistd.h>
+
 namespace {
 
+// The user's home directory, from $HOME or else the password database.
+// Empty if neither knows.
+std::string homeDir() {
+    auto home = static_cast<const char *>(::getenv("HOME"));
+    if (home && *home) { return home; }
+
+    auto pw = ::getpwuid(::getuid());
+    return pw && pw->pw_dir ? pw->pw_dir : "";
+}
+
 const Color COLOURS_LINUX[16] = {
   { 0x00, 0x00, 0x00 },
   { 0xA8, 0x00, 0x00 },
@@ -169,6 +182,11 @@ const Color COLOURS_SOLARIZED_LIGHT[16] = {
 Config::Config() :
     fontName("Monospace"),
     fontSize(12),
+    glyphCache(false),
+    renderThread(false),
+    frameTimeOverlay(false),
+    workerThreads(0),
+    shellPool(0),
     termName("xterm-256color"),
     scrollWithHistory(false),
     scrollOnTtyOutput(false),
@@ -180,7 +198,17 @@ Config::Config() :
     chdir(),
     scrollBackHistory(1 * 1024 * 1024),
     unlimitedScrollBack(true),
+    scrollBackBytes(0),
+    serverScrollBackBytes(0),
+    lineCacheSize(1024),
+    rowCachePixels(2 * 1024 * 1024),
+    spillHistory(false),
+    spillThreshold(64 * 1024 * 1024),
+    spillLimit(1024 * 1024 * 1024),
+    spillDirectory("/var/tmp"),
+    compressHistory(false),
     framesPerSecond(50),
+    minFramesPerSecond(10),
     traditionalWrapping(false),
     //
     traceTty(false),
@@ -203,6 +231,7 @@ Config::Config() :
     doubleClickTimeout(400),
     //
     serverFork(true),
+    persistHistory(false),
     bindings(),
     cutChars("-A-Za-z0-9./?%&#_=+@~"),
     autoHideCursor(true),
@@ -214,7 +243,8 @@ Config::Config() :
     visualBellDuration(25),
     x11PseudoTransparency(false),
     x11CompositedTransparency(false),
-    x11TransparencyValue(0.1)
+    x11TransparencyValue(0.1),
+    x11Shm(false)
 {
     try {
         setColorScheme("rxvt");
@@ -229,6 +259,22 @@ Config::Config() :
     std::ostringstream ost;
     ost << "/tmp/terminols-" << user;
     socketPath = ost.str();
+
+    ost << "-history";
+    historyDir = ost.str();
+
+    // Not in /tmp, where another user could have planted a symlink.
+    auto home = homeDir();
+    if (!home.empty()) { exportTarget = home + "/terminols-history.txt"; }
+
+    // Likewise, and where planted metrics would be used rather than measuring.
+    auto cache = static_cast<const char *>(::getenv("XDG_CACHE_HOME"));
+    if (cache && cache[0] == '/') {
+        fontMetricsCache = std::string(cache) + "/terminol/font-metrics";
+    }
+    else if (!home.empty()) {
+        fontMetricsCache = home + "/.cache/terminol/font-metrics";
+    }
 }
 
 void Config::setColorScheme(const std::string & name) throw (ParseError) {
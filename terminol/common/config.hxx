@@ -14,6 +14,12 @@ struct Config {
 
     std::string fontName;
     int         fontSize;
+    std::string fontMetricsCache;   // Empty -> none.
+    bool        glyphCache;
+    bool        renderThread;
+    bool        frameTimeOverlay;
+    size_t      workerThreads;      // terminols only, 0 -> none.
+    size_t      shellPool;          // terminols only, 0 -> none.
     std::string termName;
     bool        scrollWithHistory;
     bool        scrollOnTtyOutput;
@@ -25,7 +31,17 @@ struct Config {
     std::string chdir;
     size_t      scrollBackHistory;
     bool        unlimitedScrollBack;
+    size_t      scrollBackBytes;
+    size_t      serverScrollBackBytes;
+    size_t      lineCacheSize;
+    size_t      rowCachePixels;
+    bool        spillHistory;
+    size_t      spillThreshold;
+    size_t      spillLimit;
+    std::string spillDirectory;
+    bool        compressHistory;
     int         framesPerSecond;
+    int         minFramesPerSecond;
     bool        traditionalWrapping;
     // Debugging support:
     bool        traceTty;
@@ -61,6 +77,9 @@ struct Config {
 
     std::string socketPath;
     bool        serverFork;
+    bool        persistHistory;
+    std::string historyDir;
+    std::string exportTarget;     // A file, or "|command".
 
     Bindings    bindings;
 
@@ -80,6 +99,7 @@ struct Config {
     bool        x11PseudoTransparency;
     bool        x11CompositedTransparency;
     double      x11TransparencyValue;
+    bool        x11Shm;
 
     //
     //
@@ -0,0 +1,137 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/control.hxx"
+#include "terminol/support/debug.hxx"
+
+#include <cstring>
+
+namespace control {
+
+namespace {
+
+template <typename T> void put(std::vector<uint8_t> & bytes, T value) {
+    auto size = bytes.size();
+    bytes.resize(size + sizeof value);
+    std::memcpy(&bytes[size], &value, sizeof value);
+}
+
+void putString(std::vector<uint8_t> & bytes, const std::string & str) {
+    put<uint32_t>(bytes, str.size());
+    bytes.insert(bytes.end(), str.begin(), str.end());
+}
+
+// Reads a payload front to back, failing rather than overrunning it.
+class Unpacker {
+    const std::vector<uint8_t> & _bytes;
+    size_t                       _offset;
+
+public:
+    explicit Unpacker(const std::vector<uint8_t> & bytes) : _bytes(bytes), _offset(0) {}
+
+    template <typename T> bool get(T & value) {
+        if (_bytes.size() - _offset < sizeof value) { return false; }
+        std::memcpy(&value, &_bytes[_offset], sizeof value);
+        _offset += sizeof value;
+        return true;
+    }
+
+    bool getString(std::string & str) {
+        uint32_t length;
+        if (!get(length) || _bytes.size() - _offset < length) { return false; }
+        str.assign(reinterpret_cast<const char *>(&_bytes[_offset]), length);
+        _offset += length;
+        return true;
+    }
+
+    bool atEnd() const { return _offset == _bytes.size(); }
+};
+
+} // namespace {anonymous}
+
+void putFrame(std::vector<uint8_t> & bytes,
+              ControlRequest         type,
+              uint32_t               tag,
+              const uint8_t        * payload,
+              size_t                 size) {
+    ASSERT(size <= MAX_PAYLOAD, "");
+    put<uint8_t>(bytes, static_cast<uint8_t>(type));
+    put<uint32_t>(bytes, tag);
+    put<uint32_t>(bytes, size);
+    bytes.insert(bytes.end(), payload, payload + size);
+}
+
+void encodeCreate(const Create & create, std::vector<uint8_t> & payload) {
+    put<uint16_t>(payload, create.rows);
+    put<uint16_t>(payload, create.cols);
+    putString(payload, create.cwd);
+    put<uint32_t>(payload, create.command.size());
+    for (auto & arg : create.command) { putString(payload, arg); }
+}
+
+bool decodeCreate(const std::vector<uint8_t> & payload, Create & create) {
+    Unpacker unpacker(payload);
+    uint32_t num;
+
+    if (!unpacker.get(create.rows) || !unpacker.get(create.cols) ||
+        !unpacker.getString(create.cwd) || !unpacker.get(num)) {
+        return false;
+    }
+
+    create.command.clear();
+
+    for (uint32_t i = 0; i != num; ++i) {
+        std::string arg;
+        if (!unpacker.getString(arg)) { return false; }
+        create.command.push_back(std::move(arg));
+    }
+
+    return unpacker.atEnd();
+}
+
+void encodeWindow(uint32_t window, std::vector<uint8_t> & payload) {
+    put<uint32_t>(payload, window);
+}
+
+uint32_t decodeWindow(const std::vector<uint8_t> & payload) {
+    Unpacker unpacker(payload);
+    uint32_t window;
+    return unpacker.get(window) && unpacker.atEnd() ? window : 0;
+}
+
+void Reader::append(const uint8_t * data, size_t size) {
+    // Drop what has been read before growing.
+    if (_offset != 0) {
+        _bytes.erase(_bytes.begin(), _bytes.begin() + _offset);
+        _offset = 0;
+    }
+
+    _bytes.insert(_bytes.end(), data, data + size);
+}
+
+bool Reader::next(Frame & frame) throw (Error) {
+    auto available = _bytes.size() - _offset;
+    if (available < HEADER_SIZE) { return false; }
+
+    auto     header = &_bytes[_offset];
+    uint32_t tag, size;
+    std::memcpy(&tag,  header + sizeof(uint8_t), sizeof tag);
+    std::memcpy(&size, header + sizeof(uint8_t) + sizeof tag, sizeof size);
+
+    if (size > MAX_PAYLOAD) {
+        throw Error("Frame too large: " + std::to_string(size) + " bytes.");
+    }
+
+    if (available - HEADER_SIZE < size) { return false; }
+
+    frame.type = static_cast<ControlRequest>(header[0]);
+    frame.tag  = tag;
+    frame.payload.assign(header + HEADER_SIZE, header + HEADER_SIZE + size);
+
+    _offset += HEADER_SIZE + size;
+    if (_offset == _bytes.size()) { _bytes.clear(); _offset = 0; }
+
+    return true;
+}
+
+} // namespace control
@@ -0,0 +1,101 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef COMMON__CONTROL__HXX
+#define COMMON__CONTROL__HXX
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// The type of each request from terminolc to terminols, echoed by its reply.
+enum class ControlRequest : uint8_t {
+    CREATE   = 0x00,        // Open a window. Reply with its id.
+    MEMORY   = 0x01,        // Reply with a report of the memory in use, as text.
+    FRAMES   = 0x02,        // Reply with the counters of each window's recent frames.
+    SHUTDOWN = 0xFF         // Close every window and exit. No reply.
+};
+
+// Does the server reply?
+inline bool hasReply(ControlRequest request) {
+    return request != ControlRequest::SHUTDOWN;
+}
+
+namespace control {
+
+//
+// Frame layout, in host byte order:
+//
+//   uint8_t  type          a ControlRequest
+//   uint32_t tag           chosen by the client, echoed by the reply
+//   uint32_t size          of the payload, at most MAX_PAYLOAD
+//   payload
+//
+// A connection carries any number of requests, which the client needn't
+// wait to send, and their replies, which arrive as each request completes.
+// Frames aren't aligned to the socket's packets so, either way, the reader
+// reassembles them.
+//
+// CREATE payload:
+//
+//   uint16_t rows, uint16_t cols       zero for the configured size
+//   string   cwd                       empty for the server's
+//   uint32_t N, N * string             the command, empty for the server's
+//
+// where a string is a uint32_t length and its bytes. The reply payload is
+// a uint32_t window id, zero if the window couldn't be opened.
+//
+
+const size_t HEADER_SIZE = sizeof(uint8_t) + 2 * sizeof(uint32_t);
+const size_t MAX_PAYLOAD = 1 << 20;
+
+struct Frame {
+    ControlRequest       type = ControlRequest::CREATE;
+    uint32_t             tag  = 0;
+    std::vector<uint8_t> payload;
+};
+
+struct Create {
+    uint16_t                 rows = 0;
+    uint16_t                 cols = 0;
+    std::string              cwd;
+    std::vector<std::string> command;
+};
+
+// Append the frame to 'bytes'.
+void putFrame(std::vector<uint8_t> & bytes,
+              ControlRequest         type,
+              uint32_t               tag,
+              const uint8_t        * payload,
+              size_t                 size);
+
+void encodeCreate(const Create & create, std::vector<uint8_t> & payload);
+// False if the payload is malformed.
+bool decodeCreate(const std::vector<uint8_t> & payload, Create & create);
+
+void     encodeWindow(uint32_t window, std::vector<uint8_t> & payload);
+uint32_t decodeWindow(const std::vector<uint8_t> & payload);
+
+// Reassembles frames from the bytes received on a connection.
+class Reader {
+    std::vector<uint8_t> _bytes;
+    size_t               _offset;       // Of the first unread byte.
+
+public:
+    struct Error {
+        explicit Error(const std::string & message_) : message(message_) {}
+        std::string message;
+    };
+
+    Reader() : _bytes(), _offset(0) {}
+
+    void append(const uint8_t * data, size_t size);
+
+    // Take the next complete frame, false if there is none yet.
+    bool next(Frame & frame) throw (Error);
+};
+
+} // namespace control
+
+#endif // COMMON__CONTROL__HXX
@@ -3,6 +3,211 @@
 
 #include "terminol/common/data_types.hxx"
 
+#include <limits>
+
+namespace {
+
+const size_t MAX_DAMAGE_REGIONS = 8;
+
+bool isEmpty(const Region & region) {
+    return region.begin.row == region.end.row || region.begin.col == region.end.col;
+}
+
+int area(const Region & region) {
+    return (region.end.row - region.begin.row) * (region.end.col - region.begin.col);
+}
+
+Region bounds(const Region & lhs, const Region & rhs) {
+    return Region(Pos(std::min(lhs.begin.row, rhs.begin.row),
+                      std::min(lhs.begin.col, rhs.begin.col)),
+                  Pos(std::max(lhs.end.row,   rhs.end.row),
+                      std::max(lhs.end.col,   rhs.end.col)));
+}
+
+// Do the regions overlap, or share columns on adjacent rows?
+bool touches(const Region & lhs, const Region & rhs) {
+    return
+        lhs.begin.row <= rhs.end.row && rhs.begin.row <= lhs.end.row &&
+        lhs.begin.col <  rhs.end.col && rhs.begin.col <  lhs.end.col;
+}
+
+// Beyond this many styles, new direct colors are approximated.
+const size_t QUANTISE_SIZE = StyleTable::CAPACITY / 4 * 3;
+
+// Styles denied an id of their own before the observer is notified. Doubled
+// after each reclaim that leaves the table as full, so a table that really
+// is in use isn't swept over and over, up to the maximum.
+const size_t MIN_NOTIFY_PRESSURE = StyleTable::CAPACITY / 64;
+const size_t MAX_NOTIFY_PRESSURE = StyleTable::CAPACITY * 16;
+
+// The nearest level of the 6x6x6 cube: 0, 95, 135, 175, 215, 255.
+uint8_t cubeLevel(uint8_t value) {
+    if (value < 48)  { return 0; }
+    if (value < 115) { return 1; }
+    return static_cast<uint8_t>((value - 35) / 40);
+}
+
+UColor quantise(UColor color) {
+    if (color.type != UColor::Type::DIRECT) { return color; }
+
+    auto & v = color.values;
+    return UColor::indexed(16 + 36 * cubeLevel(v.r) + 6 * cubeLevel(v.g) + cubeLevel(v.b));
+}
+
+uint32_t colorBits(UColor color) {
+    return
+        (static_cast<uint32_t>(color.type) << 24) |
+        (color._init[0] << 16) | (color._init[1] << 8) | color._init[2];
+}
+
+} // namespace {anonymous}
+
+const StyleId StyleTable::DEFAULT;
+const size_t  StyleTable::CAPACITY;
+const size_t  StyleTable::CHUNK_SIZE;
+
+size_t StyleTable::Hash::operator () (const Style & style) const {
+    uint64_t bits =
+        (static_cast<uint64_t>(style.attrs.bits()) << 56) ^
+        (static_cast<uint64_t>(colorBits(style.fg)) << 28) ^
+        colorBits(style.bg);
+    return std::hash<uint64_t>()(bits);
+}
+
+StyleTable::StyleTable() :
+    _mutex(),
+    _ids(),
+    _allocated(0),
+    _free(),
+    _recent(CAPACITY, false),
+    _observer(nullptr),
+    _pressure(0),
+    _notifyAt(MIN_NOTIFY_PRESSURE),
+    _notified(false),
+    _generation(0)
+{
+    for (auto & chunk : _chunks) { chunk.store(nullptr, std::memory_order_relaxed); }
+
+    auto id = insert(Style());
+    ASSERT(id == DEFAULT, "");
+}
+
+StyleId StyleTable::intern(const Style & style) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto iter = _ids.find(style);
+    if (LIKELY(iter != _ids.end())) {
+        _recent[iter->second] = true;
+        return iter->second;
+    }
+
+    if (_ids.size() < QUANTISE_SIZE) { return insert(style); }
+
+    denied();
+
+    Style approx(style.attrs, quantise(style.fg), quantise(style.bg));
+    iter = _ids.find(approx);
+    if (iter != _ids.end()) {
+        _recent[iter->second] = true;
+        return iter->second;
+    }
+    if (_ids.size() != CAPACITY) { return insert(approx); }
+
+    return DEFAULT;
+}
+
+void StyleTable::setObserver(I_Observer * observer) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _observer = observer;
+}
+
+size_t StyleTable::reclaim(const std::vector<bool> & used) {
+    ASSERT(used.size() == CAPACITY, "");
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    size_t count = 0;
+
+    for (auto iter = _ids.begin(); iter != _ids.end(); ) {
+        auto id = iter->second;
+
+        if (id != DEFAULT && !used[id] && !_recent[id]) {
+            _free.push_back(id);
+            iter = _ids.erase(iter);
+            ++count;
+        }
+        else {
+            ++iter;
+        }
+    }
+
+    _recent.assign(CAPACITY, false);
+
+    if (_ids.size() < QUANTISE_SIZE) {
+        _notifyAt = MIN_NOTIFY_PRESSURE;
+    }
+    else {
+        _notifyAt = std::min(2 * _notifyAt, MAX_NOTIFY_PRESSURE);
+    }
+
+    _pressure = 0;
+    _notified = false;
+
+    if (count != 0) { _generation.fetch_add(1, std::memory_order_relaxed); }
+
+    return count;
+}
+
+size_t StyleTable::size() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _ids.size();
+}
+
+size_t StyleTable::bytes() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto chunks = (_allocated + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    return
+        sizeof *this +
+        chunks * CHUNK_SIZE * sizeof(Style) +
+        _recent.capacity() / 8 +
+        _free.capacity() * sizeof(StyleId) +
+        _ids.bucket_count() * sizeof(void *) +
+        _ids.size() * (sizeof(Style) + sizeof(StyleId) + 2 * sizeof(void *));
+}
+
+StyleId StyleTable::insert(const Style & style) {
+    StyleId id;
+
+    if (!_free.empty()) {
+        id = _free.back();
+        _free.pop_back();
+    }
+    else {
+        id = static_cast<StyleId>(_allocated++);
+    }
+
+    auto chunk = _chunks[id / CHUNK_SIZE].load(std::memory_order_relaxed);
+
+    if (!chunk) {
+        ASSERT(id % CHUNK_SIZE == 0, "");
+        chunk = new Style[CHUNK_SIZE];
+    }
+
+    // The style is written before the chunk is published (if it is new),
+    // and before the id can reach another thread.
+    chunk[id % CHUNK_SIZE] = style;
+    _chunks[id / CHUNK_SIZE].store(chunk, std::memory_order_release);
+    _ids.insert(std::make_pair(style, id));
+    _recent[id] = true;
+    return id;
+}
+
+void StyleTable::denied() {
+    if (++_pressure >= _notifyAt && !_notified && _observer) {
+        _notified = true;
+        _observer->stylesFilling();
+    }
+}
+
 std::ostream & operator << (std::ostream & ost, Color color) {
     ost << '#'
         << nibbleToHex((color.r >> 4) & 0x0F)
@@ -34,3 +239,63 @@ std::istream & operator >> (std::istream & ist, Color & color) {
 
     return ist;
 }
+
+void RegionSet::add(Region region) {
+    if (isEmpty(region)) { return; }
+
+    // Absorb every region this one touches. Growing may make it touch
+    // regions it didn't before, so start again after each absorption.
+    for (size_t i = 0; i != _regions.size(); ) {
+        if (touches(_regions[i], region)) {
+            region = bounds(_regions[i], region);
+            _regions.erase(_regions.begin() + i);
+            i = 0;
+        }
+        else {
+            ++i;
+        }
+    }
+
+    _regions.push_back(region);
+
+    if (_regions.size() > MAX_DAMAGE_REGIONS) {
+        size_t bestI = 0, bestJ = 1;
+        auto   bestWaste = std::numeric_limits<int>::max();
+
+        for (size_t i = 0; i != _regions.size(); ++i) {
+            for (size_t j = i + 1; j != _regions.size(); ++j) {
+                auto waste =
+                    area(bounds(_regions[i], _regions[j])) -
+                    area(_regions[i]) - area(_regions[j]);
+
+                if (waste < bestWaste) {
+                    bestI     = i;
+                    bestJ     = j;
+                    bestWaste = waste;
+                }
+            }
+        }
+
+        auto merged = bounds(_regions[bestI], _regions[bestJ]);
+        _regions.erase(_regions.begin() + bestJ);
+        _regions.erase(_regions.begin() + bestI);
+        add(merged);
+    }
+}
+
+void RegionSet::add(const RegionSet & other) {
+    for (auto & region : other._regions) {
+        add(region);
+    }
+}
+
+std::ostream & operator << (std::ostream & ost, const RegionSet & regionSet) {
+    auto first = true;
+
+    for (auto & region : regionSet.getRegions()) {
+        if (first) { first = false; } else { ost << "; "; }
+        ost << region;
+    }
+
+    return ost;
+}
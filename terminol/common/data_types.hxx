@@ -8,8 +8,13 @@
 #include "terminol/common/utf8.hxx"
 #include "terminol/common/ascii.hxx"
 #include "terminol/support/conv.hxx"
+#include "terminol/support/pattern.hxx"
 
 #include <algorithm>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
 
 //
 // An RGB color.
@@ -132,38 +137,150 @@ inline bool operator != (const Style & lhs, const Style & rhs) {
     return !(lhs == rhs);
 }
 
+//
+// StyleTable (of the process).
+//
+
+// A Cell holds the id of its Style, an index into the table.
+typedef uint16_t StyleId;
+
+// StyleTable interns the Styles of Cells, so that a Cell carries a 2 byte id
+// rather than a 9 byte Style. There is one table per process, because the
+// dedupers share paragraphs between buffers, so two ids are equal if and only
+// if their Styles are. Looking up an id takes no lock, the Styles live in
+// chunks that are never moved or freed. Interning locks, but buffers intern
+// their cursor style when it changes, not for each cell written.
+// Ids fall out of use as history is trimmed, so they are reclaimed, lest one
+// colourful client exhaust the table for every window for good. As the table
+// fills the observer is notified, and it is up to the observer to call
+// reclaim() with the ids held by every cell of the process, at a time when
+// no holder is in use, e.g. with every worker locked. Ids interned since the
+// last reclaim are kept regardless, as they may be in cells on their way to
+// a holder, such as a restore's paragraphs.
+class StyleTable : protected Uncopyable {
+public:
+    static const StyleId DEFAULT  = 0;          // Style().
+    static const size_t  CAPACITY = 1 << 16;
+
+    class I_Observer {
+    public:
+        // The table is filling, call reclaim() soon. Called on the interning
+        // thread, with the table locked, once per reclaim.
+        virtual void stylesFilling() = 0;
+
+    protected:
+        I_Observer() {}
+        ~I_Observer() {}
+    };
+
+    // Never destroyed, so that it outlives every thread.
+    static StyleTable & instance() {
+        static StyleTable * table = new StyleTable;
+        return *table;
+    }
+
+    // The id of 'style', adding it if necessary. Once the table is three
+    // quarters full the direct colors of new styles are approximated by the
+    // 6x6x6 color cube, and once it is full new styles get DEFAULT, until
+    // ids are reclaimed.
+    StyleId intern(const Style & style);
+
+    const Style & lookup(StyleId id) const {
+        return _chunks[id / CHUNK_SIZE].load(std::memory_order_acquire)[id % CHUNK_SIZE];
+    }
+
+    void setObserver(I_Observer * observer);
+
+    // Free the ids that aren't 'used' (CAPACITY flags) and haven't been
+    // interned since the last reclaim. Returns the number freed.
+    size_t reclaim(const std::vector<bool> & used);
+
+    // Changes whenever ids are freed, and so may come to stand for other
+    // styles, e.g. to invalidate anything keyed by the ids of cells.
+    uint32_t generation() const { return _generation.load(std::memory_order_relaxed); }
+
+    size_t size()  const;
+    size_t bytes() const;
+
+private:
+    static const size_t CHUNK_SIZE = 256;
+
+    struct Hash {
+        size_t operator () (const Style & style) const;
+    };
+
+    mutable std::mutex                       _mutex;
+    std::unordered_map<Style, StyleId, Hash> _ids;              // Guarded by _mutex.
+    std::atomic<Style *>                     _chunks[CAPACITY / CHUNK_SIZE];
+    size_t                                   _allocated;        // Ids ever used. Guarded by _mutex.
+    std::vector<StyleId>                     _free;             // Reclaimed ids. Ditto.
+    std::vector<bool>                        _recent;           // Interned since reclaim(). Ditto.
+    I_Observer                             * _observer;         // Ditto.
+    size_t                                   _pressure;         // Styles denied an id of their own. Ditto.
+    size_t                                   _notifyAt;         // Pressure that notifies. Ditto.
+    bool                                     _notified;         // Ditto.
+    std::atomic<uint32_t>                    _generation;
+
+    StyleTable();
+
+    StyleId insert(const Style & style);        // With _mutex held.
+    void    denied();                           // Ditto.
+};
+
+inline StyleId internStyle(const Style & style) {
+    return StyleTable::instance().intern(style);
+}
+
+inline const Style & lookupStyle(StyleId id) {
+    return StyleTable::instance().lookup(id);
+}
+
 //
 // Cell (an element in the Buffer array).
 //
 
 struct Cell {
-    Style     style;        // 9 bytes
+    StyleId   styleId;      // 2 bytes
     utf8::Seq seq;          // 4 bytes
 
-    static Cell blank(const Style & style = Style()) {
+    const Style & style() const { return lookupStyle(styleId); }
+
+    static Cell blank(StyleId style = StyleTable::DEFAULT) {
         return Cell(style, utf8::Seq(SPACE));
     }
 
-    static Cell ascii(uint8_t a, const Style & style = Style()) {
+    static Cell blank(const Style & style) {
+        return blank(internStyle(style));
+    }
+
+    static Cell ascii(uint8_t a, StyleId style = StyleTable::DEFAULT) {
         return Cell(style, utf8::Seq(a));
     }
 
-    static Cell utf8(utf8::Seq seq, const Style & style = Style()) {
+    static Cell ascii(uint8_t a, const Style & style) {
+        return ascii(a, internStyle(style));
+    }
+
+    static Cell utf8(utf8::Seq seq, StyleId style = StyleTable::DEFAULT) {
         return Cell(style, seq);
     }
 
+    static Cell utf8(utf8::Seq seq, const Style & style) {
+        return utf8(seq, internStyle(style));
+    }
+
 private:
-    Cell(const Style & style_, utf8::Seq seq_) :
-        style(style_),
+    Cell(StyleId styleId_, utf8::Seq seq_) :
+        styleId(styleId_),
         seq(seq_) {}
 };
 
-static_assert(sizeof(Cell) == 13, "Incorrect size of Cell.");
+static_assert(sizeof(Cell) == 6, "Incorrect size of Cell.");
 
 inline bool operator == (const Cell & lhs, const Cell & rhs) {
     return
-        lhs.seq   == rhs.seq &&
-        lhs.style == rhs.style;
+        lhs.seq     == rhs.seq &&
+        lhs.styleId == rhs.styleId;
 }
 
 inline bool operator != (const Cell & lhs, const Cell & rhs) { return !(lhs == rhs); }
@@ -237,4 +354,58 @@ inline std::ostream & operator << (std::ostream & ost, const Region & region) {
     return ost << "begin: " << region.begin << ", end: " << region.end;
 }
 
+//
+// A small set of disjoint regions. Regions that overlap, or that share columns
+// on adjacent rows, are merged as they are added. Past a handful of regions,
+// the pair whose bounding box adds the fewest cells is merged.
+//
+
+class RegionSet {
+    std::vector<Region> _regions;
+
+public:
+    RegionSet() : _regions() {}
+
+    bool empty() const { return _regions.empty(); }
+    void clear() { _regions.clear(); }
+
+    const std::vector<Region> & getRegions() const { return _regions; }
+
+    void add(Region region);
+    void add(const RegionSet & other);
+};
+
+std::ostream & operator << (std::ostream & ost, const RegionSet & regionSet);
+
+//
+// A rectangle of cells, 'rows' by 'cols' from 'pos'.
+//
+
+struct CellRect {
+    Pos     pos;
+    int16_t rows;
+    int16_t cols;
+
+    CellRect(Pos pos_, int16_t rows_, int16_t cols_) : pos(pos_), rows(rows_), cols(cols_) {}
+};
+
+//
+// 'count' cells of a row from 'col', drawn in one colour and set of
+// attributes. Their UTF-8 is 'size' bytes from 'offset' into the row's
+// string. In a row's runs each follows on from the last, cells and bytes.
+//
+
+struct FgRun {
+    int16_t  col;
+    int16_t  count;
+    UColor   color;
+    AttrSet  attrs;
+    uint32_t offset;
+    uint32_t size;
+
+    FgRun(int16_t col_, int16_t count_, UColor color_, AttrSet attrs_,
+          uint32_t offset_, uint32_t size_) :
+        col(col_), count(count_), color(color_), attrs(attrs_), offset(offset_), size(size_) {}
+};
+
 #endif // COMMON__DATA_TYPES__HXX
@@ -0,0 +1,26 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/deduper_factory.hxx"
+#include "terminol/common/compressed_deduper.hxx"
+#include "terminol/common/simple_deduper.hxx"
+#include "terminol/common/tiered_deduper.hxx"
+#include "terminol/support/debug.hxx"
+
+I_Deduper * createDeduper(const Config & config, I_Destroyer & destroyer, int shardBits) {
+    if (config.spillHistory) {
+        try {
+            return new TieredDeduper(destroyer, config.spillDirectory,
+                                     config.spillThreshold, config.spillLimit);
+        }
+        catch (const SpillFile::Error & error) {
+            WARNING(error.message);
+        }
+    }
+
+    if (config.compressHistory) {
+        return new CompressedDeduper();
+    }
+
+    return new SimpleDeduper(destroyer, shardBits);
+}
@@ -0,0 +1,17 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef COMMON__DEDUPER_FACTORY__HXX
+#define COMMON__DEDUPER_FACTORY__HXX
+
+#include "terminol/common/deduper_interface.hxx"
+#include "terminol/common/config.hxx"
+#include "terminol/support/destroyer_interface.hxx"
+
+// Create the deduper selected by the config. If it can't be created then
+// a warning is issued and a SimpleDeduper is returned instead.
+// 'shardBits' is log2 of the number of lock shards for a SimpleDeduper,
+// worthwhile when the deduper is shared by many screens.
+I_Deduper * createDeduper(const Config & config, I_Destroyer & destroyer, int shardBits = 0);
+
+#endif // COMMON__DEDUPER_FACTORY__HXX
@@ -5,29 +5,91 @@
 #define COMMON__DEDUPER_INTERFACE__HXX
 
 #include "terminol/common/data_types.hxx"
+#include "terminol/support/debug.hxx"
 
 #include <vector>
 #include <numeric>
+#include <functional>
 
 class I_Deduper {
 public:
     typedef uint32_t Tag;       // Note, can use smaller tag sizes to cause collisions, etc.
     static Tag invalidTag() { return std::numeric_limits<Tag>::max(); }
 
+    typedef std::function<void (const uint8_t * text, size_t size)> TextVisitor;
+
     virtual Tag store(const std::vector<Cell> & cells) = 0;
     virtual void lookup(Tag tag, std::vector<Cell> & cells) const = 0;
     virtual void lookupSegment(Tag tag, uint32_t offset, int16_t maxSize,
                                std::vector<Cell> & cells, bool & cont, int16_t & wrap) const = 0;
     virtual size_t lookupLength(Tag tag) const = 0;
+    // The encoded size of a paragraph, as counted for each of its references
+    // in the total bytes of getByteStats().
+    virtual size_t lookupBytes(Tag tag) const = 0;
+    // Visit the stored UTF-8 text of a paragraph, one sequence per cell,
+    // without decoding it. The bytes are only valid during the call, which
+    // may hold the deduper's lock, so 'visit' mustn't call back into it.
+    virtual void lookupText(Tag tag, const TextVisitor & visit) const = 0;
+    // Take another reference to a stored paragraph, as though it had been
+    // stored again. Balance with remove().
+    virtual void addRef(Tag tag) = 0;
     virtual void remove(Tag tag) = 0;
+    // As remove() of each of 'tags', skipping invalid ones, but locking once
+    // per batch rather than once per tag.
+    virtual void removeMany(const std::vector<Tag> & tags) = 0;
+
+    // Set the flag in 'used' (see StyleTable::reclaim()) of every style id
+    // held by a stored paragraph.
+    virtual void markStyles(std::vector<bool> & used) const = 0;
 
     virtual void getLineStats(uint32_t & uniqueLines, uint32_t & totalLines) const = 0;
     virtual void getByteStats(size_t & uniqueBytes, size_t & totalBytes) const = 0;
     virtual void dump(std::ostream & ost) const = 0;
 
+    virtual ~I_Deduper() {}
+
 protected:
     I_Deduper() {}
-    ~I_Deduper() {}
+
+    // Derive a tag from a 64-bit hash of the encoded paragraph.
+    static Tag makeTag(uint64_t hash) {
+        auto tag = static_cast<Tag>(hash ^ (hash >> 32));
+        if (tag == invalidTag()) { ++tag; }
+        return tag;
+    }
+
+    // The next tag to try after a collision. Step by an odd amount taken
+    // from the upper half of the hash. Being odd the step visits every tag
+    // before repeating, and being content dependent colliding paragraphs
+    // don't pile into consecutive tags.
+    // A power of two 'stride' multiplies the step so that the tag's low bits
+    // are preserved, i.e. probing stays within a shard.
+    static Tag nextTag(Tag tag, uint64_t hash, Tag stride = 1) {
+        auto step = (static_cast<Tag>(hash >> 32) | 1) * stride;
+        tag += step;
+        if (tag == invalidTag()) { tag += step; }
+        return tag;
+    }
+
+    // The tag under which a paragraph with the given hash is stored, probing
+    // past collisions. 'claim(tag)' returns false if the tag holds different
+    // content, otherwise it stores or references the paragraph there and
+    // returns true. 'room()' says whether there are tags left to probe.
+    template <class Claim, class Room>
+    static Tag claimTag(uint64_t hash, Tag stride, Claim claim, Room room) {
+        auto tag = makeTag(hash);
+
+        for (;;) {
+            ASSERT(tag != invalidTag(), "");
+            if (claim(tag)) { return tag; }
+
+            std::cerr << "Hash collision: " << tag << std::endl;
+
+            ENFORCE(room(), "No dedupe room left.");
+
+            tag = nextTag(tag, hash, stride);
+        }
+    }
 };
 
 #endif // COMMON__DEDUPER_INTERFACE__HXX
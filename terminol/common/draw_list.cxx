@@ -0,0 +1,152 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/draw_list.hxx"
+
+void DrawList::clear() {
+    _commands.clear();
+    _bytes.clear();
+    _rects.clear();
+    _runs.clear();
+    _frames    = 0;
+    _damage.clear();
+    _scrollbar = false;
+}
+
+void DrawList::addScroll(int16_t begin, int16_t end, int16_t cols, int16_t rows) {
+    Command command(Type::SCROLL);
+    command.pos   = Pos(begin, end);
+    command.count = rows;
+    command.cols  = cols;
+    _commands.push_back(command);
+}
+
+void DrawList::addBg(UColor color, const std::vector<CellRect> & rects) {
+    Command command(Type::BG);
+    command.color0 = color;
+    command.offset = _rects.size();
+    command.size   = rects.size();
+    _commands.push_back(command);
+    _rects.insert(_rects.end(), rects.begin(), rects.end());
+}
+
+void DrawList::addFg(int16_t row, const std::vector<FgRun> & runs,
+                     const uint8_t * str, size_t size) {
+    Command command(Type::FG);
+    command.pos       = Pos(row, 0);
+    command.offset    = _bytes.size();
+    command.size      = size;
+    command.runOffset = _runs.size();
+    command.runCount  = runs.size();
+    _commands.push_back(command);
+    _bytes.insert(_bytes.end(), str, str + size);
+    _runs.insert(_runs.end(), runs.begin(), runs.end());
+}
+
+void DrawList::addCursor(Pos pos, UColor fg, UColor bg, AttrSet attrs,
+                         const uint8_t * str, size_t size, bool wrapNext, bool focused) {
+    Command command(Type::CURSOR);
+    command.pos      = pos;
+    command.color0   = fg;
+    command.color1   = bg;
+    command.attrs    = attrs;
+    command.wrapNext = wrapNext;
+    command.focused  = focused;
+    command.offset   = _bytes.size();
+    command.size     = size;
+    _commands.push_back(command);
+    _bytes.insert(_bytes.end(), str, str + size);
+}
+
+void DrawList::addScrollbar(size_t totalRows, size_t historyOffset, int16_t visibleRows) {
+    Command command(Type::SCROLLBAR);
+    command.count         = visibleRows;
+    command.size          = totalRows;
+    command.historyOffset = historyOffset;
+    _commands.push_back(command);
+}
+
+void DrawList::addEnd(const RegionSet & damage, bool scrollbar) {
+    _damage.add(damage);
+    _scrollbar = _scrollbar || scrollbar;
+    ++_frames;
+}
+
+void DrawList::splice(DrawList & other) {
+    if (empty()) {
+        std::swap(*this, other);
+    }
+    else {
+        auto bytes = _bytes.size();
+        auto rects = _rects.size();
+        auto runs  = _runs.size();
+
+        for (auto command : other._commands) {
+            switch (command.type) {
+                case Type::BG:
+                    command.offset += rects;
+                    break;
+                case Type::FG:
+                    command.offset    += bytes;
+                    command.runOffset += runs;
+                    break;
+                case Type::CURSOR:
+                    command.offset += bytes;
+                    break;
+                case Type::SCROLL:
+                case Type::SCROLLBAR:
+                    break;
+            }
+
+            _commands.push_back(command);
+        }
+
+        _bytes.insert(_bytes.end(), other._bytes.begin(), other._bytes.end());
+        _rects.insert(_rects.end(), other._rects.begin(), other._rects.end());
+        _runs.insert(_runs.end(), other._runs.begin(), other._runs.end());
+
+        _damage.add(other._damage);
+        _scrollbar = _scrollbar || other._scrollbar;
+        _frames   += other._frames;
+    }
+
+    other.clear();
+}
+
+void DrawList::replay(I_Target & target) const {
+    ASSERT(!empty(), "");
+
+    std::vector<CellRect> rects;
+    std::vector<FgRun>    runs;
+
+    for (auto & command : _commands) {
+        switch (command.type) {
+            case Type::SCROLL:
+                target.drawListScroll(command.pos.row, command.pos.col,
+                                      command.cols, command.count);
+                break;
+            case Type::BG:
+                rects.assign(_rects.begin() + command.offset,
+                             _rects.begin() + command.offset + command.size);
+                target.drawListBg(command.color0, rects);
+                break;
+            case Type::FG:
+                runs.assign(_runs.begin() + command.runOffset,
+                            _runs.begin() + command.runOffset + command.runCount);
+                target.drawListFg(command.pos.row, runs,
+                                  &_bytes[command.offset], command.size);
+                break;
+            case Type::CURSOR:
+                target.drawListCursor(command.pos,
+                                      command.color0, command.color1, command.attrs,
+                                      &_bytes[command.offset], command.size,
+                                      command.wrapNext, command.focused);
+                break;
+            case Type::SCROLLBAR:
+                target.drawListScrollbar(command.size, command.historyOffset, command.count);
+                break;
+        }
+    }
+
+    target.drawListEnd(_damage, _scrollbar);
+}
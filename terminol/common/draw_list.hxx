@@ -0,0 +1,128 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef COMMON__DRAW_LIST__HXX
+#define COMMON__DRAW_LIST__HXX
+
+#include "terminol/common/data_types.hxx"
+
+#include <vector>
+
+// DrawList is an immutable-once-recorded snapshot of a frame: the drawing
+// calls made by Terminal while fixing damage, with copies of their strings,
+// runs and rectangles, so that it can be replayed later, on another thread,
+// without touching the Buffer. Consecutive frames that haven't been replayed yet can
+// be spliced into one, in which case their damage is united and the target
+// only sees a single end.
+class DrawList {
+public:
+    class I_Target {
+    public:
+        virtual void drawListScroll(int16_t begin,
+                                    int16_t end,
+                                    int16_t cols,
+                                    int16_t rows) = 0;
+        virtual void drawListBg(UColor                        color,
+                                const std::vector<CellRect> & rects) = 0;
+        virtual void drawListFg(int16_t                    row,
+                                const std::vector<FgRun> & runs,
+                                const uint8_t            * str,
+                                size_t                     size) = 0;
+        virtual void drawListCursor(Pos             pos,
+                                    UColor          fg,
+                                    UColor          bg,
+                                    AttrSet         attrs,
+                                    const uint8_t * str,
+                                    size_t          size,
+                                    bool            wrapNext,
+                                    bool            focused) = 0;
+        virtual void drawListScrollbar(size_t  totalRows,
+                                       size_t  historyOffset,
+                                       int16_t visibleRows) = 0;
+        virtual void drawListEnd(const RegionSet & damage,
+                                 bool              scrollbar) = 0;
+
+    protected:
+        I_Target() {}
+        ~I_Target() {}
+    };
+
+private:
+    enum class Type : uint8_t {
+        SCROLL,
+        BG,
+        FG,
+        CURSOR,
+        SCROLLBAR
+    };
+
+    struct Command {
+        Type    type;
+        Pos     pos;            // CURSOR. FG: row. SCROLL: begin/end rows.
+        int16_t count;          // SCROLL: rows. SCROLLBAR: visible rows.
+        int16_t cols;           // SCROLL.
+        UColor  color0;         // BG. CURSOR: fg.
+        UColor  color1;         // CURSOR: bg.
+        AttrSet attrs;          // CURSOR.
+        bool    wrapNext;       // CURSOR.
+        bool    focused;        // CURSOR.
+        size_t  offset;         // BG: into _rects. FG, CURSOR: into _bytes.
+        size_t  size;           // Ditto. SCROLLBAR: total rows.
+        size_t  historyOffset;  // SCROLLBAR.
+        size_t  runOffset;      // FG: into _runs.
+        size_t  runCount;       // Ditto.
+
+        explicit Command(Type type_) :
+            type(type_),
+            pos(),
+            count(0),
+            cols(0),
+            color0(UColor::stock(UColor::Name::TEXT_FG)),
+            color1(UColor::stock(UColor::Name::TEXT_BG)),
+            attrs(),
+            wrapNext(false),
+            focused(false),
+            offset(0),
+            size(0),
+            historyOffset(0),
+            runOffset(0),
+            runCount(0) {}
+    };
+
+    std::vector<Command>  _commands;
+    std::vector<uint8_t>  _bytes;
+    std::vector<CellRect> _rects;
+    std::vector<FgRun>    _runs;
+    size_t                _frames;      // Number of ended frames spliced together.
+    RegionSet                _damage;      // United over the frames.
+    bool                  _scrollbar;   // Ditto.
+
+public:
+    DrawList() :
+        _commands(), _bytes(), _rects(), _runs(), _frames(0), _damage(), _scrollbar(false) {}
+
+    // True if no frame has been ended.
+    bool   empty()  const { return _frames == 0; }
+    size_t frames() const { return _frames; }
+
+    void clear();
+
+    // Recording, in Terminal::I_Observer order:
+
+    void addScroll(int16_t begin, int16_t end, int16_t cols, int16_t rows);
+    void addBg(UColor color, const std::vector<CellRect> & rects);
+    void addFg(int16_t row, const std::vector<FgRun> & runs,
+               const uint8_t * str, size_t size);
+    void addCursor(Pos pos, UColor fg, UColor bg, AttrSet attrs,
+                   const uint8_t * str, size_t size, bool wrapNext, bool focused);
+    void addScrollbar(size_t totalRows, size_t historyOffset, int16_t visibleRows);
+    void addEnd(const RegionSet & damage, bool scrollbar);
+
+    // Append the frames in 'other' to this list and clear 'other'.
+    void splice(DrawList & other);
+
+    // Replay the commands followed by a single end. Requires !empty().
+    void replay(I_Target & target) const;
+};
+
+#endif // COMMON__DRAW_LIST__HXX
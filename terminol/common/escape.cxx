@@ -399,11 +399,9 @@ std::string OscEsc::str() const {
     ost << "^[]";
 
     // arguments
-    auto firstArg = true;
-    for (auto a : args) {
-        if (firstArg) { firstArg = false; }
-        else          { ost << ';'; }
-        ost << a;
+    for (size_t i = 0; i != size(); ++i) {
+        if (i != 0) { ost << ';'; }
+        ost << arg(i);
     }
 
     return ost.str();
@@ -414,11 +412,9 @@ std::ostream & operator << (std::ostream & ost, const OscEsc & esc) {
     ost << "\033]";
 
     // arguments
-    auto firstArg = true;
-    for (auto a : esc.args) {
-        if (firstArg) { firstArg = false; }
-        else          { ost << ';'; }
-        ost << a;
+    for (size_t i = 0; i != esc.size(); ++i) {
+        if (i != 0) { ost << ';'; }
+        ost << esc.arg(i);
     }
 
     return ost;
@@ -4,7 +4,10 @@
 #ifndef SUPPORT__ESCAPE__HXX
 #define SUPPORT__ESCAPE__HXX
 
+#include "terminol/support/small_vector.hxx"
+
 #include <iostream>
+#include <string>
 #include <vector>
 #include <cstdint>
 
@@ -13,8 +16,12 @@
 //
 
 struct SimpleEsc {
-    std::vector<uint8_t> inters;
-    uint8_t              code;
+    typedef SmallVector<uint8_t, 4> Inters;
+
+    SimpleEsc() : inters(), code('\0') {}
+
+    Inters  inters;
+    uint8_t code;
 
     // Convert to human readable string.
     std::string str() const;
@@ -27,6 +34,12 @@ std::ostream & operator << (std::ostream & ost, const SimpleEsc & esc);
 //
 
 struct CsiEsc {
+    // Bounded, so parsing a sequence never allocates. Arguments beyond the
+    // capacity are dropped and args.overflowed() is set, in which case the
+    // state machine ignores the sequence.
+    typedef SmallVector<int32_t, 32> Args;
+    typedef SmallVector<uint8_t, 4>  Inters;
+
     CsiEsc() : priv('\0'), args(), inters(), mode('\0') {}
 
     // SGR - Select Graphic Recognition.
@@ -125,10 +138,10 @@ struct CsiEsc {
     // Convert to human readable string.
     std::string str() const;
 
-    uint8_t              priv;
-    std::vector<int32_t> args;
-    std::vector<uint8_t> inters;
-    uint8_t              mode;
+    uint8_t priv;
+    Args    args;
+    Inters  inters;
+    uint8_t mode;
 };
 
 std::ostream & operator << (std::ostream & ost, const CsiEsc & esc);
@@ -151,7 +164,27 @@ std::ostream & operator << (std::ostream & ost, const DcsEsc & esc);
 //
 
 struct OscEsc {
-    std::vector<std::string> args;
+    // The arguments are stored back to back, without their separators, so
+    // that the storage can be reused from one sequence to the next.
+    typedef SmallVector<uint32_t, 16> Ends;
+
+    OscEsc() : bytes(), ends() {}
+
+    std::string bytes;
+    Ends        ends;           // End of each argument within bytes.
+
+    size_t size()  const { return ends.size(); }
+    bool   empty() const { return ends.empty(); }
+
+    std::string arg(size_t i) const {
+        auto begin = i == 0 ? 0 : ends[i - 1];
+        return bytes.substr(begin, ends[i] - begin);
+    }
+
+    void clear() {
+        bytes.clear();
+        ends.clear();
+    }
 
     // Convert to human readable string.
     std::string str() const;
@@ -0,0 +1,84 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/frame_scheduler.hxx"
+
+#include <algorithm>
+
+namespace {
+
+// Spend at most 1/COST_FACTOR of the time drawing during bulk output.
+const int COST_FACTOR = 4;
+
+} // namespace {anonymous}
+
+FrameScheduler::FrameScheduler(I_Observer   & observer,
+                               I_Selector   & selector,
+                               const Config & config) :
+    _observer(observer),
+    _selector(selector),
+    _config(config),
+    _scheduled(false),
+    _interactive(false),
+    _lastFrame(),
+    _cost(Clock::duration::zero()) {}
+
+FrameScheduler::~FrameScheduler() {
+    if (_scheduled) {
+        _selector.removeTimeoutable(this);
+    }
+}
+
+void FrameScheduler::input() {
+    _interactive = true;
+}
+
+void FrameScheduler::request() {
+    auto now = Clock::now();
+
+    if (_interactive || _config.syncTty || now >= _lastFrame + getInterval()) {
+        // The timeout only fires once the selector is idle, so a frame that
+        // falls due during continuous output is drawn here instead.
+        if (_scheduled) {
+            _selector.removeTimeoutable(this);
+            _scheduled = false;
+        }
+
+        draw();
+    }
+    else if (!_scheduled) {
+        auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(
+            _lastFrame + getInterval() - now);
+        _selector.addTimeoutable(this, static_cast<int>(delay.count()) + 1);
+        _scheduled = true;
+    }
+}
+
+auto FrameScheduler::getInterval() const -> Clock::duration {
+    auto fps    = std::max(1, _config.framesPerSecond);
+    auto minFps = std::max(1, std::min(fps, _config.minFramesPerSecond));
+
+    auto lower = Clock::duration(std::chrono::seconds(1)) / fps;
+    auto upper = Clock::duration(std::chrono::seconds(1)) / minFps;
+
+    return std::min(upper, std::max(lower, COST_FACTOR * _cost));
+}
+
+void FrameScheduler::draw() {
+    auto start = Clock::now();
+    _interactive = false;
+
+    _observer.frameSchedulerDraw();
+
+    _lastFrame = Clock::now();
+
+    // Weight the latest frame by 1/4.
+    _cost = (3 * _cost + (_lastFrame - start)) / 4;
+}
+
+// I_Selector::I_TimeoutHandler implementation:
+
+void FrameScheduler::handleTimeout() {
+    _scheduled = false;
+    draw();
+}
@@ -0,0 +1,65 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef COMMON__FRAME_SCHEDULER__HXX
+#define COMMON__FRAME_SCHEDULER__HXX
+
+#include "terminol/common/config.hxx"
+#include "terminol/support/selector.hxx"
+#include "terminol/support/pattern.hxx"
+
+#include <chrono>
+
+// FrameScheduler decides when pending damage is drawn. A frame is drawn
+// immediately if the user has just typed (so the echo isn't delayed) or if
+// the previous frame is old enough. Otherwise, during bulk output, frames are
+// coalesced: the interval between them stretches with the measured cost of
+// drawing, between 1/frames-per-second and 1/min-frames-per-second, so a
+// slow draw doesn't starve the tty. A timeout draws the trailing frame when
+// the output stops.
+class FrameScheduler :
+    protected I_Selector::I_TimeoutHandler,
+    protected Uncopyable
+{
+public:
+    class I_Observer {
+    public:
+        virtual void frameSchedulerDraw() = 0;
+
+    protected:
+        ~I_Observer() {}
+    };
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    I_Observer        & _observer;
+    I_Selector        & _selector;
+    const Config      & _config;
+    bool                _scheduled;     // Is a timeout registered?
+    bool                _interactive;   // Has there been input since the last frame?
+    Clock::time_point   _lastFrame;
+    Clock::duration     _cost;          // Moving average of draw durations.
+
+public:
+    FrameScheduler(I_Observer & observer, I_Selector & selector, const Config & config);
+    virtual ~FrameScheduler();
+
+    // The user typed something, the next frame shouldn't wait.
+    void input();
+
+    // There is damage to be drawn, either now or later.
+    void request();
+
+    // The current minimum interval between frames.
+    Clock::duration getInterval() const;
+
+protected:
+    void draw();
+
+    // I_Selector::I_TimeoutHandler implementation:
+
+    void handleTimeout() override;
+};
+
+#endif // COMMON__FRAME_SCHEDULER__HXX
@@ -0,0 +1,90 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/history_budget.hxx"
+#include "terminol/support/debug.hxx"
+
+#include <unordered_set>
+
+HistoryBudget::HistoryBudget(I_Observer & observer, size_t limit) :
+    _observer(observer),
+    _limit(limit),
+    _mutex(),
+    _clients(),
+    _bytes(0),
+    _exceeded(false)
+{
+    ASSERT(limit != 0, "");
+}
+
+void HistoryBudget::add(I_Client * client) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    auto result = _clients.insert(std::make_pair(client, 0));
+    ASSERT(result.second, "Client already added.");
+}
+
+void HistoryBudget::remove(I_Client * client) {
+    std::unique_lock<std::mutex> lock(_mutex);
+    auto iter = _clients.find(client);
+    ASSERT(iter != _clients.end(), "");
+    _bytes -= iter->second;
+    _clients.erase(iter);
+}
+
+void HistoryBudget::charge(I_Client * client, ssize_t delta) {
+    bool notify = false;
+
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto iter = _clients.find(client);
+        ASSERT(iter != _clients.end(), "");
+        ASSERT(delta >= 0 || static_cast<size_t>(-delta) <= iter->second, "");
+
+        iter->second += delta;
+        _bytes       += delta;
+
+        if (_bytes > _limit && !_exceeded) {
+            _exceeded = true;
+            notify    = true;
+        }
+    }
+
+    if (notify) { _observer.budgetExceeded(); }
+}
+
+void HistoryBudget::enforce() {
+    auto                           target = _limit - _limit / 16;
+    std::unordered_set<I_Client *> spent;       // Nothing left to evict.
+
+    for (;;) {
+        I_Client * victim = nullptr;
+
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            if (_bytes <= target) { break; }
+
+            size_t most = 0;
+            for (auto & pair : _clients) {
+                if (pair.second > most && spent.find(pair.first) == spent.end()) {
+                    victim = pair.first;
+                    most   = pair.second;
+                }
+            }
+
+            if (!victim) { break; }
+        }
+
+        // Not locked, the victim charges us as it evicts.
+        if (!victim->budgetEvict()) { spent.insert(victim); }
+    }
+
+    // Whatever couldn't be evicted, notify again when next exceeded.
+    std::unique_lock<std::mutex> lock(_mutex);
+    _exceeded = false;
+}
+
+size_t HistoryBudget::getBytes() const {
+    std::unique_lock<std::mutex> lock(_mutex);
+    return _bytes;
+}
@@ -0,0 +1,71 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef COMMON__HISTORY_BUDGET__HXX
+#define COMMON__HISTORY_BUDGET__HXX
+
+#include "terminol/support/pattern.hxx"
+
+#include <unordered_map>
+#include <mutex>
+#include <cstddef>
+#include <sys/types.h>
+
+// HistoryBudget bounds the bytes of history held by a group of buffers, i.e.
+// all the windows of a terminols process, as counted by the deduper. Buffers
+// charge it as their history grows and shrinks, from whatever thread they run
+// on. Exceeding the limit notifies the observer, once, and it is then up to
+// the observer to call enforce() at a time when no client is in use, e.g.
+// with every worker locked. Eviction takes the oldest history of the client
+// holding the most bytes, then the next, so a window flooded with huge
+// paragraphs pays for them before its neighbours do.
+class HistoryBudget : protected Uncopyable {
+public:
+    class I_Client {
+    public:
+        // Evict the oldest historical paragraph, false if there is none.
+        virtual bool budgetEvict() = 0;
+
+    protected:
+        I_Client() {}
+        ~I_Client() {}
+    };
+
+    class I_Observer {
+    public:
+        // The limit has been exceeded. Called on the charging thread.
+        virtual void budgetExceeded() = 0;
+
+    protected:
+        I_Observer() {}
+        ~I_Observer() {}
+    };
+
+private:
+    I_Observer                             & _observer;
+    const size_t                             _limit;
+    mutable std::mutex                       _mutex;
+    std::unordered_map<I_Client *, size_t>   _clients;      // Guarded by _mutex.
+    size_t                                   _bytes;        // Ditto.
+    bool                                     _exceeded;     // Ditto. Observer notified?
+
+public:
+    HistoryBudget(I_Observer & observer, size_t limit);
+
+    void add(I_Client * client);
+
+    // Forget the client, and what it was charged.
+    void remove(I_Client * client);
+
+    // 'delta' bytes more (or fewer) of the client's history.
+    void charge(I_Client * client, ssize_t delta);
+
+    // Evict history until a sixteenth under the limit, so that a steady
+    // stream of output is trimmed in batches.
+    void enforce();
+
+    size_t getLimit() const { return _limit; }
+    size_t getBytes() const;
+};
+
+#endif // COMMON__HISTORY_BUDGET__HXX
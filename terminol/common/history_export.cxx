@@ -0,0 +1,273 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/history_export.hxx"
+#include "terminol/support/debug.hxx"
+#include "terminol/support/sys.hxx"
+
+#include <cerrno>
+
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+namespace {
+
+const size_t BLOCK_SIZE = 1 << 20;      // Output gathered per write.
+const int    CANCEL_MS  = 100;          // Between checks for cancellation while blocked.
+
+void appendNumber(std::vector<uint8_t> & output, uint32_t number) {
+    uint8_t digits[10];
+    size_t  count = 0;
+
+    do {
+        digits[count++] = '0' + number % 10;
+        number /= 10;
+    } while (number != 0);
+
+    while (count != 0) { output.push_back(digits[--count]); }
+}
+
+void appendColor(std::vector<uint8_t> & output, const UColor & ucolor, uint32_t base) {
+    // Stock colours are the defaults, which the reset restores.
+    switch (ucolor.type) {
+        case UColor::Type::STOCK:
+            return;
+        case UColor::Type::INDEXED:
+            output.push_back(';');
+            if (ucolor.index < 8) {
+                appendNumber(output, base + ucolor.index);
+            }
+            else if (ucolor.index < 16) {
+                appendNumber(output, base + 60 + ucolor.index - 8);
+            }
+            else {
+                appendNumber(output, base + 8);
+                output.push_back(';');
+                output.push_back('5');
+                output.push_back(';');
+                appendNumber(output, ucolor.index);
+            }
+            return;
+        case UColor::Type::DIRECT:
+            output.push_back(';');
+            appendNumber(output, base + 8);
+            output.push_back(';');
+            output.push_back('2');
+            for (auto value : { ucolor.values.r, ucolor.values.g, ucolor.values.b }) {
+                output.push_back(';');
+                appendNumber(output, value);
+            }
+            return;
+    }
+
+    FATAL("Unreachable");
+}
+
+// A complete SGR sequence, from the reset, for 'style'.
+void appendStyle(std::vector<uint8_t> & output, const Style & style) {
+    const std::pair<Attr, uint8_t> ATTRS[] = {
+        { Attr::BOLD,      '1' },
+        { Attr::FAINT,     '2' },
+        { Attr::ITALIC,    '3' },
+        { Attr::UNDERLINE, '4' },
+        { Attr::BLINK,     '5' },
+        { Attr::INVERSE,   '7' },
+        { Attr::CONCEAL,   '8' }
+    };
+
+    output.push_back(ESC);
+    output.push_back('[');
+    output.push_back('0');
+
+    for (auto & attr : ATTRS) {
+        if (style.attrs.get(attr.first)) {
+            output.push_back(';');
+            output.push_back(attr.second);
+        }
+    }
+
+    appendColor(output, style.fg, 30);
+    appendColor(output, style.bg, 40);
+
+    output.push_back('m');
+}
+
+} // namespace {anonymous}
+
+HistoryExport::HistoryExport(I_Deduper                        & deduper,
+                             std::vector<Tag>                && tags,
+                             std::vector<std::vector<Cell>>  && tail,
+                             int                                fd,
+                             bool                               styled) :
+    _deduper(deduper),
+    _tags(std::move(tags)),
+    _tail(std::move(tail)),
+    _fd(fd),
+    _styled(styled),
+    _cancelled(false),
+    _finished(false),
+    _failed(false),
+    _thread()
+{
+    ASSERT(_fd != -1, "");
+
+    // So a reader that doesn't read can't stop the export being cancelled.
+    fdNonBlock(_fd);
+
+    for (auto tag : _tags) {
+        ASSERT(tag != I_Deduper::invalidTag(), "");
+        _deduper.addRef(tag);
+    }
+
+    _thread = std::thread(&HistoryExport::work, this);
+}
+
+HistoryExport::~HistoryExport() {
+    _cancelled = true;
+    _thread.join();
+
+    TEMP_FAILURE_RETRY(::close(_fd));
+
+    for (auto tag : _tags) {
+        _deduper.remove(tag);
+    }
+}
+
+void HistoryExport::markStyles(std::vector<bool> & used) const {
+    for (auto & cells : _tail) {
+        for (auto & cell : cells) { used[cell.styleId] = true; }
+    }
+}
+
+int HistoryExport::openTarget(const std::string & target) {
+    if (target.empty() || target.front() != '|') {
+        // A symlink isn't followed, lest it point the export elsewhere.
+        return TEMP_FAILURE_RETRY(::open(target.c_str(),
+                                         O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_NOFOLLOW,
+                                         0600));
+    }
+
+    int fds[2];
+    if (::pipe2(fds, O_CLOEXEC) == -1) { return -1; }
+
+    // Prepared before forking, only exec follows.
+    auto        command = target.substr(1);
+    const char * args[] = { "/bin/sh", "-c", command.c_str(), nullptr };
+
+    auto pid = ::fork();
+
+    if (pid == -1) {
+        auto error = errno;
+        TEMP_FAILURE_RETRY(::close(fds[0]));
+        TEMP_FAILURE_RETRY(::close(fds[1]));
+        errno = error;
+        return -1;
+    }
+    else if (pid == 0) {
+        // Child code-path. Fork again so the command is orphaned, and
+        // reaped by init rather than by us.
+        if (::fork() != 0) { ::_exit(0); }
+
+        if (::dup2(fds[0], STDIN_FILENO) == -1) { ::_exit(127); }
+        ::execv(args[0], const_cast<char * const *>(args));
+        ::_exit(127);       // Same as ::system() for failed commands.
+    }
+
+    // Parent code-path.
+    TEMP_FAILURE_RETRY(::close(fds[0]));
+    TEMP_FAILURE_RETRY(::waitpid(pid, nullptr, 0));
+
+    return fds[1];
+}
+
+void HistoryExport::appendPara(const std::vector<Cell> & cells,
+                               bool                      styled,
+                               std::vector<uint8_t>    & output) {
+    auto style = StyleTable::DEFAULT;
+
+    for (auto & cell : cells) {
+        if (styled && cell.styleId != style) {
+            style = cell.styleId;
+            appendStyle(output, cell.style());
+        }
+
+        auto length = utf8::leadLength(cell.seq.lead());
+        output.insert(output.end(), cell.seq.bytes, cell.seq.bytes + length);
+    }
+
+    if (style != StyleTable::DEFAULT) {
+        // Don't carry the style over to the next paragraph.
+        output.push_back(ESC);
+        output.push_back('[');
+        output.push_back('m');
+    }
+
+    output.push_back('\n');
+}
+
+void HistoryExport::work() {
+    // A command that exits early should fail the writes rather than raise
+    // SIGPIPE. It's sent to this thread, so is blocked here only.
+    sigset_t sigset;
+    ::sigemptyset(&sigset);
+    ::sigaddset(&sigset, SIGPIPE);
+    ::pthread_sigmask(SIG_BLOCK, &sigset, nullptr);
+
+    std::vector<uint8_t> output;
+    std::vector<Cell>    cells;
+    bool                 ok = true;
+
+    output.reserve(BLOCK_SIZE);
+
+    for (auto i = _tags.begin(); ok && i != _tags.end() && !_cancelled; ++i) {
+        if (_styled) {
+            cells.clear();
+            _deduper.lookup(*i, cells);
+            appendPara(cells, true, output);
+        }
+        else {
+            // The stored text is used as is, no need to decode the cells.
+            _deduper.lookupText(*i, [&](const uint8_t * bytes, size_t size) {
+                output.insert(output.end(), bytes, bytes + size);
+            });
+            output.push_back('\n');
+        }
+
+        if (output.size() >= BLOCK_SIZE) { ok = flush(output); }
+    }
+
+    for (auto i = _tail.begin(); ok && i != _tail.end() && !_cancelled; ++i) {
+        appendPara(*i, _styled, output);
+    }
+
+    if (ok && !_cancelled) { ok = flush(output); }
+
+    _failed   = !ok;
+    _finished = true;
+}
+
+bool HistoryExport::flush(std::vector<uint8_t> & output) {
+    size_t offset = 0;
+
+    while (offset != output.size()) {
+        auto rval = TEMP_FAILURE_RETRY(::write(_fd, &output[offset], output.size() - offset));
+
+        if (rval != -1) {
+            offset += rval;
+        }
+        else if (errno == EAGAIN) {
+            struct pollfd pollFd = { _fd, POLLOUT, 0 };
+            TEMP_FAILURE_RETRY(::poll(&pollFd, 1, CANCEL_MS));
+            if (_cancelled) { return false; }
+        }
+        else {
+            return false;
+        }
+    }
+
+    output.clear();
+    return true;
+}
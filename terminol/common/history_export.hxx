@@ -0,0 +1,74 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef COMMON__HISTORY_EXPORT__HXX
+#define COMMON__HISTORY_EXPORT__HXX
+
+#include "terminol/common/deduper_interface.hxx"
+#include "terminol/support/pattern.hxx"
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+
+// HistoryExport writes a snapshot of a buffer's history to a descriptor on
+// a thread of its own, so the owner's thread isn't held up however long the
+// history. Each paragraph is written as a line of UTF-8 text, optionally with
+// SGR sequences for its style. The historical paragraphs are referenced for
+// the duration of the export, so the buffer is free to change, and are read
+// from the deduper as stored; it must be safe to read from another thread.
+// Output is gathered into large blocks so there are few writes.
+class HistoryExport : protected Uncopyable {
+public:
+    typedef I_Deduper::Tag Tag;
+
+private:
+    I_Deduper                            & _deduper;
+    const std::vector<Tag>                 _tags;       // Oldest first. Referenced.
+    const std::vector<std::vector<Cell>>   _tail;       // Paragraphs following the tags.
+    const int                              _fd;
+    const bool                             _styled;
+    std::atomic<bool>                      _cancelled;
+    std::atomic<bool>                      _finished;
+    std::atomic<bool>                      _failed;
+    std::thread                            _thread;
+
+public:
+    // Takes ownership of 'fd'. 'tags' mustn't contain invalidTag().
+    HistoryExport(I_Deduper                        & deduper,
+                  std::vector<Tag>                && tags,
+                  std::vector<std::vector<Cell>>  && tail,
+                  int                                fd,
+                  bool                               styled);
+
+    // Cancels the export, waiting for the writer to stop.
+    ~HistoryExport();
+
+    bool isFinished() const { return _finished; }
+
+    // Valid once finished.
+    bool isFailed() const { return _failed; }
+
+    // Set the flag in 'used' (see StyleTable::reclaim()) of every style id
+    // held by the tail. The tags are held by the deduper.
+    void markStyles(std::vector<bool> & used) const;
+
+    // Open a target for writing: a file, which is created or truncated but
+    // never reached through a symlink, or
+    // if 'target' begins with '|' a shell command which is started to read
+    // the export on its standard input. Returns -1 on failure, with errno set.
+    static int openTarget(const std::string & target);
+
+    // Append a paragraph's text, and a newline, to 'output'. If 'styled'
+    // then the text is preceded by SGR sequences wherever the style changes.
+    static void appendPara(const std::vector<Cell> & cells,
+                           bool                      styled,
+                           std::vector<uint8_t>    & output);
+
+protected:
+    void work();
+    bool flush(std::vector<uint8_t> & output);
+};
+
+#endif // COMMON__HISTORY_EXPORT__HXX
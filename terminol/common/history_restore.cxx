@@ -0,0 +1,195 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/history_restore.hxx"
+#include "terminol/common/para_codec.hxx"
+#include "terminol/support/debug.hxx"
+#include "terminol/support/hash.hxx"
+
+#include <cstring>
+
+const char     HistoryRestore::SNAPSHOT_MAGIC[8] = { 'T', 'R', 'M', 'L', 'H', 'I', 'S', 'T' };
+const uint32_t HistoryRestore::SNAPSHOT_VERSION  = 3;
+
+namespace {
+
+// Reads the snapshot in place, failing rather than overrunning it.
+class Cursor {
+    const uint8_t * _data;
+    size_t          _size;
+    size_t          _offset;
+
+public:
+    Cursor(const uint8_t * data, size_t size) : _data(data), _size(size), _offset(0) {}
+
+    const uint8_t * skip(size_t size) throw (StreamError) {
+        if (size > _size - _offset) { throw StreamError(); }
+        auto data = _data + _offset;
+        _offset += size;
+        return data;
+    }
+
+    template <typename T> T read() throw (StreamError) {
+        return para::get<T>(skip(sizeof(T)), 0);
+    }
+
+    bool atEnd() const { return _offset == _size; }
+};
+
+bool isValid(UColor color) {
+    switch (color.type) {
+        case UColor::Type::STOCK:
+            return color.name <= UColor::Name::CURSOR_TEXT;
+        case UColor::Type::INDEXED:
+        case UColor::Type::DIRECT:
+            return true;
+    }
+
+    return false;
+}
+
+// See Buffer::saveHistory() for the layout.
+void readParagraph(Cursor & cursor, std::vector<Cell> & cells) throw (StreamError) {
+    auto size = cursor.read<uint32_t>();
+    auto hash = cursor.read<uint64_t>();
+    auto data = cursor.skip(size);
+
+    if (size < 2 * sizeof(uint32_t) || hash64(data, size) != hash) {
+        throw StreamError();
+    }
+
+    auto length    = para::get<uint32_t>(data, 0);
+    auto numStyles = para::get<uint32_t>(data, sizeof(uint32_t));
+
+    if (numStyles > StyleTable::CAPACITY) { throw StreamError(); }
+
+    auto encoded = 2 * sizeof(uint32_t) + numStyles * sizeof(Style);
+
+    if (size <= encoded || !para::validate(data + encoded, size - encoded, length)) {
+        throw StreamError();
+    }
+
+    std::vector<StyleId> ids;
+    ids.reserve(numStyles);
+
+    for (uint32_t i = 0; i != numStyles; ++i) {
+        auto style = para::get<Style>(data, 2 * sizeof(uint32_t) + i * sizeof(Style));
+        if (!isValid(style.fg) || !isValid(style.bg)) { throw StreamError(); }
+        ids.push_back(internStyle(style));
+    }
+
+    cells.clear();
+    para::decode(data + encoded, length, cells);
+
+    for (auto & cell : cells) {
+        if (cell.styleId >= ids.size()) { throw StreamError(); }
+        cell.styleId = ids[cell.styleId];
+    }
+}
+
+} // namespace {anonymous}
+
+HistoryRestore::HistoryRestore(I_Deduper & deduper, const std::string & path) throw (StreamError) :
+    _deduper(deduper),
+    _path(path),
+    _file(path),
+    _tags(),
+    _lengths(),
+    _index(),
+    _cancelled(false),
+    _finished(false),
+    _failed(false),
+    _thread()
+{
+    _thread = std::thread(&HistoryRestore::work, this);
+}
+
+HistoryRestore::~HistoryRestore() {
+    _cancelled = true;
+    wait();
+
+    release();
+}
+
+void HistoryRestore::wait() {
+    if (_thread.joinable()) { _thread.join(); }
+}
+
+void HistoryRestore::take(std::vector<Tag>      & tags,
+                          std::vector<uint32_t> & lengths,
+                          SearchIndex           & index) {
+    ASSERT(_finished && !_failed, "");
+
+    tags.clear();
+    lengths.clear();
+    std::swap(tags, _tags);
+    std::swap(lengths, _lengths);
+    index.merge(_index);
+}
+
+void HistoryRestore::work() {
+    try {
+        read();
+    }
+    catch (const StreamError &) {
+        release();
+        _failed = true;
+    }
+
+    _finished = true;
+}
+
+void HistoryRestore::read() throw (StreamError) {
+    Cursor cursor(_file.data(), _file.size());
+
+    auto magic = cursor.skip(sizeof SNAPSHOT_MAGIC);
+
+    if (std::memcmp(magic, SNAPSHOT_MAGIC, sizeof SNAPSHOT_MAGIC) != 0 ||
+        cursor.read<uint32_t>() != SNAPSHOT_VERSION)
+    {
+        throw StreamError();
+    }
+
+    auto                  num = cursor.read<uint32_t>();
+    std::vector<Tag>      numbered;
+    std::vector<uint32_t> numberedLengths;
+    std::vector<Cell>     cells;
+
+    for (uint32_t i = 0; i != num; ++i) {
+        if (_cancelled) { return; }
+
+        auto number = cursor.read<uint32_t>();
+
+        if (number == numbered.size()) {
+            readParagraph(cursor, cells);
+
+            auto tag = _deduper.store(cells);
+            _tags.push_back(tag);
+            _index.add(tag, cells);
+
+            numbered.push_back(tag);
+            numberedLengths.push_back(cells.size());
+        }
+        else if (number < numbered.size()) {
+            // Take another reference.
+            auto tag = numbered[number];
+            _deduper.addRef(tag);
+            _tags.push_back(tag);
+            _index.addRef(tag);
+        }
+        else {
+            throw StreamError();
+        }
+
+        _lengths.push_back(numberedLengths[number]);
+    }
+
+    if (!cursor.atEnd()) { throw StreamError(); }
+}
+
+void HistoryRestore::release() {
+    _deduper.removeMany(_tags);
+    _tags.clear();
+    _lengths.clear();
+    _index.clear();
+}
@@ -0,0 +1,74 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef COMMON__HISTORY_RESTORE__HXX
+#define COMMON__HISTORY_RESTORE__HXX
+
+#include "terminol/common/deduper_interface.hxx"
+#include "terminol/common/search_index.hxx"
+#include "terminol/support/file_stream.hxx"
+#include "terminol/support/pattern.hxx"
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+
+// HistoryRestore reads a snapshot written by Buffer::saveHistory() on a
+// thread of its own, so the owner's thread isn't held up however long the
+// history. The snapshot is untrusted: everything is bounds checked, and
+// each paragraph validated before it is decoded. The paragraphs are stored
+// in the deduper, which must be safe to use from another thread, and are
+// summarised for searching. Once finished the owner takes the result, or
+// the references are released when the restore is destroyed.
+class HistoryRestore : protected Uncopyable {
+public:
+    typedef I_Deduper::Tag Tag;
+
+    // Snapshot header.
+    static const char     SNAPSHOT_MAGIC[8];
+    static const uint32_t SNAPSHOT_VERSION;
+
+private:
+    I_Deduper             & _deduper;
+    const std::string       _path;
+    MappedFile              _file;
+    std::vector<Tag>        _tags;          // Oldest first. Referenced.
+    std::vector<uint32_t>   _lengths;
+    SearchIndex             _index;
+    std::atomic<bool>       _cancelled;
+    std::atomic<bool>       _finished;
+    std::atomic<bool>       _failed;
+    std::thread             _thread;
+
+public:
+    // The snapshot is mapped before returning, so it may then be unlinked.
+    HistoryRestore(I_Deduper & deduper, const std::string & path) throw (StreamError);
+
+    // Cancels the restore, waiting for the reader to stop, and releases
+    // anything not taken.
+    ~HistoryRestore();
+
+    bool isFinished() const { return _finished; }
+
+    // Valid once finished.
+    bool isFailed() const { return _failed; }
+
+    const std::string & getPath() const { return _path; }
+
+    // Wait for the restore to finish.
+    void wait();
+
+    // Once finished and not failed, take the paragraphs, their lengths and
+    // their summaries, with the references to them.
+    void take(std::vector<Tag>      & tags,
+              std::vector<uint32_t> & lengths,
+              SearchIndex           & index);
+
+protected:
+    void work();
+    void read() throw (StreamError);
+    void release();
+};
+
+#endif // COMMON__HISTORY_RESTORE__HXX
@@ -0,0 +1,210 @@
+// vi:noai:sw=4
+// Copyright © 2013-2015 David Bryant
+
+#include "terminol/common/para_codec.hxx"
+
+#include <algorithm>
+#include <iostream>
+
+namespace para {
+
+namespace {
+
+// As getVarint(), but fails if the varint overruns 'size' or is too long.
+bool readVarint(const uint8_t * data, size_t size, size_t & offset, uint32_t & value) {
+    value = 0;
+    for (size_t i = 0; i != MAX_VARINT_SIZE; ++i) {
+        if (offset == size) { return false; }
+        auto byte = data[offset++];
+        value |= static_cast<uint32_t>(byte & 0x7F) << (7 * i);
+        if ((byte & 0x80) == 0) { return true; }
+    }
+    return false;
+}
+
+} // namespace {anonymous}
+
+void encode(const std::vector<Cell> & cells,
+            std::vector<uint8_t>    & bytes) {
+    auto size   = cells.size();
+    auto stride = std::max(MIN_STRIDE, (size + MAX_CHECKPOINTS) / (MAX_CHECKPOINTS + 1));
+    auto num    = size == 0 ? 0 : (size - 1) / stride;
+    ASSERT(num <= MAX_CHECKPOINTS, "");
+
+    // Measure the runs and the string.
+    size_t runsSize   = 1;      // The terminating count.
+    size_t stringSize = 0;
+
+    for (size_t c = 0; c != size; ) {
+        auto style = cells[c].styleId;
+        auto begin = c;
+
+        for (; c != size && cells[c].styleId == style; ++c) {
+            auto lead = cells[c].seq.lead();
+            stringSize += LIKELY((lead & 0x80) == 0) ? 1 : utf8::leadLength(lead);
+        }
+
+        runsSize += varintSize(c - begin) + sizeof(StyleId);
+    }
+
+    auto ascii        = stringSize == size;
+    auto runsOffset   = 1 + (num == 0 ? 0 : HEADER_SIZE + num * CHECKPOINT_SIZE);
+    auto stringOffset = runsOffset + runsSize;
+
+    bytes.resize(stringOffset + stringSize);
+    bytes.front() = static_cast<uint8_t>(num | (ascii ? ASCII_FLAG : 0));
+
+    if (num != 0) {
+        put<uint32_t>(bytes, 1, stride);
+        put<uint32_t>(bytes, 1 + sizeof(uint32_t), stringOffset);
+    }
+
+    // Write the runs, the string and the checkpoints, in one pass.
+    auto   data       = bytes.data();
+    auto   runOffset  = runsOffset;
+    auto   seqOffset  = stringOffset;
+    size_t checkpoint = 0;
+    auto   next       = stride;     // Cell of the next checkpoint.
+
+    for (size_t c = 0; c != size; ) {
+        auto style = cells[c].styleId;
+        auto begin = c;
+
+        for (; c != size && cells[c].styleId == style; ++c) {
+            if (UNLIKELY(c == next)) {
+                auto offset = 1 + HEADER_SIZE + checkpoint * CHECKPOINT_SIZE;
+                put<uint32_t>(bytes, offset, runOffset);
+                put<uint32_t>(bytes, offset + sizeof(uint32_t), seqOffset);
+                put<uint32_t>(bytes, offset + 2 * sizeof(uint32_t), c - begin);
+                ++checkpoint;
+                next += stride;
+            }
+
+            auto & seq = cells[c].seq;
+
+            if (ascii) {
+                data[seqOffset++] = seq.bytes[0];
+            }
+            else {
+                auto length = utf8::leadLength(seq.lead());
+                std::memcpy(data + seqOffset, seq.bytes, length);
+                seqOffset += length;
+            }
+        }
+
+        runOffset += putVarint(data + runOffset, c - begin);
+        put<StyleId>(bytes, runOffset, style);
+        runOffset += sizeof(StyleId);
+    }
+
+    data[runOffset] = 0;
+
+    ASSERT(checkpoint == num, "");
+    ASSERT(runOffset + 1 == stringOffset && seqOffset == bytes.size(), "");
+
+#if 0
+    auto before = cells.size() * sizeof(Cell);
+    auto after  = bytes.size();
+
+    std::cout << before << " --> " << after;
+    if (before > 0) {
+        std::cout << " " << double(after) / double(before) * 100.0;
+    }
+    std::cout << std::endl;
+#endif
+}
+
+bool validate(const uint8_t * data, size_t size, uint32_t length) {
+    // Every cell takes at least a byte of the string.
+    if (size == 0 || length > size) { return false; }
+
+    auto   num        = numCheckpoints(data);
+    auto   runsOffset = size_t(1);
+    size_t stride     = 0;
+
+    if (num != 0) {
+        runsOffset += HEADER_SIZE + num * CHECKPOINT_SIZE;
+        if (runsOffset > size) { return false; }
+
+        // Each checkpoint falls within the paragraph.
+        stride = get<uint32_t>(data, 1);
+        if (stride == 0 || uint64_t(num) * stride >= length) { return false; }
+    }
+
+    auto checkpointOffset = [](size_t checkpoint) {
+        return 1 + HEADER_SIZE + checkpoint * CHECKPOINT_SIZE;
+    };
+
+    // The runs, and the run offset and skip of each checkpoint.
+    auto     offset     = runsOffset;
+    uint64_t cells      = 0;
+    size_t   checkpoint = 0;
+
+    for (;;) {
+        auto     begin = offset;
+        uint32_t count;
+
+        if (!readVarint(data, size, offset, count)) { return false; }
+
+        if (count == 0) {
+            // The terminator is a single zero byte, as textOffset() expects.
+            if (offset != begin + 1) { return false; }
+            break;
+        }
+
+        if (size - offset < sizeof(StyleId)) { return false; }
+        offset += sizeof(StyleId);
+
+        for (; checkpoint != num && (checkpoint + 1) * stride < cells + count; ++checkpoint) {
+            auto at = checkpointOffset(checkpoint);
+            if (get<uint32_t>(data, at) != begin ||
+                get<uint32_t>(data, at + 2 * sizeof(uint32_t)) != (checkpoint + 1) * stride - cells)
+            {
+                return false;
+            }
+        }
+
+        cells += count;
+        if (cells > length) { return false; }
+    }
+
+    if (cells != length) { return false; }
+    if (num != 0 && get<uint32_t>(data, 1 + sizeof(uint32_t)) != offset) { return false; }
+
+    // The string, and the sequence offset of each checkpoint.
+    auto ascii = isAscii(data);
+    checkpoint = 0;
+
+    for (size_t c = 0; c != length; ++c) {
+        if (checkpoint != num && c == (checkpoint + 1) * stride) {
+            if (get<uint32_t>(data, checkpointOffset(checkpoint) + sizeof(uint32_t)) != offset) {
+                return false;
+            }
+            ++checkpoint;
+        }
+
+        if (offset == size) { return false; }
+        auto lead = data[offset];
+
+        if (ascii) {
+            if ((lead & 0x80) != 0) { return false; }
+            ++offset;
+        }
+        else {
+            if (!utf8::isLead(lead)) { return false; }
+
+            size_t seqLength = utf8::leadLength(lead);
+            if (size - offset < seqLength) { return false; }
+
+            for (size_t i = 1; i != seqLength; ++i) {
+                if ((data[offset + i] & 0xC0) != 0x80) { return false; }
+            }
+
+            offset += seqLength;
+        }
+    }
+
+    return offset == size;
+}
+
+} // namespace para
@@ -0,0 +1,255 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef COMMON__PARA_CODEC__HXX
+#define COMMON__PARA_CODEC__HXX
+
+#include "terminol/common/data_types.hxx"
+
+#include <vector>
+#include <cstring>
+
+// Encoding of paragraphs (vectors of Cells) into compact byte strings,
+// as kept by the dedupers.
+
+namespace para {
+
+//
+// Encoded paragraph layout:
+//
+//   uint8_t                                    ASCII flag (bit 7), number of
+//                                              checkpoints (N, bits 0-6)
+//   uint32_t stride, uint32_t string offset    only present if N != 0
+//   N * (uint32_t run offset,
+//        uint32_t seq offset,
+//        uint32_t run skip)                    checkpoints
+//   (varint count, StyleId style) runs         terminated by a zero count
+//   packed UTF-8 string
+//
+// Checkpoint i is the decoder state at cell (i + 1) * stride: the offset of
+// the style run containing the cell, the number of cells of that run which
+// precede it, and the offset of the cell's UTF-8 sequence. This lets a
+// segment of a long paragraph be decoded without expanding everything
+// before it. Short paragraphs (the common case) pay a single byte.
+//
+// The ASCII flag means every sequence is a single byte, so the string is
+// read and written a cell per byte without examining the lead bytes.
+//
+// Counts are varints, seven bits to a byte, least significant first, the
+// top bit set on all but the last byte. A count is never zero, so the first
+// byte of a run is never zero either.
+//
+
+const uint8_t ASCII_FLAG      = 0x80;
+const size_t  MIN_STRIDE      = 128;
+const size_t  MAX_CHECKPOINTS = 0x7F;
+const size_t  HEADER_SIZE     = 2 * sizeof(uint32_t);
+const size_t  CHECKPOINT_SIZE = 3 * sizeof(uint32_t);
+const size_t  MAX_VARINT_SIZE = 5;
+
+template <typename T> inline void put(std::vector<uint8_t> & bytes, size_t offset, T value) {
+    std::memcpy(&bytes[offset], &value, sizeof value);
+}
+
+template <typename T> inline T get(const uint8_t * data, size_t offset) {
+    T value;
+    std::memcpy(&value, data + offset, sizeof value);
+    return value;
+}
+
+inline size_t varintSize(uint32_t value) {
+    size_t size = 1;
+    while (value >= 0x80) { value >>= 7; ++size; }
+    return size;
+}
+
+// Returns the number of bytes written.
+inline size_t putVarint(uint8_t * data, uint32_t value) {
+    size_t size = 0;
+    while (value >= 0x80) {
+        data[size++] = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    data[size++] = static_cast<uint8_t>(value);
+    return size;
+}
+
+// Advances 'offset' over the varint.
+inline uint32_t getVarint(const uint8_t * data, size_t & offset) {
+    uint32_t value = 0;
+    for (int shift = 0; ; shift += 7) {
+        auto byte = data[offset++];
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) { return value; }
+    }
+}
+
+inline size_t numCheckpoints(const uint8_t * data) { return data[0] & MAX_CHECKPOINTS; }
+
+inline bool isAscii(const uint8_t * data) { return (data[0] & ASCII_FLAG) != 0; }
+
+// Encode 'cells' into 'bytes', replacing its contents. The encoding is
+// measured first so 'bytes' is sized once and written in place.
+void encode(const std::vector<Cell> & cells,
+            std::vector<uint8_t>    & bytes);
+
+// Is 'data' a well formed encoding of 'length' cells, exactly 'size' bytes
+// long? The decoder trusts its input, so anything read from outside the
+// process (e.g. a snapshot) is validated first. Every varint, run, checkpoint
+// and sequence is checked to lie within the encoding and agree with the rest.
+bool validate(const uint8_t * data, size_t size, uint32_t length);
+
+// Offset of the packed UTF-8 string, which runs to the end of the encoding.
+inline size_t textOffset(const uint8_t * data) {
+    if (numCheckpoints(data) != 0) {
+        return get<uint32_t>(data, 1 + sizeof(uint32_t));
+    }
+
+    // Find the string by skipping over the runs.
+    size_t offset = 1;
+    while (data[offset] != 0) {
+        getVarint(data, offset);
+        offset += sizeof(StyleId);
+    }
+    return offset + 1;
+}
+
+// Set the flag in 'used' of the style of each run.
+inline void markStyles(const uint8_t * data, std::vector<bool> & used) {
+    auto   num    = numCheckpoints(data);
+    size_t offset = num == 0 ? 1 : 1 + HEADER_SIZE + num * CHECKPOINT_SIZE;
+
+    while (data[offset] != 0) {
+        getVarint(data, offset);
+        used[get<StyleId>(data, offset)] = true;
+        offset += sizeof(StyleId);
+    }
+}
+
+// Sequential decoder positioned at an arbitrary cell of an encoded paragraph.
+class Decoder {
+    const uint8_t * _data;
+    bool            _ascii;
+    size_t          _runOffset;     // Next run to read.
+    size_t          _seqOffset;     // Next sequence to read.
+    size_t          _run;           // Cells remaining in current run.
+    StyleId         _style;
+
+    void nextRun() {
+        while (_run == 0) {
+            _run = getVarint(_data, _runOffset);
+            ASSERT(_run != 0, "Decoding beyond end of paragraph.");
+            _style = get<StyleId>(_data, _runOffset);
+            _runOffset += sizeof(StyleId);
+        }
+    }
+
+    utf8::Seq nextSeq() {
+        uint8_t b[4] = { 0 };
+        auto length = utf8::leadLength(_data[_seqOffset]);
+        std::memcpy(b, _data + _seqOffset, length);
+        _seqOffset += length;
+        return utf8::Seq(b[0], b[1], b[2], b[3]);
+    }
+
+public:
+    Decoder(const uint8_t * data, uint32_t cell) :
+        _data(data), _ascii(isAscii(data)),
+        _runOffset(0), _seqOffset(0), _run(0), _style(StyleTable::DEFAULT)
+    {
+        size_t num   = numCheckpoints(_data);
+        size_t begin = 0;
+
+        if (num == 0) {
+            _runOffset = 1;
+            _seqOffset = textOffset(_data);
+        }
+        else {
+            auto stride = get<uint32_t>(_data, 1);
+            auto i      = std::min<size_t>(cell / stride, num);
+
+            if (i == 0) {
+                _runOffset = 1 + HEADER_SIZE + num * CHECKPOINT_SIZE;
+                _seqOffset = get<uint32_t>(_data, 1 + sizeof(uint32_t));
+            }
+            else {
+                auto offset = 1 + HEADER_SIZE + (i - 1) * CHECKPOINT_SIZE;
+                _runOffset = get<uint32_t>(_data, offset);
+                _seqOffset = get<uint32_t>(_data, offset + sizeof(uint32_t));
+
+                auto skip  = get<uint32_t>(_data, offset + 2 * sizeof(uint32_t));
+                nextRun();
+                _run -= skip;
+                begin = i * stride;
+            }
+        }
+
+        skip(cell - begin);
+    }
+
+    void skip(size_t count) {
+        while (count != 0) {
+            nextRun();
+            auto n = std::min(_run, count);
+            _run  -= n;
+            count -= n;
+
+            if (_ascii) {
+                _seqOffset += n;
+            }
+            else {
+                for (size_t i = 0; i != n; ++i) {
+                    _seqOffset += utf8::leadLength(_data[_seqOffset]);
+                }
+            }
+        }
+    }
+
+    Cell next() {
+        nextRun();
+        --_run;
+
+        if (_ascii) {
+            return Cell::ascii(_data[_seqOffset++], _style);
+        }
+        else {
+            return Cell::utf8(nextSeq(), _style);
+        }
+    }
+
+    // Decode the next 'count' cells into 'cells', a run at a time.
+    void read(Cell * cells, size_t count) {
+        while (count != 0) {
+            nextRun();
+            auto n = std::min(_run, count);
+            _run  -= n;
+            count -= n;
+
+            if (_ascii) {
+                auto string = _data + _seqOffset;
+                for (size_t i = 0; i != n; ++i) {
+                    cells[i] = Cell::ascii(string[i], _style);
+                }
+                _seqOffset += n;
+            }
+            else {
+                for (size_t i = 0; i != n; ++i) {
+                    cells[i] = Cell::utf8(nextSeq(), _style);
+                }
+            }
+
+            cells += n;
+        }
+    }
+};
+
+// Append the 'length' cells of an encoded paragraph to 'cells'.
+inline void decode(const uint8_t * data, uint32_t length, std::vector<Cell> & cells) {
+    auto begin = cells.size();
+    cells.resize(begin + length, Cell::blank());
+    Decoder(data, 0).read(cells.data() + begin, length);
+}
+
+} // namespace para
+
+#endif // COMMON__PARA_CODEC__HXX
@@ -82,6 +82,12 @@ Parser::Parser(Config & config) : _config(config) {
     registerSimpleHandler("font-name", _config.fontName);
 
     registerSimpleHandler("font-size", _config.fontSize);
+    registerSimpleHandler("font-metrics-cache", _config.fontMetricsCache);
+    registerSimpleHandler("glyph-cache", _config.glyphCache);
+    registerSimpleHandler("render-thread", _config.renderThread);
+    registerSimpleHandler("frame-time-overlay", _config.frameTimeOverlay);
+    registerSimpleHandler("worker-threads", _config.workerThreads);
+    registerSimpleHandler("shell-pool", _config.shellPool);
     registerSimpleHandler("term-name", _config.termName);
     registerSimpleHandler("scroll-with-history", _config.scrollWithHistory);
     registerSimpleHandler("scroll-on-tty-output", _config.scrollOnTtyOutput);
@@ -101,7 +107,17 @@ Parser::Parser(Config & config) : _config(config) {
                           );
 
     registerSimpleHandler("unlimited-scroll-back", _config.unlimitedScrollBack);
+    registerSimpleHandler("scroll-back-bytes", _config.scrollBackBytes);
+    registerSimpleHandler("server-scroll-back-bytes", _config.serverScrollBackBytes);
+    registerSimpleHandler("line-cache-size", _config.lineCacheSize);
+    registerSimpleHandler("row-cache-pixels", _config.rowCachePixels);
+    registerSimpleHandler("spill-history", _config.spillHistory);
+    registerSimpleHandler("spill-threshold", _config.spillThreshold);
+    registerSimpleHandler("spill-limit", _config.spillLimit);
+    registerSimpleHandler("spill-directory", _config.spillDirectory);
+    registerSimpleHandler("compress-history", _config.compressHistory);
     registerSimpleHandler("frames-per-second", _config.framesPerSecond);
+    registerSimpleHandler("min-frames-per-second", _config.minFramesPerSecond);
     registerSimpleHandler("traditional-wrapping", _config.traditionalWrapping);
     registerSimpleHandler("trace-tty", _config.traceTty);
     registerSimpleHandler("sync-tty", _config.syncTty);
@@ -165,6 +181,9 @@ Parser::Parser(Config & config) : _config(config) {
                           );
 
     registerSimpleHandler("server-fork", _config.serverFork);
+    registerSimpleHandler("persist-history", _config.persistHistory);
+    registerSimpleHandler("history-dir", _config.historyDir);
+    registerSimpleHandler("export-target", _config.exportTarget);
 
     registerSimpleHandler("color-0", _config.systemColors[0]);
     registerSimpleHandler("color-1", _config.systemColors[1]);
@@ -196,12 +215,17 @@ Parser::Parser(Config & config) : _config(config) {
     registerSimpleHandler("x11-pseudo-transparency", _config.x11PseudoTransparency);
     registerSimpleHandler("x11-composited-transparency", _config.x11CompositedTransparency);
     registerSimpleHandler("x11-transparency-value", _config.x11TransparencyValue);
+    registerSimpleHandler("x11-shm", _config.x11Shm);
 
     //
     //
     //
 
     _actions.insert(std::make_pair("search",               Action::SEARCH));
+    _actions.insert(std::make_pair("search-next",          Action::SEARCH_NEXT));
+    _actions.insert(std::make_pair("search-prev",          Action::SEARCH_PREV));
+    _actions.insert(std::make_pair("export-history",       Action::EXPORT_HISTORY));
+    _actions.insert(std::make_pair("export-history-sgr",   Action::EXPORT_HISTORY_SGR));
     _actions.insert(std::make_pair("window-narrower",      Action::WINDOW_NARROWER));
     _actions.insert(std::make_pair("window-wider",         Action::WINDOW_WIDER));
     _actions.insert(std::make_pair("window-shorter",       Action::WINDOW_SHORTER));
@@ -229,6 +253,7 @@ Parser::Parser(Config & config) : _config(config) {
     _actions.insert(std::make_pair("debug-selection",      Action::DEBUG_SELECTION));
     _actions.insert(std::make_pair("debug-stats",          Action::DEBUG_STATS));
     _actions.insert(std::make_pair("debug-stats2",         Action::DEBUG_STATS2));
+    _actions.insert(std::make_pair("debug-frames",         Action::DEBUG_FRAMES));
 
     parse();
 }
@@ -0,0 +1,276 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/search_index.hxx"
+
+#include <algorithm>
+#include <cctype>
+
+namespace {
+
+// Bloom filters hold about eight bits per trigram, within these bounds.
+const size_t MIN_BLOOM_WORDS = 4;
+const size_t MAX_BLOOM_WORDS = 1024;
+
+uint32_t hashTrigram(const uint8_t * bytes) {
+    uint32_t t = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16);
+    t *= 0x9E3779B1;
+    return t ^ (t >> 15);
+}
+
+bool isMeta(uint8_t c) {
+    switch (c) {
+        case '\\': case '^': case '$': case '.': case '[': case ']': case '|':
+        case '(': case ')': case '?': case '*': case '+': case '{': case '}':
+            return true;
+        default:
+            return false;
+    }
+}
+
+void addTrigrams(const std::vector<uint8_t> & run, std::vector<uint32_t> & hashes) {
+    for (size_t i = 0; i + 3 <= run.size(); ++i) {
+        hashes.push_back(hashTrigram(&run[i]));
+    }
+}
+
+// Where an escape whose letter or digit is at 'i' ends, or 0 if that can't
+// be told, in which case nothing about the pattern should be assumed.
+size_t escapeEnd(const std::string & pattern, size_t i) {
+    auto at      = [&](size_t j) -> uint8_t { return j < pattern.size() ? pattern[j] : 0; };
+    auto closing = [&](size_t j, char close) -> size_t {     // 'j' at the opener.
+        auto k = pattern.find(close, j + 1);
+        return k == std::string::npos ? 0 : k + 1;
+    };
+
+    uint8_t c = pattern[i];
+
+    switch (c) {
+        case 'd': case 'D': case 'w': case 'W': case 's': case 'S': case 'h':
+        case 'H': case 'v': case 'V': case 'R': case 'X': case 'C': case 'b':
+        case 'B': case 'A': case 'z': case 'Z': case 'G': case 'K': case 'a':
+        case 'e': case 'f': case 'n': case 'r': case 't':
+            return i + 1;
+        case 'x':
+            if (at(i + 1) == '{') { return closing(i + 1, '}'); }
+            for (auto j = i + 1; ; ++j) {
+                if (j == i + 3 || !std::isxdigit(at(j))) { return j; }
+            }
+        case 'c':
+            return i + 1 < pattern.size() ? i + 2 : 0;
+        case 'p':
+        case 'P':
+            if (at(i + 1) == '{') { return closing(i + 1, '}'); }
+            return i + 1 < pattern.size() ? i + 2 : 0;
+        case 'N':
+            return at(i + 1) == '{' ? closing(i + 1, '}') : i + 1;
+        case 'o':
+            return at(i + 1) == '{' ? closing(i + 1, '}') : 0;
+        case 'g':
+        case 'k':
+            switch (at(i + 1)) {
+                case '{':  return closing(i + 1, '}');
+                case '<':  return closing(i + 1, '>');
+                case '\'': return closing(i + 1, '\'');
+            }
+            if (c == 'g') {
+                auto j = i + 1;
+                if (at(j) == '-' || at(j) == '+') { ++j; }
+                while (std::isdigit(at(j))) { ++j; }
+                return j;
+            }
+            return 0;
+        default:
+            if (std::isdigit(c)) {      // Octal or a back-reference.
+                auto j = i;
+                while (std::isdigit(at(j))) { ++j; }
+                return j;
+            }
+            return 0;                   // \Q, \E, and whatever else.
+    }
+}
+
+// Drop the last, possibly multi-byte, character of the run.
+void popChar(std::vector<uint8_t> & run) {
+    while (!run.empty() && (run.back() & 0xC0) == 0x80) { run.pop_back(); }
+    if (!run.empty()) { run.pop_back(); }
+}
+
+} // namespace {anonymous}
+
+// This is deliberately conservative: only literal text outside of groups,
+// classes and alternations is taken as required, and a character followed by
+// a quantifier that permits zero occurrences is not. Escapes spelt with
+// letters or digits break the text, and options anywhere disable filtering.
+SearchIndex::Query::Query(const std::string & pattern) : _hashes() {
+    if (pattern.find('|')  != std::string::npos ||
+        pattern.find("(?") != std::string::npos)
+    {
+        // Alternation or options (e.g. caseless), anything goes.
+        return;
+    }
+
+    std::vector<uint8_t> run;
+    int                  depth = 0;
+
+    auto flush = [&] { addTrigrams(run, _hashes); run.clear(); };
+
+    for (size_t i = 0; i != pattern.size(); ++i) {
+        uint8_t c = pattern[i];
+
+        if (!isMeta(c)) {
+            if (depth == 0) { run.push_back(c); }
+            continue;
+        }
+
+        switch (c) {
+            case '\\':
+                if (i + 1 == pattern.size()) { break; }
+                c = pattern[++i];
+                if (!std::isalnum(c)) {
+                    if (depth == 0) { run.push_back(c); }
+                }
+                else {
+                    // \d, \b, \x41, \101, \cA, \p{L}... none are the text
+                    // that they're spelt with.
+                    auto end = escapeEnd(pattern, i);
+                    if (end == 0) { _hashes.clear(); return; }
+                    flush();
+                    i = end - 1;
+                }
+                break;
+            case '[':
+                flush();
+                // Skip the class. A ']' first in the class is literal.
+                i += (i + 1 != pattern.size() && pattern[i + 1] == '^') ? 2 : 1;
+                if (i < pattern.size() && pattern[i] == ']') { ++i; }
+                while (i < pattern.size() && pattern[i] != ']') {
+                    if (pattern[i] == '\\') { ++i; }
+                    ++i;
+                }
+                if (i >= pattern.size()) { _hashes.clear(); return; }
+                break;
+            case '(':
+                flush();
+                ++depth;
+                break;
+            case ')':
+                flush();
+                --depth;
+                break;
+            case '?':
+            case '*':
+            case '{':
+                // The preceding character is optional.
+                popChar(run);
+                flush();
+                if (c == '{') {
+                    while (i < pattern.size() && pattern[i] != '}') { ++i; }
+                    if (i == pattern.size()) { _hashes.clear(); return; }
+                }
+                break;
+            case '+':
+            default:
+                flush();
+                break;
+        }
+    }
+
+    flush();
+
+    std::sort(_hashes.begin(), _hashes.end());
+    _hashes.erase(std::unique(_hashes.begin(), _hashes.end()), _hashes.end());
+}
+
+void SearchIndex::add(Tag tag, const std::vector<Cell> & cells) {
+    auto iter = _entries.find(tag);
+
+    if (iter != _entries.end()) {
+        ++iter->second.refs;
+        return;
+    }
+
+    std::vector<uint8_t> text;
+    appendText(cells, text);
+
+    auto trigrams = text.size() < 3 ? 0 : text.size() - 2;
+    auto words    = MIN_BLOOM_WORDS;
+    while (words < MAX_BLOOM_WORDS && words * 64 < trigrams * 8) { words *= 2; }
+
+    Entry entry;
+    entry.refs = 1;
+    entry.bloom.assign(words, 0);
+
+    auto mask = words * 64 - 1;
+    for (size_t i = 0; i != trigrams; ++i) {
+        auto bit = hashTrigram(&text[i]) & mask;
+        entry.bloom[bit / 64] |= uint64_t(1) << (bit % 64);
+    }
+
+    _bloomBytes += words * sizeof(uint64_t);
+    _entries.insert(tag, std::move(entry));
+}
+
+void SearchIndex::addRef(Tag tag) {
+    auto iter = _entries.find(tag);
+    ASSERT(iter != _entries.end(), "Tag not indexed.");
+    ++iter->second.refs;
+}
+
+void SearchIndex::remove(Tag tag) {
+    auto iter = _entries.find(tag);
+    ASSERT(iter != _entries.end(), "Tag not indexed.");
+
+    if (--iter->second.refs == 0) {
+        _bloomBytes -= iter->second.bloom.size() * sizeof(uint64_t);
+        _entries.erase(iter);
+    }
+}
+
+void SearchIndex::merge(SearchIndex & other) {
+    _entries.reserve(_entries.size() + other._entries.size());
+
+    for (auto & pair : other._entries) {
+        auto iter = _entries.find(pair.first);
+
+        if (iter != _entries.end()) {
+            iter->second.refs += pair.second.refs;
+        }
+        else {
+            _bloomBytes += pair.second.bloom.size() * sizeof(uint64_t);
+            _entries.insert(pair.first, std::move(pair.second));
+        }
+    }
+
+    other.clear();
+}
+
+void SearchIndex::clear() {
+    _entries.clear();
+    _bloomBytes = 0;
+}
+
+void SearchIndex::candidates(const Query & query, std::vector<Tag> & tags) const {
+    for (auto & pair : _entries) {
+        auto & bloom = pair.second.bloom;
+        auto   mask  = bloom.size() * 64 - 1;
+        auto   maybe = true;
+
+        for (auto hash : query._hashes) {
+            auto bit = hash & mask;
+            if (!(bloom[bit / 64] & (uint64_t(1) << (bit % 64)))) {
+                maybe = false;
+                break;
+            }
+        }
+
+        if (maybe) { tags.push_back(pair.first); }
+    }
+}
+
+void SearchIndex::appendText(const std::vector<Cell> & cells, std::vector<uint8_t> & text) {
+    for (auto & cell : cells) {
+        auto seq = cell.seq;
+        text.insert(text.end(), &seq.bytes[0], &seq.bytes[utf8::leadLength(seq.lead())]);
+    }
+}
@@ -0,0 +1,76 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef COMMON__SEARCH_INDEX__HXX
+#define COMMON__SEARCH_INDEX__HXX
+
+#include "terminol/common/deduper_interface.hxx"
+#include "terminol/support/flat_map.hxx"
+#include "terminol/support/pattern.hxx"
+
+#include <vector>
+#include <string>
+
+// SearchIndex summarises the text of each unique historical paragraph,
+// keyed by deduper tag, so that a search only decodes and matches the
+// paragraphs that could contain the pattern, and each of those only once
+// however often it recurs in the history. A summary is a bloom filter of
+// the paragraph's byte trigrams. Entries are reference counted in step
+// with the owner's references to the tag.
+class SearchIndex : protected Uncopyable {
+public:
+    typedef I_Deduper::Tag Tag;
+
+    // The trigrams that any match of a pattern must contain. Empty if
+    // nothing can be deduced, in which case every paragraph is a candidate.
+    class Query {
+        friend class SearchIndex;
+        std::vector<uint32_t> _hashes;
+
+    public:
+        explicit Query(const std::string & pattern);
+
+        bool filters() const { return !_hashes.empty(); }
+    };
+
+private:
+    // Tags are already hashes, so no need to hash them again.
+    struct TagHash {
+        size_t operator () (Tag tag) const { return tag; }
+    };
+
+    struct Entry {
+        uint32_t              refs;
+        std::vector<uint64_t> bloom;    // Power of two words.
+
+        Entry() : refs(0), bloom() {}
+    };
+
+    FlatMap<Tag, Entry, TagHash> _entries;
+    size_t                       _bloomBytes;
+
+public:
+    SearchIndex() : _entries(I_Deduper::invalidTag()), _bloomBytes(0) {}
+
+    size_t size() const { return _entries.size(); }
+    // Bytes held by the summaries.
+    size_t bytes() const { return _bloomBytes + _entries.tableBytes(); }
+
+    // Take a reference to the tag, summarising the cells if it is new.
+    void add(Tag tag, const std::vector<Cell> & cells);
+    // Take another reference to a tag already added.
+    void addRef(Tag tag);
+    // Release a reference taken by add() or addRef().
+    void remove(Tag tag);
+    // Take over the references of 'other', leaving it empty.
+    void merge(SearchIndex & other);
+    void clear();
+
+    // Append the unique tags that may match the query.
+    void candidates(const Query & query, std::vector<Tag> & tags) const;
+
+    // The UTF-8 text of the cells, as summarised and as searched.
+    static void appendText(const std::vector<Cell> & cells, std::vector<uint8_t> & text);
+};
+
+#endif // COMMON__SEARCH_INDEX__HXX
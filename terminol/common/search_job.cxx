@@ -0,0 +1,176 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/search_job.hxx"
+#include "terminol/common/search_index.hxx"
+#include "terminol/support/flat_map.hxx"
+
+#include <algorithm>
+
+namespace {
+
+const size_t SLICE_TAGS = 4096;     // Paragraphs per slice of the snapshot.
+
+} // namespace {anonymous}
+
+SearchJob::SearchJob(I_Deduper        & deduper,
+                     const Regex      & regex,
+                     std::vector<Tag> && tags,
+                     std::vector<Tag> && candidates,
+                     size_t              threads) :
+    _deduper(deduper),
+    _regex(regex),
+    _tags(std::move(tags)),
+    _candidates((std::sort(candidates.begin(), candidates.end()),
+                 candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                                  candidates.end()),
+                 std::move(candidates))),
+    _slices((_tags.size() + SLICE_TAGS - 1) / SLICE_TAGS),
+    _cancelled(false),
+    _mutex(),
+    _hits(),
+    _matches(),
+    _running(0),
+    _threads()
+{
+    if (_candidates.empty()) {
+        _slices = 0;        // Nothing can match.
+    }
+
+    // Only the candidates are looked up, so only they need pinning: one
+    // reference per unique paragraph rather than per line of history.
+    for (auto tag : _candidates) {
+        if (tag != I_Deduper::invalidTag()) { _deduper.addRef(tag); }
+    }
+
+    threads = std::max<size_t>(1, std::min<size_t>(threads, _slices));
+
+    if (_slices != 0) {
+        _running = threads;
+
+        for (size_t i = 0; i != threads; ++i) {
+            _threads.emplace_back(&SearchJob::work, this);
+        }
+    }
+}
+
+SearchJob::~SearchJob() {
+    _cancelled = true;
+
+    for (auto & thread : _threads) {
+        thread.join();
+    }
+
+    _deduper.removeMany(_candidates);
+}
+
+bool SearchJob::collect(std::vector<Hit>                    & hits,
+                        std::vector<std::pair<Tag, Ranges>> & matches) {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    hits.insert(hits.end(), _hits.begin(), _hits.end());
+    _hits.clear();
+
+    std::move(_matches.begin(), _matches.end(), std::back_inserter(matches));
+    _matches.clear();
+
+    return _running == 0;
+}
+
+void SearchJob::match(const Regex             & regex,
+                      const std::vector<Cell> & cells,
+                      std::vector<uint8_t>    & text,
+                      Ranges                  & ranges) {
+    text.clear();
+    SearchIndex::appendText(cells, text);
+    auto size = text.size();
+    text.push_back(NUL);        // So front() is valid.
+
+    match(regex, &text.front(), size, ranges);
+}
+
+void SearchJob::match(const Regex   & regex,
+                      const uint8_t * text,
+                      size_t          size,
+                      Ranges        & ranges) {
+    auto allOffsets = regex.matchAllOffsets(reinterpret_cast<const char *>(text), size);
+
+    // Convert the byte offsets of the whole matches to cell offsets. The
+    // matches are in order, so walk the text once.
+    uint32_t cell = 0;
+    size_t   byte = 0;
+
+    auto toCell = [&](int offset) {
+        while (byte < size && byte < static_cast<size_t>(offset)) {
+            byte += utf8::leadLength(text[byte]);
+            ++cell;
+        }
+        return cell;
+    };
+
+    ranges.clear();
+
+    for (auto & offsets : allOffsets) {
+        auto begin = toCell(offsets.front().first);
+        auto end   = toCell(offsets.front().last);
+        ranges.push_back(std::make_pair(begin, end));
+    }
+}
+
+void SearchJob::work() {
+    FlatMap<Tag, bool>                  done(I_Deduper::invalidTag());   // Matched?
+    std::vector<uint8_t>                text;
+    Ranges                              ranges;
+    std::vector<Hit>                    hits;
+    std::vector<std::pair<Tag, Ranges>> matches;
+
+    for (;;) {
+        auto slice = _slices.load();
+        while (slice != 0 && !_slices.compare_exchange_weak(slice, slice - 1)) {}
+
+        if (slice == 0 || _cancelled) { break; }
+
+        // Slices are taken newest first, and searched newest first.
+        auto begin = (slice - 1) * SLICE_TAGS;
+        auto end   = std::min(begin + SLICE_TAGS, _tags.size());
+
+        for (auto index = end; index != begin && !_cancelled; /**/) {
+            auto tag = _tags[--index];
+
+            if (tag == I_Deduper::invalidTag() ||
+                !std::binary_search(_candidates.begin(), _candidates.end(), tag))
+            {
+                continue;
+            }
+
+            auto iter = done.find(tag);
+
+            if (iter == done.end()) {
+                // Copy the text out rather than hold the deduper's lock
+                // while matching.
+                _deduper.lookupText(tag, [&](const uint8_t * bytes, size_t size) {
+                    text.assign(bytes, bytes + size);
+                });
+                auto size = text.size();
+                text.push_back(NUL);        // So front() is valid.
+                match(_regex, &text.front(), size, ranges);
+
+                iter = done.insert(tag, !ranges.empty());
+                if (iter->second) { matches.push_back(std::make_pair(tag, ranges)); }
+            }
+
+            if (iter->second) {
+                hits.push_back(Hit{ static_cast<uint32_t>(index), tag });
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _hits.insert(_hits.end(), hits.begin(), hits.end());
+        std::move(matches.begin(), matches.end(), std::back_inserter(_matches));
+        hits.clear();
+        matches.clear();
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    --_running;
+}
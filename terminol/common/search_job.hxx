@@ -0,0 +1,86 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef COMMON__SEARCH_JOB__HXX
+#define COMMON__SEARCH_JOB__HXX
+
+#include "terminol/common/deduper_interface.hxx"
+#include "terminol/support/regex.hxx"
+#include "terminol/support/pattern.hxx"
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+// SearchJob matches a snapshot of a buffer's historical paragraphs against
+// a regex on a few worker threads, so the owner's thread isn't held up
+// however long the history. The snapshot is split into slices which the
+// workers take newest first. Each worker matches a given unique paragraph
+// at most once, against its text as stored by the deduper. The owner collects the hits as they are found.
+// The deduper must be safe to use from several threads. The job holds a
+// reference to each candidate, the only tags it looks up, so the owner's
+// history can be trimmed while it runs.
+class SearchJob : protected Uncopyable {
+public:
+    typedef I_Deduper::Tag Tag;
+
+    // Matched cells of a paragraph, [begin, end) pairs in order.
+    typedef std::vector<std::pair<uint32_t, uint32_t>> Ranges;
+
+    struct Hit {
+        uint32_t index;     // Into the snapshot.
+        Tag      tag;
+    };
+
+private:
+    I_Deduper                & _deduper;
+    const Regex              & _regex;
+    const std::vector<Tag>     _tags;           // The snapshot, oldest first.
+    const std::vector<Tag>     _candidates;     // Sorted, unique. Other tags can't match.
+    std::atomic<size_t>        _slices;         // Slices not yet taken.
+    std::atomic<bool>          _cancelled;
+    std::mutex                 _mutex;          // Protects the following three.
+    std::vector<Hit>           _hits;           // Found but not collected.
+    std::vector<std::pair<Tag, Ranges>> _matches; // Ranges of the newly matched tags.
+    size_t                     _running;        // Workers yet to finish.
+    std::vector<std::thread>   _threads;
+
+public:
+    // 'candidates' needn't be sorted.
+    SearchJob(I_Deduper        & deduper,
+              const Regex      & regex,
+              std::vector<Tag> && tags,
+              std::vector<Tag> && candidates,
+              size_t              threads);
+
+    // Cancels the job, waiting for the workers to stop, then releases the
+    // candidates.
+    ~SearchJob();
+
+    // Move the hits found since the last call into 'hits', and the ranges of
+    // the tags they refer to, that haven't been collected before, into
+    // 'matches'. Returns true if the job has finished, i.e. nothing more
+    // will be found.
+    bool collect(std::vector<Hit>                    & hits,
+                 std::vector<std::pair<Tag, Ranges>> & matches);
+
+    // The cells matched in a paragraph's text, as produced by
+    // SearchIndex::appendText().
+    static void match(const Regex             & regex,
+                      const std::vector<Cell> & cells,
+                      std::vector<uint8_t>    & text,       // Scratch.
+                      Ranges                  & ranges);
+
+    // The cells matched in a paragraph's text, as visited by
+    // I_Deduper::lookupText(). 'text' mustn't be null.
+    static void match(const Regex   & regex,
+                      const uint8_t * text,
+                      size_t          size,
+                      Ranges        & ranges);
+
+protected:
+    void work();
+};
+
+#endif // COMMON__SEARCH_JOB__HXX
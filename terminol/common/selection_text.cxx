@@ -0,0 +1,124 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/selection_text.hxx"
+#include "terminol/support/debug.hxx"
+
+#include <algorithm>
+#include <limits>
+
+SelectionText::SelectionText(I_Deduper & deduper) :
+    _deduper(deduper),
+    _spans(),
+    _literal(),
+    _minSize(0) {}
+
+SelectionText::~SelectionText() {
+    for (auto & span : _spans) {
+        if (span.tag != I_Deduper::invalidTag()) {
+            _deduper.remove(span.tag);
+        }
+    }
+}
+
+void SelectionText::appendPara(Tag tag, uint32_t begin, uint32_t end) {
+    ASSERT(tag != I_Deduper::invalidTag(), "");
+    ASSERT(begin <= end, "");
+
+    if (!_spans.empty()) {
+        auto & last = _spans.back();
+
+        if (last.tag == tag && last.end == begin && !last.newline) {
+            // The next row of the same paragraph.
+            last.end  = end;
+            _minSize += end - begin;
+            return;
+        }
+    }
+
+    _deduper.addRef(tag);
+    _spans.emplace_back(tag, begin, end);
+    _minSize += end - begin;
+}
+
+void SelectionText::appendText(const uint8_t * text, size_t size) {
+    if (_spans.empty() ||
+        _spans.back().tag != I_Deduper::invalidTag() ||
+        _spans.back().newline)
+    {
+        _spans.emplace_back(I_Deduper::invalidTag(), _literal.size(), _literal.size());
+    }
+
+    _literal.append(reinterpret_cast<const char *>(text), size);
+    _spans.back().end = _literal.size();
+    _minSize += size;
+}
+
+void SelectionText::appendNewline() {
+    if (_spans.empty() || _spans.back().newline) {
+        _spans.emplace_back(I_Deduper::invalidTag(), _literal.size(), _literal.size());
+    }
+
+    _spans.back().newline = true;
+    ++_minSize;
+}
+
+void SelectionText::read(Cursor & cursor, size_t maxSize, std::string & chunk) const {
+    ASSERT(maxSize >= utf8::Length::LMAX, "No room for a sequence.");
+
+    while (cursor.span != _spans.size() && chunk.size() < maxSize) {
+        auto & span   = _spans[cursor.span];
+        auto   length = span.end - span.begin;
+
+        if (cursor.done < length) {
+            if (span.tag == I_Deduper::invalidTag()) {
+                auto count = std::min<size_t>(length - cursor.done, maxSize - chunk.size());
+                chunk.append(_literal, span.begin + cursor.done, count);
+                cursor.done += count;
+            }
+            else {
+                _deduper.lookupText(span.tag, [&](const uint8_t * bytes, size_t size) {
+                    auto cell = span.begin + cursor.done;
+                    auto byte = cursor.byte;
+
+                    if (cursor.done == 0) {
+                        // Find the first cell, the cursor hasn't been here before.
+                        byte = 0;
+                        for (uint32_t i = 0; i != span.begin && byte < size; ++i) {
+                            byte += utf8::leadLength(bytes[byte]);
+                        }
+                    }
+
+                    auto from = byte;
+
+                    for (; cell != span.end && byte < size; ++cell) {
+                        auto seqLength = utf8::leadLength(bytes[byte]);
+                        if (chunk.size() + (byte - from) + seqLength > maxSize) { break; }
+                        byte += seqLength;
+                    }
+
+                    ASSERT(cell == span.end || byte < size, "Paragraph shorter than span.");
+                    chunk.append(reinterpret_cast<const char *>(bytes) + from, byte - from);
+                    cursor.done = cell - span.begin;
+                    cursor.byte = byte;
+                });
+
+                if (cursor.done != length) { break; }   // The chunk is full.
+            }
+        }
+        else if (span.newline && cursor.done == length) {
+            chunk.push_back('\n');
+            ++cursor.done;
+        }
+        else {
+            ++cursor.span;
+            cursor.done = 0;
+        }
+    }
+}
+
+void SelectionText::read(std::string & text) const {
+    Cursor cursor;
+    text.reserve(text.size() + _minSize);
+    read(cursor, std::numeric_limits<size_t>::max(), text);
+}
@@ -0,0 +1,74 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef COMMON__SELECTION_TEXT__HXX
+#define COMMON__SELECTION_TEXT__HXX
+
+#include "terminol/common/deduper_interface.hxx"
+#include "terminol/support/pattern.hxx"
+
+#include <vector>
+#include <string>
+
+// SelectionText is a copy of selected text which produces the UTF-8 a chunk
+// at a time, so that a large selection never exists as one string.
+// Historical paragraphs are held by reference (a tag, which keeps the
+// paragraph alive in the deduper, and a range of cells), everything else as
+// literal text. The copy doesn't depend on the buffer it was taken from.
+class SelectionText : protected Uncopyable {
+public:
+    typedef I_Deduper::Tag Tag;
+
+    // Position of the next byte to read.
+    struct Cursor {
+        size_t   span;
+        uint32_t done;          // Cells (or bytes) of the span read, plus its newline.
+        size_t   byte;          // Offset of the next cell in the paragraph's text.
+
+        Cursor() : span(0), done(0), byte(0) {}
+    };
+
+private:
+    struct Span {
+        Tag      tag;           // invalidTag() for literal text.
+        uint32_t begin;         // Cells of the paragraph, or bytes of _literal.
+        uint32_t end;
+        bool     newline;       // Followed by a newline?
+
+        Span(Tag tag_, uint32_t begin_, uint32_t end_) :
+            tag(tag_), begin(begin_), end(end_), newline(false) {}
+    };
+
+    I_Deduper         & _deduper;
+    std::vector<Span>   _spans;
+    std::string         _literal;
+    size_t              _minSize;       // Lower bound on the bytes of text.
+
+public:
+    explicit SelectionText(I_Deduper & deduper);
+    ~SelectionText();
+
+    // Building, in order:
+
+    void appendPara(Tag tag, uint32_t begin, uint32_t end);
+    void appendText(const uint8_t * text, size_t size);
+    void appendNewline();
+
+    // Reading:
+
+    bool   isEmpty()    const { return _spans.empty(); }
+    size_t getMinSize() const { return _minSize; }
+
+    bool atEnd(const Cursor & cursor) const { return cursor.span == _spans.size(); }
+
+    // Append the text at 'cursor' to 'chunk', advancing the cursor, until
+    // 'chunk' holds 'maxSize' bytes (less the tail of a UTF-8 sequence that
+    // wouldn't fit) or the end is reached. Each paragraph is only visited
+    // from the cursor on, so reading a long one in chunks is linear.
+    void read(Cursor & cursor, size_t maxSize, std::string & chunk) const;
+
+    // All of the text.
+    void read(std::string & text) const;
+};
+
+#endif // COMMON__SELECTION_TEXT__HXX
@@ -5,12 +5,21 @@
 #define COMMON__SERVER__HXX
 
 #include "terminol/common/config.hxx"
+#include "terminol/common/control.hxx"
 #include "terminol/support/net.hxx"
 
+#include <string>
+#include <map>
+
 class I_Creator {
 public:
-    virtual void create() = 0;
+    // Open a window, returning its id, or zero if it couldn't be opened.
+    virtual uint32_t create(const control::Create & request) = 0;
     virtual void shutdown() = 0;
+    // Describe the memory in use, a line per item.
+    virtual void memoryReport(std::string & report) = 0;
+    // Dump the recent frames of each window.
+    virtual void frameReport(std::string & report) = 0;
 
 protected:
     I_Creator() {}
@@ -21,9 +30,13 @@ protected:
 //
 //
 
+// Connections persist until the client disconnects, each request being
+// answered as it is handled, see control.hxx.
 class Server : protected SocketServer::I_Observer {
-    I_Creator    & _creator;
-    SocketServer   _socket;
+    I_Creator                     & _creator;
+    SocketServer                    _socket;
+    std::map<int, control::Reader>  _readers;       // Per connection.
+    bool                            _shutdown;
 
 public:
     struct Error {
@@ -35,7 +48,9 @@ public:
            I_Selector   & selector,
            const Config & config) throw (Error) try :
         _creator(creator),
-        _socket(*this, selector, config.socketPath)
+        _socket(*this, selector, config.socketPath),
+        _readers(),
+        _shutdown(false)
     {}
     catch (const SocketServer::Error & error) {
         throw Error(error.message);
@@ -44,28 +59,88 @@ public:
     virtual ~Server() {}
 
 protected:
+    void reply(int id, const control::Frame & request, const std::vector<uint8_t> & payload) {
+        std::vector<uint8_t> bytes;
+        control::putFrame(bytes, request.type, request.tag, payload.data(), payload.size());
+        _socket.send(id, bytes.data(), bytes.size());
+    }
+
+    void reply(int id, const control::Frame & request, const std::string & text) {
+        reply(id, request, std::vector<uint8_t>(text.begin(), text.end()));
+    }
+
+    // Returns false if the connection is to be dropped.
+    bool dispatch(int id, const control::Frame & request) {
+        switch (request.type) {
+            case ControlRequest::CREATE: {
+                control::Create create;
+                if (!control::decodeCreate(request.payload, create)) {
+                    ERROR("Malformed create request.");
+                    return false;
+                }
+                std::vector<uint8_t> payload;
+                control::encodeWindow(_creator.create(create), payload);
+                reply(id, request, payload);
+                return true;
+            }
+            case ControlRequest::MEMORY: {
+                std::string report;
+                _creator.memoryReport(report);
+                reply(id, request, report);
+                return true;
+            }
+            case ControlRequest::FRAMES: {
+                std::string report;
+                _creator.frameReport(report);
+                reply(id, request, report);
+                return true;
+            }
+            case ControlRequest::SHUTDOWN:
+                _creator.shutdown();
+                _shutdown = true;
+                return false;
+        }
+
+        ERROR("Unknown request: " << static_cast<int>(request.type));
+        return false;
+    }
 
     // SocketServer::I_Observer implementation:
 
-    void serverConnected(int UNUSED(id)) override {
+    void serverConnected(int id) override {
         //PRINT("Server connected: " << id);
+        _readers.insert(std::make_pair(id, control::Reader()));
     }
 
-    void serverReceived(int id, const uint8_t * data, size_t UNUSED(size)) override {
+    void serverReceived(int id, const uint8_t * data, size_t size) override {
         //PRINT("Server received bytes, " << id << ": " << size << "b");
-
-        if (data[0] == 0xFF) {
-            _creator.shutdown();
+        auto iter = _readers.find(id);
+        ASSERT(iter != _readers.end(), "");
+        auto & reader = iter->second;
+
+        // Once shut down, anything further is ignored.
+        if (_shutdown) { return; }
+
+        reader.append(data, size);
+
+        try {
+            control::Frame request;
+            while (reader.next(request)) {
+                if (!dispatch(id, request)) {
+                    _socket.disconnect(id);
+                    break;
+                }
+            }
         }
-        else {
-            _creator.create();
+        catch (const control::Reader::Error & error) {
+            ERROR(error.message);
+            _socket.disconnect(id);
         }
-
-        _socket.disconnect(id);
     }
 
-    void serverDisconnected(int UNUSED(id)) override {
+    void serverDisconnected(int id) override {
         //PRINT("Server disconnected: " << id);
+        _readers.erase(id);
     }
 };
 
@@ -0,0 +1,119 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/shell_pool.hxx"
+#include "terminol/support/debug.hxx"
+
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+namespace {
+
+// Delay before (re)filling, so a new window gets its first frame first.
+const int FILL_MS = 250;
+
+} // namespace {anonymous}
+
+ShellPool::ShellPool(I_Selector         & selector,
+                     const Config       & config,
+                     const Tty::Command & command,
+                     size_t               size) :
+    _selector(selector),
+    _config(config),
+    _command(command),
+    _size(size),
+    _shells(),
+    _scheduled(false)
+{
+    schedule();
+}
+
+ShellPool::~ShellPool() {
+    if (_scheduled) {
+        _selector.removeTimeoutable(this);
+    }
+
+    for (auto & shell : _shells) {
+        kill(shell);
+    }
+}
+
+bool ShellPool::take(pid_t & pid, int & fd) {
+    auto taken = false;
+
+    while (!taken && !_shells.empty()) {
+        auto shell = _shells.front();
+        _shells.pop_front();
+
+        if (reaped(shell)) {
+            TEMP_FAILURE_RETRY(::close(shell.fd));
+        }
+        else {
+            pid   = shell.pid;
+            fd    = shell.fd;
+            taken = true;
+        }
+    }
+
+    schedule();
+    return taken;
+}
+
+void ShellPool::tryReap() {
+    for (auto iter = _shells.begin(); iter != _shells.end(); /**/) {
+        if (reaped(*iter)) {
+            TEMP_FAILURE_RETRY(::close(iter->fd));
+            iter = _shells.erase(iter);
+        }
+        else {
+            ++iter;
+        }
+    }
+}
+
+void ShellPool::schedule() {
+    if (!_scheduled && _shells.size() < _size) {
+        _selector.addTimeoutable(this, FILL_MS);
+        _scheduled = true;
+    }
+}
+
+void ShellPool::fill() {
+    while (_shells.size() < _size) {
+        Shell shell;
+
+        try {
+            Tty::spawn(_config, _config.initialRows, _config.initialCols, "", _command, "",
+                       shell.pid, shell.fd);
+        }
+        catch (const Tty::Error & error) {
+            ERROR("Failed to start pooled shell: " << error.message);
+            return;
+        }
+
+        _shells.push_back(shell);
+    }
+}
+
+bool ShellPool::reaped(const Shell & shell) {
+    int  stat;
+    auto pid = TEMP_FAILURE_RETRY(::waitpid(shell.pid, &stat, WNOHANG));
+    ENFORCE_SYS(pid != -1, "::waitpid() failed.");
+    return pid != 0;
+}
+
+void ShellPool::kill(const Shell & shell) {
+    // Closing the master hangs up the shell. It has no user state, so
+    // there is no need to wait for it to exit nicely.
+    TEMP_FAILURE_RETRY(::close(shell.fd));
+    ::kill(shell.pid, SIGKILL);
+    TEMP_FAILURE_RETRY(::waitpid(shell.pid, nullptr, 0));
+}
+
+// I_Selector::I_TimeoutHandler implementation:
+
+void ShellPool::handleTimeout() {
+    _scheduled = false;
+    fill();
+}
@@ -0,0 +1,66 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef COMMON__SHELL_POOL__HXX
+#define COMMON__SHELL_POOL__HXX
+
+#include "terminol/common/tty.hxx"
+#include "terminol/common/config.hxx"
+#include "terminol/support/selector.hxx"
+#include "terminol/support/pattern.hxx"
+
+#include <deque>
+
+// ShellPool keeps shells started ahead of time, each on a pty of the initial
+// size, so that a new window can adopt one rather than wait for a shell to
+// start up. Pooled shells have no WINDOWID. The pool is filled, and refilled
+// after each adoption, from a timeout so that starting the shells is kept
+// off the path of the window that wants one. A shell that exits while
+// pooled is dropped but not replaced until the next adoption, so a shell that
+// can't start isn't restarted endlessly.
+class ShellPool :
+    protected I_Selector::I_TimeoutHandler,
+    protected Uncopyable
+{
+    struct Shell {
+        pid_t pid;
+        int   fd;
+    };
+
+    I_Selector         & _selector;
+    const Config       & _config;
+    const Tty::Command   _command;
+    const size_t         _size;
+    std::deque<Shell>    _shells;       // Oldest first.
+    bool                 _scheduled;
+
+public:
+    ShellPool(I_Selector         & selector,
+              const Config       & config,
+              const Tty::Command & command,
+              size_t               size);
+
+    // Kills the pooled shells.
+    virtual ~ShellPool();
+
+    size_t size() const { return _shells.size(); }
+
+    // Take the oldest shell that is still running, leaving its reaping to the
+    // caller. Returns false if there are none.
+    bool take(pid_t & pid, int & fd);
+
+    // Reap the pooled shells that have exited.
+    void tryReap();
+
+protected:
+    void schedule();
+    void fill();
+    static bool reaped(const Shell & shell);
+    static void kill(const Shell & shell);
+
+    // I_Selector::I_TimeoutHandler implementation:
+
+    void handleTimeout() override;
+};
+
+#endif // COMMON__SHELL_POOL__HXX
@@ -2,190 +2,247 @@
 // Copyright © 2013 David Bryant
 
 #include "terminol/common/simple_deduper.hxx"
+#include "terminol/common/para_codec.hxx"
 #include "terminol/support/hash.hxx"
-#include "terminol/support/rle.hxx"
 
 #include <algorithm>
 #include <iostream>
 #include <iomanip>
+#include <cstring>
 
-namespace {
+// Compacts a shard's arena when destroyed (on the destroyer's thread).
+class SimpleDeduper::Compactor : public I_Destroyer::Garbage {
+    SimpleDeduper & _deduper;
+    Shard         & _shard;
 
-void encode(const std::vector<Cell> & cells,
-            std::vector<uint8_t>    & bytes) {
-    OutMemoryStream os(bytes, true);
+public:
+    Compactor(SimpleDeduper & deduper, Shard & shard) : _deduper(deduper), _shard(shard) {}
 
-    // RLE encode the styles.
-    std::vector<Style> styles;
-    for (auto & cell : cells) {
-        styles.push_back(cell.style);
+    ~Compactor() override {
+        _deduper.compact(_shard);
     }
-    rleEncode(styles, os);
-
-    // Pack the string.
-    std::vector<uint8_t> string;
-    for (auto & cell : cells) {
-        auto length = utf8::leadLength(cell.seq.lead());
-        for (uint8_t i = 0; i != length; ++i) {
-            string.push_back(cell.seq.bytes[i]);
-        }
-    }
-    os.writeAll(&string.front(), 1, string.size());
+};
 
-#if 0
-    auto before = cells.size() * sizeof(Cell);
-    auto after  = bytes.size();
+SimpleDeduper::SimpleDeduper(I_Destroyer & destroyer, int shardBits) :
+    _destroyer(destroyer),
+    _numShards(Tag(1) << shardBits),
+    _shards()
+{
+    ASSERT(shardBits >= 0 && shardBits < 16, "");
 
-    std::cout << before << " --> " << after;
-    if (before > 0) {
-        std::cout << " " << double(after) / double(before) * 100.0;
+    for (Tag i = 0; i != _numShards; ++i) {
+        _shards.emplace_back(new Shard);
     }
-    std::cout << std::endl;
-#endif
 }
 
-void decode(const std::vector<uint8_t> & bytes, std::vector<Cell> & cells) {
-    InMemoryStream is(bytes);
-
-    // RLE decode the styles
-    std::vector<Style> styles;
-    rleDecode(is, styles);
-
-    for (auto & style : styles) {
-        uint8_t b[4] = { 0 };
-
-        is.readAll(&b[0], 1, 1);
-
-        auto length = utf8::leadLength(b[0]);
-
-        for (uint8_t i = 1; i != length; ++i) {
-            is.readAll(&b[i], 1, 1);
-        }
-
-        utf8::Seq seq(b[0], b[1], b[2], b[3]);
-        cells.push_back(Cell::utf8(seq, style));
-    }
-}
-
-} // namespace {anonymous}
-
-SimpleDeduper::SimpleDeduper() : _entries(), _totalRefs(0), _mutex() {}
-
 SimpleDeduper::~SimpleDeduper() {}
 
 auto SimpleDeduper::store(const std::vector<Cell> & cells) -> Tag {
-    std::unique_lock<std::mutex> lock(_mutex);
-
     std::vector<uint8_t> bytes;
-    encode(cells, bytes);
-    auto tag = makeTag(bytes);
+    para::encode(cells, bytes);
+    auto hash = hash64(bytes.data(), bytes.size());
 
-again:
-    ASSERT(tag != invalidTag(), "");
-    auto iter = _entries.find(tag);
+    auto & shard = shardOf(makeTag(hash));
+    std::unique_lock<std::mutex> lock(shard.mutex);
 
-    if (iter == _entries.end()) {
-        _entries.insert(std::make_pair(tag, Entry(cells.size(), std::move(bytes))));
-    }
-    else {
-        auto & entry = iter->second;
+    // Stepping by the number of shards keeps the probes in this shard.
+    auto tag = claimTag(hash, _numShards,
+                        [&](Tag t) {
+                            auto iter = shard.entries.find(t);
 
-        if (bytes != entry.bytes) {
-            std::cerr << "Hash collision: " << tag << std::endl;
+                            if (iter == shard.entries.end()) {
+                                auto ref = shard.arena.allocate(t, bytes.data(), bytes.size());
+                                shard.entries.insert(t, Entry(cells.size(), ref));
+                                shard.uniqueBytes += bytes.size();
+                                return true;
+                            }
 
-            ENFORCE(static_cast<Tag>(_entries.size()) != invalidTag(), "No dedupe room left.");
+                            auto & entry = iter->second;
 
-            ++tag;
-            if (tag == invalidTag()) { ++tag; }
-            goto again;
-        }
+                            if (bytes.size() == shard.arena.size(entry.ref) &&
+                                std::memcmp(bytes.data(), shard.arena.data(entry.ref),
+                                            bytes.size()) == 0)
+                            {
+                                ++entry.refs;
+                                return true;
+                            }
 
-        ++entry.refs;
-    }
+                            return false;
+                        },
+                        [&] { return shard.entries.size() < invalidTag() / _numShards; });
 
-    ++_totalRefs;
+    ++shard.totalRefs;
+    shard.totalBytes += bytes.size();
 
     return tag;
 }
 
 void SimpleDeduper::lookup(Tag tag, std::vector<Cell> & cells) const {
-    std::unique_lock<std::mutex> lock(_mutex);
+    auto & shard = shardOf(tag);
+    std::unique_lock<std::mutex> lock(shard.mutex);
 
-    auto iter = _entries.find(tag);
-    ASSERT(iter != _entries.end(), "");
+    auto iter = shard.entries.find(tag);
+    ASSERT(iter != shard.entries.end(), "");
 
-    auto & bytes = iter->second.bytes;
-    decode(bytes, cells);
+    auto & entry = iter->second;
+    para::decode(shard.arena.data(entry.ref), entry.length, cells);
 }
 
 void SimpleDeduper::lookupSegment(Tag tag, uint32_t offset, int16_t max_size,
                                   std::vector<Cell> & cells, bool & cont, int16_t & wrap) const {
-    std::unique_lock<std::mutex> lock(_mutex);
+    auto & shard = shardOf(tag);
+    std::unique_lock<std::mutex> lock(shard.mutex);
 
-    auto iter = _entries.find(tag);
-    ASSERT(iter != _entries.end(), "");
+    auto iter = shard.entries.find(tag);
+    ASSERT(iter != shard.entries.end(), "");
 
-    auto & bytes = iter->second.bytes;
-    std::vector<Cell> tmp_cells;
-    decode(bytes, tmp_cells);
+    // Only decode the requested segment.
+    auto & entry = iter->second;
+    ASSERT(offset <= entry.length, "");
+    para::Decoder decoder(shard.arena.data(entry.ref), offset);
 
     cells.resize(max_size, Cell::blank());
-    wrap = std::min<uint32_t>(max_size, tmp_cells.size() - offset);
+    wrap = std::min<uint32_t>(max_size, entry.length - offset);
 
-    std::copy(tmp_cells.begin() + offset, tmp_cells.begin() + offset + wrap, cells.begin());
+    decoder.read(cells.data(), wrap);
     std::fill(cells.begin() + wrap, cells.end(), Cell::blank());
-    cont = (offset + wrap != tmp_cells.size());
+    cont = (offset + wrap != entry.length);
 }
 
 size_t SimpleDeduper::lookupLength(Tag tag) const {
-    std::unique_lock<std::mutex> lock(_mutex);
+    auto & shard = shardOf(tag);
+    std::unique_lock<std::mutex> lock(shard.mutex);
 
-    auto iter = _entries.find(tag);
-    ASSERT(iter != _entries.end(), "");
+    auto iter = shard.entries.find(tag);
+    ASSERT(iter != shard.entries.end(), "");
     return iter->second.length;
 }
 
-void SimpleDeduper::remove(Tag tag) {
-    std::unique_lock<std::mutex> lock(_mutex);
+size_t SimpleDeduper::lookupBytes(Tag tag) const {
+    auto & shard = shardOf(tag);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+
+    auto iter = shard.entries.find(tag);
+    ASSERT(iter != shard.entries.end(), "");
+    return shard.arena.size(iter->second.ref);
+}
+
+void SimpleDeduper::lookupText(Tag tag, const TextVisitor & visit) const {
+    auto & shard = shardOf(tag);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+
+    auto iter = shard.entries.find(tag);
+    ASSERT(iter != shard.entries.end(), "");
+
+    auto & entry  = iter->second;
+    auto   bytes  = shard.arena.data(entry.ref);
+    auto   offset = para::textOffset(bytes);
+    visit(bytes + offset, shard.arena.size(entry.ref) - offset);
+}
+
+void SimpleDeduper::addRef(Tag tag) {
+    ASSERT(tag != invalidTag(), "");
+    auto & shard = shardOf(tag);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+
+    auto iter = shard.entries.find(tag);
+    ASSERT(iter != shard.entries.end(), "");
+    ++iter->second.refs;
+    ++shard.totalRefs;
+    shard.totalBytes += shard.arena.size(iter->second.ref);
+}
 
+void SimpleDeduper::remove(Tag tag) {
     ASSERT(tag != invalidTag(), "");
-    auto iter = _entries.find(tag);
-    ASSERT(iter != _entries.end(), "");
+    auto & shard = shardOf(tag);
+    std::unique_lock<std::mutex> lock(shard.mutex);
+
+    removeEntry(shard, tag);
+    maybeCompact(shard, lock);
+}
+
+void SimpleDeduper::removeMany(const std::vector<Tag> & tags) {
+    // Bucket the tags by shard, so each lock is taken once and each tag
+    // visited once.
+    std::vector<std::vector<Tag>> buckets(_numShards);
+
+    for (auto tag : tags) {
+        if (tag != invalidTag()) { buckets[tag & (_numShards - 1)].push_back(tag); }
+    }
+
+    for (Tag s = 0; s != _numShards; ++s) {
+        if (buckets[s].empty()) { continue; }
+
+        auto & shard = *_shards[s];
+        std::unique_lock<std::mutex> lock(shard.mutex);
+
+        for (auto tag : buckets[s]) {
+            removeEntry(shard, tag);
+        }
+
+        maybeCompact(shard, lock);
+    }
+}
+
+void SimpleDeduper::markStyles(std::vector<bool> & used) const {
+    for (auto & shard : _shards) {
+        std::unique_lock<std::mutex> lock(shard->mutex);
+
+        for (auto & pair : shard->entries) {
+            para::markStyles(shard->arena.data(pair.second.ref), used);
+        }
+    }
+}
+
+void SimpleDeduper::removeEntry(Shard & shard, Tag tag) {
+    auto iter = shard.entries.find(tag);
+    ASSERT(iter != shard.entries.end(), "");
     auto & entry = iter->second;
+    auto   size  = shard.arena.size(entry.ref);
 
     if (--entry.refs == 0) {
-        _entries.erase(iter);
+        shard.arena.release(entry.ref);
+        shard.entries.erase(iter);
+        shard.uniqueBytes -= size;
     }
 
-    --_totalRefs;
+    --shard.totalRefs;
+    shard.totalBytes -= size;
+}
+
+void SimpleDeduper::maybeCompact(Shard & shard, std::unique_lock<std::mutex> & lock) {
+    if (!shard.compacting && shard.arena.fragmented()) {
+        shard.compacting = true;
+        lock.unlock();      // The destroyer may be synchronous.
+        _destroyer.add(new Compactor(*this, shard));
+    }
 }
 
 void SimpleDeduper::getLineStats(uint32_t & uniqueLines, uint32_t & totalLines) const {
-    std::unique_lock<std::mutex> lock(_mutex);
+    uniqueLines = 0;
+    totalLines  = 0;
+
+    for (auto & shard : _shards) {
+        std::unique_lock<std::mutex> lock(shard->mutex);
 
-    uniqueLines = _entries.size();
-    totalLines  = _totalRefs;
+        uniqueLines += shard->entries.size();
+        totalLines  += shard->totalRefs;
+    }
 }
 
 void SimpleDeduper::getByteStats(size_t & uniqueBytes, size_t & totalBytes) const {
-    std::unique_lock<std::mutex> lock(_mutex);
-
     uniqueBytes = 0;
     totalBytes = 0;
 
-    for (auto & l : _entries) {
-        auto & entry = l.second;
-
-        size_t size = entry.bytes.size();
+    for (auto & shard : _shards) {
+        std::unique_lock<std::mutex> lock(shard->mutex);
 
-        uniqueBytes += size;
-        totalBytes  += entry.refs * size;
+        uniqueBytes += shard->uniqueBytes;
+        totalBytes  += shard->totalBytes;
     }
 }
 
 void SimpleDeduper::dump(std::ostream & UNUSED(ost)) const {
-    std::unique_lock<std::mutex> lock(_mutex);
-
 #if 0
     ost << "BEGIN GLOBAL TAGS" << std::endl;
 
@@ -217,8 +274,20 @@ void SimpleDeduper::dump(std::ostream & UNUSED(ost)) const {
 #endif
 }
 
-auto SimpleDeduper::makeTag(const std::vector<uint8_t> & bytes) -> Tag {
-    auto tag = hash<SDBM<Tag>>(&bytes.front(), bytes.size());
-    if (tag == invalidTag()) { ++tag; }
-    return tag;
+void SimpleDeduper::compact(Shard & shard) {
+    // Compact one chunk at a time to avoid starving the other threads.
+    for (;;) {
+        std::unique_lock<std::mutex> lock(shard.mutex);
+
+        auto more = shard.arena.compact([&shard](Tag tag, Arena::Ref ref) {
+                                        auto iter = shard.entries.find(tag);
+                                        ASSERT(iter != shard.entries.end(), "");
+                                        iter->second.ref = ref;
+                                        });
+
+        if (!more) {
+            shard.compacting = false;
+            break;
+        }
+    }
 }
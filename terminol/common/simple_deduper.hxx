@@ -5,31 +5,61 @@
 #define COMMON__SIMPLE_DEDUPER__HXX
 
 #include "terminol/common/deduper_interface.hxx"
+#include "terminol/support/arena.hxx"
+#include "terminol/support/destroyer_interface.hxx"
+#include "terminol/support/flat_map.hxx"
 
-#include <unordered_map>
 #include <vector>
+#include <memory>
 #include <mutex>
 
 //
 //
 //
 
+// The tag space is divided into shards by the low bits of the tag. Each
+// shard has its own table, arena and lock, so screens sharing the deduper
+// (and the destroyer thread) only contend when they touch the same shard.
+// Paragraphs are still deduplicated across all users, because a paragraph's
+// shard is determined by its content.
 class SimpleDeduper : public I_Deduper {
     struct Entry {
-        uint32_t             refs;
-        uint32_t             length;
-        std::vector<uint8_t> bytes;
+        uint32_t   refs;
+        uint32_t   length;
+        Arena::Ref ref;         // Encoded bytes.
 
-        Entry(uint32_t length_, std::vector<uint8_t> && bytes_) :
-            refs(1), length(length_), bytes(bytes_) {}
+        Entry() : refs(0), length(0), ref() {}
+        Entry(uint32_t length_, Arena::Ref ref_) :
+            refs(1), length(length_), ref(ref_) {}
     };
 
-    std::unordered_map<Tag, Entry> _entries;
-    size_t                         _totalRefs;
-    mutable std::mutex             _mutex;
+    // Tags are already hashes, so no need to hash them again.
+    struct TagHash {
+        size_t operator () (Tag tag) const { return tag; }
+    };
+
+    struct Shard {
+        FlatMap<Tag, Entry, TagHash> entries;
+        Arena                        arena;
+        size_t                       totalRefs;
+        size_t                       uniqueBytes;   // Encoded bytes of the entries.
+        size_t                       totalBytes;    // As above, times their references.
+        bool                         compacting;    // Is a Compactor pending?
+        mutable std::mutex           mutex;
+
+        Shard() : entries(invalidTag()), arena(), totalRefs(0), uniqueBytes(0), totalBytes(0),
+                  compacting(false), mutex() {}
+    };
+
+    class Compactor;
+
+    I_Destroyer                         & _destroyer;   // Compaction happens in the destroyer.
+    const Tag                             _numShards;   // Power of two.
+    std::vector<std::unique_ptr<Shard>>   _shards;
 
 public:
-    SimpleDeduper();
+    // 'shardBits' is log2 of the number of shards.
+    explicit SimpleDeduper(I_Destroyer & destroyer, int shardBits = 0);
     virtual ~SimpleDeduper();
 
     // I_Deduper implementation:
@@ -39,14 +69,30 @@ public:
     void lookupSegment(Tag tag, uint32_t offset, int16_t maxSize,
                        std::vector<Cell> & cells, bool & cont, int16_t & wrap) const override;
     size_t lookupLength(Tag tag) const override;
+    size_t lookupBytes(Tag tag) const override;
+    void lookupText(Tag tag, const TextVisitor & visit) const override;
+    void addRef(Tag tag) override;
     void remove(Tag tag) override;
+    void removeMany(const std::vector<Tag> & tags) override;
+    void markStyles(std::vector<bool> & used) const override;
 
     void getLineStats(uint32_t & uniqueLines, uint32_t & totalLines) const override;
     void getByteStats(size_t & uniqueBytes1, size_t & totalBytes) const override;
     void dump(std::ostream & ost) const override;
 
 protected:
-    static Tag makeTag(const std::vector<uint8_t> & bytes);
+    Shard & shardOf(Tag tag) const {
+        return *_shards[tag & (_numShards - 1)];
+    }
+
+    // The shard must be locked.
+    void removeEntry(Shard & shard, Tag tag);
+
+    // Schedule a compaction if the shard is fragmented enough. 'lock' holds
+    // the shard, and is released to schedule it.
+    void maybeCompact(Shard & shard, std::unique_lock<std::mutex> & lock);
+
+    void compact(Shard & shard);
 };
 
 #endif // COMMON__SIMPLE_DEDUPER__HXX
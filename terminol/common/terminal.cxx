@@ -11,12 +11,24 @@
 
 namespace {
 
-int32_t nthArg(const std::vector<int32_t> & args, size_t n, int32_t fallback = 0) {
+const int SEARCH_POLL_MS = 20;      // Between collecting the hits of a search.
+const int EXPORT_POLL_MS = 100;     // Between checks that an export has finished.
+const int RESTORE_POLL_MS = 50;     // Between checks that a restore has finished.
+const int ALT_RELEASE_MS = 30000;   // After leaving the alternate screen.
+const int RESIZE_FRAMES  = 3;       // Frames without a resize before resizing.
+
+int millisUntil(std::chrono::steady_clock::time_point time) {
+    auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(
+        time - std::chrono::steady_clock::now());
+    return std::max(0, static_cast<int>(delay.count()));
+}
+
+int32_t nthArg(const CsiEsc::Args & args, size_t n, int32_t fallback = 0) {
     return n < args.size() ? args[n] : fallback;
 }
 
 // Same as nth arg, but use fallback if arg is zero.
-int32_t nthArgNonZero(const std::vector<int32_t> & args, size_t n, int32_t fallback) {
+int32_t nthArgNonZero(const CsiEsc::Args & args, size_t n, int32_t fallback) {
     auto arg = nthArg(args, n, fallback);
     return arg != 0 ? arg : fallback;
 }
@@ -80,19 +92,25 @@ Terminal::Terminal(I_Observer         & observer,
                    int16_t              rows,
                    int16_t              cols,
                    const std::string  & windowId,
-                   const Tty::Command & command) throw (Tty::Error) :
+                   const Tty::Command & command,
+                   const std::string  & cwd,
+                   ShellPool          * shellPool,
+                   HistoryBudget      * historyBudget) throw (Tty::Error) :
     _observer(observer),
     //
     _config(config),
+    _selector(selector),
     _deduper(deduper),
+    _destroyer(destroyer),
     //
     _priBuffer(_config, deduper, destroyer, rows, cols,
                _config.unlimitedScrollBack ?
                std::numeric_limits<int32_t>::max() :
                _config.scrollBackHistory,
-               CharSubArray(&CS_US, &CS_SPECIAL, &CS_US, &CS_US)),
-    _altBuffer(_config, deduper, destroyer, rows, cols, 0,
-               CharSubArray(&CS_US, &CS_SPECIAL, &CS_US, &CS_US)),
+               CharSubArray(&CS_US, &CS_SPECIAL, &CS_US, &CS_US),
+               historyBudget),
+    _altBuffer(),
+    _altRelease(),
     _buffer(&_priBuffer),
     //
     _modes(),
@@ -101,11 +119,21 @@ Terminal::Terminal(I_Observer         & observer,
     _button(Button::LEFT),
     _pointerPos(),
     _focused(true),
+    _timeout(false),
+    _timeoutDue(),
+    _resizeRows(0),
+    _resizeCols(0),
+    _resizeDue(),
+    _export(),
+    _restore(),
+    _frameScheduler(*this, selector, config),
+    _frameTrace(),
     _lastSeq(),
     //
     _utf8Machine(),
+    _decoded(),
     _vtMachine(*this, _config),
-    _tty(*this, selector, config, rows, cols, windowId, command)
+    _tty(*this, selector, config, rows, cols, windowId, command, cwd, shellPool)
 {
     _modes.set(Mode::AUTO_WRAP);
     _modes.set(Mode::SHOW_CURSOR);
@@ -113,7 +141,11 @@ Terminal::Terminal(I_Observer         & observer,
     _modes.set(Mode::ALT_SENDS_ESC);
 }
 
-Terminal::~Terminal() {}
+Terminal::~Terminal() {
+    if (_timeout) {
+        _selector.removeTimeoutable(this);
+    }
+}
 
 void Terminal::resize(int16_t rows, int16_t cols) {
     // Special exception, resizes can occur during dispatch to support
@@ -121,13 +153,36 @@ void Terminal::resize(int16_t rows, int16_t cols) {
 
     ASSERT(rows > 0 && cols > 0, "Rows or cols not positive.");
 
+    _resizeRows = _resizeCols = 0;      // Superseded.
+
     _priBuffer.resizeReflow(rows, cols);
-    _altBuffer.resizeClip(rows, cols);
+    if (_altBuffer) { _altBuffer->resizeClip(rows, cols); }
     _tty.resize(rows, cols);
+
+    scheduleTimeout();
+}
+
+void Terminal::resizeDebounced(int16_t rows, int16_t cols) {
+    ASSERT(rows > 0 && cols > 0, "Rows or cols not positive.");
+
+    if (rows == getRows() && cols == getCols()) {
+        // Back where we started.
+        _resizeRows = _resizeCols = 0;
+        return;
+    }
+
+    auto frameMs = 1000 / std::max(1, _config.framesPerSecond);
+
+    _resizeRows = rows;
+    _resizeCols = cols;
+    _resizeDue  = std::chrono::steady_clock::now() +
+        std::chrono::milliseconds(RESIZE_FRAMES * frameMs);
+
+    scheduleTimeout();
 }
 
 void Terminal::redraw() {
-    Region damage;
+    RegionSet damage;
     bool   scrollbar;
     draw(Trigger::CLIENT, damage, scrollbar);
 }
@@ -158,6 +213,18 @@ bool Terminal::keyPress(xkb_keysym_t keySym, ModifierSet modifiers) {
                 std::copy(seq, seq + l, input.begin());
             }
 
+            if (_buffer->isSearching()) {
+                // Keys navigate the search, like less(1), rather than reaching the tty.
+                if (input.size() == 1 && (input[0] == 'n' || input[0] == 'N')) {
+                    if (input[0] == 'n') { _buffer->nextSearch(); }
+                    else                 { _buffer->prevSearch(); }
+                    fixDamage(Trigger::OTHER);
+                }
+                return true;
+            }
+
+            _frameScheduler.input();
+            _tty.interact();
             write(&input.front(), input.size());
             if (_modes.get(Mode::ECHO)) { echo(&input.front(), input.size()); }
         }
@@ -261,8 +328,8 @@ void Terminal::buttonRelease(bool UNUSED(broken), ModifierSet modifiers) {
     ASSERT(_press != Press::NONE, "Received button release but have no press.");
 
     if (_press == Press::SELECT) {
-        std::string text;
-        if (_buffer->getSelectedText(text)) {
+        auto text = std::make_shared<SelectionText>(_deduper);
+        if (_buffer->getSelectedText(*text)) {
             _observer.terminalCopy(text, Selection::PRIMARY);
         }
 
@@ -351,6 +418,11 @@ void Terminal::paste(const uint8_t * data, size_t size) {
     }
 }
 
+void Terminal::replay(const uint8_t * data, size_t size) {
+    processRead(data, size);
+    fixDamage(Trigger::TTY);
+}
+
 void Terminal::tryReap() {
     _tty.tryReap();
 }
@@ -431,8 +503,8 @@ bool Terminal::handleKeyBinding(xkb_keysym_t keySym, ModifierSet modifiers) {
                 _observer.terminalResizeGlobalFont(-1);
                 return true;
             case Action::COPY_TO_CLIPBOARD: {
-                std::string text;
-                if (_buffer->getSelectedText(text)) {
+                auto text = std::make_shared<SelectionText>(_deduper);
+                if (_buffer->getSelectedText(*text)) {
                     _observer.terminalCopy(text, Selection::CLIPBOARD);
                 }
                 return true;
@@ -482,9 +554,28 @@ bool Terminal::handleKeyBinding(xkb_keysym_t keySym, ModifierSet modifiers) {
                 else {
                     _tty.suspend();
                     _buffer->beginSearch("da");
+                    scheduleTimeout();
                 }
                 fixDamage(Trigger::CLIENT); // kludgy
                 return true;
+            case Action::SEARCH_NEXT:
+                if (_buffer->isSearching()) {
+                    _buffer->nextSearch();
+                    fixDamage(Trigger::OTHER);
+                }
+                return true;
+            case Action::SEARCH_PREV:
+                if (_buffer->isSearching()) {
+                    _buffer->prevSearch();
+                    fixDamage(Trigger::OTHER);
+                }
+                return true;
+            case Action::EXPORT_HISTORY:
+                exportHistory(false);
+                return true;
+            case Action::EXPORT_HISTORY_SGR:
+                exportHistory(true);
+                return true;
             case Action::DEBUG_GLOBAL_TAGS:
                 _deduper.dump(std::cerr);
                 return true;
@@ -506,13 +597,28 @@ bool Terminal::handleKeyBinding(xkb_keysym_t keySym, ModifierSet modifiers) {
             case Action::DEBUG_SELECTION:
                 _buffer->dumpSelection(std::cerr);
                 return true;
+            case Action::DEBUG_FRAMES: {
+                std::vector<FrameTrace::Frame> frames;
+                _frameTrace.snapshot(frames);
+                FrameTrace::dump(std::cerr, frames);
+                return true;
+            }
             case Action::DEBUG_STATS: {
                 size_t uniqueBytes, totalBytes;
                 _deduper.getByteStats(uniqueBytes, totalBytes);
 
+                size_t                       pending;
+                I_Destroyer::Clock::duration meanLatency, maxLatency;
+                _destroyer.getStats(pending, meanLatency, maxLatency);
+
+                typedef std::chrono::duration<double, std::milli> Millis;
+
                 std::ostringstream ost;
                 ost << "line-data="   << humanSize(uniqueBytes) << " "
-                    << "(non-dedupe=" << humanSize(totalBytes) << ")";
+                    << "(non-dedupe=" << humanSize(totalBytes) << ")"
+                    << " garbage="    << pending << " "
+                    << "(latency="    << Millis(meanLatency).count() << "/"
+                    << Millis(maxLatency).count() << "ms)";
                 _observer.terminalSetWindowTitle(ost.str(), true);
                 return true;
             }
@@ -524,12 +630,16 @@ bool Terminal::handleKeyBinding(xkb_keysym_t keySym, ModifierSet modifiers) {
                 double   dedupe =
                     uniqueLines == 0 ? 0.0 :
                     static_cast<double>(globalLines) / uniqueLines;
+                uint32_t cacheHits;
+                uint32_t cacheMisses;
+                _buffer->getLineCacheStats(cacheHits, cacheMisses);
 
                 std::ostringstream ost;
                 ost << "local=" << localLines
                     << " global=" << globalLines
                     << " unique=" << uniqueLines
-                    << " (dedupe-factor=" << dedupe << ")";
+                    << " (dedupe-factor=" << dedupe << ")"
+                    << " line-cache=" << cacheHits << "/" << cacheHits + cacheMisses;
                 _observer.terminalSetWindowTitle(ost.str(), true);
                 return true;
             }
@@ -547,15 +657,146 @@ void Terminal::fixDamage(Trigger trigger) {
     }
 
     if (_observer.terminalFixDamageBegin()) {
-        Region damage;
+        RegionSet damage;
         bool   scrollbar;
-        draw(trigger, damage, scrollbar);
+
+        {
+            FrameTrace::Timer timer(_frameTrace, FrameTrace::DRAW);
+            draw(trigger, damage, scrollbar);
+        }
+
+        uint32_t rows = 0;
+        for (auto & region : damage.getRegions()) {
+            rows += region.end.row - region.begin.row;
+        }
+        _frameTrace.add(FrameTrace::DAMAGED_ROWS, rows);
 
         _observer.terminalFixDamageEnd(damage, scrollbar);
+        _frameTrace.commit();
+    }
+}
+
+// Reflowed history is indexed in chunks, between events. The hits of a
+// search are collected as they are found. A finished export is cleaned up,
+// and a finished restore inserted.
+void Terminal::scheduleTimeout() {
+    // The soonest of whatever is waiting.
+    int delay = -1;
+    auto soonest = [&](int ms) { if (delay == -1 || ms < delay) { delay = ms; } };
+
+    if (_priBuffer.isReflowing())                  { soonest(0); }
+    if (_buffer->isSearchPending())                { soonest(SEARCH_POLL_MS); }
+    if (_export)                                   { soonest(EXPORT_POLL_MS); }
+    if (_restore)                                  { soonest(RESTORE_POLL_MS); }
+    if (_resizeRows != 0)                          { soonest(millisUntil(_resizeDue)); }
+    if (_altBuffer && _buffer != _altBuffer.get()) { soonest(millisUntil(_altRelease)); }
+
+    if (delay == -1) { return; }
+
+    auto due = std::chrono::steady_clock::now() + std::chrono::milliseconds(delay);
+
+    if (_timeout) {
+        // Only reschedule for something sooner.
+        if (_timeoutDue <= due) { return; }
+        _selector.removeTimeoutable(this);
+    }
+
+    _timeout    = true;
+    _timeoutDue = due;
+    _selector.addTimeoutable(this, delay);
+}
+
+// Most shells never use the alternate screen, and those that do use it
+// in bursts (an editor, a pager), so it is only kept in between.
+Buffer & Terminal::altBuffer() {
+    if (!_altBuffer) {
+        _altBuffer.reset(new Buffer(_config, _deduper, _destroyer,
+                                    _priBuffer.getRows(), _priBuffer.getCols(), 0,
+                                    CharSubArray(&CS_US, &CS_SPECIAL, &CS_US, &CS_US)));
+    }
+
+    return *_altBuffer;
+}
+
+void Terminal::useBuffer(Buffer * buffer) {
+    _buffer = buffer;
+
+    if (_buffer == &_priBuffer && _altBuffer) {
+        // Release the alternate buffer unless it is used again soon. Its
+        // contents are lost, as if cleared.
+        _altRelease = std::chrono::steady_clock::now() +
+            std::chrono::milliseconds(ALT_RELEASE_MS);
+        scheduleTimeout();
+    }
+}
+
+// The history is always that of the primary buffer, whichever is showing.
+void Terminal::exportHistory(bool styled) {
+    if (_export) {
+        WARNING("Already exporting history.");
+        return;
+    }
+
+    auto fd = HistoryExport::openTarget(_config.exportTarget);
+
+    if (fd == -1) {
+        ERROR("Failed to open export target: " << _config.exportTarget <<
+              " (" << ::strerror(errno) << ")");
+        return;
+    }
+
+    std::vector<I_Deduper::Tag>    tags;
+    std::vector<std::vector<Cell>> tail;
+    _priBuffer.getHistory(tags, tail);
+
+    _export.reset(new HistoryExport(_deduper, std::move(tags), std::move(tail), fd, styled));
+    scheduleTimeout();
+}
+
+void Terminal::pollExport() {
+    if (_export && _export->isFinished()) {
+        if (_export->isFailed()) {
+            ERROR("Failed to export history to: " << _config.exportTarget);
+        }
+
+        _export.reset();
+    }
+}
+
+void Terminal::saveHistory(OutStream & ostream) throw (StreamError) {
+    if (_restore) {
+        _restore->wait();
+        pollRestore();
+    }
+
+    _priBuffer.saveHistory(ostream);
+}
+
+void Terminal::restoreHistory(const std::string & path) throw (StreamError) {
+    ASSERT(!_restore, "Already restoring history.");
+
+    _restore.reset(new HistoryRestore(_deduper, path));
+    scheduleTimeout();
+}
+
+void Terminal::pollRestore() {
+    if (_restore && _restore->isFinished()) {
+        if (_restore->isFailed()) {
+            ERROR("Failed to restore history: " << _restore->getPath());
+        }
+        else {
+            std::vector<I_Deduper::Tag> tags;
+            std::vector<uint32_t>       lengths;
+            SearchIndex                 index;
+            _restore->take(tags, lengths, index);
+            _priBuffer.insertHistory(tags, lengths, index);
+        }
+
+        _restore.reset();
     }
 }
 
-void Terminal::draw(Trigger trigger, Region & damage, bool & scrollbar) {
+void Terminal::draw(Trigger trigger, RegionSet & damage, bool & scrollbar) {
     damage.clear();
 
     if (trigger == Trigger::FOCUS) {
@@ -671,8 +912,20 @@ void Terminal::resetAll() {
 }
 
 void Terminal::processRead(const uint8_t * data, size_t size) {
-    for (size_t i = 0; i != size; ++i) {
-        switch (_utf8Machine.consume(data[i])) {
+    // Tracing and syncing need to see each character.
+    auto fast = !_config.traceTty && !_config.syncTty;
+
+    for (size_t i = 0; i != size; ) {
+        if (fast && _utf8Machine.idle() && _vtMachine.inGround()) {
+            auto run = processRun(data + i, size - i);
+
+            if (run != 0) {
+                i += run;
+                continue;
+            }
+        }
+
+        switch (_utf8Machine.consume(data[i++])) {
             case utf8::Machine::State::ACCEPT:
                 processChar(_utf8Machine.seq(), _utf8Machine.length());
                 break;
@@ -685,6 +938,37 @@ void Terminal::processRead(const uint8_t * data, size_t size) {
     }
 }
 
+size_t Terminal::processRun(const uint8_t * data, size_t size) {
+    ASSERT(size != 0, "");
+
+    // In GROUND every character that isn't a control goes straight to
+    // machineNormal(), so bypass the machines for runs of them.
+    if (data[0] < 0x80) {
+        auto run = printableRun(data, size);
+        if (run != 0) { processPrintable(data, run); }
+        return run;
+    }
+    else {
+        _decoded.clear();
+        auto run = utf8::decodeRun(data, size, _decoded);
+
+        for (auto seq : _decoded) {
+            machineNormal(seq, utf8::leadLength(seq.lead()));
+        }
+
+        return run;
+    }
+}
+
+void Terminal::processPrintable(const uint8_t * data, size_t size) {
+    ASSERT(size != 0, "");
+
+    // Equivalent to machineNormal() for each character.
+    _buffer->writeRun(data, size, _modes.get(Mode::AUTO_WRAP), _modes.get(Mode::INSERT));
+    _lastSeq = utf8::Seq(data[size - 1]);
+    _frameTrace.add(FrameTrace::CELLS_WRITTEN, size);
+}
+
 void Terminal::processChar(utf8::Seq seq, utf8::Length length) {
     _vtMachine.consume(seq, length);
 
@@ -694,7 +978,7 @@ void Terminal::processChar(utf8::Seq seq, utf8::Length length) {
     }
 }
 
-void Terminal::processAttributes(const std::vector<int32_t> & args) {
+void Terminal::processAttributes(const CsiEsc::Args & args) {
     ASSERT(!args.empty(), "Empty args.");
 
     for (size_t i = 0; i != args.size(); ++i) {
@@ -932,7 +1216,7 @@ void Terminal::processAttributes(const std::vector<int32_t> & args) {
     }
 }
 
-void Terminal::processModes(uint8_t priv, bool set, const std::vector<int32_t> & args) {
+void Terminal::processModes(uint8_t priv, bool set, const CsiEsc::Args & args) {
     //PRINT("processModes: priv=" << priv << ", set=" << set << ", args=" << args.front() /*XXX*/);
 
     for (auto a : args) {
@@ -1001,10 +1285,10 @@ void Terminal::processModes(uint8_t priv, bool set, const std::vector<int32_t> &
                     //NYI("Ignored: "  << a << ", " << set);
                     break;
                 case 47: {
-                    Buffer * newBuffer = set ? &_altBuffer : &_priBuffer;
+                    Buffer * newBuffer = set ? &altBuffer() : &_priBuffer;
                     if (_buffer != newBuffer) {
                         newBuffer->migrateFrom(*_buffer, false);
-                        _buffer = newBuffer;
+                        useBuffer(newBuffer);
                     }
                 } break;
                 case 1000: // Mouse X11 (button press and release)
@@ -1080,10 +1364,10 @@ void Terminal::processModes(uint8_t priv, bool set, const std::vector<int32_t> &
                     _modes.setTo(Mode::ALT_SENDS_ESC, set);
                     break;
                 case 1047: {
-                    Buffer * newBuffer = set ? &_altBuffer : &_priBuffer;
+                    Buffer * newBuffer = set ? &altBuffer() : &_priBuffer;
                     if (_buffer != newBuffer) {
                         newBuffer->migrateFrom(*_buffer, set);
-                        _buffer = newBuffer;
+                        useBuffer(newBuffer);
                     }
                 } break;
                 case 1048:
@@ -1095,11 +1379,11 @@ void Terminal::processModes(uint8_t priv, bool set, const std::vector<int32_t> &
                     }
                     break;
                 case 1049: { // rmcup/smcup, alternative screen
-                    Buffer * newBuffer = set ? &_altBuffer : &_priBuffer;
+                    Buffer * newBuffer = set ? &altBuffer() : &_priBuffer;
                     if (_buffer != newBuffer) {
                         if (set) { _buffer->saveCursor(); }
                         newBuffer->migrateFrom(*_buffer, set);
-                        _buffer = newBuffer;
+                        useBuffer(newBuffer);
                         if (!set) { _buffer->restoreCursor(); }
                     }
                 } break;
@@ -1174,9 +1458,12 @@ const CharSub * Terminal::lookupCharSub(uint8_t code) {
 void Terminal::machineNormal(utf8::Seq seq, utf8::Length UNUSED(length)) {
     _lastSeq = seq;
     _buffer->write(seq, _modes.get(Mode::AUTO_WRAP), _modes.get(Mode::INSERT));
+    _frameTrace.add(FrameTrace::CELLS_WRITTEN, 1);
 }
 
 void Terminal::machineControl(uint8_t control) {
+    _frameTrace.add(FrameTrace::SEQUENCES, 1);
+
     switch (control) {
         case BEL:
             _observer.terminalBell();
@@ -1211,6 +1498,8 @@ void Terminal::machineControl(uint8_t control) {
 }
 
 void Terminal::machineSimpleEsc(const SimpleEsc & esc) {
+    _frameTrace.add(FrameTrace::SEQUENCES, 1);
+
     if (esc.inters.empty()) {
         switch (esc.code) {
             case '7':   // DECSC - Save Cursor
@@ -1314,6 +1603,8 @@ void Terminal::machineSimpleEsc(const SimpleEsc & esc) {
 }
 
 void Terminal::machineCsiEsc(const CsiEsc & esc) {
+    _frameTrace.add(FrameTrace::SEQUENCES, 1);
+
     if (esc.inters.empty()) {
         switch (esc.mode) {
             case '@': { // ICH - Insert Character
@@ -1621,27 +1912,31 @@ default_:
 }
 
 void Terminal::machineDcsEsc(const DcsEsc & UNUSED(esc)) {
+    _frameTrace.add(FrameTrace::SEQUENCES, 1);
     //WARNING("Unhandled: " << esc.str());
 }
 
 void Terminal::machineOscEsc(const OscEsc & esc) {
-    if (!esc.args.empty()) {
+    _frameTrace.add(FrameTrace::SEQUENCES, 1);
+
+    if (!esc.empty()) {
         try {
-            switch (unstringify<int>(esc.args[0])) {
+            switch (unstringify<int>(esc.arg(0))) {
                 case 0: // Icon name and window title
-                    if (esc.args.size() > 1) {
-                        _observer.terminalSetIconName(esc.args[1]);
-                        _observer.terminalSetWindowTitle(esc.args[1], false);
+                    if (esc.size() > 1) {
+                        auto name = esc.arg(1);
+                        _observer.terminalSetIconName(name);
+                        _observer.terminalSetWindowTitle(name, false);
                     }
                     break;
                 case 1: // Icon name
-                    if (esc.args.size() > 1) {
-                        _observer.terminalSetIconName(esc.args[1]);
+                    if (esc.size() > 1) {
+                        _observer.terminalSetIconName(esc.arg(1));
                     }
                     break;
                 case 2: // Window title
-                    if (esc.args.size() > 1) {
-                        _observer.terminalSetWindowTitle(esc.args[1], false);
+                    if (esc.size() > 1) {
+                        _observer.terminalSetWindowTitle(esc.arg(1), false);
                     }
                     break;
                 case 55:
@@ -1674,32 +1969,68 @@ void Terminal::machineOscEsc(const OscEsc & esc) {
 // Tty::I_Observer implementation:
 
 void Terminal::ttyData(const uint8_t * data, size_t size) {
+    _frameTrace.add(FrameTrace::BYTES_READ, size);
+    FrameTrace::Timer timer(_frameTrace, FrameTrace::PARSE);
     processRead(data, size);
 }
 
 void Terminal::ttySync() {
-    fixDamage(Trigger::TTY);
+    _frameScheduler.request();
 }
 
 void Terminal::ttyReaped(int status) {
     _observer.terminalReaped(status);
 }
 
+// FrameScheduler::I_Observer implementation:
+
+void Terminal::frameSchedulerDraw() {
+    fixDamage(Trigger::TTY);
+}
+
+// I_Selector::I_TimeoutHandler implementation:
+
+void Terminal::handleTimeout() {
+    _timeout = false;
+
+    if (_resizeRows != 0 && std::chrono::steady_clock::now() >= _resizeDue) {
+        resize(_resizeRows, _resizeCols);
+    }
+
+    if (_priBuffer.isReflowing()) {
+        // The scrollbar estimate will change.
+        _priBuffer.continueReflow();
+    }
+
+    _buffer->pollSearch();
+    pollExport();
+    pollRestore();
+
+    if (_altBuffer && _buffer != _altBuffer.get() &&
+        std::chrono::steady_clock::now() >= _altRelease)
+    {
+        _altBuffer.reset();
+    }
+
+    scheduleTimeout();
+
+    fixDamage(Trigger::OTHER);
+}
+
 // Buffer::I_Renderer implementation
 
-void Terminal::bufferDrawBg(Pos     pos,
-                            int16_t count,
-                            UColor  color) {
-    _observer.terminalDrawBg(pos, count, color);
+void Terminal::bufferDrawBg(UColor                        color,
+                            const std::vector<CellRect> & rects) {
+    _frameTrace.add(FrameTrace::DRAW_CALLS, 1);
+    _observer.terminalDrawBg(color, rects);
 }
 
-void Terminal::bufferDrawFg(Pos             pos,
-                            int16_t         count,
-                            UColor          color,
-                            AttrSet         attrs,
-                            const uint8_t * str,
-                            size_t          size) {
-    _observer.terminalDrawFg(pos, count, color, attrs, str, size);
+void Terminal::bufferDrawFg(int16_t                    row,
+                            const std::vector<FgRun> & runs,
+                            const uint8_t            * str,
+                            size_t                     size) {
+    _frameTrace.add(FrameTrace::DRAW_CALLS, 1);
+    _observer.terminalDrawFg(row, runs, str, size);
 }
 
 void Terminal::bufferDrawCursor(Pos             pos,
@@ -1709,9 +2040,24 @@ void Terminal::bufferDrawCursor(Pos             pos,
                                 const uint8_t * str,
                                 size_t          size,
                                 bool            wrapNext) {
+    _frameTrace.add(FrameTrace::DRAW_CALLS, 1);
     _observer.terminalDrawCursor(pos, fg, bg, attrs, str, size, wrapNext, _focused);
 }
 
+bool Terminal::bufferScroll(int16_t begin,
+                            int16_t end,
+                            int16_t rows) {
+    return _observer.terminalScroll(begin, end, rows);
+}
+
+bool Terminal::bufferBlitRow(int16_t row, const Buffer::RowKey & key) {
+    return _observer.terminalBlitRow(row, key);
+}
+
+void Terminal::bufferCaptureRow(int16_t row, const Buffer::RowKey & key) {
+    _observer.terminalCaptureRow(row, key);
+}
+
 std::ostream & operator << (std::ostream & ost, Terminal::Button button) {
     switch (button) {
         case Terminal::Button::LEFT:
@@ -5,21 +5,31 @@
 #define COMMON__TERMINAL__HXX
 
 #include "terminol/common/tty.hxx"
+#include "terminol/common/frame_scheduler.hxx"
 #include "terminol/common/vt_state_machine.hxx"
 #include "terminol/common/config.hxx"
 #include "terminol/common/bit_sets.hxx"
 #include "terminol/common/buffer.hxx"
 #include "terminol/common/deduper_interface.hxx"
+#include "terminol/common/history_export.hxx"
+#include "terminol/common/history_restore.hxx"
+#include "terminol/common/selection_text.hxx"
 #include "terminol/support/async_destroyer.hxx"
+#include "terminol/support/frame_trace.hxx"
 #include "terminol/support/selector.hxx"
 #include "terminol/support/pattern.hxx"
 
+#include <memory>
+#include <chrono>
+
 #include <xkbcommon/xkbcommon.h>
 
 class Terminal :
     protected VtStateMachine::I_Observer,
     protected Tty::I_Observer,
+    protected FrameScheduler::I_Observer,
     protected Buffer::I_Renderer,
+    protected I_Selector::I_TimeoutHandler,
     protected Uncopyable
 {
     static const CharSub CS_US;
@@ -32,7 +42,8 @@ public:
     class I_Observer {
     public:
         virtual const std::string & terminalGetDisplayName() const = 0;
-        virtual void terminalCopy(const std::string & text, Selection selection) = 0;
+        virtual void terminalCopy(const std::shared_ptr<const SelectionText> & text,
+                                  Selection                                    selection) = 0;
         virtual void terminalPaste(Selection selection) = 0;
         virtual void terminalResizeLocalFont(int delta) = 0;
         virtual void terminalResizeGlobalFont(int delta) = 0;
@@ -42,15 +53,18 @@ public:
         virtual void terminalBell() = 0;
         virtual void terminalResizeBuffer(int16_t rows, int16_t cols) = 0;
         virtual bool terminalFixDamageBegin() = 0;
-        virtual void terminalDrawBg(Pos     pos,
-                                    int16_t count,
-                                    UColor  color) = 0;
-        virtual void terminalDrawFg(Pos             pos,
-                                    int16_t         count,
-                                    UColor          color,
-                                    AttrSet         attrs,
-                                    const uint8_t * str,       // nul-terminated
-                                    size_t          size) = 0;
+        // Move rows [begin, end) up by 'rows' (down if negative), or return
+        // false to have them redrawn.
+        virtual bool terminalScroll(int16_t begin,
+                                    int16_t end,
+                                    int16_t rows) = 0;
+        virtual void terminalDrawBg(UColor                        color,
+                                    const std::vector<CellRect> & rects) = 0;
+        // A damaged segment of the row, see Buffer::I_Renderer.
+        virtual void terminalDrawFg(int16_t                    row,
+                                    const std::vector<FgRun> & runs,
+                                    const uint8_t            * str,
+                                    size_t                     size) = 0;
         virtual void terminalDrawCursor(Pos             pos,
                                         UColor          fg,
                                         UColor          bg,
@@ -59,11 +73,13 @@ public:
                                         size_t          size,
                                         bool            wrapNext,
                                         bool            focused) = 0;
+        virtual bool terminalBlitRow(int16_t row, const Buffer::RowKey & key) = 0;
+        virtual void terminalCaptureRow(int16_t row, const Buffer::RowKey & key) = 0;
         virtual void terminalDrawScrollbar(size_t  totalRows,
                                            size_t  historyOffset,
                                            int16_t visibleRows) = 0;
-        virtual void terminalFixDamageEnd(const Region & damage,
-                                          bool           scrollbar) = 0;
+        virtual void terminalFixDamageEnd(const RegionSet & damage,
+                                          bool              scrollbar) = 0;
         virtual void terminalReaped(int status) = 0;
 
     protected:
@@ -81,10 +97,14 @@ private:
     I_Observer          & _observer;
 
     const Config        & _config;
-    const I_Deduper     & _deduper;
+    I_Selector          & _selector;
+    I_Deduper           & _deduper;
+    I_Destroyer         & _destroyer;
 
     Buffer                _priBuffer;
-    Buffer                _altBuffer;
+    std::unique_ptr<Buffer> _altBuffer;     // Created on first use, released once unused.
+    std::chrono::steady_clock::time_point
+                          _altRelease;      // When to release _altBuffer, if not current.
     Buffer              * _buffer;
 
     ModeSet               _modes;
@@ -95,12 +115,24 @@ private:
     Button                _button;
     Pos                   _pointerPos;
     bool                  _focused;
+    bool                  _timeout;         // Is a reflow, search, export, etc. timeout scheduled?
+    std::chrono::steady_clock::time_point
+                          _timeoutDue;      // When, if so.
+    int16_t               _resizeRows;      // Of the debounced resize, zero if none.
+    int16_t               _resizeCols;
+    std::chrono::steady_clock::time_point
+                          _resizeDue;       // When the debounced resize takes effect.
+    std::unique_ptr<HistoryExport> _export; // Writing the history, until finished.
+    std::unique_ptr<HistoryRestore> _restore; // Reading a snapshot, until finished.
+    FrameScheduler        _frameScheduler;
+    FrameTrace            _frameTrace;      // The work done towards recent frames.
 
     utf8::Seq             _lastSeq;
 
     //
 
     utf8::Machine         _utf8Machine;
+    std::vector<utf8::Seq> _decoded;        // Scratch for processRun().
     VtStateMachine        _vtMachine;
     Tty                   _tty;
 
@@ -113,7 +145,10 @@ public:
              int16_t              rows,
              int16_t              cols,
              const std::string  & windowId,
-             const Tty::Command & command) throw (Tty::Error);
+             const Tty::Command & command,
+             const std::string  & cwd,
+             ShellPool          * shellPool = nullptr,
+             HistoryBudget      * historyBudget = nullptr) throw (Tty::Error);
     virtual ~Terminal();
 
     // Geometry:
@@ -125,6 +160,12 @@ public:
 
     void     resize(int16_t rows, int16_t cols);
 
+    // Resize once the size has been stable for a few frames, e.g. at the
+    // end of a window drag. Until then the terminal keeps its old size, so
+    // the history isn't reflowed, nor the tty's application signalled, for
+    // every intermediate size.
+    void     resizeDebounced(int16_t rows, int16_t cols);
+
     void     redraw();
 
     bool     keyPress(xkb_keysym_t keySym, ModifierSet modifiers);
@@ -136,6 +177,11 @@ public:
 
     void     paste(const uint8_t * data, size_t size);
 
+    // Process data as though it were read from the tty and draw the
+    // result immediately, bypassing the frame scheduler. For replaying
+    // recorded output, see bench.cxx.
+    void     replay(const uint8_t * data, size_t size);
+
     void     tryReap();
     void     killReap();
     void     clearSelection();
@@ -144,6 +190,32 @@ public:
 
     bool     hasSubprocess() const;
 
+    // Observers may add the time of their stages, from any thread.
+    FrameTrace & getFrameTrace() { return _frameTrace; }
+
+    // Footprint of both buffers.
+    void     getMemoryStats(Buffer::MemoryStats & stats) const {
+        _priBuffer.getMemoryStats(stats);
+        if (_altBuffer) { _altBuffer->getMemoryStats(stats); }
+    }
+
+    // Set the flag in 'used' (see StyleTable::reclaim()) of every style id
+    // held by the buffers, or an export.
+    void     markStyles(std::vector<bool> & used) const {
+        _priBuffer.markStyles(used);
+        if (_altBuffer) { _altBuffer->markStyles(used); }
+        if (_export)    { _export->markStyles(used); }
+    }
+
+    // History, of the primary buffer:
+
+    // A restore still underway is finished first, so its history is saved too.
+    void     saveHistory(OutStream & ostream) throw (StreamError);
+
+    // Start reading a snapshot in the background. Its paragraphs are
+    // inserted before the existing history once it has all been read.
+    void     restoreHistory(const std::string & path) throw (StreamError);
+
 protected:
     enum class Trigger { TTY, FOCUS, CLIENT, OTHER };
 
@@ -151,7 +223,16 @@ protected:
 
     void     fixDamage(Trigger trigger);
 
-    void     draw(Trigger trigger, Region & damage, bool & scrollbar);
+    void     scheduleTimeout();
+
+    Buffer & altBuffer();
+    void     useBuffer(Buffer * buffer);
+
+    void     exportHistory(bool styled);
+    void     pollExport();
+    void     pollRestore();
+
+    void     draw(Trigger trigger, RegionSet & damage, bool & scrollbar);
 
     void     write(const uint8_t * data, size_t size);
     void     echo(const uint8_t * data, size_t size);
@@ -161,10 +242,12 @@ protected:
     void     resetAll();
 
     void     processRead(const uint8_t * data, size_t size);
+    size_t   processRun(const uint8_t * data, size_t size);
+    void     processPrintable(const uint8_t * data, size_t size);
     void     processChar(utf8::Seq seq, utf8::Length length);
 
-    void     processAttributes(const std::vector<int32_t> & args);
-    void     processModes(uint8_t priv, bool set, const std::vector<int32_t> & args);
+    void     processAttributes(const CsiEsc::Args & args);
+    void     processModes(uint8_t priv, bool set, const CsiEsc::Args & args);
 
     static const CharSub * lookupCharSub(uint8_t code);
 
@@ -183,17 +266,22 @@ protected:
     void     ttySync() override;
     void     ttyReaped(int status) override;
 
+    // FrameScheduler::I_Observer implementation:
+
+    void     frameSchedulerDraw() override;
+
+    // I_Selector::I_TimeoutHandler implementation:
+
+    void     handleTimeout() override;
+
     // Buffer::I_Renderer implementation:
 
-    void     bufferDrawBg(Pos     pos,
-                          int16_t count,
-                          UColor  color) override;
-    void     bufferDrawFg(Pos             pos,
-                          int16_t         count,
-                          UColor          color,
-                          AttrSet         attrs,
-                          const uint8_t * str,
-                          size_t          size) override;
+    void     bufferDrawBg(UColor                        color,
+                          const std::vector<CellRect> & rects) override;
+    void     bufferDrawFg(int16_t                    row,
+                          const std::vector<FgRun> & runs,
+                          const uint8_t            * str,
+                          size_t                     size) override;
     void     bufferDrawCursor(Pos             pos,
                               UColor          fg,
                               UColor          bg,
@@ -201,6 +289,11 @@ protected:
                               const uint8_t * str,
                               size_t          size,
                               bool            wrapNext) override;
+    bool     bufferScroll(int16_t begin,
+                          int16_t end,
+                          int16_t rows) override;
+    bool     bufferBlitRow(int16_t row, const Buffer::RowKey & key) override;
+    void     bufferCaptureRow(int16_t row, const Buffer::RowKey & key) override;
 };
 
 std::ostream & operator << (std::ostream & ost, Terminal::Button button);
@@ -0,0 +1,58 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/ascii.hxx"
+#include "terminol/support/debug.hxx"
+
+#include <cstdlib>
+
+namespace {
+
+size_t referenceRun(const uint8_t * data, size_t size) {
+    size_t i = 0;
+    while (i != size && isPrintable(data[i])) { ++i; }
+    return i;
+}
+
+} // namespace {anonymous}
+
+int main() {
+    for (int c = 0; c != 256; ++c) {
+        ENFORCE(isPrintable(c) == (c >= 0x20 && c <= 0x7E), c);
+    }
+
+    // Place each interesting byte at each offset within and across the
+    // vector widths, with varying start alignment.
+    const uint8_t stops[] = { NUL, LF, US, DEL, 0x80, 0xC3, 0xFF };
+    uint8_t buffer[128];
+
+    for (size_t align = 0; align != 8; ++align) {
+        for (size_t size = 0; size != sizeof buffer - align; ++size) {
+            auto data = buffer + align;
+
+            for (size_t i = 0; i != size; ++i) { data[i] = SPACE + (i % 95); }
+            ENFORCE(printableRun(data, size) == size, size);
+
+            for (auto stop : stops) {
+                for (size_t pos = 0; pos < size; pos += 1 + pos / 8) {
+                    auto saved = data[pos];
+                    data[pos] = stop;
+                    ENFORCE(printableRun(data, size) == pos, size << " " << pos);
+                    data[pos] = saved;
+                }
+            }
+        }
+    }
+
+    srand(1);
+
+    for (int n = 0; n != 10000; ++n) {
+        auto size = static_cast<size_t>(rand() % sizeof buffer);
+        for (size_t i = 0; i != size; ++i) {
+            buffer[i] = rand() % 64 == 0 ? rand() % 256 : SPACE + rand() % 95;
+        }
+        ENFORCE(printableRun(buffer, size) == referenceRun(buffer, size), size);
+    }
+
+    return 0;
+}
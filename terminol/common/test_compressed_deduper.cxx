@@ -0,0 +1,143 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/compressed_deduper.hxx"
+#include "terminol/support/debug.hxx"
+
+#include <string>
+#include <cstdlib>
+
+namespace {
+
+std::vector<Cell> makeParagraph(size_t length) {
+    const utf8::Seq seqs[] = {
+        utf8::Seq('a'),
+        utf8::Seq(0xC3, 0xA9),              // e acute
+        utf8::Seq(0xE2, 0x82, 0xAC)         // euro
+    };
+
+    std::vector<Cell> cells;
+    Style style;
+
+    for (size_t i = 0; i != length; ++i) {
+        if (std::rand() % 50 == 0) {
+            style.fg = UColor::indexed(std::rand() % 256);
+        }
+
+        cells.push_back(Cell::utf8(seqs[std::rand() % 3], style));
+    }
+
+    return cells;
+}
+
+void enforceText(const I_Deduper & deduper, I_Deduper::Tag tag,
+                 const std::vector<Cell> & expected) {
+    std::string text;
+    for (auto & cell : expected) {
+        auto seq = cell.seq;
+        text.append(reinterpret_cast<const char *>(seq.bytes), utf8::leadLength(seq.lead()));
+    }
+
+    deduper.lookupText(tag, [&](const uint8_t * bytes, size_t size) {
+        ENFORCE(std::string(reinterpret_cast<const char *>(bytes), size) == text,
+                "Text mismatch, length: " << expected.size());
+    });
+}
+
+void enforceParagraph(const I_Deduper & deduper, I_Deduper::Tag tag,
+                      const std::vector<Cell> & expected) {
+    std::vector<Cell> cells;
+    deduper.lookup(tag, cells);
+    ENFORCE(cells == expected, "Lookup mismatch.");
+
+    std::vector<Cell> segment;
+    bool              cont;
+    int16_t           wrap;
+    uint32_t          offset = 0;
+
+    do {
+        deduper.lookupSegment(tag, offset, 80, segment, cont, wrap);
+        for (int16_t i = 0; i != wrap; ++i) {
+            ENFORCE(segment[i] == expected[offset + i], "Segment mismatch.");
+        }
+        offset += wrap;
+    } while (cont);
+
+    ENFORCE(offset == expected.size(), "");
+
+    enforceText(deduper, tag, expected);
+}
+
+} // namespace {anonymous}
+
+int main() {
+    std::srand(11);
+
+    // Small blocks so that most paragraphs end up compressed.
+    CompressedDeduper deduper(4096);
+
+    std::vector<std::pair<I_Deduper::Tag, std::vector<Cell>>> paragraphs;
+
+    for (int i = 0; i != 5000; ++i) {
+        auto cells = makeParagraph(std::rand() % 300);
+        auto tag   = deduper.store(cells);
+        paragraphs.push_back(std::make_pair(tag, cells));
+    }
+
+    for (auto & p : paragraphs) {
+        enforceParagraph(deduper, p.first, p.second);
+    }
+
+    // The styles held, sealed or open.
+    {
+        std::vector<bool> expected(StyleTable::CAPACITY, false);
+        for (auto & p : paragraphs) {
+            for (auto & cell : p.second) { expected[cell.styleId] = true; }
+        }
+
+        std::vector<bool> used(StyleTable::CAPACITY, false);
+        deduper.markStyles(used);
+        ENFORCE(used == expected, "");
+    }
+
+    // Storing duplicates of sealed paragraphs moves them to the open block.
+    for (size_t i = 0; i < paragraphs.size(); i += 7) {
+        auto & p = paragraphs[i];
+        ENFORCE(deduper.store(p.second) == p.first, "Tag mismatch.");
+        enforceParagraph(deduper, p.first, p.second);
+        deduper.remove(p.first);
+    }
+
+    for (auto & p : paragraphs) {
+        enforceParagraph(deduper, p.first, p.second);
+        deduper.remove(p.first);
+    }
+
+    uint32_t uniqueLines, totalLines;
+    deduper.getLineStats(uniqueLines, totalLines);
+    ENFORCE(uniqueLines == 0 && totalLines == 0, "");
+
+    size_t uniqueBytes, totalBytes;
+    deduper.getByteStats(uniqueBytes, totalBytes);
+    ENFORCE(totalBytes == 0, "");
+
+    // Distinct but similar lines, as in a log, should compress well.
+    std::vector<I_Deduper::Tag> tags;
+
+    for (int i = 0; i != 5000; ++i) {
+        auto text = "[server] request " + std::to_string(i) + " completed in 12ms";
+        std::vector<Cell> cells;
+        for (auto c : text) { cells.push_back(Cell::ascii(c, Style())); }
+        tags.push_back(deduper.store(cells));
+    }
+
+    deduper.getByteStats(uniqueBytes, totalBytes);
+    ENFORCE(uniqueBytes * 3 < totalBytes, "Poor ratio: " << uniqueBytes << "/" << totalBytes);
+
+    deduper.removeMany(tags);
+
+    deduper.getByteStats(uniqueBytes, totalBytes);
+    ENFORCE(uniqueBytes == 0 && totalBytes == 0, "");
+
+    return 0;
+}
@@ -0,0 +1,175 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/control.hxx"
+#include "terminol/common/server.hxx"
+#include "terminol/common/client.hxx"
+#include "terminol/support/debug.hxx"
+
+#include <cstring>
+
+#include <unistd.h>
+
+namespace {
+
+class TestCreator : public I_Creator {
+public:
+    std::vector<control::Create> created;
+    bool                         finished = false;
+
+    virtual ~TestCreator() {}
+
+    uint32_t create(const control::Create & request) override {
+        created.push_back(request);
+        return request.cwd == "/fail" ? 0 : 100 + created.size();
+    }
+
+    void shutdown() override { finished = true; }
+
+    void memoryReport(std::string & report) override { report = "memory\n"; }
+
+    void frameReport(std::string & report) override {
+        // Bigger than a packet.
+        report.assign(3 * SocketServer::MAX_MESSAGE, 'f');
+    }
+};
+
+void testCreate() {
+    control::Create create;
+    create.rows    = 24;
+    create.cols    = 80;
+    create.cwd     = "/tmp";
+    create.command = { "/bin/sh", "-c", "", "echo hi" };
+
+    std::vector<uint8_t> payload;
+    control::encodeCreate(create, payload);
+
+    control::Create decoded;
+    ENFORCE(control::decodeCreate(payload, decoded), "");
+    ENFORCE(decoded.rows == 24 && decoded.cols == 80 && decoded.cwd == "/tmp", "");
+    ENFORCE(decoded.command == create.command, "");
+
+    // Every truncation, and any excess, is malformed.
+    for (size_t size = 0; size != payload.size(); ++size) {
+        std::vector<uint8_t> truncated(payload.begin(), payload.begin() + size);
+        ENFORCE(!control::decodeCreate(truncated, decoded), size);
+    }
+
+    payload.push_back(0);
+    ENFORCE(!control::decodeCreate(payload, decoded), "");
+
+    payload.clear();
+    control::encodeWindow(0x1A00003, payload);
+    ENFORCE(control::decodeWindow(payload) == 0x1A00003, "");
+    payload.pop_back();
+    ENFORCE(control::decodeWindow(payload) == 0, "");
+}
+
+void testReader() {
+    std::vector<uint8_t> bytes;
+    for (uint32_t tag = 0; tag != 100; ++tag) {
+        std::vector<uint8_t> payload(tag * 7, static_cast<uint8_t>(tag));
+        control::putFrame(bytes, ControlRequest::MEMORY, tag, payload.data(), payload.size());
+    }
+
+    // In pieces of every size, which split headers and payloads.
+    for (size_t piece = 1; piece != 50; ++piece) {
+        control::Reader reader;
+        control::Frame  frame;
+        uint32_t        tag = 0;
+
+        for (size_t offset = 0; offset < bytes.size(); offset += piece) {
+            reader.append(&bytes[offset], std::min(piece, bytes.size() - offset));
+
+            while (reader.next(frame)) {
+                ENFORCE(frame.type == ControlRequest::MEMORY && frame.tag == tag, tag);
+                ENFORCE(frame.payload == std::vector<uint8_t>(tag * 7, tag), tag);
+                ++tag;
+            }
+        }
+
+        ENFORCE(tag == 100, piece);
+    }
+
+    // An oversized frame is an error, without waiting for its payload.
+    uint8_t header[control::HEADER_SIZE] = { 0 };
+    uint32_t size = control::MAX_PAYLOAD + 1;
+    std::memcpy(header + 5, &size, sizeof size);
+
+    control::Reader reader;
+    control::Frame  frame;
+    reader.append(header, sizeof header);
+    bool thrown = false;
+    try { reader.next(frame); }
+    catch (const control::Reader::Error &) { thrown = true; }
+    ENFORCE(thrown, "");
+}
+
+// Many requests pipelined over one connection, with replies for each. The
+// replies far exceed the socket's buffer, so the server mustn't wait for
+// them to be read by the client, which shares its thread.
+void testPipelined() {
+    Config config;
+    config.socketPath = "terminol-test-control-" + std::to_string(::getpid());
+
+    Selector    selector;
+    TestCreator creator;
+    Server      server(creator, selector, config);
+    Client      client(selector, config);
+
+    control::Create create;
+    create.command = { "/bin/true" };
+    for (int i = 0; i != 200; ++i) {
+        create.rows = i;
+        client.create(create);
+    }
+
+    create.cwd = "/fail";
+    auto failTag   = client.create(create);
+    auto memoryTag = client.request(ControlRequest::MEMORY);
+    auto framesTag = client.request(ControlRequest::FRAMES);
+    for (int i = 0; i != 99; ++i) { client.request(ControlRequest::FRAMES); }
+
+    do {
+        selector.animate();
+    } while (!client.isFinished());
+
+    auto & replies = client.getReplies();
+    ENFORCE(replies.size() == 302, replies.size());
+    ENFORCE(creator.created.size() == 201, "");
+
+    for (auto & reply : replies) {
+        if (reply.tag < 200) {
+            ENFORCE(reply.type == ControlRequest::CREATE, "");
+            ENFORCE(control::decodeWindow(reply.payload) == 101 + reply.tag, reply.tag);
+            ENFORCE(creator.created[reply.tag].rows == reply.tag, reply.tag);
+        }
+        else if (reply.tag == failTag) {
+            ENFORCE(control::decodeWindow(reply.payload) == 0, "");
+        }
+        else if (reply.tag == memoryTag) {
+            ENFORCE(std::string(reply.payload.begin(), reply.payload.end()) == "memory\n", "");
+        }
+        else {
+            ENFORCE(reply.tag >= framesTag, reply.tag);
+            ENFORCE(reply.payload.size() == 3 * SocketServer::MAX_MESSAGE, "");
+        }
+    }
+
+    // Shutdown has no reply, the server disconnects.
+    client.request(ControlRequest::SHUTDOWN);
+
+    do {
+        selector.animate();
+    } while (!creator.finished);
+}
+
+} // namespace {anonymous}
+
+int main() {
+    testCreate();
+    testReader();
+    testPipelined();
+
+    return 0;
+}
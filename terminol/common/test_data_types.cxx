@@ -5,6 +5,140 @@
 #include "terminol/support/conv.hxx"
 #include "terminol/support/debug.hxx"
 
+#include <cstdlib>
+
+namespace {
+
+bool overlap(const Region & lhs, const Region & rhs) {
+    return
+        lhs.begin.row < rhs.end.row && rhs.begin.row < lhs.end.row &&
+        lhs.begin.col < rhs.end.col && rhs.begin.col < lhs.end.col;
+}
+
+bool covers(const RegionSet & damage, Pos pos) {
+    for (auto & r : damage.getRegions()) {
+        if (pos.row >= r.begin.row && pos.row < r.end.row &&
+            pos.col >= r.begin.col && pos.col < r.end.col)
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void testRegionSet() {
+    // A cursor in one corner and a clock in the other stay apart.
+    RegionSet sparse;
+    sparse.add(Region(Pos(0, 0), Pos(1, 1)));
+    sparse.add(Region(Pos(23, 72), Pos(24, 80)));
+    ENFORCE(sparse.getRegions().size() == 2, sparse);
+
+    // Adjacent rows sharing columns merge into one region.
+    RegionSet rows;
+    for (int16_t r = 0; r != 10; ++r) {
+        rows.add(Region(Pos(r, 0), Pos(r + 1, 10 + r)));
+    }
+    ENFORCE(rows.getRegions().size() == 1, rows);
+    ENFORCE(rows.getRegions().front().end == Pos(10, 19), rows);
+
+    // Empty regions are ignored.
+    RegionSet none;
+    none.add(Region());
+    none.add(Region(Pos(3, 4), Pos(3, 8)));
+    ENFORCE(none.empty(), none);
+
+    // Scattered damage stays bounded, disjoint and covering.
+    std::srand(11);
+    RegionSet scattered;
+    std::vector<Pos> cells;
+    for (int i = 0; i != 200; ++i) {
+        Pos pos(std::rand() % 50, std::rand() % 100);
+        cells.push_back(pos);
+        scattered.add(Region(pos, Pos(pos.row + 1, pos.col + 1)));
+
+        auto & regions = scattered.getRegions();
+        ENFORCE(regions.size() <= 8, scattered);
+
+        for (size_t a = 0; a != regions.size(); ++a) {
+            for (size_t b = a + 1; b != regions.size(); ++b) {
+                ENFORCE(!overlap(regions[a], regions[b]), scattered);
+            }
+        }
+    }
+
+    for (auto pos : cells) {
+        ENFORCE(covers(scattered, pos), pos);
+    }
+}
+
+void testStyleTable() {
+    auto & table = StyleTable::instance();
+
+    ENFORCE(internStyle(Style()) == StyleTable::DEFAULT, "");
+    ENFORCE(Cell::blank() == Cell::blank(Style()), "");
+
+    AttrSet attrs;
+    attrs.set(Attr::BOLD);
+    Style bold(attrs, UColor::indexed(1), UColor::direct(10, 20, 30));
+
+    // Equal styles get equal ids, distinct styles distinct ids.
+    auto id = internStyle(bold);
+    ENFORCE(id != StyleTable::DEFAULT, "");
+    ENFORCE(internStyle(bold) == id, "");
+    ENFORCE(lookupStyle(id) == bold, "");
+    ENFORCE(Cell::ascii('x', bold).style() == bold, "");
+    ENFORCE(Cell::ascii('x', bold) != Cell::ascii('x'), "");
+
+    // Full to the point of approximation, direct colors map onto the cube.
+    for (int i = 0; table.size() < StyleTable::CAPACITY / 4 * 3; ++i) {
+        internStyle(Style(AttrSet(), UColor::indexed(i % 256), UColor::indexed(i / 256)));
+    }
+
+    auto red = lookupStyle(internStyle(Style(attrs, UColor::direct(250, 0, 0), UColor::indexed(0))));
+    ENFORCE(red.fg == UColor::indexed(196), "");
+    ENFORCE(lookupStyle(id) == bold, "");
+
+    // Reclaimed, once not interned since the previous reclaim, unless used.
+    std::vector<bool> used(StyleTable::CAPACITY, false);
+    used[id] = true;
+
+    auto generation = table.generation();
+    auto size       = table.size();
+    ENFORCE(table.reclaim(used) == 0, "Recently interned.");
+    ENFORCE(table.reclaim(used) == size - 2, "All but DEFAULT and bold.");
+    ENFORCE(table.generation() != generation, "");
+    ENFORCE(table.size() == 2, table.size());
+    ENFORCE(lookupStyle(id) == bold && internStyle(bold) == id, "");
+
+    // Direct colors are exact again.
+    Style direct(attrs, UColor::direct(250, 0, 0), UColor::indexed(0));
+    ENFORCE(lookupStyle(internStyle(direct)) == direct, "");
+
+    // Styles denied an id of their own notify the observer, once.
+    struct Observer : public StyleTable::I_Observer {
+        int count = 0;
+        virtual ~Observer() {}
+        void stylesFilling() override { ++count; }
+    } observer;
+
+    table.setObserver(&observer);
+
+    for (int i = 0; table.size() < StyleTable::CAPACITY / 4 * 3; ++i) {
+        internStyle(Style(AttrSet(), UColor::indexed(i % 256), UColor::indexed(i / 256)));
+    }
+    ENFORCE(observer.count == 0, "");
+
+    for (int i = 0; i != 2 * StyleTable::CAPACITY / 64; ++i) {
+        internStyle(Style(AttrSet(), UColor::direct(i % 256, i / 256, 1), UColor::indexed(0)));
+    }
+    ENFORCE(observer.count == 1, observer.count);
+
+    table.setObserver(nullptr);
+}
+
+} // namespace {anonymous}
+
 int main() try {
     auto strCol = "#3142BD";
     auto color = unstringify<Color>(strCol);
@@ -14,6 +148,9 @@ int main() try {
     auto strCol2 = stringify(color);
     ENFORCE(strCol == strCol2, "Strings don't match: " << strCol << " vs " << strCol2);
 
+    testRegionSet();
+    testStyleTable();
+
     return 0;
 }
 catch (const ParseError & error) {
@@ -0,0 +1,136 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/draw_list.hxx"
+#include "terminol/support/debug.hxx"
+
+#include <sstream>
+#include <string>
+
+namespace {
+
+// Flattens the replayed calls into a string.
+class Target : public DrawList::I_Target {
+public:
+    std::ostringstream ost;
+
+    virtual ~Target() {}
+
+    void drawListScroll(int16_t begin, int16_t end, int16_t cols, int16_t rows) override {
+        ost << "scroll " << begin << " " << end << " " << cols << " " << rows << ";";
+    }
+
+    void drawListBg(UColor color, const std::vector<CellRect> & rects) override {
+        ost << "bg " << int(color.index);
+        for (auto & r : rects) { ost << " " << r.pos << "x" << r.rows << "x" << r.cols; }
+        ost << ";";
+    }
+
+    void drawListFg(int16_t row, const std::vector<FgRun> & runs,
+                    const uint8_t * str, size_t size) override {
+        ost << "fg " << row;
+        for (auto & r : runs) {
+            ost << " " << r.col << "x" << r.count << " " << int(r.color.index) << " "
+                << r.attrs.get(Attr::BOLD) << " "
+                << std::string(reinterpret_cast<const char *>(str) + r.offset, r.size);
+        }
+        ost << " " << size << ";";
+    }
+
+    void drawListCursor(Pos pos, UColor fg, UColor bg, AttrSet UNUSED(attrs),
+                        const uint8_t * str, size_t size,
+                        bool wrapNext, bool focused) override {
+        ost << "cursor " << pos << " " << int(fg.index) << " " << int(bg.index) << " "
+            << std::string(reinterpret_cast<const char *>(str), size) << " "
+            << wrapNext << focused << ";";
+    }
+
+    void drawListScrollbar(size_t totalRows, size_t historyOffset, int16_t visibleRows) override {
+        ost << "scrollbar " << totalRows << " " << historyOffset << " " << visibleRows << ";";
+    }
+
+    void drawListEnd(const RegionSet & damage, bool scrollbar) override {
+        ost << "end " << damage << " " << scrollbar << ";";
+    }
+};
+
+const uint8_t * bytes(const char * str) {
+    return reinterpret_cast<const uint8_t *>(str);
+}
+
+RegionSet damage(const Region & region) {
+    RegionSet result;
+    result.add(region);
+    return result;
+}
+
+} // namespace {anonymous}
+
+int main() {
+    AttrSet bold;
+    bold.set(Attr::BOLD);
+
+    DrawList frame1;
+    frame1.addBg(UColor::indexed(1), { CellRect(Pos(0, 0), 2, 3) });
+    frame1.addFg(0, { FgRun(0, 3, UColor::indexed(2), bold, 0, 3) }, bytes("abc"), 3);
+    frame1.addEnd(damage(Region(Pos(0, 0), Pos(2, 3))), false);
+
+    ENFORCE(!frame1.empty(), "");
+
+    DrawList frame2;
+    frame2.addScroll(0, 24, 80, 1);
+    frame2.addBg(UColor::indexed(3), { CellRect(Pos(23, 0), 1, 80), CellRect(Pos(5, 4), 1, 1) });
+    frame2.addFg(23, { FgRun(0, 2, UColor::indexed(4), AttrSet(), 0, 2),
+                       FgRun(2, 1, UColor::indexed(2), bold, 2, 4) }, bytes("de\xF0\x9F\x98\x80"), 6);
+    frame2.addCursor(Pos(5, 4), UColor::indexed(5), UColor::indexed(6), AttrSet(),
+                     bytes("f"), 1, false, true);
+    frame2.addScrollbar(100, 10, 24);
+    frame2.addEnd(damage(Region(Pos(5, 0), Pos(24, 80))), true);
+
+    Target single;
+    frame2.replay(single);
+
+    DrawList pending;
+    ENFORCE(pending.empty(), "");
+
+    pending.splice(frame1);
+    ENFORCE(frame1.empty(), "");
+    ENFORCE(pending.frames() == 1, "");
+
+    pending.splice(frame2);
+    ENFORCE(frame2.empty(), "");
+    ENFORCE(pending.frames() == 2, "");
+
+    Target spliced;
+    pending.replay(spliced);
+
+    // The frames' damage doesn't touch, so it stays separate.
+    RegionSet united;
+    united.add(Region(Pos(0, 0), Pos(2, 3)));
+    united.add(Region(Pos(5, 0), Pos(24, 80)));
+    ENFORCE(united.getRegions().size() == 2, "");
+
+    std::ostringstream expected;
+    expected << "bg 1 " << Pos(0, 0) << "x2x3;"
+             << "fg 0 0x3 2 1 abc 3;"
+             << "scroll 0 24 80 1;"
+             << "bg 3 " << Pos(23, 0) << "x1x80 " << Pos(5, 4) << "x1x1;"
+             << "fg 23 0x2 4 0 de 2x1 2 1 \xF0\x9F\x98\x80 6;"
+             << "cursor " << Pos(5, 4) << " 5 6 f 01;"
+             << "scrollbar 100 10 24;"
+             << "end " << united << " 1;";
+
+    ENFORCE(spliced.ost.str() == expected.str(), spliced.ost.str());
+
+    // The second frame alone sees only its own damage.
+    std::ostringstream end2;
+    end2 << "end " << damage(Region(Pos(5, 0), Pos(24, 80))) << " 1;";
+    ENFORCE(single.ost.str().find("abc") == std::string::npos, single.ost.str());
+    ENFORCE(single.ost.str().find(end2.str()) != std::string::npos, single.ost.str());
+
+    // Clearing leaves nothing to replay.
+    pending.clear();
+    ENFORCE(pending.empty(), "");
+
+    return 0;
+}
@@ -0,0 +1,98 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/frame_scheduler.hxx"
+#include "terminol/support/debug.hxx"
+
+namespace {
+
+// Records the timeout registration rather than waiting for it.
+class FakeSelector : public I_Selector {
+public:
+    I_TimeoutHandler * handler = nullptr;
+    int                milliseconds = -1;
+
+    virtual ~FakeSelector() {}
+
+    void addReadable(int, I_ReadHandler *) override { FATAL(""); }
+    void removeReadable(int) override { FATAL(""); }
+    void addWriteable(int, I_WriteHandler *) override { FATAL(""); }
+    void removeWriteable(int) override { FATAL(""); }
+    void setUrgent(int, bool) override { FATAL(""); }
+
+    void addTimeoutable(I_TimeoutHandler * handler_, int milliseconds_) override {
+        ENFORCE(!handler, "Already registered.");
+        handler      = handler_;
+        milliseconds = milliseconds_;
+    }
+
+    void removeTimeoutable(I_TimeoutHandler * handler_) override {
+        ENFORCE(handler == handler_, "Not registered.");
+        handler = nullptr;
+    }
+
+    void fire() {
+        ENFORCE(handler, "Not registered.");
+        auto h = handler;
+        handler = nullptr;
+        h->handleTimeout();
+    }
+};
+
+struct Observer : public FrameScheduler::I_Observer {
+    int frames = 0;
+    virtual ~Observer() {}
+    void frameSchedulerDraw() override { ++frames; }
+};
+
+} // namespace {anonymous}
+
+int main() {
+    Config       config;
+    FakeSelector selector;
+    Observer     observer;
+
+    config.framesPerSecond    = 50;
+    config.minFramesPerSecond = 10;
+
+    {
+        FrameScheduler scheduler(observer, selector, config);
+
+        // The first frame is never deferred.
+        scheduler.request();
+        ENFORCE(observer.frames == 1, "");
+        ENFORCE(!selector.handler, "");
+
+        // A burst defers the next frame, with a single timeout.
+        scheduler.request();
+        scheduler.request();
+        ENFORCE(observer.frames == 1, "");
+        ENFORCE(selector.handler, "");
+        ENFORCE(selector.milliseconds > 0 && selector.milliseconds <= 21,
+                selector.milliseconds);
+
+        selector.fire();
+        ENFORCE(observer.frames == 2, "");
+
+        // Input makes the next frame immediate and cancels any timeout.
+        scheduler.request();
+        ENFORCE(selector.handler, "");
+        scheduler.input();
+        scheduler.request();
+        ENFORCE(observer.frames == 3, "");
+        ENFORCE(!selector.handler, "");
+
+        // The interval is bounded by the configured rates.
+        auto interval = scheduler.getInterval();
+        ENFORCE(interval >= std::chrono::milliseconds(20), "");
+        ENFORCE(interval <= std::chrono::milliseconds(100), "");
+
+        // Destruction removes a pending timeout.
+        scheduler.request();
+        ENFORCE(selector.handler, "");
+    }
+
+    ENFORCE(!selector.handler, "");
+
+    return 0;
+}
@@ -0,0 +1,111 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/history_budget.hxx"
+#include "terminol/support/debug.hxx"
+
+#include <vector>
+
+namespace {
+
+class Observer : public HistoryBudget::I_Observer {
+public:
+    int count = 0;
+
+    virtual ~Observer() {}
+
+    void budgetExceeded() override { ++count; }
+};
+
+// A history of paragraphs of given sizes, oldest first.
+class Client : public HistoryBudget::I_Client {
+    HistoryBudget     & _budget;
+    std::vector<size_t> _sizes;
+
+public:
+    explicit Client(HistoryBudget & budget) : _budget(budget), _sizes() {
+        _budget.add(this);
+    }
+
+    virtual ~Client() { _budget.remove(this); }
+
+    void push(size_t size) {
+        _sizes.push_back(size);
+        _budget.charge(this, size);
+    }
+
+    size_t paragraphs() const { return _sizes.size(); }
+
+    bool budgetEvict() override {
+        if (_sizes.empty()) { return false; }
+        _budget.charge(this, -static_cast<ssize_t>(_sizes.front()));
+        _sizes.erase(_sizes.begin());
+        return true;
+    }
+};
+
+void testNotify() {
+    Observer      observer;
+    HistoryBudget budget(observer, 1600);
+    Client        client(budget);
+
+    client.push(1000);
+    ENFORCE(observer.count == 0, "");
+    client.push(1000);
+    ENFORCE(observer.count == 1, "");
+    client.push(1000);
+    ENFORCE(observer.count == 1, "Notified only once.");
+
+    budget.enforce();
+    ENFORCE(budget.getBytes() == 1000 && client.paragraphs() == 1, budget.getBytes());
+
+    client.push(1000);
+    ENFORCE(observer.count == 2, "Notified again after enforcement.");
+}
+
+void testFairness() {
+    Observer      observer;
+    HistoryBudget budget(observer, 1600);
+    Client        quiet(budget);
+    Client        noisy(budget);
+
+    for (int i = 0; i != 4; ++i) { quiet.push(100); }
+    for (int i = 0; i != 20; ++i) { noisy.push(100); }
+
+    budget.enforce();
+    ENFORCE(budget.getBytes() <= 1500, budget.getBytes());
+    ENFORCE(quiet.paragraphs() == 4, "The noisy client pays first.");
+
+    // Until both hold the same.
+    for (int i = 0; i != 30; ++i) { noisy.push(100); }
+    for (int i = 0; i != 8; ++i) { quiet.push(100); }
+
+    budget.enforce();
+    ENFORCE(budget.getBytes() <= 1500, budget.getBytes());
+    ENFORCE(quiet.paragraphs() >= 7 && noisy.paragraphs() >= 7, "");
+}
+
+void testRemove() {
+    Observer      observer;
+    HistoryBudget budget(observer, 1000);
+
+    {
+        Client client(budget);
+        client.push(2000);
+    }
+
+    ENFORCE(budget.getBytes() == 0, budget.getBytes());
+
+    // Nothing left to evict.
+    budget.enforce();
+}
+
+} // namespace {anonymous}
+
+int main() {
+    testNotify();
+    testFairness();
+    testRemove();
+
+    return 0;
+}
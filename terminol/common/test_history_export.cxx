@@ -0,0 +1,188 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/history_export.hxx"
+#include "terminol/common/simple_deduper.hxx"
+#include "terminol/support/sync_destroyer.hxx"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include <unistd.h>
+
+namespace {
+
+std::vector<Cell> makeCells(const std::string & str, const Style & style = Style()) {
+    std::vector<Cell> cells;
+    utf8::Machine     machine;
+
+    for (auto c : str) {
+        if (machine.consume(c) == utf8::Machine::State::ACCEPT) {
+            cells.push_back(Cell::utf8(machine.seq(), style));
+        }
+    }
+
+    return cells;
+}
+
+std::string toString(const std::vector<uint8_t> & output) {
+    return std::string(output.begin(), output.end());
+}
+
+std::string readFile(const std::string & path) {
+    std::ifstream      ifs(path);
+    std::ostringstream ost;
+    ost << ifs.rdbuf();
+    return ost.str();
+}
+
+// Export to 'target' and wait until finished.
+bool run(I_Deduper                        & deduper,
+         const std::string                & target,
+         std::vector<HistoryExport::Tag>    tags,
+         std::vector<std::vector<Cell>>     tail,
+         bool                               styled) {
+    auto fd = HistoryExport::openTarget(target);
+    ENFORCE_SYS(fd != -1, "");
+
+    HistoryExport job(deduper, std::move(tags), std::move(tail), fd, styled);
+
+    while (!job.isFinished()) {
+        std::this_thread::yield();
+    }
+
+    return !job.isFailed();
+}
+
+uint32_t totalRefs(const I_Deduper & deduper) {
+    uint32_t uniqueLines, totalLines;
+    deduper.getLineStats(uniqueLines, totalLines);
+    return totalLines;
+}
+
+} // namespace {anonymous}
+
+int main() {
+    SyncDestroyer destroyer;
+    SimpleDeduper deduper(destroyer);
+
+    // Plain text.
+    {
+        std::vector<uint8_t> output;
+        HistoryExport::appendPara(makeCells("h\xC3\xA9llo"), false, output);
+        HistoryExport::appendPara(makeCells(""), false, output);
+        ENFORCE(toString(output) == "h\xC3\xA9llo\n\n", "");
+    }
+
+    // Styled text: a sequence wherever the style changes, reset at the end.
+    {
+        AttrSet attrs;
+        attrs.set(Attr::BOLD);
+        attrs.set(Attr::UNDERLINE);
+
+        Style red(AttrSet(), UColor::indexed(1), UColor::stock(UColor::Name::TEXT_BG));
+        Style fancy(attrs, UColor::indexed(9), UColor::direct(1, 20, 255));
+        Style grey(AttrSet(), UColor::stock(UColor::Name::TEXT_FG), UColor::indexed(240));
+
+        auto cells = makeCells("a");
+        for (auto & c : makeCells("bc", red))  { cells.push_back(c); }
+        for (auto & c : makeCells("d", fancy)) { cells.push_back(c); }
+        for (auto & c : makeCells("e", grey))  { cells.push_back(c); }
+
+        std::vector<uint8_t> output;
+        HistoryExport::appendPara(cells, true, output);
+        HistoryExport::appendPara(makeCells("f"), true, output);
+
+        auto expected =
+            "a\x1B[0;31mbc\x1B[0;1;4;91;48;2;1;20;255md\x1B[0;48;5;240me\x1B[m\n"
+            "f\n";
+        ENFORCE(toString(output) == expected, toString(output));
+
+        output.clear();
+        HistoryExport::appendPara(cells, false, output);
+        ENFORCE(toString(output) == "abcde\n", "");
+    }
+
+    char dir[] = "/tmp/test-history-export-XXXXXX";
+    ENFORCE_SYS(::mkdtemp(dir), "");
+    auto path = std::string(dir) + "/history.txt";
+
+    auto hello = deduper.store(makeCells("h\xC3\xA9llo"));
+    auto world = deduper.store(makeCells("world"));
+
+    // The stored paragraphs, repeated enough for several blocks, then the tail.
+    {
+        std::vector<HistoryExport::Tag> tags;
+        std::string                     expected;
+
+        for (int i = 0; i != 200000; ++i) {
+            tags.push_back(i % 3 == 0 ? world : hello);
+            expected += i % 3 == 0 ? "world\n" : "h\xC3\xA9llo\n";
+        }
+
+        std::vector<std::vector<Cell>> tail;
+        tail.push_back(makeCells("$ ls"));
+        expected += "$ ls\n";
+
+        ENFORCE(run(deduper, path, tags, tail, false), "");
+        ENFORCE(readFile(path) == expected, "");
+        ENFORCE(totalRefs(deduper) == 2, "References not released.");
+
+        // Unstyled cells are the same either way.
+        ENFORCE(run(deduper, path, tags, tail, true), "");
+        ENFORCE(readFile(path) == expected, "");
+    }
+
+    // The paragraphs stay valid while exporting.
+    {
+        auto fd = HistoryExport::openTarget(path);
+        ENFORCE_SYS(fd != -1, "");
+
+        auto temp = deduper.store(makeCells("temporary"));
+        HistoryExport job(deduper, std::vector<HistoryExport::Tag>(1, temp),
+                          std::vector<std::vector<Cell>>(), fd, false);
+        deduper.remove(temp);
+
+        while (!job.isFinished()) { std::this_thread::yield(); }
+        ENFORCE(!job.isFailed(), "");
+    }
+
+    ENFORCE(readFile(path) == "temporary\n", "");
+    ENFORCE(totalRefs(deduper) == 2, "");
+
+    // To a command.
+    {
+        auto target = "|cat > " + path + ".2 && mv " + path + ".2 " + path;
+        ENFORCE(run(deduper, target, std::vector<HistoryExport::Tag>(1, world),
+                    std::vector<std::vector<Cell>>(), false), "");
+
+        // The command runs independently, wait for it to finish.
+        std::string text;
+        for (int i = 0; i != 500 && (text = readFile(path)) != "world\n"; ++i) {
+            ::usleep(10000);
+        }
+        ENFORCE(text == "world\n", "[" << text << "]");
+    }
+
+    // A target that can't be opened.
+    ENFORCE(HistoryExport::openTarget(std::string(dir) + "/missing/history.txt") == -1, "");
+
+    // Nor is a symlink followed, leaving what it points to intact.
+    {
+        auto link = std::string(dir) + "/link.txt";
+        ENFORCE_SYS(::symlink(path.c_str(), link.c_str()) == 0, "");
+        ENFORCE(HistoryExport::openTarget(link) == -1, "");
+        ENFORCE(readFile(path) == "world\n", "");
+        ::unlink(link.c_str());
+    }
+
+    ::unlink(path.c_str());
+    ::rmdir(dir);
+
+    deduper.remove(hello);
+    deduper.remove(world);
+    ENFORCE(totalRefs(deduper) == 0, "");
+
+    return 0;
+}
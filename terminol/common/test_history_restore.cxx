@@ -0,0 +1,214 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/history_restore.hxx"
+#include "terminol/common/para_codec.hxx"
+#include "terminol/common/simple_deduper.hxx"
+#include "terminol/support/sync_destroyer.hxx"
+#include "terminol/support/hash.hxx"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <cstdlib>
+
+#include <unistd.h>
+
+namespace {
+
+std::vector<Cell> makeCells(const std::string & str, const Style & style = Style()) {
+    std::vector<Cell> cells;
+    utf8::Machine     machine;
+
+    for (auto c : str) {
+        if (machine.consume(c) == utf8::Machine::State::ACCEPT) {
+            cells.push_back(Cell::utf8(machine.seq(), style));
+        }
+    }
+
+    return cells;
+}
+
+template <typename T> void append(std::vector<uint8_t> & bytes, T value) {
+    auto data = reinterpret_cast<const uint8_t *>(&value);
+    bytes.insert(bytes.end(), data, data + sizeof value);
+}
+
+// A snapshot of the paragraphs, as Buffer::saveHistory() writes it. Each
+// paragraph is given all of 'styles', numbered in order.
+std::vector<uint8_t> makeSnapshot(const std::vector<std::vector<Cell>> & paras,
+                                  const std::vector<Style>             & styles) {
+    std::vector<uint8_t> bytes(HistoryRestore::SNAPSHOT_MAGIC, HistoryRestore::SNAPSHOT_MAGIC + 8);
+    append<uint32_t>(bytes, HistoryRestore::SNAPSHOT_VERSION);
+    append<uint32_t>(bytes, paras.size());
+
+    std::vector<const std::vector<Cell> *> written;
+
+    for (auto & cells : paras) {
+        auto iter = std::find_if(written.begin(), written.end(),
+                                 [&](const std::vector<Cell> * p) { return *p == cells; });
+        append<uint32_t>(bytes, iter - written.begin());
+        if (iter != written.end()) { continue; }
+        written.push_back(&cells);
+
+        std::vector<Cell> numbered;
+        for (auto & cell : cells) {
+            auto number = std::find(styles.begin(), styles.end(), cell.style()) - styles.begin();
+            numbered.push_back(Cell::utf8(cell.seq, static_cast<StyleId>(number)));
+        }
+
+        std::vector<uint8_t> encoded;
+        para::encode(numbered, encoded);
+
+        std::vector<uint8_t> para;
+        append<uint32_t>(para, cells.size());
+        append<uint32_t>(para, styles.size());
+        for (auto & style : styles) { append(para, style); }
+        para.insert(para.end(), encoded.begin(), encoded.end());
+
+        append<uint32_t>(bytes, para.size());
+        append<uint64_t>(bytes, hash64(para.data(), para.size()));
+        bytes.insert(bytes.end(), para.begin(), para.end());
+    }
+
+    return bytes;
+}
+
+void writeFile(const std::string & path, const std::vector<uint8_t> & bytes) {
+    std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+    ofs.write(reinterpret_cast<const char *>(bytes.data()), bytes.size());
+    ENFORCE(ofs, "");
+}
+
+uint32_t totalRefs(const I_Deduper & deduper) {
+    uint32_t uniqueLines, totalLines;
+    deduper.getLineStats(uniqueLines, totalLines);
+    return totalLines;
+}
+
+// Restore the snapshot at 'path', returning whether it succeeded. The
+// references taken are released.
+bool run(I_Deduper & deduper, const std::string & path) {
+    HistoryRestore restore(deduper, path);
+    restore.wait();
+    ENFORCE(restore.isFinished(), "");
+
+    if (restore.isFailed()) { return false; }
+
+    std::vector<HistoryRestore::Tag> tags;
+    std::vector<uint32_t>            lengths;
+    SearchIndex                      index;
+    restore.take(tags, lengths, index);
+
+    for (auto tag : tags) { index.remove(tag); }
+    ENFORCE(index.size() == 0, "");
+
+    deduper.removeMany(tags);
+    return true;
+}
+
+} // namespace {anonymous}
+
+int main() {
+    SyncDestroyer destroyer;
+    SimpleDeduper deduper(destroyer);
+
+    char dir[] = "/tmp/test-history-restore-XXXXXX";
+    ENFORCE_SYS(::mkdtemp(dir), "");
+    auto path = std::string(dir) + "/0";
+
+    Style bold;
+    bold.attrs.set(Attr::BOLD);
+    bold.fg = UColor::indexed(3);
+
+    std::vector<Style> styles = { Style(), bold };
+
+    std::vector<std::vector<Cell>> paras = {
+        makeCells("h\xC3\xA9llo"), makeCells("world", bold), makeCells(""),
+        makeCells("h\xC3\xA9llo"), makeCells(std::string(1000, 'x'))
+    };
+
+    auto snapshot = makeSnapshot(paras, styles);
+
+    // The paragraphs, their lengths and their summaries, duplicates shared.
+    {
+        writeFile(path, snapshot);
+
+        HistoryRestore restore(deduper, path);
+        ENFORCE_SYS(::unlink(path.c_str()) == 0, "");       // Already mapped.
+        restore.wait();
+        ENFORCE(restore.isFinished() && !restore.isFailed(), "");
+
+        std::vector<HistoryRestore::Tag> tags;
+        std::vector<uint32_t>            lengths;
+        SearchIndex                      index;
+        restore.take(tags, lengths, index);
+
+        ENFORCE(tags.size() == paras.size() && lengths.size() == paras.size(), "");
+        ENFORCE(tags[0] == tags[3] && tags[0] != tags[1], "");
+        ENFORCE(index.size() == 4, index.size());
+        ENFORCE(totalRefs(deduper) == paras.size(), "");
+
+        for (size_t i = 0; i != paras.size(); ++i) {
+            std::vector<Cell> cells;
+            deduper.lookup(tags[i], cells);
+            ENFORCE(cells == paras[i], i);
+            ENFORCE(lengths[i] == paras[i].size(), i);
+        }
+
+        for (auto tag : tags) { index.remove(tag); }
+        deduper.removeMany(tags);
+        ENFORCE(totalRefs(deduper) == 0, "");
+    }
+
+    // Damage of any kind fails the restore, or is harmless, and leaves
+    // nothing behind.
+    {
+        auto bad = snapshot;
+        bad[0] = 'X';
+        writeFile(path, bad);
+        ENFORCE(!run(deduper, path), "Bad magic");
+
+        bad = snapshot;
+        bad.push_back(0);
+        writeFile(path, bad);
+        ENFORCE(!run(deduper, path), "Trailing bytes");
+
+        for (size_t size = 0; size != snapshot.size(); ++size) {
+            writeFile(path, std::vector<uint8_t>(snapshot.begin(), snapshot.begin() + size));
+            ENFORCE(!run(deduper, path), "Truncated: " << size);
+        }
+
+        std::srand(3);
+
+        for (int i = 0; i != 500; ++i) {
+            bad = snapshot;
+            bad[std::rand() % bad.size()] ^= 1 << (std::rand() % 8);
+            writeFile(path, bad);
+            run(deduper, path);
+        }
+
+        ENFORCE(totalRefs(deduper) == 0, "References not released.");
+    }
+
+    // Destroyed before finishing, the references are released.
+    {
+        std::vector<std::vector<Cell>> many;
+        for (int i = 0; i != 5000; ++i) { many.push_back(makeCells(std::to_string(i))); }
+        writeFile(path, makeSnapshot(many, styles));
+
+        { HistoryRestore restore(deduper, path); }
+        ENFORCE(totalRefs(deduper) == 0, "References not released.");
+    }
+
+    // A snapshot that can't be opened.
+    ::unlink(path.c_str());
+    bool thrown = false;
+    try { HistoryRestore restore(deduper, path); }
+    catch (const StreamError &) { thrown = true; }
+    ENFORCE(thrown, "");
+
+    ::rmdir(dir);
+
+    return 0;
+}
@@ -0,0 +1,149 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/para_codec.hxx"
+#include "terminol/support/debug.hxx"
+
+#include <string>
+#include <cstdlib>
+
+namespace {
+
+// Paragraphs of ASCII only, or not, with style runs of around 'run' cells.
+std::vector<Cell> makeParagraph(size_t length, bool ascii, size_t run) {
+    const utf8::Seq seqs[] = {
+        utf8::Seq('a'),
+        utf8::Seq('z'),
+        utf8::Seq(0xC3, 0xA9),              // e acute
+        utf8::Seq(0xE2, 0x82, 0xAC),        // euro
+        utf8::Seq(0xF0, 0x9F, 0x98, 0x80)   // grinning face
+    };
+
+    std::vector<Cell> cells;
+    Style style;
+
+    for (size_t i = 0; i != length; ++i) {
+        if (std::rand() % run == 0) {
+            style.fg = UColor::indexed(std::rand() % 4);
+        }
+
+        cells.push_back(Cell::utf8(seqs[std::rand() % (ascii ? 2 : 5)], style));
+    }
+
+    if (!ascii) { cells[length / 2].seq = seqs[3]; }
+
+    return cells;
+}
+
+void enforceRoundTrip(const std::vector<Cell> & cells, bool ascii) {
+    std::vector<uint8_t> bytes;
+    para::encode(cells, bytes);
+    auto data = bytes.data();
+
+    ENFORCE(para::isAscii(data) == ascii, "ASCII flag, length: " << cells.size());
+    ENFORCE(para::validate(data, bytes.size(), cells.size()), "Invalid, length: " << cells.size());
+
+    std::vector<Cell> decoded(1, Cell::ascii('x'));
+    para::decode(data, cells.size(), decoded);
+    ENFORCE(decoded.size() == cells.size() + 1, "");
+    ENFORCE(std::equal(cells.begin(), cells.end(), decoded.begin() + 1),
+            "Decode mismatch, length: " << cells.size());
+
+    std::string text;
+    for (auto & cell : cells) {
+        text.append(reinterpret_cast<const char *>(cell.seq.bytes),
+                    utf8::leadLength(cell.seq.lead()));
+    }
+
+    auto offset = para::textOffset(data);
+    ENFORCE(std::string(reinterpret_cast<const char *>(data + offset),
+                        bytes.size() - offset) == text,
+            "Text mismatch, length: " << cells.size());
+
+    // Segments from either side of the checkpoints, and from scattered cells.
+    for (size_t begin = 0; begin < cells.size(); begin += 1 + std::rand() % 97) {
+        for (auto b : { begin, begin / para::MIN_STRIDE * para::MIN_STRIDE }) {
+            auto count = std::min<size_t>(cells.size() - b, 80);
+            std::vector<Cell> segment(count, Cell::blank());
+
+            para::Decoder decoder(data, b);
+            decoder.read(segment.data(), count / 2);
+            for (auto i = count / 2; i != count; ++i) { segment[i] = decoder.next(); }
+
+            ENFORCE(std::equal(segment.begin(), segment.end(), cells.begin() + b),
+                    "Segment mismatch, length: " << cells.size() << " cell: " << b);
+        }
+    }
+}
+
+void testVarints() {
+    const uint32_t values[] = { 1, 0x7F, 0x80, 0x3FFF, 0x4000, 0xFFFFFFFF };
+
+    for (auto value : values) {
+        uint8_t data[para::MAX_VARINT_SIZE];
+        auto   size   = para::putVarint(data, value);
+        size_t offset = 0;
+
+        ENFORCE(size == para::varintSize(value), value);
+        ENFORCE(para::getVarint(data, offset) == value && offset == size, value);
+        ENFORCE(data[0] != 0, value);
+    }
+}
+
+// Damaged encodings are rejected, or are still safe to decode.
+void testValidate(const std::vector<Cell> & cells) {
+    std::vector<uint8_t> bytes;
+    para::encode(cells, bytes);
+    auto length = static_cast<uint32_t>(cells.size());
+
+    ENFORCE(!para::validate(bytes.data(), bytes.size(), length + 1), length);
+    ENFORCE(!para::validate(bytes.data(), bytes.size(), length - 1), length);
+
+    for (size_t size = 0; size < bytes.size(); size += 1 + std::rand() % 17) {
+        ENFORCE(!para::validate(bytes.data(), size, length), "Truncated: " << size);
+    }
+
+    for (int i = 0; i != 2000; ++i) {
+        auto damaged = bytes;
+        damaged[std::rand() % damaged.size()] ^= 1 << (std::rand() % 8);
+
+        if (para::validate(damaged.data(), damaged.size(), length)) {
+            std::vector<Cell> decoded;
+            para::decode(damaged.data(), length, decoded);
+            ENFORCE(decoded.size() == length, "");
+        }
+    }
+}
+
+} // namespace {anonymous}
+
+int main() {
+    testVarints();
+
+    enforceRoundTrip(std::vector<Cell>(), true);
+
+    std::srand(7);
+
+    for (auto ascii : { true, false }) {
+        // Short and long, with a few runs or many, or one run (the common
+        // case) too long for a byte count.
+        for (auto length : { 1, 79, 80, 129, 1000, 20000, 100000 }) {
+            for (auto run : { 3, 300, 1000000 }) {
+                enforceRoundTrip(makeParagraph(length, ascii, run), ascii);
+            }
+        }
+    }
+
+    for (auto ascii : { true, false }) {
+        for (auto length : { 1, 79, 1000 }) {
+            testValidate(makeParagraph(length, ascii, 3));
+        }
+    }
+
+    // A paragraph of blanks costs a byte per cell and little else.
+    std::vector<uint8_t> bytes;
+    para::encode(std::vector<Cell>(80, Cell::blank()), bytes);
+    ENFORCE(bytes.size() == 1 + 1 + sizeof(StyleId) + 1 + 80, bytes.size());
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/search_index.hxx"
+
+#include <algorithm>
+
+namespace {
+
+std::vector<Cell> makeCells(const std::string & str) {
+    std::vector<Cell> cells;
+    utf8::Machine     machine;
+
+    for (auto c : str) {
+        if (machine.consume(c) == utf8::Machine::State::ACCEPT) {
+            cells.push_back(Cell::utf8(machine.seq()));
+        }
+    }
+
+    return cells;
+}
+
+bool isCandidate(const SearchIndex & index, SearchIndex::Tag tag, const std::string & pattern) {
+    std::vector<SearchIndex::Tag> tags;
+    index.candidates(SearchIndex::Query(pattern), tags);
+    return std::find(tags.begin(), tags.end(), tag) != tags.end();
+}
+
+} // namespace {anonymous}
+
+int main() {
+    // Queries.
+    ENFORCE(SearchIndex::Query("hello").filters(), "");
+    ENFORCE(!SearchIndex::Query("he").filters(), "Too short for a trigram.");
+    ENFORCE(!SearchIndex::Query("foo|bar").filters(), "Alternation.");
+    ENFORCE(!SearchIndex::Query("(?i)hello").filters(), "Options.");
+    ENFORCE(!SearchIndex::Query("(hello)?").filters(), "Optional group.");
+    ENFORCE(!SearchIndex::Query("hel?").filters(), "Optional last character.");
+    ENFORCE(!SearchIndex::Query("[abc]de").filters(), "");
+    ENFORCE(SearchIndex::Query("[abc]def").filters(), "");
+    ENFORCE(SearchIndex::Query("a\\.bc").filters(), "Escaped literal.");
+    ENFORCE(SearchIndex::Query("\\-ab").filters(), "Escaped literal.");
+    ENFORCE(!SearchIndex::Query("ab(?i)cd").filters(), "Inline options.");
+    ENFORCE(!SearchIndex::Query("\\x41bc").filters(), "Hex escape.");
+    ENFORCE(!SearchIndex::Query("\\x{41}bc").filters(), "Hex escape.");
+    ENFORCE(!SearchIndex::Query("\\101bc").filters(), "Octal escape.");
+    ENFORCE(!SearchIndex::Query("\\cAbc").filters(), "Control escape.");
+    ENFORCE(!SearchIndex::Query("\\p{Lu}bc").filters(), "Property.");
+    ENFORCE(!SearchIndex::Query("\\pLbc").filters(), "Property.");
+    ENFORCE(!SearchIndex::Query("\\N{U+41}bc").filters(), "Named character.");
+    ENFORCE(!SearchIndex::Query("\\Qabc\\E").filters(), "Quoting.");
+    ENFORCE(SearchIndex::Query("\\x41bcd").filters(), "Literal after the escape.");
+
+    SearchIndex index;
+
+    std::string long_(5000, 'x');
+    long_ += "needle";
+
+    index.add(1, makeCells("the quick brown fox"));
+    index.add(2, makeCells("jumps over the lazy dog"));
+    index.add(3, makeCells("caf\xC3\xA9 au lait"));
+    index.add(4, makeCells(long_));
+    ENFORCE(index.size() == 4, "");
+
+    // No false negatives.
+    ENFORCE(isCandidate(index, 1, "quick"), "");
+    ENFORCE(isCandidate(index, 1, "qu.ck brown"), "");
+    ENFORCE(isCandidate(index, 1, "foxy?"), "");
+    ENFORCE(isCandidate(index, 2, "lazy\\s+dog"), "");
+    ENFORCE(isCandidate(index, 3, "caf\xC3\xA9"), "");
+    ENFORCE(isCandidate(index, 3, "caf\xC3\xA9?"), "Optional multi-byte character.");
+    ENFORCE(isCandidate(index, 4, "needle"), "");
+    ENFORCE(isCandidate(index, 2, "zebra|dog"), "Unfiltered.");
+    ENFORCE(isCandidate(index, 1, "\\x71uick"), "");
+    ENFORCE(isCandidate(index, 1, "\\161uick"), "");
+    ENFORCE(isCandidate(index, 1, "\\p{Ll}uick \\x{62}rown"), "");
+
+    // Filtering.
+    ENFORCE(!isCandidate(index, 1, "lazy"), "");
+    ENFORCE(!isCandidate(index, 2, "quick"), "");
+
+    // Reference counting.
+    index.add(1, makeCells("the quick brown fox"));
+    index.remove(1);
+    ENFORCE(isCandidate(index, 1, "quick"), "Still referenced.");
+    index.remove(1);
+    ENFORCE(!isCandidate(index, 1, "quick"), "");
+    ENFORCE(index.size() == 3, "");
+
+    index.clear();
+    ENFORCE(index.size() == 0, "");
+
+    return 0;
+}
@@ -0,0 +1,206 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/search_job.hxx"
+#include "terminol/common/simple_deduper.hxx"
+#include "terminol/support/sync_destroyer.hxx"
+
+#include <algorithm>
+#include <set>
+
+namespace {
+
+const size_t SLICE = 5000;      // More than a slice of the snapshot.
+
+std::vector<Cell> makeCells(const std::string & str) {
+    std::vector<Cell> cells;
+    utf8::Machine     machine;
+
+    for (auto c : str) {
+        if (machine.consume(c) == utf8::Machine::State::ACCEPT) {
+            cells.push_back(Cell::utf8(machine.seq()));
+        }
+    }
+
+    return cells;
+}
+
+// Collect until finished.
+void run(SearchJob & job,
+         std::vector<SearchJob::Hit> & hits,
+         std::set<SearchJob::Tag> & matched) {
+    std::vector<std::pair<SearchJob::Tag, SearchJob::Ranges>> matches;
+
+    while (!job.collect(hits, matches)) {
+        std::this_thread::yield();
+    }
+
+    for (auto & pair : matches) {
+        matched.insert(pair.first);
+    }
+}
+
+} // namespace {anonymous}
+
+int main() {
+    SyncDestroyer destroyer;
+    SimpleDeduper deduper(destroyer);
+
+    // Ranges are in cells, not bytes.
+    {
+        Regex                regex("needle");
+        std::vector<uint8_t> text;
+        SearchJob::Ranges    ranges;
+
+        SearchJob::match(regex, makeCells("h\xC3\xA9llo needle, needle"), text, ranges);
+        ENFORCE(ranges.size() == 2, "");
+        ENFORCE(ranges[0] == std::make_pair(6u, 12u), "");
+        ENFORCE(ranges[1] == std::make_pair(14u, 20u), "");
+
+        SearchJob::match(regex, makeCells("haystack"), text, ranges);
+        ENFORCE(ranges.empty(), "");
+    }
+
+    // Likewise matching the text as stored by the deduper.
+    {
+        Regex             regex("needle");
+        SearchJob::Ranges ranges;
+
+        auto tag = deduper.store(makeCells("h\xC3\xA9llo needle, needle"));
+        deduper.lookupText(tag, [&](const uint8_t * bytes, size_t size) {
+            SearchJob::match(regex, bytes, size, ranges);
+        });
+        deduper.remove(tag);
+
+        ENFORCE(ranges.size() == 2, "");
+        ENFORCE(ranges[0] == std::make_pair(6u, 12u), "");
+        ENFORCE(ranges[1] == std::make_pair(14u, 20u), "");
+    }
+
+    // Empty matches don't repeat forever.
+    {
+        Regex                regex("x*");
+        std::vector<uint8_t> text;
+        SearchJob::Ranges    ranges;
+
+        SearchJob::match(regex, makeCells("ab"), text, ranges);
+        ENFORCE(!ranges.empty(), "");
+    }
+
+    const char * texts[] = { "alpha beta", "a needle in the hay", "gamma", "needle" };
+    std::vector<SearchJob::Tag> unique;
+    for (auto text : texts) { unique.push_back(deduper.store(makeCells(text))); }
+
+    // Enough paragraphs for several slices.
+    std::vector<SearchJob::Tag> tags;
+    std::set<uint32_t>          expected;
+    size_t                      needles = 0;    // Just "needle".
+    for (uint32_t i = 0; i != 20000; ++i) {
+        auto j = (i * 7 + i / 3) % 4;
+        tags.push_back(unique[j]);
+        if (j == 1 || j == 3) { expected.insert(i); }
+        if (j == 3)           { ++needles; }
+    }
+    tags.push_back(I_Deduper::invalidTag());       // Pending.
+
+    // Every occurrence is found, each unique paragraph matched once.
+    {
+        Regex                       regex("needle");
+        SearchJob                   job(deduper, regex,
+                                        std::vector<SearchJob::Tag>(tags),
+                                        std::vector<SearchJob::Tag>(unique), 3);
+        std::vector<SearchJob::Hit> hits;
+        std::set<SearchJob::Tag>    matched;
+        run(job, hits, matched);
+
+        ENFORCE(hits.size() == expected.size(), hits.size() << " " << expected.size());
+        for (auto & hit : hits) {
+            ENFORCE(expected.count(hit.index) == 1, hit.index);
+            ENFORCE(hit.tag == tags[hit.index], "");
+        }
+        ENFORCE(matched == std::set<SearchJob::Tag>({ unique[1], unique[3] }), "");
+    }
+
+    // Tags that aren't candidates aren't matched.
+    {
+        Regex                       regex("needle");
+        SearchJob                   job(deduper, regex,
+                                        std::vector<SearchJob::Tag>(tags),
+                                        std::vector<SearchJob::Tag>(1, unique[3]), 2);
+        std::vector<SearchJob::Hit> hits;
+        std::set<SearchJob::Tag>    matched;
+        run(job, hits, matched);
+
+        ENFORCE(hits.size() == needles, hits.size() << " " << needles);
+        ENFORCE(matched == std::set<SearchJob::Tag>({ unique[3] }), "");
+    }
+
+    // No candidates, nothing to do.
+    {
+        Regex                       regex("needle");
+        SearchJob                   job(deduper, regex,
+                                        std::vector<SearchJob::Tag>(tags),
+                                        std::vector<SearchJob::Tag>(), 2);
+        std::vector<SearchJob::Hit> hits;
+        std::set<SearchJob::Tag>    matched;
+        run(job, hits, matched);
+        ENFORCE(hits.empty(), "");
+    }
+
+    // Destroying a running job cancels it.
+    {
+        Regex     regex("a");
+        SearchJob job(deduper, regex,
+                      std::vector<SearchJob::Tag>(tags),
+                      std::vector<SearchJob::Tag>(unique), 4);
+    }
+
+    for (auto tag : unique) { deduper.remove(tag); }
+
+    // The snapshot outlives the owner's references to it.
+    {
+        auto tag = deduper.store(makeCells("needle"));
+
+        Regex     regex("needle");
+        SearchJob job(deduper, regex,
+                      std::vector<SearchJob::Tag>(SLICE, tag),
+                      std::vector<SearchJob::Tag>(1, tag), 2);
+        deduper.remove(tag);
+
+        std::vector<SearchJob::Hit> hits;
+        std::set<SearchJob::Tag>    matched;
+        run(job, hits, matched);
+        ENFORCE(hits.size() == SLICE, hits.size());
+    }
+
+    // Only the candidates are pinned, once each however often repeated.
+    {
+        auto tag = deduper.store(makeCells("needle"));
+
+        uint32_t uniqueBefore, totalBefore;
+        deduper.getLineStats(uniqueBefore, totalBefore);
+
+        Regex regex("needle");
+        {
+            SearchJob job(deduper, regex,
+                          std::vector<SearchJob::Tag>(SLICE, tag),
+                          std::vector<SearchJob::Tag>(3, tag), 2);
+
+            uint32_t uniqueDuring, totalDuring;
+            deduper.getLineStats(uniqueDuring, totalDuring);
+            ENFORCE(totalDuring == totalBefore + 1, totalDuring << " " << totalBefore);
+        }
+
+        uint32_t uniqueAfter, totalAfter;
+        deduper.getLineStats(uniqueAfter, totalAfter);
+        ENFORCE(totalAfter == totalBefore, totalAfter << " " << totalBefore);
+
+        deduper.remove(tag);
+    }
+
+    uint32_t uniqueLines, totalLines;
+    deduper.getLineStats(uniqueLines, totalLines);
+    ENFORCE(uniqueLines == 0 && totalLines == 0, uniqueLines << " " << totalLines);
+
+    return 0;
+}
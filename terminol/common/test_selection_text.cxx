@@ -0,0 +1,108 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/selection_text.hxx"
+#include "terminol/common/simple_deduper.hxx"
+#include "terminol/support/sync_destroyer.hxx"
+
+#include <string>
+
+namespace {
+
+std::vector<Cell> makeCells(const std::string & str) {
+    std::vector<Cell> cells;
+    utf8::Machine     machine;
+
+    for (auto c : str) {
+        if (machine.consume(c) == utf8::Machine::State::ACCEPT) {
+            cells.push_back(Cell::utf8(machine.seq()));
+        }
+    }
+
+    return cells;
+}
+
+void append(SelectionText & text, const std::string & str) {
+    text.appendText(reinterpret_cast<const uint8_t *>(str.data()), str.size());
+}
+
+// Read in chunks of at most 'maxSize' bytes.
+std::string readChunks(const SelectionText & text, size_t maxSize) {
+    SelectionText::Cursor cursor;
+    std::string           all;
+
+    while (!text.atEnd(cursor)) {
+        std::string chunk;
+        text.read(cursor, maxSize, chunk);
+        ENFORCE(chunk.size() <= maxSize, "");
+        all += chunk;
+    }
+
+    return all;
+}
+
+uint32_t totalRefs(const I_Deduper & deduper) {
+    uint32_t uniqueLines, totalLines;
+    deduper.getLineStats(uniqueLines, totalLines);
+    return totalLines;
+}
+
+} // namespace {anonymous}
+
+int main() {
+    SyncDestroyer destroyer;
+    SimpleDeduper deduper(destroyer);
+
+    auto para = deduper.store(makeCells("h\xC3\xA9llo w\xE2\x82\xACrld"));     // 11 cells.
+    auto big  = deduper.store(makeCells(std::string(100000, 'x') + "\xC3\xA9"));
+
+    {
+        SelectionText text(deduper);
+        ENFORCE(text.isEmpty(), "");
+
+        // Consecutive rows of a paragraph are one span holding one reference.
+        text.appendPara(para, 3, 6);
+        text.appendPara(para, 6, 11);
+        text.appendNewline();
+        ENFORCE(totalRefs(deduper) == 3, "");
+
+        append(text, "ab");
+        append(text, "c");
+        text.appendNewline();
+        text.appendNewline();
+        text.appendPara(para, 0, 1);
+
+        std::string expected = "lo w\xE2\x82\xACrld\nabc\n\nh";
+        ENFORCE(text.getMinSize() <= expected.size(), "");
+
+        std::string all;
+        text.read(all);
+        ENFORCE(all == expected, "[" << all << "]");
+
+        for (size_t maxSize = 4; maxSize != 20; ++maxSize) {
+            ENFORCE(readChunks(text, maxSize) == expected, maxSize);
+        }
+    }
+
+    ENFORCE(totalRefs(deduper) == 2, "References not released.");
+
+    // A long paragraph read in chunks; sequences aren't split.
+    {
+        SelectionText text(deduper);
+        text.appendPara(big, 1, 100001);
+
+        auto all = readChunks(text, 4096);
+        ENFORCE(all == std::string(99999, 'x') + "\xC3\xA9", "");
+
+        SelectionText::Cursor cursor;
+        std::string           chunk;
+        text.read(cursor, 99999 + 1, chunk);
+        ENFORCE(chunk == std::string(99999, 'x'), "");
+    }
+
+    deduper.remove(para);
+    deduper.remove(big);
+    ENFORCE(totalRefs(deduper) == 0, "");
+
+    return 0;
+}
@@ -0,0 +1,115 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/shell_pool.hxx"
+#include "terminol/support/pipe.hxx"
+
+#include <string>
+
+#include <unistd.h>
+#include <poll.h>
+#include <sys/wait.h>
+
+namespace {
+
+// Animate until the pool has 'size' shells.
+void waitFill(Selector & selector, ShellPool & pool, size_t size) {
+    Pipe pipe;      // The selector needs something to wait on.
+
+    class Null : public I_Selector::I_ReadHandler {
+    public:
+        virtual ~Null() {}
+        void handleRead(int UNUSED(fd)) override {}
+    } null;
+
+    selector.addReadable(pipe.readFd(), &null);
+
+    for (int i = 0; i != 100 && pool.size() != size; ++i) {
+        selector.animate();
+    }
+
+    selector.removeReadable(pipe.readFd());
+}
+
+// Read from the pty until 'text' has been seen.
+bool expect(int fd, const std::string & text) {
+    std::string seen;
+
+    while (seen.find(text) == std::string::npos) {
+        struct pollfd pollFd = { fd, POLLIN, 0 };
+        if (TEMP_FAILURE_RETRY(::poll(&pollFd, 1, 5000)) != 1) { return false; }
+
+        char buf[256];
+        auto rval = TEMP_FAILURE_RETRY(::read(fd, buf, sizeof buf));
+        if (rval <= 0) { return false; }
+        seen.append(buf, rval);
+    }
+
+    return true;
+}
+
+void finish(pid_t pid, int fd) {
+    TEMP_FAILURE_RETRY(::close(fd));
+    TEMP_FAILURE_RETRY(::waitpid(pid, nullptr, 0));
+}
+
+} // namespace {anonymous}
+
+int main() {
+    Config   config;
+    Selector selector;
+
+    // Shells that run until hung up.
+    {
+        ShellPool pool(selector, config, Tty::Command{ "/bin/cat" }, 2);
+        ENFORCE(pool.size() == 0, "Filled later.");
+
+        waitFill(selector, pool, 2);
+        ENFORCE(pool.size() == 2, "");
+
+        pid_t pid;
+        int   fd;
+        ENFORCE(pool.take(pid, fd), "");
+        ENFORCE(pool.size() == 1, "");
+
+        // It's running on the pty.
+        ENFORCE(TEMP_FAILURE_RETRY(::write(fd, "hello\n", 6)) == 6, "");
+        ENFORCE(expect(fd, "hello"), "");
+        finish(pid, fd);
+
+        // Refilled after the adoption.
+        waitFill(selector, pool, 2);
+        ENFORCE(pool.size() == 2, "Refilled.");
+
+        pool.tryReap();
+        ENFORCE(pool.size() == 2, "Still running.");
+    }
+
+    // Shells that exit while pooled are dropped.
+    {
+        ShellPool pool(selector, config, Tty::Command{ "/bin/true" }, 2);
+        waitFill(selector, pool, 2);
+
+        for (int i = 0; i != 500 && pool.size() != 0; ++i) {
+            ::usleep(10000);
+            pool.tryReap();
+        }
+
+        ENFORCE(pool.size() == 0, "Exited shells dropped.");
+
+        pid_t pid;
+        int   fd;
+        ENFORCE(!pool.take(pid, fd), "");
+    }
+
+    // No pool.
+    {
+        ShellPool pool(selector, config, Tty::Command(), 0);
+
+        pid_t pid;
+        int   fd;
+        ENFORCE(!pool.take(pid, fd), "");
+    }
+
+    return 0;
+}
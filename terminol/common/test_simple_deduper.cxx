@@ -0,0 +1,202 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/simple_deduper.hxx"
+#include "terminol/support/debug.hxx"
+#include "terminol/support/sync_destroyer.hxx"
+
+#include <string>
+#include <thread>
+#include <cstdlib>
+
+namespace {
+
+std::vector<Cell> makeParagraph(size_t length) {
+    const utf8::Seq seqs[] = {
+        utf8::Seq('a'),
+        utf8::Seq('z'),
+        utf8::Seq(0xC3, 0xA9),              // e acute
+        utf8::Seq(0xE2, 0x82, 0xAC),        // euro
+        utf8::Seq(0xF0, 0x9F, 0x98, 0x80)   // grinning face
+    };
+
+    std::vector<Cell> cells;
+    Style style;
+
+    for (size_t i = 0; i != length; ++i) {
+        // Runs of varying length, including ones longer than an RLE count.
+        if (std::rand() % 300 == 0) {
+            style.fg = UColor::indexed(std::rand() % 256);
+        }
+
+        cells.push_back(Cell::utf8(seqs[std::rand() % 5], style));
+    }
+
+    return cells;
+}
+
+void enforceText(const I_Deduper & deduper, I_Deduper::Tag tag,
+                 const std::vector<Cell> & expected) {
+    std::string text;
+    for (auto & cell : expected) {
+        auto seq = cell.seq;
+        text.append(reinterpret_cast<const char *>(seq.bytes), utf8::leadLength(seq.lead()));
+    }
+
+    deduper.lookupText(tag, [&](const uint8_t * bytes, size_t size) {
+        ENFORCE(std::string(reinterpret_cast<const char *>(bytes), size) == text,
+                "Text mismatch, length: " << expected.size());
+    });
+}
+
+void enforceSegments(const I_Deduper & deduper, I_Deduper::Tag tag,
+                     const std::vector<Cell> & expected, int16_t cols) {
+    uint32_t offset = 0;
+
+    for (;;) {
+        std::vector<Cell> cells;
+        bool              cont;
+        int16_t           wrap;
+
+        deduper.lookupSegment(tag, offset, cols, cells, cont, wrap);
+
+        ENFORCE(cells.size() == static_cast<size_t>(cols), "");
+        ENFORCE(offset + wrap <= expected.size(), "");
+
+        for (int16_t i = 0; i != cols; ++i) {
+            auto cell = i < wrap ? expected[offset + i] : Cell::blank();
+            ENFORCE(cells[i] == cell, "Mismatch at: " << offset + i);
+        }
+
+        offset += wrap;
+
+        if (!cont) { break; }
+    }
+
+    ENFORCE(offset == expected.size(), "Segments don't cover paragraph.");
+}
+
+} // namespace {anonymous}
+
+int main() {
+    std::srand(7);
+
+    SyncDestroyer destroyer;
+    SimpleDeduper deduper(destroyer);
+
+    for (size_t length : { 0, 1, 79, 80, 127, 128, 129, 1000, 40000, 100000 }) {
+        auto cells = makeParagraph(length);
+        auto tag   = deduper.store(cells);
+
+        ENFORCE(deduper.lookupLength(tag) == length, "");
+
+        std::vector<Cell> all;
+        deduper.lookup(tag, all);
+        ENFORCE(all == cells, "Lookup mismatch, length: " << length);
+
+        enforceSegments(deduper, tag, cells, 80);
+        enforceSegments(deduper, tag, cells, 133);
+        enforceText(deduper, tag, cells);
+
+        // Storing the same paragraph again must share the entry.
+        ENFORCE(deduper.store(cells) == tag, "");
+        deduper.remove(tag);
+        deduper.remove(tag);
+    }
+
+    // Store enough to span many arena chunks then release most of it,
+    // triggering compaction. The survivors must be unaffected.
+    std::vector<std::pair<I_Deduper::Tag, std::vector<Cell>>> survivors;
+
+    for (int i = 0; i != 20000; ++i) {
+        auto cells = makeParagraph(std::rand() % 400);
+        auto tag   = deduper.store(cells);
+
+        if (i % 20 == 0) {
+            survivors.push_back(std::make_pair(tag, cells));
+        }
+        else {
+            deduper.remove(tag);
+        }
+    }
+
+    for (auto & s : survivors) {
+        std::vector<Cell> cells;
+        deduper.lookup(s.first, cells);
+        ENFORCE(cells == s.second, "Survivor mismatch.");
+        enforceSegments(deduper, s.first, s.second, 80);
+        enforceText(deduper, s.first, s.second);
+        deduper.remove(s.first);
+    }
+
+    uint32_t uniqueLines, totalLines;
+    deduper.getLineStats(uniqueLines, totalLines);
+    ENFORCE(uniqueLines == 0 && totalLines == 0, "");
+
+    // The byte counts follow the references.
+    {
+        auto tag = deduper.store(makeParagraph(100));
+        size_t bytes, totalBytes;
+        deduper.getByteStats(bytes, totalBytes);
+        ENFORCE(bytes != 0 && totalBytes == bytes, "");
+        ENFORCE(deduper.lookupBytes(tag) == bytes, deduper.lookupBytes(tag));
+
+        deduper.addRef(tag);
+        auto empty = deduper.store(makeParagraph(0));
+        size_t uniqueBytes;
+        deduper.getByteStats(uniqueBytes, totalBytes);
+        ENFORCE(totalBytes - uniqueBytes == bytes, "");
+
+        deduper.remove(tag);
+        deduper.remove(tag);
+        deduper.remove(empty);
+        deduper.getByteStats(uniqueBytes, totalBytes);
+        ENFORCE(uniqueBytes == 0 && totalBytes == 0, uniqueBytes << " " << totalBytes);
+    }
+
+    // Several threads storing the same paragraphs into a sharded deduper
+    // must arrive at the same tags.
+    SimpleDeduper sharded(destroyer, 3);
+
+    std::vector<std::vector<Cell>> paragraphs;
+    for (int i = 0; i != 500; ++i) {
+        paragraphs.push_back(makeParagraph(std::rand() % 200));
+    }
+
+    const int NUM_THREADS = 4;
+    std::vector<std::vector<I_Deduper::Tag>> tags(NUM_THREADS);
+    std::vector<std::thread> threads;
+
+    for (int t = 0; t != NUM_THREADS; ++t) {
+        threads.emplace_back([&, t]() {
+                             for (auto & p : paragraphs) {
+                                 auto tag = sharded.store(p);
+                                 tags[t].push_back(tag);
+
+                                 std::vector<Cell> cells;
+                                 sharded.lookup(tag, cells);
+                                 ENFORCE(cells == p, "Sharded lookup mismatch.");
+                             }
+                             });
+    }
+
+    for (auto & thread : threads) { thread.join(); }
+
+    for (int t = 0; t != NUM_THREADS; ++t) {
+        ENFORCE(tags[t] == tags[0], "Tags differ between threads.");
+
+        if (t % 2 == 0) {
+            for (auto tag : tags[t]) { sharded.remove(tag); }
+        }
+        else {
+            // In bulk, which skips invalid tags.
+            tags[t].push_back(I_Deduper::invalidTag());
+            sharded.removeMany(tags[t]);
+        }
+    }
+
+    sharded.getLineStats(uniqueLines, totalLines);
+    ENFORCE(uniqueLines == 0 && totalLines == 0, "");
+
+    return 0;
+}
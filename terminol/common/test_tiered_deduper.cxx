@@ -0,0 +1,294 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/tiered_deduper.hxx"
+#include "terminol/common/para_codec.hxx"
+#include "terminol/support/debug.hxx"
+#include "terminol/support/sync_destroyer.hxx"
+
+#include <sstream>
+#include <string>
+#include <cstdlib>
+
+namespace {
+
+std::vector<Cell> makeParagraph(size_t length) {
+    const utf8::Seq seqs[] = {
+        utf8::Seq('a'),
+        utf8::Seq(0xC3, 0xA9),              // e acute
+        utf8::Seq(0xE2, 0x82, 0xAC)         // euro
+    };
+
+    std::vector<Cell> cells;
+    Style style;
+
+    for (size_t i = 0; i != length; ++i) {
+        if (std::rand() % 50 == 0) {
+            style.fg = UColor::indexed(std::rand() % 256);
+        }
+
+        cells.push_back(Cell::utf8(seqs[std::rand() % 3], style));
+    }
+
+    return cells;
+}
+
+void enforceText(const I_Deduper & deduper, I_Deduper::Tag tag,
+                 const std::vector<Cell> & expected) {
+    std::string text;
+    for (auto & cell : expected) {
+        auto seq = cell.seq;
+        text.append(reinterpret_cast<const char *>(seq.bytes), utf8::leadLength(seq.lead()));
+    }
+
+    deduper.lookupText(tag, [&](const uint8_t * bytes, size_t size) {
+        ENFORCE(std::string(reinterpret_cast<const char *>(bytes), size) == text,
+                "Text mismatch, length: " << expected.size());
+    });
+}
+
+void enforceParagraph(const I_Deduper & deduper, I_Deduper::Tag tag,
+                      const std::vector<Cell> & expected) {
+    std::vector<Cell> cells;
+    deduper.lookup(tag, cells);
+    ENFORCE(cells == expected, "Lookup mismatch.");
+
+    std::vector<Cell> segment;
+    bool              cont;
+    int16_t           wrap;
+    uint32_t          offset = 0;
+
+    do {
+        deduper.lookupSegment(tag, offset, 80, segment, cont, wrap);
+        for (int16_t i = 0; i != wrap; ++i) {
+            ENFORCE(segment[i] == expected[offset + i], "Segment mismatch.");
+        }
+        offset += wrap;
+    } while (cont);
+
+    ENFORCE(offset == expected.size(), "");
+
+    enforceText(deduper, tag, expected);
+}
+
+// The bytes of a tier, as dumped.
+size_t tierBytes(const TieredDeduper & deduper, const std::string & tier) {
+    std::ostringstream ost;
+    deduper.dump(ost);
+
+    auto str = ost.str();
+    auto pos = str.find(tier);
+    ENFORCE(pos != std::string::npos, "");
+    pos = str.find(", ", pos);
+
+    return std::strtoul(str.c_str() + pos + 2, nullptr, 10);
+}
+
+// The bytes of a trailing figure, as dumped, e.g. " file bytes".
+size_t dumpedBytes(const TieredDeduper & deduper, const std::string & suffix) {
+    std::ostringstream ost;
+    deduper.dump(ost);
+
+    auto str = ost.str();
+    auto pos = str.rfind(suffix);
+    ENFORCE(pos != std::string::npos, "");
+    pos = str.rfind(", ", pos);
+
+    return std::strtoul(str.c_str() + pos + 2, nullptr, 10);
+}
+
+size_t fileBytes(const TieredDeduper & deduper) {
+    return dumpedBytes(deduper, " file bytes");
+}
+
+// Store 'count' paragraphs, releasing the oldest so only 'window' remain,
+// like a history trimmed to its limit. The survivors are added to 'kept'.
+void churn(TieredDeduper                                              & deduper,
+           std::vector<std::pair<I_Deduper::Tag, std::vector<Cell>>>  & kept,
+           size_t                                                       count,
+           size_t                                                       window,
+           size_t                                                       threshold) {
+    std::vector<std::pair<I_Deduper::Tag, std::vector<Cell>>> recent;
+
+    for (size_t i = 0; i != count; ++i) {
+        auto cells = makeParagraph(std::rand() % 300);
+        auto tag   = deduper.store(cells);
+        recent.push_back(std::make_pair(tag, cells));
+
+        if (recent.size() > window) {
+            deduper.remove(recent.front().first);
+            recent.erase(recent.begin());
+        }
+
+        // Spilling keeps up, the file reusing its dead space.
+        ENFORCE(tierBytes(deduper, "hot:") <= threshold + 4096, i);
+    }
+
+    for (auto & p : recent) {
+        enforceParagraph(deduper, p.first, p.second);
+    }
+
+    kept.insert(kept.end(), recent.begin(), recent.end());
+}
+
+} // namespace {anonymous}
+
+int main() {
+    std::srand(11);
+
+    SyncDestroyer destroyer;
+
+    // A tiny threshold forces nearly everything into the spill file.
+    TieredDeduper deduper(destroyer, "/tmp", 4096, 0);
+
+    std::vector<std::pair<I_Deduper::Tag, std::vector<Cell>>> paragraphs;
+
+    for (int i = 0; i != 5000; ++i) {
+        auto cells = makeParagraph(std::rand() % 300);
+        auto tag   = deduper.store(cells);
+        paragraphs.push_back(std::make_pair(tag, cells));
+    }
+
+    for (auto & p : paragraphs) {
+        enforceParagraph(deduper, p.first, p.second);
+    }
+
+    // Storing duplicates of cold paragraphs brings them back into memory.
+    for (size_t i = 0; i < paragraphs.size(); i += 7) {
+        auto & p = paragraphs[i];
+        ENFORCE(deduper.store(p.second) == p.first, "Tag mismatch.");
+        enforceParagraph(deduper, p.first, p.second);
+        deduper.remove(p.first);
+    }
+
+    // Both tiers are counted.
+    size_t uniqueBytes, totalBytes, expected = 0;
+    for (auto & p : paragraphs) {
+        std::vector<uint8_t> bytes;
+        para::encode(p.second, bytes);
+        expected += bytes.size();
+    }
+    deduper.getByteStats(uniqueBytes, totalBytes);
+    ENFORCE(totalBytes == expected && uniqueBytes <= totalBytes, "");
+
+    // Remove the hot and cold paragraphs together.
+    std::vector<I_Deduper::Tag> tags;
+    for (auto & p : paragraphs) {
+        enforceParagraph(deduper, p.first, p.second);
+        tags.push_back(p.first);
+    }
+    deduper.removeMany(tags);
+
+    uint32_t uniqueLines, totalLines;
+    deduper.getLineStats(uniqueLines, totalLines);
+    ENFORCE(uniqueLines == 0 && totalLines == 0, "");
+    deduper.getByteStats(uniqueBytes, totalBytes);
+    ENFORCE(uniqueBytes == 0 && totalBytes == 0, "");
+
+    std::ostringstream ost;
+    deduper.dump(ost);
+    ENFORCE(ost.str().find("cold: 0 entries, 0 bytes, 0 file bytes") != std::string::npos,
+            "Spill file not reset.");
+
+    const size_t MiB = 1024 * 1024;
+
+    // History trimmed oldest first recycles the file's segments, so it
+    // stays within its limit however much passes through it.
+    {
+        TieredDeduper                                             limited(destroyer, "/tmp",
+                                                                          4096, 4 * MiB);
+        std::vector<std::pair<I_Deduper::Tag, std::vector<Cell>>> kept;
+
+        churn(limited, kept, 30000, 2000, 4096);
+        ENFORCE(fileBytes(limited) <= 4 * MiB, fileBytes(limited));
+
+        for (auto & p : kept) { limited.remove(p.first); }
+    }
+
+    // Survivors scattered through the file are compacted, so their
+    // segments are recycled too.
+    {
+        TieredDeduper                                             limited(destroyer, "/tmp",
+                                                                          4096, 4 * MiB);
+        std::vector<std::pair<I_Deduper::Tag, std::vector<Cell>>> kept;
+
+        std::vector<std::pair<I_Deduper::Tag, std::vector<Cell>>> all;
+        for (int i = 0; i != 8000; ++i) {
+            auto cells = makeParagraph(std::rand() % 300);
+            all.push_back(std::make_pair(limited.store(cells), cells));
+        }
+        for (size_t i = 0; i != all.size(); ++i) {
+            if (i % 20 == 0) { kept.push_back(all[i]); }
+            else             { limited.remove(all[i].first); }
+        }
+
+        churn(limited, kept, 20000, 2000, 4096);
+        ENFORCE(fileBytes(limited) <= 4 * MiB, fileBytes(limited));
+
+        for (auto & p : kept) {
+            enforceParagraph(limited, p.first, p.second);
+            limited.remove(p.first);
+        }
+    }
+
+    // Beyond the limit, history stays in memory.
+    {
+        TieredDeduper                                             limited(destroyer, "/tmp",
+                                                                          4096, 1 * MiB);
+        std::vector<std::pair<I_Deduper::Tag, std::vector<Cell>>> kept;
+
+        for (int i = 0; i != 10000; ++i) {
+            auto cells = makeParagraph(std::rand() % 300);
+            kept.push_back(std::make_pair(limited.store(cells), cells));
+        }
+
+        ENFORCE(fileBytes(limited) == 1 * MiB, fileBytes(limited));
+        ENFORCE(tierBytes(limited, "hot:") > 1 * MiB, "");
+
+        for (auto & p : kept) {
+            enforceParagraph(limited, p.first, p.second);
+            limited.remove(p.first);
+        }
+    }
+
+    // The in-memory tier's arena is compacted as paragraphs are removed.
+    {
+        TieredDeduper                                             hot(destroyer, "/tmp",
+                                                                      64 * MiB, 0);
+        std::vector<std::pair<I_Deduper::Tag, std::vector<Cell>>> all, kept;
+
+        for (int i = 0; i != 40000; ++i) {
+            auto cells = makeParagraph(std::rand() % 300);
+            all.push_back(std::make_pair(hot.store(cells), cells));
+        }
+
+        auto mapped = dumpedBytes(hot, " arena bytes");
+
+        for (size_t i = 0; i != all.size(); ++i) {
+            if (i % 20 == 0) { kept.push_back(all[i]); }
+            else             { hot.remove(all[i].first); }
+        }
+
+        ENFORCE(dumpedBytes(hot, " arena bytes") < mapped / 2,
+                dumpedBytes(hot, " arena bytes") << " " << mapped);
+
+        for (auto & p : kept) {
+            enforceParagraph(hot, p.first, p.second);
+            hot.remove(p.first);
+        }
+    }
+
+    // A paragraph larger than a segment has segments of its own.
+    {
+        TieredDeduper limited(destroyer, "/tmp", 4096, 8 * MiB);
+        auto          cells = makeParagraph(2 * MiB);
+        auto          tag   = limited.store(cells);
+        auto          other = limited.store(makeParagraph(10000));   // Spills the first.
+        ENFORCE(tierBytes(limited, "cold:") > 2 * MiB, "");
+        enforceParagraph(limited, tag, cells);
+        limited.remove(tag);
+        limited.remove(other);
+    }
+
+    return 0;
+}
@@ -5,6 +5,8 @@
 #include "terminol/support/debug.hxx"
 #include "terminol/support/conv.hxx"
 
+#include <cstdlib>
+
 //const uint8_t B0 = 1 << 0;
 const uint8_t B1 = 1 << 1;
 const uint8_t B2 = 1 << 2;
@@ -87,6 +89,93 @@ void forwardReverse(CodePoint cp) {
     ENFORCE(cp == cp2, cp << " = " << cp2);
 }
 
+// Check decodeRun() against a Machine fed the same bytes: the run must be
+// exactly the sequences the Machine accepts and it must stop only where the
+// Machine would reject or ignore a byte, see a control character, or run
+// out of data part way through a sequence.
+void checkDecodeRun(const std::vector<uint8_t> & data) {
+    std::vector<Seq> seqs;
+    auto consumed = decodeRun(data.data(), data.size(), seqs);
+    ENFORCE(consumed <= data.size(), "");
+
+    Machine machine;
+    size_t  count = 0;
+
+    for (size_t i = 0; i != consumed; ++i) {
+        auto state = machine.consume(data[i]);
+        ENFORCE(state != Machine::State::REJECT && state != Machine::State::START, i);
+
+        if (state == Machine::State::ACCEPT) {
+            ENFORCE(count < seqs.size(), "");
+            ENFORCE(machine.seq() == seqs[count], i);
+            ENFORCE(machine.length() == leadLength(seqs[count].lead()), i);
+            ENFORCE(machine.seq().lead() >= 0x20, i);
+            ++count;
+        }
+    }
+
+    ENFORCE(count == seqs.size(), count << " " << seqs.size());
+    ENFORCE(machine.idle(), "");
+
+    if (consumed != data.size()) {
+        for (auto i = consumed; i != data.size(); ++i) {
+            auto state = machine.consume(data[i]);
+
+            if (state == Machine::State::ACCEPT) {
+                ENFORCE(machine.seq().lead() < 0x20, consumed);
+                break;
+            }
+            else if (state == Machine::State::REJECT || state == Machine::State::START) {
+                break;
+            }
+        }
+    }
+}
+
+void testDecodeRun() {
+    // Fragments biased towards valid text, plus broken and control bytes.
+    const char * fragments[] = {
+        "a", "Z", " ", "~", "\x7F",
+        "\xC3\xA9", "\xDF\xBF",                       // 2 bytes
+        "\xE2\x94\x80", "\xE4\xB8\xAD", "\xEF\xBF\xBD",   // 3 bytes
+        "\xF0\x9F\x98\x80", "\xF4\x8F\xBF\xBF",           // 4 bytes
+        "\n", "\x1B", "\x00",                          // controls
+        "\xC0", "\xC1", "\xF8", "\xFF", "\x80", "\xBF",   // rejected or ignored
+        "\xC3", "\xE2\x94", "\xF0\x9F\x98",             // truncated
+    };
+    const size_t count = sizeof fragments / sizeof fragments[0];
+
+    srand(1);
+
+    for (int n = 0; n != 20000; ++n) {
+        std::vector<uint8_t> data;
+        auto pieces = rand() % 60;
+        auto broken = rand() % 4 == 0;
+
+        for (int p = 0; p != pieces; ++p) {
+            // Mostly valid fragments, so runs get long enough to vectorise.
+            auto index = broken ? rand() % count : rand() % 12;
+            auto str   = fragments[index];
+            auto len   = std::max<size_t>(1, strlen(str));
+            data.insert(data.end(), str, str + len);
+        }
+
+        checkDecodeRun(data);
+
+        // Also every suffix, to vary alignment and block boundaries.
+        for (size_t offset = 1; offset < std::min<size_t>(data.size(), 20); ++offset) {
+            checkDecodeRun(std::vector<uint8_t>(data.begin() + offset, data.end()));
+        }
+    }
+
+    // Purely random bytes.
+    for (int n = 0; n != 20000; ++n) {
+        std::vector<uint8_t> data(rand() % 80);
+        for (auto & byte : data) { byte = rand() % 256; }
+        checkDecodeRun(data);
+    }
+}
+
 int main() {
     try {
         ENFORCE(leadLength(B1) == Length::L1, "");
@@ -116,6 +205,22 @@ int main() {
         // 4 byte sequence
         forwardReverse(0x038250);
         forwardReverse(0x10FFFF);
+
+        // Widths, including range boundaries.
+        ENFORCE(width('a')     == Width::NARROW, "");
+        ENFORCE(width(0x1F)    == Width::AMBIGUOUS, "");
+        ENFORCE(width(0xE9)    == Width::NARROW, "");       // e acute
+        ENFORCE(width(0x0301)  == Width::ZERO, "");         // combining acute
+        ENFORCE(width(0x2500)  == Width::NARROW, "");       // box drawing
+        ENFORCE(width(0x259F)  == Width::NARROW, "");
+        ENFORCE(width(0x25A0)  == Width::AMBIGUOUS, "");
+        ENFORCE(width(0x4E2D)  == Width::WIDE, "");         // CJK
+        ENFORCE(width(0xE0B0)  == Width::NARROW, "");       // Powerline
+        ENFORCE(width(0xE0B4)  == Width::AMBIGUOUS, "");
+        ENFORCE(width(0x1F600) == Width::WIDE, "");         // emoji
+        ENFORCE(width(0x10FFFF) == Width::AMBIGUOUS, "");
+
+        testDecodeRun();
     }
     catch (const utf8::Error & error) {
         FATAL("Failed");
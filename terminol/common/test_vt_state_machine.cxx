@@ -0,0 +1,101 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/vt_state_machine.hxx"
+#include "terminol/support/debug.hxx"
+
+#include <string>
+#include <vector>
+
+namespace {
+
+// Records the CSI sequences dispatched, and the characters printed.
+class Observer : public VtStateMachine::I_Observer {
+public:
+    std::vector<std::vector<int32_t>> csis;
+    std::vector<uint8_t>              modes;
+    size_t                            simples = 0;
+    std::string                       normal;
+
+    virtual ~Observer() {}
+
+    void machineNormal(utf8::Seq seq, utf8::Length UNUSED(length)) override {
+        normal.push_back(seq.bytes[0]);
+    }
+
+    void machineControl(uint8_t UNUSED(control)) override {}
+
+    void machineSimpleEsc(const SimpleEsc & UNUSED(esc)) override { ++simples; }
+
+    void machineCsiEsc(const CsiEsc & esc) override {
+        csis.emplace_back(esc.args.begin(), esc.args.end());
+        modes.push_back(esc.mode);
+    }
+
+    void machineDcsEsc(const DcsEsc & UNUSED(esc)) override {}
+    void machineOscEsc(const OscEsc & UNUSED(esc)) override {}
+};
+
+void consume(VtStateMachine & machine, const std::string & str) {
+    for (auto c : str) {
+        machine.consume(utf8::Seq(c), utf8::Length::L1);
+    }
+}
+
+std::string csiArgs(size_t count) {
+    std::string str = "\x1B[";
+    for (size_t i = 0; i != count; ++i) { str += "1;"; }
+    return str + "m";
+}
+
+} // namespace {anonymous}
+
+int main() {
+    Config config;
+
+    // Arguments, defaulted and not.
+    {
+        Observer       observer;
+        VtStateMachine machine(observer, config);
+
+        consume(machine, "\x1B[12;34H\x1B[;5H\x1B[m");
+        ENFORCE(observer.csis.size() == 3, "");
+        ENFORCE(observer.csis[0] == std::vector<int32_t>({ 12, 34 }), "");
+        ENFORCE(observer.modes[0] == 'H', "");
+        ENFORCE(observer.csis[2].empty() && observer.modes[2] == 'm', "");
+    }
+
+    // As many arguments as fit.
+    {
+        Observer       observer;
+        VtStateMachine machine(observer, config);
+
+        consume(machine, csiArgs(CsiEsc::Args::CAPACITY));
+        ENFORCE(observer.csis.size() == 1, "");
+        ENFORCE(observer.csis[0] == std::vector<int32_t>(CsiEsc::Args::CAPACITY, 1), "");
+    }
+
+    // Too many, in which case the sequence is ignored, and those that follow
+    // are parsed afresh.
+    {
+        Observer       observer;
+        VtStateMachine machine(observer, config);
+
+        consume(machine, csiArgs(40) + "a" + csiArgs(CsiEsc::Args::CAPACITY + 1) + "\x1B[7;8H");
+        ENFORCE(observer.csis.size() == 1, observer.csis.size());
+        ENFORCE(observer.csis[0] == std::vector<int32_t>({ 7, 8 }), "");
+        ENFORCE(observer.normal == "a", observer.normal);
+    }
+
+    // Likewise too many intermediates.
+    {
+        Observer       observer;
+        VtStateMachine machine(observer, config);
+
+        consume(machine, "\x1B[1       q\x1B       (B\x1B(B");
+        ENFORCE(observer.csis.empty(), "");
+        ENFORCE(observer.simples == 1, observer.simples);
+    }
+
+    return 0;
+}
@@ -0,0 +1,365 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/common/tiered_deduper.hxx"
+#include "terminol/common/para_codec.hxx"
+#include "terminol/support/hash.hxx"
+
+#include <algorithm>
+#include <iostream>
+#include <cstring>
+
+// Compacts the arena when destroyed (on the destroyer's thread).
+class TieredDeduper::Compactor : public I_Destroyer::Garbage {
+    TieredDeduper & _deduper;
+
+public:
+    explicit Compactor(TieredDeduper & deduper) : _deduper(deduper) {}
+
+    ~Compactor() override {
+        _deduper.compactArena();
+    }
+};
+
+TieredDeduper::TieredDeduper(I_Destroyer & destroyer, const std::string & dir,
+                             size_t threshold, size_t limit) throw (SpillFile::Error) :
+    _destroyer(destroyer),
+    _entries(invalidTag()),
+    _arena(),
+    _file(dir, limit),
+    _clock(),
+    _threshold(threshold),
+    _hotEntries(0),
+    _hotBytes(0),
+    _coldEntries(0),
+    _full(false),
+    _totalRefs(0),
+    _uniqueBytes(0),
+    _totalBytes(0),
+    _compacting(false),
+    _mutex() {}
+
+TieredDeduper::~TieredDeduper() {}
+
+auto TieredDeduper::store(const std::vector<Cell> & cells) -> Tag {
+    std::vector<uint8_t> bytes;
+    para::encode(cells, bytes);
+    auto hash = hash64(bytes.data(), bytes.size());
+
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    auto tag = claimTag(hash, 1,
+                        [&](Tag t) {
+                            auto iter = _entries.find(t);
+
+                            if (iter == _entries.end()) {
+                                auto ref = _arena.allocate(t, bytes.data(), bytes.size());
+                                _entries.insert(t, Entry(cells.size(), bytes.size(), ref));
+                                _clock.push_back(t);
+                                ++_hotEntries;
+                                _hotBytes += bytes.size();
+                                _uniqueBytes += bytes.size();
+                                return true;
+                            }
+
+                            auto & entry = iter->second;
+
+                            if (bytes.size() == entry.size &&
+                                std::memcmp(bytes.data(), data(entry), bytes.size()) == 0)
+                            {
+                                ++entry.refs;
+
+                                if (entry.hot) {
+                                    entry.recent = true;
+                                }
+                                else {
+                                    promote(entry, t);
+                                }
+                                return true;
+                            }
+
+                            return false;
+                        },
+                        [&] { return static_cast<Tag>(_entries.size()) != invalidTag(); });
+
+    ++_totalRefs;
+    _totalBytes += bytes.size();
+
+    spill();
+    maybeCompactArena(lock);
+
+    return tag;
+}
+
+void TieredDeduper::lookup(Tag tag, std::vector<Cell> & cells) const {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    auto iter = _entries.find(tag);
+    ASSERT(iter != _entries.end(), "");
+
+    auto & entry = iter->second;
+    entry.recent = true;
+    para::decode(data(entry), entry.length, cells);
+}
+
+void TieredDeduper::lookupSegment(Tag tag, uint32_t offset, int16_t max_size,
+                                  std::vector<Cell> & cells, bool & cont, int16_t & wrap) const {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    auto iter = _entries.find(tag);
+    ASSERT(iter != _entries.end(), "");
+
+    auto & entry = iter->second;
+    ASSERT(offset <= entry.length, "");
+    entry.recent = true;
+    para::Decoder decoder(data(entry), offset);
+
+    cells.resize(max_size, Cell::blank());
+    wrap = std::min<uint32_t>(max_size, entry.length - offset);
+
+    decoder.read(cells.data(), wrap);
+    std::fill(cells.begin() + wrap, cells.end(), Cell::blank());
+    cont = (offset + wrap != entry.length);
+}
+
+size_t TieredDeduper::lookupLength(Tag tag) const {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    auto iter = _entries.find(tag);
+    ASSERT(iter != _entries.end(), "");
+    return iter->second.length;
+}
+
+size_t TieredDeduper::lookupBytes(Tag tag) const {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    auto iter = _entries.find(tag);
+    ASSERT(iter != _entries.end(), "");
+    return iter->second.size;
+}
+
+void TieredDeduper::lookupText(Tag tag, const TextVisitor & visit) const {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    auto iter = _entries.find(tag);
+    ASSERT(iter != _entries.end(), "");
+
+    auto & entry  = iter->second;
+    auto   bytes  = data(entry);
+    entry.recent  = true;
+    auto   offset = para::textOffset(bytes);
+    visit(bytes + offset, entry.size - offset);
+}
+
+void TieredDeduper::addRef(Tag tag) {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    ASSERT(tag != invalidTag(), "");
+    auto iter = _entries.find(tag);
+    ASSERT(iter != _entries.end(), "");
+    ++iter->second.refs;
+    ++_totalRefs;
+    _totalBytes += iter->second.size;
+}
+
+void TieredDeduper::remove(Tag tag) {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    ASSERT(tag != invalidTag(), "");
+    removeEntry(tag);
+    trimClock();
+    maybeCompactArena(lock);
+}
+
+void TieredDeduper::removeMany(const std::vector<Tag> & tags) {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    for (auto tag : tags) {
+        if (tag != invalidTag()) { removeEntry(tag); }
+    }
+
+    trimClock();
+    maybeCompactArena(lock);
+}
+
+void TieredDeduper::markStyles(std::vector<bool> & used) const {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    for (auto & pair : _entries) {
+        para::markStyles(data(pair.second), used);
+    }
+}
+
+void TieredDeduper::removeEntry(Tag tag) {
+    auto iter = _entries.find(tag);
+    ASSERT(iter != _entries.end(), "");
+    auto & entry = iter->second;
+    auto   size  = entry.size;
+
+    if (--entry.refs == 0) {
+        if (entry.hot) {
+            _arena.release(entry.ref);
+            --_hotEntries;
+            _hotBytes -= entry.size;
+        }
+        else {
+            release(entry);
+        }
+
+        _uniqueBytes -= entry.size;
+        _entries.erase(iter);
+    }
+
+    --_totalRefs;
+    _totalBytes -= size;
+}
+
+void TieredDeduper::trimClock() {
+    // Drop stale tags from the clock if they have come to dominate it.
+    if (_clock.size() > 2 * _hotEntries + 1024) {
+        std::deque<Tag> clock;
+        for (auto t : _clock) {
+            auto i = _entries.find(t);
+            if (i != _entries.end() && i->second.hot) { clock.push_back(t); }
+        }
+        std::swap(clock, _clock);
+    }
+}
+
+void TieredDeduper::getLineStats(uint32_t & uniqueLines, uint32_t & totalLines) const {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    uniqueLines = _entries.size();
+    totalLines  = _totalRefs;
+}
+
+void TieredDeduper::getByteStats(size_t & uniqueBytes, size_t & totalBytes) const {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    uniqueBytes = _uniqueBytes;
+    totalBytes  = _totalBytes;
+}
+
+void TieredDeduper::dump(std::ostream & ost) const {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    ost << "BEGIN TIERS" << std::endl
+        << "hot:  " << _hotEntries  << " entries, " << _hotBytes << " bytes, "
+        << _arena.mappedBytes() << " arena bytes" << std::endl
+        << "cold: " << _coldEntries << " entries, " << _file.liveBytes() << " bytes, "
+        << _file.size() << " file bytes" << std::endl
+        << "END TIERS" << std::endl << std::endl;
+}
+
+void TieredDeduper::promote(Entry & entry, Tag tag) {
+    ASSERT(!entry.hot, "");
+
+    entry.ref    = _arena.allocate(tag, _file.data(entry.offset), entry.size);
+    entry.hot    = true;
+    entry.recent = true;
+
+    _clock.push_back(tag);
+    ++_hotEntries;
+    _hotBytes += entry.size;
+
+    release(entry);
+}
+
+void TieredDeduper::release(Entry & entry) {
+    if (_file.release(entry.offset, entry.size)) { _full = false; }
+
+    if (--_coldEntries == 0) {
+        // Everything in the file is dead.
+        _file.reset();
+    }
+}
+
+void TieredDeduper::spill() {
+    if (_full) { return; }
+
+    bool compacted = false;
+
+    while (_hotBytes > _threshold && !_clock.empty()) {
+        auto tag = _clock.front();
+        _clock.pop_front();
+
+        auto iter = _entries.find(tag);
+        if (iter == _entries.end() || !iter->second.hot) { continue; }  // Stale.
+
+        auto & entry = iter->second;
+
+        if (entry.recent) {
+            // Second chance.
+            entry.recent = false;
+            _clock.push_back(tag);
+            continue;
+        }
+
+        uint64_t offset;
+        if (!_file.append(_arena.data(entry.ref), entry.size, offset)) {
+            _clock.push_front(tag);
+
+            if (!compacted) {
+                compacted = true;
+                if (compact()) { continue; }
+            }
+
+            WARNING("Spill file full, keeping history in memory.");
+            _full = true;
+            break;
+        }
+
+        _arena.release(entry.ref);
+        entry.hot    = false;
+        entry.offset = offset;
+
+        --_hotEntries;
+        ++_coldEntries;
+        _hotBytes -= entry.size;
+    }
+}
+
+// Bring back the cold entries of the mostly dead segments, which recycles
+// them. The entries are spilled again, compactly, in their turn. Returns
+// false if there were none.
+bool TieredDeduper::compact() {
+    size_t count = 0;
+
+    for (auto & pair : _entries) {
+        auto & entry = pair.second;
+
+        if (!entry.hot && _file.sparse(entry.offset)) {
+            promote(entry, pair.first);
+            entry.recent = false;
+            ++count;
+        }
+    }
+
+    return count != 0;
+}
+
+void TieredDeduper::maybeCompactArena(std::unique_lock<std::mutex> & lock) {
+    if (!_compacting && _arena.fragmented()) {
+        _compacting = true;
+        lock.unlock();      // The destroyer may be synchronous.
+        _destroyer.add(new Compactor(*this));
+    }
+}
+
+void TieredDeduper::compactArena() {
+    // Compact one chunk at a time to avoid starving the other threads.
+    for (;;) {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        auto more = _arena.compact([this](Tag tag, Arena::Ref ref) {
+                                   auto iter = _entries.find(tag);
+                                   ASSERT(iter != _entries.end() && iter->second.hot, "");
+                                   iter->second.ref = ref;
+                                   });
+
+        if (!more) {
+            _compacting = false;
+            break;
+        }
+    }
+}
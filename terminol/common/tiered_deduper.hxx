@@ -0,0 +1,110 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef COMMON__TIERED_DEDUPER__HXX
+#define COMMON__TIERED_DEDUPER__HXX
+
+#include "terminol/common/deduper_interface.hxx"
+#include "terminol/support/arena.hxx"
+#include "terminol/support/destroyer_interface.hxx"
+#include "terminol/support/flat_map.hxx"
+#include "terminol/support/spill_file.hxx"
+
+#include <deque>
+#include <vector>
+#include <mutex>
+
+// TieredDeduper keeps recently referenced paragraphs in memory and spills
+// cold ones to a SpillFile once the in-memory tier exceeds a threshold.
+// Paragraphs are spilled in roughly the order they were stored (oldest
+// history first), giving a sequential file layout. Which paragraphs to spill
+// is decided with the clock (second chance) algorithm: a paragraph that has
+// been looked up since it was last considered is given another lap.
+// Cold paragraphs are read in place from the file mapping. Storing a
+// duplicate of a cold paragraph brings it back into memory.
+// Should the file fill up, which it can't beyond its limit, the cold
+// paragraphs of its mostly dead segments are brought back into memory, so
+// the segments are recycled. Failing that, paragraphs stay in memory until
+// some of the file is released. As paragraphs are spilled or removed the
+// in-memory arena is compacted, in the destroyer, once it is fragmented.
+class TieredDeduper : public I_Deduper {
+    struct Entry {
+        uint32_t      refs;
+        uint32_t      length;
+        uint32_t      size;         // Encoded bytes.
+        bool          hot;
+        mutable bool  recent;       // Referenced since last considered for spilling?
+        Arena::Ref    ref;          // If hot.
+        uint64_t      offset;       // If cold.
+
+        Entry() : refs(0), length(0), size(0), hot(false), recent(false), ref(), offset(0) {}
+        Entry(uint32_t length_, uint32_t size_, Arena::Ref ref_) :
+            refs(1), length(length_), size(size_), hot(true), recent(false), ref(ref_), offset(0) {}
+    };
+
+    struct TagHash {
+        size_t operator () (Tag tag) const { return tag; }
+    };
+
+    class Compactor;
+
+    I_Destroyer                & _destroyer;        // Compaction happens in the destroyer.
+    FlatMap<Tag, Entry, TagHash> _entries;
+    Arena                        _arena;
+    SpillFile                    _file;
+    std::deque<Tag>              _clock;            // Hot tags, oldest first. May be stale.
+    size_t                       _threshold;        // Maximum hot bytes.
+    size_t                       _hotEntries;
+    size_t                       _hotBytes;
+    size_t                       _coldEntries;
+    bool                         _full;             // The file can't take more, for now.
+    size_t                       _totalRefs;
+    size_t                       _uniqueBytes;      // Encoded bytes of the entries, either tier.
+    size_t                       _totalBytes;       // As above, times their references.
+    bool                         _compacting;       // Is a Compactor pending?
+    mutable std::mutex           _mutex;
+
+public:
+    TieredDeduper(I_Destroyer & destroyer, const std::string & dir,
+                  size_t threshold, size_t limit) throw (SpillFile::Error);
+    virtual ~TieredDeduper();
+
+    // I_Deduper implementation:
+
+    Tag store(const std::vector<Cell> & cells) override;
+    void lookup(Tag tag, std::vector<Cell> & cells) const override;
+    void lookupSegment(Tag tag, uint32_t offset, int16_t maxSize,
+                       std::vector<Cell> & cells, bool & cont, int16_t & wrap) const override;
+    size_t lookupLength(Tag tag) const override;
+    size_t lookupBytes(Tag tag) const override;
+    void lookupText(Tag tag, const TextVisitor & visit) const override;
+    void addRef(Tag tag) override;
+    void remove(Tag tag) override;
+    void removeMany(const std::vector<Tag> & tags) override;
+    void markStyles(std::vector<bool> & used) const override;
+
+    void getLineStats(uint32_t & uniqueLines, uint32_t & totalLines) const override;
+    void getByteStats(size_t & uniqueBytes, size_t & totalBytes) const override;
+    void dump(std::ostream & ost) const override;
+
+protected:
+    const uint8_t * data(const Entry & entry) const {
+        return entry.hot ? _arena.data(entry.ref) : _file.data(entry.offset);
+    }
+
+    void promote(Entry & entry, Tag tag);
+    // The following must be called with _mutex locked.
+    void removeEntry(Tag tag);
+    void release(Entry & entry);
+    void trimClock();
+    void spill();
+    bool compact();
+
+    // Schedule a compaction of the arena if it is fragmented enough. 'lock'
+    // holds _mutex, and is released to schedule it.
+    void maybeCompactArena(std::unique_lock<std::mutex> & lock);
+
+    void compactArena();
+};
+
+#endif // COMMON__TIERED_DEDUPER__HXX
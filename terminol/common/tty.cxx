@@ -2,8 +2,9 @@
 // Copyright © 2013 David Bryant
 
 #include "terminol/common/tty.hxx"
-#include "terminol/support/time.hxx"
+#include "terminol/common/shell_pool.hxx"
 #include "terminol/support/sys.hxx"
+#include "terminol/support/startup_trace.hxx"
 
 #include <unistd.h>
 #include <pwd.h>
@@ -44,6 +45,32 @@ std::string nthToken(const std::string & str, size_t n) throw (ParseError) {
     return str.substr(i, j - i);
 }
 
+// Return to the selector after this many reads, even if there is more data,
+// so other fds (notably X) are serviced during bulk output.
+const int MAX_READS = 16;
+
+// Bounds of the read buffer. It doubles whenever a handleRead() fills it and
+// halves after SHRINK_AFTER consecutive handleRead()s that use less than a
+// quarter of it, so bulk output costs few syscalls and parser invocations,
+// while an idle terminal doesn't pin a large buffer.
+const size_t MIN_READ_BUFFER = 64 << 10;
+const size_t MAX_READ_BUFFER = 1 << 20;
+const int    SHRINK_AFTER    = 64;
+
+// Each handleRead() parses about TIME_BUDGET worth of output, judging from
+// the rate of earlier ones, so a pty with bulk output returns to the selector
+// promptly to let the other ptys be served. At least MIN_READ_BUDGET is read
+// so that output still progresses when parsing is slow.
+const std::chrono::microseconds TIME_BUDGET(5000);
+const size_t                    MIN_READ_BUDGET = 4 << 10;
+
+// A pty interacted with this recently is urgent and isn't held to the budget.
+const std::chrono::milliseconds INTERACTIVE(250);
+
+// Bound on input queued for a pty that isn't keeping up. A paste of this many
+// bytes can be outstanding, beyond that input is dropped.
+const size_t MAX_WRITE_QUEUE = 64 << 20;
+
 } // namespace {anonymous}
 
 Tty::Tty(I_Observer        & observer,
@@ -52,16 +79,34 @@ Tty::Tty(I_Observer        & observer,
          uint16_t            rows,
          uint16_t            cols,
          const std::string & windowId,
-         const Command     & command) throw (Error) :
+         const Command     & command,
+         const std::string & cwd,
+         ShellPool         * shellPool) throw (Error) :
     _observer(observer),
     _selector(selector),
     _config(config),
     _pid(0),
     _fd(-1),
     _dumpWrites(false),
-    _suspended(false)
+    _suspended(false),
+    _readBuffer(MIN_READ_BUFFER),
+    _readIdle(0),
+    _readBudget(MAX_READ_BUFFER),
+    _inputTime(),
+    _urgent(false),
+    _writeQueue(),
+    _writeOffset(0)
 {
-    openPty(rows, cols, windowId, command);
+    if (shellPool && shellPool->take(_pid, _fd)) {
+        // Started at the pool's size.
+        StartupTrace::instant("pooled-shell");
+        resize(rows, cols);
+        _selector.addReadable(_fd, this);
+    }
+    else {
+        openPty(rows, cols, windowId, command, cwd);
+    }
+
     ASSERT(_pid != 0, "Expected non-zero PID.");
     ASSERT(_fd != -1, "Expected valid file-descriptor.");
 }
@@ -132,34 +177,29 @@ void Tty::write(const uint8_t * data, size_t size) {
 
     ASSERT(size != 0, "");
 
-    while (size != 0) {
-        auto rval =
-            TEMP_FAILURE_RETRY(::write(_fd, static_cast<const void *>(data), size));
-
-        if (rval == -1) {
-            switch (errno) {
-                case EAGAIN:
-                    WARNING("Dropping: " << size << " bytes");
-                    goto done;
-                case EIO:
-                    // Don't close the PTY, wait for handleRead() to error.
-                    _dumpWrites = true;
-                    goto done;
-                default:
-                    FATAL("Unexpected error: " << errno << " " << ::strerror(errno));
-            }
-        }
-        else if (rval == 0) {
-            FATAL("Zero length write.");
-        }
-        else {
-            data += rval;
-            size -= rval;
+    if (queuedWrites() != 0) {
+        // Preserve ordering. This also coalesces small writes, e.g. key
+        // presses, issued while the queue drains.
+        enqueue(data, size);
+    }
+    else {
+        auto written = writeSome(data, size);
+        if (written != size && !_dumpWrites && _fd != -1) {
+            enqueue(data + written, size - written);
+            _selector.addWriteable(_fd, this);
         }
     }
+}
+
+void Tty::interact() {
+    if (_fd == -1 || _suspended) { return; }
 
-done:                   // FIXME write a utility function for read()/write()
-    ;
+    _inputTime = Clock::now();
+
+    if (!_urgent) {
+        _selector.setUrgent(_fd, true);
+        _urgent = true;
+    }
 }
 
 bool Tty::hasSubprocess() const {
@@ -185,6 +225,7 @@ void Tty::suspend() {
 
     _selector.removeReadable(_fd);
     _suspended = true;
+    _urgent    = false;         // Forgotten by the selector.
 }
 
 void Tty::resume() {
@@ -200,6 +241,13 @@ void Tty::close() {
 
     if (!_suspended) {
         _selector.removeReadable(_fd);
+        _urgent = false;
+    }
+
+    if (queuedWrites() != 0) {
+        _selector.removeWriteable(_fd);
+        _writeQueue.clear();
+        _writeOffset = 0;
     }
 
     ENFORCE_SYS(TEMP_FAILURE_RETRY(::close(_fd)) != -1, "::close() failed");
@@ -209,9 +257,24 @@ void Tty::close() {
 void Tty::openPty(uint16_t            rows,
                   uint16_t            cols,
                   const std::string & windowId,
-                  const Command     & command) throw (Error) {
+                  const Command     & command,
+                  const std::string & cwd) throw (Error) {
     ASSERT(_fd == -1, "");
 
+    spawn(_config, rows, cols, windowId, command, cwd, _pid, _fd);
+    _selector.addReadable(_fd, this);
+}
+
+void Tty::spawn(const Config      & config,
+                uint16_t            rows,
+                uint16_t            cols,
+                const std::string & windowId,
+                const Command     & command,
+                const std::string & cwd,
+                pid_t             & pid,
+                int               & fd) throw (Error) {
+    StartupTrace::Scope trace("spawn-shell");
+
     int master, slave;
     struct winsize winsize = { rows, cols, 0, 0 };
 
@@ -224,15 +287,16 @@ void Tty::openPty(uint16_t            rows,
                             TEMP_FAILURE_RETRY(::close(slave));
                             });
 
-    _pid = ::fork();
+    pid = ::fork();
 
-    if (_pid == -1) {
+    if (pid == -1) {
+        pid = 0;
         throw Error("fork() failed.");
     }
 
     guard.dismiss();
 
-    if (_pid != 0) {
+    if (pid != 0) {
         // Parent code-path.
 
         ENFORCE_SYS(TEMP_FAILURE_RETRY(::close(slave)) != -1, "");
@@ -240,10 +304,12 @@ void Tty::openPty(uint16_t            rows,
         // Set non-blocking.
         fdNonBlock(master);
 
-        // Stash the master descriptor.
-        _fd = master;
+        // Not inherited by later children, which would otherwise keep the
+        // pty open once this one is closed.
+        fdCloseExec(master);
 
-        _selector.addReadable(_fd, this);
+        // Stash the master descriptor.
+        fd = master;
     }
     else {
         // Child code-path.
@@ -265,12 +331,18 @@ void Tty::openPty(uint16_t            rows,
         ENFORCE_SYS(TEMP_FAILURE_RETRY(::close(slave)) != -1, "");
         ENFORCE_SYS(TEMP_FAILURE_RETRY(::close(master)) != -1, "");
 
-        execShell(windowId, command);
+        execShell(config, windowId, command, cwd);
     }
 }
 
-void Tty::execShell(const std::string & windowId,
-                    const Command     & command) {
+void Tty::execShell(const Config      & config,
+                    const std::string & windowId,
+                    const Command     & command,
+                    const std::string & cwd) {
+    if (!cwd.empty() && ::chdir(cwd.c_str()) == -1) {
+        WARNING("Could not change directory to: " << cwd << ", " << ::strerror(errno));
+    }
+
     ::unsetenv("COLUMNS");
     ::unsetenv("LINES");
     ::unsetenv("TERMCAP");
@@ -283,8 +355,14 @@ void Tty::execShell(const std::string & windowId,
         ::setenv("HOME",    passwd->pw_dir,   0);
     }
 
-    ::setenv("WINDOWID", windowId.c_str(), 1);
-    ::setenv("TERM", _config.termName.c_str(), 1);
+    if (windowId.empty()) {
+        ::unsetenv("WINDOWID");     // Pooled, the window is yet to exist.
+    }
+    else {
+        ::setenv("WINDOWID", windowId.c_str(), 1);
+    }
+
+    ::setenv("TERM", config.termName.c_str(), 1);
     ::setenv("XTERM_256_COLORS", "1", 1);
 
     ::signal(SIGCHLD, SIG_DFL);
@@ -356,6 +434,55 @@ int Tty::waitReap() {
     return WIFEXITED(stat) ? WEXITSTATUS(stat) : EXIT_FAILURE;
 }
 
+size_t Tty::writeSome(const uint8_t * data, size_t size) {
+    auto written = size_t(0);
+
+    while (written != size) {
+        auto rval =
+            TEMP_FAILURE_RETRY(::write(_fd, static_cast<const void *>(data + written),
+                                       size - written));
+
+        if (rval == -1) {
+            switch (errno) {
+                case EAGAIN:
+                    goto done;
+                case EIO:
+                    // Don't close the PTY, wait for handleRead() to error.
+                    _dumpWrites = true;
+                    goto done;
+                default:
+                    FATAL("Unexpected error: " << errno << " " << ::strerror(errno));
+            }
+        }
+        else if (rval == 0) {
+            FATAL("Zero length write.");
+        }
+        else {
+            written += rval;
+        }
+    }
+
+done:
+    return written;
+}
+
+void Tty::enqueue(const uint8_t * data, size_t size) {
+    auto room = MAX_WRITE_QUEUE - std::min(MAX_WRITE_QUEUE, queuedWrites());
+
+    if (size > room) {
+        WARNING("Dropping: " << size - room << " bytes");
+        size = room;
+    }
+
+    // Reclaim the written prefix before growing.
+    if (_writeOffset != 0 && _writeQueue.size() + size > _writeQueue.capacity()) {
+        _writeQueue.erase(_writeQueue.begin(), _writeQueue.begin() + _writeOffset);
+        _writeOffset = 0;
+    }
+
+    _writeQueue.insert(_writeQueue.end(), data, data + size);
+}
+
 // I_Selector::I_ReadHandler implementation:
 
 void Tty::handleRead(int fd) {
@@ -374,12 +501,74 @@ void Tty::handleRead(int fd) {
     // that we are suspended.
     if (_suspended) { return; }
 
-    Timer   timer(1000 / _config.framesPerSecond);
-    uint8_t buf[BUFSIZ];          // 8192 last time I looked.
-    auto    size = _config.syncTty ? 1 : sizeof buf;
+    if (_config.syncTty) {
+        handleReadSync();
+        return;
+    }
+
+    StartupTrace::instant("tty-read");
+
+    if (_urgent && Clock::now() - _inputTime > INTERACTIVE) {
+        _selector.setUrgent(_fd, false);
+        _urgent = false;
+    }
+
+    // Accumulate successive reads into one contiguous span so the parser is
+    // handed whole bursts rather than pieces of them. Limited by the budget
+    // unless the user is waiting on this pty.
+    auto data  = &_readBuffer.front();
+    auto cap   = _urgent ? _readBuffer.size() : std::min(_readBuffer.size(), _readBudget);
+    auto fill  = size_t(0);
+    auto reads = 0;
+    auto gone  = false;
+
+    do {
+        auto rval = TEMP_FAILURE_RETRY(::read(_fd, static_cast<void *>(data + fill), cap - fill));
+
+        if (rval == -1) {
+            switch (errno) {
+                case EAGAIN:
+                    // Our non-blocking fd has no more data.
+                    goto done;
+                case EIO:
+                    // The other end of the PTY is gone.
+                    gone = true;
+                    goto done;
+                default:
+                    FATAL("Unexpected error: " << errno << " " << ::strerror(errno));
+            }
+        }
+        else if (rval == 0) {
+            // The other end of the PTY is gone.
+            gone = true;
+            goto done;
+        }
+        else {
+            fill += rval;
+        }
+    } while (fill != cap && ++reads != MAX_READS);
+
+done:
+    if (fill != 0) {
+        auto start = Clock::now();
+        _observer.ttyData(data, fill);
+        adaptReadBudget(fill, Clock::now() - start);
+    }
+
+    if (gone) { close(); }
+
+    adaptReadBuffer(fill);
+
+    // The observer decides whether to draw now or later.
+    _observer.ttySync();
+}
+
+void Tty::handleReadSync() {
+    uint8_t byte;
+    auto    reads = 0;
 
     do {
-        auto rval = TEMP_FAILURE_RETRY(::read(_fd, static_cast<void *>(buf), size));
+        auto rval = TEMP_FAILURE_RETRY(::read(_fd, static_cast<void *>(&byte), 1));
 
         if (rval == -1) {
             switch (errno) {
@@ -400,11 +589,68 @@ void Tty::handleRead(int fd) {
             goto done;
         }
         else {
-            _observer.ttyData(buf, rval);
-            if (_config.syncTty) { _observer.ttySync(); }
+            _observer.ttyData(&byte, 1);
+            _observer.ttySync();
         }
-    } while (!timer.expired());
+    } while (++reads != MAX_READS);
 
 done:
+    // The observer decides whether to draw now or later.
     _observer.ttySync();
 }
+
+void Tty::adaptReadBuffer(size_t fill) {
+    auto cap = _readBuffer.size();
+
+    if (fill == cap) {
+        // Sustained output, try to take it in fewer, larger bites.
+        _readIdle = 0;
+        if (cap != MAX_READ_BUFFER) { _readBuffer.resize(std::min(2 * cap, MAX_READ_BUFFER)); }
+    }
+    else if (fill < cap / 4 && cap != MIN_READ_BUFFER) {
+        if (++_readIdle == SHRINK_AFTER) {
+            _readIdle = 0;
+            std::vector<uint8_t>(std::max(cap / 2, MIN_READ_BUFFER)).swap(_readBuffer);
+        }
+    }
+    else {
+        _readIdle = 0;
+    }
+}
+
+void Tty::adaptReadBudget(size_t fill, Clock::duration elapsed) {
+    // Small reads say little about the rate.
+    if (fill < MIN_READ_BUDGET || elapsed <= Clock::duration::zero()) { return; }
+
+    auto fit = static_cast<size_t>(
+        fill * (std::chrono::duration<double>(TIME_BUDGET) / elapsed));
+
+    // Weight the latest rate by 1/4.
+    auto budget = (3 * _readBudget + std::min(fit, MAX_READ_BUFFER)) / 4;
+    _readBudget = std::max(budget, MIN_READ_BUDGET);
+}
+
+// I_Selector::I_WriteHandler implementation:
+
+void Tty::handleWrite(int fd) {
+    ASSERT(_fd == fd, "");
+    ASSERT(queuedWrites() != 0, "");
+
+    _writeOffset += writeSome(&_writeQueue[_writeOffset], queuedWrites());
+
+    if (_dumpWrites) {
+        // As for handleRead(), the PTY will be closed when reading errors.
+        _writeOffset = _writeQueue.size();
+    }
+
+    if (queuedWrites() == 0) {
+        _selector.removeWriteable(_fd);
+        _writeQueue.clear();
+        _writeOffset = 0;
+
+        // Don't hold on to the memory of a large paste.
+        if (_writeQueue.capacity() > MAX_READ_BUFFER) {
+            std::vector<uint8_t>().swap(_writeQueue);
+        }
+    }
+}
@@ -10,9 +10,13 @@
 
 #include <vector>
 #include <string>
+#include <chrono>
+
+class ShellPool;
 
 class Tty :
     protected I_Selector::I_ReadHandler,
+    protected I_Selector::I_WriteHandler,
     protected Uncopyable
 {
 public:
@@ -27,6 +31,8 @@ public:
     };
 
 private:
+    typedef std::chrono::steady_clock Clock;
+
     I_Observer           & _observer;
     I_Selector           & _selector;
     const Config         & _config;
@@ -34,6 +40,13 @@ private:
     int                    _fd;
     bool                   _dumpWrites;
     bool                   _suspended;
+    std::vector<uint8_t>   _readBuffer;     // Sized adaptively, see handleRead().
+    int                    _readIdle;       // Consecutive under-used handleRead()s.
+    size_t                 _readBudget;     // Bytes per handleRead(), see handleRead().
+    Clock::time_point      _inputTime;      // Of the last interact().
+    bool                   _urgent;         // Interacted with recently.
+    std::vector<uint8_t>   _writeQueue;     // Pending, when the pty would block.
+    size_t                 _writeOffset;    // Already written from _writeQueue.
 
 public:
     struct Error {
@@ -43,41 +56,80 @@ public:
 
     typedef std::vector<std::string> Command;           // XXX questionable typedef
 
+    // If 'shellPool' has a shell ready then it is adopted rather than
+    // starting 'command', which the pool's shells must also be running, in
+    // the same directory. An empty 'cwd' is the current directory.
     Tty(I_Observer        & observer,
         I_Selector        & selector,
         const Config      & config,
         uint16_t            rows,
         uint16_t            cols,
         const std::string & windowId,
-        const Command     & command) throw (Error);
+        const Command     & command,
+        const std::string & cwd,
+        ShellPool         * shellPool = nullptr) throw (Error);
 
     virtual ~Tty();
 
     void tryReap();
     void killReap();
     void resize(uint16_t rows, uint16_t cols);
+    // Writes that can't complete immediately are queued and drained as the
+    // pty becomes writeable, up to a bound beyond which input is dropped.
     void write(const uint8_t * buffer, size_t size);
+    size_t queuedWrites() const { return _writeQueue.size() - _writeOffset; }
+    // The user has typed into the pty: favour its output for a while so the
+    // echo isn't held up by output from others.
+    void interact();
     bool hasSubprocess() const;
+    bool isOpen() const { return _fd != -1; }
 
     void suspend();
     void resume();
 
+    // Start 'command', or the user's shell if it is empty, on a new pty, in
+    // 'cwd' unless it is empty. 'pid' is set to the child and 'fd' to the
+    // (non-blocking) master. An empty 'windowId' leaves WINDOWID unset.
+    static void spawn(const Config      & config,
+                      uint16_t            rows,
+                      uint16_t            cols,
+                      const std::string & windowId,
+                      const Command     & command,
+                      const std::string & cwd,
+                      pid_t             & pid,
+                      int               & fd) throw (Error);
+
 protected:
     void close();
 
     void openPty(uint16_t            rows,
                  uint16_t            cols,
                  const std::string & windowId,
-                 const Command     & command) throw (Error);
-    void execShell(const std::string & windowId,
-                   const Command     & command);
+                 const Command     & command,
+                 const std::string & cwd) throw (Error);
+    static void execShell(const Config      & config,
+                          const std::string & windowId,
+                          const Command     & command,
+                          const std::string & cwd);
 
     bool pollReap(int msec, int & status);
     int  waitReap();
 
+    void handleReadSync();
+    void adaptReadBuffer(size_t fill);
+    void adaptReadBudget(size_t fill, Clock::duration elapsed);
+
+    // Write as much as possible without blocking, return the bytes written.
+    size_t writeSome(const uint8_t * data, size_t size);
+    void   enqueue(const uint8_t * data, size_t size);
+
     // I_Selector::I_ReadHandler implementation:
 
     void handleRead(int fd) override;
+
+    // I_Selector::I_WriteHandler implementation:
+
+    void handleWrite(int fd) override;
 };
 
 #endif // COMMON__TTY__H
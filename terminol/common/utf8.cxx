@@ -5,6 +5,13 @@
 #include "terminol/support/debug.hxx"
 #include "terminol/support/conv.hxx"
 
+#include <algorithm>
+#include <iterator>
+
+#if defined(__SSE2__)
+#  include <emmintrin.h>
+#endif
+
 namespace utf8 {
 
 const uint8_t B0 = 1 << 0;
@@ -187,6 +194,74 @@ bool isCont(uint8_t byte) {
     return !isLead(byte);
 }
 
+namespace {
+
+struct WidthRange {
+    CodePoint first;
+    CodePoint last;     // Inclusive.
+    Width     width;
+};
+
+// Sorted and non-overlapping. Anything not listed is AMBIGUOUS.
+const WidthRange WIDTH_RANGES[] = {
+    { 0x0020,  0x007E,  Width::NARROW },    // ASCII
+    { 0x00A0,  0x02FF,  Width::NARROW },    // Latin-1, Latin Extended, IPA
+    { 0x0300,  0x036F,  Width::ZERO },      // Combining diacriticals
+    { 0x0370,  0x0482,  Width::NARROW },    // Greek, Cyrillic
+    { 0x0483,  0x0489,  Width::ZERO },      // Cyrillic combining
+    { 0x048A,  0x052F,  Width::NARROW },    // Cyrillic (cont.)
+    { 0x1100,  0x115F,  Width::WIDE },      // Hangul Jamo
+    { 0x1E00,  0x1FFF,  Width::NARROW },    // Latin Extended Additional, Greek Extended
+    { 0x200B,  0x200F,  Width::ZERO },      // Zero-width space, joiners, marks
+    { 0x2010,  0x2027,  Width::NARROW },    // Dashes, quotes, bullets, ellipsis
+    { 0x2030,  0x205E,  Width::NARROW },    // Per-mille, primes, etc.
+    { 0x2070,  0x209F,  Width::NARROW },    // Super/subscripts
+    { 0x20A0,  0x20BF,  Width::NARROW },    // Currency symbols
+    { 0x20D0,  0x20FF,  Width::ZERO },      // Combining marks for symbols
+    { 0x2190,  0x21FF,  Width::NARROW },    // Arrows
+    { 0x2500,  0x259F,  Width::NARROW },    // Box drawing, block elements
+    { 0x2E80,  0x303E,  Width::WIDE },      // CJK radicals, punctuation
+    { 0x3041,  0x33FF,  Width::WIDE },      // Kana, CJK compatibility
+    { 0x3400,  0x4DBF,  Width::WIDE },      // CJK Extension A
+    { 0x4E00,  0x9FFF,  Width::WIDE },      // CJK Unified Ideographs
+    { 0xA000,  0xA4CF,  Width::WIDE },      // Yi
+    { 0xAC00,  0xD7A3,  Width::WIDE },      // Hangul syllables
+    { 0xE0A0,  0xE0A3,  Width::NARROW },    // Powerline symbols
+    { 0xE0B0,  0xE0B3,  Width::NARROW },    // Powerline separators
+    { 0xF900,  0xFAFF,  Width::WIDE },      // CJK compatibility ideographs
+    { 0xFE00,  0xFE0F,  Width::ZERO },      // Variation selectors
+    { 0xFE20,  0xFE2F,  Width::ZERO },      // Combining half marks
+    { 0xFE30,  0xFE4F,  Width::WIDE },      // CJK compatibility forms
+    { 0xFF00,  0xFF60,  Width::WIDE },      // Fullwidth forms
+    { 0xFFE0,  0xFFE6,  Width::WIDE },      // Fullwidth signs
+    { 0x1F300, 0x1F64F, Width::WIDE },      // Pictographs, emoticons
+    { 0x1F900, 0x1F9FF, Width::WIDE },      // Supplemental pictographs
+    { 0x20000, 0x2FFFD, Width::WIDE },      // CJK Extensions B-F
+    { 0x30000, 0x3FFFD, Width::WIDE },      // CJK Extension G
+};
+
+} // namespace {anonymous}
+
+Width width(CodePoint codePoint) {
+    if (LIKELY(codePoint >= 0x20 && codePoint < 0x7F)) {
+        return Width::NARROW;
+    }
+
+    auto begin = std::begin(WIDTH_RANGES);
+    auto end   = std::end(WIDTH_RANGES);
+    auto iter  = std::upper_bound(begin, end, codePoint,
+                                  [](CodePoint cp, const WidthRange & range) {
+                                      return cp < range.first;
+                                  });
+
+    if (iter != begin && codePoint <= (iter - 1)->last) {
+        return (iter - 1)->width;
+    }
+    else {
+        return Width::AMBIGUOUS;
+    }
+}
+
 //
 //
 //
@@ -281,4 +356,95 @@ Machine::State Machine::consume(uint8_t c) {
     return _state;
 }
 
+namespace {
+
+// The length of the sequence Machine would accept given this lead, or zero
+// if the byte is a control character or would be rejected or ignored.
+inline uint8_t runLeadLength(uint8_t lead) {
+    if      (lead <  0x20) { return 0; }
+    else if (lead <  0x80) { return 1; }
+    else if (lead <  0xC2) { return 0; }   // Continuation or overlong.
+    else if (lead <  0xE0) { return 2; }
+    else if (lead <  0xF0) { return 3; }
+    else if (lead <  0xF8) { return 4; }
+    else                   { return 0; }
+}
+
+// Decode sequences from data[begin] up to, but not beyond, data[limit], each
+// of which is known to be complete and acceptable. Returns where it stopped.
+size_t emitRun(const uint8_t * data, size_t begin, size_t limit,
+               std::vector<Seq> & seqs) {
+    auto i = begin;
+
+    while (i != limit) {
+        auto length = runLeadLength(data[i]);
+        if (i + length > limit) { break; }
+
+        Seq seq;
+        for (uint8_t j = 0; j != length; ++j) { seq.bytes[j] = data[i + j]; }
+        seqs.push_back(seq);
+
+        i += length;
+    }
+
+    return i;
+}
+
+} // namespace {anonymous}
+
+size_t decodeRun(const uint8_t * data, size_t size, std::vector<Seq> & seqs) {
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    // Classify 16 bytes at a time into bit masks, one bit per byte. Compared
+    // as signed bytes '\x80'..'\xFF' map to -128..-1. A block is clean up to
+    // the first byte that is neither a lead nor an expected continuation,
+    // or the first continuation that is missing. Sequences straddling the
+    // end of the block are picked up by the next one.
+    auto cmpRange = [](__m128i v, int8_t lo, int8_t hi) {
+        return _mm_movemask_epi8(_mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(lo - 1)),
+                                               _mm_cmplt_epi8(v, _mm_set1_epi8(hi + 1))));
+    };
+
+    while (i + 16 <= size) {
+        auto v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+
+        uint32_t ascii = _mm_movemask_epi8(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x1F)));
+        uint32_t cont  = _mm_movemask_epi8(_mm_cmplt_epi8(v, _mm_set1_epi8(-64)));  // 0x80..0xBF
+        uint32_t lead2 = cmpRange(v,  -62, -33);    // 0xC2..0xDF
+        uint32_t lead3 = cmpRange(v,  -32, -17);    // 0xE0..0xEF
+        uint32_t lead4 = cmpRange(v,  -16,  -9);    // 0xF0..0xF7
+
+        uint32_t expected =
+            (lead2 << 1) |
+            (lead3 << 1) | (lead3 << 2) |
+            (lead4 << 1) | (lead4 << 2) | (lead4 << 3);
+
+        uint32_t bad   = ~(ascii | cont | lead2 | lead3 | lead4);
+        uint32_t error = (bad | (cont ^ expected)) & 0xFFFF;
+
+        if (error == 0) {
+            i = emitRun(data, i, i + 16, seqs);
+        }
+        else {
+            return emitRun(data, i, i + __builtin_ctz(error), seqs);
+        }
+    }
+#endif
+
+    // Tail, or everything without SSE2.
+    while (i != size) {
+        auto length = runLeadLength(data[i]);
+        if (length == 0 || i + length > size) { break; }
+
+        for (uint8_t j = 1; j != length; ++j) {
+            if ((data[i + j] & 0xC0) != 0x80) { return i; }
+        }
+
+        i = emitRun(data, i, i + length, seqs);
+    }
+
+    return i;
+}
+
 } // namespace utf8
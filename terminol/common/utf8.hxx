@@ -6,6 +6,7 @@
 
 #include "terminol/support/debug.hxx"
 
+#include <vector>
 #include <cstdint>
 
 namespace utf8 {
@@ -42,6 +43,19 @@ bool      isLead(uint8_t byte);
 
 bool      isCont(uint8_t byte);
 
+// How a code point occupies its cell when drawn with a monospace font.
+// NARROW code points are known to fit a cell, so runs of them may be laid
+// out together. AMBIGUOUS covers everything whose extent depends on the
+// font (including fallback fonts), which must be drawn one per cell.
+enum class Width : uint8_t {
+    ZERO,           // Combining marks, zero-width spaces, etc.
+    NARROW,
+    WIDE,           // East Asian wide/fullwidth, emoji.
+    AMBIGUOUS
+};
+
+Width     width(CodePoint codePoint);
+
 //
 //
 //
@@ -108,9 +122,22 @@ public:
         return _seq;
     }
 
+    // True if not part way through a sequence.
+    bool idle() const {
+        return _state == State::START || _state == State::ACCEPT || _state == State::REJECT;
+    }
+
     State consume(uint8_t c);
 };
 
+// Decode complete sequences from the start of data, appending them to seqs,
+// for as long as an idle Machine would accept each of them without
+// rejecting or ignoring a byte, and stopping at the first control character
+// ('\x00'..'\x1F'). Returns the number of bytes consumed. The remainder,
+// including any sequence split at the end of data, is left to a Machine.
+// Vectorised with SSE2 where the compiler targets it.
+size_t decodeRun(const uint8_t * data, size_t size, std::vector<Seq> & seqs);
+
 } // namespace utf8
 
 #endif // COMMON__UTF8__HXX
@@ -7,524 +7,346 @@
 
 namespace {
 
-bool inRange(uint8_t c, uint8_t min, uint8_t max) {
+// The transitions follow Paul Williams' DEC compatible parser
+// (http://vt100.net/emu/dec_ansi_parser), with the table generated at
+// compile time from the rules below.
+
+typedef VtStateMachine::State State;
+
+enum class Op : uint8_t {
+    NONE,
+    PRINT,
+    EXECUTE,
+    CLEAR,                  // Start a new sequence.
+    ESC_COLLECT,
+    ESC_DISPATCH,
+    CSI_PRIV,
+    CSI_PARAM,
+    CSI_COLLECT,
+    CSI_DISPATCH,
+    OSC_PUT,
+    OSC_DISPATCH,
+    OSC_DISPATCH_CLEAR      // ESC terminates the OSC and starts a new sequence.
+};
+
+struct Transition {
+    Op    op;
+    State next;
+};
+
+constexpr bool inRange(uint8_t c, uint8_t min, uint8_t max) {
     return c >= min && c <= max;
 }
 
-} // namespace {anonymous}
+// C0 controls, excluding CAN, SUB and ESC, which are handled in every state.
+constexpr bool isExecute(uint8_t c) {
+    return inRange(c, 0x00, 0x17) || c == 0x19 || inRange(c, 0x1C, 0x1F);
+}
 
-VtStateMachine::VtStateMachine(I_Observer   & observer,
-                               const Config & config) :
-    _observer(observer),
-    _config(config),
-    _state(State::GROUND),
-    _escSeq() {}
+constexpr bool isParam(uint8_t c) {
+    return inRange(c, 0x30 /* 0 */, 0x39 /* 9 */) || c == 0x3B /* ; */;
+}
 
-void VtStateMachine::consume(utf8::Seq seq, utf8::Length length) {
-    if (length == utf8::Length::L1) {
-        auto c = seq.lead();
+constexpr bool isInter(uint8_t c) {
+    return inRange(c, 0x20 /* SPACE */, 0x2F /* / */);
+}
 
-        if (c == 0x18 /* CAN */ || c == 0x1A /* SUB */) {
-            _state = State::GROUND;
-            return;
-        }
-        else if (c == 0x1B /* ESC */) {
-            if (_state == State::OSC_STRING) {
-                processOsc(_escSeq);
-            }
-
-            _state = State::ESCAPE;
-            _escSeq.clear();
-            return;
-        }
-    }
+constexpr bool isFinal(uint8_t c) {
+    return inRange(c, 0x40 /* @ */, 0x7E /* ~ */);
+}
 
-    switch (_state) {
-        case GROUND:
-            ground(seq, length);
-            break;
-        case ESCAPE_INTERMEDIATE:
-            escapeIntermediate(seq, length);
-            break;
-        case ESCAPE:
-            escape(seq, length);
-            break;
-        case SOS_PM_APC_STRING:
-            sosPmApcString(seq, length);
-            break;
-        case CSI_ENTRY:
-            csiEntry(seq, length);
-            break;
-        case CSI_PARAM:
-            csiParam(seq, length);
-            break;
-        case CSI_IGNORE:
-            csiIgnore(seq, length);
-            break;
-        case CSI_INTERMEDIATE:
-            csiIntermediate(seq, length);
-            break;
-        case OSC_STRING:
-            oscString(seq, length);
-            break;
-        case DCS_ENTRY:
-            dcsEntry(seq, length);
-            break;
-        case DCS_PARAM:
-            dcsParam(seq, length);
-            break;
-        case DCS_IGNORE:
-            dcsIgnore(seq, length);
-            break;
-        case DCS_INTERMEDIATE:
-            dcsIntermediate(seq, length);
-            break;
-        case DCS_PASSTHROUGH:
-            dcsPassthrough(seq, length);
-            break;
-    }
+constexpr Transition to(Op op, State next) {
+    return Transition{ op, next };
 }
 
-void VtStateMachine::ground(utf8::Seq seq, utf8::Length length) {
-    if (length == utf8::Length::L1) {
-        auto c = seq.lead();
+constexpr Transition ground(uint8_t c) {
+    return isExecute(c) ? to(Op::EXECUTE, State::GROUND) :
+                          to(Op::PRINT,   State::GROUND);   // 0x20..0x7F
+}
 
-        if (inRange(c, 0x00, 0x17) || c == 0x19 || inRange(c, 0x1C, 0x1F)) {
-            processControl(c);
-        }
-        else if (inRange(c, 0x20 /* SPACE */, 0x7F /* DEL */)) {
-            if (_config.traceTty) {
-                std::cerr
-                    << CsiEsc::SGR(CsiEsc::StockSGR::FG_GREEN)
-                    << CsiEsc::SGR(CsiEsc::StockSGR::UNDERLINE)
-                    << seq
-                    << CsiEsc::SGR(CsiEsc::StockSGR::RESET_ALL);
-            }
-            _observer.machineNormal(seq, length);
-        }
-        else {
-            ERROR("Unexpected: " << seq);
-        }
-    }
-    else {
-        if (_config.traceTty) {
-            std::cerr
-                << CsiEsc::SGR(CsiEsc::StockSGR::FG_GREEN)
-                << CsiEsc::SGR(CsiEsc::StockSGR::UNDERLINE)
-                << seq
-                << CsiEsc::SGR(CsiEsc::StockSGR::RESET_ALL);
-        }
-        _observer.machineNormal(seq, length);
-    }
+constexpr Transition escape(uint8_t c) {
+    return
+        isExecute(c) ? to(Op::EXECUTE, State::ESCAPE) :
+        isInter(c)   ? to(Op::ESC_COLLECT, State::ESCAPE_INTERMEDIATE) :
+        c == 0x5B /* [ */ ? to(Op::NONE, State::CSI_ENTRY) :
+        c == 0x5D /* ] */ ? to(Op::NONE, State::OSC_STRING) :
+        c == 0x50 /* P */ ? to(Op::NONE, State::DCS_ENTRY) :
+        c == 0x58 || c == 0x5E || c == 0x5F ? to(Op::NONE, State::SOS_PM_APC_STRING) :
+        c == 0x7F /* DEL */ ? to(Op::NONE, State::ESCAPE) :
+        to(Op::ESC_DISPATCH, State::GROUND);
 }
 
-void VtStateMachine::escape(utf8::Seq seq, utf8::Length length) {
-    if (length == utf8::Length::L1) {
-        auto c = seq.lead();
+constexpr Transition escapeIntermediate(uint8_t c) {
+    return
+        isExecute(c) ? to(Op::EXECUTE, State::ESCAPE_INTERMEDIATE) :
+        isInter(c)   ? to(Op::ESC_COLLECT, State::ESCAPE_INTERMEDIATE) :
+        c == 0x7F /* DEL */ ? to(Op::NONE, State::ESCAPE_INTERMEDIATE) :
+        to(Op::ESC_DISPATCH, State::GROUND);
+}
 
-        if (inRange(c, 0x00, 0x17) || c == 0x19 || inRange(c, 0x1C, 0x1F)) {
-            processControl(c);
-        }
-        else if (inRange(c, 0x30 /* 0 */, 0x4F /* O */) ||
-                 inRange(c, 0x51 /* Q */, 0x57 /* W */) ||
-                 c == 0x59 /* Y */ || c == 0x5A /* Z */ || c == 0x5C /* \ */ ||
-                 inRange(c, 0x60 /* ` */, 0x7E /* ~ */)) {
-            _escSeq.push_back(c);
-            processEsc(_escSeq);
-            _state = State::GROUND;
-        }
-        else if (c == 0x58 || c == 0x5E || c == 0x5F) {
-            _state = State::SOS_PM_APC_STRING;
-        }
-        else if (inRange(c, 0x20 /* SPACE */, 0x2F /* / */)) {
-            // collect
-            _escSeq.push_back(c);
-            _state = State::ESCAPE_INTERMEDIATE;
-        }
-        else if (c == 0x5B /* [ */) {
-            _state = State::CSI_ENTRY;
-        }
-        else if (c == 0x5D /* ] */) {
-            _state = State::OSC_STRING;
-        }
-        else if (c == 0x50 /* P */) {
-            _state = State::DCS_ENTRY;
-        }
-        else if (c == 0x7F /* DEL */) {
-            // ignore
-        }
-        else {
-            ERROR("Unexpected: " << seq);
-        }
-    }
-    else {
-        ERROR("Unexpected UTF-8");
-        _state = State::GROUND;
-    }
+constexpr Transition sosPmApcString(uint8_t UNUSED(c)) {
+    return to(Op::NONE, State::SOS_PM_APC_STRING);
 }
 
-void VtStateMachine::escapeIntermediate(utf8::Seq seq, utf8::Length length) {
-    if (length == utf8::Length::L1) {
-        auto c = seq.lead();
+constexpr Transition csiEntry(uint8_t c) {
+    return
+        isExecute(c) ? to(Op::EXECUTE, State::CSI_ENTRY) :
+        isInter(c)   ? to(Op::CSI_COLLECT, State::CSI_INTERMEDIATE) :
+        c == 0x3A /* : */ ? to(Op::NONE, State::CSI_IGNORE) :
+        isParam(c)   ? to(Op::CSI_PARAM, State::CSI_PARAM) :
+        inRange(c, 0x3C /* < */, 0x3F /* ? */) ? to(Op::CSI_PRIV, State::CSI_PARAM) :
+        isFinal(c)   ? to(Op::CSI_DISPATCH, State::GROUND) :
+        to(Op::NONE, State::CSI_ENTRY);                       // DEL
+}
 
-        if (inRange(c, 0x00, 0x17) || c == 0x19 || inRange(c, 0x1C, 0x1F)) {
-            processControl(c);
-        }
-        else if (inRange(c, 0x30 /* 0 */, 0x7E /* ~ */)) {
-            _escSeq.push_back(c);
-            processEsc(_escSeq);
-            _state = State::GROUND;
-        }
-        else if (inRange(c, 0x20 /* SPACE */, 0x2F /* / */)) {
-            // collect
-            _escSeq.push_back(c);
-        }
-        else if (c == 0x7F /* DEL */) {
-            // ignore
-        }
-        else {
-            ERROR("Unexpected: " << seq);
-        }
-    }
-    else {
-        ERROR("Unexpected UTF-8");
-        _state = State::GROUND;
-    }
+constexpr Transition csiParam(uint8_t c) {
+    return
+        isExecute(c) ? to(Op::EXECUTE, State::CSI_PARAM) :
+        isInter(c)   ? to(Op::CSI_COLLECT, State::CSI_INTERMEDIATE) :
+        isParam(c)   ? to(Op::CSI_PARAM, State::CSI_PARAM) :
+        c == 0x3A || inRange(c, 0x3C /* < */, 0x3F /* ? */) ? to(Op::NONE, State::CSI_IGNORE) :
+        isFinal(c)   ? to(Op::CSI_DISPATCH, State::GROUND) :
+        to(Op::NONE, State::CSI_PARAM);                       // DEL
 }
 
-void VtStateMachine::sosPmApcString(utf8::Seq seq, utf8::Length length) {
-    if (length == utf8::Length::L1) {
-        auto c = seq.lead();
+constexpr Transition csiIgnore(uint8_t c) {
+    return
+        isExecute(c) ? to(Op::EXECUTE, State::CSI_IGNORE) :
+        isFinal(c)   ? to(Op::NONE, State::GROUND) :
+        to(Op::NONE, State::CSI_IGNORE);
+}
 
-        if (inRange(c, 0x00, 0x17) || c == 0x19 || inRange(c, 0x1C, 0x1F)) {
-            // ignore
-        }
-        else if (inRange(c, 0x20 /* SPACE */, 0x7F /* DEL */)) {
-            // ignore
-        }
-        else {
-            ERROR("Unexpected: " << seq);
-        }
-    }
-    else {
-        ERROR("Unexpected UTF-8");          // XXX is UTF-8 allowed here?
-        _state = State::GROUND;
-    }
+constexpr Transition csiIntermediate(uint8_t c) {
+    return
+        isExecute(c) ? to(Op::EXECUTE, State::CSI_INTERMEDIATE) :
+        isInter(c)   ? to(Op::CSI_COLLECT, State::CSI_INTERMEDIATE) :
+        inRange(c, 0x30 /* 0 */, 0x3F /* ? */) ? to(Op::NONE, State::CSI_IGNORE) :
+        isFinal(c)   ? to(Op::CSI_DISPATCH, State::GROUND) :
+        to(Op::NONE, State::CSI_INTERMEDIATE);                // DEL
 }
 
-void VtStateMachine::csiEntry(utf8::Seq seq, utf8::Length length) {
-    if (length == utf8::Length::L1) {
-        auto c = seq.lead();
+constexpr Transition oscString(uint8_t c) {
+    return
+        c == 0x07 /* BEL */ ? to(Op::OSC_DISPATCH, State::GROUND) :     // XXX parser specific
+        isExecute(c) ? to(Op::NONE, State::OSC_STRING) :
+        to(Op::OSC_PUT, State::OSC_STRING);
+}
 
-        if (inRange(c, 0x00, 0x17) || c == 0x19 || inRange(c, 0x1C, 0x1F)) {
-            processControl(c);
-        }
-        else if (inRange(c, 0x20 /* SPACE */, 0x2F /* / */)) {
-            _escSeq.push_back(c);
-            _state = State::CSI_INTERMEDIATE;
-        }
-        else if (c == 0x3A /* : */) {
-            _state = State::CSI_IGNORE;
-        }
-        else if (inRange(c, 0x30 /* 0 */, 0x39 /* 9 */) || c == 0x3B /* ; */) {
-            // param
-            _escSeq.push_back(c);
-            _state = State::CSI_PARAM;
-        }
-        else if (inRange(c, 0x3C /* < */, 0x3F /* ? */)) {
-            // collect
-            _escSeq.push_back(c);
-            _state = State::CSI_PARAM;
-        }
-        else if (inRange(c, 0x40 /* @ */, 0x7E /* ~ */)) {
-            // dispatch
-            _escSeq.push_back(c);
-            processCsi(_escSeq);
-            _state = State::GROUND;
-        }
-        else if (c == 0x7F /* DEL */) {
-            // ignore
-        }
-        else {
-            ERROR("Unexpected: " << seq);
-        }
-    }
-    else {
-        ERROR("Unexpected UTF-8");
-        _state = State::GROUND;
-    }
+// The DCS states only track the structure of the sequence: nothing is
+// dispatched yet, so nothing needs collecting.
 
+constexpr Transition dcsEntry(uint8_t c) {
+    return
+        isInter(c)   ? to(Op::NONE, State::DCS_INTERMEDIATE) :
+        c == 0x3A /* : */ ? to(Op::NONE, State::DCS_IGNORE) :
+        isParam(c) || inRange(c, 0x3C /* < */, 0x3F /* ? */) ? to(Op::NONE, State::DCS_PARAM) :
+        isFinal(c)   ? to(Op::NONE, State::DCS_PASSTHROUGH) :
+        to(Op::NONE, State::DCS_ENTRY);
 }
 
-void VtStateMachine::csiParam(utf8::Seq seq, utf8::Length length) {
-    if (length == utf8::Length::L1) {
-        auto c = seq.lead();
-
-        if (inRange(c, 0x00, 0x17) || c == 0x19 || inRange(c, 0x1C, 0x1F)) {
-            processControl(c);
-        }
-        else if (inRange(c, 0x20 /* SPACE */, 0x2F /* / */)) {
-            _escSeq.push_back(c);
-            _state = State::CSI_INTERMEDIATE;
-        }
-        else if (inRange(c, 0x30 /* 0 */, 0x39 /* 9 */) || c == 0x3B /* ; */) {
-            // param
-            _escSeq.push_back(c);
-        }
-        else if (c == 0x3A || inRange(c, 0x3C /* < */, 0x3F /* ? */)) {
-            _state = State::CSI_IGNORE;
-        }
-        else if (inRange(c, 0x40 /* @ */, 0x7E /* ~ */)) {
-            // dispatch
-            _escSeq.push_back(c);
-            processCsi(_escSeq);
-            _state = State::GROUND;
-        }
-        else if (c == 0x7F /* DEL */) {
-            // ignore
-        }
-        else {
-            ERROR("Unexpected: " << seq);
-        }
-    }
-    else {
-        ERROR("Unexpected UTF-8");
-        _state = State::GROUND;
-    }
+constexpr Transition dcsParam(uint8_t c) {
+    return
+        isInter(c)   ? to(Op::NONE, State::DCS_INTERMEDIATE) :
+        c == 0x3A || inRange(c, 0x3C /* < */, 0x3F /* ? */) ? to(Op::NONE, State::DCS_IGNORE) :
+        isFinal(c)   ? to(Op::NONE, State::DCS_PASSTHROUGH) :
+        to(Op::NONE, State::DCS_PARAM);
 }
 
-void VtStateMachine::csiIgnore(utf8::Seq seq, utf8::Length length) {
-    if (length == utf8::Length::L1) {
-        auto c = seq.lead();
+constexpr Transition dcsIgnore(uint8_t UNUSED(c)) {
+    return to(Op::NONE, State::DCS_IGNORE);
+}
 
-        if (inRange(c, 0x00, 0x17) || c == 0x19 || inRange(c, 0x1C, 0x1F)) {
-            processControl(c);
-        }
-        else if (inRange(c, 0x20 /* SPACE */, 0x3F /* ? */)) {
-            // ignore
-        }
-        else if (inRange(c, 0x40 /* @ */, 0x7E /* ~ */)) {
-            // no dispatch
-            _state = State::GROUND;
-        }
-        else if (c == 0x7F /* DEL */) {
-            // ignore
-        }
-        else {
-            ERROR("Unexpected: " << seq);
-        }
-    }
-    else {
-        ERROR("Unexpected UTF-8");
-        _state = State::GROUND;
-    }
+constexpr Transition dcsIntermediate(uint8_t c) {
+    return
+        inRange(c, 0x30 /* 0 */, 0x3F /* ? */) ? to(Op::NONE, State::DCS_IGNORE) :
+        isFinal(c)   ? to(Op::NONE, State::DCS_PASSTHROUGH) :
+        to(Op::NONE, State::DCS_INTERMEDIATE);
 }
 
-void VtStateMachine::csiIntermediate(utf8::Seq seq, utf8::Length length) {
-    if (length == utf8::Length::L1) {
-        auto c = seq.lead();
+constexpr Transition dcsPassthrough(uint8_t UNUSED(c)) {
+    return to(Op::NONE, State::DCS_PASSTHROUGH);                // TODO put
+}
 
-        if (inRange(c, 0x00, 0x17) || c == 0x19 || inRange(c, 0x1C, 0x1F)) {
-            processControl(c);
-        }
-        else if (inRange(c, 0x20 /* SPACE */, 0x2F /* / */)) {
-            // collect
-            _escSeq.push_back(c);
-        }
-        else if (inRange(c, 0x30 /* 0 */, 0x3F /* ? */)) {
-            _state = State::CSI_IGNORE;
-        }
-        else if (inRange(c, 0x40 /* @ */, 0x7E /* ~ */)) {
-            // dispatch
-            _escSeq.push_back(c);
-            processCsi(_escSeq);
-            _state = State::GROUND;
-        }
-        else if (c == 0x7F /* DEL */) {
-            // ignore
-        }
-        else {
-            ERROR("Unexpected: " << seq);
-        }
-    }
-    else {
-        ERROR("Unexpected UTF-8");
-        _state = State::GROUND;
-    }
+constexpr Transition transition(State state, uint8_t c) {
+    return
+        c == 0x18 /* CAN */ || c == 0x1A /* SUB */ ? to(Op::NONE, State::GROUND) :
+        c == 0x1B /* ESC */ ? to(state == State::OSC_STRING ?
+                                 Op::OSC_DISPATCH_CLEAR : Op::CLEAR,
+                                 State::ESCAPE) :
+        state == State::GROUND              ? ground(c) :
+        state == State::ESCAPE              ? escape(c) :
+        state == State::ESCAPE_INTERMEDIATE ? escapeIntermediate(c) :
+        state == State::SOS_PM_APC_STRING   ? sosPmApcString(c) :
+        state == State::CSI_ENTRY           ? csiEntry(c) :
+        state == State::CSI_PARAM           ? csiParam(c) :
+        state == State::CSI_IGNORE          ? csiIgnore(c) :
+        state == State::CSI_INTERMEDIATE    ? csiIntermediate(c) :
+        state == State::OSC_STRING          ? oscString(c) :
+        state == State::DCS_ENTRY           ? dcsEntry(c) :
+        state == State::DCS_PARAM           ? dcsParam(c) :
+        state == State::DCS_IGNORE          ? dcsIgnore(c) :
+        state == State::DCS_INTERMEDIATE    ? dcsIntermediate(c) :
+        dcsPassthrough(c);
 }
 
-void VtStateMachine::oscString(utf8::Seq seq, utf8::Length length) {
-    if (length == utf8::Length::L1) {
-        auto c = seq.lead();
+// Only single byte (ASCII) sequences are looked up.
+struct Row {
+    Transition transitions[0x80];
+};
 
-        if (c == 0x07 /* BEL */) {        // XXX parser specific
-            // ST (ESC \)
-            _state = State::GROUND;
-            processOsc(_escSeq);
-            return;
-        }
+template <size_t... I> struct Indices {};
 
-        if (inRange(c, 0x00, 0x17) || c == 0x19 || inRange(c, 0x1C, 0x1F)) {
-            // ignore
-        }
-        else if (inRange(c, 0x20 /* SPACE */, 0x7F /* DEL */)) {
-            // put
-            _escSeq.push_back(c);
-        }
-        else {
-            ERROR("Unexpected: " << seq);
-        }
-    }
-    else {
-        // put
-        std::copy(seq.bytes, seq.bytes + size_t(length), std::back_inserter(_escSeq));
-    }
-}
+template <size_t N, size_t... I> struct MakeIndices : MakeIndices<N - 1, N - 1, I...> {};
 
-void VtStateMachine::dcsEntry(utf8::Seq seq, utf8::Length length) {
-    if (length == utf8::Length::L1) {
-        auto c = seq.lead();
+template <size_t... I> struct MakeIndices<0, I...> {
+    typedef Indices<I...> Type;
+};
 
-        if (inRange(c, 0x00, 0x17) || c == 0x19 || inRange(c, 0x1C, 0x1F)) {
-            // ignore
-        }
-        else if (inRange(c, 0x20 /* SPACE */, 0x2F /* / */)) {
-            // collect
-            _escSeq.push_back(c);
-            _state = State::DCS_INTERMEDIATE;
-        }
-        else if (c == 0x3A) {
-            _state = State::DCS_IGNORE;
-        }
-        else if (inRange(c, 0x30 /* 0 */, 0x39 /* 9 */) || c == 0x3B /* ; */) {
-            // param
-            _escSeq.push_back(c);
-            _state = State::DCS_PARAM;
-        }
-        else if (inRange(c, 0x3C /* < */, 0x3F /* ? */)) {
-            // collect
-            _escSeq.push_back(c);
-            _state = State::DCS_PARAM;
-        }
-        else if (inRange(c, 0x40 /* @ */, 0x7E /* ~ */)) {
-            _state = State::DCS_PASSTHROUGH;
-        }
-        else if (c == 0x7F /* DEL */) {
-            // ignore
-        }
-        else {
-            ERROR("Unexpected: " << seq);
-        }
-    }
-    else {
-        ERROR("Unexpected UTF-8");
-        _state = State::GROUND;
-    }
+template <size_t... I>
+constexpr Row makeRow(State state, Indices<I...>) {
+    return Row{ { transition(state, I)... } };
 }
 
-void VtStateMachine::dcsParam(utf8::Seq seq, utf8::Length length) {
-    if (length == utf8::Length::L1) {
-        auto c = seq.lead();
-
-        if (inRange(c, 0x00, 0x17) || c == 0x19 || inRange(c, 0x1C, 0x1F)) {
-            // ignore
-        }
-        else if (inRange(c, 0x20 /* SPACE */, 0x7F /* DEL */)) {
-            // collect
-            _escSeq.push_back(c);
-            _state = State::DCS_INTERMEDIATE;
-        }
-        else if (inRange(c, 0x30 /* 0 */, 0x39 /* 9 */) || c == 0x3B /* ; */) {
-            // param
-            _escSeq.push_back(c);
-        }
-        else if (c == 0x3A || inRange(c, 0x3C /* < */, 0x3F /* ? */)) {
-            _state = State::DCS_IGNORE;
-        }
-        else if (inRange(c, 0x40 /* @ */, 0x7E /* ~ */)) {
-            _state = State::DCS_PASSTHROUGH;
-        }
-        else if (c == 0x7F /* DEL */) {
-            // ignore
-        }
-        else {
-            ERROR("Unexpected: " << seq);
-        }
-    }
-    else {
-        ERROR("Unexpected UTF-8");      // XXX is UTF-8 allowed here?
-        _state = State::GROUND;
-    }
+constexpr Row makeRow(State state) {
+    return makeRow(state, MakeIndices<0x80>::Type());
 }
 
-void VtStateMachine::dcsIgnore(utf8::Seq seq, utf8::Length length) {
-    if (length == utf8::Length::L1) {
-        auto c = seq.lead();
+constexpr Row TABLE[] = {
+    makeRow(State::GROUND),
+    makeRow(State::ESCAPE),
+    makeRow(State::ESCAPE_INTERMEDIATE),
+    makeRow(State::SOS_PM_APC_STRING),
+    makeRow(State::CSI_ENTRY),
+    makeRow(State::CSI_PARAM),
+    makeRow(State::CSI_IGNORE),
+    makeRow(State::CSI_INTERMEDIATE),
+    makeRow(State::OSC_STRING),
+    makeRow(State::DCS_ENTRY),
+    makeRow(State::DCS_PARAM),
+    makeRow(State::DCS_IGNORE),
+    makeRow(State::DCS_INTERMEDIATE),
+    makeRow(State::DCS_PASSTHROUGH)
+};
+
+static_assert(sizeof TABLE / sizeof TABLE[0] == State::DCS_PASSTHROUGH + 1, "");
+static_assert(TABLE[State::CSI_PARAM].transitions['m'].op == Op::CSI_DISPATCH, "");
+static_assert(TABLE[State::OSC_STRING].transitions[0x1B].op == Op::OSC_DISPATCH_CLEAR, "");
 
-        if (inRange(c, 0x00, 0x17) || c == 0x19 || inRange(c, 0x1C, 0x1F)) {
-            // ignore
-        }
-        else if (inRange(c, 0x20 /* SPACE */, 0x7F /* DEL */)) {
-            // ignore
-        }
-        else {
-            ERROR("Unexpected: " << seq);
+} // namespace {anonymous}
+
+VtStateMachine::VtStateMachine(I_Observer   & observer,
+                               const Config & config) :
+    _observer(observer),
+    _config(config),
+    _state(State::GROUND),
+    _simpleEsc(),
+    _csiEsc(),
+    _csiInArg(false),
+    _oscEsc(),
+    _oscNextArg(true) {}
+
+void VtStateMachine::consume(utf8::Seq seq, utf8::Length length) {
+    if (LIKELY(length == utf8::Length::L1)) {
+        auto c = seq.lead();
+        ASSERT(c < 0x80, "");
+
+        auto transition = TABLE[_state].transitions[c];
+        _state = transition.next;
+
+        switch (transition.op) {
+            case Op::NONE:
+                break;
+            case Op::PRINT:
+                processNormal(seq, length);
+                break;
+            case Op::EXECUTE:
+                processControl(c);
+                break;
+            case Op::CLEAR:
+                clear();
+                break;
+            case Op::ESC_COLLECT:
+                _simpleEsc.inters.push_back(c);
+                break;
+            case Op::ESC_DISPATCH:
+                _simpleEsc.code = c;
+                processEsc();
+                break;
+            case Op::CSI_PRIV:
+                _csiEsc.priv = c;
+                break;
+            case Op::CSI_PARAM:
+                if (c == ';') {
+                    _csiInArg = false;
+                }
+                else {
+                    if (!_csiInArg) { _csiEsc.args.push_back(0); _csiInArg = true; }
+                    // Once full, the rest are dropped and the sequence ignored.
+                    if (!_csiEsc.args.overflowed()) {
+                        _csiEsc.args.back() = 10 * _csiEsc.args.back() + c - '0';
+                    }
+                }
+                break;
+            case Op::CSI_COLLECT:
+                _csiEsc.inters.push_back(c);
+                break;
+            case Op::CSI_DISPATCH:
+                _csiEsc.mode = c;
+                processCsi();
+                break;
+            case Op::OSC_PUT:
+                putOsc(c);
+                break;
+            case Op::OSC_DISPATCH:
+                processOsc();
+                break;
+            case Op::OSC_DISPATCH_CLEAR:
+                processOsc();
+                clear();
+                break;
         }
     }
     else {
-        ERROR("Unexpected UTF-8");      // XXX is UTF-8 allowed here?
-        _state = State::GROUND;
+        switch (_state) {
+            case State::GROUND:
+                processNormal(seq, length);
+                break;
+            case State::OSC_STRING:
+                for (size_t i = 0; i != size_t(length); ++i) { putOsc(seq.bytes[i]); }
+                break;
+            default:
+                ERROR("Unexpected UTF-8");          // XXX is UTF-8 allowed in DCS/SOS?
+                _state = State::GROUND;
+                break;
+        }
     }
 }
 
-void VtStateMachine::dcsIntermediate(utf8::Seq seq, utf8::Length length) {
-    if (length == utf8::Length::L1) {
-        auto c = seq.lead();
+void VtStateMachine::clear() {
+    _simpleEsc.inters.clear();
 
-        if (inRange(c, 0x00, 0x17) || c == 0x19 || inRange(c, 0x1C, 0x1F)) {
-            // ignore
-        }
-        else if (inRange(c, 0x20 /* SPACE */, 0x2F /* / */)) {
-            // collect
-            _escSeq.push_back(c);
-        }
-        else if (inRange(c, 0x30 /* 0 */, 0x3F /* ? */)) {
-            _state = State::DCS_IGNORE;
-        }
-        else if (inRange(c, 0x40 /* @ */, 0x7E /* ~ */)) {
-            _state = State::DCS_PASSTHROUGH;
-        }
-        else if (c == 0x7F /* DEL */) {
-            // ignore
-        }
-        else {
-            ERROR("Unexpected: " << seq);
-        }
-    }
-    else {
-        ERROR("Unexpected UTF-8");      // XXX is UTF-8 allowed here?
-        _state = State::GROUND;
-    }
+    _csiEsc.priv = NUL;
+    _csiEsc.args.clear();
+    _csiEsc.inters.clear();
+    _csiEsc.mode = NUL;
+    _csiInArg    = false;
+
+    _oscEsc.clear();
+    _oscNextArg  = true;
 }
 
-void VtStateMachine::dcsPassthrough(utf8::Seq seq, utf8::Length length) {
-    if (length == utf8::Length::L1) {
-        auto c = seq.lead();
+void VtStateMachine::putOsc(uint8_t c) {
+    if (_oscNextArg) { _oscEsc.ends.push_back(_oscEsc.bytes.size()); _oscNextArg = false; }
 
-        if (inRange(c, 0x00, 0x17) || c == 0x19 || inRange(c, 0x1C, 0x1F) ||
-            inRange(c, 0x20 /* SPACE */, 0x7E /* ~ */)) {
-            // TODO put
-        }
-        else if (c == 0x7F /* DEL */) {
-            // ignore
-        }
-        else {
-            ERROR("Unexpected: " << seq);
-        }
+    if (_oscEsc.ends.overflowed()) {
+        // Drop the excess arguments.
+    }
+    else if (c == ';') {
+        _oscNextArg = true;
     }
     else {
-        ERROR("Unexpected UTF-8");      // XXX is UTF-8 allowed here?
-        _state = State::GROUND;
+        _oscEsc.bytes.push_back(c);
+        _oscEsc.ends.back() = _oscEsc.bytes.size();
     }
 }
 
@@ -532,6 +354,17 @@ void VtStateMachine::dcsPassthrough(utf8::Seq seq, utf8::Length length) {
 //
 //
 
+void VtStateMachine::processNormal(utf8::Seq seq, utf8::Length length) {
+    if (_config.traceTty) {
+        std::cerr
+            << CsiEsc::SGR(CsiEsc::StockSGR::FG_GREEN)
+            << CsiEsc::SGR(CsiEsc::StockSGR::UNDERLINE)
+            << seq
+            << CsiEsc::SGR(CsiEsc::StockSGR::RESET_ALL);
+    }
+    _observer.machineNormal(seq, length);
+}
+
 void VtStateMachine::processControl(uint8_t c) {
     if (_config.traceTty) {
         std::cerr
@@ -545,99 +378,51 @@ void VtStateMachine::processControl(uint8_t c) {
     _observer.machineControl(c);
 }
 
-void VtStateMachine::processEsc(const std::vector<uint8_t> & seq) {
-    ASSERT(!seq.empty(), "");
-
-    SimpleEsc esc;
-    esc.inters.insert(esc.inters.begin(), seq.begin(), seq.end() - 1);
-    esc.code = seq.back();
+void VtStateMachine::processEsc() {
+    if (UNLIKELY(_simpleEsc.inters.overflowed())) {
+        ERROR("Too many intermediates, ignored: " << _simpleEsc.str());
+        return;
+    }
 
     if (_config.traceTty) {
         std::cerr
             << CsiEsc::SGR(CsiEsc::StockSGR::FG_CYAN)
-            << esc.str()
+            << _simpleEsc.str()
             << CsiEsc::SGR(CsiEsc::StockSGR::RESET_ALL);
     }
-    _observer.machineSimpleEsc(esc);
+    _observer.machineSimpleEsc(_simpleEsc);
 }
 
-void VtStateMachine::processCsi(const std::vector<uint8_t> & seq) {
-    ASSERT(seq.size() >= 1, "");
-
-    size_t i = 0;
-    CsiEsc esc;
-
-    // Private:
-
-    if (inRange(seq[i], 0x3C /* < */, 0x3F /* ? */)) {
-        esc.priv = seq[i];
-        ++i;
-    }
-    else {
-        esc.priv = NUL;
-    }
-
-    // Arguments:
-
-    auto inArg = false;
-
-    while (i != seq.size()) {
-        auto c = seq[i];
-
-        if (c >= '0' && c <= '9') {
-            if (!inArg) { esc.args.push_back(0); inArg = true; }
-            esc.args.back() = 10 * esc.args.back() + c - '0';
-        }
-        else {
-            if (c != ';') { break; }
-            if (inArg) { inArg = false; }
-        }
-
-        ++i;
+void VtStateMachine::processCsi() {
+    // A truncated sequence could mean something else entirely.
+    if (UNLIKELY(_csiEsc.args.overflowed())) {
+        ERROR("Too many arguments, ignored: " << _csiEsc.str());
+        return;
     }
-
-    // Intermediates:
-
-    while (inRange(seq[i], 0x20 /* SPACE */, 0x2F /* ? */)) {
-        esc.inters.push_back(seq[i]);
-        ++i;
+    else if (UNLIKELY(_csiEsc.inters.overflowed())) {
+        ERROR("Too many intermediates, ignored: " << _csiEsc.str());
+        return;
     }
 
-    ASSERT(i == seq.size() - 1, "");
-
-    // Mode:
-
-    esc.mode = seq[i];
-
-    // Dispatch:
-
     if (_config.traceTty) {
         std::cerr
             << CsiEsc::SGR(CsiEsc::StockSGR::FG_WHITE)
-            << esc.str()
+            << _csiEsc.str()
             << CsiEsc::SGR(CsiEsc::StockSGR::RESET_ALL);
     }
-    _observer.machineCsiEsc(esc);
+    _observer.machineCsiEsc(_csiEsc);
 }
 
-void VtStateMachine::processOsc(const std::vector<uint8_t> & seq) {
-    OscEsc esc;
-
-    auto next = true;
-    for (auto c : seq) {
-        if (next) { esc.args.push_back(std::string()); next = false; }
-
-        if (c == ';') { next = true; }
-        else          { esc.args.back().push_back(c); }
+void VtStateMachine::processOsc() {
+    if (UNLIKELY(_oscEsc.ends.overflowed())) {
+        ERROR("Too many arguments, truncated: " << _oscEsc.str());
     }
 
-    // Dispatch:
-
     if (_config.traceTty) {
         std::cerr
             << CsiEsc::SGR(CsiEsc::StockSGR::FG_RED)
-            << esc.str()
+            << _oscEsc.str()
             << CsiEsc::SGR(CsiEsc::StockSGR::RESET_ALL);
     }
-    _observer.machineOscEsc(esc);
+    _observer.machineOscEsc(_oscEsc);
 }
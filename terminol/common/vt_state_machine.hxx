@@ -26,7 +26,6 @@ public:
         ~I_Observer() {}
     };
 
-private:
     enum State : uint8_t {
         GROUND,
         ESCAPE,
@@ -44,37 +43,35 @@ private:
         DCS_PASSTHROUGH
     };
 
+private:
     I_Observer           & _observer;
     const Config         & _config;
     State                  _state;
-    std::vector<uint8_t>   _escSeq;
+    // The sequence being parsed. Arguments are accumulated as the bytes
+    // arrive, reusing the storage from one sequence to the next.
+    SimpleEsc              _simpleEsc;
+    CsiEsc                 _csiEsc;
+    bool                   _csiInArg;
+    OscEsc                 _oscEsc;
+    bool                   _oscNextArg;
 
 public:
     VtStateMachine(I_Observer & observer, const Config & config);
 
     void consume(utf8::Seq seq, utf8::Length length);
 
-protected:
-    void ground(utf8::Seq seq, utf8::Length length);
-    void escapeIntermediate(utf8::Seq seq, utf8::Length length);
-    void escape(utf8::Seq seq, utf8::Length length);
-    void sosPmApcString(utf8::Seq seq, utf8::Length length);
-    void csiEntry(utf8::Seq seq, utf8::Length length);
-    void csiParam(utf8::Seq seq, utf8::Length length);
-    void csiIgnore(utf8::Seq seq, utf8::Length length);
-    void csiIntermediate(utf8::Seq seq, utf8::Length length);
-    void oscString(utf8::Seq seq, utf8::Length length);
-    void dcsEntry(utf8::Seq seq, utf8::Length length);
-    void dcsParam(utf8::Seq seq, utf8::Length length);
-    void dcsIgnore(utf8::Seq seq, utf8::Length length);
-    void dcsIntermediate(utf8::Seq seq, utf8::Length length);
-    void dcsPassthrough(utf8::Seq seq, utf8::Length length);
+    // True if printable characters will go straight to machineNormal().
+    bool inGround() const { return _state == GROUND; }
 
+protected:
+    void clear();
+    void putOsc(uint8_t c);
 
+    void processNormal(utf8::Seq seq, utf8::Length length);
     void processControl(uint8_t c);
-    void processEsc(const std::vector<uint8_t> & seq);
-    void processCsi(const std::vector<uint8_t> & seq);
-    void processOsc(const std::vector<uint8_t> & seq);
+    void processEsc();
+    void processCsi();
+    void processOsc();
 };
 
 #endif // COMMON__VT_STATE_MACHINE__H
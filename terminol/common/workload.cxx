@@ -0,0 +1,260 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+// Deterministic, seeded terminal workloads, written to stdout. Run it in
+// terminol, or record it with bench, and the same profile, seed and size
+// produce the same byte stream every time.
+
+#include "terminol/common/escape.hxx"
+#include "terminol/common/ascii.hxx"
+#include "terminol/common/utf8.hxx"
+#include "terminol/support/cmdline.hxx"
+
+#include <iostream>
+#include <sstream>
+#include <random>
+#include <thread>
+#include <chrono>
+
+#include <unistd.h>
+
+namespace {
+
+class Generator {
+    typedef std::chrono::steady_clock Clock;
+
+    std::mt19937       _engine;
+    const int          _rows;
+    const int          _cols;
+    const size_t       _limit;      // Bytes to write.
+    const size_t       _rate;       // Bytes per second, zero for unlimited.
+    size_t             _written;
+    Clock::time_point  _start;
+    std::ostringstream _ost;
+
+public:
+    Generator(uint32_t seed, int rows, int cols, size_t limit, size_t rate) :
+        _engine(seed), _rows(rows), _cols(cols), _limit(limit), _rate(rate),
+        _written(0), _start(Clock::now()), _ost() {}
+
+    typedef void (Generator::*Unit)();
+
+    // Each unit of the profile is buffered and flushed whole, so the output
+    // is cut at a unit boundary and never mid-sequence.
+    void run(Unit unit) {
+        while (_written < _limit) {
+            (this->*unit)();
+            flush();
+        }
+        std::cout << CsiEsc::SGR(CsiEsc::StockSGR::RESET_ALL) << std::flush;
+    }
+
+    // Profiles:
+
+    void log() {
+        static const char * LEVELS[] = { "DEBUG", "INFO", "INFO", "INFO", "WARN", "ERROR" };
+        auto ms = _written / 64;
+        _ost << "2015-06-01 "
+             << pad(ms / 3600000 % 24, 2) << ':' << pad(ms / 60000 % 60, 2) << ':'
+             << pad(ms / 1000 % 60, 2) << '.' << pad(ms % 1000, 3)
+             << " [" << LEVELS[random(0, STATIC_ARRAY_SIZE(LEVELS))] << "] worker-"
+             << random(0, 16) << ": ";
+        words(random(20, 100));
+        _ost << "\r\n";
+    }
+
+    void sgr24() {
+        for (int r = 0; r != _rows; ++r) {
+            _ost << CsiEsc::CUP(r + 1, 1);
+            for (int c = 0; c != _cols; ++c) {
+                _ost << "\x1B[38;2;" << random(0, 256) << ';' << random(0, 256) << ';' << random(0, 256)
+                     << ";48;2;" << random(0, 256) << ';' << random(0, 256) << ';' << random(0, 256)
+                     << 'm' << char(random(0x21, 0x7F));
+            }
+        }
+    }
+
+    void curses() {
+        // A status bar, then a body of mostly plain text with some
+        // highlighted spans, as an editor or top would redraw.
+        _ost << CsiEsc::CUP(1, 1) << CsiEsc::SGR(CsiEsc::StockSGR::INVERSE);
+        words(_cols);
+        _ost << CsiEsc::SGR(CsiEsc::StockSGR::RESET_ALL);
+
+        for (int r = 2; r <= _rows; ++r) {
+            _ost << CsiEsc::CUP(r, 1);
+            auto col = 0;
+            while (col < _cols - 10) {
+                auto span = random(1, 10);
+                if (random(0, 4) == 0) {
+                    _ost << CsiEsc::SGR(CsiEsc::StockSGR(random(int(CsiEsc::StockSGR::FG_BLACK),
+                                                                int(CsiEsc::StockSGR::FG_WHITE) + 1)));
+                    words(span);
+                    _ost << CsiEsc::SGR(CsiEsc::StockSGR::FG_DEFAULT);
+                }
+                else {
+                    words(span);
+                }
+                col += span;
+            }
+            _ost << "\x1B[K";       // EL
+        }
+    }
+
+    void scroll() {
+        auto top    = random(1, _rows);
+        auto bottom = random(top + 1, _rows + 1);
+        _ost << CsiEsc::DECSTBM(top, bottom);
+
+        for (int i = random(1, 2 * _rows); i != 0; --i) {
+            if (random(0, 8) == 0) {
+                _ost << CsiEsc::CUP(top, 1) << ESC << 'M';          // RI
+            }
+            else {
+                _ost << CsiEsc::CUP(bottom, 1) << ESC << 'D';       // IND
+            }
+            words(random(10, _cols));
+        }
+
+        _ost << CsiEsc::DECSTBM(1, _rows);
+    }
+
+    void wrap() {
+        words(_cols * random(2, 20));
+        _ost << "\r\n";
+    }
+
+    void cjk() {
+        uint8_t seq[utf8::Length::LMAX];
+        auto    col = 0;
+
+        while (col < _cols * 4) {
+            if (random(0, 10) == 0) {
+                _ost << ' ';
+                col += 1;
+            }
+            else {
+                auto length = utf8::encode(random(0x4E00, 0xA000), seq);
+                _ost.write(reinterpret_cast<const char *>(seq), size_t(length));
+                col += 2;
+            }
+        }
+        _ost << "\r\n";
+    }
+
+protected:
+    // Uniformly distributed in [min, max). The engine's output is specified
+    // by the standard, unlike std::uniform_int_distribution's, so workloads
+    // are reproducible across standard libraries.
+    uint32_t random(uint32_t min, uint32_t max) {
+        ASSERT(min < max, "");
+        return min + _engine() % (max - min);
+    }
+
+    static std::string pad(size_t value, int width) {
+        auto str = std::to_string(value);
+        return std::string(width - std::min<size_t>(width, str.size()), '0') + str;
+    }
+
+    // Approximately 'length' characters of lower case words.
+    void words(int length) {
+        for (int i = 0; i < length; ++i) {
+            _ost << (random(0, 6) == 0 ? ' ' : char('a' + random(0, 26)));
+        }
+    }
+
+    void flush() {
+        auto str = _ost.str();
+        _ost.str(std::string());
+
+        std::cout << str;
+        _written += str.size();
+
+        if (_rate != 0) {
+            std::cout << std::flush;
+            auto due = _start + std::chrono::microseconds(_written * 1000000 / _rate);
+            std::this_thread::sleep_until(due);
+        }
+    }
+};
+
+struct Profile {
+    const char      * name;
+    Generator::Unit   unit;
+    const char      * description;
+};
+
+const Profile PROFILES[] = {
+    { "log",    &Generator::log,    "timestamped log lines" },
+    { "sgr24",  &Generator::sgr24,  "full screen, 24-bit colours per cell" },
+    { "curses", &Generator::curses, "full screen redraws with a status bar" },
+    { "scroll", &Generator::scroll, "scroll region churn, DECSTBM with IND/RI" },
+    { "wrap",   &Generator::wrap,   "long lines that wrap" },
+    { "cjk",    &Generator::cjk,    "double width CJK text" },
+};
+
+std::string makeHelp(const std::string & progName) {
+    std::ostringstream ost;
+    ost << "Usage: " << progName << " [OPTION]... PROFILE" << std::endl
+        << std::endl
+        << "Profiles:" << std::endl;
+    for (auto & profile : PROFILES) {
+        ost << "  " << profile.name << std::string(8 - strlen(profile.name), ' ')
+            << profile.description << std::endl;
+    }
+    ost << std::endl
+        << "Options:" << std::endl
+        << "  --help" << std::endl
+        << "  --seed=SEED       (default 1)" << std::endl
+        << "  --size=BYTES      approximate output (default 16777216)" << std::endl
+        << "  --rate=BYTES      per second, 0 for unlimited (default 0)" << std::endl
+        << "  --rows=ROWS       (default 24)" << std::endl
+        << "  --cols=COLS       (default 80)" << std::endl
+        ;
+    return ost.str();
+}
+
+} // namespace {anonymous}
+
+int main(int argc, char * argv[]) {
+    int seed = 1;
+    int size = 16 << 20;
+    int rate = 0;
+    int rows = 24;
+    int cols = 80;
+
+    CmdLine cmdLine(makeHelp(argv[0]), "workload");
+    cmdLine.add(new IntHandler(seed), '\0', "seed");
+    cmdLine.add(new IntHandler(size), '\0', "size");
+    cmdLine.add(new IntHandler(rate), '\0', "rate");
+    cmdLine.add(new IntHandler(rows), '\0', "rows");
+    cmdLine.add(new IntHandler(cols), '\0', "cols");
+
+    try {
+        auto arguments = cmdLine.parse(argc, const_cast<const char **>(argv));
+
+        if (arguments.size() != 1) {
+            std::cerr << makeHelp(argv[0]);
+            return 1;
+        }
+
+        if (size < 0 || rate < 0 || rows < 2 || cols < 20) {
+            FATAL("Bad size, rate or geometry.");
+        }
+
+        for (auto & profile : PROFILES) {
+            if (arguments.front() == profile.name) {
+                Generator generator(seed, rows, cols, size, rate);
+                generator.run(profile.unit);
+                return 0;
+            }
+        }
+
+        FATAL("Unknown profile: " << arguments.front());
+    }
+    catch (const CmdLine::Error & error) {
+        FATAL(error.message);
+    }
+
+    return 0;
+}
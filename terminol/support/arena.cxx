@@ -0,0 +1,170 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/support/arena.hxx"
+
+#include <algorithm>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+Arena::Arena(size_t chunkSize) :
+    _chunks(),
+    _freeChunks(),
+    _current(0),
+    _chunkSize(chunkSize),
+    _liveBytes(0),
+    _mappedBytes(0)
+{
+    ASSERT(_chunkSize > HEADER_SIZE, "Chunk size too small.");
+    newChunk(0);
+}
+
+Arena::~Arena() {
+    for (uint32_t i = 0; i != _chunks.size(); ++i) {
+        if (_chunks[i].base) {
+            freeChunk(i);
+        }
+    }
+}
+
+auto Arena::allocate(Id id, const void * data, uint32_t size) -> Ref {
+    ASSERT(id != DEAD_ID, "Reserved id.");
+
+    auto total = HEADER_SIZE + size;
+
+    if (_chunks[_current].used + total > _chunks[_current].capacity) {
+        auto & current = _chunks[_current];
+
+        if (current.live == 0) {
+            // Nothing references the current chunk, don't keep it around.
+            freeChunk(_current);
+        }
+
+        _current = newChunk(total);
+    }
+
+    auto & chunk  = _chunks[_current];
+    auto   offset = chunk.used;
+    auto   ptr    = chunk.base + offset;
+
+    std::memcpy(ptr, &id, sizeof id);
+    std::memcpy(ptr + sizeof id, &size, sizeof size);
+    std::memcpy(ptr + HEADER_SIZE, data, size);
+
+    chunk.used += total;
+    chunk.live += total;
+    _liveBytes += total;
+
+    return Ref(_current, offset);
+}
+
+void Arena::release(Ref ref) {
+    ASSERT(validRef(ref), "Invalid ref.");
+
+    auto & chunk = _chunks[ref.chunk];
+    ASSERT(readId(chunk, ref.offset) != DEAD_ID, "Double release.");
+
+    auto total = HEADER_SIZE + readSize(chunk, ref.offset);
+    std::memcpy(chunk.base + ref.offset, &DEAD_ID, sizeof DEAD_ID);
+
+    ASSERT(chunk.live >= total, "");
+    chunk.live -= total;
+    _liveBytes -= total;
+
+    if (chunk.live == 0) {
+        if (ref.chunk == _current) {
+            // Rewind rather than unmap.
+            chunk.used = 0;
+        }
+        else {
+            freeChunk(ref.chunk);
+        }
+    }
+}
+
+bool Arena::fragmented() const {
+    // Worth compacting once over half the space of the chunks other than
+    // the current one is dead, and there is at least a few chunks worth of
+    // it. Then at least one of them is less than half live, as
+    // sparsestChunk() requires, so a compaction always has work to do.
+    auto & current = _chunks[_current];
+    auto   mapped  = _mappedBytes - current.capacity;
+    auto   dead    = mapped - (_liveBytes - current.live);
+    return 2 * dead > mapped && dead > 4 * _chunkSize;
+}
+
+auto Arena::readId(const Chunk & chunk, uint32_t offset) -> Id {
+    Id id;
+    std::memcpy(&id, chunk.base + offset, sizeof id);
+    return id;
+}
+
+uint32_t Arena::readSize(const Chunk & chunk, uint32_t offset) {
+    uint32_t size;
+    std::memcpy(&size, chunk.base + offset + sizeof(Id), sizeof size);
+    return size;
+}
+
+uint32_t Arena::newChunk(size_t minSize) {
+    // Oversize records get a chunk to themselves.
+    auto page     = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    auto capacity = std::max(_chunkSize, (minSize + page - 1) / page * page);
+
+    auto base = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    ENFORCE_SYS(base != MAP_FAILED, "Failed to map arena chunk.");
+
+    uint32_t index;
+
+    if (_freeChunks.empty()) {
+        index = _chunks.size();
+        _chunks.emplace_back();
+    }
+    else {
+        index = _freeChunks.back();
+        _freeChunks.pop_back();
+    }
+
+    auto & chunk   = _chunks[index];
+    chunk.base     = static_cast<uint8_t *>(base);
+    chunk.capacity = capacity;
+    chunk.used     = 0;
+    chunk.live     = 0;
+
+    _mappedBytes += capacity;
+
+    return index;
+}
+
+void Arena::freeChunk(uint32_t index) {
+    auto & chunk = _chunks[index];
+    ASSERT(chunk.base, "Chunk already freed.");
+
+    ENFORCE_SYS(::munmap(chunk.base, chunk.capacity) == 0, "Failed to unmap arena chunk.");
+    _mappedBytes -= chunk.capacity;
+
+    chunk = Chunk();
+    _freeChunks.push_back(index);
+}
+
+int Arena::sparsestChunk() const {
+    int    best     = -1;
+    size_t bestLive = 0;
+
+    for (uint32_t i = 0; i != _chunks.size(); ++i) {
+        auto & chunk = _chunks[i];
+
+        // Only bother with chunks that are less than half live, the same
+        // threshold as fragmented().
+        if (i != _current && chunk.base && 2 * chunk.live < chunk.capacity) {
+            if (best < 0 || chunk.live < bestLive) {
+                best     = i;
+                bestLive = chunk.live;
+            }
+        }
+    }
+
+    return best;
+}
@@ -0,0 +1,129 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef SUPPORT__ARENA__HXX
+#define SUPPORT__ARENA__HXX
+
+#include "terminol/support/debug.hxx"
+#include "terminol/support/pattern.hxx"
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Arena is a store for many small, variable sized, immutable records.
+// Records are packed into large chunks obtained directly from the kernel,
+// so there is no per-record malloc overhead, and a chunk is returned
+// to the kernel as soon as its last record is released.
+// Each record is tagged with an owner id. Compaction moves the surviving
+// records of sparse chunks into the current chunk, telling the owner of
+// each record its new location.
+// Arena is not thread-safe, the caller must serialise access.
+class Arena : protected Uncopyable {
+public:
+    typedef uint32_t Id;
+
+    // Reference to a record.
+    struct Ref {
+        uint32_t chunk;
+        uint32_t offset;
+
+        Ref() : chunk(0), offset(0) {}
+        Ref(uint32_t chunk_, uint32_t offset_) : chunk(chunk_), offset(offset_) {}
+    };
+
+private:
+    struct Chunk {
+        uint8_t * base;         // nullptr if the chunk has been unmapped.
+        uint32_t  capacity;
+        uint32_t  used;         // Bytes allocated (live or dead).
+        uint32_t  live;         // Bytes still referenced.
+
+        Chunk() : base(nullptr), capacity(0), used(0), live(0) {}
+    };
+
+    // Each record is preceded by its owner's id and its size.
+    static const size_t HEADER_SIZE = sizeof(Id) + sizeof(uint32_t);
+    static const Id     DEAD_ID     = static_cast<Id>(-1);
+
+    std::vector<Chunk>    _chunks;
+    std::vector<uint32_t> _freeChunks;      // Indices of unmapped chunks.
+    uint32_t              _current;         // Chunk receiving allocations.
+    size_t                _chunkSize;
+    size_t                _liveBytes;
+    size_t                _mappedBytes;
+
+public:
+    explicit Arena(size_t chunkSize = 1024 * 1024);
+    ~Arena();
+
+    // Copy 'size' bytes from 'data' into a new record owned by 'id'.
+    Ref allocate(Id id, const void * data, uint32_t size);
+
+    // Release a record. Its reference may no longer be used.
+    void release(Ref ref);
+
+    const uint8_t * data(Ref ref) const {
+        ASSERT(validRef(ref), "Invalid ref.");
+        return _chunks[ref.chunk].base + ref.offset + HEADER_SIZE;
+    }
+
+    uint32_t size(Ref ref) const {
+        ASSERT(validRef(ref), "Invalid ref.");
+        return readSize(_chunks[ref.chunk], ref.offset);
+    }
+
+    // Is the arena wasting enough space to be worth compacting?
+    bool fragmented() const;
+
+    // Compact the sparsest chunk. For each surviving record,
+    // relocate(Id id, Ref newRef) is called. Returns false if there
+    // was nothing worth compacting.
+    template <class F> bool compact(F relocate);
+
+    size_t liveBytes()   const { return _liveBytes; }
+    size_t mappedBytes() const { return _mappedBytes; }
+
+protected:
+    bool validRef(Ref ref) const {
+        return
+            ref.chunk < _chunks.size() &&
+            _chunks[ref.chunk].base &&
+            ref.offset + HEADER_SIZE <= _chunks[ref.chunk].used;
+    }
+
+    static Id readId(const Chunk & chunk, uint32_t offset);
+    static uint32_t readSize(const Chunk & chunk, uint32_t offset);
+
+    uint32_t newChunk(size_t minSize);
+    void     freeChunk(uint32_t index);
+    int      sparsestChunk() const;
+};
+
+template <class F> bool Arena::compact(F relocate) {
+    auto index = sparsestChunk();
+    if (index < 0) { return false; }
+
+    // Note, _chunks may be reallocated by allocate() so index rather
+    // than hold references to it.
+    uint32_t offset = 0;
+
+    while (_chunks[index].base && offset != _chunks[index].used) {
+        auto id     = readId(_chunks[index], offset);
+        auto size   = readSize(_chunks[index], offset);
+        auto next   = offset + HEADER_SIZE + size;
+
+        if (id != DEAD_ID) {
+            Ref oldRef(index, offset);
+            auto newRef = allocate(id, data(oldRef), size);
+            relocate(id, newRef);
+            release(oldRef);        // May unmap the chunk.
+        }
+
+        offset = next;
+    }
+
+    return true;
+}
+
+#endif // SUPPORT__ARENA__HXX
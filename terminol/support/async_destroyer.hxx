@@ -6,39 +6,162 @@
 
 #include "terminol/support/destroyer_interface.hxx"
 #include "terminol/support/pattern.hxx"
-#include "terminol/support/queue.hxx"
 
 #include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <algorithm>
 
+// AsyncDestroyer destroys garbage on a thread of its own. Adding is lock-free:
+// garbage is pushed onto an intrusive stack, and the background thread takes
+// the whole stack at once, restores the order it was added in and destroys it
+// all. The background thread is only woken when garbage is added to an empty
+// stack, so a burst of garbage costs one wake-up rather than one per item.
 class AsyncDestroyer : public I_Destroyer, private Uncopyable {
+    std::atomic<Garbage *>              _head;          // Most recently added.
+    bool                                _finalised;     // Guarded by _mutex.
+    std::mutex                          _mutex;         // Only for waking.
+    std::condition_variable             _condition;
+    std::atomic<size_t>                 _pending;       // Added, not destroyed.
+    std::atomic<size_t>                 _destroyed;
+    std::atomic<Clock::duration::rep>   _totalLatency;  // Of the destroyed.
+    std::atomic<Clock::duration::rep>   _maxLatency;
+    std::thread                         _thread;
+
 public:
-    AsyncDestroyer() : _queue(), _thread(&AsyncDestroyer::background, this) {}
+    AsyncDestroyer() :
+        _head(nullptr),
+        _finalised(false),
+        _mutex(),
+        _condition(),
+        _pending(0),
+        _destroyed(0),
+        _totalLatency(0),
+        _maxLatency(0),
+        _thread(&AsyncDestroyer::background, this) {}
 
+    // Destroys anything outstanding before returning.
     virtual ~AsyncDestroyer() {
-        _queue.finalise();
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _finalised = true;
+        }
+        _condition.notify_one();
         _thread.join();
     }
 
-    // Callable from multiple threads.
+    // Callable from multiple threads, including from destructors of garbage.
+
     void add(Garbage * garbage) override {
-        _queue.add(std::move(garbage));
+        queued(garbage) = Clock::now();
+        push(garbage, garbage, 1);
+    }
+
+    void addBatch(Batch & batch) override {
+        if (batch.empty()) { return; }
+
+        Garbage * last;
+        size_t    size;
+        auto      garbage = release(batch, last, size);
+        auto      now     = Clock::now();
+
+        // Reversed, the stack has the most recently added first.
+        Garbage * newest = nullptr;
+        auto      oldest = garbage;
+
+        while (garbage) {
+            auto following = next(garbage);
+            queued(garbage) = now;
+            next(garbage)   = newest;
+            newest          = garbage;
+            garbage         = following;
+        }
+
+        push(newest, oldest, size);
+    }
+
+    void getStats(size_t          & pending,
+                  Clock::duration & meanLatency,
+                  Clock::duration & maxLatency) const override {
+        pending = _pending;
+
+        auto destroyed = _destroyed.load();
+        meanLatency = Clock::duration(destroyed == 0 ? 0 : _totalLatency / destroyed);
+        maxLatency  = Clock::duration(_maxLatency);
     }
 
 protected:
+    // Push the chain 'first' ... 'last' (linked by next()), newest first.
+    void push(Garbage * first, Garbage * last, size_t size) {
+        _pending += size;
+
+        auto head = _head.load(std::memory_order_relaxed);
+        do {
+            next(last) = head;
+        } while (!_head.compare_exchange_weak(head, first,
+                                              std::memory_order_release,
+                                              std::memory_order_relaxed));
+
+        if (!head) {
+            // Taking the mutex ensures that the background thread is either
+            // yet to see the garbage or is already waiting for the signal.
+            { std::unique_lock<std::mutex> lock(_mutex); }
+            _condition.notify_one();
+        }
+    }
+
     void background() {
-        try {
-            for (;;) {
-                auto garbage = _queue.remove();
-                delete garbage;     // Do the heavy lifting.
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _condition.wait(lock, [this] { return _head.load() || _finalised; });
+            }
+
+            auto chain = _head.exchange(nullptr, std::memory_order_acquire);
+
+            if (chain) {
+                destroy(chain);
+            }
+            else {
+                return;     // Finalised and nothing left.
             }
-        }
-        catch (const Queue<Garbage *>::Finalised &) {
         }
     }
 
-private:
-    Queue<Garbage *> _queue;
-    std::thread      _thread;
+    void destroy(Garbage * chain) {
+        // The stack has the most recently added first.
+        Garbage * oldest = nullptr;
+        while (chain) {
+            auto garbage = chain;
+            chain = next(garbage);
+            next(garbage) = oldest;
+            oldest = garbage;
+        }
+
+        size_t          count = 0;
+        Clock::duration total = Clock::duration::zero();
+        Clock::duration worst = Clock::duration::zero();
+
+        while (oldest) {
+            auto garbage = oldest;
+            auto time    = queued(garbage);
+            oldest = next(garbage);
+
+            delete garbage;     // Do the heavy lifting.
+
+            auto latency = Clock::now() - time;
+            total += latency;
+            worst  = std::max(worst, latency);
+            ++count;
+        }
+
+        // Only this thread writes the latencies.
+        _totalLatency += total.count();
+        if (worst.count() > _maxLatency) { _maxLatency = worst.count(); }
+        _destroyed += count;
+        _pending   -= count;
+    }
 };
 
 #endif // SUPPORT__ASYNC_DESTROYER__HXX
@@ -0,0 +1,20 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/support/bench.hxx"
+
+#include <iostream>
+#include <iomanip>
+
+const double Bench::MIN_SAMPLE_NS = 20e6;
+
+void Bench::report(const std::string & name, double nsPerOp, size_t bytesPerOp) const {
+    std::cout << std::left << std::setw(40) << (_suite + "/" + name) << std::right
+              << std::fixed << std::setprecision(1)
+              << std::setw(12) << nsPerOp << " ns/op"
+              << std::setw(10) << bytesPerOp << " bytes/op";
+    if (bytesPerOp != 0) {
+        std::cout << std::setw(10) << bytesPerOp / nsPerOp * 1e9 / (1 << 20) << " MB/s";
+    }
+    std::cout << std::endl;
+}
@@ -0,0 +1,59 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef SUPPORT__BENCH__HXX
+#define SUPPORT__BENCH__HXX
+
+#include "terminol/support/pattern.hxx"
+
+#include <string>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+
+// Minimal microbenchmark harness. Each benchmark is warmed up while the
+// number of operations per sample is calibrated, then timed over several
+// samples, of which the fastest is reported as ns/op along with bytes/op,
+// the size of the input the operation processes.
+class Bench : private Uncopyable {
+    typedef std::chrono::steady_clock Clock;
+
+    std::string _suite;
+
+    static const int    SAMPLES       = 5;
+    static const double MIN_SAMPLE_NS;
+
+    void report(const std::string & name, double nsPerOp, size_t bytesPerOp) const;
+
+    template <typename Func>
+    static double time(Func & func, size_t ops) {
+        auto start = Clock::now();
+        for (size_t i = 0; i != ops; ++i) { func(); }
+        return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+    }
+
+public:
+    explicit Bench(const std::string & suite) : _suite(suite) {}
+
+    // 'func' performs one operation.
+    template <typename Func>
+    void run(const std::string & name, size_t bytesPerOp, Func && func) {
+        size_t ops = 1;
+        while (time(func, ops) < MIN_SAMPLE_NS) { ops *= 2; }
+
+        auto best = std::numeric_limits<double>::max();
+        for (int i = 0; i != SAMPLES; ++i) {
+            best = std::min(best, time(func, ops) / ops);
+        }
+
+        report(name, best, bytesPerOp);
+    }
+
+    // Stop the compiler discarding a result that is otherwise unused.
+    template <typename T>
+    static void keep(const T & t) {
+        asm volatile("" : : "g"(&t) : "memory");
+    }
+};
+
+#endif // SUPPORT__BENCH__HXX
@@ -0,0 +1,44 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/support/cache.hxx"
+#include "terminol/support/bench.hxx"
+
+#include <string>
+#include <vector>
+
+int main() {
+    Bench bench("cache");
+
+    const size_t SIZE = 1024;
+
+    // A fixed pseudo-random key order, with repeats.
+    std::vector<uint32_t> keys;
+    uint32_t              state = 1;
+    for (size_t i = 0; i != 4 * SIZE; ++i) {
+        state = state * 1103515245 + 12345;
+        keys.push_back((state >> 16) % (2 * SIZE));
+    }
+
+    Cache<uint32_t, std::string> cache;
+    size_t                       next = 0;
+
+    // Find, inserting on a miss and evicting the least recently used entry
+    // when full, as a glyph cache would be used.
+    bench.run("find-insert-evict", 0, [&] {
+        auto key  = keys[next++ % keys.size()];
+        auto iter = cache.find(key);
+        if (iter == cache.end()) {
+            if (cache.size() == SIZE) { cache.erase(cache.begin()); }
+            iter = cache.insert(key, "value");
+        }
+        Bench::keep(iter->second);
+    });
+
+    bench.run("find-hit", 0, [&] {
+        auto iter = cache.find(cache.begin()->first);
+        Bench::keep(iter->second);
+    });
+
+    return 0;
+}
@@ -0,0 +1,42 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/support/queue.hxx"
+#include "terminol/support/bench.hxx"
+
+#include <thread>
+
+int main() {
+    Bench bench("queue");
+
+    {
+        Queue<int> queue;
+
+        bench.run("add-remove", sizeof(int), [&] {
+            queue.add(1);
+            Bench::keep(queue.remove());
+        });
+    }
+
+    {
+        // A consumer thread drains what this thread adds, so the cost
+        // includes contention and wake-ups.
+        Queue<int>  queue;
+        std::thread consumer([&] {
+            try {
+                for (;;) { Bench::keep(queue.remove()); }
+            }
+            catch (const Queue<int>::Finalised &) {
+            }
+        });
+
+        bench.run("add-contended", sizeof(int), [&] {
+            queue.add(1);
+        });
+
+        queue.finalise();
+        consumer.join();
+    }
+
+    return 0;
+}
@@ -0,0 +1,55 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/support/rle.hxx"
+#include "terminol/support/bench.hxx"
+#include "terminol/support/debug.hxx"
+
+namespace {
+
+// Runs of varying length, like the styles along a row of text.
+std::vector<uint32_t> makeCorpus(size_t size) {
+    std::vector<uint32_t> items;
+    uint32_t              value = 0;
+
+    while (items.size() != size) {
+        auto run = 1 + (value * 7) % 23;
+        for (uint32_t i = 0; i != run && items.size() != size; ++i) {
+            items.push_back(value);
+        }
+        ++value;
+    }
+
+    return items;
+}
+
+} // namespace {anonymous}
+
+int main() {
+    Bench bench("rle");
+
+    auto                 items = makeCorpus(4096);
+    std::vector<uint8_t> encoded;
+    {
+        OutMemoryStream ostream(encoded, true);
+        rleEncode(items, ostream);
+    }
+
+    auto bytes = items.size() * sizeof items.front();
+
+    bench.run("encode", bytes, [&] {
+        std::vector<uint8_t> buffer;
+        OutMemoryStream      ostream(buffer, true);
+        rleEncode(items, ostream);
+        Bench::keep(buffer);
+    });
+
+    bench.run("decode", bytes, [&] {
+        std::vector<uint32_t> output;
+        InMemoryStream        istream(encoded);
+        rleDecode(istream, output);
+        Bench::keep(output);
+    });
+
+    return 0;
+}
@@ -8,10 +8,12 @@
 #include "terminol/support/pattern.hxx"
 
 #include <unordered_map>
+#include <stdexcept>
 #include <cstddef>
 
 // LRU cache container
-template <typename Key, typename T> class Cache : protected Uncopyable {
+template <typename Key, typename T, typename Hash = std::hash<Key>>
+class Cache : protected Uncopyable {
     struct Link {
         Link *prev;
         Link *next;
@@ -67,7 +69,7 @@ template <typename Key, typename T> class Cache : protected Uncopyable {
         return key;
     }
 
-    typedef std::unordered_map<Key, Entry> Map;
+    typedef std::unordered_map<Key, Entry, Hash> Map;
 
     Link _sentinel;       // next is oldest, prev is newest
     Map  _map;
@@ -235,10 +237,18 @@ public:
     iterator erase(iterator iter) {
         auto & entry = linkToEntry(*iter._link);
         Link * next  = entry.link.next;
+        Key    key   = entryToKey(entry);     // Copy, the entry is about to go.
         entry.link.extract();
+        _map.erase(key);
         return iterator(next);
     }
 
+    void clear() {
+        _map.clear();
+        _sentinel.next = &_sentinel;
+        _sentinel.prev = &_sentinel;
+    }
+
     iterator find(const Key & key) {
         auto iter = _map.find(key);
 
@@ -4,19 +4,93 @@
 #ifndef SUPPORT_DESTROYER_INTERFACE__HXX
 #define SUPPORT_DESTROYER_INTERFACE__HXX
 
+#include "terminol/support/pattern.hxx"
+
+#include <chrono>
+#include <cstddef>
+
 class I_Destroyer {
 public:
+    typedef std::chrono::steady_clock Clock;
+
+    class Batch;
+
     class Garbage {
     public:
         virtual ~Garbage() = default;       // Heavy lifting goes here.
     protected:
         Garbage() = default;
+    private:
+        friend class I_Destroyer;
+        friend class I_Destroyer::Batch;
+
+        // Intrusive, so queueing garbage doesn't allocate.
+        Garbage           * _next   = nullptr;
+        Clock::time_point   _queued = Clock::time_point();
+    };
+
+    // Garbage gathered to be added all at once, e.g. by a producer that
+    // creates a lot of it in a short time.
+    class Batch : private Uncopyable {
+        friend class I_Destroyer;
+
+        Garbage * _first = nullptr;
+        Garbage * _last  = nullptr;
+        size_t    _size  = 0;
+
+    public:
+        Batch() = default;
+        ~Batch();
+
+        bool   empty() const { return _size == 0; }
+        size_t size()  const { return _size; }
+
+        void add(Garbage * garbage) {
+            garbage->_next = nullptr;
+            if (_last) { _last->_next = garbage; }
+            else       { _first = garbage; }
+            _last = garbage;
+            ++_size;
+        }
     };
 
     virtual void add(Garbage * garbage) = 0;
 
+    // Takes everything in 'batch', leaving it empty.
+    virtual void addBatch(Batch & batch) = 0;
+
+    // Garbage added but not yet destroyed, and the average and worst time
+    // that destroyed garbage waited.
+    virtual void getStats(size_t          & pending,
+                          Clock::duration & meanLatency,
+                          Clock::duration & maxLatency) const = 0;
+
 protected:
     ~I_Destroyer() {}
+
+    // For implementations to queue garbage by its intrusive links.
+
+    static Garbage *& next(Garbage * garbage) { return garbage->_next; }
+    static Clock::time_point & queued(Garbage * garbage) { return garbage->_queued; }
+
+    // Takes the chain of garbage (linked by next()) from 'batch'.
+    static Garbage * release(Batch & batch, Garbage *& last, size_t & size) {
+        auto first = batch._first;
+        last = batch._last;
+        size = batch._size;
+        batch._first = batch._last = nullptr;
+        batch._size  = 0;
+        return first;
+    }
 };
 
+// Garbage that was never added is destroyed with the batch.
+inline I_Destroyer::Batch::~Batch() {
+    while (_first) {
+        auto garbage = _first;
+        _first = garbage->_next;
+        delete garbage;
+    }
+}
+
 #endif // SUPPORT_DESTROYER_INTERFACE__HXX
@@ -0,0 +1,144 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/support/fenwick_tree.hxx"
+
+namespace {
+
+// Don't bother reclaiming a dead prefix smaller than this.
+const size_t MIN_RECLAIM = 4096;
+
+} // namespace {anonymous}
+
+void FenwickTree::assign(size_t count, uint32_t value) {
+    _values.assign(count, value);
+    _dead  = 0;
+    _total = static_cast<uint32_t>(count * value);
+    build();
+}
+
+void FenwickTree::clear() {
+    _values.clear();
+    _tree.clear();
+    _dead  = 0;
+    _total = 0;
+}
+
+void FenwickTree::set(size_t index, uint32_t value) {
+    ASSERT(index < size(), "");
+    auto & old = _values[_dead + index];
+    // Unsigned arithmetic wraps, so a decrease is added as a large delta.
+    add(_dead + index, value - old);
+    _total += value - old;
+    old = value;
+}
+
+void FenwickTree::push_back(uint32_t value) {
+    _values.push_back(value);
+
+    // The new node covers the values (node - lowBit(node), node].
+    auto node = _values.size();
+    _tree.push_back(value + sum(node - 1) - sum(node - lowBit(node)));
+    _total += value;
+}
+
+void FenwickTree::pop_back() {
+    ASSERT(!empty(), "");
+
+    // No other node covers the last value.
+    _total -= _values.back();
+    _values.pop_back();
+    _tree.pop_back();
+
+    if (empty()) {
+        clear();
+    }
+}
+
+void FenwickTree::pop_front() {
+    ASSERT(!empty(), "");
+
+    set(0, 0);
+    ++_dead;
+
+    if (empty()) {
+        clear();
+    }
+    else if (_dead >= MIN_RECLAIM && 2 * _dead > _values.size()) {
+        _values.erase(_values.begin(), _values.begin() + _dead);
+        _dead = 0;
+        build();
+    }
+}
+
+void FenwickTree::pop_front(size_t count) {
+    ASSERT(count <= size(), "");
+
+    if (count == size()) {
+        clear();
+    }
+    else if (count * 32 < size()) {
+        for (size_t i = 0; i != count; ++i) { pop_front(); }
+    }
+    else {
+        _total -= prefix(count);
+        _values.erase(_values.begin(), _values.begin() + _dead + count);
+        _dead = 0;
+        build();
+    }
+}
+
+size_t FenwickTree::find(uint32_t offset, uint32_t & remainder) const {
+    ASSERT(offset < _total, "offset=" << offset << ", total=" << _total);
+
+    // Descend from the largest power of two, skipping whole nodes whose
+    // sum doesn't exceed the remaining offset.
+    size_t step = 1;
+    while (2 * step <= _tree.size()) { step *= 2; }
+
+    size_t node = 0;
+
+    for (; step != 0; step /= 2) {
+        if (node + step <= _tree.size() && _tree[node + step - 1] <= offset) {
+            node   += step;
+            offset -= _tree[node - 1];
+        }
+    }
+
+    // 'node' values precede the one containing the offset.
+    ASSERT(node >= _dead && node < _values.size(), "");
+    remainder = offset;
+    return node - _dead;
+}
+
+void FenwickTree::shrink_to_fit() {
+    _values.shrink_to_fit();
+    _tree.shrink_to_fit();
+}
+
+uint32_t FenwickTree::sum(size_t nodes) const {
+    uint32_t result = 0;
+
+    for (; nodes != 0; nodes -= lowBit(nodes)) {
+        result += _tree[nodes - 1];
+    }
+
+    return result;
+}
+
+void FenwickTree::add(size_t index, uint32_t delta) {
+    for (auto node = index + 1; node <= _tree.size(); node += lowBit(node)) {
+        _tree[node - 1] += delta;
+    }
+}
+
+void FenwickTree::build() {
+    _tree = _values;
+
+    for (size_t node = 1; node <= _tree.size(); ++node) {
+        auto parent = node + lowBit(node);
+        if (parent <= _tree.size()) {
+            _tree[parent - 1] += _tree[node - 1];
+        }
+    }
+}
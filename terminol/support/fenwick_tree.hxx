@@ -0,0 +1,76 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef SUPPORT__FENWICK_TREE__HXX
+#define SUPPORT__FENWICK_TREE__HXX
+
+#include "terminol/support/debug.hxx"
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// FenwickTree is a sequence of counts that also maintains their prefix sums
+// (a binary indexed tree). Setting a count, summing a prefix, and finding the
+// element containing a given offset into the running total are all O(log n).
+// Elements may be pushed/popped at the back and popped at the front, so it
+// can shadow a deque. Popped front elements are zeroed and reclaimed in bulk
+// once they make up half of the storage.
+class FenwickTree {
+    std::vector<uint32_t> _values;      // Includes the _dead (zeroed) prefix.
+    std::vector<uint32_t> _tree;        // _tree[i - 1] is the 1-based node i.
+    size_t                _dead;        // Leading elements removed by pop_front().
+    uint32_t              _total;
+
+public:
+    FenwickTree() : _values(), _tree(), _dead(0), _total(0) {}
+
+    size_t   size()  const { return _values.size() - _dead; }
+    bool     empty() const { return size() == 0; }
+    uint32_t total() const { return _total; }
+    size_t   bytes() const {
+        return (_values.capacity() + _tree.capacity()) * sizeof(uint32_t);
+    }
+
+    uint32_t get(size_t index) const {
+        ASSERT(index < size(), "");
+        return _values[_dead + index];
+    }
+
+    uint32_t front() const { return get(0); }
+    uint32_t back()  const { return get(size() - 1); }
+
+    // Replace the contents with 'count' copies of 'value'. O(n).
+    void assign(size_t count, uint32_t value);
+
+    void clear();
+    void set(size_t index, uint32_t value);
+    void push_back(uint32_t value);
+    void pop_back();
+    void pop_front();
+    // Pop the first 'count' elements, rebuilding the tree if that's cheaper
+    // than popping them one at a time.
+    void pop_front(size_t count);
+
+    // Sum of the first 'count' elements.
+    uint32_t prefix(size_t count) const {
+        ASSERT(count <= size(), "");
+        return sum(_dead + count);
+    }
+
+    // Find the element that contains 'offset', i.e. the index such that
+    // prefix(index) <= offset < prefix(index + 1). Zero elements never
+    // contain an offset. 'remainder' is set to offset - prefix(index).
+    size_t find(uint32_t offset, uint32_t & remainder) const;
+
+    void shrink_to_fit();
+
+protected:
+    static size_t lowBit(size_t node) { return node & (~node + 1); }
+
+    uint32_t sum(size_t nodes) const;
+    void     add(size_t index, uint32_t delta);
+    void     build();
+};
+
+#endif // SUPPORT__FENWICK_TREE__HXX
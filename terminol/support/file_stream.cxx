@@ -0,0 +1,123 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/support/file_stream.hxx"
+#include "terminol/support/debug.hxx"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cstdio>
+
+namespace {
+
+const size_t BUFFER_SIZE = 64 * 1024;
+
+} // namespace {anonymous}
+
+OutFileStream::OutFileStream(const std::string & path) throw (StreamError) :
+    _path(path),
+    _tmpPath(path + ".tmp"),
+    _fd(-1),
+    _buffer()
+{
+    _fd = TEMP_FAILURE_RETRY(::open(_tmpPath.c_str(),
+                                    O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600));
+    if (_fd == -1) { throw StreamError(); }
+
+    _buffer.reserve(BUFFER_SIZE);
+}
+
+OutFileStream::~OutFileStream() {
+    if (_fd != -1) {
+        // Not committed.
+        ENFORCE_SYS(::close(_fd) != -1, "");
+        ::unlink(_tmpPath.c_str());
+    }
+}
+
+void OutFileStream::writeAll(const void * data,
+                             size_t       item_size,
+                             size_t       num_items) throw (StreamError) {
+    ASSERT(_fd != -1, "Already committed.");
+
+    auto ptr  = static_cast<const uint8_t *>(data);
+    auto size = item_size * num_items;
+
+    if (_buffer.size() + size > BUFFER_SIZE) {
+        flush();
+    }
+
+    if (size > BUFFER_SIZE) {
+        _buffer.assign(ptr, ptr + size);
+        flush();
+    }
+    else {
+        _buffer.insert(_buffer.end(), ptr, ptr + size);
+    }
+}
+
+void OutFileStream::commit() throw (StreamError) {
+    ASSERT(_fd != -1, "Already committed.");
+
+    flush();
+
+    auto fd = _fd;
+    _fd = -1;
+
+    if (::close(fd) == -1 || ::rename(_tmpPath.c_str(), _path.c_str()) == -1) {
+        ::unlink(_tmpPath.c_str());
+        throw StreamError();
+    }
+}
+
+void OutFileStream::flush() throw (StreamError) {
+    size_t done = 0;
+
+    while (done != _buffer.size()) {
+        auto rval = TEMP_FAILURE_RETRY(::write(_fd, &_buffer[done], _buffer.size() - done));
+        if (rval == -1) { throw StreamError(); }
+        done += rval;
+    }
+
+    _buffer.clear();
+}
+
+//
+//
+//
+
+MappedFile::MappedFile(const std::string & path) throw (StreamError) :
+    _data(nullptr),
+    _size(0)
+{
+    auto fd = TEMP_FAILURE_RETRY(::open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd == -1) { throw StreamError(); }
+
+    struct stat st;
+    if (::fstat(fd, &st) == -1) {
+        ENFORCE_SYS(::close(fd) != -1, "");
+        throw StreamError();
+    }
+
+    _size = st.st_size;
+
+    if (_size != 0) {
+        auto data = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            ENFORCE_SYS(::close(fd) != -1, "");
+            throw StreamError();
+        }
+        _data = static_cast<const uint8_t *>(data);
+    }
+
+    // The mapping outlives the descriptor.
+    ENFORCE_SYS(::close(fd) != -1, "");
+}
+
+MappedFile::~MappedFile() {
+    if (_data) {
+        ENFORCE_SYS(::munmap(const_cast<uint8_t *>(_data), _size) == 0, "");
+    }
+}
@@ -0,0 +1,54 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef SUPPORT__FILE_STREAM__HXX
+#define SUPPORT__FILE_STREAM__HXX
+
+#include "terminol/support/stream.hxx"
+#include "terminol/support/pattern.hxx"
+
+#include <string>
+
+// OutFileStream writes through a fixed size buffer to a new file. The file
+// is written to a temporary name and only renamed into place by commit(),
+// so a reader never sees a partial file.
+class OutFileStream : public OutStream, protected Uncopyable {
+    std::string          _path;
+    std::string          _tmpPath;
+    int                  _fd;
+    std::vector<uint8_t> _buffer;
+
+public:
+    explicit OutFileStream(const std::string & path) throw (StreamError);
+    virtual ~OutFileStream();
+
+    void writeAll(const void * data,
+                  size_t       item_size,
+                  size_t       num_items) throw (StreamError) override;
+
+    // Flush and rename the file into place.
+    void commit() throw (StreamError);
+
+protected:
+    void flush() throw (StreamError);
+};
+
+//
+//
+//
+
+// MappedFile is a read-only mapping of an entire file. Pages are only read
+// in as they are touched. Use InMemoryStream to read it sequentially.
+class MappedFile : protected Uncopyable {
+    const uint8_t * _data;
+    size_t          _size;
+
+public:
+    explicit MappedFile(const std::string & path) throw (StreamError);
+    ~MappedFile();
+
+    const uint8_t * data() const { return _data; }
+    size_t          size() const { return _size; }
+};
+
+#endif // SUPPORT__FILE_STREAM__HXX
@@ -0,0 +1,223 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef SUPPORT__FLAT_MAP__HXX
+#define SUPPORT__FLAT_MAP__HXX
+
+#include "terminol/support/debug.hxx"
+#include "terminol/support/pattern.hxx"
+
+#include <vector>
+#include <functional>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+
+// Open-addressed hash map. Entries live in a single flat array (no per-node
+// allocation) and collisions are resolved by linear probing. Erasure uses
+// backward-shift deletion so there are no tombstones and probe sequences
+// stay short however many entries come and go.
+// One key value, supplied at construction, is reserved to mark empty slots
+// and may not be inserted. Insert and erase invalidate iterators.
+template <typename Key, typename T, typename Hash = std::hash<Key>>
+class FlatMap : protected Uncopyable {
+public:
+    typedef Key                 key_type;
+    typedef T                   mapped_type;
+    typedef std::pair<Key, T>   value_type;
+    typedef size_t              size_type;
+
+private:
+    typedef std::vector<value_type> Slots;
+
+    Slots  _slots;          // Size is zero or a power of two.
+    size_t _size;
+    Key    _emptyKey;
+    Hash   _hasher;
+
+    // Keep the table at most three-quarters full.
+    static bool overloaded(size_t size, size_t capacity) {
+        return 4 * size > 3 * capacity;
+    }
+
+    size_t mask() const { return _slots.size() - 1; }
+
+    size_t home(const Key & key) const {
+        // Scramble the hash so that weak hashes (e.g. identity) still
+        // spread keys across the table.
+        auto h = static_cast<uint64_t>(_hasher(key)) * UINT64_C(0x9E3779B97F4A7C15);
+        return static_cast<size_t>(h ^ (h >> 32)) & mask();
+    }
+
+    size_t probe(const Key & key) const {
+        ASSERT(!_slots.empty(), "Empty table.");
+        auto i = home(key);
+        while (_slots[i].first != _emptyKey && _slots[i].first != key) {
+            i = (i + 1) & mask();
+        }
+        return i;
+    }
+
+    void rehash(size_t capacity) {
+        ASSERT((capacity & (capacity - 1)) == 0, "Capacity not a power of two.");
+        ASSERT(!overloaded(_size, capacity), "Capacity too small.");
+
+        Slots slots(capacity, value_type(_emptyKey, T()));
+        std::swap(slots, _slots);
+
+        for (auto & slot : slots) {
+            if (slot.first != _emptyKey) {
+                _slots[probe(slot.first)] = std::move(slot);
+            }
+        }
+    }
+
+    //
+    //
+    //
+
+    template <typename Map, typename Value> class Iterator {
+        friend class FlatMap;
+        Map    * _map;
+        size_t   _index;
+
+        void skip() {
+            while (_index != _map->_slots.size() &&
+                   _map->_slots[_index].first == _map->_emptyKey) {
+                ++_index;
+            }
+        }
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Value                     value_type;
+        typedef ptrdiff_t                 difference_type;
+        typedef Value                    *pointer;
+        typedef Value                    &reference;
+
+        Iterator(Map * map, size_t index) : _map(map), _index(index) { skip(); }
+
+        // Allow iterator -> const_iterator.
+        template <typename Map2, typename Value2>
+        Iterator(const Iterator<Map2, Value2> & rhs) : _map(rhs._map), _index(rhs._index) {}
+
+        pointer operator->() const { return &_map->_slots[_index]; }
+        reference operator*() const { return _map->_slots[_index]; }
+
+        Iterator & operator++() {
+            ++_index;
+            skip();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator rval(*this);
+            operator++();
+            return rval;
+        }
+
+        friend bool operator == (const Iterator & lhs, const Iterator & rhs) {
+            return lhs._index == rhs._index;
+        }
+
+        friend bool operator != (const Iterator & lhs, const Iterator & rhs) {
+            return !(lhs == rhs);
+        }
+
+        template <typename, typename> friend class Iterator;
+    };
+
+public:
+    typedef Iterator<FlatMap, value_type>             iterator;
+    typedef Iterator<const FlatMap, const value_type> const_iterator;
+
+    explicit FlatMap(const Key & emptyKey, const Hash & hasher = Hash()) :
+        _slots(), _size(0), _emptyKey(emptyKey), _hasher(hasher) {}
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end()   { return iterator(this, _slots.size()); }
+
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end()   const { return const_iterator(this, _slots.size()); }
+
+    iterator find(const Key & key) {
+        ASSERT(key != _emptyKey, "Empty key.");
+        if (_slots.empty()) { return end(); }
+        auto i = probe(key);
+        return _slots[i].first == _emptyKey ? end() : iterator(this, i);
+    }
+
+    const_iterator find(const Key & key) const {
+        ASSERT(key != _emptyKey, "Empty key.");
+        if (_slots.empty()) { return end(); }
+        auto i = probe(key);
+        return _slots[i].first == _emptyKey ? end() : const_iterator(this, i);
+    }
+
+    iterator insert(const Key & key, T && t) {
+        ASSERT(key != _emptyKey, "Empty key.");
+
+        if (_slots.empty() || overloaded(_size + 1, _slots.size())) {
+            rehash(_slots.empty() ? 16 : 2 * _slots.size());
+        }
+
+        auto i = probe(key);
+        ASSERT(_slots[i].first == _emptyKey, "Duplicate key.");
+
+        _slots[i].first  = key;
+        _slots[i].second = std::move(t);
+        ++_size;
+
+        return iterator(this, i);
+    }
+
+    void erase(iterator iter) {
+        ASSERT(iter._map == this, "Foreign iterator.");
+        ASSERT(iter != end(), "Erasing end.");
+
+        // Backward-shift: pull each subsequent member of the cluster into
+        // the hole, unless that would move it before its home slot.
+        auto hole = iter._index;
+        auto i    = hole;
+
+        for (;;) {
+            i = (i + 1) & mask();
+            if (_slots[i].first == _emptyKey) { break; }
+
+            auto h = home(_slots[i].first);
+
+            // Distance from home to the hole vs home to i, both cyclic.
+            if (((hole - h) & mask()) < ((i - h) & mask())) {
+                _slots[hole] = std::move(_slots[i]);
+                hole = i;
+            }
+        }
+
+        _slots[hole].first  = _emptyKey;
+        _slots[hole].second = T();
+        --_size;
+    }
+
+    void reserve(size_t size) {
+        size_t capacity = _slots.empty() ? 16 : _slots.size();
+        while (overloaded(size, capacity)) { capacity *= 2; }
+        if (capacity != _slots.size()) { rehash(capacity); }
+    }
+
+    void clear() {
+        _slots.clear();
+        _slots.shrink_to_fit();
+        _size = 0;
+    }
+
+    bool empty() const { return _size == 0; }
+
+    size_t size() const { return _size; }
+
+    size_t capacity() const { return _slots.size(); }
+
+    // Bytes used by the table itself (not by anything the values own).
+    size_t tableBytes() const { return _slots.capacity() * sizeof(value_type); }
+};
+
+#endif // SUPPORT__FLAT_MAP__HXX
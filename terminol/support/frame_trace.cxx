@@ -0,0 +1,106 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/support/frame_trace.hxx"
+
+#include <ostream>
+
+const size_t FrameTrace::CAPACITY;
+
+uint32_t FrameTrace::Frame::totalMicros() const {
+    uint32_t total = 0;
+    for (auto m : micros) { total += m; }
+    return total;
+}
+
+FrameTrace::FrameTrace() : _committed(0) {
+    for (auto & c : _counters) { c = 0; }
+    for (auto & m : _micros)   { m = 0; }
+
+    for (auto & slot : _slots) {
+        slot.sequence = 0;
+        slot.number   = 0;
+        for (auto & c : slot.counters) { c = 0; }
+        for (auto & m : slot.micros)   { m = 0; }
+    }
+}
+
+void FrameTrace::commit() {
+    auto   number   = _committed.load(std::memory_order_relaxed);
+    auto & slot     = _slots[number % CAPACITY];
+    auto   sequence = slot.sequence.load(std::memory_order_relaxed);
+
+    // Readers that see an odd or changed sequence retry.
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.number.store(number, std::memory_order_relaxed);
+
+    for (int i = 0; i != NUM_COUNTERS; ++i) {
+        slot.counters[i].store(_counters[i], std::memory_order_relaxed);
+        _counters[i] = 0;
+    }
+
+    for (int i = 0; i != NUM_STAGES; ++i) {
+        slot.micros[i].store(_micros[i].exchange(0, std::memory_order_relaxed),
+                             std::memory_order_relaxed);
+    }
+
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+    _committed.store(number + 1, std::memory_order_release);
+}
+
+void FrameTrace::snapshot(std::vector<Frame> & frames) const {
+    frames.clear();
+
+    auto committed = _committed.load(std::memory_order_acquire);
+    auto first     = committed > CAPACITY ? committed - CAPACITY : 0;
+
+    for (auto number = first; number != committed; ++number) {
+        Frame frame;
+        // Frames overwritten since 'committed' was read are dropped.
+        if (read(_slots[number % CAPACITY], frame) && frame.number == number) {
+            frames.push_back(frame);
+        }
+    }
+}
+
+bool FrameTrace::last(Frame & frame) const {
+    auto committed = _committed.load(std::memory_order_acquire);
+    if (committed == 0) { return false; }
+
+    while (!read(_slots[(committed - 1) % CAPACITY], frame)) {}
+    return true;
+}
+
+void FrameTrace::dump(std::ostream & ost, const std::vector<Frame> & frames) {
+    for (auto & frame : frames) {
+        ost << "frame="      << frame.number
+            << " bytes="     << frame.counters[BYTES_READ]
+            << " sequences=" << frame.counters[SEQUENCES]
+            << " cells="     << frame.counters[CELLS_WRITTEN]
+            << " rows="      << frame.counters[DAMAGED_ROWS]
+            << " draws="     << frame.counters[DRAW_CALLS]
+            << " parse-us="  << frame.micros[PARSE]
+            << " draw-us="   << frame.micros[DRAW]
+            << " copy-us="   << frame.micros[COPY]
+            << " render-us=" << frame.micros[RENDER]
+            << std::endl;
+    }
+}
+
+bool FrameTrace::read(const Slot & slot, Frame & frame) {
+    auto before = slot.sequence.load(std::memory_order_acquire);
+    if (before % 2 != 0) { return false; }
+
+    frame.number = slot.number.load(std::memory_order_relaxed);
+    for (int i = 0; i != NUM_COUNTERS; ++i) {
+        frame.counters[i] = slot.counters[i].load(std::memory_order_relaxed);
+    }
+    for (int i = 0; i != NUM_STAGES; ++i) {
+        frame.micros[i] = slot.micros[i].load(std::memory_order_relaxed);
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.sequence.load(std::memory_order_relaxed) == before;
+}
@@ -0,0 +1,108 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef SUPPORT__FRAME_TRACE__HXX
+#define SUPPORT__FRAME_TRACE__HXX
+
+#include "terminol/support/pattern.hxx"
+
+#include <atomic>
+#include <chrono>
+#include <vector>
+#include <iosfwd>
+#include <cstddef>
+#include <cstdint>
+
+// FrameTrace counts the work done towards each frame of a terminal, and the
+// time spent in each stage of the pipeline, and keeps the last CAPACITY
+// frames in a ring. The counters belong to the thread that commits the
+// frames. The stage times may be added to from any thread, e.g. a render
+// thread, whose time is counted towards the frame being accumulated when it
+// is added. Any thread may take a snapshot of the ring without locking, each
+// slot is published with a sequence number and re-read if it changes while
+// being copied.
+class FrameTrace : protected Uncopyable {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    static const size_t CAPACITY = 256;
+
+    enum Counter {
+        BYTES_READ,         // From the tty.
+        SEQUENCES,          // Controls and escapes parsed.
+        CELLS_WRITTEN,      // Characters written to the buffer.
+        DAMAGED_ROWS,
+        DRAW_CALLS,         // Backgrounds, foregrounds and cursors.
+        NUM_COUNTERS
+    };
+
+    enum Stage {
+        PARSE,              // Interpreting tty output into the buffer.
+        DRAW,               // Drawing (or recording) the damage, i.e. Pango/Cairo.
+        COPY,               // Copying to the window, i.e. X.
+        RENDER,             // Replaying recorded frames on a render thread.
+        NUM_STAGES
+    };
+
+    struct Frame {
+        uint64_t number;
+        uint32_t counters[NUM_COUNTERS];
+        uint32_t micros[NUM_STAGES];
+
+        uint32_t totalMicros() const;
+    };
+
+    // Adds the lifetime of the scope to a stage.
+    class Timer : protected Uncopyable {
+        FrameTrace        & _trace;
+        Stage               _stage;
+        Clock::time_point   _start;
+
+    public:
+        Timer(FrameTrace & trace, Stage stage) :
+            _trace(trace), _stage(stage), _start(Clock::now()) {}
+
+        ~Timer() { _trace.addTime(_stage, Clock::now() - _start); }
+    };
+
+private:
+    struct Slot {
+        std::atomic<uint64_t> sequence;     // Odd while being written.
+        std::atomic<uint64_t> number;
+        std::atomic<uint32_t> counters[NUM_COUNTERS];
+        std::atomic<uint32_t> micros[NUM_STAGES];
+    };
+
+    uint32_t              _counters[NUM_COUNTERS];      // Of the frame being accumulated.
+    std::atomic<uint32_t> _micros[NUM_STAGES];          // Ditto.
+    std::atomic<uint64_t> _committed;                   // Frames committed so far.
+    Slot                  _slots[CAPACITY];
+
+public:
+    FrameTrace();
+
+    void add(Counter counter, uint32_t count) { _counters[counter] += count; }
+
+    void addTime(Stage stage, Clock::duration duration) {
+        auto micros = std::chrono::duration_cast<std::chrono::microseconds>(duration);
+        _micros[stage].fetch_add(static_cast<uint32_t>(micros.count()), std::memory_order_relaxed);
+    }
+
+    // Publish the frame being accumulated and start the next one.
+    void commit();
+
+    // The frames in the ring, oldest first.
+    void snapshot(std::vector<Frame> & frames) const;
+
+    // The most recently committed frame, false if there isn't one.
+    bool last(Frame & frame) const;
+
+    // One line per frame.
+    static void dump(std::ostream & ost, const std::vector<Frame> & frames);
+
+protected:
+    // Copy 'slot' into 'frame', false if it was overwritten meanwhile.
+    static bool read(const Slot & slot, Frame & frame);
+};
+
+#endif // SUPPORT__FRAME_TRACE__HXX
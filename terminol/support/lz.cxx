@@ -0,0 +1,128 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/support/lz.hxx"
+
+#include <algorithm>
+#include <cstring>
+
+namespace lz {
+
+namespace {
+
+const int HASH_BITS = 12;
+
+inline uint32_t hashSeq(const uint8_t * ptr) {
+    uint32_t seq;
+    std::memcpy(&seq, ptr, sizeof seq);
+    return (seq * 2654435761u) >> (32 - HASH_BITS);
+}
+
+void putLength(std::vector<uint8_t> & dst, size_t length) {
+    while (length >= 255) {
+        dst.push_back(255);
+        length -= 255;
+    }
+    dst.push_back(static_cast<uint8_t>(length));
+}
+
+bool getLength(const uint8_t * src, size_t srcSize, size_t & i, size_t & length) {
+    uint8_t byte;
+
+    do {
+        if (i == srcSize) { return false; }
+        byte    = src[i++];
+        length += byte;
+    } while (byte == 255);
+
+    return true;
+}
+
+// A match length of zero means no match (the final sequence).
+void putSequence(std::vector<uint8_t> & dst,
+                 const uint8_t * literals, size_t literalLength,
+                 size_t offset, size_t matchLength) {
+    auto matchCode = matchLength == 0 ? 0 : matchLength - MIN_MATCH;
+    auto token     = (std::min<size_t>(literalLength, 15) << 4) | std::min<size_t>(matchCode, 15);
+
+    dst.push_back(static_cast<uint8_t>(token));
+    if (literalLength >= 15) { putLength(dst, literalLength - 15); }
+    dst.insert(dst.end(), literals, literals + literalLength);
+
+    if (matchLength != 0) {
+        dst.push_back(static_cast<uint8_t>(offset));
+        dst.push_back(static_cast<uint8_t>(offset >> 8));
+        if (matchCode >= 15) { putLength(dst, matchCode - 15); }
+    }
+}
+
+} // namespace {anonymous}
+
+void compress(const uint8_t * src, size_t size, std::vector<uint8_t> & dst) {
+    std::vector<uint32_t> table(1 << HASH_BITS, 0);
+
+    size_t anchor = 0;      // Start of pending literals.
+    size_t pos    = 0;
+
+    while (pos + MIN_MATCH <= size) {
+        auto   hash      = hashSeq(src + pos);
+        size_t candidate = table[hash];
+        table[hash]      = pos;
+
+        if (candidate < pos && pos - candidate <= MAX_OFFSET &&
+            std::memcmp(src + candidate, src + pos, MIN_MATCH) == 0)
+        {
+            auto length = MIN_MATCH;
+            while (pos + length != size && src[candidate + length] == src[pos + length]) {
+                ++length;
+            }
+
+            putSequence(dst, src + anchor, pos - anchor, pos - candidate, length);
+            pos   += length;
+            anchor = pos;
+        }
+        else {
+            ++pos;
+        }
+    }
+
+    putSequence(dst, src + anchor, size - anchor, 0, 0);
+}
+
+bool decompress(const uint8_t * src, size_t srcSize, uint8_t * dst, size_t dstSize) {
+    size_t i = 0;
+    size_t o = 0;
+
+    while (i != srcSize) {
+        auto token = src[i++];
+
+        size_t literalLength = token >> 4;
+        if (literalLength == 15 && !getLength(src, srcSize, i, literalLength)) { return false; }
+        if (srcSize - i < literalLength || dstSize - o < literalLength) { return false; }
+
+        std::memcpy(dst + o, src + i, literalLength);
+        i += literalLength;
+        o += literalLength;
+
+        if (i == srcSize) { break; }        // Final sequence.
+        if (srcSize - i < 2) { return false; }
+
+        size_t offset = src[i] | (src[i + 1] << 8);
+        i += 2;
+
+        size_t matchLength = token & 0x0F;
+        if (matchLength == 15 && !getLength(src, srcSize, i, matchLength)) { return false; }
+        matchLength += MIN_MATCH;
+
+        if (offset == 0 || offset > o || dstSize - o < matchLength) { return false; }
+
+        // The match may overlap the output, so copy forwards bytewise.
+        for (size_t j = 0; j != matchLength; ++j, ++o) {
+            dst[o] = dst[o - offset];
+        }
+    }
+
+    return o == dstSize;
+}
+
+} // namespace lz
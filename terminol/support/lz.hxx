@@ -0,0 +1,41 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef SUPPORT__LZ__HXX
+#define SUPPORT__LZ__HXX
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// A small, fast, LZ77 codec in the style of LZ4. It trades ratio for speed:
+// matches are found via a single-entry hash table and there is no entropy
+// coding. It is intended for blocks of up to a few hundred KiB.
+//
+// The compressed form is a sequence of:
+//
+//   uint8_t token                  literal length (high nibble),
+//                                  match length - MIN_MATCH (low nibble)
+//   [uint8_t ...]                  literal length continuation
+//   literals
+//   uint16_t offset                match distance, little-endian
+//   [uint8_t ...]                  match length continuation
+//
+// A nibble of 15 is continued by bytes which are added to it; a continuation
+// byte of 255 is followed by another. The final sequence holds only literals.
+
+namespace lz {
+
+const size_t MIN_MATCH  = 4;
+const size_t MAX_OFFSET = 65535;
+
+// Append the compressed form of 'size' bytes to 'dst'.
+void compress(const uint8_t * src, size_t size, std::vector<uint8_t> & dst);
+
+// Decompress exactly 'dstSize' bytes into 'dst'. Returns false if 'src' is
+// malformed or doesn't decompress to 'dstSize' bytes.
+bool decompress(const uint8_t * src, size_t srcSize, uint8_t * dst, size_t dstSize);
+
+} // namespace lz
+
+#endif // SUPPORT__LZ__HXX
@@ -8,7 +8,9 @@
 #include "terminol/support/debug.hxx"
 #include "terminol/support/sys.hxx"
 
+#include <algorithm>
 #include <set>
+#include <map>
 #include <deque>
 #include <vector>
 
@@ -17,7 +19,10 @@
 #include <sys/socket.h>
 #include <sys/un.h>
 
-class SocketServer : protected I_Selector::I_ReadHandler {
+class SocketServer :
+    protected I_Selector::I_ReadHandler,
+    protected I_Selector::I_WriteHandler
+{
 public:
     class I_Observer {
     public:
@@ -30,11 +35,13 @@ public:
     };
 
 private:
-    I_Observer    & _observer;
-    I_Selector    & _selector;
-    std::string     _path;
-    int             _fd;
-    std::set<int>   _connections;
+    I_Observer                          & _observer;
+    I_Selector                          & _selector;
+    std::string                           _path;
+    int                                   _fd;
+    std::set<int>                         _connections;
+    std::map<int, std::vector<uint8_t>>   _queues;      // Unsent, per connection.
+    std::set<int>                         _closing;     // Disconnected once sent.
 
 public:
     struct Error {
@@ -47,7 +54,10 @@ public:
                  const std::string & path) throw (Error) :
         _observer(observer),
         _selector(selector),
-        _path(path)
+        _path(path),
+        _connections(),
+        _queues(),
+        _closing()
     {
         _fd = ::socket(PF_UNIX, SOCK_SEQPACKET, 0);     // socket() doesn't raise EINTR.
         ENFORCE_SYS(_fd != -1, "Failed to create socket.");
@@ -82,7 +92,12 @@ public:
 
     virtual ~SocketServer() {
         for (auto con : _connections) {
-            _selector.removeReadable(con);
+            if (_closing.find(con) == _closing.end()) {
+                _selector.removeReadable(con);
+            }
+            if (_queues.find(con) != _queues.end()) {
+                _selector.removeWriteable(con);
+            }
             ENFORCE_SYS(TEMP_FAILURE_RETRY(::close(con)) != -1, "");
         }
 
@@ -90,11 +105,39 @@ public:
         ENFORCE_SYS(TEMP_FAILURE_RETRY(::close(_fd)) != -1, "");
     }
 
+    // Queue 'data' for the connection 'id'. It is sent as the connection
+    // accepts it, so a client that doesn't read can't hold us up. Messages
+    // are at most MAX_MESSAGE bytes so each arrives in one read.
+    void send(int id, const uint8_t * data, size_t size) {
+        auto fd = id;
+        ASSERT(_connections.find(fd) != _connections.end(), "");
+
+        if (size == 0) { return; }
+
+        auto & queue = _queues[fd];
+
+        if (queue.empty()) {
+            _selector.addWriteable(fd, this);
+        }
+
+        queue.insert(queue.end(), data, data + size);
+    }
+
+    // Disconnect once everything queued has been sent. Nothing more is
+    // received from the connection meanwhile.
     void disconnect(int id) {
         auto fd = id;
-        ENFORCE_SYS(::shutdown(fd, SHUT_RDWR) != -1, "");   // shutdown() doesn't raise EINTR.
+
+        if (_queues.find(fd) == _queues.end()) {
+            ENFORCE_SYS(::shutdown(fd, SHUT_RDWR) != -1, "");   // shutdown() doesn't raise EINTR.
+        }
+        else if (_closing.insert(fd).second) {
+            _selector.removeReadable(fd);
+        }
     }
 
+    static const size_t MAX_MESSAGE = 4096;
+
 protected:
     // I_Selector::I_ReadHandler implementation:
 
@@ -107,11 +150,12 @@ protected:
                                                      &length));
 
             if (conFd == -1) {
-                fdCloseExec(conFd);
-
                 ERROR("Failed to accept connection: " << strerror(errno));
             }
             else {
+                fdCloseExec(conFd);
+                fdNonBlock(conFd);
+
                 _selector.addReadable(conFd, this);
                 _connections.insert(conFd);
                 _observer.serverConnected(conFd);
@@ -122,12 +166,17 @@ protected:
             auto rval = TEMP_FAILURE_RETRY(::recv(fd, buf, sizeof buf, 0));
 
             if (rval == -1) {
-                FATAL("Bad read.");
+                if (errno == EAGAIN) { return; }
+                rval = 0;       // Treat errors (e.g. ECONNRESET) as a disconnect.
             }
-            else if (rval == 0) {
+
+            if (rval == 0) {
                 _observer.serverDisconnected(fd);
                 _connections.erase(fd);
                 _selector.removeReadable(fd);
+                if (_queues.erase(fd) != 0) {
+                    _selector.removeWriteable(fd);
+                }
                 ENFORCE_SYS(TEMP_FAILURE_RETRY(::close(fd)) != -1, "");
             }
             else {
@@ -135,16 +184,51 @@ protected:
             }
         }
     }
+
+    // I_Selector::I_Writer implementation:
+
+    void handleWrite(int fd) override {
+        auto iter = _queues.find(fd);
+        ASSERT(iter != _queues.end(), "");
+        auto & queue = iter->second;
+
+        // A packet at a time.
+        auto max   = MAX_MESSAGE;
+        auto chunk = std::min(queue.size(), max);
+        auto rval  = TEMP_FAILURE_RETRY(::send(fd, &queue.front(), chunk, MSG_NOSIGNAL));
+
+        if (rval == -1) {
+            if (errno == EAGAIN) { return; }
+            ERROR("Failed to send: " << strerror(errno));
+            rval = queue.size();        // The read side will see the disconnect.
+        }
+
+        queue.erase(queue.begin(), queue.begin() + rval);
+
+        if (queue.empty()) {
+            _queues.erase(iter);
+            _selector.removeWriteable(fd);
+
+            if (_closing.erase(fd) != 0) {
+                ENFORCE_SYS(::shutdown(fd, SHUT_RDWR) != -1, "");   // shutdown() doesn't raise EINTR.
+                _selector.addReadable(fd, this);                    // To see the disconnect.
+            }
+        }
+    }
 };
 
 //
 //
 //
 
-class SocketClient : protected I_Selector::I_WriteHandler {
+class SocketClient :
+    protected I_Selector::I_ReadHandler,
+    protected I_Selector::I_WriteHandler
+{
 public:
     class I_Observer {
     public:
+        virtual void clientReceived(const uint8_t * data, size_t size) = 0;
         virtual void clientDisconnected() = 0;
         virtual void clientQueueEmpty() = 0;
 
@@ -156,6 +240,7 @@ private:
     I_Observer           & _observer;
     I_Selector           & _selector;
     int                    _fd;
+    bool                   _connected;      // Until the server disconnects.
     std::vector<uint8_t>   _queue;
 
 public:
@@ -168,7 +253,9 @@ public:
                  I_Selector        & selector,
                  const std::string & path) throw (Error) :
         _observer(observer),
-        _selector(selector)
+        _selector(selector),
+        _connected(false),
+        _queue()
     {
         _fd = ::socket(PF_UNIX, SOCK_SEQPACKET, 0);     // socket() doesn't raise EINTR.
         ENFORCE_SYS(_fd != -1, "Failed to create socket.");
@@ -197,9 +284,15 @@ public:
                     FATAL("");
             }
         }
+
+        _connected = true;
+        _selector.addReadable(_fd, this);
     }
 
     virtual ~SocketClient() {
+        if (_connected) {
+            _selector.removeReadable(_fd);
+        }
         if (!_queue.empty()) {
             _selector.removeWriteable(_fd);
         }
@@ -217,12 +310,43 @@ public:
     }
 
 protected:
+    // I_Selector::I_ReadHandler implementation:
+
+    void handleRead(int fd) override {
+        ASSERT(fd == _fd, "");
+        uint8_t buf[BUFSIZ];
+        auto rval = TEMP_FAILURE_RETRY(::recv(fd, buf, sizeof buf, 0));
+
+        if (rval == -1) {
+            if (errno == EAGAIN) { return; }
+            rval = 0;       // Treat errors (e.g. ECONNRESET) as a disconnect.
+        }
+
+        if (rval == 0) {
+            _connected = false;
+            _selector.removeReadable(fd);
+            _observer.clientDisconnected();
+        }
+        else {
+            _observer.clientReceived(buf, rval);
+        }
+    }
+
     // I_Selector::I_Writer implementation:
 
     void handleWrite(int fd) override {
         ASSERT(fd == _fd, "");
         ASSERT(!_queue.empty(), "");
-        auto rval = TEMP_FAILURE_RETRY(::send(fd, &_queue.front(), _queue.size(), MSG_NOSIGNAL));
+        // A packet at a time, each small enough for the server to read whole.
+        auto max   = SocketServer::MAX_MESSAGE;
+        auto chunk = std::min(_queue.size(), max);
+        auto rval  = TEMP_FAILURE_RETRY(::send(fd, &_queue.front(), chunk, MSG_NOSIGNAL));
+
+        if (rval == -1) {
+            if (errno == EAGAIN) { return; }
+            ERROR("Failed to send: " << strerror(errno));
+            rval = _queue.size();       // The read side will see the disconnect.
+        }
 
         _queue.erase(_queue.begin(), _queue.begin() + rval);
 
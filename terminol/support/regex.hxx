@@ -108,12 +108,18 @@ public:
                 break;
             }
             else {
+                auto empty = offsets.front().first == offsets.front().last;
                 offset = offsets.front().last;
                 allOffsets.push_back(std::move(offsets));
 
                 if (offset == size) {
                     break;
                 }
+
+                if (empty) {
+                    // Step over the next character or the empty match repeats forever.
+                    do { ++offset; } while (offset != size && (text[offset] & 0xC0) == 0x80);
+                }
             }
         }
 
@@ -5,8 +5,10 @@
 #define SUPPORT__SELECTOR__HXX
 
 #include "terminol/support/debug.hxx"
+#include "terminol/support/timer_heap.hxx"
 
 #include <map>
+#include <set>
 #include <chrono>
 #include <algorithm>
 #include <vector>
@@ -50,9 +52,20 @@ public:
     virtual void addTimeoutable(I_TimeoutHandler * handler, int milliseconds) = 0;
     virtual void removeTimeoutable(I_TimeoutHandler * handler) = 0;
 
+    // An urgent readable fd has its handler called ahead of the others that
+    // are ready at the same time, e.g. for a pty the user is typing into.
+    // The ready fds are otherwise served round robin. Urgency is forgotten
+    // when the fd is removed.
+    virtual void setUrgent(int fd, bool urgent) = 0;
+
 protected:
     I_Selector() {}
     ~I_Selector() {}
+
+    struct NullLock {
+        void lock()   {}
+        void unlock() {}
+    };
 };
 
 #ifndef __linux__
@@ -66,20 +79,14 @@ protected:
 class SelectSelector : public I_Selector {
     typedef std::chrono::steady_clock Clock;
 
-    struct TimeEntry {
-        TimeEntry(Clock::time_point  time_, I_TimeoutHandler * handler_) :
-            time(time_), handler(handler_) {}
-
-        Clock::time_point   time;
-        I_TimeoutHandler  * handler;
-    };
-
     std::map<int, I_ReadHandler *>  _readRegs;
     std::map<int, I_WriteHandler *> _writeRegs;
-    std::vector<TimeEntry>          _timeoutRegs;
+    TimerHeap<I_TimeoutHandler *>   _timeouts;
+    std::set<int>                   _urgent;
+    int                             _lastRead;      // Round robin.
 
 public:
-    SelectSelector() {}
+    SelectSelector() : _lastRead(-1) {}
 
     virtual ~SelectSelector() {
         ASSERT(_readRegs.empty(), "");
@@ -87,6 +94,14 @@ public:
     }
 
     void animate() {
+        NullLock lock;
+        animate(lock);
+    }
+
+    // Wait with 'lock' unlocked, so other threads holding it may change the
+    // registrations meanwhile. They must also wake the selector (e.g. via a
+    // registered pipe) for new registrations to take effect.
+    template <typename Lock> void animate(Lock & lock) {
         ASSERT(!_readRegs.empty() || !_writeRegs.empty(), "");
 
         fd_set readFds;
@@ -110,9 +125,9 @@ public:
 
         int n;
 
-        if (!_timeoutRegs.empty()) {
+        if (!_timeouts.empty()) {
             auto now  = Clock::now();
-            auto next = std::max(now, _timeoutRegs.front().time);
+            auto next = std::max(now, _timeouts.nextTime());
 
             auto duration = std::chrono::duration_cast<std::chrono::microseconds>(next - now);
 
@@ -121,41 +136,40 @@ public:
             tv.tv_sec  = duration.count() / A_MILLION;
             tv.tv_usec = duration.count() % A_MILLION;
 
+            lock.unlock();
             n = TEMP_FAILURE_RETRY(::select(max + 1, &readFds, &writeFds, nullptr, &tv));
+            lock.lock();
         }
         else {
+            lock.unlock();
             n = TEMP_FAILURE_RETRY(::select(max + 1, &readFds, &writeFds, nullptr, nullptr));
+            lock.lock();
             ENFORCE_SYS(n != 0, "");
         }
 
         ENFORCE_SYS(n != -1, "");
 
-        if (n == 0) {
-            ASSERT(!_timeoutRegs.empty(), "");
+        if (n != 0) {
+            // Urgent fds first, then the rest starting after the last one
+            // served.
+            std::vector<int> ready;
 
-            auto now = Clock::now();
-
-            while (!_timeoutRegs.empty()) {
-                auto & reg = _timeoutRegs.back();
-
-                if (now < reg.time) {
-                    break;
-                }
-
-                auto handler = reg.handler;
-                _timeoutRegs.pop_back();    // Invalidates reg reference.
-
-                handler->handleTimeout();
+            for (auto reg : _readRegs) {
+                if (FD_ISSET(reg.first, &readFds)) { ready.push_back(reg.first); }
             }
-        }
-        else {
-            for (auto iter = _readRegs.begin(); iter != _readRegs.end(); /**/) {
-                auto fd      = iter->first;
-                auto handler = iter->second;
-                ++iter;
 
-                if (FD_ISSET(fd, &readFds)) {
-                    handler->handleRead(fd);
+            std::rotate(ready.begin(),
+                        std::upper_bound(ready.begin(), ready.end(), _lastRead),
+                        ready.end());
+            std::stable_partition(ready.begin(), ready.end(),
+                                  [this](int fd) { return _urgent.count(fd) != 0; });
+
+            for (auto fd : ready) {
+                // An earlier handler may have removed this registration.
+                auto iter = _readRegs.find(fd);
+                if (iter != _readRegs.end()) {
+                    _lastRead = fd;
+                    iter->second->handleRead(fd);
                 }
             }
 
@@ -169,6 +183,14 @@ public:
                 }
             }
         }
+
+        // Whether or not there were events, so that busy fds can't starve the
+        // timeouts. They may have been removed while waiting.
+        auto now = Clock::now();
+
+        while (_timeouts.expired(now)) {
+            _timeouts.pop()->handleTimeout();
+        }
     }
 
     // I_Selector implementation:
@@ -182,6 +204,7 @@ public:
         auto iter = _readRegs.find(fd);
         ASSERT(iter != _readRegs.end(), "");
         _readRegs.erase(iter);
+        _urgent.erase(fd);
     }
 
     void addWriteable(int fd, I_WriteHandler * handler) {
@@ -196,36 +219,21 @@ public:
     }
 
     void addTimeoutable(I_TimeoutHandler * handler, int milliseconds) {
-#if DEBUG
-        for (auto & reg : _timeoutRegs) {
-            ASSERT(reg.handler != handler, "Handler already registered.");
-        }
-#endif
-        Clock::time_point scheduled =
-            Clock::now() + std::chrono::duration<int, std::milli>(milliseconds);
-
-        auto iter = _timeoutRegs.begin();
-
-        while (iter != _timeoutRegs.end()) {
-            if (iter->time < scheduled) {
-                break;
-            }
-
-            ++iter;
-        }
-
-        _timeoutRegs.insert(iter, TimeEntry(scheduled, handler));
+        ASSERT(!_timeouts.contains(handler), "Handler already registered.");
+        _timeouts.add(handler,
+                      Clock::now() + std::chrono::duration<int, std::milli>(milliseconds));
     }
 
     void removeTimeoutable(I_TimeoutHandler * handler) {
-        for (auto iter = _timeoutRegs.begin(); iter != _timeoutRegs.end(); ++iter) {
-            if (iter->handler == handler) {
-                _timeoutRegs.erase(iter);
-                return;
-            }
+        if (!_timeouts.remove(handler)) {
+            FATAL("Handler not registered.");
         }
+    }
 
-        FATAL("Handler not registered.");
+    void setUrgent(int fd, bool urgent) {
+        ASSERT(_readRegs.find(fd) != _readRegs.end(), "");
+        if (urgent) { _urgent.insert(fd); }
+        else        { _urgent.erase(fd); }
     }
 };
 
@@ -242,18 +250,11 @@ typedef SelectSelector Selector;
 class EPollSelector : public I_Selector {
     typedef std::chrono::steady_clock Clock;
 
-    struct TimeEntry {
-        TimeEntry(Clock::time_point  time_, I_TimeoutHandler * handler_) :
-            time(time_), handler(handler_) {}
-
-        Clock::time_point   time;
-        I_TimeoutHandler  * handler;
-    };
-
     int                             _fd;
     std::map<int, I_ReadHandler *>  _readRegs;
     std::map<int, I_WriteHandler *> _writeRegs;
-    std::vector<TimeEntry>          _timeoutRegs;
+    TimerHeap<I_TimeoutHandler *>   _timeouts;
+    std::set<int>                   _urgent;
 
 public:
     EPollSelector() {
@@ -265,48 +266,51 @@ public:
     }
 
     void animate() {
+        NullLock lock;
+        animate(lock);
+    }
+
+    // Wait with 'lock' unlocked, so other threads holding it may change the
+    // registrations meanwhile. They must also wake the selector (e.g. via a
+    // registered pipe) for new registrations to take effect.
+    template <typename Lock> void animate(Lock & lock) {
         ASSERT(!_readRegs.empty() || !_writeRegs.empty(), "");
 
-        const int MAX_EVENTS = 8;
+        // Enough that an urgent fd is seldom left out of a batch.
+        const int MAX_EVENTS = 32;
         struct epoll_event event_array[MAX_EVENTS];
 
         int n;
 
-        if (!_timeoutRegs.empty()) {
+        if (!_timeouts.empty()) {
             auto now  = Clock::now();
-            auto next = std::max(now, _timeoutRegs.front().time);
+            auto next = std::max(now, _timeouts.nextTime());
 
-            auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(next - now);
-            auto timeout  = duration.count();
+            // Rounded up, rather than waking early to find nothing expired.
+            auto duration = std::chrono::duration_cast<std::chrono::microseconds>(next - now);
+            auto timeout  = static_cast<int>((duration.count() + 999) / 1000);
 
+            lock.unlock();
             n = TEMP_FAILURE_RETRY(::epoll_wait(_fd, event_array, MAX_EVENTS, timeout));
+            lock.lock();
         }
         else {
+            lock.unlock();
             n = TEMP_FAILURE_RETRY(::epoll_wait(_fd, event_array, MAX_EVENTS, -1));
+            lock.lock();
             ENFORCE_SYS(n != 0, "");
         }
 
         ENFORCE_SYS(n != -1, "");
 
-        if (n == 0) {
-            ASSERT(!_timeoutRegs.empty(), "");
+        if (n != 0) {
+            // Urgent fds first. epoll_wait() returns the rest round robin, an
+            // fd that is still ready goes to the back of its queue.
+            std::stable_partition(event_array, event_array + n,
+                                  [this](const struct epoll_event & event) {
+                                      return _urgent.count(event.data.fd) != 0;
+                                  });
 
-            auto now = Clock::now();
-
-            while (!_timeoutRegs.empty()) {
-                auto & reg = _timeoutRegs.back();
-
-                if (now < reg.time) {
-                    break;
-                }
-
-                auto handler = reg.handler;
-                _timeoutRegs.pop_back();    // Invalidates reg reference.
-
-                handler->handleTimeout();
-            }
-        }
-        else {
             for (auto i = 0; i != n; ++i) {
                 auto & event = event_array[i];
 
@@ -319,19 +323,36 @@ public:
 
                 if (events & (EPOLLHUP | EPOLLIN)) {
                     auto iter = _readRegs.find(fd);
-                    ASSERT(iter != _readRegs.end(), "");
-                    auto handler = iter->second;
-                    handler->handleRead(fd);
+                    if (iter != _readRegs.end()) {
+                        auto handler = iter->second;
+                        handler->handleRead(fd);
+                    }
+                    else {
+                        // Only registered for writing (or no longer registered
+                        // at all), let the write handler discover the hang-up.
+                        events |= EPOLLOUT;
+                    }
                 }
 
                 if (events & EPOLLOUT) {
+                    // The read handler may have just removed this registration,
+                    // e.g. by closing the fd.
                     auto iter = _writeRegs.find(fd);
-                    ASSERT(iter != _writeRegs.end(), "");
-                    auto handler = iter->second;
-                    handler->handleWrite(fd);
+                    if (iter != _writeRegs.end()) {
+                        auto handler = iter->second;
+                        handler->handleWrite(fd);
+                    }
                 }
             }
         }
+
+        // Whether or not there were events, so that busy fds can't starve the
+        // timeouts. They may have been removed while waiting.
+        auto now = Clock::now();
+
+        while (_timeouts.expired(now)) {
+            _timeouts.pop()->handleTimeout();
+        }
     }
 
     // I_Selector implementation:
@@ -371,6 +392,7 @@ public:
         }
 
         _readRegs.erase(iter);
+        _urgent.erase(fd);
     }
 
     void addWriteable(int fd, I_WriteHandler * handler) {
@@ -411,36 +433,21 @@ public:
     }
 
     void addTimeoutable(I_TimeoutHandler * handler, int milliseconds) {
-#if DEBUG
-        for (auto & reg : _timeoutRegs) {
-            ASSERT(reg.handler != handler, "Handler already registered.");
-        }
-#endif
-        Clock::time_point scheduled =
-            Clock::now() + std::chrono::duration<int,std::milli>(milliseconds);
-
-        auto iter = _timeoutRegs.begin();
-
-        while (iter != _timeoutRegs.end()) {
-            if (iter->time < scheduled) {
-                break;
-            }
-
-            ++iter;
-        }
-
-        _timeoutRegs.insert(iter, TimeEntry(scheduled, handler));
+        ASSERT(!_timeouts.contains(handler), "Handler already registered.");
+        _timeouts.add(handler,
+                      Clock::now() + std::chrono::duration<int, std::milli>(milliseconds));
     }
 
     void removeTimeoutable(I_TimeoutHandler * handler) {
-        for (auto iter = _timeoutRegs.begin(); iter != _timeoutRegs.end(); ++iter) {
-            if (iter->handler == handler) {
-                _timeoutRegs.erase(iter);
-                return;
-            }
+        if (!_timeouts.remove(handler)) {
+            FATAL("Handler not registered.");
         }
+    }
 
-        FATAL("Handler not registered.");
+    void setUrgent(int fd, bool urgent) {
+        ASSERT(_readRegs.find(fd) != _readRegs.end(), "");
+        if (urgent) { _urgent.insert(fd); }
+        else        { _urgent.erase(fd); }
     }
 };
 
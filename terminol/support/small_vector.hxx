@@ -0,0 +1,82 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef SUPPORT__SMALL_VECTOR__HXX
+#define SUPPORT__SMALL_VECTOR__HXX
+
+#include "terminol/support/debug.hxx"
+
+#include <initializer_list>
+#include <algorithm>
+#include <cstddef>
+
+// Vector with inline, fixed capacity storage: it never allocates. Once full,
+// further elements are dropped and the vector is marked as overflowed, so
+// the owner can decide whether the truncated contents are still useful.
+// T must be default constructible and cheap to copy.
+template <typename T, size_t N>
+class SmallVector {
+    T      _elements[N];
+    size_t _size;
+    bool   _overflow;
+
+public:
+    typedef T                 value_type;
+    typedef size_t            size_type;
+    typedef T *               iterator;
+    typedef const T *         const_iterator;
+
+    static const size_t CAPACITY = N;
+
+    SmallVector() : _elements(), _size(0), _overflow(false) {}
+
+    SmallVector(std::initializer_list<T> list) : SmallVector() {
+        for (auto & element : list) { push_back(element); }
+    }
+
+    size_t size()       const { return _size; }
+    bool   empty()      const { return _size == 0; }
+    bool   full()       const { return _size == N; }
+    bool   overflowed() const { return _overflow; }
+
+    void clear() {
+        _size     = 0;
+        _overflow = false;
+    }
+
+    void push_back(const T & element) {
+        if (LIKELY(_size != N)) { _elements[_size++] = element; }
+        else                    { _overflow = true; }
+    }
+
+    void pop_back() {
+        ASSERT(_size != 0, "Empty.");
+        --_size;
+    }
+
+    T       & operator [] (size_t i)       { ASSERT(i < _size, ""); return _elements[i]; }
+    const T & operator [] (size_t i) const { ASSERT(i < _size, ""); return _elements[i]; }
+
+    T       & front()       { ASSERT(_size != 0, "Empty."); return _elements[0]; }
+    const T & front() const { ASSERT(_size != 0, "Empty."); return _elements[0]; }
+
+    T       & back()       { ASSERT(_size != 0, "Empty."); return _elements[_size - 1]; }
+    const T & back() const { ASSERT(_size != 0, "Empty."); return _elements[_size - 1]; }
+
+    iterator       begin()       { return _elements; }
+    const_iterator begin() const { return _elements; }
+    iterator       end()         { return _elements + _size; }
+    const_iterator end()   const { return _elements + _size; }
+};
+
+template <typename T, size_t N>
+bool operator == (const SmallVector<T, N> & lhs, const SmallVector<T, N> & rhs) {
+    return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin());
+}
+
+template <typename T, size_t N>
+bool operator != (const SmallVector<T, N> & lhs, const SmallVector<T, N> & rhs) {
+    return !(lhs == rhs);
+}
+
+#endif // SUPPORT__SMALL_VECTOR__HXX
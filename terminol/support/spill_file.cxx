@@ -0,0 +1,209 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/support/spill_file.hxx"
+#include "terminol/support/debug.hxx"
+#include "terminol/support/sys.hxx"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#ifdef __linux__
+#include <sys/vfs.h>
+#include <linux/magic.h>
+#endif
+
+namespace {
+
+// Address space is reserved up front so the mapping never needs to move.
+const size_t MAX_CAPACITY = sizeof(void *) >= 8 ? size_t(1) << 36 : size_t(1) << 30;
+
+const size_t NO_SEGMENT = static_cast<size_t>(-1);
+
+} // namespace {anonymous}
+
+SpillFile::SpillFile(const std::string & dir, size_t limit) throw (Error) :
+    _fd(-1),
+    _base(nullptr),
+    _capacity(0),
+    _live(),
+    _free(),
+    _current(NO_SEGMENT),
+    _tail(0),
+    _liveBytes(0)
+{
+    if (limit == 0 || limit > MAX_CAPACITY) { limit = MAX_CAPACITY; }
+    _capacity = limit / SEGMENT_SIZE * SEGMENT_SIZE;
+
+    if (_capacity == 0) {
+        throw Error("Spill file limit is less than a segment.");
+    }
+
+    auto path = dir + "/terminol-spill-XXXXXX";
+    std::vector<char> buf(path.begin(), path.end());
+    buf.push_back('\0');
+
+    _fd = ::mkstemp(&buf.front());
+    if (_fd == -1) {
+        throw Error("Failed to create spill file in " + dir + ": " + ::strerror(errno));
+    }
+
+    ENFORCE_SYS(::unlink(&buf.front()) == 0, "Failed to unlink spill file.");
+    fdCloseExec(_fd);
+
+#ifdef __linux__
+    struct statfs fs;
+    if (::fstatfs(_fd, &fs) == 0 && fs.f_type == TMPFS_MAGIC) {
+        WARNING("Spill directory " << dir << " is tmpfs, spilled history still occupies memory.");
+    }
+#endif
+
+    auto base = ::mmap(nullptr, _capacity, PROT_READ, MAP_SHARED | MAP_NORESERVE, _fd, 0);
+    if (base == MAP_FAILED) {
+        auto error = ::strerror(errno);
+        ENFORCE_SYS(::close(_fd) != -1, "");
+        throw Error(std::string("Failed to map spill file: ") + error);
+    }
+
+    _base = static_cast<uint8_t *>(base);
+}
+
+SpillFile::~SpillFile() {
+    ENFORCE_SYS(::munmap(_base, _capacity) == 0, "");
+    ENFORCE_SYS(::close(_fd) != -1, "");
+}
+
+bool SpillFile::append(const void * data, size_t size, uint64_t & offset) {
+    size_t first, count;
+
+    if (size <= SEGMENT_SIZE) {
+        if (_current == NO_SEGMENT || _tail + size > SEGMENT_SIZE) {
+            size_t segment;
+            if (!takeSegment(segment)) { return false; }
+            _current = segment;
+            _tail    = 0;
+        }
+
+        first  = _current;
+        count  = 1;
+        offset = _current * SEGMENT_SIZE + _tail;
+    }
+    else {
+        // Whole segments at the end of the file.
+        count = (size + SEGMENT_SIZE - 1) / SEGMENT_SIZE;
+        if ((_live.size() + count) * SEGMENT_SIZE > _capacity) { return false; }
+
+        first  = _live.size();
+        offset = first * SEGMENT_SIZE;
+        _live.resize(first + count, 0);
+    }
+
+    auto ptr  = static_cast<const uint8_t *>(data);
+    auto done = size_t(0);
+
+    while (done != size) {
+        auto rval = TEMP_FAILURE_RETRY(::pwrite(_fd, ptr + done, size - done, offset + done));
+        if (rval == -1) {
+            ERROR("Failed to write spill file: " << ::strerror(errno));
+            // Unused, the segments of a large extent are free again.
+            if (size > SEGMENT_SIZE) {
+                for (size_t i = 0; i != count; ++i) { recycle(first + i); }
+            }
+            return false;
+        }
+        done += rval;
+    }
+
+    if (size <= SEGMENT_SIZE) {
+        _live[first] += size;
+        _tail        += size;
+    }
+    else {
+        for (size_t i = 0; i != count; ++i) {
+            _live[first + i] = std::min(size - i * SEGMENT_SIZE, +SEGMENT_SIZE);
+        }
+    }
+
+    _liveBytes += size;
+
+    return true;
+}
+
+bool SpillFile::release(uint64_t offset, size_t size) {
+    ASSERT(size <= _liveBytes, "");
+    _liveBytes -= size;
+
+    auto segment  = static_cast<size_t>(offset / SEGMENT_SIZE);
+    auto begin    = static_cast<size_t>(offset % SEGMENT_SIZE);
+    bool recycled = false;
+
+    while (size != 0) {
+        auto part = std::min(size, SEGMENT_SIZE - begin);
+        ASSERT(part <= _live[segment], "");
+
+        _live[segment] -= part;
+        if (_live[segment] == 0) {
+            recycle(segment);
+            recycled = true;
+        }
+
+        size -= part;
+        begin = 0;
+        ++segment;
+    }
+
+    return recycled;
+}
+
+bool SpillFile::sparse(uint64_t offset) const {
+    auto segment = static_cast<size_t>(offset / SEGMENT_SIZE);
+    return segment != _current && _live[segment] < SEGMENT_SIZE / 4;
+}
+
+void SpillFile::reset() {
+    ENFORCE_SYS(::ftruncate(_fd, 0) == 0, "Failed to truncate spill file.");
+    _live.clear();
+    _free.clear();
+    _current   = NO_SEGMENT;
+    _tail      = 0;
+    _liveBytes = 0;
+}
+
+bool SpillFile::takeSegment(size_t & segment) {
+    if (!_free.empty()) {
+        // The lowest, to keep the file compact.
+        auto iter = std::min_element(_free.begin(), _free.end());
+        segment = *iter;
+        *iter   = _free.back();
+        _free.pop_back();
+        return true;
+    }
+
+    if ((_live.size() + 1) * SEGMENT_SIZE > _capacity) {
+        return false;
+    }
+
+    segment = _live.size();
+    _live.push_back(0);
+
+    return true;
+}
+
+void SpillFile::recycle(size_t segment) {
+#ifdef FALLOC_FL_PUNCH_HOLE
+    // Failure (e.g. EOPNOTSUPP) only means the space is held until reused.
+    TEMP_FAILURE_RETRY(::fallocate(_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                                   segment * SEGMENT_SIZE, SEGMENT_SIZE));
+#endif
+
+    if (segment == _current) {
+        _tail = 0;      // Refill it from the start.
+    }
+    else {
+        _free.push_back(segment);
+    }
+}
@@ -0,0 +1,80 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef SUPPORT__SPILL_FILE__HXX
+#define SUPPORT__SPILL_FILE__HXX
+
+#include "terminol/support/pattern.hxx"
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// SpillFile is an anonymous file for data that is cheaper to keep on disk
+// than in memory. The file is unlinked as soon as it is created so it never
+// outlives the process.
+// The file is divided into segments which are filled one at a time. Extents
+// are released as their data dies, and a segment with nothing live left is
+// recycled, a hole being punched over it to return its disk space (or, on
+// tmpfs, its memory). An extent larger than a segment takes whole segments
+// of its own. The file never grows beyond its limit.
+// Appends are written with pwrite() so they don't occupy the process's
+// address space. Reads go via a read-only mapping of the whole file, so only
+// the pages actually read are faulted in, and they remain reclaimable page
+// cache.
+// SpillFile is not thread-safe, the caller must serialise access.
+class SpillFile : protected Uncopyable {
+public:
+    static const size_t SEGMENT_SIZE = 1 << 20;
+
+private:
+    int                   _fd;
+    uint8_t             * _base;        // Read-only mapping, reserved once for _capacity.
+    size_t                _capacity;    // Maximum file size, a whole number of segments.
+    std::vector<uint32_t> _live;        // Live bytes of each segment of the file.
+    std::vector<size_t>   _free;        // Recycled segments.
+    size_t                _current;     // Segment being filled, if any.
+    size_t                _tail;        // Bytes used of the current segment.
+    size_t                _liveBytes;
+
+public:
+    struct Error {
+        explicit Error(const std::string & message_) : message(message_) {}
+        std::string message;
+    };
+
+    // Create the file within 'dir', of at most 'limit' bytes, zero for as
+    // large as the address space allows.
+    SpillFile(const std::string & dir, size_t limit) throw (Error);
+    ~SpillFile();
+
+    // Append 'size' bytes, storing their offset. Returns false if the
+    // file is full or the write fails.
+    bool append(const void * data, size_t size, uint64_t & offset);
+
+    // The extent is dead. Returns true if a segment was recycled, i.e. there
+    // is room for more.
+    bool release(uint64_t offset, size_t size);
+
+    const uint8_t * data(uint64_t offset) const {
+        return _base + offset;
+    }
+
+    // Is most of the segment holding the extent dead? Its live extents are
+    // better appended afresh, so the segment can be recycled.
+    bool sparse(uint64_t offset) const;
+
+    // Discard the contents, returning the disk space.
+    void reset();
+
+    size_t size()      const { return _live.size() * SEGMENT_SIZE; }
+    size_t liveBytes() const { return _liveBytes; }
+    size_t capacity()  const { return _capacity; }
+
+protected:
+    bool takeSegment(size_t & segment);
+    void recycle(size_t segment);
+};
+
+#endif // SUPPORT__SPILL_FILE__HXX
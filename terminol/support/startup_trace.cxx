@@ -0,0 +1,125 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/support/startup_trace.hxx"
+#include "terminol/support/debug.hxx"
+
+#include <vector>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <cstdlib>
+
+#include <unistd.h>
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const size_t MAX_EVENTS = 1024;     // Stops recording if finish() never comes.
+
+struct Event {
+    const char * name;
+    char         phase;             // 'B'egin, 'E'nd or 'i'nstant.
+    int          tid;
+    int64_t      micros;            // Since the origin.
+};
+
+// Constructed during static initialisation, so the origin is close to when
+// the process was loaded.
+struct State {
+    const Clock::time_point        origin    = Clock::now();
+    std::atomic<bool>              recording { true };
+    std::mutex                     mutex;
+    std::vector<Event>             events;
+    std::map<std::thread::id, int> tids;        // Numbered in order of appearance.
+    std::string                    output;
+    std::atomic<bool>              finished  { false };
+} state;
+
+void record(const char * name, char phase) {
+    if (!state.recording.load(std::memory_order_relaxed)) { return; }
+
+    auto now = Clock::now();
+
+    std::unique_lock<std::mutex> lock(state.mutex);
+    if (!state.recording) { return; }
+
+    auto iter = state.tids.find(std::this_thread::get_id());
+    if (iter == state.tids.end()) {
+        iter = state.tids.insert(std::make_pair(std::this_thread::get_id(),
+                                                static_cast<int>(state.tids.size() + 1))).first;
+    }
+
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(now - state.origin);
+    state.events.push_back(Event{ name, phase, iter->second, micros.count() });
+
+    if (state.events.size() == MAX_EVENTS) {
+        state.recording = false;
+    }
+}
+
+} // namespace {anonymous}
+
+void StartupTrace::begin(const char * name) {
+    record(name, 'B');
+}
+
+void StartupTrace::end(const char * name) {
+    record(name, 'E');
+}
+
+void StartupTrace::instant(const char * name) {
+    record(name, 'i');
+}
+
+void StartupTrace::setOutput(const std::string & path) {
+    std::unique_lock<std::mutex> lock(state.mutex);
+    state.output = path;
+}
+
+std::string StartupTrace::outputFromEnvironment() {
+    auto path = static_cast<const char *>(::getenv("TERMINOL_STARTUP_TRACE"));
+    return path ? path : "";
+}
+
+void StartupTrace::finish() {
+    std::vector<Event> events;
+    std::string        output;
+
+    if (state.finished.load(std::memory_order_relaxed)) { return; }
+
+    {
+        std::unique_lock<std::mutex> lock(state.mutex);
+        if (state.finished) { return; }
+
+        // A full trace is still written.
+        state.finished  = true;
+        state.recording = false;
+        std::swap(events, state.events);
+        std::swap(output, state.output);
+    }
+
+    if (output.empty()) { return; }
+
+    std::ofstream ofs(output.c_str());
+    auto          pid = ::getpid();
+
+    ofs << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    for (auto i = events.begin(); i != events.end(); ++i) {
+        if (i != events.begin()) { ofs << ','; }
+        ofs << "\n{\"name\":\"" << i->name << "\",\"ph\":\"" << i->phase << '"';
+        if (i->phase == 'i') { ofs << ",\"s\":\"p\""; }
+        ofs << ",\"ts\":" << i->micros << ",\"pid\":" << pid << ",\"tid\":" << i->tid << '}';
+    }
+
+    ofs << "\n]}\n";
+
+    if (!ofs.flush()) {
+        ERROR("Failed to write startup trace: " << output);
+    }
+}
@@ -0,0 +1,44 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef SUPPORT__STARTUP_TRACE__HXX
+#define SUPPORT__STARTUP_TRACE__HXX
+
+#include "terminol/support/pattern.hxx"
+
+#include <string>
+
+// StartupTrace times the phases of starting up, from any thread, against a
+// monotonic clock that starts when the process is loaded. Recording stops at
+// finish(), normally once the first frame of output has been drawn, and the
+// events are written, if an output was given, as Chrome trace JSON (for
+// chrome://tracing or Perfetto). After that, or once the events fill a fixed
+// bound, each call costs only an atomic load.
+//
+// Names must be string literals, they aren't copied.
+class StartupTrace {
+public:
+    // Records the begin/end of a phase with the lifetime of the scope.
+    class Scope : private Uncopyable {
+        const char * _name;
+
+    public:
+        explicit Scope(const char * name) : _name(name) { begin(_name); }
+        ~Scope() { end(_name); }
+    };
+
+    static void begin(const char * name);
+    static void end(const char * name);
+    static void instant(const char * name);
+
+    // Where finish() will write the trace. Empty -> nowhere.
+    static void setOutput(const std::string & path);
+
+    // The value of TERMINOL_STARTUP_TRACE in the environment, if set.
+    static std::string outputFromEnvironment();
+
+    // Stop recording and write out the events. Only the first call counts.
+    static void finish();
+};
+
+#endif // SUPPORT__STARTUP_TRACE__HXX
@@ -40,18 +40,23 @@ protected:
 struct EndOfFile : StreamError {};
 
 class InMemoryStream : public InStream {
-    const std::vector<uint8_t> & _buffer;
-    size_t                       _index;
+    const uint8_t * _buffer;
+    size_t          _size;
+    size_t          _index;
 
 public:
     InMemoryStream(const std::vector<uint8_t> & buffer) :
-        _buffer(buffer), _index(0) {}
+        _buffer(buffer.data()), _size(buffer.size()), _index(0) {}
+
+    // Read directly from memory that isn't a vector, e.g. a file mapping.
+    InMemoryStream(const uint8_t * buffer, size_t size) :
+        _buffer(buffer), _size(size), _index(0) {}
 
     void readAll(void * data,
                  size_t item_size,
                  size_t num_items) throw (EndOfFile) override {
         auto size = item_size * num_items;
-        if (_index + size > _buffer.size()) {
+        if (_index + size > _size) {
             throw EndOfFile();
         }
         else {
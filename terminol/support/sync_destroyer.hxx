@@ -14,6 +14,27 @@ public:
     void add(Garbage * garbage) override {
         delete garbage;
     }
+
+    void addBatch(Batch & batch) override {
+        Garbage * last;
+        size_t    size;
+        auto      garbage = release(batch, last, size);
+
+        while (garbage) {
+            auto following = next(garbage);
+            delete garbage;
+            garbage = following;
+        }
+    }
+
+    // Nothing waits.
+    void getStats(size_t          & pending,
+                  Clock::duration & meanLatency,
+                  Clock::duration & maxLatency) const override {
+        pending     = 0;
+        meanLatency = Clock::duration::zero();
+        maxLatency  = Clock::duration::zero();
+    }
 };
 
 #endif // SUPPORT__SYNC_DESTROYER__HXX
@@ -0,0 +1,116 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/support/arena.hxx"
+
+#include <map>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+typedef std::map<Arena::Id, std::pair<Arena::Ref, std::string>> Records;
+
+void enforceRecords(const Arena & arena, const Records & records) {
+    size_t total = 0;
+
+    for (auto & r : records) {
+        auto & ref = r.second.first;
+        auto & str = r.second.second;
+
+        ENFORCE(arena.size(ref) == str.size(), "Size mismatch: " << r.first);
+        ENFORCE(std::memcmp(arena.data(ref), str.data(), str.size()) == 0,
+                "Data mismatch: " << r.first);
+        total += str.size();
+    }
+
+    ENFORCE(arena.liveBytes() >= total, "");
+}
+
+} // namespace {anonymous}
+
+int main() {
+    const size_t CHUNK_SIZE = 4096;
+
+    Arena   arena(CHUNK_SIZE);
+    Records records;
+
+    std::srand(3);
+
+    // Fill, including some records bigger than a chunk.
+    for (Arena::Id id = 0; id != 5000; ++id) {
+        auto size = std::rand() % 100 == 0 ? 3 * CHUNK_SIZE : std::rand() % 200;
+        std::string str(size, static_cast<char>('a' + id % 26));
+        auto ref = arena.allocate(id, str.data(), str.size());
+        records.insert(std::make_pair(id, std::make_pair(ref, str)));
+    }
+
+    enforceRecords(arena, records);
+    auto fullMapped = arena.mappedBytes();
+
+    // Release most records, leaving the arena fragmented.
+    for (auto iter = records.begin(); iter != records.end();) {
+        if (std::rand() % 10 != 0) {
+            arena.release(iter->second.first);
+            iter = records.erase(iter);
+        }
+        else {
+            ++iter;
+        }
+    }
+
+    enforceRecords(arena, records);
+    ENFORCE(arena.fragmented(), "Expected fragmentation.");
+
+    // Compact until done, tracking relocations.
+    while (arena.compact([&](Arena::Id id, Arena::Ref ref) {
+                         auto iter = records.find(id);
+                         ENFORCE(iter != records.end(), "Unknown id: " << id);
+                         iter->second.first = ref;
+                         }))
+    {
+        enforceRecords(arena, records);
+    }
+
+    ENFORCE(!arena.fragmented(), "Still fragmented.");
+    ENFORCE(arena.mappedBytes() < fullMapped / 2, "Memory not returned.");
+
+    // Releasing everything unmaps all but the current chunk.
+    for (auto & r : records) {
+        arena.release(r.second.first);
+    }
+    records.clear();
+
+    ENFORCE(arena.liveBytes() == 0, "");
+    ENFORCE(arena.mappedBytes() <= 3 * CHUNK_SIZE, "");
+
+    // Fragmented exactly when there is a chunk worth compacting: every
+    // chunk 60% live isn't, 40% live is.
+    {
+        Arena                   even(CHUNK_SIZE);
+        std::vector<Arena::Ref> refs;
+        std::string             str(CHUNK_SIZE / 10 - 8, 'x');
+
+        for (Arena::Id id = 0; id != 200; ++id) {
+            refs.push_back(even.allocate(id, str.data(), str.size()));
+        }
+
+        for (size_t i = 0; i != refs.size(); ++i) {
+            if (i % 10 < 4) { even.release(refs[i]); }
+        }
+
+        ENFORCE(!even.fragmented(), "");
+        ENFORCE(!even.compact([](Arena::Id, Arena::Ref) {}), "");
+
+        for (size_t i = 0; i != refs.size(); ++i) {
+            if (i % 10 == 4 || i % 10 == 5) { even.release(refs[i]); }
+        }
+
+        ENFORCE(even.fragmented(), "");
+        ENFORCE(even.compact([](Arena::Id, Arena::Ref) {}), "");
+    }
+
+    return 0;
+}
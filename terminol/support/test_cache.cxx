@@ -59,6 +59,19 @@ int main() {
 
     cache.erase(cache.find(6));
     enforceKeys(cache, {42, 99});
+    ENFORCE(cache.size() == 2, "");
+    ENFORCE(cache.find(6) == cache.end(), "");
+
+    cache.insert(6, "degrees of kevin bacon");
+    enforceKeys(cache, {42, 99, 6});
+
+    // Evict the oldest.
+    cache.erase(cache.begin());
+    enforceKeys(cache, {99, 6});
+
+    cache.clear();
+    ENFORCE(cache.empty(), "");
+    enforceKeys(cache, {});
 
     return 0;
 }
@@ -6,21 +6,32 @@
 #include "terminol/support/test.hxx"
 
 #include <atomic>
+#include <vector>
 
 namespace {
 
+class IncDec : public I_Destroyer::Garbage {
+    std::atomic_int & _count;
+
+public:
+    IncDec(std::atomic_int & count_) : _count(count_) { ++_count; }
+    ~IncDec() override                                { --_count; }
+};
+
+// Records the order of destruction. Only one thread destroys.
+class Ordered : public I_Destroyer::Garbage {
+    std::vector<int> & _order;
+    int                _id;
+
+public:
+    Ordered(std::vector<int> & order_, int id_) : _order(order_), _id(id_) {}
+    ~Ordered() override { _order.push_back(_id); }
+};
+
 template <typename Destroyer>
 void destroy(Test & test) {
     std::atomic_int count(0);
 
-    class IncDec : public I_Destroyer::Garbage {
-        std::atomic_int & _count;
-
-    public:
-        IncDec(std::atomic_int & count_) : _count(count_) { ++_count; }
-        ~IncDec() override                                { --_count; }
-    };
-
     {
         ENFORCE(count.load() == 0, "Zero counter at start.");
 
@@ -34,12 +45,92 @@ void destroy(Test & test) {
     test.assertEqual(0, count.load(), "All garbage has been destroyed.");
 }
 
+template <typename Destroyer>
+void batch(Test & test) {
+    std::atomic_int  count(0);
+    std::vector<int> order;
+
+    {
+        Destroyer          destroyer;
+        I_Destroyer::Batch batch;
+
+        for (int i = 0; i != 100; ++i) {
+            batch.add(new IncDec(count));
+        }
+
+        test.assertEqual(batch.size(), size_t(100), "Gathered.");
+        destroyer.addBatch(batch);
+        test.assert(batch.empty(), "Taken.");
+
+        for (int i = 0; i != 100; ++i) {
+            if (i % 10 == 0) {
+                destroyer.add(new Ordered(order, i));
+            }
+            else {
+                batch.add(new Ordered(order, i));
+                if (i % 10 == 9) { destroyer.addBatch(batch); }
+            }
+        }
+    }
+
+    test.assertEqual(0, count.load(), "All garbage has been destroyed.");
+
+    std::vector<int> expected;
+    for (int i = 0; i != 100; ++i) { expected.push_back(i); }
+    test.assert(order == expected, "Destroyed in the order added.");
+
+    // Garbage never added is destroyed with the batch.
+    {
+        I_Destroyer::Batch batch;
+        batch.add(new IncDec(count));
+    }
+
+    test.assertEqual(0, count.load(), "Unadded garbage destroyed.");
+}
+
+// Garbage added from many threads at once.
+void producers(Test & test) {
+    std::atomic_int count(0);
+
+    {
+        AsyncDestroyer           destroyer;
+        std::vector<std::thread> threads;
+
+        for (int t = 0; t != 4; ++t) {
+            threads.emplace_back([&] {
+                for (int i = 0; i != 10000; ++i) {
+                    destroyer.add(new IncDec(count));
+                }
+            });
+        }
+
+        for (auto & thread : threads) { thread.join(); }
+
+        // Wait for the background thread to catch up.
+        size_t                       pending;
+        I_Destroyer::Clock::duration meanLatency, maxLatency;
+
+        do {
+            std::this_thread::yield();
+            destroyer.getStats(pending, meanLatency, maxLatency);
+        } while (pending != 0);
+
+        test.assertEqual(0, count.load(), "Nothing pending.");
+        test.assert(meanLatency <= maxLatency, "Latencies.");
+    }
+
+    test.assertEqual(0, count.load(), "All garbage has been destroyed.");
+}
+
 } // namespace {anonymous}
 
 int main() {
     Test test("support/destroyer");
     test.run("async", destroy<AsyncDestroyer>);
     test.run("sync", destroy<SyncDestroyer>);
+    test.run("async-batch", batch<AsyncDestroyer>);
+    test.run("sync-batch", batch<SyncDestroyer>);
+    test.run("producers", producers);
 
-    return 0;
+    return test.rval();
 }
@@ -0,0 +1,105 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/support/fenwick_tree.hxx"
+
+#include <deque>
+#include <cstdlib>
+
+namespace {
+
+void enforceSame(const FenwickTree & tree, const std::deque<uint32_t> & ref) {
+    ENFORCE(tree.size() == ref.size(), "Size mismatch.");
+
+    uint32_t sum = 0;
+
+    for (size_t i = 0; i != ref.size(); ++i) {
+        ENFORCE(tree.get(i) == ref[i], "Value mismatch: " << i);
+        ENFORCE(tree.prefix(i) == sum, "Prefix mismatch: " << i);
+
+        for (uint32_t o = 0; o != ref[i]; ++o) {
+            uint32_t remainder;
+            ENFORCE(tree.find(sum + o, remainder) == i, "Find mismatch: " << sum + o);
+            ENFORCE(remainder == o, "Remainder mismatch: " << sum + o);
+        }
+
+        sum += ref[i];
+    }
+
+    ENFORCE(tree.prefix(ref.size()) == sum, "");
+    ENFORCE(tree.total() == sum, "Total mismatch.");
+}
+
+} // namespace {anonymous}
+
+int main() {
+    FenwickTree          tree;
+    std::deque<uint32_t> ref;
+
+    std::srand(7);
+
+    // Mixed operations, with zeros common enough to be skipped by find().
+    for (int round = 0; round != 200; ++round) {
+        for (int op = 0; op != 100; ++op) {
+            auto value = static_cast<uint32_t>(std::rand() % 4);
+
+            switch (ref.empty() ? 0 : std::rand() % 5) {
+                case 0:
+                case 1:
+                    tree.push_back(value);
+                    ref.push_back(value);
+                    break;
+                case 2:
+                    tree.pop_back();
+                    ref.pop_back();
+                    break;
+                case 3:
+                    tree.pop_front();
+                    ref.pop_front();
+                    break;
+                case 4: {
+                    auto index = std::rand() % ref.size();
+                    tree.set(index, value);
+                    ref[index] = value;
+                    break;
+                }
+            }
+        }
+
+        enforceSame(tree, ref);
+    }
+
+    // Shadow a long-running queue, forcing the dead prefix to be reclaimed.
+    tree.assign(100, 2);
+    ref.assign(100, 2);
+
+    for (uint32_t i = 0; i != 50000; ++i) {
+        tree.push_back(i % 3 + 1);
+        ref.push_back(i % 3 + 1);
+        tree.pop_front();
+        ref.pop_front();
+    }
+
+    enforceSame(tree, ref);
+
+    // Pop ranges both small and large relative to the tree.
+    for (uint32_t i = 0; i != 30000; ++i) {
+        tree.push_back(i % 5);
+        ref.push_back(i % 5);
+    }
+
+    for (size_t count : { 1, 10, 1000, 20000 }) {
+        tree.pop_front(count);
+        ref.erase(ref.begin(), ref.begin() + count);
+        enforceSame(tree, ref);
+    }
+
+    while (!ref.empty()) {
+        tree.pop_back();
+        ref.pop_back();
+    }
+
+    enforceSame(tree, ref);
+
+    return 0;
+}
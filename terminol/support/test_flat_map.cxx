@@ -0,0 +1,116 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/support/flat_map.hxx"
+#include "terminol/support/hash.hxx"
+
+#include <map>
+#include <limits>
+#include <string>
+#include <cstdlib>
+
+namespace {
+
+// All keys collide, forcing long probe sequences and wrap-around.
+struct BadHash {
+    size_t operator () (uint32_t) const { return 0; }
+};
+
+template <typename Hash>
+void enforceSame(const FlatMap<uint32_t, std::string, Hash> & flat,
+                 const std::map<uint32_t, std::string>       & ref) {
+    ENFORCE(flat.size() == ref.size(), "Size mismatch.");
+
+    size_t count = 0;
+    for (auto & pair : flat) {
+        auto iter = ref.find(pair.first);
+        ENFORCE(iter != ref.end(), "Unexpected key: " << pair.first);
+        ENFORCE(iter->second == pair.second, "Value mismatch.");
+        ++count;
+    }
+    ENFORCE(count == ref.size(), "Iteration count mismatch.");
+
+    for (auto & pair : ref) {
+        auto iter = flat.find(pair.first);
+        ENFORCE(iter != flat.end(), "Missing key: " << pair.first);
+        ENFORCE(iter->second == pair.second, "Value mismatch.");
+    }
+}
+
+template <typename Hash>
+void churn(uint32_t range, int rounds) {
+    const uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+
+    FlatMap<uint32_t, std::string, Hash> flat(EMPTY);
+    std::map<uint32_t, std::string>      ref;
+
+    std::srand(42);
+
+    for (int i = 0; i != rounds; ++i) {
+        uint32_t key = std::rand() % range;
+        auto     ri  = ref.find(key);
+        auto     fi  = flat.find(key);
+
+        ENFORCE((ri == ref.end()) == (fi == flat.end()), "Presence mismatch.");
+
+        if (ri == ref.end()) {
+            auto value = std::to_string(i);
+            ref.insert(std::make_pair(key, value));
+            flat.insert(key, std::move(value));
+        }
+        else {
+            ref.erase(ri);
+            flat.erase(fi);
+        }
+
+        if (i % 97 == 0) { enforceSame(flat, ref); }
+    }
+
+    enforceSame(flat, ref);
+}
+
+} // namespace {anonymous}
+
+int main() {
+    {
+        FlatMap<uint32_t, int> map(0);
+        ENFORCE(map.empty(), "");
+        ENFORCE(map.find(7) == map.end(), "");
+
+        map.insert(7, 49);
+        map.insert(8, 64);
+        ENFORCE(map.size() == 2, "");
+        ENFORCE(map.find(7)->second == 49, "");
+
+        map.erase(map.find(7));
+        ENFORCE(map.find(7) == map.end(), "");
+        ENFORCE(map.find(8)->second == 64, "");
+
+        map.reserve(1000);
+        ENFORCE(map.capacity() >= 1000, "");
+        ENFORCE(map.find(8)->second == 64, "");
+
+        map.clear();
+        ENFORCE(map.empty(), "");
+    }
+
+    churn<std::hash<uint32_t>>(1000, 20000);
+    churn<BadHash>(100, 2000);
+
+    {
+        const char str[] = "The quick brown fox jumps over the lazy dog";
+        // Every prefix length exercises a different tail size.
+        for (size_t i = 0; i != sizeof str; ++i) {
+            ENFORCE(hash64(str, i) == hash64(str, i), "");
+            if (i != 0) { ENFORCE(hash64(str, i) != hash64(str, i - 1), ""); }
+        }
+        ENFORCE(hash64(str, 8, 0) != hash64(str, 8, 1), "Seed ignored.");
+
+        // Snapshots persist the values, they mustn't change.
+        ENFORCE(hash64(str, 5) == UINT64_C(0x075F659EA4700789), "");
+        ENFORCE(hash64(str, 8) == UINT64_C(0xB70636B16E9FC04B), "");
+        ENFORCE(hash64(str, sizeof str - 1) == UINT64_C(0x5589CA33042A861B), "");
+    }
+
+    return 0;
+}
@@ -0,0 +1,108 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/support/frame_trace.hxx"
+#include "terminol/support/test.hxx"
+
+#include <thread>
+#include <sstream>
+
+namespace {
+
+void counters(Test & test) {
+    FrameTrace         trace;
+    FrameTrace::Frame  frame;
+    std::vector<FrameTrace::Frame> frames;
+
+    test.assert(!trace.last(frame), "No frames yet.");
+    trace.snapshot(frames);
+    test.assert(frames.empty(), "Empty snapshot.");
+
+    trace.add(FrameTrace::BYTES_READ, 10);
+    trace.add(FrameTrace::BYTES_READ, 5);
+    trace.add(FrameTrace::DRAW_CALLS, 3);
+    trace.addTime(FrameTrace::DRAW, std::chrono::microseconds(7));
+    trace.commit();
+
+    test.assert(trace.last(frame), "A frame.");
+    test.assertEqual(frame.number, uint64_t(0), "First frame.");
+    test.assertEqual(frame.counters[FrameTrace::BYTES_READ], uint32_t(15), "Bytes accumulate.");
+    test.assertEqual(frame.counters[FrameTrace::DRAW_CALLS], uint32_t(3), "Draw calls.");
+    test.assertEqual(frame.micros[FrameTrace::DRAW], uint32_t(7), "Draw time.");
+    test.assertEqual(frame.totalMicros(), uint32_t(7), "Total time.");
+
+    // The next frame starts from zero.
+    trace.commit();
+    test.assert(trace.last(frame), "Another frame.");
+    test.assertEqual(frame.number, uint64_t(1), "Second frame.");
+    test.assertEqual(frame.counters[FrameTrace::BYTES_READ], uint32_t(0), "Reset.");
+
+    std::ostringstream ost;
+    trace.snapshot(frames);
+    FrameTrace::dump(ost, frames);
+    test.assert(ost.str().find("frame=0 bytes=15 ") == 0, "Dumped.");
+}
+
+void wrap(Test & test) {
+    FrameTrace trace;
+
+    for (uint32_t i = 0; i != FrameTrace::CAPACITY + 10; ++i) {
+        trace.add(FrameTrace::CELLS_WRITTEN, i);
+        trace.commit();
+    }
+
+    std::vector<FrameTrace::Frame> frames;
+    trace.snapshot(frames);
+
+    test.assertEqual(frames.size(), FrameTrace::CAPACITY, "Bounded.");
+    test.assertEqual(frames.front().number, uint64_t(10), "Oldest first.");
+
+    bool ordered = true;
+    for (size_t i = 0; i != frames.size(); ++i) {
+        ordered = ordered &&
+            frames[i].number == i + 10 &&
+            frames[i].counters[FrameTrace::CELLS_WRITTEN] == i + 10;
+    }
+    test.assert(ordered, "In order, intact.");
+}
+
+// A reader never sees a frame torn by a concurrent commit.
+void concurrent(Test & test) {
+    FrameTrace        trace;
+    std::atomic<bool> done(false);
+
+    std::thread writer([&] {
+        for (uint32_t i = 1; i != 20000; ++i) {
+            trace.add(FrameTrace::BYTES_READ, i);
+            trace.add(FrameTrace::SEQUENCES, i);
+            trace.commit();
+        }
+        done = true;
+    });
+
+    bool                           intact = true;
+    std::vector<FrameTrace::Frame> frames;
+
+    while (!done) {
+        trace.snapshot(frames);
+        for (auto & frame : frames) {
+            intact = intact &&
+                frame.counters[FrameTrace::BYTES_READ] == frame.number + 1 &&
+                frame.counters[FrameTrace::SEQUENCES]  == frame.number + 1;
+        }
+    }
+
+    writer.join();
+    test.assert(intact, "No torn frames.");
+}
+
+} // namespace {anonymous}
+
+int main() {
+    Test test("support/frame-trace");
+    test.run("counters", counters);
+    test.run("wrap", wrap);
+    test.run("concurrent", concurrent);
+
+    return test.rval();
+}
@@ -0,0 +1,55 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/support/lz.hxx"
+#include "terminol/support/debug.hxx"
+
+#include <string>
+#include <cstdlib>
+
+namespace {
+
+void roundTrip(const std::string & input) {
+    auto src = reinterpret_cast<const uint8_t *>(input.data());
+
+    std::vector<uint8_t> compressed;
+    lz::compress(src, input.size(), compressed);
+
+    std::vector<uint8_t> output(input.size());
+    ENFORCE(lz::decompress(compressed.data(), compressed.size(), output.data(), output.size()),
+            "Decompress failed, size: " << input.size());
+    ENFORCE(std::string(output.begin(), output.end()) == input, "Round trip mismatch.");
+
+    // A wrong size must be detected.
+    std::vector<uint8_t> longer(input.size() + 1);
+    ENFORCE(!lz::decompress(compressed.data(), compressed.size(), longer.data(), longer.size()), "");
+}
+
+} // namespace {anonymous}
+
+int main() {
+    std::srand(5);
+
+    roundTrip("");
+    roundTrip("a");
+    roundTrip("abcd");
+    roundTrip(std::string(100000, 'x'));            // Overlapping matches.
+
+    // Random bytes don't compress but must survive.
+    std::string noise;
+    for (int i = 0; i != 20000; ++i) { noise.push_back(static_cast<char>(std::rand())); }
+    roundTrip(noise);
+
+    // Log-like text, which should compress well.
+    std::string log;
+    for (int i = 0; i != 2000; ++i) {
+        log += "g++ -std=c++11 -Wall -c terminol/common/file" + std::to_string(i % 37) + ".cxx\n";
+    }
+    roundTrip(log);
+
+    std::vector<uint8_t> compressed;
+    lz::compress(reinterpret_cast<const uint8_t *>(log.data()), log.size(), compressed);
+    ENFORCE(compressed.size() * 4 < log.size(), "Poor ratio: " << compressed.size());
+
+    return 0;
+}
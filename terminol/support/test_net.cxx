@@ -58,6 +58,10 @@ protected:
 
     // SocketClient::I_Observer implementation:
 
+    void clientReceived(const uint8_t * UNUSED(data), size_t size) override {
+        PRINT("Client received bytes: " << size);
+    }
+
     void clientDisconnected() override {
         PRINT("Client disconnected");
     }
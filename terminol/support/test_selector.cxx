@@ -0,0 +1,107 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/support/selector.hxx"
+#include "terminol/support/pipe.hxx"
+#include "terminol/support/test.hxx"
+
+namespace {
+
+// Records the order in which the fds are read.
+class Handler : public I_Selector::I_ReadHandler {
+public:
+    std::vector<int> order;
+
+    virtual ~Handler() {}
+
+    void handleRead(int fd) override {
+        char c;
+        while (TEMP_FAILURE_RETRY(::read(fd, &c, 1)) == 1) {}
+        order.push_back(fd);
+    }
+};
+
+void ready(Pipe & pipe) {
+    char c = 0;
+    ENFORCE_SYS(TEMP_FAILURE_RETRY(::write(pipe.writeFd(), &c, 1)) == 1, "");
+}
+
+void urgent(Test & test) {
+    Selector selector;
+    Pipe     a, b;
+    Handler  handler;
+
+    selector.addReadable(a.readFd(), &handler);
+    selector.addReadable(b.readFd(), &handler);
+
+    const std::vector<int> aFirst = { a.readFd(), b.readFd() };
+    const std::vector<int> bFirst = { b.readFd(), a.readFd() };
+
+    // 'b' is ready first, but 'a' is urgent.
+    selector.setUrgent(a.readFd(), true);
+    ready(b);
+    ready(a);
+    selector.animate();
+    test.assert(handler.order == aFirst, "Urgent first.");
+
+    handler.order.clear();
+    selector.setUrgent(a.readFd(), false);
+    selector.setUrgent(b.readFd(), true);
+    ready(a);
+    ready(b);
+    selector.animate();
+    test.assert(handler.order == bFirst, "Urgency changed.");
+
+    // Removal forgets the urgency.
+    handler.order.clear();
+    selector.removeReadable(b.readFd());
+    selector.addReadable(b.readFd(), &handler);
+    selector.setUrgent(a.readFd(), true);
+    ready(b);
+    ready(a);
+    selector.animate();
+    test.assert(handler.order == aFirst, "Forgotten when removed.");
+
+    selector.removeReadable(a.readFd());
+    selector.removeReadable(b.readFd());
+}
+
+// An fd that is always ready doesn't hold up the timeouts.
+void starved(Test & test) {
+    Selector selector;
+    Pipe     pipe;
+
+    class Busy :
+        public I_Selector::I_ReadHandler,
+        public I_Selector::I_TimeoutHandler
+    {
+    public:
+        int reads    = 0;
+        int timeouts = 0;
+        virtual ~Busy() {}
+        void handleRead(int UNUSED(fd)) override { ++reads; }
+        void handleTimeout() override { ++timeouts; }
+    } busy;
+
+    ready(pipe);
+    selector.addReadable(pipe.readFd(), &busy);
+    selector.addTimeoutable(&busy, 1);
+
+    for (int i = 0; i != 100000 && busy.timeouts == 0; ++i) {
+        selector.animate();
+    }
+
+    test.assertEqual(busy.timeouts, 1, "Timed out while busy.");
+
+    selector.removeReadable(pipe.readFd());
+}
+
+} // namespace {anonymous}
+
+int main() {
+    Test test("support/selector");
+    test.run("urgent", urgent);
+    test.run("starved", starved);
+
+    return test.rval();
+}
@@ -0,0 +1,53 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/support/small_vector.hxx"
+
+#include <numeric>
+
+int main() {
+    {
+        SmallVector<int, 4> vec;
+        ENFORCE(vec.empty(), "");
+        ENFORCE(!vec.full(), "");
+        ENFORCE(!vec.overflowed(), "");
+
+        for (int i = 0; i != 4; ++i) { vec.push_back(i); }
+        ENFORCE(vec.size() == 4, "");
+        ENFORCE(vec.full(), "");
+        ENFORCE(!vec.overflowed(), "");
+        ENFORCE(vec.front() == 0 && vec.back() == 3, "");
+        ENFORCE(std::accumulate(vec.begin(), vec.end(), 0) == 6, "");
+
+        // Pushing onto a full vector drops the element.
+        vec.push_back(4);
+        ENFORCE(vec.size() == 4, "");
+        ENFORCE(vec.overflowed(), "");
+        ENFORCE(vec.back() == 3, "");
+
+        vec.back() = 7;
+        ENFORCE(vec[3] == 7, "");
+        vec.pop_back();
+        ENFORCE(vec.size() == 3, "");
+        ENFORCE(vec.overflowed(), "Overflow survives pop_back.");
+
+        vec.clear();
+        ENFORCE(vec.empty(), "");
+        ENFORCE(!vec.overflowed(), "");
+    }
+
+    {
+        SmallVector<int, 3> lhs = { 1, 2 };
+        SmallVector<int, 3> rhs = { 1, 2 };
+        ENFORCE(lhs == rhs, "");
+        rhs.push_back(3);
+        ENFORCE(lhs != rhs, "");
+        lhs.push_back(4);
+        ENFORCE(lhs != rhs, "");
+
+        SmallVector<int, 2> trunc = { 1, 2, 3 };
+        ENFORCE(trunc.size() == 2 && trunc.overflowed(), "");
+    }
+
+    return 0;
+}
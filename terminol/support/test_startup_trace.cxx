@@ -0,0 +1,74 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/support/startup_trace.hxx"
+#include "terminol/support/test.hxx"
+
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <unistd.h>
+
+namespace {
+
+std::string readFile(const std::string & path) {
+    std::ifstream      ifs(path.c_str());
+    std::ostringstream ost;
+    ost << ifs.rdbuf();
+    return ost.str();
+}
+
+size_t count(const std::string & text, const std::string & pattern) {
+    size_t n = 0;
+    for (auto i = text.find(pattern); i != std::string::npos; i = text.find(pattern, i + 1)) {
+        ++n;
+    }
+    return n;
+}
+
+void trace(Test & test) {
+    char path[] = "/tmp/test-startup-trace-XXXXXX";
+    auto fd = ::mkstemp(path);
+    ENFORCE_SYS(fd != -1, "");
+    ::close(fd);
+
+    StartupTrace::setOutput(path);
+
+    {
+        StartupTrace::Scope scope("outer");
+        StartupTrace::instant("marker");
+
+        std::thread thread([] { StartupTrace::Scope inner("inner"); });
+        thread.join();
+    }
+
+    StartupTrace::finish();
+
+    auto text = readFile(path);
+    test.assert(text.find("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[") == 0, "Header.");
+    test.assertEqual(count(text, "\"ph\":\"B\""), size_t(2), "Two begins.");
+    test.assertEqual(count(text, "\"ph\":\"E\""), size_t(2), "Two ends.");
+    test.assertEqual(count(text, "\"ph\":\"i\""), size_t(1), "One instant.");
+    test.assert(text.find("\"name\":\"inner\",\"ph\":\"B\"") != std::string::npos, "Inner scope.");
+    test.assert(text.find("\"tid\":1") != std::string::npos &&
+                text.find("\"tid\":2") != std::string::npos, "Threads distinguished.");
+    test.assert(text.rfind("]}\n") == text.size() - 3, "Closed.");
+
+    // Nothing more is recorded or written.
+    ::unlink(path);
+    StartupTrace::instant("late");
+    StartupTrace::setOutput(path);
+    StartupTrace::finish();
+    test.assert(::access(path, F_OK) == -1, "Finished once.");
+    ::unlink(path);
+}
+
+} // namespace {anonymous}
+
+int main() {
+    Test test("support/startup-trace");
+    test.run("trace", trace);
+
+    return test.rval();
+}
@@ -2,6 +2,11 @@
 // Copyright © 2015 David Bryant
 
 #include "terminol/support/stream.hxx"
+#include "terminol/support/file_stream.hxx"
+#include "terminol/support/debug.hxx"
+
+#include <string>
+#include <unistd.h>
 
 int main() {
     std::vector<uint8_t> bytes;
@@ -9,5 +14,47 @@ int main() {
     OutMemoryStream os(bytes, true);
     InMemoryStream is(bytes);
 
+    // Round trip through a file, including writes bigger than the buffer.
+    std::string path = "/tmp/terminol-test-stream-" + std::to_string(::getpid());
+    std::vector<uint8_t> big(200 * 1024);
+    for (size_t i = 0; i != big.size(); ++i) { big[i] = static_cast<uint8_t>(i * 7); }
+
+    {
+        OutFileStream ofs(path);
+        uint32_t value = 42;
+        ofs.writeAll(&value, sizeof value, 1);
+        ofs.writeAll(big.data(), 1, big.size());
+        ofs.commit();
+    }
+
+    {
+        MappedFile file(path);
+        ENFORCE(file.size() == sizeof(uint32_t) + big.size(), "");
+
+        InMemoryStream ifs(file.data(), file.size());
+        uint32_t value;
+        ifs.readAll(&value, sizeof value, 1);
+        ENFORCE(value == 42, "");
+
+        std::vector<uint8_t> big2(big.size());
+        ifs.readAll(big2.data(), 1, big2.size());
+        ENFORCE(big2 == big, "");
+
+        try {
+            ifs.readAll(&value, sizeof value, 1);
+            FATAL("Expected EndOfFile.");
+        }
+        catch (const EndOfFile &) {}
+    }
+
+    ::unlink(path.c_str());
+
+    // An uncommitted file never appears.
+    {
+        OutFileStream ofs(path);
+        ofs.writeAll(big.data(), 1, 10);
+    }
+    ENFORCE(::access(path.c_str(), F_OK) == -1, "");
+
     return 0;
 }
@@ -0,0 +1,122 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/support/timer_heap.hxx"
+#include "terminol/support/test.hxx"
+
+#include <algorithm>
+#include <map>
+#include <random>
+
+namespace {
+
+typedef TimerHeap<int>  Heap;
+typedef Heap::TimePoint TimePoint;
+
+TimePoint at(int ms) {
+    return TimePoint(std::chrono::milliseconds(ms));
+}
+
+void order(Test & test) {
+    Heap heap;
+
+    heap.add(3, at(30));
+    heap.add(1, at(10));
+    heap.add(4, at(40));
+    heap.add(2, at(20));
+
+    test.assert(heap.nextTime() == at(10), "Earliest next.");
+    test.assert(!heap.expired(at(9)), "Not yet expired.");
+    test.assert(heap.expired(at(10)), "Expired.");
+
+    std::vector<int> keys;
+    while (!heap.empty()) { keys.push_back(heap.pop()); }
+
+    test.assert(keys == std::vector<int>({ 1, 2, 3, 4 }), "Popped in order.");
+}
+
+void ties(Test & test) {
+    Heap heap;
+
+    for (int i = 0; i != 8; ++i) { heap.add(i, at(5)); }
+
+    std::vector<int> keys;
+    while (!heap.empty()) { keys.push_back(heap.pop()); }
+
+    test.assert(keys == std::vector<int>({ 0, 1, 2, 3, 4, 5, 6, 7 }), "Popped as added.");
+}
+
+void removal(Test & test) {
+    Heap heap;
+
+    for (int i = 0; i != 10; ++i) { heap.add(i, at(10 * i)); }
+
+    test.assert(heap.remove(0), "First removed.");
+    test.assert(heap.remove(5), "Middle removed.");
+    test.assert(heap.remove(9), "Last removed.");
+    test.assert(!heap.remove(5), "Not removed twice.");
+    test.assert(!heap.contains(5), "Gone.");
+    test.assertEqual(heap.size(), size_t(7), "Remainder.");
+
+    std::vector<int> keys;
+    while (!heap.empty()) { keys.push_back(heap.pop()); }
+
+    test.assert(keys == std::vector<int>({ 1, 2, 3, 4, 6, 7, 8 }), "Rest in order.");
+
+    // Keys can be added again once removed.
+    heap.add(5, at(1));
+    test.assert(heap.contains(5), "Re-added.");
+}
+
+// Random operations against a sorted reference.
+void randomised(Test & test) {
+    Heap                               heap;
+    std::map<std::pair<int, int>, int> reference;   // (time, sequence) -> key.
+    std::map<int, std::pair<int, int>> times;       // key -> (time, sequence).
+    std::mt19937                       generator(1);
+    int                                sequence = 0;
+    bool                               ok       = true;
+
+    for (int i = 0; i != 10000 && ok; ++i) {
+        auto key = static_cast<int>(generator() % 64);
+        auto op  = generator() % 3;
+
+        if (op == 0 && !heap.contains(key)) {
+            auto time = static_cast<int>(generator() % 100);
+            heap.add(key, at(time));
+            reference[std::make_pair(time, sequence)] = key;
+            times[key] = std::make_pair(time, sequence);
+            ++sequence;
+        }
+        else if (op == 1) {
+            auto iter = times.find(key);
+            ok = heap.remove(key) == (iter != times.end());
+            if (iter != times.end()) {
+                reference.erase(iter->second);
+                times.erase(iter);
+            }
+        }
+        else if (!heap.empty()) {
+            auto front = reference.begin();
+            ok = heap.nextTime() == at(front->first.first) && heap.pop() == front->second;
+            times.erase(front->second);
+            reference.erase(front);
+        }
+
+        ok = ok && heap.size() == reference.size();
+    }
+
+    test.assert(ok, "Matches reference.");
+}
+
+} // namespace {anonymous}
+
+int main() {
+    Test test("support/timer-heap");
+    test.run("order", order);
+    test.run("ties", ties);
+    test.run("removal", removal);
+    test.run("randomised", randomised);
+
+    return test.rval();
+}
@@ -0,0 +1,123 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/support/worker.hxx"
+#include "terminol/support/test.hxx"
+
+#include <atomic>
+
+namespace {
+
+// Counts the reads and timeouts handled on the worker's thread. Only
+// touched with the worker locked.
+class Handler :
+    public I_Selector::I_ReadHandler,
+    public I_Selector::I_TimeoutHandler
+{
+public:
+    std::thread::id thread;
+    int             reads;
+    int             timeouts;
+
+    Handler() : thread(), reads(0), timeouts(0) {}
+    virtual ~Handler() {}
+
+    void handleRead(int fd) override {
+        char c;
+        while (TEMP_FAILURE_RETRY(::read(fd, &c, 1)) == 1) { ++reads; }
+        thread = std::this_thread::get_id();
+    }
+
+    void handleTimeout() override {
+        ++timeouts;
+        thread = std::this_thread::get_id();
+    }
+};
+
+// Poll, with the worker locked, until 'done' is true.
+template <typename Lockable, typename Func>
+void waitFor(Lockable & lockable, Func && done) {
+    for (;;) {
+        {
+            std::unique_lock<Lockable> lock(lockable);
+            if (done()) { return; }
+        }
+        std::this_thread::yield();
+    }
+}
+
+void handlers(Test & test) {
+    Worker  worker;
+    Pipe    pipe;
+    Handler handler;
+
+    {
+        std::unique_lock<Worker> lock(worker);
+        worker.getSelector().addReadable(pipe.readFd(), &handler);
+    }
+
+    char c = 0;
+    for (int i = 0; i != 3; ++i) {
+        ENFORCE_SYS(TEMP_FAILURE_RETRY(::write(pipe.writeFd(), &c, 1)) == 1, "");
+    }
+
+    waitFor(worker, [&] { return handler.reads == 3; });
+    test.assert(handler.thread != std::this_thread::get_id(), "Read on the worker's thread.");
+
+    // A timeout registered while the worker is waiting indefinitely.
+    {
+        std::unique_lock<Worker> lock(worker);
+        worker.getSelector().addTimeoutable(&handler, 1);
+    }
+
+    waitFor(worker, [&] { return handler.timeouts == 1; });
+    test.assert(handler.thread != std::this_thread::get_id(), "Timed out on the worker's thread.");
+
+    std::unique_lock<Worker> lock(worker);
+    worker.getSelector().removeReadable(pipe.readFd());
+}
+
+// A busy worker still lets other threads in.
+void busy(Test & test) {
+    WorkerPool pool(2);
+    Pipe       pipe;        // Always readable.
+    auto     & worker = pool.choose();
+
+    char c = 0;
+    ENFORCE_SYS(TEMP_FAILURE_RETRY(::write(pipe.writeFd(), &c, 1)) == 1, "");
+
+    class Busy : public I_Selector::I_ReadHandler {
+    public:
+        std::atomic<int> count;
+        Busy() : count(0) {}
+        virtual ~Busy() {}
+        void handleRead(int UNUSED(fd)) override { ++count; }
+    } busy;
+
+    {
+        std::unique_lock<Worker> lock(worker);
+        worker.getSelector().addReadable(pipe.readFd(), &busy);
+    }
+
+    // Neither this thread nor the worker is starved.
+    for (int i = 0; i != 100; ++i) {
+        std::unique_lock<WorkerPool> lock(pool);
+    }
+
+    auto count = busy.count.load();
+    waitFor(pool, [&] { return busy.count > count; });
+    test.assert(busy.count > count, "The worker still runs.");
+
+    std::unique_lock<WorkerPool> lock(pool);
+    worker.getSelector().removeReadable(pipe.readFd());
+}
+
+} // namespace {anonymous}
+
+int main() {
+    Test test("support/worker");
+    test.run("handlers", handlers);
+    test.run("busy", busy);
+
+    return test.rval();
+}
@@ -0,0 +1,144 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef SUPPORT__TIMER_HEAP__HXX
+#define SUPPORT__TIMER_HEAP__HXX
+
+#include "terminol/support/debug.hxx"
+
+#include <vector>
+#include <unordered_map>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// TimerHeap orders keys (e.g. timeout handlers) by expiry time, earliest
+// first, as a binary min-heap. Each key appears at most once and its position
+// in the heap is indexed, so adding, removing and popping are O(log n) and
+// the next expiry is O(1). Keys expiring at the same time are popped in the
+// order they were added.
+template <typename Key, typename Clock = std::chrono::steady_clock>
+class TimerHeap {
+public:
+    typedef typename Clock::time_point TimePoint;
+
+private:
+    struct Entry {
+        Entry(TimePoint time_, uint64_t sequence_, Key key_) :
+            time(time_), sequence(sequence_), key(key_) {}
+
+        TimePoint time;
+        uint64_t  sequence;     // Ties broken by order of addition.
+        Key       key;
+    };
+
+    std::vector<Entry>              _heap;
+    std::unordered_map<Key, size_t> _positions;     // Of each key in _heap.
+    uint64_t                        _sequence;
+
+public:
+    TimerHeap() : _heap(), _positions(), _sequence(0) {}
+
+    size_t size()  const { return _heap.size(); }
+    bool   empty() const { return _heap.empty(); }
+
+    bool contains(Key key) const {
+        return _positions.find(key) != _positions.end();
+    }
+
+    void add(Key key, TimePoint time) {
+        ASSERT(!contains(key), "Already added.");
+        _heap.push_back(Entry(time, _sequence++, key));
+        _positions[key] = _heap.size() - 1;
+        siftUp(_heap.size() - 1);
+    }
+
+    // Returns false if 'key' wasn't added.
+    bool remove(Key key) {
+        auto iter = _positions.find(key);
+        if (iter == _positions.end()) { return false; }
+
+        auto index = iter->second;
+        _positions.erase(iter);
+
+        auto last = _heap.size() - 1;
+
+        if (index != last) {
+            move(last, index);
+            _heap.pop_back();
+            // The moved entry may belong either above or below.
+            siftDown(siftUp(index));
+        }
+        else {
+            _heap.pop_back();
+        }
+
+        return true;
+    }
+
+    TimePoint nextTime() const {
+        ASSERT(!empty(), "");
+        return _heap.front().time;
+    }
+
+    // Whether the next key expires no later than 'now'.
+    bool expired(TimePoint now) const {
+        return !empty() && !(now < nextTime());
+    }
+
+    // Remove and return the key with the earliest expiry.
+    Key pop() {
+        ASSERT(!empty(), "");
+        auto key = _heap.front().key;
+        remove(key);
+        return key;
+    }
+
+protected:
+    static bool before(const Entry & lhs, const Entry & rhs) {
+        return lhs.time < rhs.time ||
+            (lhs.time == rhs.time && lhs.sequence < rhs.sequence);
+    }
+
+    // Move the entry at 'from' to 'to', overwriting whatever is there.
+    void move(size_t from, size_t to) {
+        _heap[to] = _heap[from];
+        _positions[_heap[to].key] = to;
+    }
+
+    void swap(size_t i, size_t j) {
+        std::swap(_heap[i], _heap[j]);
+        _positions[_heap[i].key] = i;
+        _positions[_heap[j].key] = j;
+    }
+
+    // Returns the entry's final position.
+    size_t siftUp(size_t index) {
+        while (index != 0) {
+            auto parent = (index - 1) / 2;
+            if (!before(_heap[index], _heap[parent])) { break; }
+            swap(index, parent);
+            index = parent;
+        }
+
+        return index;
+    }
+
+    void siftDown(size_t index) {
+        for (;;) {
+            auto least = index;
+            auto left  = 2 * index + 1;
+            auto right = left + 1;
+
+            if (left  < _heap.size() && before(_heap[left],  _heap[least])) { least = left;  }
+            if (right < _heap.size() && before(_heap[right], _heap[least])) { least = right; }
+
+            if (least == index) { break; }
+
+            swap(index, least);
+            index = least;
+        }
+    }
+};
+
+#endif // SUPPORT__TIMER_HEAP__HXX
@@ -0,0 +1,149 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef SUPPORT__WORKER__HXX
+#define SUPPORT__WORKER__HXX
+
+#include "terminol/support/selector.hxx"
+#include "terminol/support/pipe.hxx"
+#include "terminol/support/pattern.hxx"
+
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+// Worker runs a Selector on a thread of its own. Whatever is registered with
+// the selector belongs to the worker: the handlers are called with the
+// worker's mutex held and other threads must hold it, by locking the worker,
+// to touch them. The mutex is released while the selector waits, and the
+// worker gives way after each dispatch if another thread is waiting for it,
+// so that a busy worker can't starve the other threads.
+class Worker :
+    protected I_Selector::I_ReadHandler,
+    private Uncopyable
+{
+    Selector                _selector;
+    Pipe                    _pipe;          // Wakes the selector.
+    std::mutex              _mutex;
+    std::condition_variable _condition;     // Signalled when unlocked by another thread.
+    std::atomic<int>        _waiters;       // Other threads waiting to lock.
+    std::atomic<bool>       _finished;
+    std::thread             _thread;
+
+public:
+    Worker() :
+        _selector(),
+        _pipe(),
+        _mutex(),
+        _condition(),
+        _waiters(0),
+        _finished(false),
+        _thread()
+    {
+        _selector.addReadable(_pipe.readFd(), this);
+        _thread = std::thread(&Worker::loop, this);
+    }
+
+    // Everything else must have been unregistered.
+    virtual ~Worker() {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _finished = true;
+        }
+        _condition.notify_one();
+        wake();
+        _thread.join();
+
+        _selector.removeReadable(_pipe.readFd());
+    }
+
+    // Only touch the selector with the worker locked.
+    I_Selector & getSelector() { return _selector; }
+
+    // BasicLockable, for threads other than the worker's.
+
+    void lock() {
+        ++_waiters;
+        _mutex.lock();
+        --_waiters;
+    }
+
+    // Wakes the selector so that any new registrations take effect.
+    void unlock() {
+        _mutex.unlock();
+        _condition.notify_one();
+        wake();
+    }
+
+protected:
+    void wake() {
+        // There's nothing to do if the pipe is full, the worker will wake.
+        char c = 0;
+        TEMP_FAILURE_RETRY(::write(_pipe.writeFd(), &c, 1));
+    }
+
+    void loop() {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        while (!_finished) {
+            _selector.animate(lock);
+
+            if (_waiters != 0) {
+                _condition.wait(lock, [&] { return _waiters == 0 || _finished; });
+            }
+        }
+    }
+
+    // I_Selector::I_ReadHandler implementation:
+
+    void handleRead(int fd) override {
+        ASSERT(fd == _pipe.readFd(), "");
+
+        char buf[BUFSIZ];
+        while (TEMP_FAILURE_RETRY(::read(fd, buf, sizeof buf)) > 0) {}
+    }
+};
+
+//
+//
+//
+
+// WorkerPool shares the things to be owned by workers between them, and
+// locks them all at once for a thread that owns things which interact with
+// all of theirs. Workers are always locked in the same order.
+class WorkerPool : private Uncopyable {
+    std::vector<std::unique_ptr<Worker>> _workers;
+    size_t                               _next;     // Round robin.
+
+public:
+    explicit WorkerPool(size_t size) : _workers(), _next(0) {
+        for (size_t i = 0; i != size; ++i) {
+            _workers.emplace_back(new Worker);
+        }
+    }
+
+    bool isEmpty() const { return _workers.empty(); }
+
+    // The worker for the next thing.
+    Worker & choose() {
+        ASSERT(!isEmpty(), "");
+        auto & worker = *_workers[_next];
+        _next = (_next + 1) % _workers.size();
+        return worker;
+    }
+
+    // BasicLockable.
+
+    void lock() {
+        for (auto & worker : _workers) { worker->lock(); }
+    }
+
+    void unlock() {
+        for (auto & worker : _workers) { worker->unlock(); }
+    }
+};
+
+#endif // SUPPORT__WORKER__HXX
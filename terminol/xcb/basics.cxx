@@ -4,6 +4,7 @@
 #include "terminol/xcb/basics.hxx"
 #include "terminol/xcb/common.hxx"
 #include "terminol/support/debug.hxx"
+#include "terminol/support/startup_trace.hxx"
 
 #include <xkbcommon/xkbcommon-keysyms.h>
 
@@ -15,6 +16,8 @@
 #include <limits.h>
 
 Basics::Basics() throw (Error) {
+    StartupTrace::Scope trace("basics");
+
 #ifdef __linux__
     char h[HOST_NAME_MAX + 1];
 #else
@@ -88,6 +91,7 @@ Basics::Basics() throw (Error) {
             _atomUtf8String = XCB_ATOM_STRING;
         }
         _atomTargets            = lookupAtom("TARGETS", true);
+        _atomIncr               = lookupAtom("INCR", true);
         _atomWmProtocols        = lookupAtom("WM_PROTOCOLS", false);
         _atomWmDeleteWindow     = lookupAtom("WM_DELETE_WINDOW", true);
         _atomXRootPixmapId      = lookupAtom("_XROOTPMAP_ID", true);
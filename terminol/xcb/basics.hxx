@@ -37,6 +37,7 @@ class Basics : protected Uncopyable {
     xcb_atom_t              _atomClipboard;
     xcb_atom_t              _atomUtf8String;
     xcb_atom_t              _atomTargets;
+    xcb_atom_t              _atomIncr;
     xcb_atom_t              _atomWmProtocols;
     xcb_atom_t              _atomWmDeleteWindow;
     xcb_atom_t              _atomXRootPixmapId;
@@ -81,6 +82,7 @@ public:
     xcb_atom_t              atomClipboard()        { return _atomClipboard; }
     xcb_atom_t              atomUtf8String()       { return _atomUtf8String; }
     xcb_atom_t              atomTargets()          { return _atomTargets; }
+    xcb_atom_t              atomIncr()             { return _atomIncr; }
     xcb_atom_t              atomWmProtocols()      { return _atomWmProtocols; }
     xcb_atom_t              atomWmDeleteWindow()   { return _atomWmDeleteWindow; }
     xcb_atom_t              atomXRootPixmapId()    { return _atomXRootPixmapId; }
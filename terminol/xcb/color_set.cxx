@@ -3,6 +3,7 @@
 
 #include "terminol/xcb/color_set.hxx"
 #include "terminol/support/debug.hxx"
+#include "terminol/support/startup_trace.hxx"
 #include <algorithm>
 #include <limits>
 
@@ -11,6 +12,8 @@ ColorSet::ColorSet(const Config & config,
     _config(config),
     _basics(basics)
 {
+    StartupTrace::Scope trace("color-set");
+
     _cursorFillColor  = convert(_config.cursorFillColor);
     _cursorTextColor  = convert(_config.cursorTextColor);
     _selectFgColor    = convert(_config.selectFgColor);
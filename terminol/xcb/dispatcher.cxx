@@ -167,6 +167,17 @@ void Dispatcher::dispatch(uint8_t responseType, xcb_generic_event_t * event) {
             auto e = reinterpret_cast<xcb_property_notify_event_t *>(event);
             auto i = _observers.find(e->window);
             if (i != _observers.end()) { i->second->propertyNotify(e); }
+
+            // Copy the watchers, they may remove themselves. The window's
+            // own observer hears of the event once only.
+            auto range = _watchers.equal_range(e->window);
+            std::vector<I_Observer *> watchers;
+            for (auto j = range.first; j != range.second; ++j) {
+                if (i == _observers.end() || j->second != i->second) {
+                    watchers.push_back(j->second);
+                }
+            }
+            for (auto watcher : watchers) { watcher->propertyNotify(e); }
             break;
         }
         default:
@@ -48,6 +48,11 @@ public:
     virtual void add(xcb_window_t window, I_Observer * observer) = 0;
     virtual void remove(xcb_window_t window) = 0;
 
+    // Also deliver the property notifications of a window, typically another
+    // client's, to 'observer'. A window may have several watchers.
+    virtual void addPropertyWatch(xcb_window_t window, I_Observer * observer) = 0;
+    virtual void removePropertyWatch(xcb_window_t window, I_Observer * observer) = 0;
+
 protected:
   I_Dispatcher() {}
   ~I_Dispatcher() {}
@@ -88,6 +93,21 @@ public:
         _observers.erase(window);
     }
 
+    void addPropertyWatch(xcb_window_t window, I_Observer * observer) override {
+        _watchers.insert(std::make_pair(window, observer));
+    }
+
+    void removePropertyWatch(xcb_window_t window, I_Observer * observer) override {
+        auto range = _watchers.equal_range(window);
+
+        for (auto i = range.first; i != range.second; ++i) {
+            if (i->second == observer) {
+                _watchers.erase(i);
+                break;
+            }
+        }
+    }
+
     // This method is public so that X events can be processed in the
     // absence of the file descriptor becoming readable. Why the descriptor
     // doesn't become readable is a mystery to me.
@@ -105,10 +125,12 @@ protected:
 
 private:
     typedef std::unordered_map<xcb_window_t, I_Observer *> Observers;
+    typedef std::unordered_multimap<xcb_window_t, I_Observer *> Watchers;
 
     I_Selector       & _selector;
     xcb_connection_t * _connection;
     Observers          _observers;
+    Watchers           _watchers;
 };
 
 
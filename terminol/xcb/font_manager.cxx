@@ -2,3 +2,469 @@
 // Copyright © 2013 David Bryant
 
 #include "terminol/xcb/font_manager.hxx"
+
+#include <sstream>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#include <pango/pangocairo.h>
+#include <fontconfig/fontconfig.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+namespace {
+
+const size_t MAX_UNUSED = 6;       // Font sets kept that no client uses.
+
+const char * const METRICS_HEADER = "terminol-font-metrics 2";
+
+// Create the missing directories leading to 'path', private to the user.
+void makeParents(const std::string & path) {
+    for (auto i = path.find('/', 1); i != std::string::npos; i = path.find('/', i + 1)) {
+        // Failure, most likely EEXIST, is left to show when the file is created.
+        ::mkdir(path.substr(0, i).c_str(), 0700);
+    }
+}
+
+} // namespace {anonymous}
+
+FontManager::FontManager(const Config & config, Basics & basics) :
+    _config(config),
+    _basics(basics),
+    _delta(0),
+    _clients(),
+    _fontSets(),
+    _unused(),
+    _dispatch(false),
+    _dpi(0),
+    _fontFile(),
+    _fontMtime(0),
+    _mutex(),
+    _condition(),
+    _requests(),
+    _loading(),
+    _prefetched(),
+    _metrics(),
+    _metricsDirty(false),
+    _finished(false),
+    _thread()
+{
+    identifyFont();
+    loadMetrics();
+    _thread = std::thread(&FontManager::loop, this);
+}
+
+FontManager::~FontManager() {
+    ASSERT(!_dispatch, "");
+    ASSERT(_clients.empty(), "Clients remain at destruction.");
+
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _finished = true;
+    }
+    _condition.notify_all();
+    _thread.join();
+
+    for (auto p : _prefetched) {
+        delete p.second;
+    }
+
+    for (auto p : _fontSets) {
+        delete p.second;
+    }
+
+    if (_metricsDirty) { saveMetrics(); }
+}
+
+FontSet * FontManager::addClient(I_Client * client) {
+    ASSERT(!_dispatch, "");
+
+    auto size = std::max(1, _config.fontSize + _delta);
+
+    _clients.insert(std::make_pair(client, size));
+    auto fontSet = obtain(size);
+    prefetchAround(size);
+    return fontSet;
+}
+
+void FontManager::removeClient(I_Client * client) {
+    ASSERT(!_dispatch, "");
+
+    auto iter = _clients.find(client);
+    ASSERT(iter != _clients.end(), "");
+    _clients.erase(iter);
+
+    purgeUnusedFonts();
+}
+
+void FontManager::localDelta(I_Client * client, int delta) {
+    if (_dispatch) { return; }
+
+    ASSERT(_clients.find(client) != _clients.end(), "");
+    resizeClient(client, delta);
+    purgeUnusedFonts();
+}
+
+void FontManager::globalDelta(int delta) {
+    if (_dispatch) { return; }
+
+    for (auto & p : _clients) {
+        resizeClient(p.first, delta);
+    }
+
+    purgeUnusedFonts();
+
+    if (delta == 0) {
+        _delta = 0;
+    }
+    else {
+        _delta += delta;
+    }
+}
+
+void FontManager::getMemoryStats(size_t & fontSets, size_t & glyphBytes) {
+    adoptPrefetched();
+
+    fontSets   = _fontSets.size();
+    glyphBytes = 0;
+
+    for (auto & p : _fontSets) {
+        glyphBytes += p.second->getAtlas().getBytes();
+    }
+}
+
+void FontManager::resizeClient(I_Client * client, int delta) {
+    auto iter        = _clients.find(client);
+    ASSERT(iter != _clients.end(), "");
+    auto old_size    = iter->second;
+    auto new_size    = delta == 0 ? _config.fontSize : old_size + delta;
+    auto total_delta = new_size - _config.fontSize;
+
+    if (new_size < 1) { return; }
+
+    iter->second = new_size;
+
+    auto fontSet = obtain(new_size);
+
+    _dispatch = true;
+    client->useFontSet(fontSet, total_delta);
+    _dispatch = false;
+
+    prefetchAround(new_size);
+}
+
+void FontManager::purgeUnusedFonts() {
+    adoptPrefetched();
+
+    // Create a set of sizes and populate it with all the sizes that are in use.
+    std::set<int> used;
+    for (auto & p : _clients) { used.insert(p.second); }
+
+    // Sizes that have just fallen out of use are the most recently used.
+    for (auto & p : _fontSets) {
+        if (used.find(p.first) == used.end() &&
+            std::find(_unused.begin(), _unused.end(), p.first) == _unused.end())
+        {
+            _unused.push_front(p.first);
+        }
+    }
+
+    while (_unused.size() > MAX_UNUSED) {
+        auto iter = _fontSets.find(_unused.back());
+        ASSERT(iter != _fontSets.end(), "");
+        delete iter->second;
+        _fontSets.erase(iter);
+        _unused.pop_back();
+    }
+}
+
+FontSet * FontManager::obtain(int size) {
+    adoptPrefetched();
+
+    auto iter = _fontSets.find(size);
+
+    if (iter == _fontSets.end()) {
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+
+            auto request = std::find(_requests.begin(), _requests.end(), size);
+            if (request != _requests.end()) { _requests.erase(request); }
+
+            _condition.wait(lock, [&] { return _loading.find(size) == _loading.end(); });
+        }
+
+        adoptPrefetched();
+        iter = _fontSets.find(size);
+
+        if (iter == _fontSets.end()) {
+            iter = _fontSets.insert(std::make_pair(size, build(size))).first;
+        }
+    }
+
+    _unused.remove(size);
+
+    return iter->second;
+}
+
+void FontManager::prefetch(int size) {
+    if (size < 1 || _fontSets.find(size) != _fontSets.end()) { return; }
+
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+
+        if (_loading.find(size) != _loading.end() ||
+            _prefetched.find(size) != _prefetched.end() ||
+            std::find(_requests.begin(), _requests.end(), size) != _requests.end())
+        {
+            return;
+        }
+
+        _requests.push_back(size);
+    }
+
+    _condition.notify_all();
+}
+
+void FontManager::prefetchAround(int size) {
+    // The next zoom is most likely to be in, rather than out.
+    prefetch(size + 1);
+    prefetch(size - 1);
+}
+
+void FontManager::adoptPrefetched() {
+    std::map<int, FontSet *> prefetched;
+
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        std::swap(prefetched, _prefetched);
+    }
+
+    for (auto & p : prefetched) {
+        ASSERT(_fontSets.find(p.first) == _fontSets.end(), "");
+        _fontSets.insert(p);
+        _unused.push_front(p.first);
+    }
+}
+
+FontSet * FontManager::build(int size) {
+    auto        key = std::make_tuple(_config.fontName, size, _dpi, _fontFile, _fontMtime);
+    FontMetrics metrics;
+    bool        known;
+
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        auto iter = _metrics.find(key);
+        known = iter != _metrics.end();
+        if (known) { metrics = iter->second; }
+    }
+
+    auto fontSet = new FontSet(_config, _basics, size, known ? &metrics : nullptr);
+
+    if (!known) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _metrics.insert(std::make_pair(key, fontSet->getMetrics()));
+        _metricsDirty = true;
+    }
+
+    if (!known) { _condition.notify_all(); }     // Wake the loading thread to save.
+
+    return fontSet;
+}
+
+void FontManager::loop() {
+    std::unique_lock<std::mutex> lock(_mutex);
+
+    for (;;) {
+        _condition.wait(lock, [&] { return !_requests.empty() || _metricsDirty || _finished; });
+        if (_finished) { break; }
+
+        if (_requests.empty()) {
+            // Idle, so save what has been measured.
+            _metricsDirty = false;
+            lock.unlock();
+            saveMetrics();
+            lock.lock();
+            continue;
+        }
+
+        auto size = _requests.front();
+        _requests.pop_front();
+        _loading.insert(size);
+
+        lock.unlock();
+        auto fontSet = build(size);
+        lock.lock();
+
+        _loading.erase(size);
+        _prefetched.insert(std::make_pair(size, fontSet));
+        _condition.notify_all();
+    }
+}
+
+void FontManager::identifyFont() {
+    auto fontMap = PANGO_CAIRO_FONT_MAP(pango_cairo_font_map_get_default());
+    _dpi = static_cast<int>(pango_cairo_font_map_get_resolution(fontMap) + 0.5);
+
+    // The file fontconfig matches for the family. Pango may choose
+    // differently for some glyphs, but updating or replacing the font, or
+    // installing a better match, changes it.
+    auto pattern = FcNameParse(reinterpret_cast<const FcChar8 *>(_config.fontName.c_str()));
+    if (!pattern) { return; }
+
+    FcConfigSubstitute(nullptr, pattern, FcMatchPattern);
+    FcDefaultSubstitute(pattern);
+
+    FcResult result;
+    auto     match = FcFontMatch(nullptr, pattern, &result);
+    FcPatternDestroy(pattern);
+    if (!match) { return; }
+
+    FcChar8 * file;
+    if (FcPatternGetString(match, FC_FILE, 0, &file) == FcResultMatch) {
+        _fontFile = reinterpret_cast<const char *>(file);
+
+        struct stat st;
+        if (::stat(_fontFile.c_str(), &st) == 0) { _fontMtime = st.st_mtime; }
+    }
+
+    FcPatternDestroy(match);
+}
+
+// A header line, then one line per font and size:
+//     <size> <dpi> <mtime> <width> <height> <bold> <italic> <italic-bold> <family>\t<file>
+// The family and file are last, separated by a tab, as they may contain
+// spaces. Files without the header are from an older version and ignored.
+
+void FontManager::loadMetrics() {
+    if (_config.fontMetricsCache.empty()) { return; }
+
+    // The metrics are used instead of measuring, so only trust our own file.
+    auto fd = TEMP_FAILURE_RETRY(::open(_config.fontMetricsCache.c_str(),
+                                        O_RDONLY | O_NOFOLLOW | O_CLOEXEC));
+    if (fd == -1) { return; }
+
+    std::string contents;
+    struct stat st;
+
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_uid == ::getuid()) {
+        char buf[BUFSIZ];
+        ssize_t rval;
+
+        while ((rval = TEMP_FAILURE_RETRY(::read(fd, buf, sizeof buf))) > 0) {
+            contents.append(buf, rval);
+        }
+    }
+    else {
+        WARNING("Ignoring font metrics cache, it must be a file owned by the user: " <<
+                _config.fontMetricsCache);
+    }
+
+    TEMP_FAILURE_RETRY(::close(fd));
+
+    std::istringstream iss(contents);
+    std::string        line;
+
+    if (!std::getline(iss, line) || line != METRICS_HEADER) { return; }
+
+    while (std::getline(iss, line)) {
+        std::istringstream ist(line);
+        int                size, dpi, width, height;
+        int64_t            mtime;
+        bool               bold, italic, italicBold;
+        std::string        family, file;
+
+        ist >> size >> dpi >> mtime >> width >> height >> bold >> italic >> italicBold >> std::ws;
+        std::getline(ist, family, '\t');
+        std::getline(ist, file);
+
+        if (!ist.fail() && !family.empty() && size > 0 && width > 0 && height > 0) {
+            FontMetrics metrics;
+            metrics.width      = width;
+            metrics.height     = height;
+            metrics.bold       = bold;
+            metrics.italic     = italic;
+            metrics.italicBold = italicBold;
+
+            std::unique_lock<std::mutex> lock(_mutex);
+            // Keep what was measured by this process.
+            _metrics.insert(std::make_pair(std::make_tuple(family, size, dpi, file, mtime),
+                                           metrics));
+        }
+    }
+}
+
+void FontManager::saveMetrics() {
+    if (_config.fontMetricsCache.empty()) { return; }
+
+    // Include what other processes have saved since.
+    loadMetrics();
+
+    // Written from a copy, so the lock isn't held over the file I/O.
+    std::map<MetricsKey, FontMetrics> copy;
+
+    {
+        std::unique_lock<std::mutex> lock(_mutex);
+        copy = _metrics;
+    }
+
+    std::ostringstream ost;
+    ost << METRICS_HEADER << '\n';
+
+    for (auto & p : copy) {
+        auto & family  = std::get<0>(p.first);
+        auto & file    = std::get<3>(p.first);
+        auto & metrics = p.second;
+
+        // Such names couldn't be read back.
+        if (family.find_first_of("\t\n") != std::string::npos ||
+            file.find('\n') != std::string::npos)
+        {
+            continue;
+        }
+
+        ost << std::get<1>(p.first) << ' '
+            << std::get<2>(p.first) << ' '
+            << std::get<4>(p.first) << ' '
+            << metrics.width << ' ' << metrics.height << ' '
+            << metrics.bold << ' ' << metrics.italic << ' ' << metrics.italicBold << ' '
+            << family << '\t' << file << '\n';
+    }
+
+    auto contents = ost.str();
+
+    makeParents(_config.fontMetricsCache);
+
+    // A temporary of our own, created exclusively, then renamed over the cache.
+    auto tmpPath = _config.fontMetricsCache + ".XXXXXX";
+    std::vector<char> buf(tmpPath.begin(), tmpPath.end());
+    buf.push_back('\0');
+
+    auto fd = ::mkstemp(&buf.front());
+    if (fd == -1) {
+        ERROR("Failed to create: " << tmpPath << " (" << ::strerror(errno) << ")");
+        return;
+    }
+
+    tmpPath = &buf.front();
+
+    size_t done = 0;
+    while (done != contents.size()) {
+        auto rval = TEMP_FAILURE_RETRY(::write(fd, contents.data() + done, contents.size() - done));
+        if (rval == -1) { break; }
+        done += rval;
+    }
+
+    if (TEMP_FAILURE_RETRY(::close(fd)) == -1 || done != contents.size()) {
+        ERROR("Failed to write: " << tmpPath);
+        ::unlink(tmpPath.c_str());
+        return;
+    }
+
+    if (::rename(tmpPath.c_str(), _config.fontMetricsCache.c_str()) == -1) {
+        ERROR("Failed to rename: " << tmpPath);
+        ::unlink(tmpPath.c_str());
+    }
+}
@@ -11,7 +11,23 @@
 
 #include <set>
 #include <map>
-
+#include <list>
+#include <deque>
+#include <string>
+#include <tuple>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// FontManager shares font sets, one per size, between its clients. Sets that
+// fall out of use are kept, up to a bound, in case their size is wanted again,
+// and the sizes either side of those in use are loaded ahead of time on a
+// thread of its own, so that zooming rarely waits for fonts. The measured
+// metrics of each font and size are remembered, in a file shared by all
+// processes, so that sets built again needn't be measured. The metrics are
+// also keyed by the resolution and by the font file (and its modification
+// time), so a changed or replaced font is measured afresh, and the file is
+// written by the loading thread when it is idle, never while zooming.
 class FontManager : protected Uncopyable {
 public:
     class I_Client {
@@ -24,131 +40,66 @@ public:
     };
 
 private:
-    const Config              & _config;
-    Basics                    & _basics;
-
-    int                         _delta;     // Global delta
-    std::map<I_Client *, int>   _clients;   // client->size
-    std::map<int, FontSet *>    _fontSets;  // size->font-set
-    bool                        _dispatch;  // used to disallow re-entrance
+    // family, size, resolution, font file, modification time of font file
+    typedef std::tuple<std::string, int, int, std::string, int64_t> MetricsKey;
+
+    const Config                        & _config;
+    Basics                              & _basics;
+
+    int                                   _delta;       // Global delta
+    std::map<I_Client *, int>             _clients;     // client->size
+    std::map<int, FontSet *>              _fontSets;    // size->font-set
+    std::list<int>                        _unused;      // sizes, most recently used first
+    bool                                  _dispatch;    // used to disallow re-entrance
+    int                                   _dpi;         // of the font map
+    std::string                           _fontFile;    // fontconfig's match for the family
+    int64_t                               _fontMtime;
+
+    // Shared with the loading thread, guarded by _mutex.
+    std::mutex                            _mutex;
+    std::condition_variable               _condition;   // Signalled when a request, set or metrics are ready.
+    std::deque<int>                       _requests;    // sizes to load
+    std::set<int>                         _loading;     // sizes being loaded
+    std::map<int, FontSet *>              _prefetched;  // size->font-set, loaded
+    std::map<MetricsKey, FontMetrics>     _metrics;
+    bool                                  _metricsDirty;
+    bool                                  _finished;
+    std::thread                           _thread;
 
 public:
-    FontManager(const Config & config, Basics & basics) :
-        _config(config),
-        _basics(basics),
-        _delta(0),
-        _clients(),
-        _fontSets(),
-        _dispatch(false) {}
-
-    virtual ~FontManager() {
-        ASSERT(!_dispatch, "");
-
-        for (auto p : _fontSets) {
-            delete p.second;
-        }
-
-        ASSERT(_clients.empty(), "Clients remain at destruction.");
-    }
-
-    FontSet * addClient(I_Client * client) {
-        ASSERT(!_dispatch, "");
-
-        auto size = std::max(1, _config.fontSize + _delta);
-
-        _clients.insert(std::make_pair(client, size));
-        auto iter = _fontSets.find(size);
-        if (iter == _fontSets.end()) {
-            auto fontSet = new FontSet(_config, _basics, size);
-            _fontSets.insert(std::make_pair(size, fontSet));
-            return fontSet;
-        }
-        else {
-            return iter->second;
-        }
-    }
-
-    void removeClient(I_Client * client) {
-        ASSERT(!_dispatch, "");
-
-        auto iter = _clients.find(client);
-        ASSERT(iter != _clients.end(), "");
-        _clients.erase(iter);
-
-        purgeUnusedFonts();
-    }
-
-    void localDelta(I_Client * client, int delta) {
-        if (_dispatch) { return; }
-
-        ASSERT(_clients.find(client) != _clients.end(), "");
-        resizeClient(client, delta);
-        purgeUnusedFonts();
-    }
-
-    void globalDelta(int delta) {
-        if (_dispatch) { return; }
-
-        for (auto & p : _clients) {
-            resizeClient(p.first, delta);
-        }
-
-        purgeUnusedFonts();
-
-        if (delta == 0) {
-            _delta = 0;
-        }
-        else {
-            _delta += delta;
-        }
-    }
+    FontManager(const Config & config, Basics & basics);
+    virtual ~FontManager();
+
+    FontSet * addClient(I_Client * client);
+    void      removeClient(I_Client * client);
+    void      localDelta(I_Client * client, int delta);
+    void      globalDelta(int delta);
+
+    // The sets loaded, in use or not, and the bytes of their glyph atlases.
+    // Drawing must be excluded, see Screen::getFontMemoryStats().
+    void      getMemoryStats(size_t & fontSets, size_t & glyphBytes);
 
 protected:
-    void resizeClient(I_Client * client, int delta) {
-        auto iter1       = _clients.find(client);
-        ASSERT(iter1 != _clients.end(), "");
-        auto old_size    = iter1->second;
-        auto new_size    = delta == 0 ? _config.fontSize : old_size + delta;
-        auto iter2       = _fontSets.find(new_size);
-        auto total_delta = new_size - _config.fontSize;
-
-        if (new_size < 1) { return; }
-
-        iter1->second = new_size;
-
-        _dispatch = true;
-
-        if (iter2 == _fontSets.end()) {
-            auto fontSet = new FontSet(_config, _basics, new_size);
-            _fontSets.insert(std::make_pair(new_size, fontSet));
-            client->useFontSet(fontSet, total_delta);
-        }
-        else {
-            client->useFontSet(iter2->second, total_delta);
-        }
-
-        _dispatch = false;
-    }
-
-    void purgeUnusedFonts() {
-        // Create a set of sizes and populate it with all the sizes that are in use.
-        std::set<int> used;
-        for (auto & p : _clients) { used.insert(p.second); }
-
-        std::set<int> unused;
-        for (auto & p : _fontSets) {
-            if (used.find(p.first) == used.end()) {
-                unused.insert(p.first);
-            }
-        }
-
-        for (auto size : unused) {
-            auto iter = _fontSets.find(size);
-            ASSERT(iter != _fontSets.end(), "");
-            delete iter->second;
-            _fontSets.erase(iter);
-        }
-    }
+    void      resizeClient(I_Client * client, int delta);
+    void      purgeUnusedFonts();
+
+    // The set for 'size', from the sets already loaded, waiting if it is
+    // being loaded, or else loading it now.
+    FontSet * obtain(int size);
+
+    // Have the loading thread load 'size' if it isn't already.
+    void      prefetch(int size);
+    void      prefetchAround(int size);
+
+    void      adoptPrefetched();
+    FontSet * build(int size);
+
+    void      loop();
+
+    // Determine the resolution and font file that key the metrics.
+    void      identifyFont();
+    void      loadMetrics();
+    void      saveMetrics();
 };
 
 #endif // XCB__FONT_MANAGER__HXX
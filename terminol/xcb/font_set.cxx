@@ -3,19 +3,41 @@
 
 #include "terminol/xcb/font_set.hxx"
 #include "terminol/support/pattern.hxx"
+#include "terminol/support/startup_trace.hxx"
 
 #include <cairo/cairo-xcb.h>
 #include <pango/pangocairo.h>
 
-FontSet::FontSet(const Config & config,
-                 Basics       & basics,
-                 int            size) :
+FontSet::FontSet(const Config      & config,
+                 Basics            & basics,
+                 int                 size,
+                 const FontMetrics * known) :
     _config(config),
-    _basics(basics)
+    _basics(basics),
+    _metrics(),
+    _atlas(nullptr)
 {
+    StartupTrace::Scope trace(known ? "font-set-known" : "font-set");
+
     ASSERT(size > 0, "");
     auto & name = _config.fontName;
 
+    if (known) {
+        // Measured before, the styles are known to conform or not.
+        _metrics = *known;
+        _width   = _metrics.width;
+        _height  = _metrics.height;
+
+        _normal     = describe(name, size, false, false);
+        _bold       = describe(name, size, _metrics.bold, false);
+        _italic     = describe(name, size, false, _metrics.italic);
+        _italicBold = _metrics.italicBold ? describe(name, size, true, true) :
+                      describe(name, size, false, _metrics.italic);
+
+        _atlas = new GlyphAtlas(_width, _height);
+        return;
+    }
+
     try {
         _normal = load(name, size, true, false, false);
     }
@@ -26,6 +48,7 @@ FontSet::FontSet(const Config & config,
 
     try {
         _bold = load(name, size, false, true, false);
+        _metrics.bold = true;
     }
     catch (const Error &) {
         std::cerr << "Using non-bold font" << std::endl;
@@ -35,6 +58,7 @@ FontSet::FontSet(const Config & config,
 
     try {
         _italic = load(name, size, false, false, true);
+        _metrics.italic = true;
     }
     catch (const Error &) {
         std::cerr << "Using non-italic font" << std::endl;
@@ -44,19 +68,25 @@ FontSet::FontSet(const Config & config,
 
     try {
         _italicBold = load(name, size, false, true, true);
+        _metrics.italicBold = true;
     }
     catch (const Error &) {
         std::cerr << "Note, trying non-bold, italic font" << std::endl;
-        try {
-            _italicBold = load(name, size, false, false, true);
+        if (_metrics.italic) {
+            _italicBold = pango_font_description_copy(_italic);
         }
-        catch (const Error &) {
+        else {
             std::cerr << "Using trying non-bold, non-italic font" << std::endl;
             _italicBold = pango_font_description_copy(_normal);
         }
     }
     auto italicBoldGuard = scopeGuard([&] { unload(_italicBold); });
 
+    _metrics.width  = _width;
+    _metrics.height = _height;
+
+    _atlas = new GlyphAtlas(_width, _height);
+
     // Dismiss guards
     italicBoldGuard.dismiss();
     italicGuard.dismiss();
@@ -65,12 +95,30 @@ FontSet::FontSet(const Config & config,
 }
 
 FontSet::~FontSet() {
+    delete _atlas;
     unload(_italicBold);
     unload(_italic);
     unload(_bold);
     unload(_normal);
 }
 
+PangoFontDescription * FontSet::describe(const std::string & family,
+                                         int                 size,
+                                         bool                bold,
+                                         bool                italic) {
+    auto desc = pango_font_description_new();
+    pango_font_description_set_family(desc, family.c_str());
+    //pango_font_description_set_size(desc, size * PANGO_SCALE);
+    pango_font_description_set_absolute_size(desc, size * PANGO_SCALE);
+    pango_font_description_set_weight(desc,
+                                      bold ? PANGO_WEIGHT_BOLD :
+                                      PANGO_WEIGHT_NORMAL);
+    pango_font_description_set_style(desc,
+                                     italic ? PANGO_STYLE_OBLIQUE :
+                                     PANGO_STYLE_NORMAL);
+    return desc;
+}
+
 PangoFontDescription * FontSet::load(const std::string & family,
                                      int                 size,
                                      bool                master,
@@ -96,17 +144,8 @@ PangoFontDescription * FontSet::load(const std::string & family,
     }
 #endif
 
-    auto desc = pango_font_description_new();
+    auto desc = describe(family, size, bold, italic);
     auto descGuard = scopeGuard([&] { pango_font_description_free(desc); });
-    pango_font_description_set_family(desc, family.c_str());
-    //pango_font_description_set_size(desc, size * PANGO_SCALE);
-    pango_font_description_set_absolute_size(desc, size * PANGO_SCALE);
-    pango_font_description_set_weight(desc,
-                                      bold ? PANGO_WEIGHT_BOLD :
-                                      PANGO_WEIGHT_NORMAL);
-    pango_font_description_set_style(desc,
-                                     italic ? PANGO_STYLE_OBLIQUE :
-                                     PANGO_STYLE_NORMAL);
 
     /*
     auto str = pango_font_description_to_string(desc);
@@ -5,11 +5,23 @@
 #define XCB__FONT_SET__HXX
 
 #include "terminol/xcb/basics.hxx"
+#include "terminol/xcb/glyph_atlas.hxx"
 #include "terminol/common/config.hxx"
 #include "terminol/support/pattern.hxx"
 
 #include <pango/pango-font.h>
 
+// The measurements of a font family at a size: the cell size, set by the
+// normal font, and which of the other styles conform to it. Those that don't
+// fall back to a conforming style.
+struct FontMetrics {
+    uint16_t width      = 0;
+    uint16_t height     = 0;
+    bool     bold       = false;
+    bool     italic     = false;
+    bool     italicBold = false;
+};
+
 class FontSet : protected Uncopyable {
     const Config         & _config;
     Basics               & _basics;
@@ -20,11 +32,18 @@ class FontSet : protected Uncopyable {
     PangoFontDescription * _italicBold;
     uint16_t               _width;
     uint16_t               _height;
+    FontMetrics            _metrics;
+    GlyphAtlas           * _atlas;
 
 public:
-    FontSet(const Config & config, Basics & basics, int size);
+    // If 'known' is given then the fonts are taken to have those metrics,
+    // rather than measured. Safe to construct on any thread.
+    FontSet(const Config & config, Basics & basics, int size,
+            const FontMetrics * known = nullptr);
     ~FontSet();
 
+    const FontMetrics & getMetrics() const { return _metrics; }
+
     PangoFontDescription * get(bool italic, bool bold) {
         switch ((italic ? 2 : 0) + (bold ? 1 : 0)) {
             case 0: return _normal;
@@ -38,12 +57,17 @@ public:
     uint16_t getWidth()  const { return _width;  }
     uint16_t getHeight() const { return _height; }
 
+    GlyphAtlas & getAtlas() { return *_atlas; }
+    const GlyphAtlas & getAtlas() const { return *_atlas; }
+
 protected:
     struct Error {
         explicit Error(const std::string & message_) : message(message_) {}
         std::string message;
     };
 
+    static PangoFontDescription * describe(const std::string & family, int size,
+                                           bool bold, bool italic);
     PangoFontDescription * load(const std::string & family, int size, bool master,
                                 bool bold, bool italic) throw (Error);
     void unload(PangoFontDescription * desc);
@@ -0,0 +1,138 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/xcb/glyph_atlas.hxx"
+
+#include <pango/pangocairo.h>
+
+namespace {
+
+const int PAGE_COLS = 32;       // Slots across a page.
+const int PAGE_ROWS = 8;        // Slots down a page.
+const int PAGE_SLOTS = PAGE_COLS * PAGE_ROWS;
+const size_t MAX_PAGES = 16;
+
+} // namespace {anonymous}
+
+GlyphAtlas::GlyphAtlas(uint16_t width, uint16_t height) :
+    _width(width),
+    _height(height),
+    _pages(),
+    _used(PAGE_SLOTS),
+    _slots() {}
+
+GlyphAtlas::~GlyphAtlas() {
+    clear();
+}
+
+bool GlyphAtlas::isSimple(utf8::CodePoint codePoint) {
+    // Anything known to fit a cell.
+    return utf8::width(codePoint) == utf8::Width::NARROW;
+}
+
+void GlyphAtlas::draw(cairo_t              * cr,
+                      PangoFontDescription * font,
+                      bool                   italic,
+                      bool                   bold,
+                      utf8::CodePoint        codePoint,
+                      int                    x,
+                      int                    y) {
+    ASSERT(isSimple(codePoint), "");
+
+    uint32_t key  = (static_cast<uint32_t>(codePoint) << 2) + (italic ? 2 : 0) + (bold ? 1 : 0);
+    auto     iter = _slots.find(key);
+
+    if (iter == _slots.end()) {
+        auto slot = allocate();
+        rasterise(cr, font, codePoint, slot);
+        iter = _slots.insert(std::make_pair(key, slot)).first;
+    }
+
+    auto & slot = iter->second;
+    int sx, sy;
+    slotXY(slot, sx, sy);
+
+    cairo_save(cr); {
+        cairo_rectangle(cr, x, y, _width, _height);
+        cairo_clip(cr);
+        cairo_mask_surface(cr, _pages[slot.page], x - sx, y - sy);
+    } cairo_restore(cr);
+}
+
+size_t GlyphAtlas::getBytes() const {
+    // A8 pages have a byte per pixel.
+    size_t pageBytes = (PAGE_COLS * _width) * (PAGE_ROWS * _height);
+    return _pages.size() * pageBytes +
+        _slots.size() * (sizeof(uint32_t) + sizeof(Slot) + sizeof(void *));
+}
+
+void GlyphAtlas::slotXY(Slot slot, int & x, int & y) const {
+    x = (slot.index % PAGE_COLS) * _width;
+    y = (slot.index / PAGE_COLS) * _height;
+}
+
+auto GlyphAtlas::allocate() -> Slot {
+    if (_used == PAGE_SLOTS) {
+        if (_pages.size() == MAX_PAGES) {
+            clear();
+        }
+
+        auto page = cairo_image_surface_create(CAIRO_FORMAT_A8,
+                                               PAGE_COLS * _width,
+                                               PAGE_ROWS * _height);
+        ENFORCE(cairo_surface_status(page) == CAIRO_STATUS_SUCCESS,
+                "Bad cairo surface status.");
+        _pages.push_back(page);
+        _used = 0;
+    }
+
+    return Slot(_pages.size() - 1, _used++);
+}
+
+void GlyphAtlas::rasterise(cairo_t              * cr,
+                           PangoFontDescription * font,
+                           utf8::CodePoint        codePoint,
+                           Slot                   slot) {
+    auto pageCr = cairo_create(_pages[slot.page]);
+    auto pageCrGuard = scopeGuard([&] { cairo_destroy(pageCr); });
+
+    int x, y;
+    slotXY(slot, x, y);
+
+    cairo_rectangle(pageCr, x, y, _width, _height);
+    cairo_clip(pageCr);
+
+    auto layout = pango_cairo_create_layout(pageCr);
+    auto layoutGuard = scopeGuard([&] { g_object_unref(layout); });
+
+    // Render with the target's font options (hinting, anti-aliasing)
+    // rather than those of an image surface.
+    auto options = cairo_font_options_create();
+    auto optionsGuard = scopeGuard([&] { cairo_font_options_destroy(options); });
+    cairo_surface_get_font_options(cairo_get_target(cr), options);
+    pango_cairo_context_set_font_options(pango_layout_get_context(layout), options);
+    pango_layout_context_changed(layout);
+
+    pango_layout_set_font_description(layout, font);
+    pango_layout_set_width(layout, -1);
+
+    uint8_t seq[utf8::Length::LMAX];
+    auto    length = utf8::encode(codePoint, seq);
+
+    cairo_move_to(pageCr, x, y);
+    pango_layout_set_text(layout, reinterpret_cast<const char *>(seq), length);
+    pango_cairo_show_layout(pageCr, layout);
+
+    ASSERT(cairo_status(pageCr) == 0,
+           "Cairo error: " << cairo_status_to_string(cairo_status(pageCr)));
+}
+
+void GlyphAtlas::clear() {
+    for (auto page : _pages) {
+        cairo_surface_destroy(page);
+    }
+
+    _pages.clear();
+    _slots.clear();
+    _used = PAGE_SLOTS;
+}
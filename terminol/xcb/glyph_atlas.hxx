@@ -0,0 +1,63 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef XCB__GLYPH_ATLAS__HXX
+#define XCB__GLYPH_ATLAS__HXX
+
+#include "terminol/common/utf8.hxx"
+#include "terminol/support/pattern.hxx"
+
+#include <pango/pango-font.h>
+#include <cairo/cairo.h>
+
+#include <unordered_map>
+#include <vector>
+
+// GlyphAtlas caches rasterised glyphs so that drawing a cell is a masked
+// blit rather than a Pango layout. Glyphs are rendered, one per cell-sized
+// slot, into pages of an A8 image surface and keyed by code point and style
+// (italic/bold). Only simple (non-combining, left-to-right, single-width)
+// code points are cached, everything else must go via Pango.
+// When every page is full the atlas is cleared and refilled on demand.
+class GlyphAtlas : protected Uncopyable {
+    struct Slot {
+        uint16_t page;
+        uint16_t index;
+
+        Slot(uint16_t page_, uint16_t index_) : page(page_), index(index_) {}
+    };
+
+    uint16_t                           _width;      // Cell width.
+    uint16_t                           _height;     // Cell height.
+    std::vector<cairo_surface_t *>     _pages;
+    uint16_t                           _used;       // Slots used in the last page.
+    std::unordered_map<uint32_t, Slot> _slots;      // (code point, style) -> slot
+
+public:
+    GlyphAtlas(uint16_t width, uint16_t height);
+    ~GlyphAtlas();
+
+    // Can this code point be drawn from the atlas?
+    static bool isSimple(utf8::CodePoint codePoint);
+
+    // Paint the glyph for 'codePoint' through the current source of 'cr'
+    // into the cell with its top-left at x,y. 'codePoint' must be simple.
+    void draw(cairo_t              * cr,
+              PangoFontDescription * font,
+              bool                   italic,
+              bool                   bold,
+              utf8::CodePoint        codePoint,
+              int                    x,
+              int                    y);
+
+    // Bytes held by the pages and the index of slots.
+    size_t getBytes() const;
+
+protected:
+    void slotXY(Slot slot, int & x, int & y) const;
+    Slot allocate();
+    void rasterise(cairo_t * cr, PangoFontDescription * font, utf8::CodePoint codePoint, Slot slot);
+    void clear();
+};
+
+#endif // XCB__GLYPH_ATLAS__HXX
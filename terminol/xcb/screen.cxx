@@ -5,14 +5,32 @@
 #include "terminol/xcb/common.hxx"
 #include "terminol/support/conv.hxx"
 #include "terminol/support/pattern.hxx"
+#include "terminol/support/startup_trace.hxx"
 
 #include <xcb/xcb_icccm.h>
 #include <pango/pangocairo.h>
 
+#include <algorithm>
 #include <limits>
+#include <cstdlib>
 
 #include <unistd.h>
 
+namespace {
+
+// Pango and the FontSets (with their glyph atlases) are shared between
+// screens and aren't safe to draw with from several threads at once, so all
+// drawing into surfaces, by render threads or the main thread, holds this.
+std::recursive_mutex renderMutex;
+
+typedef std::unique_lock<std::recursive_mutex> RenderLock;
+
+// Selections larger than this are sent incrementally, in chunks of this size.
+// It is well within the maximum request size of any server.
+const size_t INCR_CHUNK_SIZE = 64 * 1024;
+
+} // namespace {anonymous}
+
 Screen::Screen(I_Observer         & observer,
                const Config       & config,
                I_Selector         & selector,
@@ -22,7 +40,12 @@ Screen::Screen(I_Observer         & observer,
                Basics             & basics,
                const ColorSet     & colorSet,
                FontManager        & fontManager,
-               const Tty::Command & command) throw (Widget::Error, Error) :
+               int16_t              rows,
+               int16_t              cols,
+               const Tty::Command & command,
+               const std::string  & cwd,
+               ShellPool          * shellPool,
+               HistoryBudget      * historyBudget) throw (Widget::Error, Error) :
     Widget(dispatcher, basics, colorSet.getBackgroundPixel(), config.initialX, config.initialY, -1, -1),
     _observer(observer),
     _config(config),
@@ -39,13 +62,29 @@ Screen::Screen(I_Observer         & observer,
     _pointerPos(Pos::invalid()),
     _mapped(false),
     _pixmap(0),
+    _shmImage(nullptr),
+    _shmUsable(_config.x11Shm && !_config.x11PseudoTransparency),
     _surface(nullptr),
     _cr(nullptr),
+    _layout(nullptr),
+    _rowCache(),
+    _rowCachePixels(0),
+    _recording(false),
+    _frameLock(),
+    _drawList(),
+    _pending(),
+    _finalised(false),
+    _queueMutex(),
+    _queueCondition(),
+    _renderThread(),
     _entitlement(Entitlement::PERMANENT),
     _title(_config.title),
     _icon(_config.icon),
     _primarySelection(),
     _clipboardSelection(),
+    _transfers(),
+    _receiving(false),
+    _received(),
     _pressed(false),
     _pressCount(0),
     _lastPressTime(0),
@@ -55,6 +94,9 @@ Screen::Screen(I_Observer         & observer,
     _deferred(false),
     _hadDeleteRequest(false)
 {
+    // The window itself has been created by Widget.
+    StartupTrace::Scope trace("screen");
+
     // Register our object with the font manager.
 
     _fontSet = _fontManager.addClient(this);
@@ -64,8 +106,8 @@ Screen::Screen(I_Observer         & observer,
     // Calculate what our initial geometry should be. Though the WM
     // may give us something else.
 
-    auto rows             = _config.initialRows;
-    auto cols             = _config.initialCols;
+    if (rows <= 0) { rows = _config.initialRows; }
+    if (cols <= 0) { cols = _config.initialCols; }
     auto border_thickness = _config.borderThickness;
     auto scrollbar_width  = _config.scrollbarVisible ? _config.scrollbarWidth : 0;
 
@@ -123,8 +165,10 @@ Screen::Screen(I_Observer         & observer,
     // Create the TTY and terminal.
 
     try {
+        StartupTrace::Scope terminalTrace("terminal");
         _terminal = new Terminal(*this, _config, selector, deduper, destroyer,
-                                 rows, cols, stringify(getWindow()), command);
+                                 rows, cols, stringify(getWindow()), command, cwd, shellPool,
+                                 historyBudget);
         _open     = true;
     }
     catch (const Tty::Error & error) {
@@ -137,10 +181,12 @@ Screen::Screen(I_Observer         & observer,
 
     // Map the window.
 
+    StartupTrace::begin("map-window");
     cookie = xcb_map_window_checked(_basics.connection(), getWindow());
     if (xcb_request_failed(_basics.connection(), cookie, "Failed to map window")) {
         throw Error("Failed to map window.");
     }
+    StartupTrace::end("map-window");
 
     // Flush our XCB calls.
 
@@ -152,11 +198,27 @@ Screen::Screen(I_Observer         & observer,
     fontGuard.dismiss();
 
     map();
+
+    // Start the render thread last, nothing can fail after it.
+
+    if (_config.renderThread) {
+        _renderThread = std::thread(&Screen::render, this);
+    }
 }
 
 Screen::~Screen() {
+    if (_renderThread.joinable()) {
+        {
+            std::unique_lock<std::mutex> lock(_queueMutex);
+            _finalised = true;
+            _queueCondition.notify_one();
+        }
+
+        _renderThread.join();
+    }
+
     if (_mapped) {
-        ASSERT(_pixmap, "Null pixmap.");
+        ASSERT(_pixmap || _shmImage, "Null pixmap.");
         ASSERT(_surface, "Null surface.");
 
         destroySurfaceAndPixmap();
@@ -164,6 +226,11 @@ Screen::~Screen() {
     else {
         ASSERT(!_surface, "Surface not null.");
         ASSERT(!_pixmap, "Pixmap not null.");
+        ASSERT(!_shmImage, "Shm image not null.");
+    }
+
+    while (!_transfers.empty()) {
+        endTransfer(_transfers.begin());
     }
 
     // A generic cookie for all subsequent checked XCB calls.
@@ -172,6 +239,10 @@ Screen::~Screen() {
 
     // Unwind constructor.
 
+    flushRowCache();
+
+    if (_layout) { g_object_unref(_layout); }
+
     delete _terminal;
 
     cookie = xcb_free_gc_checked(_basics.connection(), _gc);
@@ -354,6 +425,7 @@ void Screen::motionNotify(xcb_motion_notify_event_t * event) noexcept {
 void Screen::mapNotify(xcb_map_notify_event_t * UNUSED(event)) noexcept {
     ASSERT(!_mapped, "Received map notification, but already mapped.");
 
+    RenderLock lock(renderMutex);
     _mapped = true;
     createPixmapAndSurface();
 }
@@ -361,6 +433,7 @@ void Screen::mapNotify(xcb_map_notify_event_t * UNUSED(event)) noexcept {
 void Screen::unmapNotify(xcb_unmap_notify_event_t * UNUSED(event)) noexcept {
     ASSERT(_mapped, "Received unmap notification, but not mapped.");
 
+    RenderLock lock(renderMutex);
     _mapped = false;
     destroySurfaceAndPixmap();
 }
@@ -373,8 +446,9 @@ void Screen::expose(xcb_expose_event_t * event) noexcept {
     ASSERT(_mapped, "Received expose event, but not mapped.");
 
     if (_mapped) {
-        ASSERT(_pixmap, "Null pixmap.");
+        ASSERT(_pixmap || _shmImage, "Null pixmap.");
         ASSERT(_surface, "Null surface.");
+        RenderLock lock(renderMutex);
         copyPixmapToWindow(event->x, event->y, event->width, event->height);
     }
 }
@@ -459,41 +533,35 @@ void Screen::destroyNotify(xcb_destroy_notify_event_t * event) noexcept {
     _destroyed = true;
 }
 
-void Screen::selectionClear(xcb_selection_clear_event_t * UNUSED(event)) noexcept {
+void Screen::selectionClear(xcb_selection_clear_event_t * event) noexcept {
+    // Another client owns the selection, so our copy isn't needed. Transfers
+    // in progress hold on to it.
+    if (event->selection == _basics.atomPrimary()) {
+        _primarySelection.reset();
+    }
+    else if (event->selection == _basics.atomClipboard()) {
+        _clipboardSelection.reset();
+    }
+
     _terminal->clearSelection();
 }
 
 void Screen::selectionNotify(xcb_selection_notify_event_t * UNUSED(event)) noexcept {
     if (!_open) { return; }
 
+    xcb_atom_t           type;
     std::vector<uint8_t> content;
-    uint32_t             offset = 0;        // 32-bit quantities
-
-    for (;;) {
-        auto cookie = xcb_get_property(_basics.connection(),
-                                       false,     // delete
-                                       getWindow(),
-                                       XCB_ATOM_PRIMARY,
-                                       XCB_GET_PROPERTY_TYPE_ANY,
-                                       offset,
-                                       8192 / 4);
-
-        auto reply = xcb_get_property_reply(_basics.connection(), cookie, nullptr);
-        if (!reply) { break; }
-
-        auto guard  = scopeGuard([reply] { std::free(reply); });
-        auto value  = static_cast<uint8_t *>(xcb_get_property_value(reply));
-        auto length = xcb_get_property_value_length(reply);
-        if (length == 0) { break; }
+    readProperty(type, content);
 
-        auto oldSize = content.size();
-        content.resize(oldSize + length);
-        std::copy(value, value + length, content.begin() + oldSize);
+    // Deleting the property tells an incremental owner to send the first chunk.
+    xcb_delete_property(_basics.connection(), getWindow(), XCB_ATOM_PRIMARY);
+    xcb_flush(_basics.connection());
 
-        offset += (length + 3) / 4;
+    if (type == _basics.atomIncr()) {
+        _receiving = true;
+        _received.clear();
     }
-
-    if (!content.empty()) {
+    else if (!content.empty()) {
         _terminal->paste(&content.front(), content.size());
     }
 }
@@ -523,7 +591,7 @@ void Screen::selectionRequest(xcb_selection_request_event_t * event) noexcept {
         response.property = event->property;
     }
     else if (event->target == _basics.atomUtf8String()) {
-        std::string text;
+        std::shared_ptr<const SelectionText> text;
 
         if (event->selection == _basics.atomPrimary()) {
             text = _primarySelection;
@@ -535,15 +603,25 @@ void Screen::selectionRequest(xcb_selection_request_event_t * event) noexcept {
             ERROR("Unexpected selection.");
         }
 
-        auto cookie = xcb_change_property_checked(_basics.connection(),
-                                                  XCB_PROP_MODE_REPLACE,
-                                                  event->requestor,
-                                                  event->property,
-                                                  event->target,
-                                                  8,
-                                                  text.length(),
-                                                  text.data());
-        xcb_request_failed(_basics.connection(), cookie, "Failed to change property.");
+        std::string           chunk;
+        SelectionText::Cursor cursor;
+        if (text) { text->read(cursor, INCR_CHUNK_SIZE, chunk); }
+
+        if (text && !text->atEnd(cursor)) {
+            beginTransfer(event->requestor, event->property, event->target, text);
+        }
+        else {
+            auto cookie = xcb_change_property_checked(_basics.connection(),
+                                                      XCB_PROP_MODE_REPLACE,
+                                                      event->requestor,
+                                                      event->property,
+                                                      event->target,
+                                                      8,
+                                                      chunk.length(),
+                                                      chunk.data());
+            xcb_request_failed(_basics.connection(), cookie, "Failed to change property.");
+        }
+
         response.property = event->property;
     }
 
@@ -565,13 +643,50 @@ void Screen::clientMessage(xcb_client_message_event_t * event) noexcept {
     }
 }
 
+void Screen::propertyNotify(xcb_property_notify_event_t * event) noexcept {
+    if (event->state == XCB_PROPERTY_DELETE) {
+        // A requestor has taken a chunk, send the next.
+        for (auto iter = _transfers.begin(); iter != _transfers.end(); ++iter) {
+            if (iter->requestor == event->window && iter->property == event->atom) {
+                continueTransfer(iter);
+                break;
+            }
+        }
+    }
+    else if (_receiving && event->window == getWindow() && event->atom == XCB_ATOM_PRIMARY) {
+        // An owner has sent us a chunk.
+        xcb_atom_t           type;
+        std::vector<uint8_t> content;
+        readProperty(type, content);
+
+        xcb_delete_property(_basics.connection(), getWindow(), XCB_ATOM_PRIMARY);
+        xcb_flush(_basics.connection());
+
+        if (content.empty()) {
+            // The zero length chunk ends the transfer.
+            _receiving = false;
+
+            if (!_received.empty() && _open) {
+                _terminal->paste(&_received.front(), _received.size());
+            }
+
+            std::vector<uint8_t>().swap(_received);
+        }
+        else {
+            _received.insert(_received.end(), content.begin(), content.end());
+        }
+    }
+}
+
 //
 //
 //
 
 void Screen::redraw() {
+    RenderLock lock(renderMutex);
+
     if (_mapped) {
-        ASSERT(_pixmap, "");
+        ASSERT(_pixmap || _shmImage, "");
         ASSERT(_surface, "");
         renderPixmap();
         copyPixmapToWindow(0, 0, _geometry.width, _geometry.height);
@@ -590,6 +705,44 @@ void Screen::clearSelection() {
     _terminal->clearSelection();
 }
 
+void Screen::saveHistory(OutStream & ostream) const throw (StreamError) {
+    _terminal->saveHistory(ostream);
+}
+
+void Screen::restoreHistory(const std::string & path) throw (StreamError) {
+    _terminal->restoreHistory(path);
+}
+
+void Screen::getMemoryStats(MemoryStats & stats) const {
+    _terminal->getMemoryStats(stats.buffers);
+
+    RenderLock lock(renderMutex);
+
+    // 32 bits per pixel.
+    if (_mapped) {
+        stats.surface += static_cast<size_t>(_geometry.width) * _geometry.height * 4;
+    }
+
+    stats.rowCache += _rowCachePixels * 4;
+}
+
+void Screen::markStyles(std::vector<bool> & used) const {
+    _terminal->markStyles(used);
+}
+
+void Screen::dumpFrames(std::ostream & ost) const {
+    std::vector<FrameTrace::Frame> frames;
+    _terminal->getFrameTrace().snapshot(frames);
+    FrameTrace::dump(ost, frames);
+}
+
+void Screen::getFontMemoryStats(FontManager & fontManager,
+                                size_t      & fontSets,
+                                size_t      & glyphBytes) {
+    RenderLock lock(renderMutex);
+    fontManager.getMemoryStats(fontSets, glyphBytes);
+}
+
 void Screen::deferral() {
     ASSERT(_deferred, "");
     _deferred = false;
@@ -731,7 +884,10 @@ bool Screen::xy2Pos(int x, int y, Pos & pos, Hand & hand) const {
 void Screen::setTitle(const std::string & title, bool prependGeometry) {
     std::ostringstream ost;
     if (prependGeometry) {
-        ost << "[" << _terminal->getCols() << 'x' << _terminal->getRows() << "] ";
+        // The window's size, which the terminal may not have caught up with.
+        int16_t rows, cols;
+        sizeToRowsCols(rows, cols);
+        ost << "[" << cols << 'x' << rows << "] ";
     }
     ost << title;
 
@@ -773,6 +929,20 @@ void Screen::setIcon(const std::string & icon) {
 }
 
 void Screen::createPixmapAndSurface() {
+    if (_shmUsable) {
+        try {
+            _shmImage = new ShmImage(_basics, _geometry.width, _geometry.height);
+            _surface  = _shmImage->getSurface();
+            renderPixmap();
+            return;
+        }
+        catch (const ShmImage::Error & error) {
+            std::cerr
+                << "Not using MIT-SHM: " << error.message << std::endl;
+            _shmUsable = false;
+        }
+    }
+
     _pixmap = xcb_generate_id(_basics.connection());
     // Note, we create the pixmap against the root window rather than
     // getWindow() to avoid dealing with the case where getWindow() may have been
@@ -798,6 +968,16 @@ void Screen::createPixmapAndSurface() {
 }
 
 void Screen::destroySurfaceAndPixmap() {
+    discardFrames();
+
+    if (_shmImage) {
+        // The image owns the surface.
+        delete _shmImage;
+        _shmImage = nullptr;
+        _surface  = nullptr;
+        return;
+    }
+
     cairo_surface_finish(_surface);
     cairo_surface_destroy(_surface);
     _surface = nullptr;
@@ -808,9 +988,14 @@ void Screen::destroySurfaceAndPixmap() {
 }
 
 void Screen::renderPixmap() {
+    StartupTrace::Scope trace("render-pixmap");
+
     ASSERT(_mapped, "");
-    ASSERT(_pixmap, "");
+    ASSERT(_pixmap || _shmImage, "");
     ASSERT(_surface, "");
+    // Everything is about to be redrawn.
+    discardFrames();
+    if (_shmImage) { _shmImage->await(); }
     _cr = cairo_create(_surface);
     cairo_set_line_width(_cr, 1.0);
 
@@ -837,15 +1022,17 @@ void Screen::drawBorder() {
     auto border_thickness = _config.borderThickness;
     auto scrollbar_width  = _config.scrollbarVisible ? _config.scrollbarWidth : 0;
 
+    // Until a debounced resize takes effect the terminal may overhang the
+    // window.
     auto x0 = 0;
     auto x1 = border_thickness;
-    auto x2 = border_thickness + _fontSet->getWidth() * _terminal->getCols();
     auto x3 = _geometry.width - scrollbar_width;
+    auto x2 = std::min<int>(x3, border_thickness + _fontSet->getWidth() * _terminal->getCols());
 
     auto y0 = 0;
     auto y1 = border_thickness;
-    auto y2 = border_thickness + _fontSet->getHeight() * _terminal->getRows();
     auto y3 = _geometry.height;
+    auto y2 = std::min<int>(y3, border_thickness + _fontSet->getHeight() * _terminal->getRows());
 
     if (_config.x11PseudoTransparency) {
         auto x = _geometry.x;
@@ -934,18 +1121,248 @@ void Screen::drawBorder() {
     } cairo_restore(_cr);
 }
 
+// Draw a run of cells from the glyph atlas, one glyph per cell. Returns false,
+// having drawn nothing, if any cell needs Pango to lay it out.
+bool Screen::atlasDrawable(const uint8_t * str, size_t size) {
+    try {
+        for (size_t i = 0; i < size; i += utf8::leadLength(str[i])) {
+            if (!GlyphAtlas::isSimple(utf8::decode(&str[i]))) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+    catch (const utf8::Error &) {
+        return false;
+    }
+}
+
+void Screen::drawGlyphs(int x, int y, bool italic, bool bold,
+                        const uint8_t * str, size_t size) {
+    ASSERT(atlasDrawable(str, size), "");
+
+    auto & atlas = _fontSet->getAtlas();
+    auto   font  = _fontSet->get(italic, bold);
+
+    for (size_t i = 0; i < size; i += utf8::leadLength(str[i])) {
+        atlas.draw(_cr, font, italic, bold, utf8::decode(&str[i]), x, y);
+        x += _fontSet->getWidth();
+    }
+}
+
+PangoLayout * Screen::fgLayout() {
+    ASSERT(_cr, "");
+
+    if (!_layout) {
+        _layout = pango_cairo_create_layout(_cr);
+        pango_layout_set_width(_layout, -1);
+    }
+    else {
+        // The context may be new, though its target is alike.
+        pango_cairo_update_layout(_cr, _layout);
+    }
+
+    return _layout;
+}
+
+void Screen::drawFgRun(int16_t row, const FgRun & run, const uint8_t * str, bool glyphs) {
+    cairo_save(_cr); {
+        auto italic = run.attrs.get(Attr::ITALIC);
+        auto bold   = run.attrs.get(Attr::BOLD);
+
+        int x, y;
+        pos2XY(Pos(row, run.col), x, y);
+
+        double w = run.count * _fontSet->getWidth();
+        double h = _fontSet->getHeight();
+        cairo_rectangle(_cr, x, y, w, h);
+        cairo_clip(_cr);
+
+        auto alpha = run.attrs.get(Attr::CONCEAL) ? 0.1 : run.attrs.get(Attr::FAINT) ? 0.5 : 1.0;
+        auto fg    = getColor(run.color);
+        cairo_set_source_rgba(_cr, fg.r, fg.g, fg.b, alpha);
+
+        if (run.attrs.get(Attr::UNDERLINE)) {
+            cairo_move_to(_cr, x, y + h - 0.5);
+            cairo_rel_line_to(_cr, w, 0.0);
+            cairo_stroke(_cr);
+        }
+
+        if (glyphs) {
+            drawGlyphs(x, y, italic, bold, str + run.offset, run.size);
+        }
+        else {
+            auto layout = fgLayout();
+            pango_layout_set_attributes(layout, nullptr);
+            pango_layout_set_font_description(layout, _fontSet->get(italic, bold));
+
+            cairo_move_to(_cr, x, y);
+            pango_layout_set_text(layout, reinterpret_cast<const char *>(str + run.offset),
+                                  run.size);
+            pango_cairo_show_layout(_cr, layout);
+        }
+
+        ASSERT(cairo_status(_cr) == 0,
+               "Cairo error: " << cairo_status_to_string(cairo_status(_cr)));
+    } cairo_restore(_cr);
+}
+
+void Screen::drawFgSegment(int16_t row, const FgRun * begin, const FgRun * end,
+                           const uint8_t * str) {
+    if (begin == end) { return; }
+
+    auto last = end - 1;
+
+    cairo_save(_cr); {
+        int x, y;
+        pos2XY(Pos(row, begin->col), x, y);
+
+        double h = _fontSet->getHeight();
+        cairo_rectangle(_cr, x, y, (last->col + last->count - begin->col) * _fontSet->getWidth(), h);
+        cairo_clip(_cr);
+
+        // Colours and fonts by attribute, underlines as drawn for single runs.
+        auto list      = pango_attr_list_new();
+        auto listGuard = scopeGuard([&] { pango_attr_list_unref(list); });
+        auto max       = std::numeric_limits<uint16_t>::max();
+
+        for (auto run = begin; run != end; ++run) {
+            auto fg    = getColor(run->color);
+            auto first = run->offset - begin->offset;
+
+            auto color = pango_attr_foreground_new(fg.r * max, fg.g * max, fg.b * max);
+            color->start_index = first;
+            color->end_index   = first + run->size;
+            pango_attr_list_insert(list, color);
+
+            auto italic = run->attrs.get(Attr::ITALIC);
+            auto bold   = run->attrs.get(Attr::BOLD);
+
+            if (italic || bold) {
+                auto font = pango_attr_font_desc_new(_fontSet->get(italic, bold));
+                font->start_index = first;
+                font->end_index   = first + run->size;
+                pango_attr_list_insert(list, font);
+            }
+
+            if (run->attrs.get(Attr::UNDERLINE)) {
+                int x0, y0;
+                pos2XY(Pos(row, run->col), x0, y0);
+                cairo_set_source_rgb(_cr, fg.r, fg.g, fg.b);
+                cairo_move_to(_cr, x0, y0 + h - 0.5);
+                cairo_rel_line_to(_cr, run->count * _fontSet->getWidth(), 0.0);
+                cairo_stroke(_cr);
+            }
+        }
+
+        auto layout = fgLayout();
+        pango_layout_set_attributes(layout, list);
+        pango_layout_set_font_description(layout, _fontSet->get(false, false));
+
+        cairo_move_to(_cr, x, y);
+        pango_layout_set_text(layout, reinterpret_cast<const char *>(str + begin->offset),
+                              last->offset + last->size - begin->offset);
+        pango_cairo_show_layout(_cr, layout);
+
+        ASSERT(cairo_status(_cr) == 0,
+               "Cairo error: " << cairo_status_to_string(cairo_status(_cr)));
+    } cairo_restore(_cr);
+}
+
 void Screen::copyPixmapToWindow(int x, int y, int w, int h) {
+    xcb_rectangle_t rect = {
+        static_cast<int16_t>(x),  static_cast<int16_t>(y),
+        static_cast<uint16_t>(w), static_cast<uint16_t>(h)
+    };
+    copyPixmapToWindow(std::vector<xcb_rectangle_t>(1, rect));
+}
+
+void Screen::copyPixmapToWindow(const std::vector<xcb_rectangle_t> & rects) {
+    StartupTrace::Scope trace("copy-to-window");
+    auto                start = FrameTrace::Clock::now();
+
     ASSERT(_mapped, "");
-    ASSERT(_pixmap, "");
-    // Copy the buffer region and flush.
-    xcb_copy_area(_basics.connection(),
-                  _pixmap,
-                  getWindow(),
-                  _gc,
-                  x, y,   // src
-                  x, y,   // dst
-                  w, h);
+    ASSERT(_pixmap || _shmImage, "");
+
+    // Copy the buffer regions and flush once.
+    for (auto & r : rects) {
+        if (_shmImage) {
+            _shmImage->put(getWindow(), _gc, r.x, r.y, r.width, r.height);
+        }
+        else {
+            xcb_copy_area(_basics.connection(),
+                          _pixmap,
+                          getWindow(),
+                          _gc,
+                          r.x, r.y,   // src
+                          r.x, r.y,   // dst
+                          r.width, r.height);
+        }
+    }
+
     xcb_flush(_basics.connection());
+
+    if (_terminal) {
+        _terminal->getFrameTrace().addTime(FrameTrace::COPY, FrameTrace::Clock::now() - start);
+    }
+}
+
+// Strips are drawn with, and captured from, _cr's surface on the main thread.
+// Recorded frames don't exist in the surface yet, and pseudo-transparent
+// rows depend on where the window is.
+bool Screen::rowCacheUsable() const {
+    return _config.rowCachePixels != 0 && !_recording && !_config.x11PseudoTransparency;
+}
+
+void Screen::flushRowCache() {
+    for (auto & pair : _rowCache) {
+        cairo_surface_destroy(pair.second);
+    }
+
+    _rowCache.clear();
+    _rowCachePixels = 0;
+}
+
+// The render thread replays the frames recorded by the main thread. Frames
+// that arrive while it is drawing are spliced together and drawn as one.
+void Screen::render() {
+    DrawList frames;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(_queueMutex);
+            _queueCondition.wait(lock, [this] { return _finalised || !_pending.empty(); });
+            if (_finalised) { return; }
+        }
+
+        RenderLock renderLock(renderMutex);
+
+        {
+            std::unique_lock<std::mutex> lock(_queueMutex);
+            frames.splice(_pending);
+        }
+
+        // The frames may have been discarded while we waited for the lock.
+        if (!frames.empty()) {
+            ASSERT(_mapped, "");
+            ASSERT(_surface, "");
+            if (_shmImage) { _shmImage->await(); }
+            _cr = cairo_create(_surface);
+            cairo_set_line_width(_cr, 1.0);
+
+            FrameTrace::Timer timer(_terminal->getFrameTrace(), FrameTrace::RENDER);
+            frames.replay(*this);
+            frames.clear();
+        }
+    }
+}
+
+// Drop the frames the render thread hasn't drawn, because the surface is
+// about to be redrawn or destroyed. The caller holds the render lock.
+void Screen::discardFrames() {
+    std::unique_lock<std::mutex> lock(_queueMutex);
+    _pending.clear();
 }
 
 void Screen::handleConfigure() {
@@ -962,12 +1379,16 @@ void Screen::handleConfigure() {
 }
 
 void Screen::handleResize() {
+    RenderLock lock(renderMutex);
+
     _geometry = _deferredGeometry;
 
     int16_t rows, cols;
     sizeToRowsCols(rows, cols);
 
-    _terminal->resize(rows, cols);      // OK to resize if not open?
+    // Dragging the window produces a stream of these. The terminal keeps
+    // its size, drawn into the resized pixmap, until they stop.
+    _terminal->resizeDebounced(rows, cols);     // OK to resize if not open?
 
     if (_hadDeleteRequest) {
         // Resizes clear delete requests that are waiting for confirmation.
@@ -981,7 +1402,7 @@ void Screen::handleResize() {
     }
 
     if (_mapped) {
-        ASSERT(_pixmap, "Null pixmap.");
+        ASSERT(_pixmap || _shmImage, "Null pixmap.");
         ASSERT(_surface, "Null surface.");
 
         destroySurfaceAndPixmap();
@@ -1014,10 +1435,12 @@ void Screen::handleResize() {
 void Screen::handleMove() {
     ASSERT(_config.x11PseudoTransparency, "");
 
+    RenderLock lock(renderMutex);
+
     _geometry = _deferredGeometry;
 
     if (_mapped) {
-        ASSERT(_pixmap, "");
+        ASSERT(_pixmap || _shmImage, "");
         ASSERT(_surface, "");
         renderPixmap();
         copyPixmapToWindow(0, 0, _geometry.width, _geometry.height);
@@ -1102,13 +1525,132 @@ void Screen::cursorVisibility(bool visible) {
     }
 }
 
+// Read the whole of the property that selections are converted into.
+void Screen::readProperty(xcb_atom_t & type, std::vector<uint8_t> & content) {
+    uint32_t offset = 0;        // 32-bit quantities
+
+    type = XCB_ATOM_NONE;
+
+    for (;;) {
+        auto cookie = xcb_get_property(_basics.connection(),
+                                       false,     // delete
+                                       getWindow(),
+                                       XCB_ATOM_PRIMARY,
+                                       XCB_GET_PROPERTY_TYPE_ANY,
+                                       offset,
+                                       8192 / 4);
+
+        auto reply = xcb_get_property_reply(_basics.connection(), cookie, nullptr);
+        if (!reply) { break; }
+
+        auto guard  = scopeGuard([reply] { std::free(reply); });
+        auto value  = static_cast<uint8_t *>(xcb_get_property_value(reply));
+        auto length = xcb_get_property_value_length(reply);
+        if (offset == 0) { type = reply->type; }
+        if (length == 0) { break; }
+
+        auto oldSize = content.size();
+        content.resize(oldSize + length);
+        std::copy(value, value + length, content.begin() + oldSize);
+
+        offset += (length + 3) / 4;
+    }
+}
+
+void Screen::beginTransfer(xcb_window_t                                 requestor,
+                           xcb_atom_t                                   property,
+                           xcb_atom_t                                   target,
+                           const std::shared_ptr<const SelectionText> & text) {
+    // A new request for the same property supersedes an unfinished one.
+    for (auto iter = _transfers.begin(); iter != _transfers.end(); ++iter) {
+        if (iter->requestor == requestor && iter->property == property) {
+            endTransfer(iter);
+            break;
+        }
+    }
+
+    // We need to hear of the requestor deleting the property, without
+    // disturbing the events we (if it is one of our windows) already select.
+    uint32_t eventMask = 0;
+    auto     other     = std::find_if(_transfers.begin(), _transfers.end(),
+                                      [&](const Transfer & t) { return t.requestor == requestor; });
+
+    if (other != _transfers.end()) {
+        eventMask = other->eventMask;
+    }
+    else {
+        auto cookie = xcb_get_window_attributes(_basics.connection(), requestor);
+        auto reply  = xcb_get_window_attributes_reply(_basics.connection(), cookie, nullptr);
+        if (!reply) { return; }     // The requestor has gone.
+        eventMask = reply->your_event_mask;
+        std::free(reply);
+
+        uint32_t mask = eventMask | XCB_EVENT_MASK_PROPERTY_CHANGE;
+        xcb_change_window_attributes(_basics.connection(), requestor, XCB_CW_EVENT_MASK, &mask);
+    }
+
+    getDispatcher().addPropertyWatch(requestor, this);
+
+    // The INCR property holds a lower bound on the size of the selection.
+    uint32_t minSize = std::min<size_t>(text->getMinSize(), std::numeric_limits<uint32_t>::max());
+    auto cookie = xcb_change_property_checked(_basics.connection(),
+                                              XCB_PROP_MODE_REPLACE,
+                                              requestor,
+                                              property,
+                                              _basics.atomIncr(),
+                                              32,
+                                              1,
+                                              &minSize);
+    xcb_request_failed(_basics.connection(), cookie, "Failed to change property.");
+
+    _transfers.push_back(Transfer{ requestor, property, target, eventMask, text,
+                                   SelectionText::Cursor() });
+}
+
+void Screen::continueTransfer(std::vector<Transfer>::iterator iter) {
+    std::string chunk;
+    iter->text->read(iter->cursor, INCR_CHUNK_SIZE, chunk);
+
+    auto cookie = xcb_change_property_checked(_basics.connection(),
+                                              XCB_PROP_MODE_REPLACE,
+                                              iter->requestor,
+                                              iter->property,
+                                              iter->target,
+                                              8,
+                                              chunk.length(),
+                                              chunk.data());
+    auto failed = xcb_request_failed(_basics.connection(), cookie, "Failed to change property.");
+
+    // A zero length chunk ends the transfer.
+    if (failed || chunk.empty()) {
+        endTransfer(iter);
+    }
+
+    xcb_flush(_basics.connection());
+}
+
+void Screen::endTransfer(std::vector<Transfer>::iterator iter) {
+    auto requestor = iter->requestor;
+    auto eventMask = iter->eventMask;
+    _transfers.erase(iter);
+
+    getDispatcher().removePropertyWatch(requestor, this);
+
+    if (std::none_of(_transfers.begin(), _transfers.end(),
+                     [&](const Transfer & t) { return t.requestor == requestor; }))
+    {
+        xcb_change_window_attributes(_basics.connection(), requestor, XCB_CW_EVENT_MASK, &eventMask);
+    }
+}
+
 // Terminal::I_Observer implementation:
 
 const std::string & Screen::terminalGetDisplayName() const {
     return _basics.displayName();
 }
 
-void Screen::terminalCopy(const std::string & text, Terminal::Selection selection) {
+void Screen::terminalCopy(const std::shared_ptr<const SelectionText> & text,
+                          Terminal::Selection                          selection) {
     _observer.screenSelected(this);
 
     xcb_atom_t atom = XCB_ATOM_NONE;
@@ -1140,6 +1682,10 @@ void Screen::terminalPaste(Terminal::Selection selection) {
             break;
     }
 
+    // Abandon any incremental paste that didn't finish.
+    _receiving = false;
+    _received.clear();
+
     xcb_convert_selection(_basics.connection(),
                           getWindow(),
                           atom,
@@ -1202,9 +1748,11 @@ void Screen::terminalBell() {
 
     if (_config.visualBell) {
         if (_mapped) {
-            ASSERT(_pixmap, "Null pixmap.");
+            ASSERT(_pixmap || _shmImage, "Null pixmap.");
             ASSERT(_surface, "Null surface.");
 
+            RenderLock lock(renderMutex);
+
             // Fill the window with a solid colour.
 
             xcb_rectangle_t rect = { 0, 0, _geometry.width, _geometry.height };
@@ -1236,8 +1784,18 @@ bool Screen::terminalFixDamageBegin() {
     // It's possible for the pixmap to be valid (because the window was mapped)
     // but not current (because we haven't received an expose event yet).
     if (!_deferred && _mapped) {
-        ASSERT(_pixmap, "Null pixmap.");
+        ASSERT(_pixmap || _shmImage, "Null pixmap.");
         ASSERT(_surface, "Null surface.");
+
+        if (_renderThread.joinable()) {
+            // Record the frame, it will be drawn by the render thread.
+            _recording = true;
+            return true;
+        }
+
+        _frameLock = RenderLock(renderMutex);
+
+        if (_shmImage) { _shmImage->await(); }
         _cr = cairo_create(_surface);
         cairo_set_line_width(_cr, 1.0);
         return true;
@@ -1247,23 +1805,240 @@ bool Screen::terminalFixDamageBegin() {
     }
 }
 
-void Screen::terminalDrawBg(Pos     pos,
-                            int16_t count,
-                            UColor  color) {
+bool Screen::terminalScroll(int16_t begin,
+                            int16_t end,
+                            int16_t rows) {
+    if (_config.x11PseudoTransparency) {
+        // The root window's pixels must not move with the text.
+        return false;
+    }
+
+    if (_recording) {
+        _drawList.addScroll(begin, end, _terminal->getCols(), rows);
+    }
+    else {
+        drawListScroll(begin, end, _terminal->getCols(), rows);
+    }
+
+    return true;
+}
+
+void Screen::terminalDrawBg(UColor                        color,
+                            const std::vector<CellRect> & rects) {
+    if (_recording) {
+        _drawList.addBg(color, rects);
+    }
+    else {
+        drawListBg(color, rects);
+    }
+}
+
+void Screen::terminalDrawFg(int16_t                    row,
+                            const std::vector<FgRun> & runs,
+                            const uint8_t            * str,
+                            size_t                     size) {
+    ASSERT(!runs.empty(), "");
+    ASSERT(runs.back().col + runs.back().count <= _terminal->getCols(), "");
+
+    if (_recording) {
+        _drawList.addFg(row, runs, str, size);
+    }
+    else {
+        drawListFg(row, runs, str, size);
+    }
+}
+
+void Screen::terminalDrawCursor(Pos             pos,
+                                UColor          fg,
+                                UColor          bg,
+                                AttrSet         attrs,
+                                const uint8_t * str,
+                                size_t          size,
+                                bool            wrapNext,
+                                bool            focused) {
+    if (_recording) {
+        _drawList.addCursor(pos, fg, bg, attrs, str, size, wrapNext, focused);
+    }
+    else {
+        drawListCursor(pos, fg, bg, attrs, str, size, wrapNext, focused);
+    }
+}
+
+bool Screen::terminalBlitRow(int16_t row, const Buffer::RowKey & key) {
+    if (!rowCacheUsable()) { return false; }
+
+    auto iter = _rowCache.find(key);
+    if (iter == _rowCache.end()) { return false; }
+
+    ASSERT(_cr, "");
+
     int x, y;
-    pos2XY(pos, x, y);
+    pos2XY(Pos(row, 0), x, y);
 
-    auto w = count * _fontSet->getWidth();
-    auto h = _fontSet->getHeight();
+    cairo_save(_cr); {
+        cairo_set_operator(_cr, CAIRO_OPERATOR_SOURCE);
+        cairo_set_source_surface(_cr, iter->second, x, y);
+        cairo_rectangle(_cr, x, y, key.cols * _fontSet->getWidth(), _fontSet->getHeight());
+        cairo_fill(_cr);
 
+        ASSERT(cairo_status(_cr) == 0,
+               "Cairo error: " << cairo_status_to_string(cairo_status(_cr)));
+    } cairo_restore(_cr);
+
+    return true;
+}
+
+void Screen::terminalCaptureRow(int16_t row, const Buffer::RowKey & key) {
+    if (!rowCacheUsable()) { return; }
+    if (_rowCache.find(key) != _rowCache.end()) { return; }
+
+    auto w      = key.cols * _fontSet->getWidth();
+    auto h      = _fontSet->getHeight();
+    auto pixels = static_cast<size_t>(w * h);
+
+    if (pixels > _config.rowCachePixels) { return; }
+
+    while (_rowCachePixels + pixels > _config.rowCachePixels) {
+        // Evict the oldest. All strips share the font, so only cols vary.
+        auto oldest = _rowCache.begin();
+        _rowCachePixels -= static_cast<size_t>(oldest->first.cols * _fontSet->getWidth() * h);
+        cairo_surface_destroy(oldest->second);
+        _rowCache.erase(oldest);
+    }
+
+    int x, y;
+    pos2XY(Pos(row, 0), x, y);
+
+    // A similar surface stays in the same place, e.g. on the X server.
+    auto strip = cairo_surface_create_similar(_surface, CAIRO_CONTENT_COLOR, w, h);
+    auto cr    = cairo_create(strip);
+    cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+    cairo_set_source_surface(cr, _surface, -x, -y);
+    cairo_paint(cr);
+    cairo_destroy(cr);
+
+    _rowCache.insert(key, strip);
+    _rowCachePixels += pixels;
+}
+
+void Screen::terminalDrawScrollbar(size_t  totalRows,
+                                   size_t  historyOffset,
+                                   int16_t visibleRows) {
+    ASSERT(_config.scrollbarVisible, "");
+
+    if (_recording) {
+        _drawList.addScrollbar(totalRows, historyOffset, visibleRows);
+    }
+    else {
+        drawListScrollbar(totalRows, historyOffset, visibleRows);
+    }
+}
+
+void Screen::terminalFixDamageEnd(const RegionSet & damage,
+                                  bool              scrollBar) {
+    if (_recording) {
+        _recording = false;
+        _drawList.addEnd(damage, scrollBar);
+
+        std::unique_lock<std::mutex> lock(_queueMutex);
+        // Frames the render thread hasn't reached yet are merged with this one.
+        _pending.splice(_drawList);
+        _queueCondition.notify_one();
+    }
+    else {
+        drawListEnd(damage, scrollBar);
+        _frameLock.unlock();
+    }
+}
+
+void Screen::terminalReaped(int status) {
+    _open = false;
+    _observer.screenReaped(this, status);
+}
+
+// FontManager::I_Client implementation:
+
+void Screen::useFontSet(FontSet * fontSet, int delta) {
+    RenderLock lock(renderMutex);
+
+    _fontSet = fontSet;
+    flushRowCache();
+
+    // Pass 'true' for sync so that the window has handled the configure
+    // event when this function returns.
+    _entitlement = Entitlement::PENDING;
+    resizeToAccommodate(_terminal->getRows(), _terminal->getCols(), true);
+
+    int16_t rows, cols;
+    sizeToRowsCols(rows, cols);
+
+    if (rows != _terminal->getRows() || cols != _terminal->getCols()) {
+        _terminal->resize(rows, cols);      // Ok to resize if not open?
+    }
+
+    if (_mapped) {
+        ASSERT(_pixmap || _shmImage, "");
+        ASSERT(_surface, "");
+        renderPixmap();
+        copyPixmapToWindow(0, 0, _geometry.width, _geometry.height);
+    }
+
+    std::ostringstream ost;
+    ost << "Font size: " << explicitSign(delta);
+    _entitlement = Entitlement::TRANSIENT;
+    setTitle(ost.str(), true);
+}
+
+// DrawList::I_Target implementation:
+
+void Screen::drawListScroll(int16_t begin,
+                            int16_t end,
+                            int16_t cols,
+                            int16_t rows) {
+    ASSERT(_cr, "");
+
+    int x0, y0;
+    pos2XY(Pos(begin, 0), x0, y0);
+    int x1, y1;
+    pos2XY(Pos(end, cols), x1, y1);
+
+    auto dy = rows * _fontSet->getHeight();
+    auto h  = y1 - y0 - std::abs(dy);
+    ASSERT(h > 0, "");
+
+    if (_shmImage) {
+        _shmImage->scroll(x0, y0, x1 - x0, y1 - y0, dy);
+        return;
+    }
+
+    // Cairo must be flushed before, and told about, drawing behind its back.
+    cairo_surface_flush(_surface);
+    xcb_copy_area(_basics.connection(),
+                  _pixmap,
+                  _pixmap,
+                  _gc,
+                  x0, dy > 0 ? y0 + dy : y0,        // src
+                  x0, dy > 0 ? y0 : y0 - dy,        // dst
+                  x1 - x0, h);
+    cairo_surface_mark_dirty(_surface);
+}
+
+void Screen::drawListBg(UColor                        color,
+                        const std::vector<CellRect> & rects) {
     if (_config.x11PseudoTransparency) {
-        xcb_copy_area(_basics.connection(),
-                      _basics.rootPixmap(),
-                      _pixmap,
-                      _gc,
-                      _geometry.x + x, _geometry.y + y,   // src
-                      x, y,                               // dst
-                      w, h);
+        for (auto & rect : rects) {
+            int x, y;
+            pos2XY(rect.pos, x, y);
+
+            xcb_copy_area(_basics.connection(),
+                          _basics.rootPixmap(),
+                          _pixmap,
+                          _gc,
+                          _geometry.x + x, _geometry.y + y,   // src
+                          x, y,                               // dst
+                          rect.cols * _fontSet->getWidth(),
+                          rect.rows * _fontSet->getHeight());
+        }
     }
 
     ASSERT(_cr, "");
@@ -1276,7 +2051,15 @@ void Screen::terminalDrawBg(Pos     pos,
         auto bg = getColor(color);
         cairo_set_source_rgba(_cr, bg.r, bg.g, bg.b, alpha);
 
-        cairo_rectangle(_cr, x, y, w, h);
+        // One path, one fill.
+        for (auto & rect : rects) {
+            int x, y;
+            pos2XY(rect.pos, x, y);
+
+            cairo_rectangle(_cr, x, y,
+                            rect.cols * _fontSet->getWidth(),
+                            rect.rows * _fontSet->getHeight());
+        }
         cairo_fill(_cr);
 
         ASSERT(cairo_status(_cr) == 0,
@@ -1284,58 +2067,41 @@ void Screen::terminalDrawBg(Pos     pos,
     } cairo_restore(_cr);
 }
 
-void Screen::terminalDrawFg(Pos             pos,
-                            int16_t         count,
-                            UColor          color,
-                            AttrSet         attrs,
-                            const uint8_t * str,
-                            size_t          size) {
+void Screen::drawListFg(int16_t                    row,
+                        const std::vector<FgRun> & runs,
+                        const uint8_t            * str,
+                        size_t                     UNUSED(size)) {
     ASSERT(_cr, "");
-    ASSERT(pos.col + count <= _terminal->getCols(), "");
 
-    cairo_save(_cr); {
-        auto layout = pango_cairo_create_layout(_cr);
-        auto layoutGuard = scopeGuard([&] { g_object_unref(layout); });
-
-        auto font = _fontSet->get(attrs.get(Attr::ITALIC), attrs.get(Attr::BOLD));
-        pango_layout_set_font_description(layout, font);
-        pango_layout_set_width(layout, -1);
+    // The glyph atlas draws what it can, run by run. Of the rest, consecutive
+    // runs of plain single byte cells share a layout, with attributes for
+    // their colours and fonts. Anything else is laid out alone, in case its
+    // glyphs don't match the cell width and would upset the others.
+    auto pending = runs.data();     // The first run awaiting a shared layout.
 
-        int x, y;
-        pos2XY(pos, x, y);
-
-        double w = count * _fontSet->getWidth();
-        double h = _fontSet->getHeight();
-        cairo_rectangle(_cr, x, y, w, h);
-        cairo_clip(_cr);
-
-        auto alpha = attrs.get(Attr::CONCEAL) ? 0.1 : attrs.get(Attr::FAINT) ? 0.5 : 1.0;
-        auto fg    = getColor(color);
-        cairo_set_source_rgba(_cr, fg.r, fg.g, fg.b, alpha);
+    for (auto & run : runs) {
+        auto glyphs = _config.glyphCache && atlasDrawable(str + run.offset, run.size);
+        auto plain  = run.size == static_cast<uint32_t>(run.count) &&
+                      !run.attrs.get(Attr::CONCEAL) && !run.attrs.get(Attr::FAINT);
 
-        if (attrs.get(Attr::UNDERLINE)) {
-            cairo_move_to(_cr, x, y + h - 0.5);
-            cairo_rel_line_to(_cr, w, 0.0);
-            cairo_stroke(_cr);
-        }
+        if (!glyphs && plain) { continue; }
 
-        cairo_move_to(_cr, x, y);
-        pango_layout_set_text(layout, reinterpret_cast<const char *>(str), size);
-        pango_cairo_show_layout(_cr, layout);
+        drawFgSegment(row, pending, &run, str);
+        drawFgRun(row, run, str, glyphs);
+        pending = &run + 1;
+    }
 
-        ASSERT(cairo_status(_cr) == 0,
-               "Cairo error: " << cairo_status_to_string(cairo_status(_cr)));
-    } cairo_restore(_cr);
+    drawFgSegment(row, pending, runs.data() + runs.size(), str);
 }
 
-void Screen::terminalDrawCursor(Pos             pos,
-                                UColor          fg_,
-                                UColor          bg_,
-                                AttrSet         attrs,
-                                const uint8_t * str,
-                                size_t          size,
-                                bool            wrapNext,
-                                bool            focused) {
+void Screen::drawListCursor(Pos             pos,
+                            UColor          fg_,
+                            UColor          bg_,
+                            AttrSet         attrs,
+                            const uint8_t * str,
+                            size_t          size,
+                            bool            wrapNext,
+                            bool            focused) {
     ASSERT(_cr, "");
 
     cairo_save(_cr); {
@@ -1389,9 +2155,9 @@ void Screen::terminalDrawCursor(Pos             pos,
     } cairo_restore(_cr);
 }
 
-void Screen::terminalDrawScrollbar(size_t  totalRows,
-                                   size_t  historyOffset,
-                                   int16_t visibleRows) {
+void Screen::drawListScrollbar(size_t  totalRows,
+                               size_t  historyOffset,
+                               int16_t visibleRows) {
     ASSERT(_cr, "");
     ASSERT(_config.scrollbarVisible, "");
 
@@ -1450,61 +2216,97 @@ void Screen::terminalDrawScrollbar(size_t  totalRows,
     } cairo_restore(_cr);
 }
 
-void Screen::terminalFixDamageEnd(const Region & damage,
-                                  bool           scrollBar) {
-    ASSERT(_cr, "");
+// Over the top right cells, in reverse video. Drawn after the damage, so it
+// stays on top, in the top row, which scrolling (usually up) discards rather
+// than moves.
+void Screen::drawFrameTime(xcb_rectangle_t & rect) {
+    FrameTrace::Frame frame;
+    if (!_terminal->getFrameTrace().last(frame)) { return; }
 
-    cairo_destroy(_cr);
-    _cr = nullptr;
+    const int COLS = 8;
 
-    cairo_surface_flush(_surface);      // Useful?
+    std::ostringstream ost;
+    ost.precision(1);
+    ost << std::fixed << frame.totalMicros() / 1000.0 << "ms";
+    auto text = ost.str();
 
-    int x0, y0;
-    pos2XY(damage.begin, x0, y0);
-    int x1, y1;
-    pos2XY(damage.end, x1, y1);
+    auto w = std::min<int>(COLS * _fontSet->getWidth(), _geometry.width);
+    auto h = std::min<int>(_fontSet->getHeight(), _geometry.height);
+    auto x = _geometry.width - w -
+        (_config.scrollbarVisible ? _config.scrollbarWidth : 0) - _config.borderThickness;
+    auto y = _config.borderThickness;
 
-    if (scrollBar) {
-        // Expand the region to include the scroll bar
-        y0 = 0;
-        x1 = _geometry.width;
-        y1 = _geometry.height;
-    }
+    if (x < 0) { return; }
 
-    copyPixmapToWindow(x0, y0, x1 - x0, y1 - y0);
-}
+    cairo_save(_cr); {
+        cairo_rectangle(_cr, x, y, w, h);
+        cairo_clip(_cr);
 
-void Screen::terminalReaped(int status) {
-    _open = false;
-    _observer.screenReaped(this, status);
+        auto & fill = _colorSet.getNormalFgColor();
+        cairo_set_source_rgb(_cr, fill.r, fill.g, fill.b);
+        cairo_paint(_cr);
+
+        auto layout = pango_cairo_create_layout(_cr);
+        auto layoutGuard = scopeGuard([&] { g_object_unref(layout); });
+
+        pango_layout_set_font_description(layout, _fontSet->get(false, false));
+        pango_layout_set_width(layout, -1);
+        pango_layout_set_text(layout, text.data(), text.size());
+
+        auto & ink = _colorSet.getNormalBgColor();
+        cairo_set_source_rgb(_cr, ink.r, ink.g, ink.b);
+        cairo_move_to(_cr, x, y);
+        pango_cairo_show_layout(_cr, layout);
+    } cairo_restore(_cr);
+
+    rect.x      = static_cast<int16_t>(x);
+    rect.y      = static_cast<int16_t>(y);
+    rect.width  = static_cast<uint16_t>(w);
+    rect.height = static_cast<uint16_t>(h);
 }
 
-// FontManager::I_Client implementation:
+void Screen::drawListEnd(const RegionSet & damage,
+                         bool              scrollBar) {
+    ASSERT(_cr, "");
 
-void Screen::useFontSet(FontSet * fontSet, int delta) {
-    _fontSet = fontSet;
+    xcb_rectangle_t overlay = { 0, 0, 0, 0 };
+    if (_config.frameTimeOverlay) { drawFrameTime(overlay); }
 
-    // Pass 'true' for sync so that the window has handled the configure
-    // event when this function returns.
-    _entitlement = Entitlement::PENDING;
-    resizeToAccommodate(_terminal->getRows(), _terminal->getCols(), true);
+    cairo_destroy(_cr);
+    _cr = nullptr;
 
-    int16_t rows, cols;
-    sizeToRowsCols(rows, cols);
+    cairo_surface_flush(_surface);      // Useful?
 
-    if (rows != _terminal->getRows() || cols != _terminal->getCols()) {
-        _terminal->resize(rows, cols);      // Ok to resize if not open?
+    // Copy only the damaged regions, not their bounding box.
+    std::vector<xcb_rectangle_t> rects;
+
+    for (auto & region : damage.getRegions()) {
+        int x0, y0;
+        pos2XY(region.begin, x0, y0);
+        int x1, y1;
+        pos2XY(region.end, x1, y1);
+
+        xcb_rectangle_t rect = {
+            static_cast<int16_t>(x0),       static_cast<int16_t>(y0),
+            static_cast<uint16_t>(x1 - x0), static_cast<uint16_t>(y1 - y0)
+        };
+        rects.push_back(rect);
     }
 
-    if (_mapped) {
-        ASSERT(_pixmap, "");
-        ASSERT(_surface, "");
-        renderPixmap();
-        copyPixmapToWindow(0, 0, _geometry.width, _geometry.height);
+    if (scrollBar) {
+        auto w = _config.scrollbarWidth;
+        xcb_rectangle_t rect = {
+            static_cast<int16_t>(_geometry.width - w), 0,
+            static_cast<uint16_t>(w),                  _geometry.height
+        };
+        rects.push_back(rect);
     }
 
-    std::ostringstream ost;
-    ost << "Font size: " << explicitSign(delta);
-    _entitlement = Entitlement::TRANSIENT;
-    setTitle(ost.str(), true);
+    if (overlay.width != 0) { rects.push_back(overlay); }
+
+    copyPixmapToWindow(rects);
+
+    // The first frame drawn from the terminal's damage, normally the shell's
+    // prompt, ends starting up.
+    StartupTrace::finish();
 }
@@ -7,22 +7,32 @@
 #include "terminol/xcb/basics.hxx"
 #include "terminol/xcb/color_set.hxx"
 #include "terminol/xcb/font_manager.hxx"
+#include "terminol/xcb/shm_image.hxx"
 #include "terminol/xcb/widget.hxx"
 #include "terminol/common/config.hxx"
+#include "terminol/common/draw_list.hxx"
 #include "terminol/common/key_map.hxx"
 #include "terminol/common/terminal.hxx"
 #include "terminol/support/async_destroyer.hxx"
+#include "terminol/support/cache.hxx"
 #include "terminol/support/selector.hxx"
 #include "terminol/support/pattern.hxx"
 
 #include <xcb/xcb.h>
 #include <xcb/xcb_keysyms.h>
 #include <cairo-xcb.h>
+#include <pango/pangocairo.h>
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
 
 class Screen :
     public    Widget,
     protected Terminal::I_Observer,
-    protected FontManager::I_Client
+    protected FontManager::I_Client,
+    protected DrawList::I_Target
 {
 public:
     class I_Observer {
@@ -52,12 +62,37 @@ private:
     bool              _open;
     Pos               _pointerPos;
 
-    // If the window is mapped then _pixmap and _surface are be valid. Otherwise not.
+    // If the window is mapped then _surface and one of _pixmap/_shmImage are be
+    // valid. Otherwise not.
     bool              _mapped;
     xcb_pixmap_t      _pixmap;              // Created when mapped, destroyed when unmapped.
+    ShmImage        * _shmImage;            // Alternative to _pixmap, see config.x11Shm.
+    bool              _shmUsable;           // False once MIT-SHM has failed.
     cairo_surface_t * _surface;             // Ditto.
 
     cairo_t         * _cr;                  // Cairo drawing context. Created only as required.
+    PangoLayout     * _layout;              // Reused for the foreground, created on first use.
+
+    // Rendered historical rows, see config.rowCachePixels. The strips don't
+    // depend on the pixmap, but they do on the font.
+    typedef Cache<Buffer::RowKey, cairo_surface_t *, Buffer::RowKey::Hash> RowCache;
+    RowCache          _rowCache;
+    size_t            _rowCachePixels;      // Total area of the strips.
+
+    // With config.renderThread, the main thread records each frame into
+    // _drawList and hands it over via _pending. The render thread replays
+    // _pending into the surface.
+    bool                    _recording;     // Between terminalFixDamage{Begin,End}().
+    // Otherwise the frame is drawn directly and, as terminols' worker
+    // threads each draw their own screens, holds the render mutex
+    // throughout.
+    std::unique_lock<std::recursive_mutex> _frameLock;
+    DrawList                _drawList;
+    DrawList                _pending;       // Guarded by _queueMutex.
+    bool                    _finalised;     // Ditto.
+    std::mutex              _queueMutex;
+    std::condition_variable _queueCondition;
+    std::thread             _renderThread;
 
     enum class Entitlement {
         PERMANENT,
@@ -69,8 +104,23 @@ private:
     std::string       _title;
     std::string       _icon;
 
-    std::string       _primarySelection;
-    std::string       _clipboardSelection;
+    std::shared_ptr<const SelectionText> _primarySelection;
+    std::shared_ptr<const SelectionText> _clipboardSelection;
+
+    // A selection too large for one property is sent with the INCR
+    // protocol, a chunk each time the requestor deletes the property.
+    struct Transfer {
+        xcb_window_t                         requestor;
+        xcb_atom_t                           property;
+        xcb_atom_t                           target;
+        uint32_t                             eventMask;     // The requestor's, to restore.
+        std::shared_ptr<const SelectionText> text;
+        SelectionText::Cursor                cursor;
+    };
+
+    std::vector<Transfer> _transfers;
+    bool                  _receiving;       // Is an INCR paste in progress?
+    std::vector<uint8_t>  _received;        // Its chunks so far.
 
     bool              _pressed;         // Is there an active button press?
     int               _pressCount;      // single, double, triple-click, etc
@@ -90,6 +140,14 @@ public:
         std::string message;
     };
 
+    struct MemoryStats {
+        Buffer::MemoryStats buffers;
+        size_t              surface  = 0;   // The pixmap or shared image, if mapped.
+        size_t              rowCache = 0;   // The strips of rendered rows.
+    };
+
+    // Zero 'rows' or 'cols' is the configured size. A 'cwd' or 'command'
+    // other than the pool's calls for a null 'shellPool'.
     Screen(I_Observer         & observer,
            const Config       & config,
            I_Selector         & selector,
@@ -99,7 +157,12 @@ public:
            Basics             & basics,
            const ColorSet     & colorSet,
            FontManager        & fontManager,
-           const Tty::Command & command = Tty::Command()) throw (Widget::Error, Error);
+           int16_t              rows,
+           int16_t              cols,
+           const Tty::Command & command,
+           const std::string  & cwd,
+           ShellPool          * shellPool = nullptr,
+           HistoryBudget      * historyBudget = nullptr) throw (Widget::Error, Error);
 
     virtual ~Screen();
 
@@ -112,6 +175,19 @@ public:
     void killReap();
     void clearSelection();
     void deferral();
+    void saveHistory(OutStream & ostream) const throw (StreamError);
+    void restoreHistory(const std::string & path) throw (StreamError);
+
+    void getMemoryStats(MemoryStats & stats) const;
+    // See Terminal::markStyles().
+    void markStyles(std::vector<bool> & used) const;
+    void dumpFrames(std::ostream & ost) const;
+
+    // The font sets and their glyph atlases, which are shared by all
+    // screens. Excludes drawing while it counts.
+    static void getFontMemoryStats(FontManager & fontManager,
+                                   size_t      & fontSets,
+                                   size_t      & glyphBytes);
 
 protected:
     void icccmConfigure();
@@ -126,7 +202,22 @@ protected:
     void destroySurfaceAndPixmap();
     void renderPixmap();
     void drawBorder();
+    static bool atlasDrawable(const uint8_t * str, size_t size);
+    void drawGlyphs(int x, int y, bool italic, bool bold,
+                    const uint8_t * str, size_t size);
+    PangoLayout * fgLayout();
+    void drawFgRun(int16_t row, const FgRun & run, const uint8_t * str, bool glyphs);
+    void drawFgSegment(int16_t row, const FgRun * begin, const FgRun * end,
+                       const uint8_t * str);
     void copyPixmapToWindow(int x, int y, int w, int h);
+    void copyPixmapToWindow(const std::vector<xcb_rectangle_t> & rects);
+    void drawFrameTime(xcb_rectangle_t & rect);
+
+    bool rowCacheUsable() const;
+    void flushRowCache();
+
+    void render();
+    void discardFrames();
 
     void handleConfigure();
     void handleResize();
@@ -139,10 +230,19 @@ protected:
 
     void cursorVisibility(bool visible);
 
+    void readProperty(xcb_atom_t & type, std::vector<uint8_t> & content);
+    void beginTransfer(xcb_window_t                                 requestor,
+                       xcb_atom_t                                   property,
+                       xcb_atom_t                                   target,
+                       const std::shared_ptr<const SelectionText> & text);
+    void continueTransfer(std::vector<Transfer>::iterator iter);
+    void endTransfer(std::vector<Transfer>::iterator iter);
+
     // Terminal::I_Observer implementation:
 
     const std::string & terminalGetDisplayName() const override;
-    void terminalCopy(const std::string & text, Terminal::Selection selection) override;
+    void terminalCopy(const std::shared_ptr<const SelectionText> & text,
+                      Terminal::Selection                          selection) override;
     void terminalPaste(Terminal::Selection selection) override;
     void terminalResizeLocalFont(int delta) override;
     void terminalResizeGlobalFont(int delta) override;
@@ -152,15 +252,15 @@ protected:
     void terminalBell() override;
     void terminalResizeBuffer(int16_t rows, int16_t cols) override;
     bool terminalFixDamageBegin() override;
-    void terminalDrawBg(Pos     pos,
-                        int16_t count,
-                        UColor color) override;
-    void terminalDrawFg(Pos             pos,
-                        int16_t         count,
-                        UColor          color,
-                        AttrSet         attrs,
-                        const uint8_t * str,
-                        size_t          size) override;
+    bool terminalScroll(int16_t begin,
+                        int16_t end,
+                        int16_t rows) override;
+    void terminalDrawBg(UColor                        color,
+                        const std::vector<CellRect> & rects) override;
+    void terminalDrawFg(int16_t                    row,
+                        const std::vector<FgRun> & runs,
+                        const uint8_t            * str,
+                        size_t                     size) override;
     void terminalDrawCursor(Pos             pos,
                             UColor          fg,
                             UColor          bg,
@@ -169,17 +269,45 @@ protected:
                             size_t          size,
                             bool            wrapNext,
                             bool            focused) override;
+    bool terminalBlitRow(int16_t row, const Buffer::RowKey & key) override;
+    void terminalCaptureRow(int16_t row, const Buffer::RowKey & key) override;
     void terminalDrawScrollbar(size_t  totalRows,
                                size_t  historyOffset,
                                int16_t visibleRows) override;
-    void terminalFixDamageEnd(const Region & damage,
-                              bool           scrollbar) override;
+    void terminalFixDamageEnd(const RegionSet & damage,
+                              bool              scrollbar) override;
     void terminalReaped(int exitStatus) override;
 
     // FontManager::I_Client implementation:
 
     void useFontSet(FontSet * fontSet, int delta) override;
 
+    // DrawList::I_Target implementation:
+
+    void drawListScroll(int16_t begin,
+                        int16_t end,
+                        int16_t cols,
+                        int16_t rows) override;
+    void drawListBg(UColor                        color,
+                    const std::vector<CellRect> & rects) override;
+    void drawListFg(int16_t                    row,
+                    const std::vector<FgRun> & runs,
+                    const uint8_t            * str,
+                    size_t                     size) override;
+    void drawListCursor(Pos             pos,
+                        UColor          fg,
+                        UColor          bg,
+                        AttrSet         attrs,
+                        const uint8_t * str,
+                        size_t          size,
+                        bool            wrapNext,
+                        bool            focused) override;
+    void drawListScrollbar(size_t  totalRows,
+                           size_t  historyOffset,
+                           int16_t visibleRows) override;
+    void drawListEnd(const RegionSet & damage,
+                     bool              scrollbar) override;
+
     // I_Dispatcher::I_Observer overrides:
 
     void keyPress(xcb_key_press_event_t * event) noexcept override;
@@ -200,6 +328,7 @@ protected:
     void selectionNotify(xcb_selection_notify_event_t * event) noexcept override;
     void selectionRequest(xcb_selection_request_event_t * event) noexcept override;
     void clientMessage(xcb_client_message_event_t * event) noexcept override;
+    void propertyNotify(xcb_property_notify_event_t * event) noexcept override;
 
 private:
     DColor getColor(const UColor & ucolor) const {
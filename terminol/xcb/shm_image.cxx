@@ -0,0 +1,170 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#include "terminol/xcb/shm_image.hxx"
+#include "terminol/xcb/common.hxx"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+namespace {
+
+// Cairo's 32-bit formats match Z-pixmaps of depth 24/32 with 32 bits per pixel.
+bool hasPixmapFormat(xcb_connection_t * connection, uint8_t depth) {
+    auto setup = xcb_get_setup(connection);
+
+    for (auto iter = xcb_setup_pixmap_formats_iterator(setup);
+         iter.rem; xcb_format_next(&iter))
+    {
+        if (iter.data->depth == depth) {
+            return iter.data->bits_per_pixel == 32;
+        }
+    }
+
+    return false;
+}
+
+} // namespace {anonymous}
+
+ShmImage::ShmImage(Basics & basics, uint16_t width, uint16_t height) throw (Error) :
+    _basics(basics),
+    _width(width),
+    _height(height),
+    _depth(basics.screen()->root_depth),
+    _stride(0),
+    _data(nullptr),
+    _seg(0),
+    _surface(nullptr),
+    _fenced(false),
+    _fence()
+{
+    auto connection = _basics.connection();
+    auto extension  = xcb_get_extension_data(connection, &xcb_shm_id);
+
+    if (!extension || !extension->present) {
+        throw Error("MIT-SHM extension not present.");
+    }
+
+    if ((_depth != 24 && _depth != 32) || !hasPixmapFormat(connection, _depth)) {
+        throw Error("Unsupported depth for MIT-SHM.");
+    }
+
+    auto format = _depth == 32 ? CAIRO_FORMAT_ARGB32 : CAIRO_FORMAT_RGB24;
+    _stride = cairo_format_stride_for_width(format, _width);
+    ASSERT(_stride == 4 * _width, "Unexpected stride: " << _stride);
+
+    auto id = ::shmget(IPC_PRIVATE, static_cast<size_t>(_stride) * _height, IPC_CREAT | 0600);
+    if (id == -1) {
+        throw Error(std::string("Failed to create shm segment: ") + ::strerror(errno));
+    }
+
+    auto data = ::shmat(id, nullptr, 0);
+    if (data == reinterpret_cast<void *>(-1)) {
+        auto error = ::strerror(errno);
+        ::shmctl(id, IPC_RMID, nullptr);
+        throw Error(std::string("Failed to attach shm segment: ") + error);
+    }
+    _data = static_cast<uint8_t *>(data);
+
+    _seg = xcb_generate_id(connection);
+    auto cookie = xcb_shm_attach_checked(connection, _seg, id, 1);   // Read-only.
+    auto failed = xcb_request_failed(connection, cookie, "Failed to attach shm segment.");
+
+    // The server has attached (or failed to), so the segment can be marked
+    // for removal. It is destroyed once both sides have detached.
+    ::shmctl(id, IPC_RMID, nullptr);
+
+    if (failed) {
+        ::shmdt(_data);
+        throw Error("X server could not attach shm segment (remote display?).");
+    }
+
+    _surface = cairo_image_surface_create_for_data(_data, format, _width, _height, _stride);
+    ENFORCE(cairo_surface_status(_surface) == CAIRO_STATUS_SUCCESS,
+            "Bad cairo surface status.");
+}
+
+ShmImage::~ShmImage() {
+    await();
+
+    cairo_surface_finish(_surface);
+    cairo_surface_destroy(_surface);
+
+    xcb_shm_detach(_basics.connection(), _seg);
+    ::shmdt(_data);
+}
+
+void ShmImage::await() {
+    if (_fenced) {
+        std::free(xcb_get_input_focus_reply(_basics.connection(), _fence, nullptr));
+        _fenced = false;
+    }
+}
+
+void ShmImage::put(xcb_drawable_t drawable, xcb_gcontext_t gc, int x, int y, int w, int h) {
+    // Clip to the image.
+    auto x1 = std::min<int>(x + w, _width);
+    auto y1 = std::min<int>(y + h, _height);
+    x = std::max(x, 0);
+    y = std::max(y, 0);
+
+    if (x >= x1 || y >= y1) { return; }
+
+    cairo_surface_flush(_surface);
+
+    auto connection = _basics.connection();
+    xcb_shm_put_image(connection,
+                      drawable,
+                      gc,
+                      _width, _height,
+                      x, y,                 // src
+                      x1 - x, y1 - y,
+                      x, y,                 // dst
+                      _depth,
+                      XCB_IMAGE_FORMAT_Z_PIXMAP,
+                      0,                    // No completion event.
+                      _seg,
+                      0);
+
+    // Any request issued after the put is replied to after the put completes.
+    // Only the latest fence matters.
+    if (_fenced) {
+        xcb_discard_reply(connection, _fence.sequence);
+    }
+
+    _fence  = xcb_get_input_focus(connection);
+    _fenced = true;
+}
+
+void ShmImage::scroll(int x, int y, int w, int h, int dy) {
+    ASSERT(x >= 0 && y >= 0 && x + w <= _width && y + h <= _height, "");
+    ASSERT(std::abs(dy) < h, "");
+
+    await();
+    cairo_surface_flush(_surface);
+
+    auto rowBytes = 4 * w;
+    auto rows     = h - std::abs(dy);
+
+    if (dy > 0) {
+        for (auto r = 0; r != rows; ++r) {
+            std::memmove(_data + (y + r) * _stride + 4 * x,
+                         _data + (y + r + dy) * _stride + 4 * x,
+                         rowBytes);
+        }
+    }
+    else {
+        for (auto r = rows; r != 0; --r) {
+            std::memmove(_data + (y + r - 1 - dy) * _stride + 4 * x,
+                         _data + (y + r - 1) * _stride + 4 * x,
+                         rowBytes);
+        }
+    }
+
+    cairo_surface_mark_dirty(_surface);
+}
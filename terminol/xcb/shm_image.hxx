@@ -0,0 +1,53 @@
+// vi:noai:sw=4
+// Copyright © 2015 David Bryant
+
+#ifndef XCB__SHM_IMAGE__HXX
+#define XCB__SHM_IMAGE__HXX
+
+#include "terminol/xcb/basics.hxx"
+#include "terminol/support/pattern.hxx"
+
+#include <xcb/shm.h>
+#include <cairo/cairo.h>
+
+#include <string>
+
+// ShmImage is a client-side cairo image surface whose pixels live in a
+// MIT-SHM segment shared with the X server. Drawing into it generates no
+// protocol, and regions are pushed to a drawable with xcb_shm_put_image().
+// The server reads the segment asynchronously, so await() must be called
+// before the pixels are modified after a put().
+class ShmImage : protected Uncopyable {
+    Basics                       & _basics;
+    uint16_t                       _width;
+    uint16_t                       _height;
+    uint8_t                        _depth;
+    int                            _stride;
+    uint8_t                      * _data;
+    xcb_shm_seg_t                  _seg;
+    cairo_surface_t              * _surface;
+    bool                           _fenced;     // Is a put() possibly still being read?
+    xcb_get_input_focus_cookie_t   _fence;      // Replied to once the server has read it.
+
+public:
+    struct Error {
+        explicit Error(const std::string & message_) : message(message_) {}
+        std::string message;
+    };
+
+    ShmImage(Basics & basics, uint16_t width, uint16_t height) throw (Error);
+    ~ShmImage();
+
+    cairo_surface_t * getSurface() { return _surface; }
+
+    // Wait until the server has finished reading the last put().
+    void await();
+
+    // Copy a region to the same location in 'drawable'.
+    void put(xcb_drawable_t drawable, xcb_gcontext_t gc, int x, int y, int w, int h);
+
+    // Move the region up by 'dy' pixels (down if negative).
+    void scroll(int x, int y, int w, int h, int dy);
+};
+
+#endif // XCB__SHM_IMAGE__HXX
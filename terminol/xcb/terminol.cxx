@@ -7,7 +7,7 @@
 #include "terminol/xcb/basics.hxx"
 #include "terminol/xcb/common.hxx"
 #include "terminol/xcb/dispatcher.hxx"
-#include "terminol/common/simple_deduper.hxx"
+#include "terminol/common/deduper_factory.hxx"
 #include "terminol/common/config.hxx"
 #include "terminol/common/parser.hxx"
 #include "terminol/common/key_map.hxx"
@@ -17,6 +17,9 @@
 #include "terminol/support/debug.hxx"
 #include "terminol/support/pattern.hxx"
 #include "terminol/support/cmdline.hxx"
+#include "terminol/support/startup_trace.hxx"
+
+#include <memory>
 
 #include <xcb/xcb.h>
 #include <xcb/xcb_event.h>
@@ -29,12 +32,14 @@ class EventLoop :
     protected I_Selector::I_ReadHandler,
     protected Screen::I_Observer,
     protected I_Dispatcher::I_Observer,
+    protected StyleTable::I_Observer,
     protected Uncopyable
 {
     const Config     & _config;
     Selector           _selector;
     Pipe               _pipe;
-    SimpleDeduper      _deduper;
+    Pipe               _stylePipe;      // Wakes us to reclaim style ids.
+    std::unique_ptr<I_Deduper> _deduper;
     AsyncDestroyer     _destroyer;      // Must be declared after anything indirectly used by it.
     Basics             _basics;
     ColorSet           _colorSet;
@@ -57,7 +62,8 @@ public:
         _config(config),
         _selector(),
         _pipe(),
-        _deduper(),
+        _stylePipe(),
+        _deduper(createDeduper(config, _destroyer)),   // Note, _destroyer is constructed later.
         _destroyer(),
         _basics(),
         _colorSet(config, _basics),
@@ -66,13 +72,16 @@ public:
         _screen(*this,
                 config,
                 _selector,
-                _deduper,
+                *_deduper,
                 _destroyer,
                 _dispatcher,
                 _basics,
                 _colorSet,
                 _fontManager,
-                command),
+                0,
+                0,
+                command,
+                std::string()),
         _deferral(false),
         _exited(false)
     {
@@ -87,10 +96,14 @@ public:
                                          &mask);
         }
 
+        StyleTable::instance().setObserver(this);
+
+        StartupTrace::instant("event-loop");
         loop();
     }
 
     virtual ~EventLoop() {
+        StyleTable::instance().setObserver(nullptr);
         _singleton = nullptr;
     }
 
@@ -110,6 +123,7 @@ protected:
         auto oldHandler = signal(SIGCHLD, &staticSignalHandler);
 
         _selector.addReadable(_pipe.readFd(), this);
+        _selector.addReadable(_stylePipe.readFd(), this);
         _dispatcher.add(_basics.screen()->root, this);
 
         for (;;) {
@@ -123,6 +137,7 @@ protected:
         }
 
         _dispatcher.remove(_basics.screen()->root);
+        _selector.removeReadable(_stylePipe.readFd());
         _selector.removeReadable(_pipe.readFd());
 
         signal(SIGCHLD, oldHandler);
@@ -138,11 +153,39 @@ protected:
         _screen.tryReap();          // XXX We should assert that this success. Why bother with screenReaped?
     }
 
+    void reclaimStyles() {
+        char buf[BUFSIZ];
+        auto size = sizeof buf;
+
+        ENFORCE_SYS(TEMP_FAILURE_RETRY(::read(_stylePipe.readFd(),
+                                              static_cast<void *>(buf), size)) != -1, "");
+
+        std::vector<bool> used(StyleTable::CAPACITY, false);
+        _screen.markStyles(used);
+        _deduper->markStyles(used);
+
+        StyleTable::instance().reclaim(used);
+    }
+
     // I_Selector::I_ReadHandler implementation:
 
     void handleRead(int fd) override {
-        ASSERT(fd == _pipe.readFd(), "Bad fd.");
-        death();
+        if (fd == _stylePipe.readFd()) {
+            reclaimStyles();
+        }
+        else {
+            ASSERT(fd == _pipe.readFd(), "Bad fd.");
+            death();
+        }
+    }
+
+    // StyleTable::I_Observer implementation:
+
+    void stylesFilling() override {
+        // Called by whichever thread interned, with the table locked, so
+        // defer to this thread's loop.
+        char c = 0;
+        TEMP_FAILURE_RETRY(::write(_stylePipe.writeFd(), &c, 1));
     }
 
     // Screen::I_Observer implementation:
@@ -201,6 +244,7 @@ std::string makeHelp(const std::string & progName) {
         << "  --term-name=NAME" << std::endl
         << "  --trace" << std::endl
         << "  --sync" << std::endl
+        << "  --startup-trace=PATH" << std::endl
         ;
     return ost.str();
 }
@@ -208,15 +252,20 @@ std::string makeHelp(const std::string & progName) {
 } // namespace {anonymous}
 
 int main(int argc, char * argv[]) {
+    StartupTrace::instant("main");
+
     Config config;
 
     try {
+        StartupTrace::Scope trace("parse-config");
         parseConfig(config);
     }
     catch (const ParseError & error) {
         FATAL(error.message);
     }
 
+    auto startupTrace = StartupTrace::outputFromEnvironment();
+
     CmdLine cmdLine(makeHelp(argv[0]), VERSION, "--execute");
     cmdLine.add(new StringHandler(config.fontName), '\0', "font-name");
     cmdLine.add(new IntHandler(config.fontSize),    '\0', "font-size");
@@ -224,6 +273,7 @@ int main(int argc, char * argv[]) {
     cmdLine.add(new BoolHandler(config.syncTty),    '\0', "sync");
     cmdLine.add(new BoolHandler(config.traditionalWrapping), '\0', "traditional-wrapping");
     cmdLine.add(new StringHandler(config.termName), '\0', "term-name");
+    cmdLine.add(new StringHandler(startupTrace),    '\0', "startup-trace");
     cmdLine.add(new_MiscHandler([&](const std::string & name) {
                                 try {
                                     config.setColorScheme(name);
@@ -235,6 +285,7 @@ int main(int argc, char * argv[]) {
 
     try {
         auto command = cmdLine.parse(argc, const_cast<const char **>(argv));
+        StartupTrace::setOutput(startupTrace);
         EventLoop eventLoop(config, command);
     }
     catch (const EventLoop::Error & error) {
@@ -253,5 +304,8 @@ int main(int argc, char * argv[]) {
         FATAL(error.message);
     }
 
+    // In case no frame was drawn.
+    StartupTrace::finish();
+
     return 0;
 }
@@ -7,6 +7,11 @@
 #include "terminol/support/debug.hxx"
 #include "terminol/support/cmdline.hxx"
 
+#include <algorithm>
+
+#include <unistd.h>
+#include <limits.h>
+
 namespace {
 
 std::string makeHelp(const std::string & progName) {
@@ -17,7 +22,16 @@ std::string makeHelp(const std::string & progName) {
         << "Options:" << std::endl
         << "  --help" << std::endl
         << "  --socket=SOCKET" << std::endl
+        << "  --count=COUNT" << std::endl
+        << "  --rows=ROWS" << std::endl
+        << "  --cols=COLS" << std::endl
+        << "  --cwd=DIR" << std::endl
         << "  --shutdown" << std::endl
+        << "  --memory" << std::endl
+        << "  --frames" << std::endl
+        << "  --execute ARG [ARG]..." << std::endl
+        << std::endl
+        << "Prints the id of each window opened, a line each." << std::endl
         ;
     return ost.str();
 }
@@ -34,29 +48,96 @@ int main(int argc, char * argv[]) {
         FATAL(error.message);
     }
 
-    bool shutdown = false;
+    bool        shutdown = false;
+    bool        memory   = false;
+    bool        frames   = false;
+    int         count    = -1;      // One, unless querying.
+    int         rows     = 0;
+    int         cols     = 0;
+    std::string cwd;
 
-    CmdLine cmdLine(makeHelp(argv[0]), VERSION);
+    CmdLine cmdLine(makeHelp(argv[0]), VERSION, "--execute");
     cmdLine.add(new StringHandler(config.socketPath), '\0', "socket");
+    cmdLine.add(new IntHandler(count), '\0', "count");
+    cmdLine.add(new IntHandler(rows), '\0', "rows");
+    cmdLine.add(new IntHandler(cols), '\0', "cols");
+    cmdLine.add(new StringHandler(cwd), '\0', "cwd");
     cmdLine.add(new BoolHandler(shutdown), '\0', "shutdown");
+    cmdLine.add(new BoolHandler(memory), '\0', "memory");
+    cmdLine.add(new BoolHandler(frames), '\0', "frames");
 
     // Command line
 
+    control::Create create;
+
     try {
-        cmdLine.parse(argc, const_cast<const char **>(argv));
+        create.command = cmdLine.parse(argc, const_cast<const char **>(argv));
     }
     catch (const CmdLine::Error & error) {
         FATAL(error.message);
     }
 
+    if (count == -1) { count = memory || frames || shutdown ? 0 : 1; }
+
+    if (shutdown && (memory || frames || count != 0)) {
+        FATAL("--shutdown is exclusive.");
+    }
+
+    if (count < 0 || rows < 0 || rows > 0xFFFF || cols < 0 || cols > 0xFFFF) {
+        FATAL("Bad --count, --rows or --cols.");
+    }
+
+    create.rows = rows;
+    create.cols = cols;
+
+    // The server's directory is not ours.
+    if (!cwd.empty() && cwd.front() != '/') {
+        char buf[PATH_MAX];
+        if (!::getcwd(buf, sizeof buf)) { FATAL("Failed to get current directory."); }
+        cwd = std::string(buf) + "/" + cwd;
+    }
+    create.cwd = cwd;
+
     Selector selector;
 
     try {
-        Client client(selector, config, shutdown);
+        Client client(selector, config);
+
+        // Everything is sent at once, then the replies are awaited.
+        for (int i = 0; i != count; ++i) { client.create(create); }
+        if (memory)   { client.request(ControlRequest::MEMORY); }
+        if (frames)   { client.request(ControlRequest::FRAMES); }
+        if (shutdown) { client.request(ControlRequest::SHUTDOWN); }
 
         do {
             selector.animate();
         } while (!client.isFinished());
+
+        // In the order requested.
+        auto replies = client.getReplies();
+        std::sort(replies.begin(), replies.end(),
+                  [](const control::Frame & lhs, const control::Frame & rhs) {
+                  return lhs.tag < rhs.tag;
+                  });
+
+        bool failed = false;
+
+        for (auto & reply : replies) {
+            if (reply.type == ControlRequest::CREATE) {
+                auto window = control::decodeWindow(reply.payload);
+                if (window == 0) { failed = true; }
+                else { std::cout << window << std::endl; }
+            }
+            else {
+                std::cout.write(reinterpret_cast<const char *>(reply.payload.data()),
+                                reply.payload.size());
+            }
+        }
+
+        if (failed) {
+            ERROR("Failed to open window.");
+            return 1;
+        }
     }
     catch (const Client::Error & error) {
         FATAL(error.message);
@@ -7,51 +7,74 @@
 #include "terminol/xcb/basics.hxx"
 #include "terminol/xcb/common.hxx"
 #include "terminol/xcb/dispatcher.hxx"
-#include "terminol/common/simple_deduper.hxx"
+#include "terminol/common/deduper_factory.hxx"
+#include "terminol/common/history_budget.hxx"
 #include "terminol/common/config.hxx"
 #include "terminol/common/parser.hxx"
 #include "terminol/common/key_map.hxx"
 #include "terminol/common/server.hxx"
+#include "terminol/common/shell_pool.hxx"
 #include "terminol/support/async_destroyer.hxx"
 #include "terminol/support/selector.hxx"
+#include "terminol/support/worker.hxx"
 #include "terminol/support/pipe.hxx"
 #include "terminol/support/debug.hxx"
 #include "terminol/support/pattern.hxx"
 #include "terminol/support/cmdline.hxx"
+#include "terminol/support/startup_trace.hxx"
+#include "terminol/support/file_stream.hxx"
+#include "terminol/support/conv.hxx"
 
 #include <set>
 #include <map>
+#include <deque>
 #include <memory>
+#include <algorithm>
+#include <cerrno>
+#include <cctype>
+#include <cstring>
 
 #include <xcb/xcb.h>
 #include <xcb/xcb_event.h>
 #include <xcb/xcb_aux.h>
 
 #include <unistd.h>
+#include <dirent.h>
+#include <fcntl.h>
 #include <sys/select.h>
+#include <sys/stat.h>
 
 class EventLoop :
     protected I_Selector::I_ReadHandler,
     protected Screen::I_Observer,
     protected I_Dispatcher::I_Observer,
     protected I_Creator,
+    protected HistoryBudget::I_Observer,
+    protected StyleTable::I_Observer,
     protected Uncopyable
 {
     const Config                 & _config;
     Tty::Command                   _command;
     Selector                       _selector;
     Pipe                           _pipe;
-    SimpleDeduper                  _deduper;
+    Pipe                           _budgetPipe;     // Wakes us to enforce the budget.
+    Pipe                           _stylePipe;      // Wakes us to reclaim style ids.
+    std::unique_ptr<HistoryBudget> _budget;         // Shared by all screens, if any.
+    ShellPool                      _shellPool;      // Shells ready for new screens.
+    std::unique_ptr<I_Deduper>     _deduper;        // Shared by all screens.
     AsyncDestroyer                 _destroyer;      // Must be declared after anything indirectly used by it.
     Basics                         _basics;
     Server                         _server;
     ColorSet                       _colorSet;
     FontManager                    _fontManager;
     Dispatcher                     _dispatcher;
+    WorkerPool                     _pool;           // Own the screens' terminals, if any.
+    std::thread::id                _mainThread;
     std::map<xcb_window_t,
         std::unique_ptr<Screen>>   _screens;
     std::set<Screen *>             _deferrals;
     std::vector<Screen *>          _exits;
+    std::deque<uint64_t>           _snapshots;      // Saved histories awaiting a screen.
     bool                           _finished;
 
     static EventLoop             * _singleton;
@@ -68,16 +91,24 @@ public:
         _command(command),
         _selector(),
         _pipe(),
-        _deduper(),
+        _budgetPipe(),
+        _stylePipe(),
+        _budget(config.serverScrollBackBytes == 0 ? nullptr :
+                new HistoryBudget(*this, config.serverScrollBackBytes)),
+        _shellPool(_selector, config, command, config.shellPool),
+        _deduper(createDeduper(config, _destroyer, 4)),    // Note, _destroyer is constructed later.
         _destroyer(),
         _basics(),
         _server(*this, _selector, config),
         _colorSet(config, _basics),
         _fontManager(config, _basics),
         _dispatcher(_selector, _basics.connection() /* XXX */),
+        _pool(config.workerThreads),
+        _mainThread(std::this_thread::get_id()),
         _screens(),
         _deferrals(),
         _exits(),
+        _snapshots(),
         _finished(false)
     {
         ASSERT(!_singleton, "");
@@ -89,6 +120,12 @@ public:
             }
         }
 
+        StyleTable::instance().setObserver(this);
+
+        if (_config.persistHistory) {
+            findSnapshots();
+        }
+
         if (_config.x11PseudoTransparency) {
             uint32_t mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
             xcb_change_window_attributes(_basics.connection(),
@@ -97,10 +134,16 @@ public:
                                          &mask);
         }
 
+        StartupTrace::instant("event-loop");
         loop();
     }
 
     virtual ~EventLoop() {
+        // The workers own the terminals.
+        std::unique_lock<WorkerPool> lock(_pool);
+        StyleTable::instance().setObserver(nullptr);
+        _screens.clear();
+
         _singleton = nullptr;
     }
 
@@ -116,14 +159,23 @@ protected:
         TEMP_FAILURE_RETRY(::write(_pipe.writeFd(), &c, 1));
     }
 
+    // With worker threads, each screen's terminal belongs to a worker and
+    // everything else to this thread. This thread keeps all the workers
+    // locked except while it waits, so X events are handled, and screens
+    // created and destroyed, with no worker running. A worker's screen
+    // processes its tty output while this thread waits.
     void loop() {
         auto oldHandler = signal(SIGCHLD, &staticSignalHandler);
 
+        std::unique_lock<WorkerPool> lock(_pool);
+
         _selector.addReadable(_pipe.readFd(), this);
+        _selector.addReadable(_budgetPipe.readFd(), this);
+        _selector.addReadable(_stylePipe.readFd(), this);
         _dispatcher.add(_basics.screen()->root, this);
 
         while (!_finished) {
-            _selector.animate();
+            _selector.animate(lock);
 
             // Poll for X11 events that may not have shown up on the descriptor.
             _dispatcher.poll();
@@ -147,11 +199,120 @@ protected:
         }
 
         _dispatcher.remove(_basics.screen()->root);
+        _selector.removeReadable(_stylePipe.readFd());
+        _selector.removeReadable(_budgetPipe.readFd());
         _selector.removeReadable(_pipe.readFd());
 
         signal(SIGCHLD, oldHandler);
     }
 
+    std::string snapshotPath(uint64_t number) const {
+        return _config.historyDir + "/" + stringify(number);
+    }
+
+    // Snapshots are read back into new screens, so the directory must be a
+    // real directory of ours that no one else can write to, or anyone could
+    // plant a history.
+    bool checkHistoryDir() const {
+        struct stat st;
+
+        if (::lstat(_config.historyDir.c_str(), &st) == -1) {
+            if (errno != ENOENT) {
+                WARNING("Failed to stat history directory: " << _config.historyDir <<
+                        " (" << ::strerror(errno) << ")");
+            }
+            return false;
+        }
+
+        if (!S_ISDIR(st.st_mode) || st.st_uid != ::getuid() || (st.st_mode & 07777) != 0700) {
+            WARNING("Ignoring history directory, it must be a directory owned by the user "
+                    "with mode 0700: " << _config.historyDir);
+            return false;
+        }
+
+        return true;
+    }
+
+    // Find the histories saved by a previous instance, oldest first.
+    void findSnapshots() {
+        if (!checkHistoryDir()) { return; }
+
+        auto dir = ::opendir(_config.historyDir.c_str());
+        if (!dir) { return; }
+
+        while (auto entry = ::readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.empty() || !std::all_of(name.begin(), name.end(), ::isdigit)) {
+                continue;       // Not a snapshot.
+            }
+
+            struct stat st;
+            if (::fstatat(::dirfd(dir), name.c_str(), &st, AT_SYMLINK_NOFOLLOW) == -1 ||
+                !S_ISREG(st.st_mode) || st.st_uid != ::getuid())
+            {
+                WARNING("Ignoring snapshot, not a file of the user's: " <<
+                        _config.historyDir << "/" << name);
+                continue;
+            }
+
+            try {
+                _snapshots.push_back(unstringify<uint64_t>(name));
+            }
+            catch (const ParseError &) {
+                // Out of range.
+            }
+        }
+
+        ::closedir(dir);
+
+        std::sort(_snapshots.begin(), _snapshots.end());
+    }
+
+    // Save the history of every screen. Snapshots that were never restored
+    // are left in place, ahead of the new ones.
+    void saveSnapshots() {
+        if (::mkdir(_config.historyDir.c_str(), 0700) == -1 && errno != EEXIST) {
+            ERROR("Failed to create history directory: " << _config.historyDir <<
+                  " (" << ::strerror(errno) << ")");
+            return;
+        }
+
+        if (!checkHistoryDir()) { return; }
+
+        auto number = _snapshots.empty() ? uint64_t(0) : _snapshots.back() + 1;
+
+        for (auto & pair : _screens) {
+            auto path = snapshotPath(number);
+
+            try {
+                OutFileStream ostream(path);
+                pair.second->saveHistory(ostream);
+                ostream.commit();
+                _snapshots.push_back(number++);
+            }
+            catch (const StreamError &) {
+                ERROR("Failed to save history: " << path);
+            }
+        }
+    }
+
+    // The snapshot is read in the background. Failure to read it is
+    // reported by the terminal.
+    void restoreSnapshot(Screen & screen) {
+        auto path = snapshotPath(_snapshots.front());
+        _snapshots.pop_front();
+
+        try {
+            screen.restoreHistory(path);
+        }
+        catch (const StreamError &) {
+            ERROR("Failed to open history: " << path);
+        }
+
+        // Mapped by now, if it ever will be.
+        ::unlink(path.c_str());
+    }
+
     void death() {
         char buf[BUFSIZ];
         auto size = sizeof buf;
@@ -165,19 +326,79 @@ protected:
             auto & s = p.second;
             s->tryReap();
         }
+
+        _shellPool.tryReap();
+    }
+
+    // The workers are locked, so no buffer is charging the budget while
+    // some of them are evicted from.
+    void enforceBudget() {
+        char buf[BUFSIZ];
+        auto size = sizeof buf;
+
+        ENFORCE_SYS(TEMP_FAILURE_RETRY(::read(_budgetPipe.readFd(),
+                                              static_cast<void *>(buf), size)) != -1, "");
+
+        _budget->enforce();
+    }
+
+    // The workers are locked, so no cells are on the move while the ids
+    // in use are gathered.
+    void reclaimStyles() {
+        char buf[BUFSIZ];
+        auto size = sizeof buf;
+
+        ENFORCE_SYS(TEMP_FAILURE_RETRY(::read(_stylePipe.readFd(),
+                                              static_cast<void *>(buf), size)) != -1, "");
+
+        std::vector<bool> used(StyleTable::CAPACITY, false);
+
+        for (auto & p : _screens) { p.second->markStyles(used); }
+        _deduper->markStyles(used);
+
+        StyleTable::instance().reclaim(used);
     }
 
     // I_Selector::I_ReadHandler implementation:
 
     void handleRead(int fd) override {
-        ASSERT(fd == _pipe.readFd(), "Bad fd.");
-        death();
+        if (fd == _budgetPipe.readFd()) {
+            enforceBudget();
+        }
+        else if (fd == _stylePipe.readFd()) {
+            reclaimStyles();
+        }
+        else {
+            ASSERT(fd == _pipe.readFd(), "Bad fd.");
+            death();
+        }
+    }
+
+    // HistoryBudget::I_Observer implementation:
+
+    void budgetExceeded() override {
+        // Called by whichever thread charged the budget, quite possibly in the
+        // middle of a buffer operation, so defer to the main thread.
+        char c = 0;
+        TEMP_FAILURE_RETRY(::write(_budgetPipe.writeFd(), &c, 1));
+    }
+
+    // StyleTable::I_Observer implementation:
+
+    void stylesFilling() override {
+        // Likewise, and the table is locked.
+        char c = 0;
+        TEMP_FAILURE_RETRY(::write(_stylePipe.writeFd(), &c, 1));
     }
 
     // Screen::I_Observer implementation:
 
     void screenSync() override {
-        _dispatcher.wait(XCB_CONFIGURE_NOTIFY);
+        // Only this thread may handle X events. A worker's screen will see
+        // the configure notification in due course.
+        if (std::this_thread::get_id() == _mainThread) {
+            _dispatcher.wait(XCB_CONFIGURE_NOTIFY);
+        }
     }
 
     void screenDefer(Screen * screen) override {
@@ -216,26 +437,130 @@ protected:
 
     // I_Creator implementation:
 
-    void create() override {
+    uint32_t create(const control::Create & request) override {
+        // The pool's shells run our command, in our directory.
+        auto pooled  = request.command.empty() && request.cwd.empty();
+        auto command = request.command.empty() ? _command : request.command;
+        // Whatever the request, the window's pixel size must fit 16 bits.
+        const uint16_t maxGeometry = 1000;
+
         try {
+            auto & selector = _pool.isEmpty() ?
+                static_cast<I_Selector &>(_selector) : _pool.choose().getSelector();
             std::unique_ptr<Screen> screen(
-                new Screen(*this, _config, _selector, _deduper, _destroyer, _dispatcher,
-                           _basics, _colorSet, _fontManager, _command));
+                new Screen(*this, _config, selector, *_deduper, _destroyer, _dispatcher,
+                           _basics, _colorSet, _fontManager,
+                           std::min(request.rows, maxGeometry),
+                           std::min(request.cols, maxGeometry),
+                           command, request.cwd, pooled ? &_shellPool : nullptr,
+                           _budget.get()));
+            if (!_snapshots.empty()) { restoreSnapshot(*screen); }
             auto id = screen->getWindowId();
             _screens.insert(std::make_pair(id, std::move(screen)));
+            return id;
         }
         catch (const Screen::Error & error) {
-            PRINT("Failed to create screen: " << error.message);
+            ERROR("Failed to create screen: " << error.message);
+            return 0;
         }
     }
 
     void shutdown() override {
+        if (_config.persistHistory) {
+            saveSnapshots();
+        }
+
         for (auto & pair : _screens) {
             pair.second->killReap();
         }
 
         _finished = true;
     }
+
+    // Sizes are in bytes. The workers are locked, so the screens are still.
+    void memoryReport(std::string & report) override {
+        std::ostringstream ost;
+        size_t             total = 0;
+
+        for (auto & pair : _screens) {
+            Screen::MemoryStats stats;
+            pair.second->getMemoryStats(stats);
+            auto & buffers = stats.buffers;
+            auto   sum     = buffers.total() + stats.surface + stats.rowCache;
+
+            ost << "window=0x"           << std::hex << pair.first << std::dec
+                << " tags="              << buffers.tags
+                << " history="           << buffers.history
+                << " active="            << buffers.active
+                << " pending="           << buffers.pending
+                << " line-cache="        << buffers.cache
+                << " line-cache-hits="   << buffers.cacheHits
+                << " line-cache-misses=" << buffers.cacheMisses
+                << " surface="           << stats.surface
+                << " row-cache="         << stats.rowCache
+                << " total="             << sum << std::endl;
+
+            total += sum;
+        }
+
+        uint32_t uniqueLines, totalLines;
+        size_t   uniqueBytes, totalBytes;
+        _deduper->getLineStats(uniqueLines, totalLines);
+        _deduper->getByteStats(uniqueBytes, totalBytes);
+
+        ost << "deduper unique-lines=" << uniqueLines
+            << " total-lines="         << totalLines
+            << " unique-bytes="        << uniqueBytes
+            << " total-bytes="         << totalBytes << std::endl;
+
+        total += uniqueBytes;
+
+        auto & styles     = StyleTable::instance();
+        auto   styleBytes = styles.bytes();
+
+        ost << "styles count=" << styles.size()
+            << " bytes="       << styleBytes << std::endl;
+
+        total += styleBytes;
+
+        if (_budget) {
+            ost << "budget limit=" << _budget->getLimit()
+                << " bytes="       << _budget->getBytes() << std::endl;
+        }
+
+        size_t                       pending;
+        I_Destroyer::Clock::duration meanLatency, maxLatency;
+        _destroyer.getStats(pending, meanLatency, maxLatency);
+
+        typedef std::chrono::duration<double, std::milli> Millis;
+
+        ost << "destroyer pending="   << pending
+            << " mean-latency-ms="    << Millis(meanLatency).count()
+            << " max-latency-ms="     << Millis(maxLatency).count() << std::endl;
+
+        size_t fontSets, glyphBytes;
+        Screen::getFontMemoryStats(_fontManager, fontSets, glyphBytes);
+
+        ost << "fonts sets="    << fontSets
+            << " glyph-bytes=" << glyphBytes << std::endl;
+
+        total += glyphBytes;
+
+        ost << "total=" << total << std::endl;
+
+        report = ost.str();
+    }
+
+    void frameReport(std::string & report) override {
+        std::ostringstream ost;
+
+        for (auto & pair : _screens) {
+            ost << "window=0x" << std::hex << pair.first << std::dec << std::endl;
+            pair.second->dumpFrames(ost);
+        }
+
+        report = ost.str();
+    }
 };
 
 EventLoop * EventLoop::_singleton = nullptr;
@@ -262,6 +587,7 @@ std::string makeHelp(const std::string & progName) {
         << "  --sync|--no-sync" << std::endl
         << "  --socket=SOCKET" << std::endl
         << "  --fork|--no-fork" << std::endl
+        << "  --startup-trace=PATH" << std::endl
         ;
     return ost.str();
 }
@@ -269,15 +595,20 @@ std::string makeHelp(const std::string & progName) {
 } // namespace {anonymous}
 
 int main(int argc, char * argv[]) {
+    StartupTrace::instant("main");
+
     Config config;
 
     try {
+        StartupTrace::Scope trace("parse-config");
         parseConfig(config);
     }
     catch (const ParseError & error) {
         FATAL(error.message);
     }
 
+    auto startupTrace = StartupTrace::outputFromEnvironment();
+
     CmdLine cmdLine(makeHelp(argv[0]), VERSION, "--execute");
     cmdLine.add(new StringHandler(config.fontName),   '\0', "font-name");
     cmdLine.add(new IntHandler(config.fontSize),      '\0', "font-size");
@@ -287,6 +618,7 @@ int main(int argc, char * argv[]) {
     cmdLine.add(new StringHandler(config.termName),   '\0', "term-name");
     cmdLine.add(new StringHandler(config.socketPath), '\0', "socket");
     cmdLine.add(new BoolHandler(config.serverFork),   '\0', "fork");
+    cmdLine.add(new StringHandler(startupTrace),     '\0', "startup-trace");
     cmdLine.add(new_MiscHandler([&](const std::string & name) {
                                 try {
                                     config.setColorScheme(name);
@@ -298,6 +630,7 @@ int main(int argc, char * argv[]) {
 
     try {
         auto command = cmdLine.parse(argc, const_cast<const char **>(argv));
+        StartupTrace::setOutput(startupTrace);
         EventLoop eventLoop(config, command);
     }
     catch (const EventLoop::Error & error) {
@@ -316,6 +649,9 @@ int main(int argc, char * argv[]) {
         FATAL(error.message);
     }
 
+    // In case no frame was drawn.
+    StartupTrace::finish();
+
     return 0;
 }
 
@@ -35,7 +35,8 @@ Widget::Widget(I_Dispatcher & dispatcher,
         XCB_EVENT_MASK_POINTER_MOTION_HINT | XCB_EVENT_MASK_POINTER_MOTION |
         XCB_EVENT_MASK_EXPOSURE |
         XCB_EVENT_MASK_STRUCTURE_NOTIFY |
-        XCB_EVENT_MASK_FOCUS_CHANGE,
+        XCB_EVENT_MASK_FOCUS_CHANGE |
+        XCB_EVENT_MASK_PROPERTY_CHANGE,  // For incremental selection transfers.
         // XCB_CW_CURSOR
         _basics.normalCursor()
     };
@@ -35,6 +35,8 @@ protected:
 
     xcb_window_t getWindow() { return _window; }
 
+    I_Dispatcher & getDispatcher() { return _dispatcher; }
+
 private:
     I_Dispatcher  & _dispatcher;
     Basics        & _basics;